@@ -4,6 +4,8 @@
 
 #include <pthread.h>
 
+#include "errors.hpp"
+
 // Class that wraps a pthread mutex
 class system_mutex_t {
     pthread_mutex_t m;
@@ -45,19 +45,42 @@ int epoll_to_user(int mode) {
 }
 
 epoll_event_queue_t::epoll_event_queue_t(linux_queue_parent_t *_parent)
-    : parent(_parent) {
+    : parent(_parent), spins(MIN_EVENT_QUEUE_SPINS) {
     // Create a poll fd
 
     epoll_fd = epoll_create1(0);
     guarantee_err(epoll_fd >= 0, "Could not create epoll fd");
 }
 
+static inline void cpu_relax() {
+#if defined(__i386__) || defined(__x86_64__)
+    asm volatile("pause" ::: "memory");
+#else
+    asm volatile("" ::: "memory");
+#endif
+}
+
+bool epoll_event_queue_t::spin_for_messages() {
+    for (int i = 0; i < spins; ++i) {
+        if (parent->has_incoming_messages()) {
+            spins = std::min(spins * 2, MAX_EVENT_QUEUE_SPINS);
+            return true;
+        }
+        cpu_relax();
+    }
+    spins = std::max(spins / 2, MIN_EVENT_QUEUE_SPINS);
+    return false;
+}
+
 void epoll_event_queue_t::run() {
     int res;
 
     // Now, start the loop
     while (!parent->should_shut_down()) {
-        // Grab the events from the kernel!
+        // Grab the events from the kernel! If messages from other threads show up
+        // while we spin, their senders have signalled their eventfds, so
+        // epoll_wait() returns right away instead of putting us to sleep.
+        spin_for_messages();
         res = epoll_wait(epoll_fd, events, MAX_IO_EVENT_PROCESSING_BATCH_SIZE, -1);
 
         // epoll_wait might return with EINTR in some cases (in
@@ -30,6 +30,13 @@ private:
     epoll_event events[MAX_IO_EVENT_PROCESSING_BATCH_SIZE];
     int nevents;
 
+    // How many times to poll for messages from other threads before blocking in
+    // epoll_wait(), between MIN_EVENT_QUEUE_SPINS and MAX_EVENT_QUEUE_SPINS.
+    int spins;
+
+    // Spins for a while and returns true if messages from other threads show up.
+    bool spin_for_messages();
+
 #ifndef NDEBUG
     /* In debug mode, check to make sure epoll() doesn't give us events that
     we didn't ask for. The ints stored here are combinations of poll_event_in
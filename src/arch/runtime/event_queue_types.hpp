@@ -25,6 +25,8 @@ private:
 struct linux_queue_parent_t {
     virtual void pump() = 0;
     virtual bool should_shut_down() = 0;
+    // Whether other threads have sent this thread messages that it hasn't handled yet.
+    virtual bool has_incoming_messages() = 0;
     virtual ~linux_queue_parent_t() {}
 };
 
@@ -15,7 +15,7 @@
 #endif
 
 linux_message_hub_t::linux_message_hub_t(linux_event_queue_t *queue, linux_thread_pool_t *thread_pool, int current_thread)
-    : queue_(queue), thread_pool_(thread_pool), current_thread_(current_thread) {
+    : queue_(queue), thread_pool_(thread_pool), incoming_signalled_(0), current_thread_(current_thread) {
 
     // We have to do this through dynamically, otherwise we might
     // allocate far too many file descriptors since this is what the
@@ -24,9 +24,6 @@ linux_message_hub_t::linux_message_hub_t(linux_event_queue_t *queue, linux_threa
     notify_ = new notify_t[thread_pool_->n_threads];
 
     for (int i = 0; i < thread_pool_->n_threads; i++) {
-        int res = pthread_spin_init(&incoming_messages_lock_, PTHREAD_PROCESS_PRIVATE);
-        guarantee(res == 0, "Could not initialize spin lock");
-
         // Create notify fd for other cores that send work to us
         notify_[i].notifier_thread = i;
         notify_[i].parent = this;
@@ -36,17 +33,11 @@ linux_message_hub_t::linux_message_hub_t(linux_event_queue_t *queue, linux_threa
 }
 
 linux_message_hub_t::~linux_message_hub_t() {
-    int res;
-
     for (int i = 0; i < thread_pool_->n_threads; i++) {
         rassert(queues_[i].msg_local_list.empty());
-
-        res = pthread_spin_destroy(&incoming_messages_lock_);
-        guarantee(res == 0, "Could not destroy spin lock");
+        rassert(notify_[i].incoming.empty());
     }
 
-    rassert(incoming_messages_.empty());
-
     delete[] notify_;
 }
 
@@ -90,12 +81,21 @@ void linux_message_hub_t::store_message_sometime(unsigned int nthread, linux_thr
 
 
 void linux_message_hub_t::insert_external_message(linux_thread_message_t *msg) {
-    pthread_spin_lock(&incoming_messages_lock_);
-    incoming_messages_.push_back(msg);
-    pthread_spin_unlock(&incoming_messages_lock_);
+    notify_[current_thread_].incoming.push(msg);
+    notify_[current_thread_].wake_up();
+}
 
-    // Wakey wakey eggs and bakey
-    notify_[current_thread_].event.write(1);
+bool linux_message_hub_t::has_incoming_messages() const {
+    return incoming_signalled_;
+}
+
+void linux_message_hub_t::notify_t::wake_up() {
+    // Wakey wakey eggs and bakey. (Unless someone else already did since the receiver
+    // last looked at `incoming`, in which case it's sure to look again.)
+    if (__sync_bool_compare_and_swap(&signalled, 0, 1)) {
+        parent->incoming_signalled_ = 1;
+        event.write(1);
+    }
 }
 
 void linux_message_hub_t::notify_t::on_event(int events) {
@@ -108,13 +108,17 @@ void linux_message_hub_t::notify_t::on_event(int events) {
     // don't pester us and use 100% cpu
     event.read();
 
-    msg_list_t msg_list;
+    // Let senders signal us again before we look at the queue, so that whatever gets
+    // pushed after we've drained it gets us another event.
+    parent->incoming_signalled_ = 0;
+    signalled = 0;
+    __sync_synchronize();
 
-    pthread_spin_lock(&parent->incoming_messages_lock_);
     // Pull the messages
-    //msg_list.append_and_clear(parent->thread_pool_->threads[parent->current_thread_]->message_hub);
-    msg_list.append_and_clear(&parent->incoming_messages_);
-    pthread_spin_unlock(&parent->incoming_messages_lock_);
+    msg_list_t msg_list;
+    while (linux_thread_message_t *m = incoming.pop()) {
+        msg_list.push_back(m);
+    }
 
 #ifndef NDEBUG
     start_watchdog(); // Initialize watchdog before handling messages
@@ -138,32 +142,18 @@ void linux_message_hub_t::notify_t::on_event(int events) {
     }
 }
 
-// Pushes messages collected locally global lists available to all
-// threads.
+// Pushes messages collected locally onto the queues that the other threads
+// keep for messages from this thread.
 void linux_message_hub_t::push_messages() {
     for (int i = 0; i < thread_pool_->n_threads; i++) {
-        // Append the local list for ith thread to that thread's global
-        // message list.
+        // Move the local list for ith thread onto that thread's queue for
+        // messages from us.
         thread_queue_t *queue = &queues_[i];
         if (!queue->msg_local_list.empty()) {
             // Transfer messages to the other core
-
-            pthread_spin_lock(&thread_pool_->threads[i]->message_hub.incoming_messages_lock_);
-
-            //We only need to do a wake up if the global
-            bool do_wake_up = thread_pool_->threads[i]->message_hub.incoming_messages_.empty();
-
-            thread_pool_->threads[i]->message_hub.incoming_messages_.append_and_clear(&queue->msg_local_list);
-
-            pthread_spin_unlock(&thread_pool_->threads[i]->message_hub.incoming_messages_lock_);
-
-            // Wakey wakey, perhaps eggs and bakey
-            if (do_wake_up) {
-                thread_pool_->threads[i]->message_hub.notify_[current_thread_].event.write(1);
-            }
+            notify_t *notify = &thread_pool_->threads[i]->message_hub.notify_[current_thread_];
+            notify->incoming.push_all(&queue->msg_local_list);
+            notify->wake_up();
         }
-
-        // TODO: we should use regular mutexes on single core CPU
-        // instead of spinlocks
     }
 }
@@ -2,10 +2,10 @@
 #ifndef ARCH_RUNTIME_MESSAGE_HUB_HPP_
 #define ARCH_RUNTIME_MESSAGE_HUB_HPP_
 
-#include <pthread.h>
 #include <strings.h>
 #include "arch/runtime/system_event.hpp"
 #include "containers/intrusive_list.hpp"
+#include "containers/mpsc_queue.hpp"
 #include "utils.hpp"
 #include "config/args.hpp"
 #include "arch/runtime/event_queue.hpp"
@@ -19,7 +19,13 @@ class linux_thread_pool_t;
 /* There is one message hub per thread, NOT one message hub for the entire program.
 
 Each message hub stores messages that are going from that message hub's home thread to
-other threads. It keeps a separate queue for messages destined for each other thread. */
+other threads. It keeps a separate queue for messages destined for each other thread.
+
+push_messages() moves each of those batches onto a lock-free queue that the receiving
+hub keeps for messages from our thread, so there is a queue for every pair of threads
+and no locks between them. The sender only writes to the receiver's eventfd if the
+receiver has drained that queue since the last time, so a receiver that's busy gets
+woken up once however many batches get pushed to it in the meantime. */
 
 class linux_message_hub_t {
 public:
@@ -27,8 +33,8 @@ public:
 
     linux_message_hub_t(linux_event_queue_t *queue, linux_thread_pool_t *thread_pool, int current_thread);
 
-    /* For each thread, transfer messages from our msg_local_list for that thread to our
-    msg_global_list for that thread */
+    /* For each thread, transfer messages from our msg_local_list for that thread to that
+    thread's queue for messages from us */
     void push_messages();
 
     /* Schedules the given message to be sent to the given thread by pushing it onto our
@@ -43,6 +49,11 @@ public:
     // (which does not have an event queue)
     void insert_external_message(linux_thread_message_t *msg);
 
+    // Whether another thread has signalled us since we last started handling messages
+    // from other threads. The event queue spins on this for a while before it goes
+    // to sleep.
+    bool has_incoming_messages() const;
+
     ~linux_message_hub_t();
 
 private:
@@ -64,28 +75,40 @@ private:
     struct thread_queue_t {
         //TODO this doesn't need to be a class anymore
 
-        /* Messages are cached here before being pushed to the global list so that we don't
-        have to acquire the spinlock as often */
+        /* Messages are cached here before being pushed to the other thread's queue so that
+        we push them (and signal the other thread) in batches */
         msg_list_t msg_local_list;
     } queues_[MAX_THREADS];
 
-    msg_list_t incoming_messages_;
-    pthread_spinlock_t incoming_messages_lock_;
-
     /* We keep one notify_t for each other message hub that we interact with. When it has
-    messages for us, it signals the appropriate notify_t from our set of notify_ts. We get
-    the notification and call push_messages on the sender in reply. */
+    messages for us, it pushes them onto the `incoming` queue of the appropriate notify_t
+    from our set of notify_ts and signals it. We get the notification and deliver the
+    messages. */
     struct notify_t : public linux_event_callback_t
     {
     public:
+        notify_t() : signalled(0) { }
+
         /* message_hubs[i]->notify[j].on_event() is called when thread #j has messages for
         thread #i. */
         void on_event(int events);
 
+        /* Called by the sender after pushing onto `incoming`. */
+        void wake_up();
+
     public:
         /* hub->notify[j].notifier_thread == j */
         int notifier_thread;
 
+        /* Messages from thread #notifier_thread. hub->notify[hub->current_thread_] also
+        gets the messages that the main thread sends with insert_external_message(), so
+        it can have two producers. */
+        mpsc_queue_t<linux_thread_message_t> incoming;
+
+        /* 1 from when a sender writes to `event` until we start draining `incoming`.
+        While it's set, senders don't write to `event` again. */
+        volatile int signalled;
+
         system_event_t event;                    // the eventfd to notify
 
         /* hub->notify[i].parent = hub */
@@ -93,6 +116,11 @@ private:
     };
     notify_t *notify_;
 
+    /* Set by whichever notify_t last got signalled, and cleared when we handle one. It's
+    only a hint (it can be cleared while another notify_t's event is still pending), but
+    it's a single word for the event queue to spin on. */
+    volatile int incoming_signalled_;
+
     /* The thread that we queue messages originating from. (Recall that there is one
     message_hub_t per thread.) */
     const unsigned int current_thread_;
@@ -0,0 +1,162 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "arch/runtime/migratable_task.hpp"
+
+#include <algorithm>
+
+#include "arch/runtime/runtime.hpp"
+#include "arch/runtime/thread_pool.hpp"
+
+/* The tasks from one call to run_migratable_tasks(), and the steal requests it
+sent out. Whichever thread finishes the last of them sends this back to the
+waiting coroutine's thread. */
+class migratable_task_group_t : public linux_thread_message_t {
+public:
+    explicit migratable_task_group_t(int n_tasks_and_requests)
+        : waiter_(coro_t::self()), home_thread_(get_thread_id()), remaining_(n_tasks_and_requests) {
+        rassert(waiter_ != NULL);
+    }
+
+    int home_thread() const { return home_thread_; }
+
+    // Called once for every task and every steal request, on any thread.
+    void done() {
+        if (__sync_sub_and_fetch(&remaining_, 1) == 0) {
+            if (continue_on_thread(home_thread_, this)) {
+                on_thread_switch();
+            }
+        }
+    }
+
+private:
+    void on_thread_switch() {
+        waiter_->notify_sometime();
+    }
+
+    coro_t *const waiter_;
+    const int home_thread_;
+    volatile int remaining_;
+
+    DISABLE_COPYING(migratable_task_group_t);
+};
+
+static void run_queued_task(const migratable_task_queue_t::queued_task_t &task) {
+    task.task->run();
+    task.group->done();
+}
+
+/* Asks another thread to steal tasks from the queue of `group`'s thread. It
+steals one task per message and goes around its event loop before it steals
+the next one, so that a thread that has work of its own isn't held up by ours
+for longer than a task at a time. The request is done once the queue is empty;
+the group waits for that too, so that no request is still on its way when the
+caller moves on (or the thread pool shuts down). */
+class migratable_steal_request_t : public linux_thread_message_t {
+public:
+    explicit migratable_steal_request_t(migratable_task_group_t *group) : group_(group) { }
+
+private:
+    void on_thread_switch() {
+        migratable_task_queue_t *queue = &linux_thread_pool_t::thread_pool->threads[group_->home_thread()]->migratable_tasks;
+        migratable_task_queue_t::queued_task_t task;
+        if (queue->steal_front(&task)) {
+            call_later_on_this_thread(this);
+            run_queued_task(task);
+        } else {
+            migratable_task_group_t *group = group_;
+            delete this;
+            group->done();
+        }
+    }
+
+    migratable_task_group_t *const group_;
+
+    DISABLE_COPYING(migratable_steal_request_t);
+};
+
+void run_migratable_tasks(const std::vector<migratable_task_t *> &tasks) {
+    if (tasks.empty()) {
+        return;
+    }
+
+    linux_thread_pool_t *pool = linux_thread_pool_t::thread_pool;
+    const int me = linux_thread_pool_t::thread_id;
+    migratable_task_queue_t *queue = &pool->threads[me]->migratable_tasks;
+
+    // Ask as many other threads to help as there are tasks we won't be running
+    // right away.
+    const int helpers = std::min<int>(tasks.size() - 1, pool->n_threads - 1);
+
+    migratable_task_group_t group(tasks.size() + helpers);
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        migratable_task_queue_t::queued_task_t task;
+        task.task = tasks[i];
+        task.group = &group;
+        queue->push_back(task);
+    }
+
+    // Start at a different thread each time, so that the same few threads
+    // don't get asked every time.
+    static __thread int next_helper = 0;
+    for (int i = 0; i < helpers; ++i) {
+        next_helper = (next_helper + 1) % pool->n_threads;
+        if (next_helper == me) {
+            next_helper = (next_helper + 1) % pool->n_threads;
+        }
+        DEBUG_VAR bool same_thread = continue_on_thread(next_helper, new migratable_steal_request_t(&group));
+        rassert(!same_thread);
+    }
+
+    // Messages normally go out when the event loop comes around again, but we're
+    // about to keep it busy for a while.
+    pool->threads[me]->message_hub.push_messages();
+
+    // Work through our own tasks (and anything else that's on our queue) while the
+    // others steal from the front.
+    migratable_task_queue_t::queued_task_t task;
+    while (queue->pop_back(&task)) {
+        run_queued_task(task);
+    }
+
+    // Wait for the tasks that got stolen, and for the helpers to notice that
+    // there's nothing left.
+    coro_t::wait();
+}
+
+migratable_task_queue_t::migratable_task_queue_t() {
+    int res = pthread_spin_init(&lock_, PTHREAD_PROCESS_PRIVATE);
+    guarantee(res == 0, "Could not initialize spin lock");
+}
+
+migratable_task_queue_t::~migratable_task_queue_t() {
+    rassert(tasks_.empty());
+    int res = pthread_spin_destroy(&lock_);
+    guarantee(res == 0, "Could not destroy spin lock");
+}
+
+void migratable_task_queue_t::push_back(const queued_task_t &task) {
+    pthread_spin_lock(&lock_);
+    tasks_.push_back(task);
+    pthread_spin_unlock(&lock_);
+}
+
+bool migratable_task_queue_t::pop_back(queued_task_t *task_out) {
+    pthread_spin_lock(&lock_);
+    bool found = !tasks_.empty();
+    if (found) {
+        *task_out = tasks_.back();
+        tasks_.pop_back();
+    }
+    pthread_spin_unlock(&lock_);
+    return found;
+}
+
+bool migratable_task_queue_t::steal_front(queued_task_t *task_out) {
+    pthread_spin_lock(&lock_);
+    bool found = !tasks_.empty();
+    if (found) {
+        *task_out = tasks_.front();
+        tasks_.pop_front();
+    }
+    pthread_spin_unlock(&lock_);
+    return found;
+}
@@ -0,0 +1,63 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef ARCH_RUNTIME_MIGRATABLE_TASK_HPP_
+#define ARCH_RUNTIME_MIGRATABLE_TASK_HPP_
+
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+
+#include "arch/runtime/runtime_utils.hpp"
+
+/* Coroutines are bound to their home thread, so a CPU-heavy coroutine keeps its
+thread busy while the others might sit idle. Work that doesn't need that can be
+split into migratable tasks and handed to `run_migratable_tasks()`, which lets
+the other threads of the thread pool steal them, one at a time in between their
+own work.
+
+A migratable task runs on whatever thread steals it, outside of any coroutine,
+so it must not block, spawn or switch coroutines, or touch anything that
+belongs to a particular thread (thread-local variables, `home_thread_mixin_t`
+objects, perfmon stats, the cache, the js runner...). It also must not throw;
+catch exceptions in `run()` and hand them back to whoever is waiting. */
+class migratable_task_t {
+public:
+    virtual void run() = 0;
+protected:
+    virtual ~migratable_task_t() { }
+};
+
+/* Runs all of `tasks` and returns when they've all run. Must be called in a
+coroutine on a thread pool thread. The calling thread runs tasks too (so none of
+them get queued behind other work on its event loop), and the other threads get
+asked to steal what it hasn't gotten to yet. The caller keeps ownership of the
+tasks. */
+void run_migratable_tasks(const std::vector<migratable_task_t *> &tasks);
+
+class migratable_task_group_t;
+
+/* Each thread has one of these, holding the migratable tasks that were started
+on that thread. The thread itself takes its tasks from the back; other threads
+steal from the front. */
+class migratable_task_queue_t {
+public:
+    migratable_task_queue_t();
+    ~migratable_task_queue_t();
+
+    struct queued_task_t {
+        migratable_task_t *task;
+        migratable_task_group_t *group;
+    };
+
+    void push_back(const queued_task_t &task);
+    bool pop_back(queued_task_t *task_out);
+    bool steal_front(queued_task_t *task_out);
+
+private:
+    pthread_spinlock_t lock_;
+    std::deque<queued_task_t> tasks_;
+
+    DISABLE_COPYING(migratable_task_queue_t);
+};
+
+#endif  // ARCH_RUNTIME_MIGRATABLE_TASK_HPP_
@@ -7,11 +7,16 @@
 #include <string>
 
 #include "containers/intrusive_list.hpp"
+#include "containers/mpsc_queue.hpp"
 
 typedef int fd_t;
 #define INVALID_FD fd_t(-1)
 
-class linux_thread_message_t : public intrusive_list_node_t<linux_thread_message_t> {
+// Messages wait on an intrusive list on the sending thread, then get moved onto an
+// mpsc_queue_t for the receiving thread.
+class linux_thread_message_t :
+    public intrusive_list_node_t<linux_thread_message_t>,
+    public mpsc_queue_node_t<linux_thread_message_t> {
 public:
     linux_thread_message_t() 
 #ifndef NDEBUG
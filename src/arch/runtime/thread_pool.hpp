@@ -11,6 +11,7 @@
 #include "arch/runtime/event_queue.hpp"
 #include "arch/runtime/system_event.hpp"
 #include "arch/runtime/message_hub.hpp"
+#include "arch/runtime/migratable_task.hpp"
 #include "arch/runtime/coroutines.hpp"
 #include "arch/io/blocker_pool.hpp"
 #include "arch/timer.hpp"
@@ -149,12 +150,16 @@ public:
     linux_message_hub_t message_hub;
     timer_handler_t timer_handler;
 
+    /* Migratable tasks started on this thread that nobody has run yet. */
+    migratable_task_queue_t migratable_tasks;
+
     /* Never accessed; its constructor and destructor set up and tear down thread-local variables
     for coroutines. */
     coro_runtime_t coro_runtime;
 
     void pump();   // Called by the event queue
     bool should_shut_down();   // Called by the event queue
+    bool has_incoming_messages();   // Called by the event queue
 #ifndef NDEBUG
     void initiate_shut_down(std::map<std::string, size_t> *coroutine_counts); // Can be called from any thread
 #else
@@ -39,8 +39,7 @@ progress_completion_fraction_t traversal_progress_combiner_t::guess_completion()
 
     int released = 0, total = 0;
 
-    std::vector<progress_completion_fraction_t> fractions(constituents.size(), progress_completion_fraction_t::make_invalid());
-    pmap(fractions.size(), boost::bind(&traversal_progress_combiner_t::get_constituent_fraction, this, _1, &fractions));
+    std::vector<progress_completion_fraction_t> fractions = guess_constituent_completions();
 
     for (std::vector<progress_completion_fraction_t>::const_iterator it = fractions.begin();
          it != fractions.end();
@@ -55,3 +54,12 @@ progress_completion_fraction_t traversal_progress_combiner_t::guess_completion()
 
     return progress_completion_fraction_t(released, total);
 }
+
+std::vector<progress_completion_fraction_t> traversal_progress_combiner_t::guess_constituent_completions() const {
+    assert_thread();
+    guarantee(!is_destructing);
+
+    std::vector<progress_completion_fraction_t> fractions(constituents.size(), progress_completion_fraction_t::make_invalid());
+    pmap(fractions.size(), boost::bind(&traversal_progress_combiner_t::get_constituent_fraction, this, _1, &fractions));
+    return fractions;
+}
@@ -52,6 +52,10 @@ public:
     void add_constituent(scoped_ptr_t<traversal_progress_t> *constituent);
     progress_completion_fraction_t guess_completion() const;
 
+    // The estimates of the constituents, in the order they were added.  A
+    // backfill adds one per key sub-range it traverses.
+    std::vector<progress_completion_fraction_t> guess_constituent_completions() const;
+
 private:
     // Used in a pmap by the destructor.
     void destroy_constituent(int i);
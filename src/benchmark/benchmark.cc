@@ -0,0 +1,186 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "benchmark/benchmark.hpp"
+
+#include <algorithm>
+
+#include "arch/io/disk.hpp"
+#include "mock/unittest_utils.hpp"
+#include "serializer/log/log_serializer.hpp"
+#include "unittest/mock_file.hpp"
+
+namespace benchmark {
+
+// A function-local static, so that it exists before the registrations in other
+// files run, whatever order the static initializers go in.
+static std::vector<scenario_t> *scenarios() {
+    static std::vector<scenario_t> the_scenarios;
+    return &the_scenarios;
+}
+
+static bool scenario_name_less(const scenario_t &x, const scenario_t &y) {
+    return x.name < y.name;
+}
+
+scenario_registration_t::scenario_registration_t(const char *name, scenario_fun_t fun) {
+    scenarios()->push_back(scenario_t(name, fun));
+}
+
+std::vector<scenario_t> registered_scenarios() {
+    std::vector<scenario_t> result = *scenarios();
+    std::sort(result.begin(), result.end(), &scenario_name_less);
+    return result;
+}
+
+context_t::context_t(const options_t &options, FILE *output)
+    : options_(options), output_(output), repetition_(0) {
+    guarantee(options_.scale > 0);
+}
+
+context_t::~context_t() { }
+
+int64_t context_t::scaled(int64_t n) const {
+    return std::max<int64_t>(1, static_cast<int64_t>(n * options_.scale));
+}
+
+std::string context_t::temp_file_template() const {
+    return options_.directory + "/rdb_benchmark.XXXXXX";
+}
+
+io_backender_t *context_t::io_backender() {
+    if (!io_backender_.has()) {
+        make_io_backender(aio_default, &io_backender_);
+    }
+    return io_backender_.get();
+}
+
+void context_t::start_scenario(const std::string &scenario, int repetition) {
+    scenario_ = scenario;
+    repetition_ = repetition;
+}
+
+void context_t::write_result(cJSON *result) {
+    scoped_cJSON_t json(result);
+    json.AddItemToObject("version", cJSON_CreateString(RETHINKDB_VERSION));
+    fprintf(output_, "%s\n", json.PrintUnformatted().c_str());
+    fflush(output_);
+}
+
+measurement_t::measurement_t(context_t *context, const std::string &phase)
+    : context_(context), phase_(phase),
+      params_(cJSON_CreateObject()), counters_(cJSON_CreateObject()),
+      ops_(0), bytes_(0), elapsed_(0), started_(0) { }
+
+void measurement_t::set_param(const std::string &name, double value) {
+    params_.AddItemToObject(name.c_str(), cJSON_CreateNumber(value));
+}
+
+void measurement_t::set_param(const std::string &name, const std::string &value) {
+    params_.AddItemToObject(name.c_str(), cJSON_CreateString(value.c_str()));
+}
+
+void measurement_t::set_counter(const std::string &name, double value) {
+    counters_.AddItemToObject(name.c_str(), cJSON_CreateNumber(value));
+}
+
+void measurement_t::start_op() {
+    started_ = get_ticks();
+}
+
+void measurement_t::end_op(int64_t bytes) {
+    ticks_t latency = get_ticks() - started_;
+    elapsed_ += latency;
+    latencies_.push_back(latency);
+    ++ops_;
+    bytes_ += bytes;
+}
+
+void measurement_t::start() {
+    rassert(latencies_.empty());
+    started_ = get_ticks();
+}
+
+void measurement_t::stop() {
+    elapsed_ += get_ticks() - started_;
+}
+
+void measurement_t::add_ops(int64_t ops, int64_t bytes) {
+    rassert(latencies_.empty());
+    ops_ += ops;
+    bytes_ += bytes;
+}
+
+static double ticks_to_usecs(ticks_t ticks) {
+    return ticks_to_secs(ticks) * 1000000.0;
+}
+
+// Sorts `latencies` as far as it needs to.
+static double latency_percentile(std::vector<ticks_t> *latencies, double percentile) {
+    size_t n = std::min(latencies->size() - 1, static_cast<size_t>(percentile / 100.0 * latencies->size()));
+    std::nth_element(latencies->begin(), latencies->begin() + n, latencies->end());
+    return ticks_to_usecs((*latencies)[n]);
+}
+
+void measurement_t::report() {
+    double secs = ticks_to_secs(elapsed_);
+
+    scoped_cJSON_t result(cJSON_CreateObject());
+    result.AddItemToObject("scenario", cJSON_CreateString(context_->scenario().c_str()));
+    result.AddItemToObject("phase", cJSON_CreateString(phase_.c_str()));
+    result.AddItemToObject("repetition", cJSON_CreateNumber(context_->repetition()));
+    result.AddItemToObject("params", params_.release());
+    result.AddItemToObject("ops", cJSON_CreateNumber(ops_));
+    result.AddItemToObject("bytes", cJSON_CreateNumber(bytes_));
+    result.AddItemToObject("seconds", cJSON_CreateNumber(secs));
+    result.AddItemToObject("ops_per_sec", cJSON_CreateNumber(secs > 0 ? ops_ / secs : 0));
+    result.AddItemToObject("mb_per_sec", cJSON_CreateNumber(secs > 0 ? bytes_ / secs / MEGABYTE : 0));
+
+    if (!latencies_.empty()) {
+        scoped_cJSON_t latency(cJSON_CreateObject());
+        latency.AddItemToObject("mean", cJSON_CreateNumber(ticks_to_usecs(elapsed_) / latencies_.size()));
+        latency.AddItemToObject("p50", cJSON_CreateNumber(latency_percentile(&latencies_, 50)));
+        latency.AddItemToObject("p90", cJSON_CreateNumber(latency_percentile(&latencies_, 90)));
+        latency.AddItemToObject("p99", cJSON_CreateNumber(latency_percentile(&latencies_, 99)));
+        latency.AddItemToObject("max", cJSON_CreateNumber(ticks_to_usecs(*std::max_element(latencies_.begin(), latencies_.end()))));
+        result.AddItemToObject("latency_us", latency.release());
+    }
+
+    result.AddItemToObject("counters", counters_.release());
+
+    fprintf(stderr, "%s %s: %" PRIi64 " ops in %.3fs (%.0f ops/sec)\n",
+            context_->scenario().c_str(), phase_.c_str(), ops_, secs, secs > 0 ? ops_ / secs : 0);
+    context_->write_result(result.release());
+}
+
+const char *file_kind_name(file_kind_t kind) {
+    switch (kind) {
+    case MOCK_FILE: return "mock_file";
+    case REAL_FILE: return "real_file";
+    default: unreachable();
+    }
+}
+
+benchmark_file_t::benchmark_file_t(context_t *context, file_kind_t kind) {
+    switch (kind) {
+    case MOCK_FILE:
+        mock_opener_.init(new unittest::mock_file_opener_t);
+        break;
+    case REAL_FILE:
+        temp_file_.init(new mock::temp_file_t(context->temp_file_template().c_str()));
+        file_opener_.init(new filepath_file_opener_t(temp_file_->name(), context->io_backender()));
+        break;
+    default:
+        unreachable();
+    }
+}
+
+benchmark_file_t::~benchmark_file_t() { }
+
+serializer_file_opener_t *benchmark_file_t::opener() {
+    if (mock_opener_.has()) {
+        return mock_opener_.get();
+    } else {
+        return file_opener_.get();
+    }
+}
+
+}  // namespace benchmark
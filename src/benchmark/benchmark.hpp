@@ -0,0 +1,187 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef BENCHMARK_BENCHMARK_HPP_
+#define BENCHMARK_BENCHMARK_HPP_
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "containers/scoped.hpp"
+#include "http/json.hpp"
+#include "serializer/types.hpp"
+#include "utils.hpp"
+
+class filepath_file_opener_t;
+class io_backender_t;
+
+namespace mock {
+class temp_file_t;
+}  // namespace mock
+
+namespace unittest {
+class mock_file_opener_t;
+}  // namespace unittest
+
+/* The benchmarks time the hot paths of the storage engine and the query
+language (the serializer, the cache, the btree, blobs, archives and the JSON
+streams) so that a change that slows one of them down shows up as a number
+rather than as a vague feeling. Each scenario runs in a coroutine on the
+benchmark's thread pool and reports one or more measurements, which get written
+out as one JSON object per line:
+
+    {"scenario": "serializer.mock_file", "phase": "random_read", "repetition": 0,
+     "params": {"block_size": 4096, ...}, "ops": 20000, "bytes": 81920000,
+     "seconds": 0.31, "ops_per_sec": 64516, "mb_per_sec": 252.0,
+     "latency_us": {"mean": 15.5, "p50": 14.1, "p90": 17.0, "p99": 40.2, "max": 311.0},
+     "counters": {"hit_ratio": 0.5}, "version": "..."}
+
+`latency_us` is only there if the phase timed every operation on its own. */
+
+namespace benchmark {
+
+struct options_t {
+    options_t() : scale(1.0), repetitions(1), directory("/tmp") { }
+
+    // Multiplies the number of operations every scenario does.
+    double scale;
+    int repetitions;
+    // Where the scenarios that use real files put them.
+    std::string directory;
+};
+
+class context_t;
+
+typedef void (*scenario_fun_t)(context_t *context);
+
+struct scenario_t {
+    scenario_t(const std::string &_name, scenario_fun_t _fun) : name(_name), fun(_fun) { }
+    std::string name;
+    scenario_fun_t fun;
+};
+
+/* Adds a scenario to `registered_scenarios()` during static initialization.
+Use `BENCHMARK()` instead of making one of these directly. */
+class scenario_registration_t {
+public:
+    scenario_registration_t(const char *name, scenario_fun_t fun);
+};
+
+/* All the scenarios, ordered by name. */
+std::vector<scenario_t> registered_scenarios();
+
+/* Defines a scenario called "group.name", like gtest's `TEST()`:
+
+    BENCHMARK(serializer, mock_file) {
+        ...
+    }
+
+The body gets a `benchmark::context_t *context`. */
+#define BENCHMARK(group, name)                                          \
+    static void benchmark_##group##_##name(benchmark::context_t *context); \
+    static benchmark::scenario_registration_t benchmark_##group##_##name##_registration( \
+        #group "." #name, &benchmark_##group##_##name);                 \
+    static void benchmark_##group##_##name(benchmark::context_t *context)
+
+/* What a scenario gets to run with. */
+class context_t {
+public:
+    context_t(const options_t &options, FILE *output);
+    ~context_t();
+
+    /* Returns `n` multiplied by `--scale`, but at least 1. */
+    int64_t scaled(int64_t n) const;
+
+    /* A template for `mock::temp_file_t` in `--directory`. */
+    std::string temp_file_template() const;
+
+    /* Made the first time it's asked for. */
+    io_backender_t *io_backender();
+
+    const std::string &scenario() const { return scenario_; }
+    int repetition() const { return repetition_; }
+
+    /* Called by the benchmark runner between scenarios. */
+    void start_scenario(const std::string &scenario, int repetition);
+
+    /* Called by `measurement_t::report()`. Takes ownership of `result`, and
+    adds the server version to it. */
+    void write_result(cJSON *result);
+
+private:
+    const options_t options_;
+    FILE *const output_;
+    scoped_ptr_t<io_backender_t> io_backender_;
+    std::string scenario_;
+    int repetition_;
+
+    DISABLE_COPYING(context_t);
+};
+
+/* Times one phase of a scenario, like "insert" or "random_read", and reports
+it. Either time each operation with `start_op()` and `end_op()`, which also
+gets the latency distribution, or time a whole batch of operations between
+`start()` and `stop()` and count them with `add_ops()`. Don't do both. */
+class measurement_t {
+public:
+    measurement_t(context_t *context, const std::string &phase);
+
+    /* Describes the setup, like the block size or the cache size. */
+    void set_param(const std::string &name, double value);
+    void set_param(const std::string &name, const std::string &value);
+
+    /* Other numbers that the phase came up with, like the cache hit ratio. */
+    void set_counter(const std::string &name, double value);
+
+    void start_op();
+    void end_op(int64_t bytes = 0);
+
+    void start();
+    void stop();
+    void add_ops(int64_t ops, int64_t bytes = 0);
+
+    int64_t ops() const { return ops_; }
+
+    /* Writes out the result. Call it once, at the end of the phase. */
+    void report();
+
+private:
+    context_t *const context_;
+    const std::string phase_;
+    scoped_cJSON_t params_;
+    scoped_cJSON_t counters_;
+
+    int64_t ops_;
+    int64_t bytes_;
+    ticks_t elapsed_;
+    ticks_t started_;
+    std::vector<ticks_t> latencies_;
+
+    DISABLE_COPYING(measurement_t);
+};
+
+/* Where a scenario's serializer keeps its data. `MOCK_FILE` keeps it in memory
+(`unittest::mock_file_t`), so the disk stays out of the timings; `REAL_FILE`
+uses a temporary file in `--directory`. */
+enum file_kind_t { MOCK_FILE, REAL_FILE };
+
+const char *file_kind_name(file_kind_t kind);
+
+class benchmark_file_t {
+public:
+    benchmark_file_t(context_t *context, file_kind_t kind);
+    ~benchmark_file_t();
+
+    serializer_file_opener_t *opener();
+
+private:
+    scoped_ptr_t<unittest::mock_file_opener_t> mock_opener_;
+    scoped_ptr_t<mock::temp_file_t> temp_file_;
+    scoped_ptr_t<filepath_file_opener_t> file_opener_;
+
+    DISABLE_COPYING(benchmark_file_t);
+};
+
+}  // namespace benchmark
+
+#endif  // BENCHMARK_BENCHMARK_HPP_
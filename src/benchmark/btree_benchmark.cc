@@ -0,0 +1,438 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "errors.hpp"
+#include <boost/shared_ptr.hpp>
+
+#include "benchmark/benchmark.hpp"
+#include "btree/depth_first_traversal.hpp"
+#include "btree/leaf_node.hpp"
+#include "btree/node.hpp"
+#include "btree/operations.hpp"
+#include "btree/slice.hpp"
+#include "buffer_cache/blob.hpp"
+#include "buffer_cache/buffer_cache.hpp"
+#include "concurrency/pmap.hpp"
+#include "containers/buffer_group.hpp"
+#include "perfmon/core.hpp"
+#include "rdb_protocol/btree.hpp"
+#include "serializer/config.hpp"
+#include "serializer/log/log_serializer.hpp"
+
+namespace benchmark {
+
+static const int NUM_KEYS = 20000;
+static const int ROWS_PER_SCAN = 100;
+static const int WRITES_PER_WRITER = 2000;
+
+static std::string btree_key(int i) {
+    return strprintf("key%08d", i);
+}
+
+// A document like the ones in a typical table.
+static boost::shared_ptr<scoped_cJSON_t> make_row(int i) {
+    boost::shared_ptr<scoped_cJSON_t> row(new scoped_cJSON_t(cJSON_CreateObject()));
+    row->AddItemToObject("id", cJSON_CreateString(btree_key(i).c_str()));
+    row->AddItemToObject("name", cJSON_CreateString(strprintf("user number %d", i).c_str()));
+    row->AddItemToObject("score", cJSON_CreateNumber(i % 1000));
+    row->AddItemToObject("group", cJSON_CreateString(strprintf("group%d", i % 50).c_str()));
+    row->AddItemToObject("active", cJSON_CreateBool(i % 3 != 0));
+    return row;
+}
+
+// Decodes every document it's shown, the way a range read does.
+class scan_callback_t : public depth_first_traversal_callback_t {
+public:
+    scan_callback_t(transaction_t *txn, int limit) : txn_(txn), limit_(limit), rows(0) { }
+
+    bool handle_pair(UNUSED const btree_key_t *key, const void *value) {
+        boost::shared_ptr<scoped_cJSON_t> row = get_data(static_cast<const rdb_value_t *>(value), txn_);
+        guarantee(row->type() == cJSON_Object);
+        ++rows;
+        return rows < limit_;
+    }
+
+private:
+    transaction_t *const txn_;
+    const int limit_;
+
+public:
+    int rows;
+};
+
+/* Inserts documents with `rdb_set()` in random order, one transaction each,
+and then looks them up with `rdb_get()` and scans ranges of them. The cache is
+big enough for the whole tree, so on a real file only the writes go to disk. */
+static void run_btree_benchmark(context_t *context, file_kind_t kind) {
+    benchmark_file_t file(context, kind);
+    standard_serializer_t::create(file.opener(), standard_serializer_t::static_config_t());
+    standard_serializer_t serializer(standard_serializer_t::dynamic_config_t(), file.opener(),
+                                     &get_global_perfmon_collection());
+
+    mirrored_cache_static_config_t cache_static_config;
+    cache_t::create(&serializer, &cache_static_config);
+    mirrored_cache_config_t cache_config;
+    cache_config.max_size = GIGABYTE;
+    cache_t cache(&serializer, &cache_config, &get_global_perfmon_collection());
+
+    btree_slice_t::create(&cache);
+    btree_slice_t slice(&cache, &get_global_perfmon_collection());
+    value_sizer_t<rdb_value_t> sizer(cache.get_block_size());
+
+    const int num_keys = context->scaled(NUM_KEYS);
+    rng_t rng(0);
+    order_source_t order_source;
+
+    std::vector<int> order(num_keys);
+    for (int i = 0; i < num_keys; ++i) {
+        order[i] = i;
+    }
+    for (int i = num_keys - 1; i > 0; --i) {
+        std::swap(order[i], order[rng.randint(i + 1)]);
+    }
+
+    {
+        measurement_t m(context, "insert");
+        for (int i = 0; i < num_keys; ++i) {
+            store_key_t key(btree_key(order[i]));
+            boost::shared_ptr<scoped_cJSON_t> row = make_row(order[i]);
+            m.start_op();
+            scoped_ptr_t<transaction_t> txn;
+            scoped_ptr_t<real_superblock_t> superblock;
+            get_btree_superblock_and_txn(&slice, rwi_write, 1, repli_timestamp_t::distant_past,
+                                         order_source.check_in("run_btree_benchmark(insert)"), &superblock, &txn);
+            point_write_response_t response;
+            rdb_set(key, row, true, &slice, repli_timestamp_t::distant_past, txn.get(), superblock.get(), &response);
+            m.end_op();
+        }
+        m.report();
+    }
+
+    {
+        measurement_t m(context, "lookup");
+        for (int i = 0; i < num_keys; ++i) {
+            store_key_t key(btree_key(rng.randint(num_keys)));
+            m.start_op();
+            scoped_ptr_t<transaction_t> txn;
+            scoped_ptr_t<real_superblock_t> superblock;
+            get_btree_superblock_and_txn_for_reading(&slice, rwi_read,
+                                                     order_source.check_in("run_btree_benchmark(lookup)").with_read_mode(),
+                                                     CACHE_SNAPSHOTTED_NO, &superblock, &txn);
+            point_read_response_t response;
+            rdb_get(key, &slice, txn.get(), superblock.get(), &response);
+            m.end_op();
+            guarantee(response.data->type() == cJSON_Object);
+        }
+        m.report();
+    }
+
+    {
+        measurement_t m(context, "range_scan");
+        m.set_param("rows_per_scan", ROWS_PER_SCAN);
+        int64_t rows = 0;
+        const int num_scans = std::max(1, num_keys / ROWS_PER_SCAN);
+        for (int i = 0; i < num_scans; ++i) {
+            key_range_t range(key_range_t::closed, store_key_t(btree_key(rng.randint(num_keys))),
+                              key_range_t::none, store_key_t());
+            m.start_op();
+            scoped_ptr_t<transaction_t> txn;
+            scoped_ptr_t<real_superblock_t> superblock;
+            get_btree_superblock_and_txn_for_reading(&slice, rwi_read,
+                                                     order_source.check_in("run_btree_benchmark(range_scan)").with_read_mode(),
+                                                     CACHE_SNAPSHOTTED_NO, &superblock, &txn);
+            scan_callback_t callback(txn.get(), ROWS_PER_SCAN);
+            btree_depth_first_traversal(&sizer, &slice, txn.get(), superblock.get(), range, &callback);
+            m.end_op();
+            rows += callback.rows;
+        }
+        m.set_counter("rows", rows);
+        m.report();
+    }
+}
+
+BENCHMARK(btree, mock_file) {
+    run_btree_benchmark(context, MOCK_FILE);
+}
+
+BENCHMARK(btree, real_file) {
+    run_btree_benchmark(context, REAL_FILE);
+}
+
+/* One client of a shard: does the btree part of `btree_store_t::write()` for
+random keys, one transaction each, including setting the metainfo. Given
+rwi_write, it takes the superblock and writes the metainfo the way writes did
+before they took it with rwi_intent. */
+class concurrent_writer_t {
+public:
+    concurrent_writer_t(btree_slice_t *slice, access_t superblock_access, int num_keys, int num_writes)
+        : slice_(slice), superblock_access_(superblock_access), num_keys_(num_keys), num_writes_(num_writes) { }
+
+    void operator()(int writer) const {
+        rng_t rng(writer + 1);
+        std::vector<std::pair<std::vector<char>, std::vector<char> > > metainfo(1);
+        for (int i = 0; i < num_writes_; ++i) {
+            const int k = rng.randint(num_keys_);
+            scoped_ptr_t<transaction_t> txn;
+            scoped_ptr_t<real_superblock_t> superblock;
+            get_btree_superblock_and_txn(slice_, superblock_access_, 2, repli_timestamp_t::distant_past,
+                                         order_token_t::ignore, &superblock, &txn);
+
+            // Like the version `listener_t` puts in the metainfo, it's
+            // different for every write.
+            const std::string version = strprintf("writer %d, write %d", writer, i);
+            metainfo[0].second.assign(version.begin(), version.end());
+            if (superblock_access_ == rwi_write) {
+                set_superblock_metainfo(txn.get(), superblock->get(), metainfo);
+            } else {
+                superblock->set_metainfo_on_release(txn.get(), metainfo);
+            }
+
+            point_write_response_t response;
+            rdb_set(store_key_t(btree_key(k)), make_row(k), true, slice_, repli_timestamp_t::distant_past,
+                    txn.get(), superblock.get(), &response);
+        }
+    }
+
+private:
+    btree_slice_t *const slice_;
+    const access_t superblock_access_;
+    const int num_keys_;
+    const int num_writes_;
+};
+
+/* Has a few writers at a time overwrite random documents in a tree that's
+several times the size of the cache, so that most writes wait for their leaf to
+be read. Each phase reports the writes per second and `scaling`, how many times
+faster that is than with one writer. The "intent_superblock" phase also reports
+`speedup` over "write_superblock" with the same number of writers. On a mock
+file reads don't wait for anything, so only `real_file` shows any scaling. */
+static void run_concurrent_writers_benchmark(context_t *context, file_kind_t kind) {
+    benchmark_file_t file(context, kind);
+    standard_serializer_t::create(file.opener(), standard_serializer_t::static_config_t());
+    standard_serializer_t serializer(standard_serializer_t::dynamic_config_t(), file.opener(),
+                                     &get_global_perfmon_collection());
+
+    mirrored_cache_static_config_t cache_static_config;
+    cache_t::create(&serializer, &cache_static_config);
+    mirrored_cache_config_t cache_config;
+    cache_config.max_size = 4 * MEGABYTE;
+    cache_t cache(&serializer, &cache_config, &get_global_perfmon_collection());
+
+    btree_slice_t::create(&cache);
+    btree_slice_t slice(&cache, &get_global_perfmon_collection());
+
+    // Fill the tree first, from one writer.
+    const int num_keys = context->scaled(5 * NUM_KEYS);
+    concurrent_writer_t(&slice, rwi_write, num_keys, num_keys)(0);
+
+    const int writer_counts[] = { 1, 2, 4, 8, 16 };
+    const int num_writes = context->scaled(WRITES_PER_WRITER);
+    double one_writer_rate[2] = { 0, 0 };
+    for (size_t i = 0; i < sizeof(writer_counts) / sizeof(writer_counts[0]); ++i) {
+        double write_rate = 0;
+        for (int intent = 0; intent < 2; ++intent) {
+            measurement_t m(context, intent ? "intent_superblock" : "write_superblock");
+            m.set_param("writers", writer_counts[i]);
+            ticks_t start = get_ticks();
+            m.start();
+            pmap(writer_counts[i], concurrent_writer_t(&slice, intent ? rwi_intent : rwi_write, num_keys, num_writes));
+            m.stop();
+            const double rate = writer_counts[i] * num_writes / ticks_to_secs(get_ticks() - start);
+            m.add_ops(writer_counts[i] * num_writes);
+
+            if (i == 0) {
+                one_writer_rate[intent] = rate;
+            }
+            m.set_counter("scaling", rate / one_writer_rate[intent]);
+            if (intent) {
+                m.set_counter("speedup", rate / write_rate);
+            } else {
+                write_rate = rate;
+            }
+            m.report();
+        }
+    }
+}
+
+BENCHMARK(btree_writers, mock_file) {
+    run_concurrent_writers_benchmark(context, MOCK_FILE);
+}
+
+BENCHMARK(btree_writers, real_file) {
+    run_concurrent_writers_benchmark(context, REAL_FILE);
+}
+
+// A value is a length byte followed by that many bytes.
+class short_value_sizer_t : public value_sizer_t<void> {
+public:
+    explicit short_value_sizer_t(block_size_t bs) : block_size_(bs) { }
+
+    int size(const void *value) const {
+        return 1 + *static_cast<const uint8_t *>(value);
+    }
+
+    bool fits(const void *value, int length_available) const {
+        return length_available > 0 && size(value) <= length_available;
+    }
+
+    bool deep_fsck(UNUSED block_getter_t *getter, const void *value, int length_available, std::string *msg_out) const {
+        if (!fits(value, length_available)) {
+            *msg_out = strprintf("value does not fit within %d", length_available);
+            return false;
+        }
+        return true;
+    }
+
+    int max_possible_size() const {
+        return 256;
+    }
+
+    block_magic_t btree_leaf_magic() const {
+        block_magic_t magic = { { 'b', 'm', 'L', 'F' } };
+        return magic;
+    }
+
+    block_size_t block_size() const { return block_size_; }
+
+private:
+    block_size_t block_size_;
+
+    DISABLE_COPYING(short_value_sizer_t);
+};
+
+/* Inserts random keys into a leaf node until it's full, splits it, and carries
+on with the left half, the way a leaf fills up under random inserts. Then looks
+keys up in a full node. No cache or serializer involved. */
+BENCHMARK(leaf_node, insert_split) {
+    block_size_t block_size = block_size_t::unsafe_make(DEFAULT_BTREE_BLOCK_SIZE);
+    short_value_sizer_t sizer(block_size);
+    scoped_malloc_t<leaf_node_t> node(block_size.value());
+    scoped_malloc_t<leaf_node_t> rnode(block_size.value());
+    leaf::init(&sizer, node.get());
+
+    const int num_inserts = context->scaled(10 * NUM_KEYS);
+    rng_t rng(0);
+    uint8_t value[1 + 32];
+    value[0] = 32;
+    memset(value + 1, 'v', 32);
+
+    std::vector<store_key_t> keys;
+    {
+        measurement_t m(context, "insert");
+        m.set_param("value_size", value[0]);
+        int64_t splits = 0;
+        m.start();
+        for (int i = 0; i < num_inserts; ++i) {
+            store_key_t key(btree_key(rng.randint(1000000000)));
+            if (leaf::is_full(&sizer, node.get(), key.btree_key(), value)) {
+                leaf::init(&sizer, rnode.get());
+                store_key_t median;
+                leaf::split(&sizer, node.get(), rnode.get(), median.btree_key());
+                ++splits;
+            }
+            leaf::insert(&sizer, node.get(), key.btree_key(), value, repli_timestamp_t::distant_past,
+                         key_modification_proof_t::real_proof());
+        }
+        m.stop();
+        m.add_ops(num_inserts);
+        m.set_counter("splits", splits);
+        m.report();
+    }
+
+    {
+        // Fill a fresh node with keys we remember, and look them up.
+        leaf::init(&sizer, node.get());
+        for (int i = 0; ; ++i) {
+            store_key_t key(btree_key(i * 7919 % 1000000));
+            if (leaf::is_full(&sizer, node.get(), key.btree_key(), value)) {
+                break;
+            }
+            leaf::insert(&sizer, node.get(), key.btree_key(), value, repli_timestamp_t::distant_past,
+                         key_modification_proof_t::real_proof());
+            keys.push_back(key);
+        }
+
+        measurement_t m(context, "lookup");
+        m.set_param("keys_per_node", keys.size());
+        uint8_t value_out[256];
+        m.start();
+        for (int i = 0; i < num_inserts; ++i) {
+            bool found = leaf::lookup(&sizer, node.get(), keys[i % keys.size()].btree_key(), value_out);
+            guarantee(found);
+        }
+        m.stop();
+        m.add_ops(num_inserts);
+        m.report();
+    }
+}
+
+/* Writes blobs of a few sizes, one transaction each, and reads them back. The
+cache holds everything, so this is the blob code and the cache, not the disk. */
+BENCHMARK(blob, mock_file) {
+    benchmark_file_t file(context, MOCK_FILE);
+    standard_serializer_t::create(file.opener(), standard_serializer_t::static_config_t());
+    standard_serializer_t serializer(standard_serializer_t::dynamic_config_t(), file.opener(),
+                                     &get_global_perfmon_collection());
+
+    mirrored_cache_static_config_t cache_static_config;
+    cache_t::create(&serializer, &cache_static_config);
+    mirrored_cache_config_t cache_config;
+    cache_config.max_size = GIGABYTE;
+    cache_t cache(&serializer, &cache_config, &get_global_perfmon_collection());
+
+    order_source_t order_source;
+    const int64_t sizes[] = { 200, 16 * KILOBYTE, MEGABYTE };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        const int64_t size = sizes[s];
+        const int num_blobs = context->scaled(std::min<int64_t>(2000, 32 * MEGABYTE / size));
+        const std::string contents(size, 'b');
+        std::vector<char> refs(num_blobs * blob::btree_maxreflen, 0);
+
+        {
+            measurement_t m(context, "write");
+            m.set_param("size", size);
+            for (int i = 0; i < num_blobs; ++i) {
+                m.start_op();
+                transaction_t txn(&cache, rwi_write, 0, repli_timestamp_t::distant_past,
+                                  order_source.check_in("blob benchmark(write)"));
+                blob_t blob(&refs[i * blob::btree_maxreflen], blob::btree_maxreflen);
+                blob.append_region(&txn, size);
+                blob.write_from_string(contents, &txn, 0);
+                m.end_op(size);
+            }
+            m.report();
+        }
+
+        {
+            measurement_t m(context, "read");
+            m.set_param("size", size);
+            std::vector<char> out(size);
+            for (int i = 0; i < num_blobs; ++i) {
+                m.start_op();
+                transaction_t txn(&cache, rwi_read, 0, repli_timestamp_t::invalid,
+                                  order_source.check_in("blob benchmark(read)").with_read_mode());
+                blob_t blob(&refs[i * blob::btree_maxreflen], blob::btree_maxreflen);
+                buffer_group_t exposed;
+                blob_acq_t acq;
+                blob.expose_all(&txn, rwi_read, &exposed, &acq);
+                buffer_group_t dest;
+                dest.add_buffer(size, out.data());
+                buffer_group_copy_data(&dest, const_view(&exposed));
+                m.end_op(size);
+            }
+            m.report();
+        }
+
+        for (int i = 0; i < num_blobs; ++i) {
+            transaction_t txn(&cache, rwi_write, 0, repli_timestamp_t::distant_past,
+                              order_source.check_in("blob benchmark(clear)"));
+            blob_t blob(&refs[i * blob::btree_maxreflen], blob::btree_maxreflen);
+            blob.clear(&txn);
+        }
+    }
+}
+
+}  // namespace benchmark
@@ -0,0 +1,299 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "errors.hpp"
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "benchmark/benchmark.hpp"
+#include "btree/keys.hpp"
+#include "containers/archive/stl_types.hpp"
+#include "containers/archive/vector_stream.hpp"
+#include "rdb_protocol/json_groups.hpp"
+#include "rdb_protocol/plan_cache.hpp"
+#include "rdb_protocol/query_language.hpp"
+#include "rdb_protocol/rdb_protocol_json.hpp"
+#include "rdb_protocol/stream.hpp"
+
+namespace benchmark {
+
+static const int NUM_ROWS = 50000;
+static const int NUM_GROUPS = 50;
+static const int ROWS_PER_MESSAGE = 1000;
+static const int NUM_QUERIES = 2000;
+
+typedef std::vector<std::pair<store_key_t, boost::shared_ptr<scoped_cJSON_t> > > rows_t;
+
+static std::string row_text(int i) {
+    return strprintf("{\"id\":\"key%08d\",\"name\":\"user number %d\",\"score\":%d,\"group\":\"group%d\",\"active\":%s}",
+                     i, i, (i * 7919) % 1000, i % NUM_GROUPS, i % 3 != 0 ? "true" : "false");
+}
+
+static boost::shared_ptr<scoped_cJSON_t> parse_row(const std::string &text) {
+    boost::shared_ptr<scoped_cJSON_t> row(new scoped_cJSON_t(cJSON_Parse(text.c_str())));
+    guarantee(row->get() != NULL);
+    return row;
+}
+
+/* Orders rows by one attribute, like ORDERBY does. */
+class attr_less_t {
+public:
+    explicit attr_less_t(const std::string &attr) : attr_(attr) { }
+
+    bool operator()(const boost::shared_ptr<scoped_cJSON_t> &x, const boost::shared_ptr<scoped_cJSON_t> &y) const {
+        return query_language::cJSON_cmp(x->GetObjectItem(attr_.c_str()), y->GetObjectItem(attr_.c_str()), backtrace_) < 0;
+    }
+
+private:
+    std::string attr_;
+    query_language::backtrace_t backtrace_;
+};
+
+/* The steps that a query like `table.filter(...).orderby("score")` or
+`table.groupby("group", count)` puts its rows through, minus the btree and the
+evaluator: parsing documents, sorting them, grouping them and printing the
+response. */
+BENCHMARK(json, pipeline) {
+    const int num_rows = context->scaled(NUM_ROWS);
+    std::vector<std::string> texts;
+    int64_t text_bytes = 0;
+    for (int i = 0; i < num_rows; ++i) {
+        texts.push_back(row_text(i));
+        text_bytes += texts.back().size();
+    }
+
+    scoped_cJSON_t array(cJSON_CreateArray());
+    {
+        measurement_t m(context, "parse");
+        m.start();
+        for (int i = 0; i < num_rows; ++i) {
+            array.AddItemToArray(cJSON_Parse(texts[i].c_str()));
+        }
+        m.stop();
+        m.add_ops(num_rows, text_bytes);
+        m.report();
+    }
+
+    std::vector<boost::shared_ptr<scoped_cJSON_t> > sorted;
+    {
+        measurement_t m(context, "order_by");
+        m.start();
+        query_language::sort_stream_t stream(
+            boost::make_shared<query_language::in_memory_stream_t>(json_array_iterator_t(array.get())),
+            attr_less_t("score"), 0, NULL, "");
+        while (boost::shared_ptr<scoped_cJSON_t> row = stream.next()) {
+            sorted.push_back(row);
+        }
+        m.stop();
+        m.add_ops(num_rows);
+        m.report();
+        guarantee(sorted.size() == static_cast<size_t>(num_rows));
+    }
+
+    {
+        measurement_t m(context, "group_by_count");
+        query_language::backtrace_t backtrace;
+        query_language::json_groups_t groups;
+        m.start();
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            boost::shared_ptr<scoped_cJSON_t> key(new scoped_cJSON_t(cJSON_DeepCopy(sorted[i]->GetObjectItem("group"))));
+            boost::shared_ptr<scoped_cJSON_t> *count = groups.find(key, backtrace);
+            if (count == NULL) {
+                groups.insert(key, boost::shared_ptr<scoped_cJSON_t>(new scoped_cJSON_t(cJSON_CreateNumber(1))));
+            } else {
+                (*count)->get()->valuedouble += 1;
+            }
+        }
+        groups.sort(backtrace);
+        m.stop();
+        m.add_ops(sorted.size());
+        m.set_counter("groups", groups.size());
+        m.report();
+    }
+
+    {
+        measurement_t m(context, "print");
+        int64_t bytes = 0;
+        m.start();
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            bytes += sorted[i]->PrintUnformatted().size();
+        }
+        m.stop();
+        m.add_ops(sorted.size(), bytes);
+        m.report();
+    }
+}
+
+// r.expr([{...}, ...]).filter(lambda row: row["score"] >= threshold).orderby("score")
+static void make_filter_query(int64_t token, double threshold, Query *q) {
+    q->set_type(Query::READ);
+    q->set_token(token);
+
+    Term *order_by = q->mutable_read_query()->mutable_term();
+    order_by->set_type(Term::CALL);
+    order_by->mutable_call()->mutable_builtin()->set_type(Builtin::ORDERBY);
+    order_by->mutable_call()->mutable_builtin()->add_order_by()->set_attr("score");
+
+    Term *filter = order_by->mutable_call()->add_args();
+    filter->set_type(Term::CALL);
+    filter->mutable_call()->mutable_builtin()->set_type(Builtin::FILTER);
+    Predicate *predicate = filter->mutable_call()->mutable_builtin()->mutable_filter()->mutable_predicate();
+    predicate->set_arg("row");
+    Term *compare = predicate->mutable_body();
+    compare->set_type(Term::CALL);
+    compare->mutable_call()->mutable_builtin()->set_type(Builtin::COMPARE);
+    compare->mutable_call()->mutable_builtin()->set_comparison(Builtin::GE);
+    Term *getattr = compare->mutable_call()->add_args();
+    getattr->set_type(Term::CALL);
+    getattr->mutable_call()->mutable_builtin()->set_type(Builtin::GETATTR);
+    getattr->mutable_call()->mutable_builtin()->set_attr("score");
+    Term *var = getattr->mutable_call()->add_args();
+    var->set_type(Term::VAR);
+    var->set_var("row");
+    Term *number = compare->mutable_call()->add_args();
+    number->set_type(Term::NUMBER);
+    number->set_number(threshold);
+
+    Term *stream = filter->mutable_call()->add_args();
+    stream->set_type(Term::CALL);
+    stream->mutable_call()->mutable_builtin()->set_type(Builtin::ARRAYTOSTREAM);
+    Term *array = stream->mutable_call()->add_args();
+    array->set_type(Term::ARRAY);
+    for (int i = 0; i < 10; ++i) {
+        Term *row = array->add_array();
+        row->set_type(Term::OBJECT);
+        VarTermTuple *score = row->add_object();
+        score->set_var("score");
+        score->mutable_term()->set_type(Term::NUMBER);
+        score->mutable_term()->set_number(i);
+        VarTermTuple *group = row->add_object();
+        group->set_var("group");
+        group->mutable_term()->set_type(Term::STRING);
+        group->mutable_term()->set_valuestring(strprintf("group%d", i % 3));
+    }
+}
+
+/* Type checks the same query with different literals, every time and through
+the plan cache.  The cache reports what computing the shape and rebinding the
+literals cost per query, and the type checking time each hit saves. */
+BENCHMARK(json, type_check) {
+    const int num_queries = context->scaled(NUM_QUERIES);
+    query_language::backtrace_t backtrace;
+
+    {
+        measurement_t m(context, "uncached");
+        for (int i = 0; i < num_queries; ++i) {
+            Query q;
+            make_filter_query(i, i % 10, &q);
+            bool is_det;
+            m.start_op();
+            query_language::type_checking_environment_t type_environment;
+            query_language::check_query_type(&q, &type_environment, &is_det, backtrace);
+            m.end_op();
+        }
+        m.report();
+    }
+
+    {
+        measurement_t m(context, "plan_cache");
+        query_language::query_plan_cache_t cache;
+        for (int i = 0; i < num_queries; ++i) {
+            Query q;
+            make_filter_query(i, i % 10, &q);
+            bool is_det;
+            m.start_op();
+            cache.check_query_type(&q, &is_det, backtrace);
+            m.end_op();
+        }
+        // What a hit costs, next to the type checking it saves.
+        const query_language::query_plan_cache_t::stats_t &stats = cache.stats();
+        m.set_counter("plans", cache.size());
+        m.set_counter("hits", stats.hits);
+        m.set_counter("misses", stats.misses);
+        m.set_counter("shape_ns_per_query", static_cast<double>(stats.shape_ticks) / std::max<uint64_t>(1, stats.hits + stats.misses));
+        m.set_counter("rebind_ns_per_hit", static_cast<double>(stats.rebind_ticks) / std::max<uint64_t>(1, stats.hits));
+        m.set_counter("check_ns_saved_per_hit", static_cast<double>(stats.check_ticks_saved) / std::max<uint64_t>(1, stats.hits));
+        m.report();
+    }
+}
+
+/* Serializes and deserializes range read responses and grouped map reduce
+results, the way they go between the machines of a cluster. */
+BENCHMARK(archive, rdb_responses) {
+    const int num_messages = context->scaled(NUM_ROWS / ROWS_PER_MESSAGE);
+
+    rows_t rows;
+    query_language::json_groups_t groups;
+    for (int i = 0; i < ROWS_PER_MESSAGE; ++i) {
+        boost::shared_ptr<scoped_cJSON_t> row = parse_row(row_text(i));
+        rows.push_back(std::make_pair(store_key_t(strprintf("key%08d", i)), row));
+        groups.insert(boost::shared_ptr<scoped_cJSON_t>(new scoped_cJSON_t(cJSON_CreateNumber(i))), row);
+    }
+
+    std::vector<char> rows_data;
+    {
+        measurement_t m(context, "serialize_rows");
+        m.set_param("rows", ROWS_PER_MESSAGE);
+        for (int i = 0; i < num_messages; ++i) {
+            m.start_op();
+            write_message_t msg;
+            msg << rows;
+            vector_stream_t stream;
+            int res = send_write_message(&stream, &msg);
+            guarantee(res == 0);
+            m.end_op(stream.vector().size());
+            rows_data = stream.vector();
+        }
+        m.report();
+    }
+
+    {
+        measurement_t m(context, "deserialize_rows");
+        m.set_param("rows", ROWS_PER_MESSAGE);
+        for (int i = 0; i < num_messages; ++i) {
+            m.start_op();
+            vector_read_stream_t stream(&rows_data);
+            rows_t copy;
+            archive_result_t res = deserialize(&stream, &copy);
+            guarantee(res == ARCHIVE_SUCCESS);
+            m.end_op(rows_data.size());
+        }
+        m.report();
+    }
+
+    std::vector<char> groups_data;
+    {
+        measurement_t m(context, "serialize_groups");
+        m.set_param("groups", ROWS_PER_MESSAGE);
+        for (int i = 0; i < num_messages; ++i) {
+            m.start_op();
+            write_message_t msg;
+            msg << groups;
+            vector_stream_t stream;
+            int res = send_write_message(&stream, &msg);
+            guarantee(res == 0);
+            m.end_op(stream.vector().size());
+            groups_data = stream.vector();
+        }
+        m.report();
+    }
+
+    {
+        measurement_t m(context, "deserialize_groups");
+        m.set_param("groups", ROWS_PER_MESSAGE);
+        for (int i = 0; i < num_messages; ++i) {
+            m.start_op();
+            vector_read_stream_t stream(&groups_data);
+            query_language::json_groups_t copy;
+            archive_result_t res = deserialize(&stream, &copy);
+            guarantee(res == ARCHIVE_SUCCESS);
+            m.end_op(groups_data.size());
+        }
+        m.report();
+    }
+}
+
+}  // namespace benchmark
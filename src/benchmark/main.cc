@@ -0,0 +1,110 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "errors.hpp"
+#include <boost/bind.hpp>
+#include <boost/program_options.hpp>
+
+#include "arch/runtime/runtime_utils.hpp"
+#include "arch/runtime/starter.hpp"
+#include "benchmark/benchmark.hpp"
+#include "config/args.hpp"
+#include "utils.hpp"
+
+namespace po = boost::program_options;
+
+static std::vector<benchmark::scenario_t> matching_scenarios(const std::string &filter) {
+    std::vector<benchmark::scenario_t> all = benchmark::registered_scenarios();
+    std::vector<benchmark::scenario_t> matching;
+    for (size_t i = 0; i < all.size(); ++i) {
+        if (fnmatch(filter.c_str(), all[i].name.c_str(), 0) == 0) {
+            matching.push_back(all[i]);
+        }
+    }
+    return matching;
+}
+
+static void run_scenarios(const benchmark::options_t &options, const std::vector<benchmark::scenario_t> &scenarios, FILE *output) {
+    benchmark::context_t context(options, output);
+    for (int repetition = 0; repetition < options.repetitions; ++repetition) {
+        for (size_t i = 0; i < scenarios.size(); ++i) {
+            context.start_scenario(scenarios[i].name, repetition);
+            scenarios[i].fun(&context);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    install_generic_crash_handler();
+
+    po::options_description desc("Options");
+    desc.add_options()
+        ("help,h", "show this message")
+        ("list", "list the scenarios and exit")
+        ("filter", po::value<std::string>()->default_value("*"), "only run the scenarios whose names match this glob, like 'serializer.*'")
+        ("scale", po::value<double>()->default_value(1.0), "multiply the number of operations in every scenario by this")
+        ("repetitions", po::value<int>()->default_value(1), "run every scenario this many times")
+        ("threads", po::value<int>()->default_value(get_cpu_count()), "the number of threads in the thread pool")
+        ("directory,d", po::value<std::string>()->default_value("/tmp"), "where to put the files for the scenarios that use real files")
+        ("output,o", po::value<std::string>(), "write the results to this file instead of stdout, one JSON object per line");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (const po::error &e) {
+        fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if (vm.count("help") > 0) {
+        printf("Runs the storage engine and query language benchmarks.\n\n");
+        std::cout << desc;
+        return EXIT_SUCCESS;
+    }
+
+    std::vector<benchmark::scenario_t> scenarios = matching_scenarios(vm["filter"].as<std::string>());
+    if (vm.count("list") > 0) {
+        for (size_t i = 0; i < scenarios.size(); ++i) {
+            printf("%s\n", scenarios[i].name.c_str());
+        }
+        return EXIT_SUCCESS;
+    }
+    if (scenarios.empty()) {
+        fprintf(stderr, "No scenarios match '%s'.\n", vm["filter"].as<std::string>().c_str());
+        return EXIT_FAILURE;
+    }
+
+    benchmark::options_t options;
+    options.scale = vm["scale"].as<double>();
+    options.repetitions = vm["repetitions"].as<int>();
+    options.directory = vm["directory"].as<std::string>();
+    const int threads = vm["threads"].as<int>();
+    if (options.scale <= 0 || options.repetitions < 1 || threads < 1 || threads > MAX_THREADS) {
+        fprintf(stderr, "--scale, --repetitions and --threads must be positive (and --threads at most %d).\n", MAX_THREADS);
+        return EXIT_FAILURE;
+    }
+
+    FILE *output = stdout;
+    if (vm.count("output") > 0) {
+        output = fopen(vm["output"].as<std::string>().c_str(), "w");
+        if (output == NULL) {
+            fprintf(stderr, "Could not open %s: %s\n", vm["output"].as<std::string>().c_str(), strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    run_in_thread_pool(boost::bind(&run_scenarios, options, scenarios, output), threads);
+
+    if (output != stdout) {
+        fclose(output);
+    }
+    return EXIT_SUCCESS;
+}
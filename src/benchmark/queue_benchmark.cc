@@ -0,0 +1,154 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <pthread.h>
+
+#include <vector>
+
+#include "benchmark/benchmark.hpp"
+#include "containers/intrusive_list.hpp"
+#include "containers/mpsc_queue.hpp"
+
+namespace benchmark {
+
+static const int VALUES_PER_PRODUCER = 200000;
+static const int BATCH_SIZE = 16;
+
+struct queued_value_t :
+    public intrusive_list_node_t<queued_value_t>,
+    public mpsc_queue_node_t<queued_value_t> { };
+
+/* The way the message hub handed messages over before it used `mpsc_queue_t`:
+one list per receiving thread, guarded by a spinlock that every sender takes,
+which the receiver empties in one go. */
+class spinlock_list_queue_t {
+public:
+    spinlock_list_queue_t() {
+        int res = pthread_spin_init(&lock_, PTHREAD_PROCESS_PRIVATE);
+        guarantee_xerr(res == 0, res, "pthread_spin_init failed");
+    }
+    ~spinlock_list_queue_t() {
+        int res = pthread_spin_destroy(&lock_);
+        guarantee_xerr(res == 0, res, "pthread_spin_destroy failed");
+    }
+
+    void push(queued_value_t *node) {
+        pthread_spin_lock(&lock_);
+        shared_.push_back(node);
+        pthread_spin_unlock(&lock_);
+    }
+
+    void push_all(intrusive_list_t<queued_value_t> *list) {
+        pthread_spin_lock(&lock_);
+        shared_.append_and_clear(list);
+        pthread_spin_unlock(&lock_);
+    }
+
+    queued_value_t *pop() {
+        if (taken_.empty()) {
+            pthread_spin_lock(&lock_);
+            taken_.append_and_clear(&shared_);
+            pthread_spin_unlock(&lock_);
+        }
+        queued_value_t *node = taken_.head();
+        if (node != NULL) {
+            taken_.remove(node);
+        }
+        return node;
+    }
+
+private:
+    pthread_spinlock_t lock_;
+    intrusive_list_t<queued_value_t> shared_;
+    intrusive_list_t<queued_value_t> taken_;
+
+    DISABLE_COPYING(spinlock_list_queue_t);
+};
+
+template <class queue_t>
+struct producer_t {
+    queue_t *queue;
+    scoped_array_t<queued_value_t> nodes;
+};
+
+// Pushes some values by themselves and some in batches, like the message hub does.
+template <class queue_t>
+static void *produce(void *arg) {
+    producer_t<queue_t> *producer = static_cast<producer_t<queue_t> *>(arg);
+    intrusive_list_t<queued_value_t> batch;
+    for (int i = 0; i < static_cast<int>(producer->nodes.size()); ++i) {
+        if (i % (2 * BATCH_SIZE) < BATCH_SIZE) {
+            producer->queue->push(&producer->nodes[i]);
+        } else {
+            batch.push_back(&producer->nodes[i]);
+            if (batch.size() == static_cast<unsigned int>(BATCH_SIZE)) {
+                producer->queue->push_all(&batch);
+            }
+        }
+    }
+    producer->queue->push_all(&batch);
+    return NULL;
+}
+
+/* Has `num_producers` threads push onto `queue` while this thread pops
+everything off, timed by `m`. Returns the number of values per second. */
+template <class queue_t>
+static double run_producers(context_t *context, queue_t *queue, int num_producers, measurement_t *m) {
+    const int values_per_producer = context->scaled(VALUES_PER_PRODUCER);
+    scoped_array_t<producer_t<queue_t> > producers(num_producers);
+    std::vector<pthread_t> threads(num_producers);
+    for (int p = 0; p < num_producers; ++p) {
+        producers[p].queue = queue;
+        producers[p].nodes.init(values_per_producer);
+    }
+
+    m->set_param("producers", num_producers);
+    m->set_param("batch_size", BATCH_SIZE);
+    const int total = num_producers * values_per_producer;
+    ticks_t start = get_ticks();
+    m->start();
+    for (int p = 0; p < num_producers; ++p) {
+        int res = pthread_create(&threads[p], NULL, &produce<queue_t>, &producers[p]);
+        guarantee_xerr(res == 0, res, "pthread_create failed");
+    }
+    for (int received = 0; received < total; ) {
+        if (queue->pop() != NULL) {
+            ++received;
+        }
+    }
+    m->stop();
+    const double secs = ticks_to_secs(get_ticks() - start);
+    m->add_ops(total);
+
+    for (int p = 0; p < num_producers; ++p) {
+        int res = pthread_join(threads[p], NULL);
+        guarantee_xerr(res == 0, res, "pthread_join failed");
+    }
+    guarantee(queue->pop() == NULL);
+    return total / secs;
+}
+
+/* Hands values from a few producer threads to one consumer through
+`mpsc_queue_t`, and through the spinlocked list it replaced in the message hub.
+The "mpsc_queue" phase reports how many times faster it was as `speedup`. The
+numbers only mean something with at least as many cores as threads. */
+BENCHMARK(mpsc_queue, producers) {
+    const int producer_counts[] = { 1, 2, 4 };
+    for (size_t i = 0; i < sizeof(producer_counts) / sizeof(producer_counts[0]); ++i) {
+        double spinlock_rate;
+        {
+            spinlock_list_queue_t queue;
+            measurement_t m(context, "spinlock_list");
+            spinlock_rate = run_producers(context, &queue, producer_counts[i], &m);
+            m.report();
+        }
+
+        {
+            mpsc_queue_t<queued_value_t> queue;
+            measurement_t m(context, "mpsc_queue");
+            const double mpsc_rate = run_producers(context, &queue, producer_counts[i], &m);
+            m.set_counter("speedup", mpsc_rate / spinlock_rate);
+            m.report();
+        }
+    }
+}
+
+}  // namespace benchmark
@@ -0,0 +1,229 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "benchmark/benchmark.hpp"
+#include "buffer_cache/buffer_cache.hpp"
+#include "perfmon/core.hpp"
+#include "serializer/config.hpp"
+#include "serializer/log/log_serializer.hpp"
+
+namespace benchmark {
+
+static const int NUM_BLOCKS = 20000;
+static const int WRITE_BATCH_SIZE = 64;
+
+// Something that compresses about as well as the documents in a real table do.
+static void fill_block(rng_t *rng, void *buf, size_t size) {
+    char *data = static_cast<char *>(buf);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = 'a' + rng->randint(16);
+    }
+}
+
+static void write_blocks(serializer_t *serializer, const std::vector<block_id_t> &block_ids, const void *buf) {
+    std::vector<serializer_write_t> writes;
+    for (size_t i = 0; i < block_ids.size(); ++i) {
+        writes.push_back(serializer_write_t::make_update(block_ids[i], repli_timestamp_t::distant_past, buf));
+    }
+    do_writes(serializer, writes, DEFAULT_DISK_ACCOUNT);
+}
+
+static void read_block(serializer_t *serializer, block_id_t block_id, void *buf) {
+    intrusive_ptr_t<standard_block_token_t> token = serializer->index_read(block_id);
+    guarantee(token);
+    serializer->block_read(token, buf, DEFAULT_DISK_ACCOUNT);
+}
+
+/* Writes every block in order and then overwrites random ones, in batches like
+the ones the cache's writeback makes, and then reads them back one at a time,
+in order and at random. */
+static void run_serializer_benchmark(context_t *context, file_kind_t kind) {
+    benchmark_file_t file(context, kind);
+    standard_serializer_t::create(file.opener(), standard_serializer_t::static_config_t());
+    standard_serializer_t serializer(standard_serializer_t::dynamic_config_t(), file.opener(),
+                                     &get_global_perfmon_collection());
+
+    const int64_t num_blocks = context->scaled(NUM_BLOCKS);
+    const size_t block_size = serializer.get_block_size().value();
+    rng_t rng(0);
+
+    void *buf = serializer.malloc();
+    fill_block(&rng, buf, block_size);
+
+    {
+        measurement_t m(context, "sequential_write");
+        m.set_param("block_size", block_size);
+        m.set_param("batch_size", WRITE_BATCH_SIZE);
+        m.start();
+        std::vector<block_id_t> batch;
+        for (int64_t i = 0; i < num_blocks; ++i) {
+            batch.push_back(i);
+            if (batch.size() == static_cast<size_t>(WRITE_BATCH_SIZE) || i == num_blocks - 1) {
+                write_blocks(&serializer, batch, buf);
+                m.add_ops(batch.size(), batch.size() * block_size);
+                batch.clear();
+            }
+        }
+        m.stop();
+        m.report();
+    }
+
+    {
+        measurement_t m(context, "random_write");
+        m.set_param("block_size", block_size);
+        m.set_param("batch_size", WRITE_BATCH_SIZE);
+        m.start();
+        for (int64_t written = 0; written < num_blocks; ) {
+            // A block can only be written once per batch.
+            std::set<block_id_t> batch;
+            while (batch.size() < static_cast<size_t>(std::min<int64_t>(WRITE_BATCH_SIZE, num_blocks))) {
+                batch.insert(rng.randint(num_blocks));
+            }
+            write_blocks(&serializer, std::vector<block_id_t>(batch.begin(), batch.end()), buf);
+            m.add_ops(batch.size(), batch.size() * block_size);
+            written += batch.size();
+        }
+        m.stop();
+        m.report();
+    }
+
+    {
+        measurement_t m(context, "sequential_read");
+        m.set_param("block_size", block_size);
+        for (int64_t i = 0; i < num_blocks; ++i) {
+            m.start_op();
+            read_block(&serializer, i, buf);
+            m.end_op(block_size);
+        }
+        m.report();
+    }
+
+    {
+        measurement_t m(context, "random_read");
+        m.set_param("block_size", block_size);
+        for (int64_t i = 0; i < num_blocks; ++i) {
+            block_id_t block_id = rng.randint(num_blocks);
+            m.start_op();
+            read_block(&serializer, block_id, buf);
+            m.end_op(block_size);
+        }
+        m.report();
+    }
+
+    serializer.free(buf);
+}
+
+BENCHMARK(serializer, mock_file) {
+    run_serializer_benchmark(context, MOCK_FILE);
+}
+
+BENCHMARK(serializer, real_file) {
+    run_serializer_benchmark(context, REAL_FILE);
+}
+
+/* Reads random blocks through the cache, one transaction per block, with the
+cache big enough for all of them, half of them and a tenth of them. The last
+phase sends nine out of ten reads to a tenth of the blocks, which fits. */
+static void run_cache_benchmark(context_t *context, file_kind_t kind) {
+    benchmark_file_t file(context, kind);
+    standard_serializer_t::create(file.opener(), standard_serializer_t::static_config_t());
+    standard_serializer_t serializer(standard_serializer_t::dynamic_config_t(), file.opener(),
+                                     &get_global_perfmon_collection());
+
+    mirrored_cache_static_config_t cache_static_config;
+    cache_t::create(&serializer, &cache_static_config);
+
+    const int64_t num_blocks = context->scaled(NUM_BLOCKS);
+    const int64_t block_size = serializer.get_block_size().value();
+    rng_t rng(0);
+    order_source_t order_source;
+    std::vector<block_id_t> block_ids;
+
+    {
+        mirrored_cache_config_t cache_config;
+        cache_config.max_size = 2 * num_blocks * block_size;
+        cache_t cache(&serializer, &cache_config, &get_global_perfmon_collection());
+
+        measurement_t m(context, "create");
+        m.set_param("batch_size", WRITE_BATCH_SIZE);
+        for (int64_t i = 0; i < num_blocks; i += WRITE_BATCH_SIZE) {
+            int64_t n = std::min<int64_t>(WRITE_BATCH_SIZE, num_blocks - i);
+            m.start_op();
+            transaction_t txn(&cache, rwi_write, n, repli_timestamp_t::distant_past,
+                              order_source.check_in("run_cache_benchmark(create)"));
+            for (int64_t j = 0; j < n; ++j) {
+                buf_lock_t buf(&txn);
+                block_ids.push_back(buf.get_block_id());
+                fill_block(&rng, buf.get_data_major_write(), cache.get_block_size().value());
+            }
+            m.end_op(n * block_size);
+        }
+        m.report();
+        // Destroying the cache flushes everything.
+    }
+
+    struct read_phase_t {
+        const char *name;
+        double cache_fraction;
+        double hot_fraction;
+    };
+    const read_phase_t phases[] = {
+        { "random_read", 1.0, 1.0 },
+        { "random_read", 0.5, 1.0 },
+        { "random_read", 0.1, 1.0 },
+        { "skewed_read", 0.1, 0.1 }
+    };
+
+    for (size_t p = 0; p < sizeof(phases) / sizeof(phases[0]); ++p) {
+        const read_phase_t &phase = phases[p];
+        mirrored_cache_config_t cache_config;
+        cache_config.max_size = std::max<int64_t>(1, phase.cache_fraction * num_blocks) * block_size;
+        cache_t cache(&serializer, &cache_config, &get_global_perfmon_collection());
+
+        const int64_t num_hot = std::max<int64_t>(1, phase.hot_fraction * num_blocks);
+        const int64_t num_reads = 2 * num_blocks;
+
+        // The first half of the reads fill up the cache; only the second half
+        // gets measured.
+        measurement_t m(context, phase.name);
+        m.set_param("cache_fraction", phase.cache_fraction);
+        m.set_param("hot_fraction", phase.hot_fraction);
+        int64_t hits = 0;
+        for (int64_t i = 0; i < num_reads; ++i) {
+            block_id_t block_id;
+            if (num_hot < num_blocks && rng.randint(10) != 0) {
+                block_id = block_ids[rng.randint(num_hot)];
+            } else {
+                block_id = block_ids[rng.randint(num_blocks)];
+            }
+            const bool measured = i >= num_reads / 2;
+            if (measured) {
+                hits += cache.contains_block(block_id) ? 1 : 0;
+                m.start_op();
+            }
+            {
+                transaction_t txn(&cache, rwi_read, 0, repli_timestamp_t::invalid,
+                                  order_source.check_in("run_cache_benchmark(read)").with_read_mode());
+                buf_lock_t buf(&txn, block_id, rwi_read);
+                guarantee(buf.get_data_read() != NULL);
+            }
+            if (measured) {
+                m.end_op(block_size);
+            }
+        }
+        m.set_counter("hit_ratio", static_cast<double>(hits) / m.ops());
+        m.report();
+    }
+}
+
+BENCHMARK(cache, mock_file) {
+    run_cache_benchmark(context, MOCK_FILE);
+}
+
+BENCHMARK(cache, real_file) {
+    run_cache_benchmark(context, REAL_FILE);
+}
+
+}  // namespace benchmark
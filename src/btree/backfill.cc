@@ -2,19 +2,25 @@
 #include "btree/backfill.hpp"
 
 #include <algorithm>
+#include <map>
 
 #include "errors.hpp"
 #include <boost/bind.hpp>
+#include <boost/optional.hpp>
 
 #include "arch/runtime/runtime.hpp"
 #include "btree/node.hpp"
 #include "btree/internal_node.hpp"
 #include "btree/leaf_node.hpp"
+#include "btree/operations.hpp"
 #include "btree/parallel_traversal.hpp"
 #include "btree/slice.hpp"
 #include "buffer_cache/buffer_cache.hpp"
 #include "protocol_api.hpp"
 
+/* How many leaves to backfill between calls to `on_range_done()`. */
+#define BACKFILL_CHECKPOINT_LEAVES 256
+
 struct backfill_traversal_helper_t : public btree_traversal_helper_t, public home_thread_mixin_debug_only_t {
     void process_a_leaf(transaction_t *txn, buf_lock_t *leaf_node_buf, const btree_key_t *left_exclusive_or_null, const btree_key_t *right_inclusive_or_null, DEBUG_VAR int *population_change_out, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
         assert_thread();
@@ -56,6 +62,68 @@ struct backfill_traversal_helper_t : public btree_traversal_helper_t, public hom
         x.interruptor = interruptor;
 
         leaf::dump_entries_since_time(sizer_, data, since_when_, leaf_node_buf->get_recency(), &x);
+
+        note_done(left_exclusive_or_null, right_inclusive_or_null);
+        ++leaves_since_checkpoint_;
+        maybe_report_done_range(interruptor);
+    }
+
+    /* Leaves get processed, and uninteresting subtrees skipped, in no
+    particular order. The intervals they cover tile the key space, so we
+    stitch them back together to find out how far from the left the backfill
+    is complete. */
+    void note_done(const btree_key_t *left_exclusive_or_null, const btree_key_t *right_inclusive_or_null) {
+        assert_thread();
+        boost::optional<store_key_t> right;
+        if (right_inclusive_or_null) {
+            right = store_key_t(right_inclusive_or_null);
+        }
+
+        if (left_exclusive_or_null) {
+            rassert(detached_intervals_.find(store_key_t(left_exclusive_or_null)) == detached_intervals_.end());
+            detached_intervals_.insert(std::make_pair(store_key_t(left_exclusive_or_null), right));
+        } else {
+            rassert(!leftmost_done_);
+            leftmost_done_ = true;
+            advance_done_through(right);
+        }
+
+        if (!leftmost_done_) {
+            return;
+        }
+        while (!rightmost_done_) {
+            std::map<store_key_t, boost::optional<store_key_t> >::iterator it = detached_intervals_.find(done_through_);
+            if (it == detached_intervals_.end()) {
+                break;
+            }
+            advance_done_through(it->second);
+            detached_intervals_.erase(it);
+        }
+    }
+
+    void advance_done_through(const boost::optional<store_key_t> &right_inclusive) {
+        if (right_inclusive) {
+            done_through_ = *right_inclusive;
+        } else {
+            rightmost_done_ = true;
+        }
+        done_through_moved_ = true;
+    }
+
+    void maybe_report_done_range(signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        if (!done_through_moved_ || !(rightmost_done_ || leaves_since_checkpoint_ >= BACKFILL_CHECKPOINT_LEAVES)) {
+            return;
+        }
+        done_through_moved_ = false;
+        leaves_since_checkpoint_ = 0;
+
+        key_range_t done = key_range_;
+        if (!rightmost_done_) {
+            done = done.intersection(key_range_t(key_range_t::none, store_key_t(), key_range_t::closed, done_through_));
+        }
+        if (!done.is_empty()) {
+            callback_->on_range_done(done, interruptor);
+        }
     }
 
     void postprocess_internal_node(UNUSED buf_lock_t *internal_node_buf) {
@@ -67,6 +135,8 @@ struct backfill_traversal_helper_t : public btree_traversal_helper_t, public hom
     access_t btree_node_mode() { return rwi_read; }
 
     struct annoying_t : public get_subtree_recencies_callback_t {
+        backfill_traversal_helper_t *helper;
+        ranged_block_ids_t *ids_source;
         interesting_children_callback_t *cb;
         scoped_array_t<block_id_t> block_ids;
         scoped_array_t<repli_timestamp_t> recencies;
@@ -83,6 +153,11 @@ struct backfill_traversal_helper_t : public btree_traversal_helper_t, public hom
             for (int i = 0, e = block_ids.size(); i < e; ++i) {
                 if (block_ids[i] != NULL_BLOCK_ID && recencies[i] >= since_when) {
                     cb->receive_interesting_child(i);
+                } else {
+                    block_id_t id;
+                    const btree_key_t *left, *right;
+                    ids_source->get_block_id_and_bounding_interval(i, &id, &left, &right);
+                    helper->note_done(left, right);
                 }
             }
 
@@ -111,6 +186,8 @@ struct backfill_traversal_helper_t : public btree_traversal_helper_t, public hom
         }
 
         cond_t done_cond;
+        fsm->helper = this;
+        fsm->ids_source = ids_source;
         fsm->cb = cb;
         fsm->since_when = since_when_;
         fsm->recencies.init(num_block_ids);
@@ -154,9 +231,20 @@ struct backfill_traversal_helper_t : public btree_traversal_helper_t, public hom
     value_sizer_t<void> *sizer_;
     const key_range_t& key_range_;
 
+    /* Finished intervals that aren't connected to the left edge yet, as
+    (left exclusive, right inclusive or unbounded). */
+    std::map<store_key_t, boost::optional<store_key_t> > detached_intervals_;
+    bool leftmost_done_, rightmost_done_;
+    /* Everything up to and including `done_through_` has been backfilled
+    (when `leftmost_done_`). */
+    store_key_t done_through_;
+    bool done_through_moved_;
+    int leaves_since_checkpoint_;
+
     backfill_traversal_helper_t(agnostic_backfill_callback_t *callback, repli_timestamp_t since_when,
                                 value_sizer_t<void> *sizer, const key_range_t& key_range)
-        : callback_(callback), since_when_(since_when), sizer_(sizer), key_range_(key_range) { }
+        : callback_(callback), since_when_(since_when), sizer_(sizer), key_range_(key_range),
+          leftmost_done_(false), rightmost_done_(false), done_through_moved_(false), leaves_since_checkpoint_(0) { }
 };
 
 void do_agnostic_btree_backfill(value_sizer_t<void> *sizer, btree_slice_t *slice, const key_range_t& key_range, repli_timestamp_t since_when,
@@ -168,3 +256,40 @@ void do_agnostic_btree_backfill(value_sizer_t<void> *sizer, btree_slice_t *slice
     helper.progress = p;
     btree_parallel_traversal(txn, superblock, slice, &helper, interruptor);
 }
+
+void split_backfill_range(transaction_t *txn, superblock_t *superblock, const key_range_t &key_range, int max_parts,
+                          std::vector<key_range_t> *parts_out) {
+    rassert(max_parts >= 1);
+    parts_out->clear();
+
+    /* The smallest key that can go in each of the root's children but the
+    first, where that falls inside `key_range`. */
+    std::vector<store_key_t> boundaries;
+    block_id_t root_id = superblock->get_root_block_id();
+    if (root_id != NULL_BLOCK_ID && max_parts > 1) {
+        buf_lock_t root(txn, root_id, rwi_read);
+        const node_t *node = reinterpret_cast<const node_t *>(root.get_data_read());
+        if (node::is_internal(node)) {
+            const internal_node_t *inode = reinterpret_cast<const internal_node_t *>(node);
+            // The last pair has no key.
+            for (int i = 0; i < inode->npairs - 1; ++i) {
+                store_key_t boundary(&internal_node::get_pair_by_index(inode, i)->key);
+                if (boundary.increment() && key_range.left < boundary && key_range.contains_key(boundary)) {
+                    boundaries.push_back(boundary);
+                }
+            }
+        }
+    }
+
+    /* Use evenly spaced boundaries if there are too many. */
+    int num_parts = std::min<int>(boundaries.size() + 1, max_parts);
+    key_range_t part = key_range;
+    for (int i = 1; i < num_parts; ++i) {
+        const store_key_t &boundary = boundaries[i * boundaries.size() / num_parts];
+        part.right = key_range_t::right_bound_t(boundary);
+        parts_out->push_back(part);
+        part.left = boundary;
+    }
+    part.right = key_range.right;
+    parts_out->push_back(part);
+}
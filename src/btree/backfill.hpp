@@ -2,6 +2,8 @@
 #ifndef BTREE_BACKFILL_HPP_
 #define BTREE_BACKFILL_HPP_
 
+#include <vector>
+
 #include "buffer_cache/types.hpp"
 #include "utils.hpp"
 
@@ -20,6 +22,9 @@ public:
     virtual void on_delete_range(const key_range_t &range, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) = 0;
     virtual void on_deletion(const btree_key_t *key, repli_timestamp_t recency, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) = 0;
     virtual void on_pair(transaction_t *txn, repli_timestamp_t recency, const btree_key_t *key, const void *value, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) = 0;
+    /* Every change in `range` has been passed to the other callbacks. `range`
+    always starts at the left edge of the backfilled range and only grows. */
+    virtual void on_range_done(const key_range_t &range, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) = 0;
     virtual ~agnostic_backfill_callback_t() { }
 };
 
@@ -32,4 +37,15 @@ void do_agnostic_btree_backfill(value_sizer_t<void> *sizer, btree_slice_t *slice
                                 agnostic_backfill_callback_t *callback, transaction_t *txn, superblock_t *superblock, parallel_traversal_progress_t *,
                                 signal_t *interruptor) THROWS_ONLY(interrupted_exc_t);
 
+/* The most pieces `split_backfill_range()` cuts a range into. */
+#define BACKFILL_MAX_SUBRANGES 16
+
+/* Cuts `key_range` into at most `max_parts` consecutive pieces along the keys
+in the tree's root, so that each piece covers about as many of the root's
+subtrees and the pieces can be backfilled by concurrent traversals, each with
+its own progress. A tree with a leaf for a root leaves `key_range` whole. Reads
+the root through `superblock` without releasing it. */
+void split_backfill_range(transaction_t *txn, superblock_t *superblock, const key_range_t &key_range, int max_parts,
+                          std::vector<key_range_t> *parts_out);
+
 #endif  // BTREE_BACKFILL_HPP_
@@ -1,6 +1,8 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
 #include "btree/btree_store.hpp"
 
+#include <algorithm>
+
 #include "btree/operations.hpp"
 #include "serializer/config.hpp"
 #include "containers/archive/vector_stream.hpp"
@@ -103,12 +105,56 @@ void btree_store_t<protocol_t>::write(
     scoped_ptr_t<transaction_t> txn;
     scoped_ptr_t<real_superblock_t> superblock;
     const int expected_change_count = 2; // FIXME: this is incorrect, but will do for now
-    acquire_superblock_for_write(rwi_write, timestamp.to_repli_timestamp(), expected_change_count, token, &txn, &superblock, interruptor);
+    // The superblock is only upgraded if the root gets replaced or when the
+    // metainfo is written, so other writes can follow this one down the tree.
+    acquire_superblock_for_write(rwi_intent, timestamp.to_repli_timestamp(), expected_change_count, token, &txn, &superblock, interruptor);
 
     check_and_update_metainfo(DEBUG_ONLY(metainfo_checker, ) new_metainfo, txn.get(), superblock.get());
     protocol_write(write, response, timestamp, btree.get(), txn.get(), superblock.get(), interruptor);
 }
 
+template <class protocol_t>
+void btree_store_t<protocol_t>::write_batch(
+        DEBUG_ONLY(const metainfo_checker_t<protocol_t>& metainfo_checker, )
+        const metainfo_t& new_metainfo,
+        const std::vector<typename protocol_t::write_t> &writes,
+        const std::vector<transition_timestamp_t> &timestamps,
+        std::vector<typename protocol_t::write_response_t> *responses,
+        UNUSED order_token_t order_token,
+        object_buffer_t<fifo_enforcer_sink_t::exit_write_t> *token,
+        signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t) {
+    assert_thread();
+    guarantee(writes.size() == timestamps.size());
+    responses->resize(writes.size());
+
+    // The transaction's recency has to bound every write's timestamp from
+    // above, and the writes come in timestamp order.
+    repli_timestamp_t txn_timestamp = timestamps.empty() ? repli_timestamp_t::distant_past : timestamps.back().to_repli_timestamp();
+
+    scoped_ptr_t<transaction_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    // What writeback reserves against its dirty block limit: each write
+    // dirties the leaf its key goes in, and a split adds a new node and the
+    // parent.  Writes that land in the same leaf dirty it once, so this
+    // overestimates more often than not; going over it just throttles less.
+    const int expected_change_count = writes.size() + 2;
+    // As in `write()`, the superblock is only held for writing when it changes.
+    acquire_superblock_for_write(rwi_intent, txn_timestamp, expected_change_count, token, &txn, &superblock, interruptor);
+
+    check_and_update_metainfo(DEBUG_ONLY(metainfo_checker, ) new_metainfo, txn.get(), superblock.get());
+
+    for (size_t i = 0; i < writes.size(); ++i) {
+        // Each write lets go of the superblock as soon as it's past the
+        // root, so take it again within the same transaction for the next.
+        if (!superblock.has()) {
+            get_btree_superblock(txn.get(), rwi_intent, &superblock);
+        }
+        protocol_write(writes[i], &(*responses)[i], timestamps[i], btree.get(), txn.get(), superblock.get(), interruptor);
+        superblock.reset();
+    }
+}
+
 // TODO: Figure out wtf does the backfill filtering, figure out wtf constricts delete range operations to hit only a certain hash-interval, figure out what filters keys.
 template <class protocol_t>
 bool btree_store_t<protocol_t>::send_backfill(
@@ -136,19 +182,50 @@ bool btree_store_t<protocol_t>::send_backfill(
 
 template <class protocol_t>
 void btree_store_t<protocol_t>::receive_backfill(
-        const typename protocol_t::backfill_chunk_t &chunk,
+        const std::vector<typename protocol_t::backfill_chunk_t> &chunks,
         object_buffer_t<fifo_enforcer_sink_t::exit_write_t> *token,
         signal_t *interruptor)
         THROWS_ONLY(interrupted_exc_t) {
     assert_thread();
 
+    // A batch holds the superblock for its whole transaction, so batches
+    // into one store are applied one at a time.  The concurrency comes from
+    // the store being one of several CPU-sharded stores, each with its own
+    // backfillee queue.
+
+    // Backfill chunks don't come in timestamp order, so the transaction's
+    // recency has to be the latest of them.
+    repli_timestamp_t txn_timestamp = repli_timestamp_t::distant_past;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        txn_timestamp = std::max(txn_timestamp, chunks[i].get_btree_repli_timestamp());
+    }
+
     scoped_ptr_t<transaction_t> txn;
     scoped_ptr_t<real_superblock_t> superblock;
-    const int expected_change_count = 1; // FIXME: this is probably not correct
-
-    acquire_superblock_for_write(rwi_write, chunk.get_btree_repli_timestamp(), expected_change_count, token, &txn, &superblock, interruptor);
+    // This is what writeback reserves against its dirty block limit.  Each
+    // key chunk dirties the leaf its key goes in, and a split adds a new node
+    // and the parent, as in `write()`.  Range deletes can dirty more than
+    // that; going over the reservation just throttles less, since writeback
+    // takes the dirty blocks it's actually given.
+    const int expected_change_count = chunks.size() + 2;
+
+    acquire_superblock_for_write(rwi_write, txn_timestamp, expected_change_count, token, &txn, &superblock, interruptor);
+
+    // Backfilling an empty replica sends the keys more or less in order, so
+    // most batches go after everything in the tree and can be appended to
+    // its right edge instead of inserted one key at a time.
+    if (protocol_bulk_load_backfill(btree.get(), txn.get(), superblock.get(), chunks)) {
+        return;
+    }
 
-    protocol_receive_backfill(btree.get(), txn.get(), superblock.get(), interruptor, chunk);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        // As in `write_batch()`, each chunk lets go of the superblock.
+        if (!superblock.has()) {
+            get_btree_superblock(txn.get(), rwi_write, &superblock);
+        }
+        protocol_receive_backfill(btree.get(), txn.get(), superblock.get(), interruptor, chunks[i]);
+        superblock.reset();
+    }
 }
 
 template <class protocol_t>
@@ -211,12 +288,15 @@ void btree_store_t<protocol_t>::update_metainfo(const metainfo_t &old_metainfo,
     assert_thread();
     region_map_t<protocol_t, binary_blob_t> updated_metadata = old_metainfo;
     updated_metadata.update(new_metainfo);
+    updated_metadata.coalesce();
 
     rassert(updated_metadata.get_domain() == protocol_t::region_t::universe());
 
-    buf_lock_t* sb_buf = superblock->get();
-    clear_superblock_metainfo(txn, sb_buf);
+    if (updated_metadata == old_metainfo) {
+        return;
+    }
 
+    std::vector<std::pair<std::vector<char>, std::vector<char> > > kv_pairs;
     for (typename region_map_t<protocol_t, binary_blob_t>::const_iterator i = updated_metadata.begin(); i != updated_metadata.end(); ++i) {
         vector_stream_t key;
         write_message_t msg;
@@ -227,8 +307,13 @@ void btree_store_t<protocol_t>::update_metainfo(const metainfo_t &old_metainfo,
         std::vector<char> value(static_cast<const char*>((*i).second.data()),
                                 static_cast<const char*>((*i).second.data()) + (*i).second.size());
 
-        set_superblock_metainfo(txn, sb_buf, key.vector(), value); // FIXME: this is not efficient either, see how value is created
+        kv_pairs.push_back(std::make_pair(key.vector(), value));
     }
+
+    // Writing the metainfo needs the superblock for writing.  Leave it until
+    // the superblock is released, which for a write is once it's past the
+    // root, so that the superblock isn't held exclusively on the way down.
+    superblock->set_metainfo_on_release(txn, kv_pairs);
 }
 
 template <class protocol_t>
@@ -3,6 +3,7 @@
 #define BTREE_BTREE_STORE_HPP_
 
 #include <string>
+#include <vector>
 
 #include "protocol_api.hpp"
 #include "buffer_cache/mirrored/config.hpp"  // TODO: Move to buffer_cache/config.hpp or something.
@@ -67,6 +68,17 @@ public:
             signal_t *interruptor)
         THROWS_ONLY(interrupted_exc_t);
 
+    void write_batch(
+            DEBUG_ONLY(const metainfo_checker_t<protocol_t>& metainfo_checker, )
+            const metainfo_t& new_metainfo,
+            const std::vector<typename protocol_t::write_t> &writes,
+            const std::vector<transition_timestamp_t> &timestamps,
+            std::vector<typename protocol_t::write_response_t> *responses,
+            order_token_t order_token,
+            object_buffer_t<fifo_enforcer_sink_t::exit_write_t> *token,
+            signal_t *interruptor)
+        THROWS_ONLY(interrupted_exc_t);
+
     bool send_backfill(
             const region_map_t<protocol_t, state_timestamp_t> &start_point,
             send_backfill_callback_t<protocol_t> *send_backfill_cb,
@@ -76,7 +88,7 @@ public:
         THROWS_ONLY(interrupted_exc_t);
 
     void receive_backfill(
-            const typename protocol_t::backfill_chunk_t &chunk,
+            const std::vector<typename protocol_t::backfill_chunk_t> &chunks,
             object_buffer_t<fifo_enforcer_sink_t::exit_write_t> *token,
             signal_t *interruptor)
         THROWS_ONLY(interrupted_exc_t);
@@ -120,6 +132,14 @@ protected:
                                            signal_t *interruptor,
                                            const typename protocol_t::backfill_chunk_t &chunk) = 0;
 
+    /* Applies `chunks` with a `btree_bulk_loader_t`, if they're all key/value
+    pairs that go after everything in the tree.  Returns false, having changed
+    nothing, if they aren't. */
+    virtual bool protocol_bulk_load_backfill(btree_slice_t *btree,
+                                             transaction_t *txn,
+                                             superblock_t *superblock,
+                                             const std::vector<typename protocol_t::backfill_chunk_t> &chunks) = 0;
+
     virtual void protocol_reset_data(const typename protocol_t::region_t& subregion,
                                      btree_slice_t *btree,
                                      transaction_t *txn,
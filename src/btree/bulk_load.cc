@@ -0,0 +1,378 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "btree/bulk_load.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "btree/internal_node.hpp"
+#include "btree/node.hpp"
+#include "btree/operations.hpp"
+#include "buffer_cache/buffer_cache.hpp"
+
+namespace {
+
+// Inserts the entries of one leaf into another, for as long as they fit.
+class leaf_absorber_t : public leaf::entry_reception_callback_t {
+public:
+    leaf_absorber_t(value_sizer_t<void> *sizer, leaf_node_t *node) : sizer_(sizer), node_(node), fits_(true) { }
+
+    void lost_deletions() { }
+
+    void deletion(UNUSED const btree_key_t *k, UNUSED repli_timestamp_t tstamp) {
+        // We only absorb leaves we built ourselves, which have no deletions.
+        unreachable();
+    }
+
+    void key_value(const btree_key_t *k, const void *value, repli_timestamp_t tstamp) {
+        if (fits_ && leaf::is_full(sizer_, node_, k, value)) {
+            fits_ = false;
+        }
+        if (fits_) {
+            leaf::insert(sizer_, node_, k, value, tstamp, key_modification_proof_t::real_proof());
+        }
+    }
+
+    bool fits() const { return fits_; }
+
+private:
+    value_sizer_t<void> *sizer_;
+    leaf_node_t *node_;
+    bool fits_;
+};
+
+typedef std::pair<block_id_t, store_key_t> child_t;
+
+// The children of `node`, each with the largest key under it.
+void get_children(const internal_node_t *node, const store_key_t &max_key, std::vector<child_t> *children_out) {
+    for (int i = 0; i < node->npairs - 1; ++i) {
+        const btree_internal_pair *pair = internal_node::get_pair_by_index(node, i);
+        children_out->push_back(child_t(pair->lnode, store_key_t(&pair->key)));
+    }
+    children_out->push_back(child_t(internal_node::get_pair_by_index(node, node->npairs - 1)->lnode, max_key));
+}
+
+size_t child_cost(const child_t &child) {
+    return sizeof(uint16_t) + sizeof(btree_internal_pair) + child.second.size();
+}
+
+// Returns false if they don't all fit.
+MUST_USE bool build_internal_node(block_size_t block_size, internal_node_t *node,
+                                  std::vector<child_t>::const_iterator beg, std::vector<child_t>::const_iterator end) {
+    internal_node::init(block_size, node);
+    for (std::vector<child_t>::const_iterator it = beg; it != end; ++it) {
+        if (!internal_node::can_append(node, it->second.btree_key())) {
+            return false;
+        }
+        internal_node::append(node, it->first, it + 1 == end ? NULL : it->second.btree_key());
+    }
+    return true;
+}
+
+}  // namespace
+
+btree_bulk_loader_t::btree_bulk_loader_t(value_sizer_t<void> *sizer, transaction_t *txn, superblock_t *superblock,
+                                         repli_timestamp_t tstamp, double fill_fraction)
+    : sizer_(sizer), txn_(txn), superblock_(superblock), tstamp_(tstamp),
+      fill_bytes_(fill_fraction * sizer->block_size().value()),
+      leaf_(sizer->block_size().value()), leaf_reuse_id_(NULL_BLOCK_ID),
+      held_leaf_(sizer->block_size().value()), has_held_leaf_(false), held_leaf_reuse_id_(NULL_BLOCK_ID),
+      has_last_key_(false), latest_recency_(tstamp), population_(0), finished_(false) {
+    rassert(0 < fill_fraction && fill_fraction <= 1);
+    leaf::init(sizer_, leaf_.get());
+    if (superblock->get_root_block_id() != NULL_BLOCK_ID) {
+        pick_up_right_edge();
+    }
+}
+
+btree_bulk_loader_t::~btree_bulk_loader_t() {
+    rassert(finished_ || population_ == 0, "A bulk load was abandoned halfway.");
+}
+
+void btree_bulk_loader_t::pick_up_right_edge() {
+    const block_size_t block_size = sizer_->block_size();
+
+    // Top to bottom.
+    std::vector<level_t *> edge;
+    block_id_t node_id = superblock_->get_root_block_id();
+    for (;;) {
+        buf_lock_t buf(txn_, node_id, rwi_read);
+        const node_t *node = reinterpret_cast<const node_t *>(buf.get_data_read());
+        if (!node::is_internal(node)) {
+            memcpy(leaf_.get(), node, block_size.value());
+            leaf_reuse_id_ = node_id;
+            break;
+        }
+
+        // The last child is the next node down the edge, which goes back in
+        // once it's written.
+        const internal_node_t *internal = reinterpret_cast<const internal_node_t *>(node);
+        rassert(internal->npairs >= 2);
+        level_t *level = new level_t(block_size.value());
+        internal_node::init(block_size, level->node.get());
+        for (int i = 0; i < internal->npairs - 2; ++i) {
+            const btree_internal_pair *pair = internal_node::get_pair_by_index(internal, i);
+            internal_node::append(level->node.get(), pair->lnode, &pair->key);
+        }
+        const btree_internal_pair *pending = internal_node::get_pair_by_index(internal, internal->npairs - 2);
+        level->has_pending = true;
+        level->pending_child = pending->lnode;
+        level->pending_key = store_key_t(&pending->key);
+        level->reuse_id = node_id;
+        edge.push_back(level);
+
+        node_id = internal_node::get_pair_by_index(internal, internal->npairs - 1)->lnode;
+    }
+
+    for (size_t i = edge.size(); i-- > 0;) {
+        levels_.push_back(edge[i]);
+    }
+
+    // New keys must go after everything in the rightmost leaf, or after its
+    // left neighbor if it's empty.
+    if (!leaf::is_empty(leaf_.get())) {
+        last_key_ = leaf::largest_key(sizer_, leaf_.get());
+        has_last_key_ = true;
+    } else if (!levels_.empty()) {
+        last_key_ = levels_[0].pending_key;
+        has_last_key_ = true;
+    }
+}
+
+bool btree_bulk_loader_t::accepts(const btree_key_t *key) const {
+    return !has_last_key_ || sized_strcmp(last_key_.contents(), last_key_.size(), key->contents, key->size) < 0;
+}
+
+void btree_bulk_loader_t::add(const btree_key_t *key, const void *value) {
+    add(key, value, tstamp_);
+}
+
+void btree_bulk_loader_t::add(const btree_key_t *key, const void *value, repli_timestamp_t recency) {
+    rassert(!finished_);
+    rassert(accepts(key), "Bulk loaded keys must be strictly increasing, and above the tree's.");
+
+    if (!leaf::is_empty(leaf_.get()) && (used_bytes(leaf_.get()) >= fill_bytes_ || leaf::is_full(sizer_, leaf_.get(), key, value))) {
+        flush_leaf(key);
+    }
+
+    leaf::insert(sizer_, leaf_.get(), key, value, recency, key_modification_proof_t::real_proof());
+    last_key_.assign(key);
+    has_last_key_ = true;
+    latest_recency_ = std::max(latest_recency_, recency);
+    ++population_;
+}
+
+void btree_bulk_loader_t::finish() {
+    rassert(!finished_);
+    finished_ = true;
+
+    if (population_ == 0) {
+        superblock_->release();
+        return;
+    }
+
+    finish_leaves();
+
+    // Finish every level but the top one; the top one is left with just the
+    // child that becomes the root.
+    for (size_t i = 0; i < levels_.size(); ++i) {
+        level_t *level = &levels_[i];
+        rassert(level->has_pending);
+        if (i == levels_.size() - 1 && !level->has_held && level->node->npairs == 0) {
+            ensure_stat_block(txn_, superblock_, incr_priority(ZERO_EVICTION_PRIORITY));
+            {
+                buf_lock_t stat_block(txn_, superblock_->get_stat_block_id(), rwi_write);
+                static_cast<btree_statblock_t *>(stat_block.get_data_major_write())->population += population_;
+            }
+            insert_root(level->pending_child, superblock_);
+            return;
+        }
+        finish_level(i);
+    }
+    unreachable();
+}
+
+void btree_bulk_loader_t::flush_leaf(const btree_key_t *next_key) {
+    rassert(!leaf::is_empty(leaf_.get()));
+    if (has_held_leaf_) {
+        block_id_t id = write_block(held_leaf_.get(), held_leaf_reuse_id_);
+        add_child(0, id, held_leaf_key_);
+    }
+
+    held_leaf_.swap(leaf_);
+    has_held_leaf_ = true;
+    held_leaf_reuse_id_ = leaf_reuse_id_;
+    held_leaf_key_ = last_key_;
+    shorten_separator(held_leaf_key_.btree_key(), next_key);
+
+    leaf::init(sizer_, leaf_.get());
+    leaf_reuse_id_ = NULL_BLOCK_ID;
+}
+
+void btree_bulk_loader_t::finish_leaves() {
+    if (has_held_leaf_ && leaf::is_underfull(sizer_, leaf_.get())) {
+        rebalance_leaves();
+    }
+
+    if (has_held_leaf_) {
+        block_id_t id = write_block(held_leaf_.get(), held_leaf_reuse_id_);
+        has_held_leaf_ = false;
+        add_child(0, id, held_leaf_key_);
+    }
+    if (!leaf::is_empty(leaf_.get())) {
+        block_id_t id = write_block(leaf_.get(), leaf_reuse_id_);
+        add_child(0, id, last_key_);
+    }
+}
+
+// Levels the last leaf with the one held back before it or, if that would
+// leave either of them underfull, puts them together if they fit in one.
+void btree_bulk_loader_t::rebalance_leaves() {
+    rassert(leaf_reuse_id_ == NULL_BLOCK_ID);
+    const size_t block_size = sizer_->block_size().value();
+
+    scoped_malloc_t<leaf_node_t> left(block_size);
+    memcpy(left.get(), held_leaf_.get(), block_size);
+    scoped_malloc_t<leaf_node_t> right(block_size);
+    memcpy(right.get(), leaf_.get(), block_size);
+    store_key_t replacement;
+    bool leveled = !leaf::is_underfull(sizer_, left.get())
+        && leaf::level(sizer_, 1, right.get(), left.get(), replacement.btree_key());
+
+    if (!leveled || leaf::is_underfull(sizer_, left.get()) || leaf::is_underfull(sizer_, right.get())) {
+        scoped_malloc_t<leaf_node_t> merged(block_size);
+        memcpy(merged.get(), held_leaf_.get(), block_size);
+        leaf_absorber_t absorber(sizer_, merged.get());
+        leaf::dump_entries_since_time(sizer_, leaf_.get(), repli_timestamp_t::distant_past, latest_recency_, &absorber);
+        if (absorber.fits()) {
+            held_leaf_.swap(merged);
+            held_leaf_key_ = last_key_;
+            leaf::init(sizer_, leaf_.get());
+            return;
+        }
+    }
+
+    if (leveled) {
+        held_leaf_.swap(left);
+        leaf_.swap(right);
+        held_leaf_key_ = replacement;
+    }
+}
+
+void btree_bulk_loader_t::add_child(size_t level_index, block_id_t child, const store_key_t &max_key) {
+    if (level_index == levels_.size()) {
+        levels_.push_back(new level_t(sizer_->block_size().value()));
+        internal_node::init(sizer_->block_size(), levels_.back().node.get());
+    }
+
+    level_t *level = &levels_[level_index];
+    if (level->has_pending) {
+        if (used_bytes(level->node.get()) < fill_bytes_ && internal_node::can_append(level->node.get(), level->pending_key.btree_key())) {
+            internal_node::append(level->node.get(), level->pending_child, level->pending_key.btree_key());
+        } else {
+            // The node is full.  The one before it can go now.
+            internal_node::append(level->node.get(), level->pending_child, NULL);
+            if (level->has_held) {
+                block_id_t id = write_block(level->held.get(), level->held_reuse_id);
+                add_child(level_index + 1, id, level->held_key);
+            }
+
+            level->held.swap(level->node);
+            level->has_held = true;
+            level->held_reuse_id = level->reuse_id;
+            level->held_key = level->pending_key;
+
+            internal_node::init(sizer_->block_size(), level->node.get());
+            level->reuse_id = NULL_BLOCK_ID;
+        }
+    }
+
+    level->has_pending = true;
+    level->pending_child = child;
+    level->pending_key = max_key;
+}
+
+void btree_bulk_loader_t::finish_level(size_t level_index) {
+    level_t *level = &levels_[level_index];
+    rassert(level->has_pending);
+
+    internal_node::append(level->node.get(), level->pending_child, NULL);
+    level->has_pending = false;
+
+    if (level->has_held && internal_node::is_underfull(sizer_->block_size(), level->node.get())) {
+        rebalance_level(level);
+    }
+
+    if (level->has_held) {
+        block_id_t id = write_block(level->held.get(), level->held_reuse_id);
+        level->has_held = false;
+        add_child(level_index + 1, id, level->held_key);
+    }
+    if (level->node->npairs > 0) {
+        block_id_t id = write_block(level->node.get(), level->reuse_id);
+        add_child(level_index + 1, id, level->pending_key);
+    }
+}
+
+// Spreads the children of the last node and the one held back before it
+// evenly over the two or, if that would leave either of them underfull, puts
+// them all in the held one if they fit.
+void btree_bulk_loader_t::rebalance_level(level_t *level) {
+    rassert(level->reuse_id == NULL_BLOCK_ID);
+    const block_size_t block_size = sizer_->block_size();
+
+    std::vector<child_t> children;
+    get_children(level->held.get(), level->held_key, &children);
+    get_children(level->node.get(), level->pending_key, &children);
+
+    size_t total = 0;
+    for (size_t i = 0; i < children.size(); ++i) {
+        total += child_cost(children[i]);
+    }
+    size_t left = 0;
+    size_t split = 0;
+    while (2 * (left + child_cost(children[split])) <= total) {
+        left += child_cost(children[split]);
+        ++split;
+    }
+    split = std::min(std::max<size_t>(split, 1), children.size() - 1);
+
+    guarantee(build_internal_node(block_size, level->held.get(), children.begin(), children.begin() + split));
+    guarantee(build_internal_node(block_size, level->node.get(), children.begin() + split, children.end()));
+
+    if (internal_node::is_underfull(block_size, level->held.get()) || internal_node::is_underfull(block_size, level->node.get())) {
+        scoped_malloc_t<internal_node_t> merged(block_size.value());
+        if (build_internal_node(block_size, merged.get(), children.begin(), children.end())) {
+            level->held.swap(merged);
+            internal_node::init(block_size, level->node.get());
+            split = children.size();
+        }
+    }
+
+    level->held_key = children[split - 1].second;
+}
+
+size_t btree_bulk_loader_t::used_bytes(const leaf_node_t *node) const {
+    return offsetof(leaf_node_t, pair_offsets) + node->num_pairs * sizeof(*node->pair_offsets)
+        + (sizer_->block_size().value() - node->frontmost);
+}
+
+size_t btree_bulk_loader_t::used_bytes(const internal_node_t *node) const {
+    return sizeof(internal_node_t) + node->npairs * sizeof(*node->pair_offsets)
+        + (sizer_->block_size().value() - node->frontmost_offset);
+}
+
+block_id_t btree_bulk_loader_t::write_block(const void *node, block_id_t reuse_id) {
+    buf_lock_t buf;
+    if (reuse_id == NULL_BLOCK_ID) {
+        buf_lock_t fresh(txn_);
+        buf.swap(fresh);
+    } else {
+        buf_lock_t existing(txn_, reuse_id, rwi_write);
+        buf.swap(existing);
+    }
+    memcpy(buf.get_data_major_write(), node, sizer_->block_size().value());
+    return buf.get_block_id();
+}
@@ -0,0 +1,111 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef BTREE_BULK_LOAD_HPP_
+#define BTREE_BULK_LOAD_HPP_
+
+#include "errors.hpp"
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include "btree/keys.hpp"
+#include "btree/leaf_node.hpp"
+#include "buffer_cache/types.hpp"
+#include "containers/scoped.hpp"
+#include "repli_timestamp.hpp"
+
+template <class> class value_sizer_t;
+struct internal_node_t;
+class superblock_t;
+
+/* The default fraction of each node that `btree_bulk_loader_t` fills.  The
+rest is left free so that the first writes after the load don't split every
+node they touch. */
+#define BULK_LOAD_DEFAULT_FILL_FRACTION 0.9
+
+/* Builds a btree bottom-up from key/value pairs that arrive in sorted order,
+instead of descending from the root for every key.  Leaves are packed in
+memory and each node is written once, when its right neighbor is full too, so
+the blocks are allocated in key order.  The last two nodes of each level are
+rebalanced against each other before they're written, so the load never leaves
+an underfull node or an internal node with a single child on the right edge.
+
+If the tree already has keys, the loader picks up the nodes on its right edge
+and appends to them, so every key it's given must be above all of the tree's
+keys (see `accepts()`).  The loader keeps `superblock` until `finish()`, which
+installs the new root, updates the population in the stat block and releases
+the superblock. */
+class btree_bulk_loader_t {
+public:
+    btree_bulk_loader_t(value_sizer_t<void> *sizer, transaction_t *txn, superblock_t *superblock,
+                        repli_timestamp_t tstamp, double fill_fraction = BULK_LOAD_DEFAULT_FILL_FRACTION);
+    ~btree_bulk_loader_t();
+
+    /* Whether `key` is above every key in the tree and every key added so
+    far, which `add()` requires. */
+    bool accepts(const btree_key_t *key) const;
+
+    void add(const btree_key_t *key, const void *value);
+    void add(const btree_key_t *key, const void *value, repli_timestamp_t recency);
+
+    void finish();
+
+    int64_t population() const { return population_; }
+
+private:
+    // An internal node under construction.  Its last child so far is kept
+    // aside, because only the next child tells us whether it goes in with its
+    // key or as the node's final, keyless pair.  The last full node is kept
+    // back too, until we know whether the node after it ends up underfull.
+    struct level_t {
+        explicit level_t(size_t block_size)
+            : node(block_size), reuse_id(NULL_BLOCK_ID), has_pending(false), pending_child(NULL_BLOCK_ID),
+              held(block_size), has_held(false), held_reuse_id(NULL_BLOCK_ID) { }
+        scoped_malloc_t<internal_node_t> node;
+        block_id_t reuse_id;
+        bool has_pending;
+        block_id_t pending_child;
+        store_key_t pending_key;
+
+        scoped_malloc_t<internal_node_t> held;
+        bool has_held;
+        block_id_t held_reuse_id;
+        store_key_t held_key;
+    };
+
+    void pick_up_right_edge();
+    void flush_leaf(const btree_key_t *next_key);
+    void finish_leaves();
+    void rebalance_leaves();
+    void add_child(size_t level, block_id_t child, const store_key_t &max_key);
+    void finish_level(size_t level);
+    void rebalance_level(level_t *level);
+    size_t used_bytes(const leaf_node_t *node) const;
+    size_t used_bytes(const internal_node_t *node) const;
+    // Writes `node` to `reuse_id`, or to a new block if that's NULL_BLOCK_ID.
+    block_id_t write_block(const void *node, block_id_t reuse_id);
+
+    value_sizer_t<void> *sizer_;
+    transaction_t *txn_;
+    superblock_t *superblock_;
+    repli_timestamp_t tstamp_;
+    size_t fill_bytes_;
+
+    // Blocks on the tree's old right edge get rewritten in place; that's what
+    // the `reuse_id`s are for.  Freshly built nodes have NULL_BLOCK_ID there.
+    scoped_malloc_t<leaf_node_t> leaf_;
+    block_id_t leaf_reuse_id_;
+    scoped_malloc_t<leaf_node_t> held_leaf_;
+    bool has_held_leaf_;
+    block_id_t held_leaf_reuse_id_;
+    store_key_t held_leaf_key_;
+
+    bool has_last_key_;
+    store_key_t last_key_;
+    repli_timestamp_t latest_recency_;
+    int64_t population_;
+    bool finished_;
+
+    boost::ptr_vector<level_t> levels_;
+
+    DISABLE_COPYING(btree_bulk_loader_t);
+};
+
+#endif  // BTREE_BULK_LOAD_HPP_
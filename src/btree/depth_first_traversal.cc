@@ -3,7 +3,7 @@
 
 #include "btree/operations.hpp"
 
-bool btree_depth_first_traversal(btree_slice_t *slice, transaction_t *transaction, superblock_t *superblock, const key_range_t &range, depth_first_traversal_callback_t *cb) {
+bool btree_depth_first_traversal(value_sizer_t<void> *sizer, btree_slice_t *slice, transaction_t *transaction, superblock_t *superblock, const key_range_t &range, depth_first_traversal_callback_t *cb) {
     block_id_t root_block_id = superblock->get_root_block_id();
     if (root_block_id == NULL_BLOCK_ID) {
         superblock->release();
@@ -11,11 +11,11 @@ bool btree_depth_first_traversal(btree_slice_t *slice, transaction_t *transactio
     } else {
         buf_lock_t root_block(transaction, root_block_id, rwi_read);
         superblock->release();
-        return btree_depth_first_traversal(slice, transaction, &root_block, range, cb);
+        return btree_depth_first_traversal(sizer, slice, transaction, &root_block, range, cb);
     }
 }
 
-bool btree_depth_first_traversal(btree_slice_t *slice, transaction_t *transaction, buf_lock_t *block, const key_range_t &range, depth_first_traversal_callback_t *cb) {
+bool btree_depth_first_traversal(value_sizer_t<void> *sizer, btree_slice_t *slice, transaction_t *transaction, buf_lock_t *block, const key_range_t &range, depth_first_traversal_callback_t *cb) {
     const node_t *node = reinterpret_cast<const node_t *>(block->get_data_read());
     if (node::is_internal(node)) {
         const internal_node_t *inode = reinterpret_cast<const internal_node_t *>(node);
@@ -31,7 +31,7 @@ bool btree_depth_first_traversal(btree_slice_t *slice, transaction_t *transactio
         for (int i = start_index; i < end_index; i++) {
             const btree_internal_pair *pair = internal_node::get_pair_by_index(inode, i);
             buf_lock_t lock(transaction, pair->lnode, rwi_read);
-            if (!btree_depth_first_traversal(slice, transaction, &lock, range, cb)) {
+            if (!btree_depth_first_traversal(sizer, slice, transaction, &lock, range, cb)) {
                 return false;
             }
         }
@@ -39,7 +39,7 @@ bool btree_depth_first_traversal(btree_slice_t *slice, transaction_t *transactio
     } else {
         const leaf_node_t *lnode = reinterpret_cast<const leaf_node_t *>(node);
         const btree_key_t *key;
-        for (leaf::live_iter_t it = leaf::iter_for_inclusive_lower_bound(lnode, range.left.btree_key());
+        for (leaf::live_iter_t it = leaf::iter_for_inclusive_lower_bound(sizer, lnode, range.left.btree_key());
                 (key = it.get_key(lnode)) && (range.right.unbounded || sized_strcmp(key->contents, key->size, range.right.key.contents(), range.right.key.size()) < 0);
                 it.step(lnode)) {
             if (!cb->handle_pair(key, it.get_value(lnode))) {
@@ -6,6 +6,7 @@
 #include "btree/slice.hpp"
 
 class superblock_t;
+template <class> class value_sizer_t;
 
 class depth_first_traversal_callback_t {
 public:
@@ -18,10 +19,10 @@ protected:
 
 /* Returns `true` if we reached the end of the btree or range, and `false` if
 `cb->handle_value()` returned `false`. */
-bool btree_depth_first_traversal(btree_slice_t *slice, transaction_t *transaction, superblock_t *superblock, const key_range_t &range, depth_first_traversal_callback_t *cb);
+bool btree_depth_first_traversal(value_sizer_t<void> *sizer, btree_slice_t *slice, transaction_t *transaction, superblock_t *superblock, const key_range_t &range, depth_first_traversal_callback_t *cb);
 
 /* Returns `true` if we reached the end of the subtree or range, and `false` if
 `cb->handle_value()` returned `false`. */
-bool btree_depth_first_traversal(btree_slice_t *slice, transaction_t *transaction, buf_lock_t *block, const key_range_t &range, depth_first_traversal_callback_t *cb);
+bool btree_depth_first_traversal(value_sizer_t<void> *sizer, btree_slice_t *slice, transaction_t *transaction, buf_lock_t *block, const key_range_t &range, depth_first_traversal_callback_t *cb);
 
 #endif /* BTREE_DEPTH_FIRST_TRAVERSAL_HPP_ */
@@ -27,7 +27,7 @@ public:
 
         std::vector<store_key_t> keys_to_delete;
 
-        for (leaf::live_iter_t iter = leaf::iter_for_whole_leaf(node); /* no test */; iter.step(node)) {
+        for (leaf::live_iter_t iter = leaf::iter_for_whole_leaf(sizer_, node); /* no test */; iter.step(node)) {
             const btree_key_t *k = iter.get_key(node);
             if (!k) {
                 break;
@@ -9,8 +9,8 @@
 
 class get_distribution_traversal_helper_t : public btree_traversal_helper_t, public home_thread_mixin_debug_only_t {
 public:
-    get_distribution_traversal_helper_t(int _depth_limit, std::vector<store_key_t> *_keys)
-        : depth_limit(_depth_limit), key_count(0), keys(_keys)
+    get_distribution_traversal_helper_t(value_sizer_t<void> *_sizer, int _depth_limit, std::vector<store_key_t> *_keys)
+        : sizer(_sizer), depth_limit(_depth_limit), key_count(0), keys(_keys)
     { }
 
     void read_stat_block(buf_lock_t *stat_block) { 
@@ -29,7 +29,7 @@ public:
                                 UNUSED signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
         const leaf_node_t *node = reinterpret_cast<const leaf_node_t *>(leaf_node_buf->get_data_read());
 
-        leaf::live_iter_t it = iter_for_whole_leaf(node);
+        leaf::live_iter_t it = iter_for_whole_leaf(sizer, node);
 
         const btree_key_t *key;
         while ((key = it.get_key(node))) {
@@ -75,6 +75,7 @@ public:
         return rwi_read;
     }
 
+    value_sizer_t<void> *sizer;
     int depth_limit;
     int64_t key_count;
 
@@ -82,8 +83,8 @@ public:
     std::vector<store_key_t> *keys; 
 };
 
-void get_btree_key_distribution(btree_slice_t *slice, transaction_t *txn, superblock_t *superblock, int depth_limit, int64_t *key_count_out, std::vector<store_key_t> *keys_out) {
-    get_distribution_traversal_helper_t helper(depth_limit, keys_out);
+void get_btree_key_distribution(value_sizer_t<void> *sizer, btree_slice_t *slice, transaction_t *txn, superblock_t *superblock, int depth_limit, int64_t *key_count_out, std::vector<store_key_t> *keys_out) {
+    get_distribution_traversal_helper_t helper(sizer, depth_limit, keys_out);
     rassert(keys_out->empty(), "Why is this output parameter not an empty vector\n");
 
     cond_t non_interruptor;
@@ -9,7 +9,8 @@
 #include "buffer_cache/types.hpp"
 
 class superblock_t;
+template <class> class value_sizer_t;
 
-void get_btree_key_distribution(btree_slice_t *slice, transaction_t *txn, superblock_t *superblock, int depth_limit, int64_t *key_count_out, std::vector<store_key_t> *keys_out);
+void get_btree_key_distribution(value_sizer_t<void> *sizer, btree_slice_t *slice, transaction_t *txn, superblock_t *superblock, int depth_limit, int64_t *key_count_out, std::vector<store_key_t> *keys_out);
 
 #endif /* BTREE_GET_DISTRIBUTION_HPP_ */
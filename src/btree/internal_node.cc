@@ -365,6 +365,29 @@ bool is_singleton(const internal_node_t *node) {
     return node->npairs == 2;
 }
 
+bool can_append(const internal_node_t *node, const btree_key_t *key) {
+    return sizeof(internal_node_t) + (node->npairs + 2) * sizeof(*node->pair_offsets) + impl::pair_size_with_key(key) + impl::pair_size_with_key_size(0) <= node->frontmost_offset;
+}
+
+void append(internal_node_t *node, block_id_t lnode, const btree_key_t *key) {
+    btree_key_t special;
+    special.size = 0;
+    if (key == NULL) {
+        key = &special;
+    }
+    rassert(node->npairs == 0 || get_pair_by_index(node, node->npairs - 1)->key.size != 0, "Appending after the last pair.");
+    rassert(node->npairs == 0 || key->size == 0 || internal_key_comp::compare(&get_pair_by_index(node, node->npairs - 1)->key, key) < 0);
+
+    scoped_array_t<char> pair_buf(impl::pair_size_with_key(key));
+    btree_internal_pair *pair = reinterpret_cast<btree_internal_pair *>(pair_buf.data());
+    pair->lnode = lnode;
+    keycpy(&pair->key, key);
+
+    raw_ibuf_t ibuf(node);
+    node->pair_offsets[node->npairs] = impl::insert_pair(&ibuf, pair);
+    node->npairs++;
+}
+
 size_t pair_size(const btree_internal_pair *pair) {
     return impl::pair_size_with_key_size(pair->key.size);
 }
@@ -384,8 +407,29 @@ btree_internal_pair *get_pair_by_index(internal_node_t *node, int index) {
     return get_pair(node, node->pair_offsets[index]);
 }
 
+// The index of the first pair whose key is not less than `key`, or of the
+// last, keyless pair if there's none.
 int get_offset_index(const internal_node_t *node, const btree_key_t *key) {
-    return std::lower_bound(node->pair_offsets, node->pair_offsets+node->npairs-1, (uint16_t) internal_key_comp::faux_offset, internal_key_comp(node, key)) - node->pair_offsets;
+    int beg = 0;
+    int end = node->npairs - 1;
+
+    // beg == 0 or *(beg - 1) < key; end == npairs - 1 or key <= *end.  The
+    // common prefixes are as in leaf::find_key.
+    int beg_common = 0;
+    int end_common = 0;
+
+    while (beg < end) {
+        int test_point = beg + (end - beg) / 2;
+        int common;
+        if (compare_keys_from(&get_pair_by_index(node, test_point)->key, key, std::min(beg_common, end_common), &common) < 0) {
+            beg = test_point + 1;
+            beg_common = common;
+        } else {
+            end = test_point;
+            end_common = common;
+        }
+    }
+    return beg;
 }
 
 int nodecmp(const internal_node_t *node1, const internal_node_t *node2) {
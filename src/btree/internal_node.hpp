@@ -43,6 +43,12 @@ bool change_unsafe(const internal_node_t *node);
 bool is_mergable(block_size_t block_size, const internal_node_t *node, const internal_node_t *sibling, const internal_node_t *parent);
 bool is_singleton(const internal_node_t *node);
 
+// For building a node in raw memory from children that come in key order (see
+// btree/bulk_load.hpp).  `key` is the largest key under `lnode`; pass NULL for
+// the last child.  `can_append` leaves room for that last, keyless pair.
+bool can_append(const internal_node_t *node, const btree_key_t *key);
+void append(internal_node_t *node, block_id_t lnode, const btree_key_t *key);
+
 void validate(block_size_t block_size, const internal_node_t *node);
 void print(const internal_node_t *node);
 
@@ -1,6 +1,8 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
 #include "btree/keys.hpp"
 
+#include <algorithm>
+
 bool unescaped_str_to_key(const char *str, int len, store_key_t *buf) {
     if (len <= MAX_KEY_SIZE) {
         memcpy(buf->contents(), str, len);
@@ -33,6 +35,49 @@ std::string key_to_debug_str(const store_key_t &key) {
     return s;
 }
 
+int compare_keys_from(const btree_key_t *key1, const btree_key_t *key2, int known_common, int *common_out) {
+    int limit = std::min(key1->size, key2->size);
+    rassert(known_common <= limit);
+    int i = known_common;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Eight bytes at a time; the lowest set bit of the difference is in the
+    // first byte that differs.
+    while (i + 8 <= limit) {
+        uint64_t word1, word2;
+        memcpy(&word1, key1->contents + i, sizeof(word1));
+        memcpy(&word2, key2->contents + i, sizeof(word2));
+        if (word1 != word2) {
+            i += __builtin_ctzll(word1 ^ word2) / 8;
+            *common_out = i;
+            return static_cast<int>(key1->contents[i]) - static_cast<int>(key2->contents[i]);
+        }
+        i += 8;
+    }
+#endif
+    while (i < limit && key1->contents[i] == key2->contents[i]) {
+        ++i;
+    }
+    *common_out = i;
+    if (i < limit) {
+        return static_cast<int>(key1->contents[i]) - static_cast<int>(key2->contents[i]);
+    }
+    return key1->size - key2->size;
+}
+
+void shorten_separator(btree_key_t *left, const btree_key_t *right) {
+    rassert(sized_strcmp(left->contents, left->size, right->contents, right->size) < 0);
+    int common = 0;
+    while (common < left->size && common < right->size && left->contents[common] == right->contents[common]) {
+        ++common;
+    }
+    // A proper prefix of `right` sorts before it, and since `left[common] <
+    // right[common]` the first `common + 1` bytes of `right` sort after `left`.
+    if (common + 1 < left->size && common + 1 < right->size) {
+        memcpy(left->contents, right->contents, common + 1);
+        left->size = common + 1;
+    }
+}
+
 key_range_t::key_range_t() :
     left(), right(store_key_t()) { }
 
@@ -95,8 +140,10 @@ bool key_range_t::is_superset(const key_range_t &other) const {
 }
 
 bool key_range_t::overlaps(const key_range_t &other) const {
-    return key_range_t::right_bound_t(left) < other.right &&
-        key_range_t::right_bound_t(other.left) < right &&
+    // Compare the keys in place rather than wrapping them in `right_bound_t`s,
+    // which would copy them; region maps call this a lot.
+    return (other.right.unbounded || left < other.right.key) &&
+        (right.unbounded || other.left < right.key) &&
         !is_empty() && !other.is_empty();
 }
 
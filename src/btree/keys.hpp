@@ -184,6 +184,21 @@ std::string key_to_unescaped_str(const store_key_t &key);
 
 std::string key_to_debug_str(const store_key_t &key);
 
+/* Compares `key1` and `key2` like `sized_strcmp()`, given that their first
+`known_common` bytes are already known to be equal, and sets `*common_out` to
+the length of their common prefix.  A binary search over a node's sorted keys
+knows that every key between its two bounds shares at least the shorter of the
+bounds' common prefixes with the key it's looking for, so with long shared key
+prefixes each probe only looks at the bytes after them. */
+int compare_keys_from(const btree_key_t *key1, const btree_key_t *key2, int known_common, int *common_out);
+
+/* A node's parent only needs a key that sorts at or after everything in the
+node and before everything in its right sibling, not the node's actual last
+key.  Given the last key `left` of a node and the first key `right` of its
+right sibling, this shortens `left` to the shortest prefix of `right` that is
+still such a separator, when that prefix is shorter than `left`. */
+void shorten_separator(btree_key_t *left, const btree_key_t *right);
+
 /* `key_range_t` represents a contiguous set of keys. */
 struct key_range_t {
     /* If `right.unbounded`, then the range contains all keys greater than or
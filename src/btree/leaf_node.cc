@@ -80,6 +80,31 @@ const int SKIP_ENTRY_RESERVED = 251;
 // itself three bytes, so it can't fit in a slot of size one or two. We don't
 // expect to actually see many entries of size one or two, but it pays to be
 // thorough.
+//
+// A prefix-compressed leaf (see is_prefixed()) is the same, except that the
+// entries end before a reference prefix of at most MAX_PREFIX_SIZE bytes:
+//
+// ...[tstamp][entry][entry][entry][prefix][prefix size]
+//                                  ^                   ^
+//                            entries_end          (block size)
+//
+// and that its entries store keys as [suffix size][shared][suffix], meaning
+// the first `shared` bytes of the prefix followed by the `suffix size` bytes
+// of the suffix:
+//
+//   [suffix size][shared][suffix][btree value]     -- a live entry
+//   [255][suffix size][shared][suffix]             -- a deletion entry
+//
+// The prefix starts out as the first key put into the empty leaf.  Keys
+// that share less with it just store longer suffixes.  Whenever the leaf
+// gets rewritten anyway (when it's split, merged, leveled or garbage
+// collected), the prefix becomes the longest common prefix of the leaf's
+// keys and they are all stored again against it (see recompute_prefix()).
+// When entries move between leaves, their keys are stored again against the
+// receiving leaf's prefix.
+//
+// Since the prefix size varies, the size accounting for prefix-compressed
+// leaves (see free_space()) always sets aside room for the largest prefix.
 
 
 struct entry_t;
@@ -102,27 +127,130 @@ bool entry_is_skip(const entry_t *p) {
     return !entry_is_deletion(p) && !entry_is_live(p);
 }
 
-const btree_key_t *entry_key(const entry_t *p) {
-    if (entry_is_deletion(p)) {
-        return reinterpret_cast<const btree_key_t *>(1 + reinterpret_cast<const char *>(p));
+block_magic_t prefixed_magic(block_magic_t leaf_magic) {
+    block_magic_t ret = leaf_magic;
+    ret.bytes[sizeof(ret.bytes) - 1] |= 0x80;
+    return ret;
+}
+
+block_magic_t unprefixed_magic(block_magic_t magic) {
+    block_magic_t ret = magic;
+    ret.bytes[sizeof(ret.bytes) - 1] &= 0x7f;
+    return ret;
+}
+
+bool is_prefixed(const leaf_node_t *node) {
+    return (node->magic.bytes[sizeof(node->magic.bytes) - 1] & 0x80) != 0;
+}
+
+bool has_leaf_magic(value_sizer_t<void> *sizer, block_magic_t magic) {
+    return unprefixed_magic(magic) == unprefixed_magic(sizer->btree_leaf_magic());
+}
+
+int prefix_size(value_sizer_t<void> *sizer, const leaf_node_t *node) {
+    if (is_prefixed(node)) {
+        return reinterpret_cast<const uint8_t *>(node)[sizer->block_size().value() - 1];
+    } else {
+        return 0;
+    }
+}
+
+// The offset just past the last entry.
+int entries_end(value_sizer_t<void> *sizer, const leaf_node_t *node) {
+    int bs = sizer->block_size().value();
+    return is_prefixed(node) ? bs - 1 - prefix_size(sizer, node) : bs;
+}
+
+const uint8_t *prefix(value_sizer_t<void> *sizer, const leaf_node_t *node) {
+    return reinterpret_cast<const uint8_t *>(node) + entries_end(sizer, node);
+}
+
+// Makes `key`, or as much of it as fits, the prefix of a prefix-compressed
+// node that has no entries at all.
+void reset_prefix(value_sizer_t<void> *sizer, leaf_node_t *node, const btree_key_t *key) {
+    rassert(is_prefixed(node));
+    rassert(node->num_pairs == 0);
+
+    int size = std::min<int>(key->size, MAX_PREFIX_SIZE);
+    uint8_t *end = reinterpret_cast<uint8_t *>(node) + sizer->block_size().value();
+    end[-1] = size;
+    memcpy(end - 1 - size, key->contents, size);
+    node->frontmost = entries_end(sizer, node);
+    node->tstamp_cutpoint = node->frontmost;
+}
+
+// The number of leading bytes `key` has in common with the node's prefix.
+int shared_with_prefix(value_sizer_t<void> *sizer, const leaf_node_t *node, const btree_key_t *key) {
+    const uint8_t *pre = prefix(sizer, node);
+    int limit = std::min<int>(key->size, prefix_size(sizer, node));
+    int i = 0;
+    while (i < limit && key->contents[i] == pre[i]) {
+        ++i;
+    }
+    return i;
+}
+
+// Where the key is stored in an entry that isn't a skip entry.
+const uint8_t *stored_key(const entry_t *p) {
+    return reinterpret_cast<const uint8_t *>(p) + (entry_is_deletion(p) ? 1 : 0);
+}
+
+// The size of a key stored in the node.
+int stored_key_size(const leaf_node_t *node, const uint8_t *stored) {
+    return is_prefixed(node) ? 2 + stored[0] : 1 + stored[0];
+}
+
+// The size `key` would have if it were stored in the node.
+int storage_size(value_sizer_t<void> *sizer, const leaf_node_t *node, const btree_key_t *key) {
+    if (is_prefixed(node)) {
+        return 2 + key->size - shared_with_prefix(sizer, node, key);
     } else {
-        return reinterpret_cast<const btree_key_t *>(p);
+        return key->full_size();
     }
 }
 
-const void *entry_value(const entry_t *p) {
+// Stores `key` at `dest` the way the node stores keys.
+void write_stored_key(value_sizer_t<void> *sizer, const leaf_node_t *node, const btree_key_t *key, void *dest) {
+    uint8_t *d = reinterpret_cast<uint8_t *>(dest);
+    if (is_prefixed(node)) {
+        int shared = shared_with_prefix(sizer, node, key);
+        d[0] = key->size - shared;
+        d[1] = shared;
+        memcpy(d + 2, key->contents + shared, key->size - shared);
+    } else {
+        memcpy(d, key, key->full_size());
+    }
+}
+
+// The key of an entry that isn't a skip entry.  It points into the node,
+// unless the node is prefix-compressed; then it's put together in `*buf`.
+const btree_key_t *entry_key(value_sizer_t<void> *sizer, const leaf_node_t *node, const entry_t *p, store_key_t *buf) {
+    const uint8_t *stored = stored_key(p);
+    if (!is_prefixed(node)) {
+        return reinterpret_cast<const btree_key_t *>(stored);
+    }
+
+    int suffix_size = stored[0];
+    int shared = stored[1];
+    buf->set_size(shared + suffix_size);
+    memcpy(buf->contents(), prefix(sizer, node), shared);
+    memcpy(buf->contents() + shared, stored + 2, suffix_size);
+    return buf->btree_key();
+}
+
+const void *entry_value(const leaf_node_t *node, const entry_t *p) {
     if (entry_is_deletion(p)) {
         return NULL;
     } else {
-        return reinterpret_cast<const char *>(p) + entry_key(p)->full_size();
+        return reinterpret_cast<const char *>(p) + stored_key_size(node, stored_key(p));
     }
 }
 
-int entry_size(value_sizer_t<void> *sizer, const entry_t *p) {
+int entry_size(value_sizer_t<void> *sizer, const leaf_node_t *node, const entry_t *p) {
     uint8_t code = *reinterpret_cast<const uint8_t *>(p);
     switch (code) {
     case DELETE_ENTRY_CODE:
-        return 1 + entry_key(p)->full_size();
+        return 1 + stored_key_size(node, stored_key(p));
     case SKIP_ENTRY_CODE_ONE:
         return 1;
     case SKIP_ENTRY_CODE_TWO:
@@ -131,10 +259,48 @@ int entry_size(value_sizer_t<void> *sizer, const entry_t *p) {
         return 3 + *reinterpret_cast<const uint16_t *>(1 + reinterpret_cast<const char *>(p));
     default:
         rassert(code <= MAX_KEY_SIZE);
-        return entry_key(p)->full_size() + sizer->size(entry_value(p));
+        return stored_key_size(node, stored_key(p)) + sizer->size(entry_value(node, p));
+    }
+}
+
+// The size `ent`, an entry of `fro`, has once it's moved to `tow`.
+int moved_entry_size(value_sizer_t<void> *sizer, const leaf_node_t *fro, const entry_t *ent, const leaf_node_t *tow) {
+    store_key_t buf;
+    int key_size = storage_size(sizer, tow, entry_key(sizer, fro, ent, &buf));
+    if (entry_is_deletion(ent)) {
+        return 1 + key_size;
+    } else {
+        return key_size + sizer->size(entry_value(fro, ent));
+    }
+}
+
+// Writes `ent`, an entry of `fro`, to `dest` in `tow`, storing its key the
+// way `tow` does.  Returns the size it has there.
+int copy_entry(value_sizer_t<void> *sizer, const leaf_node_t *fro, const entry_t *ent, const leaf_node_t *tow, void *dest) {
+    store_key_t buf;
+    const btree_key_t *key = entry_key(sizer, fro, ent, &buf);
+    int key_size = storage_size(sizer, tow, key);
+    char *d = reinterpret_cast<char *>(dest);
+    if (entry_is_deletion(ent)) {
+        *d = static_cast<char>(DELETE_ENTRY_CODE);
+        write_stored_key(sizer, tow, key, d + 1);
+        return 1 + key_size;
+    } else {
+        const void *value = entry_value(fro, ent);
+        int value_size = sizer->size(value);
+        write_stored_key(sizer, tow, key, d);
+        memcpy(d + key_size, value, value_size);
+        return key_size + value_size;
     }
 }
 
+// Whether entries keep their size when they move between the two nodes.
+bool same_storage(value_sizer_t<void> *sizer, const leaf_node_t *x, const leaf_node_t *y) {
+    return is_prefixed(x) == is_prefixed(y)
+        && prefix_size(sizer, x) == prefix_size(sizer, y)
+        && memcmp(prefix(sizer, x), prefix(sizer, y), prefix_size(sizer, x)) == 0;
+}
+
 const entry_t *get_entry(const leaf_node_t *node, int offset) {
     return reinterpret_cast<const entry_t *>(reinterpret_cast<const char *>(node) + offset + (offset < node->tstamp_cutpoint ? sizeof(repli_timestamp_t) : 0));
 }
@@ -153,37 +319,40 @@ repli_timestamp_t get_timestamp(const leaf_node_t *node, int offset) {
 
 struct entry_iter_t {
     int offset;
+    int end;
 
     void step(value_sizer_t<void> *sizer, const leaf_node_t *node) {
-        rassert(!done(sizer));
+        rassert(!done());
 
-        offset += entry_size(sizer, get_entry(node, offset)) + (offset < node->tstamp_cutpoint ? sizeof(repli_timestamp_t) : 0);
+        offset += entry_size(sizer, node, get_entry(node, offset)) + (offset < node->tstamp_cutpoint ? sizeof(repli_timestamp_t) : 0);
     }
 
-    bool done(value_sizer_t<void> *sizer) const {
-        int bs = sizer->block_size().value();
-        rassert(offset <= bs, "offset=%d, bs=%d", offset, bs);
-        return offset == bs;
+    bool done() const {
+        rassert(offset <= end, "offset=%d, end=%d", offset, end);
+        return offset == end;
     }
 
-    static entry_iter_t make(const leaf_node_t *node) {
+    static entry_iter_t make(value_sizer_t<void> *sizer, const leaf_node_t *node) {
         entry_iter_t ret;
         ret.offset = node->frontmost;
+        ret.end = entries_end(sizer, node);
         return ret;
     }
 };
 
-void strprint_entry(std::string *out, value_sizer_t<void> *sizer, const entry_t *entry) {
+void strprint_entry(std::string *out, value_sizer_t<void> *sizer, const leaf_node_t *node, const entry_t *entry) {
     if (entry_is_live(entry)) {
-        const btree_key_t *key = entry_key(entry);
+        store_key_t buf;
+        const btree_key_t *key = entry_key(sizer, node, entry, &buf);
         *out += strprintf("%.*s:", static_cast<int>(key->size), key->contents);
-        *out += strprintf("[entry size=%d]", entry_size(sizer, entry));
-        *out += strprintf("[value size=%d]", sizer->size(entry_value(entry)));
+        *out += strprintf("[entry size=%d]", entry_size(sizer, node, entry));
+        *out += strprintf("[value size=%d]", sizer->size(entry_value(node, entry)));
     } else if (entry_is_deletion(entry)) {
-        const btree_key_t *key = entry_key(entry);
+        store_key_t buf;
+        const btree_key_t *key = entry_key(sizer, node, entry, &buf);
         *out += strprintf("%.*s:[deletion]", static_cast<int>(key->size), key->contents);
     } else if (entry_is_skip(entry)) {
-        *out += strprintf("[skip %d]", entry_size(sizer, entry));
+        *out += strprintf("[skip %d]", entry_size(sizer, node, entry));
     } else {
         *out += strprintf("[code %d]", *reinterpret_cast<const uint8_t *>(entry));
     }
@@ -195,6 +364,10 @@ std::string strprint_leaf(value_sizer_t<void> *sizer, const leaf_node_t *node) {
     out += strprintf("Leaf(magic='%4.4s', num_pairs=%u, live_size=%u, frontmost=%u, tstamp_cutpoint=%u)\n",
             node->magic.bytes, node->num_pairs, node->live_size, node->frontmost, node->tstamp_cutpoint);
 
+    if (is_prefixed(node)) {
+        out += strprintf("  Prefix: %.*s\n", prefix_size(sizer, node), reinterpret_cast<const char *>(prefix(sizer, node)));
+    }
+
     out += strprintf("  Offsets:");
     for (int i = 0; i < node->num_pairs; ++i) {
         out += strprintf(" %d", node->pair_offsets[i]);
@@ -204,20 +377,20 @@ std::string strprint_leaf(value_sizer_t<void> *sizer, const leaf_node_t *node) {
     out += strprintf("  By Key:");
     for (int i = 0; i < node->num_pairs; ++i) {
         out += strprintf(" %d:", node->pair_offsets[i]);
-        strprint_entry(&out, sizer, get_entry(node, node->pair_offsets[i]));
+        strprint_entry(&out, sizer, node, get_entry(node, node->pair_offsets[i]));
     }
     out += strprintf("\n");
 
     out += strprintf("  By Offset:");
 
-    entry_iter_t iter = entry_iter_t::make(node);
-    while (out += strprintf(" %d", iter.offset), !iter.done(sizer)) {
+    entry_iter_t iter = entry_iter_t::make(sizer, node);
+    while (out += strprintf(" %d", iter.offset), !iter.done()) {
         out += strprintf(":");
         if (iter.offset < node->tstamp_cutpoint) {
             repli_timestamp_t tstamp = get_timestamp(node, iter.offset);
             out += strprintf("[t=%" PRIu64 "]", tstamp.longtime);
         }
-        strprint_entry(&out, sizer, get_entry(node, iter.offset));
+        strprint_entry(&out, sizer, node, get_entry(node, iter.offset));
         iter.step(sizer, node);
     }
     out += strprintf("\n");
@@ -226,17 +399,19 @@ std::string strprint_leaf(value_sizer_t<void> *sizer, const leaf_node_t *node) {
 }
 
 
-void print_entry(FILE *fp, value_sizer_t<void> *sizer, const entry_t *entry) {
+void print_entry(FILE *fp, value_sizer_t<void> *sizer, const leaf_node_t *node, const entry_t *entry) {
     if (entry_is_live(entry)) {
-        const btree_key_t *key = entry_key(entry);
+        store_key_t buf;
+        const btree_key_t *key = entry_key(sizer, node, entry, &buf);
         fprintf(fp, "%.*s:", static_cast<int>(key->size), key->contents);
-        fprintf(fp, "[entry size=%d]", entry_size(sizer, entry));
-        fprintf(fp, "[value size=%d]", sizer->size(entry_value(entry)));
+        fprintf(fp, "[entry size=%d]", entry_size(sizer, node, entry));
+        fprintf(fp, "[value size=%d]", sizer->size(entry_value(node, entry)));
     } else if (entry_is_deletion(entry)) {
-        const btree_key_t *key = entry_key(entry);
+        store_key_t buf;
+        const btree_key_t *key = entry_key(sizer, node, entry, &buf);
         fprintf(fp, "%.*s:[deletion]", static_cast<int>(key->size), key->contents);
     } else if (entry_is_skip(entry)) {
-        fprintf(fp, "[skip %d]", entry_size(sizer, entry));
+        fprintf(fp, "[skip %d]", entry_size(sizer, node, entry));
     } else {
         fprintf(fp, "[code %d]", *reinterpret_cast<const uint8_t *>(entry));
     }
@@ -248,6 +423,10 @@ void print(FILE *fp, value_sizer_t<void> *sizer, const leaf_node_t *node) {
     fprintf(fp, "Leaf(magic='%4.4s', num_pairs=%u, live_size=%u, frontmost=%u, tstamp_cutpoint=%u)\n",
             node->magic.bytes, node->num_pairs, node->live_size, node->frontmost, node->tstamp_cutpoint);
 
+    if (is_prefixed(node)) {
+        fprintf(fp, "  Prefix: %.*s\n", prefix_size(sizer, node), reinterpret_cast<const char *>(prefix(sizer, node)));
+    }
+
     fprintf(fp, "  Offsets:");
     for (int i = 0; i < node->num_pairs; ++i) {
         fprintf(fp, " %d", node->pair_offsets[i]);
@@ -258,15 +437,15 @@ void print(FILE *fp, value_sizer_t<void> *sizer, const leaf_node_t *node) {
     fprintf(fp, "  By Key:");
     for (int i = 0; i < node->num_pairs; ++i) {
         fprintf(fp, " %d:", node->pair_offsets[i]);
-        print_entry(fp, sizer, get_entry(node, node->pair_offsets[i]));
+        print_entry(fp, sizer, node, get_entry(node, node->pair_offsets[i]));
     }
     fprintf(fp, "\n");
 
     fprintf(fp, "  By Offset:");
     fflush(fp);
 
-    entry_iter_t iter = entry_iter_t::make(node);
-    while (fprintf(fp, " %d", iter.offset), fflush(fp), !iter.done(sizer)) {
+    entry_iter_t iter = entry_iter_t::make(sizer, node);
+    while (fprintf(fp, " %d", iter.offset), fflush(fp), !iter.done()) {
         fprintf(fp, ":");
         fflush(fp);
         if (iter.offset < node->tstamp_cutpoint) {
@@ -274,7 +453,7 @@ void print(FILE *fp, value_sizer_t<void> *sizer, const leaf_node_t *node) {
             fprintf(fp, "[t=%" PRIu64 "]", tstamp.longtime);
             fflush(fp);
         }
-        print_entry(fp, sizer, get_entry(node, iter.offset));
+        print_entry(fp, sizer, node, get_entry(node, iter.offset));
         iter.step(sizer, node);
     }
     fprintf(fp, "\n");
@@ -307,19 +486,23 @@ bool fsck(value_sizer_t<void> *sizer, const btree_key_t *left_exclusive_or_null,
     // correct magic, that the keys are in order, that there are no
     // deletion entries after tstamp_cutpoint, and that
     // tstamp_cutpoint lies on an entry boundary, and that frontmost
-    // is not before the end of pair_offsets
+    // is not before the end of pair_offsets.  In a prefix-compressed
+    // node, the entries end at the prefix instead of the block end,
+    // and we check that keys share no more than the prefix has.
 
     // Basic sanity checks on fields' values.
-    if (failed(node->magic == sizer->btree_leaf_magic(),
+    if (failed(has_leaf_magic(sizer, node->magic),
                "bad leaf magic")
+        || failed(prefix_size(sizer, node) <= MAX_PREFIX_SIZE,
+                  "prefix is too long")
         || failed(node->frontmost >= offsetof(leaf_node_t, pair_offsets) + node->num_pairs * sizeof(uint16_t),
                   "frontmost offset is before the end of pair_offsets")
-        || failed(node->live_size <= (sizer->block_size().value() - node->frontmost) + sizeof(uint16_t) * node->num_pairs,
+        || failed(node->live_size <= (entries_end(sizer, node) - node->frontmost) + sizeof(uint16_t) * node->num_pairs,
                   "live_size is impossibly large")
         || failed(node->tstamp_cutpoint >= node->frontmost,
                   "timestamp cut offset below frontmost offset")
-        || failed(node->tstamp_cutpoint <= sizer->block_size().value(),
-                  "timestamp cut offset larger than block size")
+        || failed(node->tstamp_cutpoint <= entries_end(sizer, node),
+                  "timestamp cut offset past the end of the entries")
         ) {
         return false;
     }
@@ -332,20 +515,20 @@ bool fsck(value_sizer_t<void> *sizer, const btree_key_t *left_exclusive_or_null,
 
     if (failed(node->num_pairs == 0 || node->frontmost <= offs[0],
                "smallest pair offset is before frontmost offset")
-        || failed(node->num_pairs == 0 || offs[node->num_pairs - 1] < sizer->block_size().value(),
-                  "largest pair offset is larger than block size")
+        || failed(node->num_pairs == 0 || offs[node->num_pairs - 1] < entries_end(sizer, node),
+                  "largest pair offset is past the end of the entries")
         ) {
         return false;
     }
 
-    entry_iter_t iter = entry_iter_t::make(node);
+    entry_iter_t iter = entry_iter_t::make(sizer, node);
 
     int observed_live_size = 0;
 
     int i = 0;
     bool seen_tstamp_cutpoint = false;
     repli_timestamp_t earliest_so_far = repli_timestamp_t::invalid;
-    while (!iter.done(sizer)) {
+    while (!iter.done()) {
         int offset = iter.offset;
 
         // tstamp_cutpoint is supposed to be on some entry's offset.
@@ -356,8 +539,8 @@ bool fsck(value_sizer_t<void> *sizer, const btree_key_t *left_exclusive_or_null,
             seen_tstamp_cutpoint = true;
         }
 
-        if (failed(offset + (offset < node->tstamp_cutpoint ? sizeof(repli_timestamp_t) : 0) < sizer->block_size().value(),
-                   "offset would be past block size after accounting for the timestamp")) {
+        if (failed(offset + (offset < node->tstamp_cutpoint ? sizeof(repli_timestamp_t) : 0) < static_cast<size_t>(entries_end(sizer, node)),
+                   "offset would be past the end of the entries after accounting for the timestamp")) {
             return false;
         }
 
@@ -371,21 +554,31 @@ bool fsck(value_sizer_t<void> *sizer, const btree_key_t *left_exclusive_or_null,
         }
 
         const entry_t *ent = get_entry(node, offset);
+        if (is_prefixed(node) && !entry_is_skip(ent)) {
+            const uint8_t *stored = stored_key(ent);
+            if (failed(stored[1] <= prefix_size(sizer, node), "key shares more than the prefix")
+                || failed(stored[0] + stored[1] <= MAX_KEY_SIZE, "key is too long")) {
+                return false;
+            }
+        }
+
         if (entry_is_live(ent)) {
-            const void *value = entry_value(ent);
-            int space = sizer->block_size().value() - (reinterpret_cast<const char *>(value) - reinterpret_cast<const char *>(node));
+            store_key_t key_buf;
+            const btree_key_t *key = entry_key(sizer, node, ent, &key_buf);
+            const void *value = entry_value(node, ent);
+            int space = entries_end(sizer, node) - (reinterpret_cast<const char *>(value) - reinterpret_cast<const char *>(node));
             if (!sizer->fits(value, space)) {
-                *msg_out = strprintf("problem with key %.*s: value does not fit\n", entry_key(ent)->size, entry_key(ent)->contents);
+                *msg_out = strprintf("problem with key %.*s: value does not fit\n", key->size, key->contents);
                 return false;
             }
 
             std::string fscker_msg;
-            if (!fscker->fsck(sizer, entry_key(ent), value, &fscker_msg)) {
-                *msg_out = strprintf("Problem with key %.*s: %s\n", entry_key(ent)->size, entry_key(ent)->contents, fscker_msg.c_str());
+            if (!fscker->fsck(sizer, key, value, &fscker_msg)) {
+                *msg_out = strprintf("Problem with key %.*s: %s\n", key->size, key->contents, fscker_msg.c_str());
                 return false;
             }
 
-            observed_live_size += sizeof(uint16_t) + entry_size(sizer, ent);
+            observed_live_size += sizeof(uint16_t) + entry_size(sizer, node, ent);
             if (failed(i < node->num_pairs, "missing entry offsets")
                 || failed(offset == offs[i], "missing live entries or entry offsets")) {
                 return false;
@@ -413,9 +606,11 @@ bool fsck(value_sizer_t<void> *sizer, const btree_key_t *left_exclusive_or_null,
 
     // Entries look valid, check key ordering.
 
+    // Keys of a prefix-compressed node get put together in these, in turn.
+    store_key_t key_bufs[2];
     const btree_key_t *last = left_exclusive_or_null;
     for (int k = 0; k < node->num_pairs; ++k) {
-        const btree_key_t *key = entry_key(get_entry(node, node->pair_offsets[k]));
+        const btree_key_t *key = entry_key(sizer, node, get_entry(node, node->pair_offsets[k]), &key_bufs[k % 2]);
         if (failed(last == NULL || sized_strcmp(last->contents, last->size, key->contents, key->size) < 0,
                    "keys out of order")) {
             return false;
@@ -447,16 +642,33 @@ void init(value_sizer_t<void> *sizer, leaf_node_t *node) {
     node->magic = sizer->btree_leaf_magic();
     node->num_pairs = 0;
     node->live_size = 0;
-    node->frontmost = sizer->block_size().value();
+    if (is_prefixed(node)) {
+        // An empty prefix.
+        reinterpret_cast<uint8_t *>(node)[sizer->block_size().value() - 1] = 0;
+    }
+    node->frontmost = entries_end(sizer, node);
     node->tstamp_cutpoint = node->frontmost;
 }
 
-int free_space(value_sizer_t<void> *sizer) {
-    return sizer->block_size().value() - offsetof(leaf_node_t, pair_offsets);
+// Makes `node` an empty node with the layout and prefix of `like`, so
+// that entries keep their size when they move from `like` to `node`.
+void init_like(value_sizer_t<void> *sizer, leaf_node_t *node, const leaf_node_t *like) {
+    node->magic = like->magic;
+    node->num_pairs = 0;
+    node->live_size = 0;
+    int end = entries_end(sizer, like);
+    memcpy(get_at_offset(node, end), prefix(sizer, like), sizer->block_size().value() - end);
+    node->frontmost = end;
+    node->tstamp_cutpoint = end;
+}
+
+int free_space(value_sizer_t<void> *sizer, const leaf_node_t *node) {
+    int space = sizer->block_size().value() - offsetof(leaf_node_t, pair_offsets);
+    return is_prefixed(node) ? space - (1 + MAX_PREFIX_SIZE) : space;
 }
 
 // Returns the mandatory storage cost of the node, returning a value
-// in the closed interval [0, free_space(sizer)].  Outputs the offset
+// in the closed interval [0, free_space(sizer, node)].  Outputs the offset
 // of the first entry for which storing a timestamp is not mandatory.
 int mandatory_cost(value_sizer_t<void> *sizer, const leaf_node_t *node, int required_timestamps, int *tstamp_back_offset_out) {
     int size = node->live_size;
@@ -465,18 +677,18 @@ int mandatory_cost(value_sizer_t<void> *sizer, const leaf_node_t *node, int requ
     // entries' timestamps, and live entries' timestamps.  We add that
     // to size.
 
-    entry_iter_t iter = entry_iter_t::make(node);
+    entry_iter_t iter = entry_iter_t::make(sizer, node);
     int count = 0;
     int deletions_cost = 0;
-    int max_deletions_cost = free_space(sizer) / DELETION_RESERVE_FRACTION;
-    while (!(count == required_timestamps || iter.done(sizer) || iter.offset >= node->tstamp_cutpoint)) {
+    int max_deletions_cost = free_space(sizer, node) / DELETION_RESERVE_FRACTION;
+    while (!(count == required_timestamps || iter.done() || iter.offset >= node->tstamp_cutpoint)) {
         const entry_t *ent = get_entry(node, iter.offset);
         if (entry_is_deletion(ent)) {
             if (deletions_cost >= max_deletions_cost) {
                 break;
             }
 
-            int this_entry_cost = sizeof(uint16_t) + sizeof(repli_timestamp_t) + entry_size(sizer, ent);
+            int this_entry_cost = sizeof(uint16_t) + sizeof(repli_timestamp_t) + entry_size(sizer, node, ent);
             deletions_cost += this_entry_cost;
             size += this_entry_cost;
             ++count;
@@ -498,11 +710,13 @@ int mandatory_cost(value_sizer_t<void> *sizer, const leaf_node_t *node, int requ
     return mandatory_cost(sizer, node, required_timestamps, &ignored);
 }
 
-int leaf_epsilon(value_sizer_t<void> *sizer) {
+int leaf_epsilon(value_sizer_t<void> *sizer, const leaf_node_t *node) {
     // Returns the maximum possible entry size, i.e. the key cost plus
     // the value cost plus pair_offsets plus timestamp cost.
 
-    int key_cost = sizeof(uint8_t) + MAX_KEY_SIZE;
+    // A prefix-compressed node stores a key that shares nothing with
+    // the prefix with one more byte than a plain node does.
+    int key_cost = (is_prefixed(node) ? 2 : 1) * sizeof(uint8_t) + MAX_KEY_SIZE;
 
     // If the value is always empty, the DELETE_ENTRY_CODE byte needs to be considered.
     int n = std::max(sizer->max_possible_size(), 1);
@@ -516,6 +730,18 @@ bool is_empty(const leaf_node_t *node) {
     return node->num_pairs == 0;
 }
 
+store_key_t smallest_key(value_sizer_t<void> *sizer, const leaf_node_t *node) {
+    rassert(node->num_pairs > 0);
+    store_key_t buf;
+    return store_key_t(entry_key(sizer, node, get_entry(node, node->pair_offsets[0]), &buf));
+}
+
+store_key_t largest_key(value_sizer_t<void> *sizer, const leaf_node_t *node) {
+    rassert(node->num_pairs > 0);
+    store_key_t buf;
+    return store_key_t(entry_key(sizer, node, get_entry(node, node->pair_offsets[node->num_pairs - 1]), &buf));
+}
+
 bool is_full(value_sizer_t<void> *sizer, const leaf_node_t *node, const btree_key_t *key, const void *value) {
 
     // Upon an insertion, we preserve `MANDATORY_TIMESTAMPS - 1`
@@ -526,10 +752,10 @@ bool is_full(value_sizer_t<void> *sizer, const leaf_node_t *node, const btree_ke
     // insert.  We conservatively assume the key is not already
     // contained in the node.
 
-    size += sizeof(uint16_t) + sizeof(repli_timestamp_t) + key->full_size() + sizer->size(value);
+    size += sizeof(uint16_t) + sizeof(repli_timestamp_t) + storage_size(sizer, node, key) + sizer->size(value);
 
     // The node is full if we can't fit all that data within the free space.
-    return size > free_space(sizer);
+    return size > free_space(sizer, node);
 }
 
 bool is_underfull(value_sizer_t<void> *sizer, const leaf_node_t *node) {
@@ -548,7 +774,17 @@ bool is_underfull(value_sizer_t<void> *sizer, const leaf_node_t *node) {
     // free_space / 2 - leaf_epsilon.  We don't want an immediately
     // split node to be underfull, hence the threshold used below.
 
-    return mandatory_cost(sizer, node, MANDATORY_TIMESTAMPS) < free_space(sizer) / 2 - leaf_epsilon(sizer);
+    return mandatory_cost(sizer, node, MANDATORY_TIMESTAMPS) < free_space(sizer, node) / 2 - leaf_epsilon(sizer, node);
+}
+
+bool may_become_underfull(value_sizer_t<void> *sizer, const leaf_node_t *node) {
+
+    // One change can take away at most the entry it replaces and, by
+    // pushing the timestamp window forward, one older deletion entry;
+    // neither costs more than leaf_epsilon.  So unless we're within
+    // two leaf_epsilons of the threshold in is_underfull, we're safe.
+
+    return mandatory_cost(sizer, node, MANDATORY_TIMESTAMPS) < free_space(sizer, node) / 2 + leaf_epsilon(sizer, node);
 }
 
 
@@ -578,7 +814,7 @@ void garbage_collect(value_sizer_t<void> *sizer, leaf_node_t *node, int num_tsta
     int mand_offset;
     UNUSED int cost = mandatory_cost(sizer, node, num_tstamped, &mand_offset);
 
-    int w = sizer->block_size().value();
+    int w = entries_end(sizer, node);
     int i = node->num_pairs - 1;
     for (; i >= 0; --i) {
         int offset = node->pair_offsets[indices[i]];
@@ -589,7 +825,7 @@ void garbage_collect(value_sizer_t<void> *sizer, leaf_node_t *node, int num_tsta
 
         entry_t *ent = get_entry(node, offset);
         if (entry_is_live(ent)) {
-            int sz = entry_size(sizer, ent);
+            int sz = entry_size(sizer, node, ent);
             w -= sz;
             memmove(get_at_offset(node, w), ent, sz);
             node->pair_offsets[indices[i]] = w;
@@ -606,7 +842,7 @@ void garbage_collect(value_sizer_t<void> *sizer, leaf_node_t *node, int num_tsta
         int offset = node->pair_offsets[indices[i]];
 
         // Preserve the timestamp.
-        int sz = sizeof(repli_timestamp_t) + entry_size(sizer, get_entry(node, offset));
+        int sz = sizeof(repli_timestamp_t) + entry_size(sizer, node, get_entry(node, offset));
 
         w -= sz;
 
@@ -645,6 +881,100 @@ void garbage_collect(value_sizer_t<void> *sizer, leaf_node_t *node, int num_tsta
     rassert(ignore == 0);
 }
 
+// The number of leading bytes `key` has in common with the first `size`
+// bytes at `bytes`.
+int common_prefix_size(const btree_key_t *key, const uint8_t *bytes, int size) {
+    int limit = std::min<int>(key->size, size);
+    int i = 0;
+    while (i < limit && key->contents[i] == bytes[i]) {
+        ++i;
+    }
+    return i;
+}
+
+// Makes the prefix of a prefix-compressed node the longest common prefix
+// of its keys, and of `also_key` if it isn't NULL, as far as it fits, and
+// stores the keys again against it.  Since the keys are in order, that's
+// the common prefix of the first key, the last key and `also_key`.  The
+// old prefix stays if the keys would take more room with the new one,
+// which happens when some keys share more with the old prefix than all
+// keys share with each other.  Entries that pair_offsets doesn't point to
+// don't survive, and pair_offsets keeps its order.
+void recompute_prefix(value_sizer_t<void> *sizer, leaf_node_t *node, const btree_key_t *also_key) {
+    if (!is_prefixed(node) || (node->num_pairs == 0 && also_key == NULL)) {
+        return;
+    }
+
+    store_key_t first_buf;
+    const btree_key_t *first = also_key;
+    if (node->num_pairs > 0) {
+        first = entry_key(sizer, node, get_entry(node, node->pair_offsets[0]), &first_buf);
+    }
+    int size = std::min<int>(first->size, MAX_PREFIX_SIZE);
+    if (node->num_pairs > 0) {
+        store_key_t last_buf;
+        size = common_prefix_size(entry_key(sizer, node, get_entry(node, node->pair_offsets[node->num_pairs - 1]), &last_buf),
+                                  first->contents, size);
+    }
+    if (also_key != NULL) {
+        size = common_prefix_size(also_key, first->contents, size);
+    }
+
+    // Every key shares all of the new prefix, and as much of the old one
+    // as its stored key says.
+    int shrinkage = 0;
+    for (int i = 0; i < node->num_pairs; ++i) {
+        shrinkage += size - stored_key(get_entry(node, node->pair_offsets[i]))[1];
+    }
+    if (also_key != NULL) {
+        shrinkage += size - shared_with_prefix(sizer, node, also_key);
+    }
+    if (shrinkage <= 0) {
+        return;
+    }
+
+    int bs = sizer->block_size().value();
+    scoped_malloc_t<char> old_copy(bs);
+    memcpy(old_copy.get(), node, bs);
+    leaf_node_t *old = reinterpret_cast<leaf_node_t *>(old_copy.get());
+
+    uint8_t *end = reinterpret_cast<uint8_t *>(node) + bs;
+    end[-1] = size;
+    memcpy(end - 1 - size, first->contents, size);
+
+    scoped_array_t<uint16_t> indices(old->num_pairs);
+    for (int i = 0; i < old->num_pairs; ++i) {
+        indices[i] = i;
+    }
+    std::sort(indices.data(), indices.data() + old->num_pairs, indirect_index_comparator_t(old->pair_offsets));
+
+    // Write the entries back to front, the untimestamped ones first.
+    int w = entries_end(sizer, node);
+    node->tstamp_cutpoint = w;
+    node->live_size = 0;
+    for (int i = old->num_pairs - 1; i >= 0; --i) {
+        int offset = old->pair_offsets[indices[i]];
+        const entry_t *ent = get_entry(old, offset);
+        int sz = moved_entry_size(sizer, old, ent, node);
+        if (offset < old->tstamp_cutpoint) {
+            w -= sizeof(repli_timestamp_t) + sz;
+            memcpy(get_at_offset(node, w), get_at_offset(old, offset), sizeof(repli_timestamp_t));
+            copy_entry(sizer, old, ent, node, get_at_offset(node, w + sizeof(repli_timestamp_t)));
+        } else {
+            w -= sz;
+            copy_entry(sizer, old, ent, node, get_at_offset(node, w));
+            node->tstamp_cutpoint = w;
+        }
+        if (entry_is_live(ent)) {
+            node->live_size += sizeof(uint16_t) + sz;
+        }
+        node->pair_offsets[indices[i]] = w;
+    }
+    node->frontmost = w;
+
+    validate(sizer, node);
+}
+
 void clean_entry(void *p, int sz) {
     rassert(sz > 0);
 
@@ -666,13 +996,32 @@ void clean_entry(void *p, int sz) {
     }
 }
 
+// The number of bytes move_elements() needs in tow for the entries of
+// fro with pair_offsets indices in [beg, end): the entries in front of
+// fro_mand_offset with their timestamps, and the live entries behind
+// it, with their keys stored the way tow stores them.
+int moved_copysize(value_sizer_t<void> *sizer, const leaf_node_t *fro, int beg, int end, int fro_mand_offset, const leaf_node_t *tow) {
+    int copysize = 0;
+    for (int i = beg; i < end; ++i) {
+        int offset = fro->pair_offsets[i];
+        const entry_t *ent = get_entry(fro, offset);
+        if (offset < fro_mand_offset) {
+            copysize += sizeof(repli_timestamp_t) + moved_entry_size(sizer, fro, ent, tow);
+        } else if (entry_is_live(ent)) {
+            copysize += moved_entry_size(sizer, fro, ent, tow);
+        }
+    }
+    return copysize;
+}
+
 // Moves entries with pair_offsets indices in the clopen range [beg,
-// end) from fro to tow.
+// end) from fro to tow.  fro_copysize must be no less than what
+// moved_copysize() says.
 void move_elements(value_sizer_t<void> *sizer, leaf_node_t *fro, int beg, int end, int wpoint, leaf_node_t *tow, int fro_copysize, int fro_mand_offset) {
     rassert(is_underfull(sizer, tow));
 
     // This assertion is a bit loose.
-    rassert(fro_copysize + mandatory_cost(sizer, tow, MANDATORY_TIMESTAMPS) <= free_space(sizer));
+    rassert(fro_copysize + mandatory_cost(sizer, tow, MANDATORY_TIMESTAMPS) <= free_space(sizer, tow));
 
     // Make tow have a nice big region we can copy entries to.  Also,
     // this means we have no "skip" entries in tow.
@@ -752,12 +1101,13 @@ void move_elements(value_sizer_t<void> *sizer, leaf_node_t *fro, int beg, int en
         // Greater timestamps go first.
         if (tow_tstamp < fro_tstamp) {
             entry_t *ent = get_entry(fro, fro_offset);
-            int entsz = entry_size(sizer, ent);
-            int sz = sizeof(repli_timestamp_t) + entsz;
-            memmove(get_at_offset(tow, wri_offset), get_at_offset(fro, fro_offset), sz);
+            int entsz = entry_size(sizer, fro, ent);
+            memcpy(get_at_offset(tow, wri_offset), get_at_offset(fro, fro_offset), sizeof(repli_timestamp_t));
+            int tow_entsz = copy_entry(sizer, fro, ent, tow, get_at_offset(tow, wri_offset + sizeof(repli_timestamp_t)));
+            int sz = sizeof(repli_timestamp_t) + tow_entsz;
 
             if (entry_is_live(ent)) {
-                livesize += entsz + sizeof(uint16_t);
+                livesize += tow_entsz + sizeof(uint16_t);
                 fro_live_size_adjustment -= entsz + sizeof(uint16_t);
             }
 
@@ -773,7 +1123,7 @@ void move_elements(value_sizer_t<void> *sizer, leaf_node_t *fro, int beg, int en
             fro_index++;
 
         } else {
-            int sz = sizeof(repli_timestamp_t) + entry_size(sizer, get_entry(tow, tow_offset));
+            int sz = sizeof(repli_timestamp_t) + entry_size(sizer, tow, get_entry(tow, tow_offset));
             memmove(get_at_offset(tow, wri_offset), get_at_offset(tow, tow_offset), sz);
 
             // Update the pair offset of the entry we've moved.
@@ -801,22 +1151,22 @@ void move_elements(value_sizer_t<void> *sizer, leaf_node_t *fro, int beg, int en
         int fro_offset = fro->pair_offsets[beg + tow->pair_offsets[fro_index]];
         entry_t *ent = get_entry(fro, fro_offset);
         if (entry_is_live(ent)) {
-            int sz = entry_size(sizer, ent);
-            memmove(get_at_offset(tow, wri_offset), ent, sz);
+            int sz = entry_size(sizer, fro, ent);
+            int tow_sz = copy_entry(sizer, fro, ent, tow, get_at_offset(tow, wri_offset));
             clean_entry(ent, sz);
             fro_live_size_adjustment -= sz + sizeof(uint16_t);
 
             fro->pair_offsets[beg + tow->pair_offsets[fro_index]] = wri_offset;
-            wri_offset += sz;
-            fro_copyage += sz;
-            livesize += sz + sizeof(uint16_t);
+            wri_offset += tow_sz;
+            fro_copyage += tow_sz;
+            livesize += tow_sz + sizeof(uint16_t);
         } else {
             rassert(entry_is_deletion(ent));
 
             // This is a dead entry.  We'll need to squash this dead entry later.
             fro->pair_offsets[beg + tow->pair_offsets[fro_index]] = 0;
 
-            int sz = entry_size(sizer, ent);
+            int sz = entry_size(sizer, fro, ent);
             clean_entry(ent, sz);
         }
     }
@@ -829,7 +1179,7 @@ void move_elements(value_sizer_t<void> *sizer, leaf_node_t *fro, int beg, int en
         rassert(wri_offset <= tow_offset);
 
         entry_t *ent = get_entry(tow, tow_offset);
-        int sz = entry_size(sizer, ent);
+        int sz = entry_size(sizer, tow, ent);
         if (entry_is_live(ent)) {
             memmove(get_at_offset(tow, wri_offset), ent, sz);
 
@@ -912,7 +1262,7 @@ void split(value_sizer_t<void> *sizer, leaf_node_t *node, leaf_node_t *rnode, bt
     int tstamp_back_offset;
     int mandatory = mandatory_cost(sizer, node, MANDATORY_TIMESTAMPS, &tstamp_back_offset);
 
-    rassert(mandatory >= free_space(sizer) - leaf_epsilon(sizer));
+    rassert(mandatory >= free_space(sizer, node) - leaf_epsilon(sizer, node));
 
     // We shall split the mandatory cost of this node as evenly as possible.
 
@@ -932,7 +1282,7 @@ void split(value_sizer_t<void> *sizer, leaf_node_t *node, leaf_node_t *rnode, bt
 
         if (entry_is_live(ent)) {
             prev_rcost = rcost;
-            rcost += entry_size(sizer, ent) + sizeof(uint16_t) + (offset < tstamp_back_offset ? sizeof(repli_timestamp_t) : 0);
+            rcost += entry_size(sizer, node, ent) + sizeof(uint16_t) + (offset < tstamp_back_offset ? sizeof(repli_timestamp_t) : 0);
 
             ++num_mandatories;
         } else {
@@ -940,7 +1290,7 @@ void split(value_sizer_t<void> *sizer, leaf_node_t *node, leaf_node_t *rnode, bt
 
             if (offset < tstamp_back_offset) {
                 prev_rcost = rcost;
-                rcost += entry_size(sizer, ent) + sizeof(uint16_t) + sizeof(repli_timestamp_t);
+                rcost += entry_size(sizer, node, ent) + sizeof(uint16_t) + sizeof(repli_timestamp_t);
 
                 ++num_mandatories;
             }
@@ -970,17 +1320,22 @@ void split(value_sizer_t<void> *sizer, leaf_node_t *node, leaf_node_t *rnode, bt
 
     // If our math was right, neither node can be underfull just
     // considering the split of the mandatory costs.
-    rassert(end_rcost >= free_space(sizer) / 2 - leaf_epsilon(sizer));
-    rassert(mandatory - end_rcost >= free_space(sizer) / 2 - leaf_epsilon(sizer));
+    rassert(end_rcost >= free_space(sizer, node) / 2 - leaf_epsilon(sizer, node));
+    rassert(mandatory - end_rcost >= free_space(sizer, node) / 2 - leaf_epsilon(sizer, node));
 
-    // Now we wish to move the elements at indices [s, num_pairs) to rnode.
+    // Now we wish to move the elements at indices [s, num_pairs) to
+    // rnode.  It gets node's prefix, so the entries keep their sizes.
+    // Then each node gets the common prefix of its own keys.
 
-    init(sizer, rnode);
+    init_like(sizer, rnode, node);
 
     int node_copysize = end_rcost - num_mandatories * sizeof(uint16_t);
     move_elements(sizer, node, s, node->num_pairs, 0, rnode, node_copysize, tstamp_back_offset);
+    recompute_prefix(sizer, node, NULL);
+    recompute_prefix(sizer, rnode, NULL);
 
-    keycpy(median_out, entry_key(get_entry(node, node->pair_offsets[s - 1])));
+    store_key_t median_buf;
+    keycpy(median_out, entry_key(sizer, node, get_entry(node, node->pair_offsets[s - 1]), &median_buf));
 }
 
 void merge(value_sizer_t<void> *sizer, leaf_node_t *left, leaf_node_t *right) {
@@ -990,17 +1345,14 @@ void merge(value_sizer_t<void> *sizer, leaf_node_t *left, leaf_node_t *right) {
     rassert(is_underfull(sizer, right));
 
     int tstamp_back_offset;
-    int mandatory = mandatory_cost(sizer, left, MANDATORY_TIMESTAMPS, &tstamp_back_offset);
+    mandatory_cost(sizer, left, MANDATORY_TIMESTAMPS, &tstamp_back_offset);
 
-    int left_copysize = mandatory;
-    // Uncount the uint16_t cost of mandatory  entries.  Sigh.
-    for (int i = 0; i < left->num_pairs; ++i) {
-        if (left->pair_offsets[i] < tstamp_back_offset || entry_is_deletion(get_entry(left, left->pair_offsets[i]))) {
-            left_copysize -= sizeof(uint16_t);
-        }
-    }
+    // Keys can take more (or less) room in right, if it has a
+    // different prefix.
+    int left_copysize = moved_copysize(sizer, left, 0, left->num_pairs, tstamp_back_offset, right);
 
     move_elements(sizer, left, 0, left->num_pairs, 0, right, left_copysize, tstamp_back_offset);
+    recompute_prefix(sizer, right, NULL);
 }
 
 // We move keys out of sibling and into node.
@@ -1040,37 +1392,42 @@ bool level(value_sizer_t<void> *sizer, int nodecmp_node_with_sib, leaf_node_t *n
 
     rassert(end - beg != sibling->num_pairs - 1);
 
+    // Entries can change size on the way, when node has a different
+    // prefix than sibling, so we count what they weigh in each node.
+    // (weight_movement is their weight in node.)
     int prev_weight_movement = 0;
     int weight_movement = 0;
     int num_mandatories = 0;
     int prev_diff = sizer->block_size().value();  // some impossibly large value
+    bool node_filled_up = false;
     for (;;) {
         int offset = sibling->pair_offsets[*w];
         entry_t *ent = get_entry(sibling, offset);
 
         // We only take mandatory entries' costs into consideration.
-        if (entry_is_live(ent)) {
-            int sz = entry_size(sizer, ent) + sizeof(uint16_t) + (offset < tstamp_back_offset ? sizeof(repli_timestamp_t) : 0);
+        if (entry_is_live(ent) || offset < tstamp_back_offset) {
+            rassert(entry_is_live(ent) || entry_is_deletion(ent));
+            int overhead = sizeof(uint16_t) + (offset < tstamp_back_offset ? sizeof(repli_timestamp_t) : 0);
+            int sibling_sz = entry_size(sizer, sibling, ent) + overhead;
+            int node_sz = moved_entry_size(sizer, sibling, ent, node) + overhead;
+
+            if (node_weight + node_sz > free_space(sizer, node)) {
+                // Only possible when the entries grow a lot in node.
+                // We move what we have so far.
+                *w -= wstep;
+                node_filled_up = true;
+                break;
+            }
+
             prev_diff = sibling_weight - node_weight;
             prev_weight_movement = weight_movement;
-            weight_movement += sz;
-            node_weight += sz;
-            sibling_weight -= sz;
+            weight_movement += node_sz;
+            node_weight += node_sz;
+            sibling_weight -= sibling_sz;
 
             ++num_mandatories;
         } else {
             rassert(entry_is_deletion(ent));
-
-            if (offset < tstamp_back_offset) {
-                int sz = entry_size(sizer, ent) + sizeof(uint16_t) + sizeof(repli_timestamp_t);
-                prev_diff = sibling_weight - node_weight;
-                prev_weight_movement = weight_movement;
-                weight_movement += sz;
-                node_weight += sz;
-                sibling_weight -= sz;
-
-                ++num_mandatories;
-            }
         }
 
         if (end - beg == sibling->num_pairs - 1 || node_weight >= sibling_weight) {
@@ -1082,7 +1439,7 @@ bool level(value_sizer_t<void> *sizer, int nodecmp_node_with_sib, leaf_node_t *n
 
     rassert(end - beg < sibling->num_pairs - 1);
 
-    if (prev_diff <= sibling_weight - node_weight) {
+    if (!node_filled_up && prev_diff <= sibling_weight - node_weight) {
         *w -= wstep;
         --num_mandatories;
         weight_movement = prev_weight_movement;
@@ -1100,43 +1457,112 @@ bool level(value_sizer_t<void> *sizer, int nodecmp_node_with_sib, leaf_node_t *n
     guarantee(node->num_pairs > 0);
     guarantee(sibling->num_pairs > 0);
 
+    recompute_prefix(sizer, node, NULL);
+    recompute_prefix(sizer, sibling, NULL);
+
+    store_key_t replacement_buf;
     if (nodecmp_node_with_sib < 0) {
-        keycpy(replacement_key_out, entry_key(get_entry(node, node->pair_offsets[node->num_pairs - 1])));
+        keycpy(replacement_key_out, entry_key(sizer, node, get_entry(node, node->pair_offsets[node->num_pairs - 1]), &replacement_buf));
     } else {
-        keycpy(replacement_key_out, entry_key(get_entry(sibling, sibling->pair_offsets[sibling->num_pairs - 1])));
+        keycpy(replacement_key_out, entry_key(sizer, sibling, get_entry(sibling, sibling->pair_offsets[sibling->num_pairs - 1]), &replacement_buf));
     }
 
     return true;
 }
 
+// Whether fro's entries fit in tow, if tow stores keys differently.
+bool fits_after_move(value_sizer_t<void> *sizer, const leaf_node_t *fro, const leaf_node_t *tow) {
+    if (same_storage(sizer, fro, tow)) {
+        // Two underfull nodes always fit in one.
+        return true;
+    }
+
+    int tstamp_back_offset;
+    mandatory_cost(sizer, fro, MANDATORY_TIMESTAMPS, &tstamp_back_offset);
+    return mandatory_cost(sizer, tow, MANDATORY_TIMESTAMPS)
+        + moved_copysize(sizer, fro, 0, fro->num_pairs, tstamp_back_offset, tow)
+        + static_cast<int>(sizeof(uint16_t)) * fro->num_pairs <= free_space(sizer, tow);
+}
+
 bool is_mergable(value_sizer_t<void> *sizer, const leaf_node_t *node, const leaf_node_t *sibling) {
-    return is_underfull(sizer, node) && is_underfull(sizer, sibling);
+    // We don't know which of them merge() will move into the other,
+    // so both ways have to work.
+    return is_underfull(sizer, node) && is_underfull(sizer, sibling)
+        && fits_after_move(sizer, node, sibling) && fits_after_move(sizer, sibling, node);
+}
+
+// Compares key with the key stored at `stored` in a prefix-compressed
+// node, like compare_keys_from().  key_shared is how much key shares
+// with the node's prefix `pre`.
+int compare_stored_key_from(const btree_key_t *key, int key_shared, const uint8_t *pre, const uint8_t *stored, int known_common, int *common_out) {
+    int suffix_size = stored[0];
+    int shared = stored[1];
+    const uint8_t *suffix = stored + 2;
+
+    if (shared > key_shared) {
+        // Both keys match the prefix up to key_shared, and then only the
+        // stored key keeps matching it.
+        *common_out = key_shared;
+        if (key_shared == key->size) {
+            return -1;
+        }
+        return static_cast<int>(key->contents[key_shared]) - static_cast<int>(pre[key_shared]);
+    }
+
+    // The first `shared` bytes of the keys are the prefix's.
+    int limit = std::min<int>(key->size, shared + suffix_size);
+    int i = std::max(known_common, shared);
+    while (i < limit && key->contents[i] == suffix[i - shared]) {
+        ++i;
+    }
+    *common_out = i;
+    if (i < limit) {
+        return static_cast<int>(key->contents[i]) - static_cast<int>(suffix[i - shared]);
+    }
+    return key->size - (shared + suffix_size);
 }
 
 // Sets *index_out to the index for the live entry or deletion entry
 // for the key, or to the index the key would have if it were
 // inserted.  Returns true if the key at said index is actually equal.
-bool find_key(const leaf_node_t *node, const btree_key_t *key, int *index_out) {
+bool find_key(value_sizer_t<void> *sizer, const leaf_node_t *node, const btree_key_t *key, int *index_out) {
+    const bool prefixed = is_prefixed(node);
+    const uint8_t *pre = prefix(sizer, node);
+    const int key_shared = prefixed ? shared_with_prefix(sizer, node, key) : 0;
+
     int beg = 0;
     int end = node->num_pairs;
 
     // beg == 0 or key > *(beg - 1).
     // end == num_pairs or key < *end.
 
+    // The lengths of the common prefixes of key and *(beg - 1) and of key
+    // and *end (zero when there's no such entry).
+    int beg_common = 0;
+    int end_common = 0;
+
     while (beg < end) {
         // when (end - beg) > 0, (end - beg) / 2 is always less than (end - beg).  So beg <= test_point < end.
         int test_point = beg + (end - beg) / 2;
 
-        const btree_key_t *ek = entry_key(get_entry(node, node->pair_offsets[test_point]));
+        const entry_t *ent = get_entry(node, node->pair_offsets[test_point]);
 
-        int res = sized_strcmp(key->contents, key->size, ek->contents, ek->size);
+        int common;
+        int res;
+        if (prefixed) {
+            res = compare_stored_key_from(key, key_shared, pre, stored_key(ent), std::min(beg_common, end_common), &common);
+        } else {
+            res = compare_keys_from(key, reinterpret_cast<const btree_key_t *>(stored_key(ent)), std::min(beg_common, end_common), &common);
+        }
 
         if (res < 0) {
             // key < *test_point.
             end = test_point;
+            end_common = common;
         } else if (res > 0) {
             // key > *test_point.  Since test_point < end, we have test_point + 1 <= end.
             beg = test_point + 1;
+            beg_common = common;
         } else {
             // We found the key!
             *index_out = test_point;
@@ -1153,10 +1579,10 @@ bool find_key(const leaf_node_t *node, const btree_key_t *key, int *index_out) {
 
 bool lookup(value_sizer_t<void> *sizer, const leaf_node_t *node, const btree_key_t *key, void *value_out) {
     int index;
-    if (find_key(node, key, &index)) {
+    if (find_key(sizer, node, key, &index)) {
         const entry_t *ent = get_entry(node, node->pair_offsets[index]);
         if (entry_is_live(ent)) {
-            const void *val = entry_value(ent);
+            const void *val = entry_value(node, ent);
             memcpy(value_out, val, sizer->size(val));
             return true;
         }
@@ -1176,8 +1602,10 @@ appropriate, and maintaining `frontmost` and `tstamp_cutpoint`. The caller is
 responsible for writing the actual entry itself (including the key) and for
 updating `live_size` if the newly created entry is live.
 
-`new_entry_size` is the total size of the new entry, including key, value,
-and/or code byte, but not including repli timestamp.
+`non_key_size` is the size of the new entry without its key: the size of the
+value, or the code byte. The caller should get the size of the key from
+`storage_size()` after this returns, since garbage collecting can change the
+node's prefix.
 
 It is an error to put a deletion entry after `tstamp_cutpoint`. If the caller
 intends to insert a deletion entry, it should pass `false` for
@@ -1188,7 +1616,7 @@ any preexisting entry that was in the leaf node. If the entry would go before
 `tstamp_cutpoint` or `allow_after_tstamp_cutpoint` is true, then the return
 value will be true. */
 MUST_USE bool prepare_space_for_new_entry(value_sizer_t<void> *sizer, leaf_node_t *node,
-        const btree_key_t *key, int new_entry_size, repli_timestamp_t tstamp,
+        const btree_key_t *key, int non_key_size, repli_timestamp_t tstamp,
         bool allow_after_tstamp_cutpoint,
         char **space_out) {
 
@@ -1197,13 +1625,13 @@ MUST_USE bool prepare_space_for_new_entry(value_sizer_t<void> *sizer, leaf_node_
     already exists, clean it. */
 
     int index;
-    bool found = find_key(node, key, &index);
+    bool found = find_key(sizer, node, key, &index);
 
     if (found) {
         int offset = node->pair_offsets[index];
         entry_t *ent = get_entry(node, offset);
 
-        int sz = entry_size(sizer, ent);
+        int sz = entry_size(sizer, node, ent);
 
         if (entry_is_live(ent)) {
             node->live_size -= sizeof(uint16_t) + sz;
@@ -1224,6 +1652,7 @@ MUST_USE bool prepare_space_for_new_entry(value_sizer_t<void> *sizer, leaf_node_
     /* Garbage collect if appropriate. We do it after cleaning up any existing
     entry so that deletion always works no matter how full the node is. */
 
+    int new_entry_size = storage_size(sizer, node, key) + non_key_size;
     if (offsetof(leaf_node_t, pair_offsets) +
             sizeof(uint16_t) * (node->num_pairs + (found ? 0 : 1)) +
             sizeof(repli_timestamp_t) +
@@ -1245,10 +1674,15 @@ MUST_USE bool prepare_space_for_new_entry(value_sizer_t<void> *sizer, leaf_node_
         moved around. */
         garbage_collect(sizer, node, MANDATORY_TIMESTAMPS - 1, &index);
 
+        /* While we're rewriting the node anyway, bring its prefix up to date.
+        This doesn't move anything around in `pair_offsets`. */
+        recompute_prefix(sizer, node, key);
+        new_entry_size = storage_size(sizer, node, key) + non_key_size;
+
         /* Make sure that `index` still refers to where the new key should be
         inserted. */
         DEBUG_VAR int index2;
-        rassert(!find_key(node, key, &index2));
+        rassert(!find_key(sizer, node, key, &index2));
         rassert(index == index2, "garbage_collect() failed to preserve index");
     }
 
@@ -1257,7 +1691,7 @@ MUST_USE bool prepare_space_for_new_entry(value_sizer_t<void> *sizer, leaf_node_
     uint16_t end_of_where_new_entry_should_go;
     bool new_entry_should_have_timestamp;
 
-    if (node->frontmost == sizer->block_size().value() ||
+    if (node->frontmost == entries_end(sizer, node) ||
             (node->frontmost < node->tstamp_cutpoint && get_timestamp(node, node->frontmost) <= tstamp)) {
         /* In the most common case, the new value will go right at
         `node->frontmost` and will get a timestamp. For performance reasons, we
@@ -1268,14 +1702,14 @@ MUST_USE bool prepare_space_for_new_entry(value_sizer_t<void> *sizer, leaf_node_
         new_entry_should_have_timestamp = true;
 
     } else {
-        entry_iter_t iter = entry_iter_t::make(node);
-        while (!iter.done(sizer) && iter.offset < node->tstamp_cutpoint && get_timestamp(node, iter.offset) > tstamp) {
+        entry_iter_t iter = entry_iter_t::make(sizer, node);
+        while (!iter.done() && iter.offset < node->tstamp_cutpoint && get_timestamp(node, iter.offset) > tstamp) {
             iter.step(sizer, node);
         }
         end_of_where_new_entry_should_go = iter.offset;
 
         if (end_of_where_new_entry_should_go == node->tstamp_cutpoint &&
-                node->tstamp_cutpoint != sizer->block_size().value()) {
+                node->tstamp_cutpoint != entries_end(sizer, node)) {
             /* We are after all of the timestamped entries, but before at least
             one non-timestamped entry. Since we don't know what the timestamp
             would have been on the non-timestamped entry, we mustn't put a
@@ -1380,22 +1814,30 @@ void insert(value_sizer_t<void> *sizer, leaf_node_t *node, const btree_key_t *ke
     rassert(!is_full(sizer, node, key, value));
     rassert(!km_proof.is_fake());
 
+    /* A prefix-compressed node takes its prefix from the first key that
+    goes into it when it's empty. */
+
+    if (is_prefixed(node) && node->num_pairs == 0) {
+        reset_prefix(sizer, node, key);
+    }
+
     /* Make space for the entry itself */
 
     char *location_to_write_data;
     DEBUG_VAR bool should_write = prepare_space_for_new_entry(sizer, node,
-        key, key->full_size() + sizer->size(value), tstamp,
+        key, sizer->size(value), tstamp,
         true,
         &location_to_write_data);
     rassert(should_write);
 
     /* Now copy the data into the node itself */
 
-    memcpy(location_to_write_data, key, key->full_size());
-    location_to_write_data += key->full_size();
+    int key_size = storage_size(sizer, node, key);
+    write_stored_key(sizer, node, key, location_to_write_data);
+    location_to_write_data += key_size;
     memcpy(location_to_write_data, value, sizer->size(value));
 
-    node->live_size += sizeof(uint16_t) + key->full_size() + sizer->size(value);
+    node->live_size += sizeof(uint16_t) + key_size + sizer->size(value);
 
     validate(sizer, node);
 }
@@ -1408,7 +1850,7 @@ void remove(value_sizer_t<void> *sizer, leaf_node_t *node, const btree_key_t *ke
 
     /* Confirm that the key is already in the node */
     DEBUG_VAR int index;
-    rassert(find_key(node, key, &index), "remove() called on key that's not in node");
+    rassert(find_key(sizer, node, key, &index), "remove() called on key that's not in node");
     rassert(entry_is_live(get_entry(node, node->pair_offsets[index])), "remove() called on key with dead entry");
 
     /* If the deletion entry would fall after `tstamp_cutpoint`, then it
@@ -1419,13 +1861,13 @@ void remove(value_sizer_t<void> *sizer, leaf_node_t *node, const btree_key_t *ke
     char *location_to_write_data;
     if (prepare_space_for_new_entry(sizer, node,
             key,
-            1 + key->full_size(),   /* 1 for `DELETE_ENTRY_CODE` */
+            1,   /* for `DELETE_ENTRY_CODE` */
             tstamp,
             false,
             &location_to_write_data)) {
         *location_to_write_data = static_cast<char>(DELETE_ENTRY_CODE);
         ++location_to_write_data;
-        memcpy(location_to_write_data, key, key->full_size());
+        write_stored_key(sizer, node, key, location_to_write_data);
     }
 
     validate(sizer, node);
@@ -1436,14 +1878,14 @@ void erase_presence(value_sizer_t<void> *sizer, leaf_node_t *node, const btree_k
     // TODO: Maybe we don't want key_modification_proof_t for this function.
     //XXX according to sam it's safe to remove this assert. To be fair we only trip this from a call siterassert(!km_proof.is_fake());
     int index;
-    bool found = find_key(node, key, &index);
+    bool found = find_key(sizer, node, key, &index);
 
     rassert(found);
     if (found) {
         int offset = node->pair_offsets[index];
         entry_t *ent = get_entry(node, offset);
 
-        int sz = entry_size(sizer, ent);
+        int sz = entry_size(sizer, node, ent);
         if (entry_is_live(ent)) {
             node->live_size -= sizeof(uint16_t) + sz;
         }
@@ -1466,8 +1908,8 @@ void dump_entries_since_time(value_sizer_t<void> *sizer, const leaf_node_t *node
     {
         repli_timestamp_t earliest_so_far = repli_timestamp_t::invalid;
 
-        entry_iter_t iter = entry_iter_t::make(node);
-        while (!iter.done(sizer) && iter.offset < node->tstamp_cutpoint) {
+        entry_iter_t iter = entry_iter_t::make(sizer, node);
+        while (!iter.done() && iter.offset < node->tstamp_cutpoint) {
             repli_timestamp_t tstamp = get_timestamp(node, iter.offset);
             rassert(earliest_so_far >= tstamp, "asserted earliest_so_far (%" PRIu64 ") >= tstamp (%" PRIu64 ")", earliest_so_far.longtime, tstamp.longtime);
             earliest_so_far = tstamp;
@@ -1485,7 +1927,7 @@ void dump_entries_since_time(value_sizer_t<void> *sizer, const leaf_node_t *node
 
     // If we haven't found a [tstamp][entry] pair such that tstamp < minimum_tstamp, then we are missing some deletion history
     if (stop_offset == 0) {
-        stop_offset = sizer->block_size().value();
+        stop_offset = entries_end(sizer, node);
         cb->lost_deletions();
         include_deletions = false;
     }
@@ -1493,7 +1935,7 @@ void dump_entries_since_time(value_sizer_t<void> *sizer, const leaf_node_t *node
     // Walk through all the entries starting with the the frontmost and finishing right before the one which has tstamp < minimum_tstamp
     // (if it exists). If it doesn't exist, we also walk through the non-timestamped entries.
     {
-        entry_iter_t iter = entry_iter_t::make(node);
+        entry_iter_t iter = entry_iter_t::make(sizer, node);
         repli_timestamp_t last_seen_tstamp = maximum_possible_timestamp;
         while (iter.offset < stop_offset) {
             repli_timestamp_t tstamp;
@@ -1506,10 +1948,11 @@ void dump_entries_since_time(value_sizer_t<void> *sizer, const leaf_node_t *node
 
             const entry_t *ent = get_entry(node, iter.offset);
 
+            store_key_t buf;
             if (entry_is_live(ent)) {
-                cb->key_value(entry_key(ent), entry_value(ent), tstamp);
+                cb->key_value(entry_key(sizer, node, ent, &buf), entry_value(node, ent), tstamp);
             } else if (entry_is_deletion(ent) && include_deletions) {
-                cb->deletion(entry_key(ent), tstamp);
+                cb->deletion(entry_key(sizer, node, ent, &buf), tstamp);
             }
 
             iter.step(sizer, node);
@@ -1525,12 +1968,12 @@ bool live_iter_t::step(const leaf_node_t *node) {
     return index_ < node->num_pairs;
 }
 
-const btree_key_t *live_iter_t::get_key(const leaf_node_t *node) const {
+const btree_key_t *live_iter_t::get_key(const leaf_node_t *node) {
     rassert(index_ <= node->num_pairs);
     if (index_ == node->num_pairs) {
         return NULL;
     } else {
-        return entry_key(get_entry(node, node->pair_offsets[index_]));
+        return entry_key(sizer_, node, get_entry(node, node->pair_offsets[index_]), &key_);
     }
 }
 
@@ -1542,7 +1985,7 @@ const void *live_iter_t::get_value(const leaf_node_t *node) const {
     if (index_ == node->num_pairs) {
         return NULL;
     } else {
-        return entry_value(get_entry(node, node->pair_offsets[index_]));
+        return entry_value(node, get_entry(node, node->pair_offsets[index_]));
     }
 }
 
@@ -1553,22 +1996,22 @@ const void *live_iter_t::get_value(const leaf_node_t *node) const {
 
 // Returns an iterator that starts at the first entry whose key is
 // greater than or equal to key.
-live_iter_t iter_for_inclusive_lower_bound(const leaf_node_t *node, const btree_key_t *key) {
+live_iter_t iter_for_inclusive_lower_bound(value_sizer_t<void> *sizer, const leaf_node_t *node, const btree_key_t *key) {
     int index;
-    find_key(node, key, &index);
+    find_key(sizer, node, key, &index);
     while (index < node->num_pairs && !entry_is_live(get_entry(node, node->pair_offsets[index]))) {
         ++index;
     }
-    return live_iter_t(index);
+    return live_iter_t(sizer, index);
 }
 
 // Returns an iterator that starts at the smallest key.
-live_iter_t iter_for_whole_leaf(const leaf_node_t *node) {
+live_iter_t iter_for_whole_leaf(value_sizer_t<void> *sizer, const leaf_node_t *node) {
     int index = 0;
     while (index < node->num_pairs && !entry_is_live(get_entry(node, node->pair_offsets[index]))) {
         ++index;
     }
-    return live_iter_t(index);
+    return live_iter_t(sizer, index);
 }
 
 
@@ -4,11 +4,11 @@
 
 #include <string>
 
+#include "btree/keys.hpp"
 #include "buffer_cache/types.hpp"
 #include "errors.hpp"
 
 template <class> class value_sizer_t;
-struct btree_key_t;
 class repli_timestamp_t;
 
 // TODO: Could key_modification_proof_t not go in this file?
@@ -81,6 +81,27 @@ struct leaf_node_t {
     uint16_t pair_offsets[];
 };
 
+// A leaf has one of two layouts.  The plain one stores every key in
+// full.  The prefix-compressed one keeps a reference prefix at the end
+// of the block and stores each key as how much of the prefix it shares
+// plus the rest, so that keys with long common prefixes (like the
+// UUID-prefixed keys of a table) take little more room than their
+// distinct parts.  (The details are in leaf_node.cc.)
+//
+// The magic tells the layouts apart: a prefix-compressed leaf's magic
+// is its value type's leaf magic with the high bit of the last byte
+// set.  A value sizer picks the layout of new leaves by returning one
+// magic or the other from btree_leaf_magic(); leaves split off from a
+// leaf keep its layout.
+block_magic_t prefixed_magic(block_magic_t leaf_magic);
+block_magic_t unprefixed_magic(block_magic_t magic);
+bool is_prefixed(const leaf_node_t *node);
+
+// Whether `magic` is the sizer's value type's leaf magic, in either layout.
+bool has_leaf_magic(value_sizer_t<void> *sizer, block_magic_t magic);
+
+// The longest reference prefix a prefix-compressed leaf keeps.
+const int MAX_PREFIX_SIZE = 64;
 
 
 
@@ -110,10 +131,19 @@ void init(value_sizer_t<void> *sizer, leaf_node_t *node);
 
 bool is_empty(const leaf_node_t *node);
 
+// The smallest key of any entry, live or deleted.  The node must not be empty.
+store_key_t smallest_key(value_sizer_t<void> *sizer, const leaf_node_t *node);
+
+// The largest key of any entry, live or deleted.  The node must not be empty.
+store_key_t largest_key(value_sizer_t<void> *sizer, const leaf_node_t *node);
+
 bool is_full(value_sizer_t<void> *sizer, const leaf_node_t *node, const btree_key_t *key, const void *value);
 
 bool is_underfull(value_sizer_t<void> *sizer, const leaf_node_t *node);
 
+// True if a single insert, remove, or erase could leave the node underfull.
+bool may_become_underfull(value_sizer_t<void> *sizer, const leaf_node_t *node);
+
 void split(value_sizer_t<void> *sizer, leaf_node_t *node, leaf_node_t *rnode, btree_key_t *median_out);
 
 void merge(value_sizer_t<void> *sizer, leaf_node_t *left, leaf_node_t *right);
@@ -122,7 +152,7 @@ bool level(value_sizer_t<void> *sizer, int nodecmp_node_with_sib, leaf_node_t *n
 
 bool is_mergable(value_sizer_t<void> *sizer, const leaf_node_t *node, const leaf_node_t *sibling);
 
-bool find_key(const leaf_node_t *node, const btree_key_t *key, int *index_out);
+bool find_key(value_sizer_t<void> *sizer, const leaf_node_t *node, const btree_key_t *key, int *index_out);
 
 bool lookup(value_sizer_t<void> *sizer, const leaf_node_t *node, const btree_key_t *key, void *value_out);
 
@@ -158,20 +188,25 @@ void dump_entries_since_time(value_sizer_t<void> *sizer, const leaf_node_t *node
 class live_iter_t {
 public:
     bool step(const leaf_node_t *node);
-    const btree_key_t *get_key(const leaf_node_t *node) const;
+    // A prefix-compressed leaf doesn't hold its keys in one piece, so
+    // the key may live in the iterator.  It stays valid until the
+    // iterator is stepped.
+    const btree_key_t *get_key(const leaf_node_t *node);
     const void *get_value(const leaf_node_t *node) const;
 
 private:
-    explicit live_iter_t(int index) : index_(index) { }
+    live_iter_t(value_sizer_t<void> *sizer, int index) : sizer_(sizer), index_(index) { }
 
-    friend live_iter_t iter_for_inclusive_lower_bound(const leaf_node_t *node, const btree_key_t *key);
-    friend live_iter_t iter_for_whole_leaf(const leaf_node_t *node);
+    friend live_iter_t iter_for_inclusive_lower_bound(value_sizer_t<void> *sizer, const leaf_node_t *node, const btree_key_t *key);
+    friend live_iter_t iter_for_whole_leaf(value_sizer_t<void> *sizer, const leaf_node_t *node);
 
+    value_sizer_t<void> *sizer_;
     int index_;
+    store_key_t key_;
 };
 
-live_iter_t iter_for_inclusive_lower_bound(const leaf_node_t *node, const btree_key_t *key);
-live_iter_t iter_for_whole_leaf(const leaf_node_t *node);
+live_iter_t iter_for_inclusive_lower_bound(value_sizer_t<void> *sizer, const leaf_node_t *node, const btree_key_t *key);
+live_iter_t iter_for_whole_leaf(value_sizer_t<void> *sizer, const leaf_node_t *node);
 
 }  // namespace leaf
 
@@ -20,7 +20,7 @@ void print(const node_t *node) {
 }
 
 bool is_underfull(value_sizer_t<void> *sizer, const node_t *node) {
-    if (node->magic == sizer->btree_leaf_magic()) {
+    if (leaf::has_leaf_magic(sizer, node->magic)) {
         return leaf::is_underfull(sizer, reinterpret_cast<const leaf_node_t *>(node));
     } else {
         rassert(is_internal(node));
@@ -29,7 +29,7 @@ bool is_underfull(value_sizer_t<void> *sizer, const node_t *node) {
 }
 
 bool is_mergable(value_sizer_t<void> *sizer, const node_t *node, const node_t *sibling, const internal_node_t *parent) {
-    if (sizer->btree_leaf_magic() == node->magic) {
+    if (leaf::has_leaf_magic(sizer, node->magic)) {
         return leaf::is_mergable(sizer, reinterpret_cast<const leaf_node_t *>(node), reinterpret_cast<const leaf_node_t *>(sibling));
     } else {
         rassert(is_internal(node));
@@ -42,6 +42,8 @@ void split(value_sizer_t<void> *sizer, buf_lock_t *node_buf, node_t *rnode, btre
     if (is_leaf(reinterpret_cast<const node_t *>(node_buf->get_data_read()))) {
         leaf_node_t *node = reinterpret_cast<leaf_node_t *>(node_buf->get_data_major_write());
         leaf::split(sizer, node, reinterpret_cast<leaf_node_t *>(rnode), median);
+        // The parent gets a shorter key and so has room for more children.
+        shorten_separator(median, leaf::smallest_key(sizer, reinterpret_cast<leaf_node_t *>(rnode)).btree_key());
     } else {
         internal_node::split(sizer->block_size(), node_buf, reinterpret_cast<internal_node_t *>(rnode), median);
     }
@@ -59,7 +61,13 @@ void merge(value_sizer_t<void> *sizer, node_t *node, buf_lock_t *rnode_buf, cons
 
 bool level(value_sizer_t<void> *sizer, int nodecmp_node_with_sib, buf_lock_t *node_buf, buf_lock_t *rnode_buf, btree_key_t *replacement_key, const internal_node_t *parent) {
     if (is_leaf(reinterpret_cast<const node_t *>(node_buf->get_data_read()))) {
-        return leaf::level(sizer, nodecmp_node_with_sib, reinterpret_cast<leaf_node_t *>(node_buf->get_data_major_write()), reinterpret_cast<leaf_node_t *>(rnode_buf->get_data_major_write()), replacement_key);
+        leaf_node_t *node = reinterpret_cast<leaf_node_t *>(node_buf->get_data_major_write());
+        leaf_node_t *sibling = reinterpret_cast<leaf_node_t *>(rnode_buf->get_data_major_write());
+        if (!leaf::level(sizer, nodecmp_node_with_sib, node, sibling, replacement_key)) {
+            return false;
+        }
+        shorten_separator(replacement_key, leaf::smallest_key(sizer, nodecmp_node_with_sib < 0 ? sibling : node).btree_key());
+        return true;
     } else {
         return internal_node::level(sizer->block_size(), node_buf, rnode_buf, replacement_key, parent);
     }
@@ -67,7 +75,7 @@ bool level(value_sizer_t<void> *sizer, int nodecmp_node_with_sib, buf_lock_t *no
 
 void validate(DEBUG_VAR value_sizer_t<void> *sizer, DEBUG_VAR const node_t *node) {
 #ifndef NDEBUG
-    if (node->magic == sizer->btree_leaf_magic()) {
+    if (leaf::has_leaf_magic(sizer, node->magic)) {
         leaf::validate(sizer, reinterpret_cast<const leaf_node_t *>(node));
     } else if (node->magic == internal_node_t::expected_magic) {
         internal_node::validate(sizer->block_size(), reinterpret_cast<const internal_node_t *>(node));
@@ -8,14 +8,38 @@
 #include "btree/slice.hpp"
 #include "buffer_cache/blob.hpp"
 
-real_superblock_t::real_superblock_t(buf_lock_t *sb_buf) {
+real_superblock_t::real_superblock_t(buf_lock_t *sb_buf) : pending_metainfo_txn_(NULL) {
     sb_buf_.swap(*sb_buf);
 }
 
+real_superblock_t::~real_superblock_t() {
+    release();
+}
+
 void real_superblock_t::release() {
+    if (pending_metainfo_txn_ != NULL) {
+        rassert(sb_buf_.is_acquired());
+        transaction_t *txn = pending_metainfo_txn_;
+        pending_metainfo_txn_ = NULL;
+        sb_buf_.upgrade_to_write();
+        set_superblock_metainfo(txn, &sb_buf_, pending_metainfo_);
+        pending_metainfo_.clear();
+    }
     sb_buf_.release_if_acquired();
 }
 
+void real_superblock_t::upgrade_to_write() {
+    if (sb_buf_.is_acquired()) {
+        sb_buf_.upgrade_to_write();
+    }
+}
+
+void real_superblock_t::set_metainfo_on_release(transaction_t *txn, const std::vector<std::pair<std::vector<char>, std::vector<char> > > &kv_pairs) {
+    rassert(sb_buf_.is_acquired());
+    pending_metainfo_txn_ = txn;
+    pending_metainfo_ = kv_pairs;
+}
+
 block_id_t real_superblock_t::get_root_block_id() const {
     rassert(sb_buf_.is_acquired());
     return reinterpret_cast<const btree_superblock_t *>(sb_buf_.get_data_read())->root_block;
@@ -23,6 +47,7 @@ block_id_t real_superblock_t::get_root_block_id() const {
 
 void real_superblock_t::set_root_block_id(const block_id_t new_root_block) {
     rassert(sb_buf_.is_acquired());
+    sb_buf_.upgrade_to_write();
     // We have to const_cast, because set_data unfortunately takes void* pointers, but get_data_read()
     // gives us const data. No way around this (except for making set_data take a const void * again, as it used to be).
     sb_buf_.set_data(const_cast<block_id_t *>(&(static_cast<const btree_superblock_t *>(sb_buf_.get_data_read())->root_block)), &new_root_block, sizeof(new_root_block));
@@ -35,6 +60,7 @@ block_id_t real_superblock_t::get_stat_block_id() const {
 
 void real_superblock_t::set_stat_block_id(const block_id_t new_stat_block) {
     rassert(sb_buf_.is_acquired());
+    sb_buf_.upgrade_to_write();
     // We have to const_cast, because set_data unfortunately takes void* pointers, but get_data_read()
     // gives us const data. No way around this (except for making set_data take a const void * again, as it used to be).
     sb_buf_.set_data(const_cast<block_id_t *>(&(static_cast<const btree_superblock_t *>(sb_buf_.get_data_read())->stat_block)), &new_stat_block, sizeof(new_stat_block));
@@ -236,6 +262,44 @@ void set_superblock_metainfo(transaction_t *txn, buf_lock_t *superblock, const s
     }
 }
 
+void set_superblock_metainfo(transaction_t *txn, buf_lock_t *superblock, const std::vector< std::pair<std::vector<char>, std::vector<char> > > &kv_pairs) {
+    btree_superblock_t *data = static_cast<btree_superblock_t *>(superblock->get_data_major_write());
+
+    blob_t blob(data->metainfo_blob, btree_superblock_t::METAINFO_BLOB_MAXREFLEN);
+    blob.clear(txn);
+
+    std::vector<char> metainfo;
+    for (std::vector< std::pair<std::vector<char>, std::vector<char> > >::const_iterator it = kv_pairs.begin(); it != kv_pairs.end(); ++it) {
+        union {
+            char x[sizeof(uint32_t)];
+            uint32_t y;
+        } u;
+        rassert(it->first.size() < UINT32_MAX);
+        rassert(it->second.size() < UINT32_MAX);
+
+        u.y = it->first.size();
+        metainfo.insert(metainfo.end(), u.x, u.x + sizeof(uint32_t));
+        metainfo.insert(metainfo.end(), it->first.begin(), it->first.end());
+
+        u.y = it->second.size();
+        metainfo.insert(metainfo.end(), u.x, u.x + sizeof(uint32_t));
+        metainfo.insert(metainfo.end(), it->second.begin(), it->second.end());
+    }
+
+    blob.append_region(txn, metainfo.size());
+
+    {
+        blob_acq_t acq;
+        buffer_group_t write_group;
+        blob.expose_all(txn, rwi_write, &write_group, &acq);
+
+        buffer_group_t group_cpy;
+        group_cpy.add_buffer(metainfo.size(), metainfo.data());
+
+        buffer_group_copy_data(&write_group, const_view(&group_cpy));
+    }
+}
+
 void delete_superblock_metainfo(transaction_t *txn, buf_lock_t *superblock, const std::vector<char> &key) {
     btree_superblock_t *data = static_cast<btree_superblock_t *>(superblock->get_data_major_write());
 
@@ -322,7 +386,7 @@ void get_root(value_sizer_t<void> *sizer, transaction_t *txn, superblock_t* sb,
     block_id_t node_id = sb->get_root_block_id();
 
     if (node_id != NULL_BLOCK_ID) {
-        buf_lock_t temp_lock(txn, node_id, rwi_write);
+        buf_lock_t temp_lock(txn, node_id, rwi_intent);
         buf_out->swap(temp_lock);
     } else {
         buf_lock_t temp_lock(txn);
@@ -468,7 +532,10 @@ void get_btree_superblock_and_txn_internal(btree_slice_t *slice, access_t access
 
     order_token_t pre_begin_txn_token = slice->pre_begin_txn_checkpoint_.check_through(token);
 
-    transaction_t *txn = new transaction_t(slice->cache(), access, expected_change_count, tstamp, pre_begin_txn_token);
+    // A writer that takes the superblock with rwi_intent still needs a write
+    // transaction for whatever it goes on to change.
+    const access_t txn_access = access == rwi_intent ? rwi_write : access;
+    transaction_t *txn = new transaction_t(slice->cache(), txn_access, expected_change_count, tstamp, pre_begin_txn_token);
     txn_out->init(txn);
 
     txn->set_account(cache_account);
@@ -25,6 +25,11 @@ public:
     // Release the superblock if possible (otherwise do nothing)
     virtual void release() = 0;
 
+    // Writers hold the superblock with rwi_intent and upgrade it only once
+    // they know they're going to change it.  Does nothing if it's already
+    // held for writing or has been released.
+    virtual void upgrade_to_write() = 0;
+
     virtual block_id_t get_root_block_id() const = 0;
     virtual void set_root_block_id(const block_id_t new_root_block) = 0;
 
@@ -43,10 +48,18 @@ private:
 class real_superblock_t : public superblock_t {
 public:
     explicit real_superblock_t(buf_lock_t *sb_buf);
+    ~real_superblock_t();
 
     void release();
+    void upgrade_to_write();
     buf_lock_t *get() { return &sb_buf_; }
 
+    // Has `release()` (or the destructor, if it comes first) replace the
+    // metainfo with `kv_pairs` just before letting go of the superblock.
+    // A write holds the superblock with rwi_intent on its way down, so this
+    // way it's only held for writing after the write is past the root.
+    void set_metainfo_on_release(transaction_t *txn, const std::vector<std::pair<std::vector<char>, std::vector<char> > > &kv_pairs);
+
     block_id_t get_root_block_id() const;
     void set_root_block_id(const block_id_t new_root_block);
 
@@ -58,6 +71,10 @@ public:
 
 private:
     buf_lock_t sb_buf_;
+
+    // Non-NULL if `release()` has to write `pending_metainfo_`.
+    transaction_t *pending_metainfo_txn_;
+    std::vector<std::pair<std::vector<char>, std::vector<char> > > pending_metainfo_;
 };
 
 /* This is for nested btrees, where the "superblock" is really more like a super value.
@@ -76,6 +93,7 @@ public:
     explicit virtual_superblock_t(block_id_t root_block_id = NULL_BLOCK_ID) : root_block_id_(root_block_id) { }
 
     void release() { }
+    void upgrade_to_write() { }
     block_id_t get_root_block_id() const {
         return root_block_id_;
     }
@@ -230,6 +248,7 @@ private:
     char *value_ptr;
 };
 
+// Acquires the root for a write, with `rwi_intent` unless it has to be created.
 void get_root(value_sizer_t<void> *sizer, transaction_t *txn, superblock_t* sb, buf_lock_t *buf_out, eviction_priority_t root_eviction_priority);
 
 void check_and_handle_split(value_sizer_t<void> *sizer, transaction_t *txn, buf_lock_t *buf, buf_lock_t *last_buf, superblock_t *sb,
@@ -243,6 +262,8 @@ bool get_superblock_metainfo(transaction_t *txn, buf_lock_t *superblock, const s
 void get_superblock_metainfo(transaction_t *txn, buf_lock_t *superblock, std::vector< std::pair<std::vector<char>, std::vector<char> > > *kv_pairs_out);
 
 void set_superblock_metainfo(transaction_t *txn, buf_lock_t *superblock, const std::vector<char> &key, const std::vector<char> &value);
+// Replaces all of the metainfo with `kv_pairs`, rewriting the blob once.
+void set_superblock_metainfo(transaction_t *txn, buf_lock_t *superblock, const std::vector< std::pair<std::vector<char>, std::vector<char> > > &kv_pairs);
 
 void delete_superblock_metainfo(transaction_t *txn, buf_lock_t *superblock, const std::vector<char> &key);
 void clear_superblock_metainfo(transaction_t *txn, buf_lock_t *superblock);
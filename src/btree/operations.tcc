@@ -16,8 +16,14 @@
 // workloads). Also, if the serializer is log-structured, we can write
 // only a small part of each node.
 
-// TODO: change rwi_write to rwi_intent followed by rwi_upgrade where
-// relevant.
+// Writers walk down the tree holding nodes with rwi_intent, which
+// excludes other writers but not readers, and only upgrade to rwi_write
+// the nodes they actually change: the leaf, plus any node that gets
+// split or merged on the way (together with its parent). Upgrades always
+// go parent first, so that a reader coupling its way down from a parent
+// we're upgrading is never waiting on a child we've already upgraded.
+// The superblock counts as the root's parent: while we still hold it, it
+// gets upgraded before any node does, since the root might be replaced.
 
 template <class Value>
 void find_keyvalue_location_for_write(transaction_t *txn, superblock_t *superblock, const btree_key_t *key, keyvalue_location_t<Value> *keyvalue_location_out, eviction_priority_t *root_eviction_priority, btree_stats_t *stats) {
@@ -36,6 +42,19 @@ void find_keyvalue_location_for_write(transaction_t *txn, superblock_t *superblo
 
     // Walk down the tree to the leaf.
     while (node::is_internal(reinterpret_cast<const node_t *>(buf.get_data_read()))) {
+        // Splitting or merging changes both the node and its parent, so
+        // that's when we need them for writing.
+        const internal_node_t *node = reinterpret_cast<const internal_node_t *>(buf.get_data_read());
+        if (internal_node::is_full(node) || (last_buf.is_acquired() && node::is_underfull(&sizer, reinterpret_cast<const node_t *>(node)))) {
+            if (keyvalue_location_out->superblock) {
+                keyvalue_location_out->superblock->upgrade_to_write();
+            }
+            if (last_buf.is_acquired()) {
+                last_buf.upgrade_to_write();
+            }
+            buf.upgrade_to_write();
+        }
+
         // Check if the node is overfull and proactively split it if it is (since this is an internal node).
         check_and_handle_split(&sizer, txn, &buf, &last_buf, superblock, key, reinterpret_cast<Value *>(NULL), root_eviction_priority);
 
@@ -58,7 +77,7 @@ void find_keyvalue_location_for_write(transaction_t *txn, superblock_t *superblo
         block_id_t node_id = internal_node::lookup(reinterpret_cast<const internal_node_t *>(buf.get_data_read()), key);
         rassert(node_id != NULL_BLOCK_ID && node_id != SUPERBLOCK_ID);
 
-        buf_lock_t tmp(txn, node_id, rwi_write);
+        buf_lock_t tmp(txn, node_id, rwi_intent);
         tmp.set_eviction_priority(incr_priority(buf.get_eviction_priority()));
         last_buf.swap(tmp);
         buf.swap(last_buf);
@@ -134,6 +153,31 @@ void apply_keyvalue_change(transaction_t *txn, keyvalue_location_t<Value> *kv_lo
 
     key_modification_proof_t km_proof = km_callback->value_modification(txn, kv_loc, key);
 
+    // The parent only changes if the leaf gets split, merged, or leveled.
+    // If none of that can happen, let go of it right away so that other
+    // writers can get past it; that also makes the checks below treat the
+    // leaf like the root, which is never underfull.  The same goes for the
+    // superblock, if the leaf or its parent is the root.
+    const leaf_node_t *leaf_node = reinterpret_cast<const leaf_node_t *>(kv_loc->buf.get_data_read());
+    const bool may_split = kv_loc->value.has() && leaf::is_full(&sizer, leaf_node, key, kv_loc->value.get());
+    const bool changes_parent = kv_loc->last_buf.is_acquired() && (may_split || leaf::may_become_underfull(&sizer, leaf_node));
+    if (kv_loc->superblock) {
+        if (changes_parent || (!kv_loc->last_buf.is_acquired() && may_split)) {
+            kv_loc->superblock->upgrade_to_write();
+        } else {
+            kv_loc->superblock->release();
+            kv_loc->superblock = NULL;
+        }
+    }
+    if (kv_loc->last_buf.is_acquired()) {
+        if (changes_parent) {
+            kv_loc->last_buf.upgrade_to_write();
+        } else {
+            kv_loc->last_buf.release();
+        }
+    }
+    kv_loc->buf.upgrade_to_write();
+
     /* how much this keyvalue change affects the total population of the btree
      * (should be -1, 0 or 1) */
     int population_change;
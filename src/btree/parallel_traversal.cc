@@ -324,6 +324,10 @@ void btree_parallel_traversal(transaction_t *txn, superblock_t *superblock, btre
 
     /* Make sure there's a stat block*/
     if (helper->btree_node_mode() == rwi_write) {
+        /* We're going to hold the root for writing, so the superblock has to be
+        upgraded first (if the writer took it with rwi_intent), or a reader
+        holding it and waiting on the root would keep us from upgrading it. */
+        superblock->upgrade_to_write();
         ensure_stat_block(txn, superblock, incr_priority(ZERO_EVICTION_PRIORITY));
     }
 
@@ -18,6 +18,12 @@ public:
         }
     }
 
+    void upgrade_to_write() {
+        if (sub_superblock != NULL) {
+            sub_superblock->upgrade_to_write();
+        }
+    }
+
     block_id_t get_root_block_id() const {
         return sub_superblock->get_root_block_id();
     }
@@ -125,7 +125,7 @@ memcpy_patch_t::memcpy_patch_t(const block_id_t block_id, const patch_counter_t
 void memcpy_patch_t::serialize_data(char *destination) const {
     memcpy(destination, &dest_offset, sizeof(dest_offset));
     destination += sizeof(dest_offset);
-    uint64_t n = src_buf.size();
+    uint16_t n = src_buf.size();
     memcpy(destination, &n, sizeof(n));
     destination += sizeof(n);
     memcpy(destination, src_buf.data(), n);
@@ -1,6 +1,10 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
 #include "buffer_cache/mirrored/mirrored.hpp"
 
+#include <string.h>
+
+#include <new>
+
 #include "errors.hpp"
 #include <boost/bind.hpp>
 
@@ -8,6 +12,8 @@
 #include "do_on_thread.hpp"
 #include "serializer/serializer.hpp"
 
+const block_magic_t mc_config_block_t::expected_magic = { { 'm', 'c', 'f', 'g' } };
+
 /**
  * Buffer implementation.
  */
@@ -157,6 +163,12 @@ void mc_inner_buf_t::load_inner_buf(bool should_lock, file_account_t *io_account
         rassert(lock.locked());
     }
 
+    // Patches that haven't been applied to the block on disk are in its delta record,
+    // unless we still have them from before.
+    const bool need_delta = !cache->patch_memory_storage.has_patches_for_block(block_id);
+    std::string delta;
+    bool has_delta = false;
+
     // Read the block...
     {
         on_thread_t thread(cache->serializer->home_thread());
@@ -165,11 +177,18 @@ void mc_inner_buf_t::load_inner_buf(bool should_lock, file_account_t *io_account
         data_token = cache->serializer->index_read(block_id);
         guarantee(data_token);
         cache->serializer->block_read(data_token, data.get(), io_account);
+        if (need_delta) {
+            has_delta = cache->serializer->delta_read(block_id, &delta, io_account);
+        }
     }
 
     // Read the block sequence id
     block_sequence_id = cache->serializer->get_block_sequence_id(block_id, data.get());
 
+    if (has_delta) {
+        load_delta_record(delta);
+    }
+
     replay_patches();
 
     if (should_lock) {
@@ -177,6 +196,25 @@ void mc_inner_buf_t::load_inner_buf(bool should_lock, file_account_t *io_account
     }
 }
 
+void mc_inner_buf_t::load_delta_record(const std::string &delta) {
+    std::list<buf_patch_t *> patches;
+    size_t offset = 0;
+    while (offset < delta.size()) {
+        buf_patch_t *patch;
+        try {
+            patch = buf_patch_t::load_patch(delta.data() + offset);
+        } catch (const patch_deserialization_error_t &e) {
+            crash("Corrupted delta record for block %u: %s", block_id, e.c_str());
+        }
+        guarantee(patch, "Truncated delta record for block %u", block_id);
+        guarantee(patch->get_block_id() == block_id);
+        offset += patch->get_serialized_size();
+        patches.push_back(patch);
+    }
+    guarantee(offset == delta.size(), "Truncated delta record for block %u", block_id);
+    cache->patch_memory_storage.load_block_patch_list(block_id, patches);
+}
+
 // This form of the buf constructor is used when the block exists on disk and needs to be loaded
 mc_inner_buf_t::mc_inner_buf_t(mc_cache_t *_cache, block_id_t _block_id, file_account_t *_io_account)
     : evictable_t(_cache),
@@ -281,7 +319,7 @@ mc_inner_buf_t *mc_inner_buf_t::allocate(mc_cache_t *cache, version_id_t snapsho
 }
 
 // This form of the buf constructor is used when a completely new block is being created.
-// Used by mc_inner_buf_t::allocate() and by the patch log.
+// Used by mc_inner_buf_t::allocate().
 // If you update this constructor, please don't forget to update mc_inner_buf_t::allocate
 // accordingly.
 mc_inner_buf_t::mc_inner_buf_t(mc_cache_t *_cache, block_id_t _block_id, version_id_t _snapshot_version, repli_timestamp_t _recency_timestamp)
@@ -348,6 +386,10 @@ mc_inner_buf_t::~mc_inner_buf_t() {
         remove_from_page_repl();
     }
 
+    // Whatever patches we still have are in the block's delta record on disk, and get read
+    // from there if the block is loaded again.
+    cache->patch_memory_storage.drop_patches(block_id);
+
     --cache->stats->pm_n_blocks_in_memory;
 }
 
@@ -510,6 +552,7 @@ mc_buf_lock_t::mc_buf_lock_t(mc_transaction_t *transaction,
 {
     transaction->assert_thread();
     rassert(block_id != NULL_BLOCK_ID);
+    ++transaction->num_blocks_acquired;
 
     // Note that it is critical that between here and creating our buf_lock_t wrapper that we do nothing
     // blocking (unless it acquires a lock on inner_buf or otherwise prevents it from being
@@ -522,6 +565,7 @@ mc_buf_lock_t::mc_buf_lock_t(mc_transaction_t *transaction,
         // otherwise, the inner buf would be around to keep track of the snapshotted version. Thus,
         // it is not wasteful to load the latest version if should_load is true.
         inner_buf = new mc_inner_buf_t(transaction->cache, block_id, transaction->get_io_account());
+        ++transaction->num_blocks_read_from_disk;
     } else {
         // TODO: the logic for when to load an inner_buf's versions (most recent or snapshotted) is
         // scattered around everywhere (eg: here). consolidate it, perhaps in mc_buf_lock_t.
@@ -538,6 +582,7 @@ mc_buf_lock_t::mc_buf_lock_t(mc_transaction_t *transaction,
 
             // Please keep in mind that this is blocking...
             inner_buf->load_inner_buf(true, transaction->get_io_account());
+            ++transaction->num_blocks_read_from_disk;
         }
     }
 
@@ -611,31 +656,6 @@ void mc_buf_lock_t::initialize(mc_inner_buf_t::version_id_t version_to_access,
     acquired = true;
 }
 
-/* Constructor for mc_buf_lock_t used by patch_disk_storage_t, takes some shortcuts and has some special behavior */
-mc_buf_lock_t * mc_buf_lock_t::acquire_non_locking_lock(mc_cache_t *cache, const block_id_t block_id)
-{
-    mc_buf_lock_t *lock = new mc_buf_lock_t();
-    lock->mode = rwi_read;
-    lock->inner_buf = cache->page_map.find(block_id);
-    cache->assert_thread();
-
-    if (!lock->inner_buf) {
-        /* The buf isn't in the cache and must be loaded from disk */
-        lock->inner_buf = new mc_inner_buf_t(cache, block_id, cache->reads_io_account.get());
-    }
-
-    // We still have to acquire the lock once to wait for the buf to get ready
-    lock->initialize(mc_inner_buf_t::faux_version_id, DEFAULT_DISK_ACCOUNT, 0);
-
-    // Release the lock we've got
-    lock->inner_buf->lock.unlock();
-    lock->non_locking_access = true;
-    lock->mode = rwi_write;
-
-    cache->assert_thread();
-    return lock;
-}
-
 mc_buf_lock_t::mc_buf_lock_t(mc_transaction_t *transaction) THROWS_NOTHING :
     acquired(false),
     snapshotted(transaction->snapshotted),
@@ -727,8 +747,14 @@ void mc_buf_lock_t::acquire_block(mc_inner_buf_t::version_id_t version_to_access
 
             break;
         }
-        case rwi_intent:
-            not_implemented("Locking with intent not supported yet.");
+        case rwi_intent: {
+            // Readers may still be looking at the block, so we may not
+            // touch the data until `upgrade_to_write()` waits them out.
+            rassert(!snapshotted);
+            data = inner_buf->data.get();
+            rassert(data != NULL);
+            break;
+        }
         case rwi_upgrade:
         default:
             unreachable();
@@ -741,6 +767,26 @@ void mc_buf_lock_t::acquire_block(mc_inner_buf_t::version_id_t version_to_access
     inner_buf->cache->assert_thread();
 }
 
+void mc_buf_lock_t::upgrade_to_write() {
+    assert_thread();
+    guarantee(acquired);
+    if (mode == rwi_write) {
+        return;
+    }
+    rassert(mode == rwi_intent);
+    inner_buf->cache->assert_thread();
+
+    ticks_t lock_start_time;
+    inner_buf->cache->stats->pm_bufs_acquiring.begin(&lock_start_time);
+    inner_buf->lock.co_lock(rwi_upgrade);
+    inner_buf->cache->stats->pm_bufs_acquiring.end(&lock_start_time);
+
+    // Now that nobody else is reading the block, take it the same way a
+    // `rwi_write` acquisition would have.
+    mode = rwi_write;
+    acquire_block(parent_transaction ? parent_transaction->snapshot_version : mc_inner_buf_t::faux_version_id);
+}
+
 void mc_buf_lock_t::swap(mc_buf_lock_t& swapee) {
     assert_thread();
     swapee.assert_thread();
@@ -777,7 +823,9 @@ block_id_t mc_buf_lock_t::get_block_id() const {
 }
 
 void mc_buf_lock_t::touch_recency(repli_timestamp_t timestamp) {
-    rassert(mode == rwi_write);
+    // Bumping the subtree recency doesn't touch the block's data, so it's
+    // fine to do it while readers still share the block with us.
+    rassert(mode == rwi_write || mode == rwi_intent);
 
     // Some operations acquire in write mode but should not
     // actually affect subtree recency.  For example, delete
@@ -1028,7 +1076,11 @@ void mc_buf_lock_t::release() {
             }
             break;
         }
-        case rwi_intent:
+        case rwi_intent: {
+            inner_buf->lock.unlock_intent();
+            rassert(inner_buf->data.equals(data));
+            break;
+        }
         case rwi_upgrade:
         default:
             unreachable("Unexpected mode.");
@@ -1083,6 +1135,8 @@ mc_transaction_t::mc_transaction_t(mc_cache_t *_cache, access_t _access, int _ex
       snapshotted(false),
       cache_account(NULL),
       num_buf_locks_acquired(0),
+      num_blocks_acquired(0),
+      num_blocks_read_from_disk(0),
       is_writeback_transaction(false) {
     block_pm_duration start_timer(&cache->stats->pm_transactions_starting);
 
@@ -1112,6 +1166,8 @@ mc_transaction_t::mc_transaction_t(mc_cache_t *_cache, access_t _access, UNUSED
     snapshotted(false),
     cache_account(NULL),
     num_buf_locks_acquired(0),
+    num_blocks_acquired(0),
+    num_blocks_read_from_disk(0),
     is_writeback_transaction(false) {
     block_pm_duration start_timer(&cache->stats->pm_transactions_starting);
     rassert(access == rwi_read || access == rwi_read_sync);
@@ -1134,6 +1190,8 @@ mc_transaction_t::mc_transaction_t(mc_cache_t *_cache, access_t _access, UNUSED
     snapshotted(false),
     cache_account(NULL),
     num_buf_locks_acquired(0),
+    num_blocks_acquired(0),
+    num_blocks_read_from_disk(0),
     is_writeback_transaction(true) {
     block_pm_duration start_timer(&cache->stats->pm_transactions_starting);
     rassert(access == rwi_read || access == rwi_read_sync);
@@ -1273,13 +1331,25 @@ mc_cache_account_t::~mc_cache_account_t() {
  */
 
 void mc_cache_t::create(serializer_t *serializer, mirrored_cache_static_config_t *config) {
-    /* Initialize config block and differential log */
+    on_thread_t switcher(serializer->home_thread());
 
-    patch_disk_storage_t::create(serializer, MC_CONFIGBLOCK_ID, config);
+    /* Write the config block */
 
-    /* Write an empty superblock */
+    void *config_data = serializer->malloc();
+    // The rest of the block goes to disk too.
+    memset(config_data, 0, serializer->get_block_size().value());
+    mc_config_block_t *c = new (config_data) mc_config_block_t();
+    c->magic = mc_config_block_t::expected_magic;
+    c->cache = *config;
 
-    on_thread_t switcher(serializer->home_thread());
+    index_write_op_t config_op(MC_CONFIGBLOCK_ID);
+    config_op.token = serializer->block_write(c, MC_CONFIGBLOCK_ID, DEFAULT_DISK_ACCOUNT);
+    config_op.recency = repli_timestamp_t::invalid;
+    serializer_index_write(serializer, config_op, DEFAULT_DISK_ACCOUNT);
+
+    serializer->free(c);
+
+    /* Write an empty superblock */
 
     void *superblock = serializer->malloc();
     bzero(superblock, serializer->get_block_size().value());
@@ -1330,12 +1400,24 @@ mc_cache_t::mc_cache_t(serializer_t *_serializer,
     writebacks_allowed = false;
 #endif
 
-    /* Load differential log from disk */
-    patch_disk_storage.init(new patch_disk_storage_t(this, MC_CONFIGBLOCK_ID));
-    patch_disk_storage->load_patches(&patch_memory_storage);
+    /* Check the config block. Patches used to go to a log in the blocks after it; now they
+    are in the serializer's delta records, and we can't read a database that has a log. */
+    int32_t n_patch_log_blocks;
+    {
+        on_thread_t switcher(serializer->home_thread());
+        mc_config_block_t *config_block = reinterpret_cast<mc_config_block_t *>(serializer->malloc());
+        serializer->block_read(serializer->index_read(MC_CONFIGBLOCK_ID), config_block, DEFAULT_DISK_ACCOUNT);
+        guarantee(mc_config_block_t::expected_magic == config_block->magic, "Invalid mirrored cache config block magic");
+        n_patch_log_blocks = config_block->cache.n_patch_log_blocks;
+        serializer->free(config_block);
+    }
+    if (n_patch_log_blocks != 0) {
+        fail_due_to_user_error("This database keeps buffer patches in an on-disk patch log of %d blocks, "
+                               "which is no longer supported. Export its data with the version that created "
+                               "it and import it into a new database.", n_patch_log_blocks);
+    }
 
     /* Please note: writebacks must *not* happen prior to this point! */
-    /* Writebacks ( / syncs / flushes) can cause blocks to be rewritten and require an intact patch_memory_storage! */
 #ifndef NDEBUG
     writebacks_allowed = true;
 #endif
@@ -1344,10 +1426,6 @@ mc_cache_t::mc_cache_t(serializer_t *_serializer,
     serializer->register_read_ahead_cb(this);
     read_ahead_registered = true;
 
-    /* We may have made a lot of blocks dirty by initializing the patch log. We need to start
-    a sync explicitly because it bypassed transaction_t. */
-    writeback.sync(NULL);
-
     /* Init the stat system with the block size */
     stats->pm_block_size.block_size = get_block_size().ser_value();
 }
@@ -1389,10 +1467,6 @@ mc_cache_t::~mc_cache_t() {
     } sync_cb;
     if (!writeback.sync(&sync_cb)) sync_cb.wait();
 
-    /* Must destroy patch_disk_storage before we delete bufs because it uses the buf mechanism
-    to hold the differential log. */
-    patch_disk_storage.reset();
-
     /* Delete all the buffers */
     while (evictable_t *buf = page_repl.get_first_buf()) {
         // TODO(rntz) check that buf is actually a mc_inner_buf_t
@@ -3,7 +3,9 @@
 #define BUFFER_CACHE_MIRRORED_MIRRORED_HPP_
 
 #include <algorithm>
+#include <list>
 #include <map>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -21,7 +23,6 @@
 #include "buffer_cache/mirrored/config.hpp"
 #include "buffer_cache/buf_patch.hpp"
 #include "buffer_cache/mirrored/patch_memory_storage.hpp"
-#include "buffer_cache/mirrored/patch_disk_storage.hpp"
 #include "buffer_cache/mirrored/stats.hpp"
 #include "repli_timestamp.hpp"
 
@@ -49,7 +50,6 @@ class mc_inner_buf_t : public evictable_t,
     friend class writeback_t::local_buf_t;
     friend class page_repl_random_t;
     friend class array_map_t;
-    friend class patch_disk_storage_t;
 
     typedef uint64_t version_id_t;
 
@@ -94,7 +94,8 @@ class mc_inner_buf_t : public evictable_t,
     void release_snapshot_data(void *data);
 
 private:
-    // Helper function for inner_buf construction from an existing block
+    // Helper functions for inner_buf construction from an existing block
+    void load_delta_record(const std::string &delta);
     void replay_patches();
 
     // Our block's block id.
@@ -153,9 +154,6 @@ public:
     mc_buf_lock_t();
     ~mc_buf_lock_t();
 
-    // Special construction for patch_disk_storage_t
-    static mc_buf_lock_t * acquire_non_locking_lock(mc_cache_t *cache, const block_id_t block_id);
-
     // Swaps this mc_buf_lock_t with another, thus obeying RAII since one
     // mc_buf_lock_t owns up to one mc_inner_buf_t at a time.
     void swap(mc_buf_lock_t& swapee);
@@ -169,6 +167,11 @@ public:
 
     bool is_acquired() const;
 
+    // Turns an `rwi_intent` lock into an `rwi_write` lock, blocking until
+    // the readers that share the block with us are gone. Does nothing if we
+    // already hold the block for writing.
+    void upgrade_to_write();
+
     // Get the data buffer for reading
     const void *get_data_read() const;
     // Use this only for writes which affect a large part of the block, as it bypasses the diff system
@@ -266,6 +269,11 @@ public:
 
     void set_account(mc_cache_account_t *cache_account);
 
+    // How many blocks this transaction has acquired so far, and how many of
+    // those weren't in the cache and had to be read from disk.
+    int64_t get_num_blocks_acquired() const { return num_blocks_acquired; }
+    int64_t get_num_blocks_read_from_disk() const { return num_blocks_read_from_disk; }
+
 private:
     void register_buf_snapshot(mc_inner_buf_t *inner_buf, mc_inner_buf_t::buf_snapshot_t *snap);
 
@@ -291,6 +299,9 @@ private:
 
     int64_t num_buf_locks_acquired;
 
+    int64_t num_blocks_acquired;
+    int64_t num_blocks_read_from_disk;
+
     bool is_writeback_transaction;
 
     DISABLE_COPYING(mc_transaction_t);
@@ -308,6 +319,15 @@ private:
     DISABLE_COPYING(mc_cache_account_t);
 };
 
+/* The cache's part of the serializer config block, stored in block MC_CONFIGBLOCK_ID. */
+struct mc_config_block_t {
+    block_magic_t magic;
+
+    mirrored_cache_static_config_t cache;
+
+    static const block_magic_t expected_magic;
+};
+
 class mc_cache_t : public home_thread_mixin_t, public serializer_read_ahead_callback_t {
     friend class mc_inner_buf_t;
     friend class mc_buf_lock_t;
@@ -317,7 +337,6 @@ class mc_cache_t : public home_thread_mixin_t, public serializer_read_ahead_call
     friend class page_repl_random_t;
     friend class evictable_t;
     friend class array_map_t;
-    friend class patch_disk_storage_t;
 
 public:
     typedef mc_buf_lock_t buf_lock_type;
@@ -414,11 +433,11 @@ private:
 
     cond_t *to_pulse_when_last_transaction_commits;
 
+    /* Patches that haven't been applied to the on-disk version of their block yet. They are
+    written to the serializer as the block's delta record, and read back from there when the
+    block gets loaded again, so we only keep them for blocks that are in memory. */
     patch_memory_storage_t patch_memory_storage;
 
-    // Pointer, not member, because we need to call its destructor explicitly in our destructor
-    scoped_ptr_t<patch_disk_storage_t> patch_disk_storage;
-
     // The ratio of block size to patch size (for some block id, at
     // some point in time) at which we think it's worth it to flush
     // the whole block and drop the patch history.
@@ -34,14 +34,17 @@ mc_cache_stats_t::mc_cache_stats_t(perfmon_collection_t *parent)
       pm_transactions_starting(secs_to_ticks(1)),
       pm_transactions_active(secs_to_ticks(1)),
       pm_transactions_committing(secs_to_ticks(1)),
-      pm_flushes_diff_flush(secs_to_ticks(1)),
       pm_flushes_diff_store(secs_to_ticks(1)),
       pm_flushes_locking(secs_to_ticks(1)),
       pm_flushes_writing(secs_to_ticks(1)),
+      pm_write_throttle_delay(secs_to_ticks(1)),
+      pm_write_throttle_hard_limit(secs_to_ticks(1)),
+      pm_flush_bandwidth(secs_to_ticks(5), false),
+      pm_dirty_rate(secs_to_ticks(5), false),
       pm_flushes_blocks(secs_to_ticks(1), true),
       pm_flushes_blocks_dirty(secs_to_ticks(1), true),
       pm_flushes_diff_patches_stored(secs_to_ticks(1), false),
-      pm_flushes_diff_storage_failures(secs_to_ticks(30), true),
+      pm_flushes_delta_merges(secs_to_ticks(1), true),
       pm_n_blocks_in_memory(),
       pm_n_blocks_dirty(),
       pm_n_blocks_total(),
@@ -60,14 +63,17 @@ mc_cache_stats_t::mc_cache_stats_t(perfmon_collection_t *parent)
           &pm_transactions_starting, "transactions_starting",
           &pm_transactions_active, "transactions_active",
           &pm_transactions_committing, "transactions_committing",
-          &pm_flushes_diff_flush, "flushes_diff_flushing",
           &pm_flushes_diff_store, "flushes_diff_store",
           &pm_flushes_locking, "flushes_locking",
           &pm_flushes_writing, "flushes_writing",
+          &pm_write_throttle_delay, "write_throttle_delay",
+          &pm_write_throttle_hard_limit, "write_throttle_hard_limit",
+          &pm_flush_bandwidth, "flush_bandwidth",
+          &pm_dirty_rate, "dirty_rate",
           &pm_flushes_blocks, "flushes_blocks",
           &pm_flushes_blocks_dirty, "flushes_blocks_need_flush",
           &pm_flushes_diff_patches_stored, "flushes_diff_patches_stored",
-          &pm_flushes_diff_storage_failures, "flushes_diff_storage_failures",
+          &pm_flushes_delta_merges, "flushes_delta_merges",
           &pm_n_blocks_in_memory, "blocks_in_memory",
           &pm_n_blocks_dirty, "blocks_dirty",
           &pm_n_blocks_total, "blocks_total",
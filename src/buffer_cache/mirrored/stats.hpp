@@ -35,16 +35,26 @@ struct mc_cache_stats_t {
 
     /* Used in writeback.hpp */
     perfmon_duration_sampler_t
-        pm_flushes_diff_flush,
         pm_flushes_diff_store,
         pm_flushes_locking,
         pm_flushes_writing;
 
+    /* Time write transactions spend being paced by `write_throttle_t`, and
+    time they spend blocked on the hard dirty block limit. */
+    perfmon_duration_sampler_t
+        pm_write_throttle_delay,
+        pm_write_throttle_hard_limit;
+
+    /* In blocks per second. */
+    perfmon_sampler_t
+        pm_flush_bandwidth,
+        pm_dirty_rate;
+
     perfmon_sampler_t
         pm_flushes_blocks,
         pm_flushes_blocks_dirty,
         pm_flushes_diff_patches_stored,
-        pm_flushes_diff_storage_failures;
+        pm_flushes_delta_merges;
 
     perfmon_counter_t
         pm_n_blocks_in_memory,
@@ -0,0 +1,85 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "buffer_cache/mirrored/write_throttle.hpp"
+
+#include <algorithm>
+
+// How long we count dirtied blocks for before folding the count into the
+// dirty rate estimate.
+#define DIRTY_RATE_WINDOW_MS 100
+
+// How much weight a new measurement gets in the running estimates.
+#define ESTIMATE_SMOOTHING 0.3
+
+static double smooth(double estimate, double measurement) {
+    if (estimate == 0) {
+        return measurement;
+    }
+    return ESTIMATE_SMOOTHING * measurement + (1 - ESTIMATE_SMOOTHING) * estimate;
+}
+
+write_throttle_t::write_throttle_t(unsigned int _max_dirty_blocks, double _throttle_fraction, ticks_t _max_delay)
+    : max_dirty_blocks(_max_dirty_blocks), throttle_fraction(_throttle_fraction), max_delay(_max_delay),
+      flush_bandwidth(0), dirty_rate(0), dirtied_in_window(0), window_start(0), next_admission(0) {
+    rassert(max_dirty_blocks > 0);
+    rassert(throttle_fraction >= 0 && throttle_fraction < 1);
+}
+
+void write_throttle_t::on_blocks_dirtied(int64_t n, ticks_t now) {
+    if (window_start == 0) {
+        window_start = now;
+    }
+    dirtied_in_window += n;
+    if (now - window_start >= secs_to_ticks(DIRTY_RATE_WINDOW_MS / 1000.0)) {
+        dirty_rate = smooth(dirty_rate, dirtied_in_window / ticks_to_secs(now - window_start));
+        dirtied_in_window = 0;
+        window_start = now;
+    }
+}
+
+void write_throttle_t::on_flush_finished(int64_t n, ticks_t duration) {
+    if (n <= 0 || duration == 0) {
+        return;
+    }
+    flush_bandwidth = smooth(flush_bandwidth, n / ticks_to_secs(duration));
+}
+
+ticks_t write_throttle_t::admit(unsigned int dirty_blocks, int expected_change_count, ticks_t now) {
+    ticks_t start = std::max(now, next_admission);
+    start = std::min(start, now + max_delay);
+
+    double fill = static_cast<double>(dirty_blocks) / max_dirty_blocks;
+    if (flush_bandwidth == 0 || fill <= throttle_fraction) {
+        next_admission = start;
+        return start;
+    }
+
+    /* `pressure` goes from 0 where throttling starts to 1 at the hard limit.
+    We let writers dirty blocks at `flush_bandwidth * (1 - pressure) /
+    pressure`: much faster than we can flush at first, exactly as fast halfway
+    to the limit, and not at all at the limit. So under a sustained load the
+    number of dirty blocks settles halfway between the two, and writers never
+    pile up against the hard limit. */
+    double pressure = std::min(1.0, (fill - throttle_fraction) / (1 - throttle_fraction));
+    ticks_t delay;
+    if (pressure >= 1) {
+        delay = max_delay;
+    } else {
+        double secs = std::max(expected_change_count, 1) * pressure / ((1 - pressure) * flush_bandwidth);
+        delay = std::min(max_delay, secs_to_ticks(secs));
+    }
+    next_admission = start + delay;
+    return start;
+}
+
+bool write_throttle_t::should_flush_early(unsigned int dirty_blocks) const {
+    if (dirty_blocks == 0 || dirty_rate == 0 || flush_bandwidth == 0) {
+        return false;
+    }
+    double throttle_point = throttle_fraction * max_dirty_blocks;
+    if (dirty_blocks >= throttle_point) {
+        return true;
+    }
+    double secs_until_throttled = (throttle_point - dirty_blocks) / dirty_rate;
+    double secs_to_flush = dirty_blocks / flush_bandwidth;
+    return secs_until_throttled <= secs_to_flush;
+}
@@ -0,0 +1,63 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef BUFFER_CACHE_MIRRORED_WRITE_THROTTLE_HPP_
+#define BUFFER_CACHE_MIRRORED_WRITE_THROTTLE_HPP_
+
+#include <stdint.h>
+
+#include "utils.hpp"
+
+/* Paces write transactions so that the rate at which they dirty blocks
+smoothly approaches the rate at which flushes clean them as the number of
+dirty blocks grows, instead of letting writers run at full speed until they
+hit the dirty block limit and then stopping all of them until a flush
+finishes. It also predicts when the dirty blocks will reach the point where
+throttling kicks in, so that writeback can get a flush going before then.
+
+The controller only does the arithmetic; `writeback_t` feeds it and acts on
+what it says. Everything takes the current time as an argument so that it can
+be tested without waiting. */
+class write_throttle_t {
+public:
+    write_throttle_t(unsigned int _max_dirty_blocks, double _throttle_fraction, ticks_t _max_delay);
+
+    /* Called when `n` blocks become dirty. */
+    void on_blocks_dirtied(int64_t n, ticks_t now);
+
+    /* Called when a flush that wrote `n` blocks finishes; `duration` is how
+    long it took from sending the writes until they were all on disk. */
+    void on_flush_finished(int64_t n, ticks_t duration);
+
+    /* Returns when a write transaction that expects to change
+    `expected_change_count` blocks may start, given that it arrives at `now`
+    while `dirty_blocks` blocks are dirty. Transactions are admitted one after
+    the other at the pace the flushes can sustain, so the return value may be
+    later than what this transaction alone would have to wait. */
+    ticks_t admit(unsigned int dirty_blocks, int expected_change_count, ticks_t now);
+
+    /* True if, at the rate blocks are being dirtied, they will reach the point
+    where we start throttling before a flush of the current dirty blocks could
+    finish. */
+    bool should_flush_early(unsigned int dirty_blocks) const;
+
+    /* The current estimates, in blocks per second; 0 until we know. */
+    double get_flush_bandwidth() const { return flush_bandwidth; }
+    double get_dirty_rate() const { return dirty_rate; }
+
+private:
+    const unsigned int max_dirty_blocks;
+    const double throttle_fraction;
+    const ticks_t max_delay;
+
+    double flush_bandwidth;
+
+    double dirty_rate;
+    int64_t dirtied_in_window;
+    ticks_t window_start;
+
+    /* When the last admitted transaction was allowed to start. */
+    ticks_t next_admission;
+
+    DISABLE_COPYING(write_throttle_t);
+};
+
+#endif  // BUFFER_CACHE_MIRRORED_WRITE_THROTTLE_HPP_
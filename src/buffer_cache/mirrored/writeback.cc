@@ -3,6 +3,9 @@
 
 #include <math.h>
 
+#include <map>
+#include <string>
+
 #include "errors.hpp"
 #include <boost/bind.hpp>
 
@@ -35,7 +38,9 @@ writeback_t::writeback_t(
     writeback_in_progress(false),
     active_flushes(0),
     dirty_block_semaphore(_max_dirty_blocks),
-    force_patch_storage_flush(false),
+    throttle(_max_dirty_blocks, WRITEBACK_THROTTLE_AT_FRACTION_OF_UNSAVED_DATA_LIMIT,
+             secs_to_ticks(WRITEBACK_MAX_THROTTLE_DELAY_MS / 1000.0)),
+    blocks_dirtied_since_commit(0),
     cache(_cache),
     start_next_sync_immediately(false),
     to_pulse_when_last_active_flush_finishes(NULL) {
@@ -94,8 +99,25 @@ void writeback_t::begin_transaction(transaction_t *txn) {
 
     if (txn->get_access() == rwi_write) {
 
-        /* Throttling */
+        /* Throttling. First we wait our turn according to how fast the
+        flushes are cleaning blocks, which is usually zero unless a lot of
+        blocks are dirty. Then the dirty block semaphore enforces the hard
+        limit. The timer can't wait for less than `TIMER_TICKS_IN_MS`, so
+        shorter delays are skipped; since the throttle schedules transactions
+        one after the other, the next one waits for them instead. Don't use
+        the perfmon's start time for this: it's zero unless full perfmon is on. */
+        ticks_t start_time;
+        cache->stats->pm_write_throttle_delay.begin(&start_time);
+        ticks_t now = get_ticks();
+        ticks_t admitted = throttle.admit(num_dirty_blocks(), txn->expected_change_count, now);
+        if (admitted >= now + secs_to_ticks(TIMER_TICKS_IN_MS / 1000.0)) {
+            nap((admitted - now) / 1000000);
+        }
+        cache->stats->pm_write_throttle_delay.end(&start_time);
+
+        cache->stats->pm_write_throttle_hard_limit.begin(&start_time);
         dirty_block_semaphore.co_lock(txn->expected_change_count);
+        cache->stats->pm_write_throttle_hard_limit.end(&start_time);
 
         /* Acquire flush lock in non-exclusive mode */
         flush_lock.co_lock(rwi_read);
@@ -125,6 +147,11 @@ void writeback_t::on_transaction_commit(transaction_t *txn) {
 
         flush_lock.unlock();
 
+        if (blocks_dirtied_since_commit > 0) {
+            throttle.on_blocks_dirtied(blocks_dirtied_since_commit, get_ticks());
+            blocks_dirtied_since_commit = 0;
+        }
+
         /* At the end of every write transaction, check if the number of dirty blocks exceeds the
         threshold to force writeback to start. */
         if (num_dirty_blocks() > flush_threshold) {
@@ -133,6 +160,10 @@ void writeback_t::on_transaction_commit(transaction_t *txn) {
             sync(NULL);
         } else if (sync_callbacks.size() >= flush_waiting_threshold) {
             sync(NULL);
+        } else if (throttle.should_flush_early(num_dirty_blocks())) {
+            /* Blocks are being dirtied fast enough that writers would start
+            getting throttled before a flush started now could finish. */
+            sync(NULL);
         }
 
         if (!flush_timer && !flush_time_randomizer.is_never_flush() && !flush_time_randomizer.is_zero()) {
@@ -152,6 +183,7 @@ void writeback_t::local_buf_t::set_dirty(bool _dirty) {
             gbuf->cache->writeback.dirty_bufs.push_back(this);
             /* Use `force_lock()` to prevent deadlocks; `co_lock()` could block. */
             gbuf->cache->writeback.dirty_block_semaphore.force_lock();
+            ++gbuf->cache->writeback.blocks_dirtied_since_commit;
         }
         ++gbuf->cache->stats->pm_n_blocks_dirty;
     }
@@ -321,6 +353,11 @@ struct writeback_t::flush_state_t {
     std::vector<buf_writer_t *> buf_writers;
     // Writes to submit to the serializer
     std::vector<serializer_write_t> serializer_writes;
+    // The delta records of the blocks whose patches we write instead of the blocks themselves
+    std::map<block_id_t, std::string> delta_records;
+    // Keeps those blocks in memory until their delta records are on disk, so that nobody
+    // reloads one and replays the delta record it had before this flush.
+    std::vector<buf_lock_t *> delta_bufs;
     flush_state_t() : block_sequence_ids_have_been_updated(false) {}
 };
 
@@ -342,19 +379,6 @@ void writeback_t::do_concurrent_flush() {
     cache->stats->pm_flushes_locking.begin(&start_time);
     cache->assert_thread();
 
-    // As we cannot afford waiting for blocks to get loaded from disk while holding the flush lock,
-    // we instead reclaim some space in the on-disk patch storage now.
-    ticks_t start_time2;
-    cache->stats->pm_flushes_diff_flush.begin(&start_time2);
-    // TODO: What are these magic constants doing here?
-    unsigned int blocks_to_flush = uint64_t(dirty_bufs.size()) * 100LL / cache->get_block_size().value() + 1;
-    if (force_patch_storage_flush) {
-        blocks_to_flush = std::max(cache->patch_disk_storage->get_number_of_log_blocks() / 20 + 1, blocks_to_flush);
-        force_patch_storage_flush = false;
-    }
-    cache->patch_disk_storage->clear_n_oldest_blocks(blocks_to_flush);
-    cache->stats->pm_flushes_diff_flush.end(&start_time2);
-
     /* Start a read transaction so we can request bufs. */
     transaction_t *transaction;
     {
@@ -387,12 +411,13 @@ void writeback_t::do_concurrent_flush() {
         start_next_sync_immediately = false;
 
         // Go through the different flushing steps...
-        flush_prepare_patches();
+        flush_prepare_patches(&state);
         cache->stats->pm_flushes_writing.begin(&start_time);
         flush_acquire_bufs(transaction, &state);
     }
 
     // Now that preparations are complete, send the writes to the serializer
+    ticks_t writes_start_time = get_ticks();
     if (!state.serializer_writes.empty()) {
         on_thread_t switcher(cache->serializer->home_thread());
         do_writes(cache->serializer, state.serializer_writes, cache->writes_io_account.get());
@@ -415,6 +440,13 @@ void writeback_t::do_concurrent_flush() {
     }
     state.serializer_writes.clear();
 
+    // The delta records are on disk now, so the blocks can go.
+    for (size_t i = 0; i < state.delta_bufs.size(); ++i) {
+        delete state.delta_bufs[i];
+    }
+    state.delta_bufs.clear();
+    state.delta_records.clear();
+
     // Wait for block sequence ids to be updated.
     for (size_t i = 0; i < state.buf_writers.size(); ++i)
         state.buf_writers[i]->launch_cb.wait_until_sequence_ids_updated();
@@ -433,6 +465,11 @@ void writeback_t::do_concurrent_flush() {
         state.buf_writers[i]->wait_for_finish();
         delete state.buf_writers[i];
     }
+    if (!state.buf_writers.empty()) {
+        throttle.on_flush_finished(state.buf_writers.size(), get_ticks() - writes_start_time);
+        cache->stats->pm_flush_bandwidth.record(throttle.get_flush_bandwidth());
+        cache->stats->pm_dirty_rate.record(throttle.get_dirty_rate());
+    }
     state.buf_writers.clear();
     delete transaction;
 
@@ -469,79 +506,50 @@ void writeback_t::do_concurrent_flush() {
     }
 }
 
-void writeback_t::flush_prepare_patches() {
+void writeback_t::flush_prepare_patches(flush_state_t *state) {
     rassert(writeback_in_progress);
 
-    /* Write patches for blocks we don't want to flush now */
-    // Please note: Writing patches to the oocore_storage can still alter the dirty_bufs list!
-    // (because some of the patch storage blocks will become dirty)
-    // The iteration below doesn't have a problem with that, but be careful if you
-    // want to change it.
+    /* Build delta records for blocks we don't want to flush now. A block's delta record
+    replaces the one it had before, so it holds all of the block's patches, not just the ones
+    that came in since the last flush. */
     ticks_t start_time2;
     cache->stats->pm_flushes_diff_store.begin(&start_time2);
-    bool patch_storage_failure = false;
     unsigned int patches_stored = 0;
+    unsigned int merges = 0;
     for (local_buf_t *lbuf = dirty_bufs.head(); lbuf; lbuf = dirty_bufs.next(lbuf)) {
         inner_buf_t *inner_buf = static_cast<inner_buf_t *>(lbuf);
 
-        // If the patch storage failed before (which usually happens if it ran out of space),
-        // we don't even try to write patches for this buffer. Instead we set needs_flush,
-        // causing the block itself to be written to disk instead of its patches.
-        if (patch_storage_failure && lbuf->get_dirty() && !lbuf->needs_flush()) {
-            lbuf->set_needs_flush(true);
-            cache->patch_memory_storage.drop_patches(inner_buf->block_id);
-        }
-
-        if (!lbuf->needs_flush() && lbuf->get_dirty() && inner_buf->next_patch_counter > 1) {
-            const block_sequence_id_t block_sequence_id = inner_buf->block_sequence_id;
-            if (cache->patch_memory_storage.has_patches_for_block(inner_buf->block_id)) {
-#ifndef NDEBUG
-                patch_counter_t previous_patch_counter = 0;
-#endif
-                std::pair<patch_memory_storage_t::const_patch_iterator, patch_memory_storage_t::const_patch_iterator>
-                    range = cache->patch_memory_storage.patches_for_block(inner_buf->block_id);
-
-                while (range.second != range.first) {
-                    // Why do we write patches in reverse oder?
-                    // Because that way we first get the most recent patches,
-                    // and can then just break out of the loop as soon as we hit
-                    // the first patch that is older than last_patch_materialized.
-                    --range.second;
-
-                    rassert(block_sequence_id > NULL_BLOCK_SEQUENCE_ID);
-                    rassert(previous_patch_counter == 0 || (*range.second)->get_patch_counter() == previous_patch_counter - 1);
-                    // Write only those patches that we have not written in a previous
-                    // writeback. Use lbuf->last_patch_materialized to make
-                    // that decision. This way we never have duplicate patches on disk.
-                    if (lbuf->last_patch_materialized() < (*range.second)->get_patch_counter()) {
-                        if (!cache->patch_disk_storage->store_patch(*range.second, block_sequence_id)) {
-                            patch_storage_failure = true;
-                            // We were not able to store all the patches to disk,
-                            // so we fall back to re-writing the block itself.
-                            lbuf->set_needs_flush(true);
-                            // Dropping the patches invalidates our iterators in range,
-                            // but we can simply break out of the loop at this point.
-                            cache->patch_memory_storage.drop_patches(inner_buf->block_id);
-                            break;
-                        } else {
-                            patches_stored++;
-                        }
-                    } else {
-                        // We hit a patch that we had written to disk before.
-                        // Because we are iterating over patches from most recent to older,
-                        // we can just break out of the loop at this point.
-                        break;
+        if (!lbuf->needs_flush() && lbuf->get_dirty() && inner_buf->next_patch_counter > 1
+            && cache->patch_memory_storage.has_patches_for_block(inner_buf->block_id)) {
+            std::pair<patch_memory_storage_t::const_patch_iterator, patch_memory_storage_t::const_patch_iterator>
+                range = cache->patch_memory_storage.patches_for_block(inner_buf->block_id);
+
+            if (range.second - range.first > MAX_DELTA_RECORD_PATCHES) {
+                // Every load of the block would have to replay all of these. Write the block
+                // itself instead, which merges them into it.
+                lbuf->set_needs_flush(true);
+                cache->patch_memory_storage.drop_patches(inner_buf->block_id);
+                ++merges;
+            } else if (lbuf->last_patch_materialized() < (*(range.second - 1))->get_patch_counter()) {
+                const block_sequence_id_t block_sequence_id = inner_buf->block_sequence_id;
+                rassert(block_sequence_id > NULL_BLOCK_SEQUENCE_ID);
+
+                std::string *record = &state->delta_records[inner_buf->block_id];
+                record->resize(cache->patch_memory_storage.get_patches_serialized_size(inner_buf->block_id));
+                size_t offset = 0;
+                for (patch_memory_storage_t::const_patch_iterator p = range.first; p != range.second; ++p) {
+                    if ((*p)->get_block_sequence_id() == NULL_BLOCK_SEQUENCE_ID) {
+                        (*p)->set_block_sequence_id(block_sequence_id);
+                    }
+                    if (lbuf->last_patch_materialized() < (*p)->get_patch_counter()) {
+                        ++patches_stored;
                     }
-#ifndef NDEBUG
-                    previous_patch_counter = (*range.second)->get_patch_counter();
-#endif
+                    (*p)->serialize(&(*record)[offset]);
+                    offset += (*p)->get_serialized_size();
                 }
+                rassert(offset == record->size());
 
-                if (!patch_storage_failure) {
-                    lbuf->set_last_patch_materialized(cache->patch_memory_storage.last_patch_materialized_or_zero(inner_buf->block_id));
-                }
-                // (if there was a patch_storage_failure, lbuf->needs_flush got set
-                // and we are going to reset last_patch_materialized a few lines later...)
+                lbuf->set_last_patch_materialized(cache->patch_memory_storage.last_patch_materialized_or_zero(inner_buf->block_id));
             }
         }
 
@@ -557,12 +565,9 @@ void writeback_t::flush_prepare_patches() {
         }
     }
     cache->stats->pm_flushes_diff_store.end(&start_time2);
-    if (patch_storage_failure)
-        force_patch_storage_flush = true; // Make sure we resolve the storage space shortage before the next flush...
 
     cache->stats->pm_flushes_diff_patches_stored.record(patches_stored);
-    if (patch_storage_failure)
-        cache->stats->pm_flushes_diff_storage_failures.record(patches_stored);
+    cache->stats->pm_flushes_delta_merges.record(merges);
 }
 
 void writeback_t::flush_acquire_bufs(transaction_t *transaction, flush_state_t *state) {
@@ -616,6 +621,15 @@ void writeback_t::flush_acquire_bufs(transaction_t *transaction, flush_state_t *
                                                 buf->get_data_read(),
                                                 buf_writer,
                                                 &buf_writer->launch_cb));
+        } else if (state->delta_records.count(inner_buf->block_id) > 0) {
+            {
+                ASSERT_NO_CORO_WAITING;
+                state->delta_bufs.push_back(new buf_lock_t(transaction, inner_buf->block_id, rwi_read_outdated_ok));
+            }
+            state->serializer_writes.push_back(
+                serializer_write_t::make_delta(inner_buf->block_id,
+                                               inner_buf->subtree_recency,
+                                               &state->delta_records[inner_buf->block_id]));
         } else if (recency_dirty) {
             // No need to acquire the block, since we're only writing its recency & don't need its contents.
             state->serializer_writes.push_back(serializer_write_t::make_touch(inner_buf->block_id, inner_buf->subtree_recency));
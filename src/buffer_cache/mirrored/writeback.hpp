@@ -9,6 +9,7 @@
 #include "concurrency/semaphore.hpp"
 #include "buffer_cache/buf_patch.hpp"
 #include "buffer_cache/mirrored/flush_time_randomizer.hpp"
+#include "buffer_cache/mirrored/write_throttle.hpp"
 #include "utils.hpp"
 
 class cond_t;
@@ -121,7 +122,13 @@ private:
     /* Use `adjustable_semaphore_t` instead of `semaphore_t` so we can get `force_lock()`. */
     adjustable_semaphore_t dirty_block_semaphore;
 
-    bool force_patch_storage_flush;
+    /* Slows write transactions down before they run into `dirty_block_semaphore`
+    and tells us when to flush ahead of `flush_threshold`. */
+    write_throttle_t throttle;
+
+    /* Blocks that became dirty since the last write transaction committed; we
+    pass them on to `throttle` once per transaction rather than once per block. */
+    int64_t blocks_dirtied_since_commit;
 
     cache_t *cache;
 
@@ -179,7 +186,7 @@ private:
     struct flush_state_t;
     void start_concurrent_flush();
     void do_concurrent_flush();
-    void flush_prepare_patches();
+    void flush_prepare_patches(flush_state_t *state);
     void flush_acquire_bufs(transaction_t *transaction, flush_state_t *state);
 };
 
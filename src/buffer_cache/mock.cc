@@ -84,12 +84,26 @@ void mock_buf_lock_t::mark_deleted() {
 }
 
 void mock_buf_lock_t::touch_recency(repli_timestamp_t timestamp) {
-    rassert(access == rwi_write);
+    rassert(access == rwi_write || access == rwi_intent);
     internal_buf->subtree_recency = timestamp;
 }
 
+void mock_buf_lock_t::upgrade_to_write() {
+    rassert(acquired);
+    if (access == rwi_write) {
+        return;
+    }
+    rassert(access == rwi_intent);
+    internal_buf->lock.co_lock(rwi_upgrade);
+    access = rwi_write;
+}
+
 void mock_buf_lock_t::release() {
-    internal_buf->lock.unlock();
+    if (access == rwi_intent) {
+        internal_buf->lock.unlock_intent();
+    } else {
+        internal_buf->lock.unlock();
+    }
     if (deleted) internal_buf->destroy();
     acquired = false;
 }
@@ -122,9 +136,10 @@ mock_buf_lock_t::mock_buf_lock_t(mock_transaction_t *txn, block_id_t block_id, a
     acquired(true)
 {
     assert_thread();
-    rassert(mode != rwi_write || txn->access == rwi_write);
+    rassert(is_read_mode(mode) || txn->access == rwi_write);
     rassert(block_id < txn->cache->bufs->get_size());
     rassert(internal_buf);
+    ++txn->num_blocks_acquired;
 
     internal_buf->lock.co_lock(mode == rwi_read_outdated_ok ? rwi_read : mode, call_when_in_line);
 
@@ -167,8 +182,8 @@ void mock_transaction_t::get_subtree_recencies(block_id_t *block_ids, size_t num
 }
 
 mock_transaction_t::mock_transaction_t(mock_cache_t *_cache, access_t _access, UNUSED int expected_change_count, repli_timestamp_t _recency_timestamp, order_token_t _order_token)
-    : cache(_cache), order_token(_order_token), access(_access), recency_timestamp(_recency_timestamp),
-      keepalive(_cache->transaction_counter.get()) {
+    : cache(_cache), order_token(_order_token), access(_access), num_blocks_acquired(0),
+      recency_timestamp(_recency_timestamp), keepalive(_cache->transaction_counter.get()) {
     coro_fifo_acq_t write_throttle_acq;
     if (is_write_mode(access)) {
         write_throttle_acq.enter(&cache->transaction_constructor_coro_fifo_);
@@ -61,6 +61,7 @@ public:
     void touch_recency(repli_timestamp_t timestamp);
 
     bool is_acquired() const;
+    void upgrade_to_write();
     void ensure_flush();
     bool is_deleted() const;
     repli_timestamp_t get_recency() const;
@@ -101,6 +102,10 @@ public:
 
     void get_subtree_recencies(block_id_t *block_ids, size_t num_block_ids, repli_timestamp_t *recencies_out, get_subtree_recencies_callback_t *cb);
 
+    // Everything is in memory, so nothing is ever read from disk.
+    int64_t get_num_blocks_acquired() const { return num_blocks_acquired; }
+    int64_t get_num_blocks_read_from_disk() const { return 0; }
+
     mock_cache_t *get_cache() const { return cache; }
     mock_cache_t *cache;
 
@@ -111,6 +116,7 @@ private:
     friend class mock_cache_t;
     access_t access;
     int n_bufs;
+    int64_t num_blocks_acquired;
     repli_timestamp_t recency_timestamp;
     auto_drainer_t::lock_t keepalive;
 };
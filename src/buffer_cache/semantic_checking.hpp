@@ -64,6 +64,7 @@ public:
     void touch_recency(repli_timestamp_t timestamp);
 
     bool is_acquired() const;
+    void upgrade_to_write();
     void ensure_flush();
     bool is_deleted() const;
     repli_timestamp_t get_recency() const;
@@ -109,6 +110,9 @@ public:
 
     void get_subtree_recencies(block_id_t *block_ids, size_t num_block_ids, repli_timestamp_t *recencies_out, get_subtree_recencies_callback_t *cb);
 
+    int64_t get_num_blocks_acquired() const { return inner_transaction.get_num_blocks_acquired(); }
+    int64_t get_num_blocks_read_from_disk() const { return inner_transaction.get_num_blocks_read_from_disk(); }
+
     scc_cache_t<inner_cache_t> *get_cache() const { return cache; }
     scc_cache_t<inner_cache_t> *cache;
 
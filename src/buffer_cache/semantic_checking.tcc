@@ -20,6 +20,12 @@ bool scc_buf_lock_t<inner_cache_t>::is_acquired() const {
     return internal_buf_lock->is_acquired();
 }
 
+template<class inner_cache_t>
+void scc_buf_lock_t<inner_cache_t>::upgrade_to_write() {
+    rassert(internal_buf_lock.has());
+    internal_buf_lock->upgrade_to_write();
+}
+
 template<class inner_cache_t>
 void scc_buf_lock_t<inner_cache_t>::release_if_acquired() {
     if (internal_buf_lock->is_acquired()) {
@@ -0,0 +1,41 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "clustering/administration/issues/corrupt_blocks.hpp"
+
+#include <inttypes.h>
+
+#include "errors.hpp"
+#include <boost/bind.hpp>
+
+#include "arch/runtime/coroutines.hpp"
+
+corrupt_block_issue_reporter_t::corrupt_block_issue_reporter_t(local_issue_tracker_t *_issue_tracker, int _issue_tracker_thread,
+                                                               const std::string &_file_name)
+    : issue_tracker(_issue_tracker), issue_tracker_thread(_issue_tracker_thread), file_name(_file_name),
+      drainer(new auto_drainer_t) { }
+
+corrupt_block_issue_reporter_t::~corrupt_block_issue_reporter_t() {
+    drainer.reset();
+    on_thread_t thread_switcher(issue_tracker_thread);
+    issue.reset();
+}
+
+void corrupt_block_issue_reporter_t::on_corrupt_block(block_id_t block_id, off64_t offset) {
+    assert_thread();
+    coro_t::spawn_sometime(boost::bind(&corrupt_block_issue_reporter_t::report, this,
+                                       block_id, offset, auto_drainer_t::lock_t(drainer.get())));
+}
+
+void corrupt_block_issue_reporter_t::report(block_id_t block_id, off64_t offset, auto_drainer_t::lock_t keepalive) {
+    keepalive.assert_is_holding(drainer.get());
+    on_thread_t thread_switcher(issue_tracker_thread);
+    if (!corrupt_offsets.insert(offset).second) {
+        return;
+    }
+    issue.reset();
+    issue.init(new local_issue_tracker_t::entry_t(
+        issue_tracker,
+        local_issue_t("CORRUPT_BLOCK", true,
+                      strprintf("%zu block(s) in '%s' don't match their checksums; the latest is block %u at offset %" PRIi64 ". "
+                                "The data on this machine can't be trusted. Restore the file from a replica.",
+                                corrupt_offsets.size(), file_name.c_str(), block_id, offset))));
+}
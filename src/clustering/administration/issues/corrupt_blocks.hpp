@@ -0,0 +1,45 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef CLUSTERING_ADMINISTRATION_ISSUES_CORRUPT_BLOCKS_HPP_
+#define CLUSTERING_ADMINISTRATION_ISSUES_CORRUPT_BLOCKS_HPP_
+
+#include <set>
+#include <string>
+
+#include "clustering/administration/issues/local.hpp"
+#include "concurrency/auto_drainer.hpp"
+#include "containers/scoped.hpp"
+#include "serializer/log/log_serializer.hpp"
+
+/* Raises a critical local issue when the serializer for `file_name` comes
+across blocks that don't match their checksums. The issue stays up until the
+server restarts: nothing repairs the blocks. Lives on the serializer's thread
+and must outlive the serializer it's registered with. */
+class corrupt_block_issue_reporter_t :
+    public serializer_corruption_callback_t,
+    public home_thread_mixin_t {
+public:
+    corrupt_block_issue_reporter_t(local_issue_tracker_t *issue_tracker, int issue_tracker_thread,
+                                   const std::string &file_name);
+    ~corrupt_block_issue_reporter_t();
+
+    void on_corrupt_block(block_id_t block_id, off64_t offset);
+
+private:
+    void report(block_id_t block_id, off64_t offset, auto_drainer_t::lock_t keepalive);
+
+    local_issue_tracker_t *const issue_tracker;
+    const int issue_tracker_thread;
+    const std::string file_name;
+
+    // These live on the issue tracker's thread. The scrubber finds the same
+    // blocks on every pass, so we remember which ones we've already reported.
+    std::set<off64_t> corrupt_offsets;
+    scoped_ptr_t<local_issue_tracker_t::entry_t> issue;
+
+    // Reset first thing in the destructor, so no report() can race with it.
+    scoped_ptr_t<auto_drainer_t> drainer;
+
+    DISABLE_COPYING(corrupt_block_issue_reporter_t);
+};
+
+#endif  // CLUSTERING_ADMINISTRATION_ISSUES_CORRUPT_BLOCKS_HPP_
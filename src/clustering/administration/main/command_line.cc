@@ -52,6 +52,13 @@ public:
     int port;
 };
 
+/* The disk options of the commands that serve tables. They're bundled up so
+that `boost::bind()` can still cope with `run_rethinkdb_porcelain()`. */
+struct serve_disk_options_t {
+    io_backend_t io_backend;
+    log_serializer_config_t table_file_config;
+};
+
 std::string metadata_file(const std::string& file_path) {
     return file_path + "/metadata";
 }
@@ -196,7 +203,7 @@ void run_rethinkdb_import(extproc::spawner_t::info_t *spawner_info, std::vector<
     }
 }
 
-void run_rethinkdb_serve(extproc::spawner_t::info_t *spawner_info, const std::string &filepath, const std::vector<host_and_port_t> &joins, service_ports_t ports, const io_backend_t io_backend, bool *result_out, std::string web_assets) {
+void run_rethinkdb_serve(extproc::spawner_t::info_t *spawner_info, const std::string &filepath, const std::vector<host_and_port_t> &joins, service_ports_t ports, const serve_disk_options_t &disk_options, bool *result_out, std::string web_assets) {
     os_signal_cond_t sigint_cond;
 
     if (!check_existence(filepath)) {
@@ -206,7 +213,7 @@ void run_rethinkdb_serve(extproc::spawner_t::info_t *spawner_info, const std::st
     }
 
     scoped_ptr_t<io_backender_t> io_backender;
-    make_io_backender(io_backend, &io_backender);
+    make_io_backender(disk_options.io_backend, &io_backender);
 
     perfmon_collection_t metadata_perfmon_collection;
     perfmon_membership_t metadata_perfmon_membership(&get_global_perfmon_collection(), &metadata_perfmon_collection, "metadata");
@@ -216,7 +223,7 @@ void run_rethinkdb_serve(extproc::spawner_t::info_t *spawner_info, const std::st
 
         *result_out = serve(spawner_info,
                             io_backender.get(),
-                            filepath, &store,
+                            filepath, disk_options.table_file_config, &store,
                             look_up_peers_addresses(joins),
                             ports,
                             store.read_machine_id(),
@@ -232,7 +239,7 @@ void run_rethinkdb_serve(extproc::spawner_t::info_t *spawner_info, const std::st
     }
 }
 
-void run_rethinkdb_porcelain(extproc::spawner_t::info_t *spawner_info, const std::string &filepath, const name_string_t &machine_name, const std::vector<host_and_port_t> &joins, service_ports_t ports, const io_backend_t io_backend, bool *result_out, std::string web_assets, bool new_directory) {
+void run_rethinkdb_porcelain(extproc::spawner_t::info_t *spawner_info, const std::string &filepath, const name_string_t &machine_name, const std::vector<host_and_port_t> &joins, service_ports_t ports, const serve_disk_options_t &disk_options, bool *result_out, std::string web_assets, bool new_directory) {
     logINF("Running %s...\n", RETHINKDB_VERSION_STR);
     os_signal_cond_t sigint_cond;
 
@@ -240,7 +247,7 @@ void run_rethinkdb_porcelain(extproc::spawner_t::info_t *spawner_info, const std
         logINF("Loading data from directory %s\n", filepath.c_str());
 
         scoped_ptr_t<io_backender_t> io_backender;
-        make_io_backender(io_backend, &io_backender);
+        make_io_backender(disk_options.io_backend, &io_backender);
 
         perfmon_collection_t metadata_perfmon_collection;
         perfmon_membership_t metadata_perfmon_membership(&get_global_perfmon_collection(), &metadata_perfmon_collection, "metadata");
@@ -249,7 +256,7 @@ void run_rethinkdb_porcelain(extproc::spawner_t::info_t *spawner_info, const std
 
             *result_out = serve(spawner_info,
                                 io_backender.get(),
-                                filepath, &store,
+                                filepath, disk_options.table_file_config, &store,
                                 look_up_peers_addresses(joins),
                                 ports,
                                 store.read_machine_id(), store.read_metadata(),
@@ -292,7 +299,7 @@ void run_rethinkdb_porcelain(extproc::spawner_t::info_t *spawner_info, const std
         }
 
         scoped_ptr_t<io_backender_t> io_backender;
-        make_io_backender(io_backend, &io_backender);
+        make_io_backender(disk_options.io_backend, &io_backender);
 
         perfmon_collection_t metadata_perfmon_collection;
         perfmon_membership_t metadata_perfmon_membership(&get_global_perfmon_collection(), &metadata_perfmon_collection, "metadata");
@@ -301,7 +308,7 @@ void run_rethinkdb_porcelain(extproc::spawner_t::info_t *spawner_info, const std
 
             *result_out = serve(spawner_info,
                                 io_backender.get(),
-                                filepath, &store,
+                                filepath, disk_options.table_file_config, &store,
                                 look_up_peers_addresses(joins),
                                 ports,
                                 our_machine_id, semilattice_metadata,
@@ -421,6 +428,14 @@ po::options_description get_disk_options() {
     return desc;
 }
 
+po::options_description get_table_file_options() {
+    po::options_description desc("Table file options");
+    desc.add_options()
+        ("block-size", po::value<int>()->default_value(DEFAULT_BTREE_BLOCK_SIZE), "the block size in bytes of table files created from now on: a power of two from 4096 to 65536")
+        ("compress-blocks", "compress the blocks of table files before writing them; this only saves space if their block size is more than 4096");
+    return desc;
+}
+
 po::options_description get_cpu_options() {
     po::options_description desc("CPU options");
     desc.add_options()
@@ -459,6 +474,7 @@ po::options_description get_rethinkdb_serve_options() {
     desc.add(get_network_options());
     desc.add(get_web_options());
     desc.add(get_disk_options());
+    desc.add(get_table_file_options());
     desc.add(get_cpu_options());
     desc.add(get_service_options());
     return desc;
@@ -472,6 +488,7 @@ po::options_description get_rethinkdb_serve_options_visible() {
 #ifdef AIOSUPPORT
     desc.add(get_disk_options());
 #endif // AIOSUPPORT
+    desc.add(get_table_file_options());
     desc.add(get_cpu_options());
     desc.add(get_service_options());
     return desc;
@@ -531,6 +548,7 @@ po::options_description get_rethinkdb_porcelain_options() {
     desc.add(get_network_options());
     desc.add(get_web_options());
     desc.add(get_disk_options());
+    desc.add(get_table_file_options());
     desc.add(get_cpu_options());
     desc.add(get_service_options());
     return desc;
@@ -554,6 +572,18 @@ MUST_USE bool pull_io_backend_option(const po::variables_map& vm, io_backend_t *
     return true;
 }
 
+// Returns true upon success, and prints what's wrong otherwise.
+MUST_USE bool pull_table_file_options(const po::variables_map& vm, log_serializer_config_t *out) {
+    const int block_size = vm["block-size"].as<int>();
+    if (block_size < DEVICE_BLOCK_SIZE || block_size > MAX_BTREE_BLOCK_SIZE || (block_size & (block_size - 1)) != 0) {
+        fprintf(stderr, "ERROR: block-size must be a power of two from %lld to %lld.\n", DEVICE_BLOCK_SIZE, MAX_BTREE_BLOCK_SIZE);
+        return false;
+    }
+    out->static_config.block_size_ = block_size;
+    out->dynamic_config.compress_blocks = vm.count("compress-blocks") > 0;
+    return true;
+}
+
 MUST_USE bool parse_commands_flat(int argc, char *argv[], po::variables_map *vm, const po::options_description& options) {
     try {
         po::store(po::parse_command_line(argc, argv, options), *vm);
@@ -687,11 +717,14 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
     service_ports_t ports = get_service_ports(vm);
     std::string web_path = get_web_path(vm, argv);
 
-    io_backend_t io_backend;
-    if (!pull_io_backend_option(vm, &io_backend)) {
+    serve_disk_options_t disk_options;
+    if (!pull_io_backend_option(vm, &disk_options.io_backend)) {
         fprintf(stderr, "ERROR: selected io-backend is invalid or unsupported.\n");
         return EXIT_FAILURE;
     }
+    if (!pull_table_file_options(vm, &disk_options.table_file_config)) {
+        return EXIT_FAILURE;
+    }
 
     extproc::spawner_t::info_t spawner_info;
     extproc::spawner_t::create(&spawner_info);
@@ -725,7 +758,7 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
     bool result;
     run_in_thread_pool(boost::bind(&run_rethinkdb_serve, &spawner_info, filepath, joins,
                                    ports,
-                                   io_backend,
+                                   disk_options,
                                    &result, web_path),
                        num_workers);
 
@@ -959,11 +992,14 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
     service_ports_t ports = get_service_ports(vm);
     std::string web_path = get_web_path(vm, argv);
 
-    io_backend_t io_backend;
-    if (!pull_io_backend_option(vm, &io_backend)) {
+    serve_disk_options_t disk_options;
+    if (!pull_io_backend_option(vm, &disk_options.io_backend)) {
         fprintf(stderr, "ERROR: selected io-backend is invalid or unsupported.\n");
         return EXIT_FAILURE;
     }
+    if (!pull_table_file_options(vm, &disk_options.table_file_config)) {
+        return EXIT_FAILURE;
+    }
 
     extproc::spawner_t::info_t spawner_info;
     extproc::spawner_t::create(&spawner_info);
@@ -1003,7 +1039,7 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
     bool result;
     run_in_thread_pool(boost::bind(&run_rethinkdb_porcelain, &spawner_info, filepath, machine_name, joins,
                                    ports,
-                                   io_backend,
+                                   disk_options,
                                    &result, web_path, new_directory),
                        num_workers);
 
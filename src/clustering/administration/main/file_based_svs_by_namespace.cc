@@ -1,6 +1,7 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
 #include "clustering/administration/main/file_based_svs_by_namespace.hpp"
 
+#include "clustering/administration/issues/corrupt_blocks.hpp"
 #include "clustering/immediate_consistency/branch/multistore.hpp"
 #include "clustering/reactor/reactor.hpp"
 #include "db_thread_info.hpp"
@@ -100,6 +101,8 @@ file_based_svs_by_namespace_t<protocol_t>::get_svs(
 
     const std::string serializer_filepath = file_name_for(namespace_id);
 
+    scoped_ptr_t<corrupt_block_issue_reporter_t> corruption_reporter(
+        new corrupt_block_issue_reporter_t(local_issue_tracker_, local_issue_tracker_thread_, serializer_filepath));
     scoped_ptr_t<standard_serializer_t> serializer;
     scoped_ptr_t<serializer_multiplexer_t> multiplexer;
 
@@ -109,9 +112,10 @@ file_based_svs_by_namespace_t<protocol_t>::get_svs(
         filepath_file_opener_t file_opener(serializer_filepath, io_backender_);
 
         // TODO: Could we handle failure when loading the serializer?  Right now, we don't.
-        serializer.init(new standard_serializer_t(standard_serializer_t::dynamic_config_t(),
+        serializer.init(new standard_serializer_t(serializer_config_.dynamic_config,
                                                   &file_opener,
                                                   serializers_perfmon_collection));
+        serializer->register_corruption_cb(corruption_reporter.get());
 
         std::vector<standard_serializer_t *> ptrs;
         ptrs.push_back(serializer.get());
@@ -135,12 +139,12 @@ file_based_svs_by_namespace_t<protocol_t>::get_svs(
         stores_out->stores()->init(num_stores);
 
         filepath_file_opener_t file_opener(serializer_filepath, io_backender_);
-        standard_serializer_t::create(&file_opener,
-                                      standard_serializer_t::static_config_t());
+        standard_serializer_t::create(&file_opener, serializer_config_.static_config);
 
-        serializer.init(new standard_serializer_t(standard_serializer_t::dynamic_config_t(),
+        serializer.init(new standard_serializer_t(serializer_config_.dynamic_config,
                                                   &file_opener,
                                                   serializers_perfmon_collection));
+        serializer->register_corruption_cb(corruption_reporter.get());
 
         std::vector<standard_serializer_t *> ptrs;
         ptrs.push_back(serializer.get());
@@ -178,6 +182,7 @@ file_based_svs_by_namespace_t<protocol_t>::get_svs(
                                  &dummy_interruptor);
     }
 
+    stores_out->corruption_reporter()->init(corruption_reporter.release());
     stores_out->serializer()->init(serializer.release());
     stores_out->multiplexer()->init(multiplexer.release());
 }
@@ -5,11 +5,21 @@
 #include <string>
 
 #include "clustering/administration/reactor_driver.hpp"
+#include "serializer/log/config.hpp"
+
+class local_issue_tracker_t;
 
 template <class protocol_t>
 class file_based_svs_by_namespace_t : public svs_by_namespace_t<protocol_t> {
 public:
-    file_based_svs_by_namespace_t(io_backender_t *io_backender, const std::string &file_path) : io_backender_(io_backender), file_path_(file_path) { }
+    // Corrupt blocks that the serializers come across get reported to `local_issue_tracker`,
+    // which must live on the thread this is constructed on. The serializers are set up according
+    // to `serializer_config`.
+    file_based_svs_by_namespace_t(io_backender_t *io_backender, const std::string &file_path,
+                                  const log_serializer_config_t &serializer_config,
+                                  local_issue_tracker_t *local_issue_tracker)
+        : io_backender_(io_backender), file_path_(file_path), serializer_config_(serializer_config),
+          local_issue_tracker_(local_issue_tracker), local_issue_tracker_thread_(get_thread_id()) { }
 
     void get_svs(perfmon_collection_t *serializers_perfmon_collection, namespace_id_t namespace_id,
                  int64_t cache_size,
@@ -26,6 +36,9 @@ private:
 
     io_backender_t *io_backender_;
     const std::string file_path_;
+    const log_serializer_config_t serializer_config_;
+    local_issue_tracker_t *const local_issue_tracker_;
+    const int local_issue_tracker_thread_;
 
     DISABLE_COPYING(file_based_svs_by_namespace_t);
 };
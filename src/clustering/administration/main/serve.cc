@@ -42,8 +42,9 @@ bool do_serve(
     extproc::spawner_t::info_t *spawner_info,
     io_backender_t *io_backender,
     bool i_am_a_server,
-    // NB. filepath & persistent_file are used iff i_am_a_server is true.
-    const std::string &filepath, metadata_persistence::persistent_file_t *persistent_file,
+    // NB. filepath, table_file_config & persistent_file are used iff i_am_a_server is true.
+    const std::string &filepath, const log_serializer_config_t &table_file_config,
+    metadata_persistence::persistent_file_t *persistent_file,
     const peer_address_set_t &joins,
     service_ports_t ports,
     machine_id_t machine_id, const cluster_semilattice_metadata_t &semilattice_metadata,
@@ -168,7 +169,9 @@ bool do_serve(
                                           NULL,
                                           semilattice_manager_cluster.get_root_view(),
                                           &directory_read_manager,
-                                          machine_id);
+                                          machine_id,
+                                          io_backender,
+                                          filepath);
 
         namespace_repo_t<rdb_protocol_t> rdb_namespace_repo(&mailbox_manager,
             directory_read_manager.get_root_view()->subview(
@@ -182,7 +185,7 @@ bool do_serve(
             // Reactor drivers
 
             // Dummy
-            file_based_svs_by_namespace_t<mock::dummy_protocol_t> dummy_svs_source(io_backender, filepath);
+            file_based_svs_by_namespace_t<mock::dummy_protocol_t> dummy_svs_source(io_backender, filepath, table_file_config, &local_issue_tracker);
             scoped_ptr_t<reactor_driver_t<mock::dummy_protocol_t> > dummy_reactor_driver(!i_am_a_server ? NULL :
                 new reactor_driver_t<mock::dummy_protocol_t>(
                     io_backender,
@@ -205,7 +208,7 @@ bool do_serve(
                         &our_root_directory_variable));
 
             // Memcached
-            file_based_svs_by_namespace_t<memcached_protocol_t> memcached_svs_source(io_backender, filepath);
+            file_based_svs_by_namespace_t<memcached_protocol_t> memcached_svs_source(io_backender, filepath, table_file_config, &local_issue_tracker);
             scoped_ptr_t<reactor_driver_t<memcached_protocol_t> > memcached_reactor_driver(!i_am_a_server ? NULL :
                 new reactor_driver_t<memcached_protocol_t>(
                     io_backender,
@@ -228,7 +231,7 @@ bool do_serve(
                         &our_root_directory_variable));
 
             // RDB
-            file_based_svs_by_namespace_t<rdb_protocol_t> rdb_svs_source(io_backender, filepath);
+            file_based_svs_by_namespace_t<rdb_protocol_t> rdb_svs_source(io_backender, filepath, table_file_config, &local_issue_tracker);
             scoped_ptr_t<reactor_driver_t<rdb_protocol_t> > rdb_reactor_driver(!i_am_a_server ? NULL :
                 new reactor_driver_t<rdb_protocol_t>(
                     io_backender,
@@ -321,12 +324,13 @@ bool do_serve(
     }
 }
 
-bool serve(extproc::spawner_t::info_t *spawner_info, io_backender_t *io_backender, const std::string &filepath, metadata_persistence::persistent_file_t *persistent_file, const peer_address_set_t &joins, service_ports_t ports, machine_id_t machine_id, const cluster_semilattice_metadata_t &semilattice_metadata, std::string web_assets, signal_t *stop_cond) {
-    return do_serve(spawner_info, io_backender, true, filepath, persistent_file, joins, ports, machine_id, semilattice_metadata, web_assets, stop_cond);
+bool serve(extproc::spawner_t::info_t *spawner_info, io_backender_t *io_backender, const std::string &filepath, const log_serializer_config_t &table_file_config, metadata_persistence::persistent_file_t *persistent_file, const peer_address_set_t &joins, service_ports_t ports, machine_id_t machine_id, const cluster_semilattice_metadata_t &semilattice_metadata, std::string web_assets, signal_t *stop_cond) {
+    return do_serve(spawner_info, io_backender, true, filepath, table_file_config, persistent_file, joins, ports, machine_id, semilattice_metadata, web_assets, stop_cond);
 }
 
 bool serve_proxy(extproc::spawner_t::info_t *spawner_info, const peer_address_set_t &joins, service_ports_t ports, machine_id_t machine_id, const cluster_semilattice_metadata_t &semilattice_metadata, std::string web_assets, signal_t *stop_cond) {
     // TODO: filepath doesn't _seem_ ignored.
-    // filepath and persistent_file are ignored for proxies, so we use the empty string & NULL respectively.
-    return do_serve(spawner_info, NULL, false, "", NULL, joins, ports, machine_id, semilattice_metadata, web_assets, stop_cond);
+    // filepath, table_file_config and persistent_file are ignored for proxies, so we use the empty
+    // string, the defaults & NULL respectively.
+    return do_serve(spawner_info, NULL, false, "", log_serializer_config_t(), NULL, joins, ports, machine_id, semilattice_metadata, web_assets, stop_cond);
 }
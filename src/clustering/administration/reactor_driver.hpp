@@ -18,6 +18,7 @@
 /* This files contains the class reactor driver whose job is to create and
  * destroy reactors based on blueprints given to the server. */
 
+class corrupt_block_issue_reporter_t;
 class perfmon_collection_repo_t;
 class serializer_t;
 class serializer_multiplexer_t;
@@ -42,11 +43,14 @@ public:
         }
     }
 
+    scoped_ptr_t<corrupt_block_issue_reporter_t> *corruption_reporter() { return &corruption_reporter_; }
     scoped_ptr_t<serializer_t> *serializer() { return &serializer_; }
     scoped_ptr_t<serializer_multiplexer_t> *multiplexer() { return &multiplexer_; }
     scoped_array_t<scoped_ptr_t<typename protocol_t::store_t> > *stores() { return &stores_; }
 
 private:
+    // Declared before serializer_ so that it outlives it.
+    scoped_ptr_t<corrupt_block_issue_reporter_t> corruption_reporter_;
     scoped_ptr_t<serializer_t> serializer_;
     scoped_ptr_t<serializer_multiplexer_t> multiplexer_;
     scoped_array_t<scoped_ptr_t<typename protocol_t::store_t> > stores_;
@@ -8,6 +8,7 @@
 #include <set>
 #include <utility>
 
+#include "clustering/administration/issues/corrupt_blocks.hpp"
 #include "clustering/administration/machine_id_to_peer_id.hpp"
 #include "clustering/administration/metadata.hpp"
 #include "clustering/administration/perfmon_collection_repo.hpp"
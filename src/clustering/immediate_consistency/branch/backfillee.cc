@@ -1,6 +1,13 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
 #include "clustering/immediate_consistency/branch/backfillee.hpp"
 
+#include <vector>
+
+#include "errors.hpp"
+#include <boost/shared_ptr.hpp>
+
+#include "arch/runtime/coroutines.hpp"
+
 #include "clustering/immediate_consistency/branch/history.hpp"
 #include "concurrency/coro_pool.hpp"
 #include "concurrency/cross_thread_signal.hpp"
@@ -11,32 +18,58 @@
 
 #define ALLOCATION_CHUNK 50
 
+/* Chunks that pile up behind each other are handed to the store in batches of
+up to `BACKFILL_BATCH_SIZE`, so that each batch costs one write transaction
+instead of one per chunk. As many chunks are in flight at once. */
+#define BACKFILL_BATCH_SIZE 64
+
 template <class protocol_t>
 struct backfill_queue_entry_t {
+    enum type_t {
+        /* An actual backfill chunk */
+        CHUNK,
+        /* Everything in `checkpoint_region` has been sent */
+        CHECKPOINT,
+        /* The backfill is over */
+        FINISH
+    };
+
     // TODO: The fact that fifo_enforcer_queue_t requires a default
     // constructor (and assignment operator, presumably) is completely asinine.
     backfill_queue_entry_t() { }
-    backfill_queue_entry_t(bool _is_not_last_backfill_chunk,
+    backfill_queue_entry_t(type_t _type,
                            const typename protocol_t::backfill_chunk_t &_chunk,
+                           const typename protocol_t::region_t &_checkpoint_region,
                            fifo_enforcer_write_token_t _write_token)
-        : is_not_last_backfill_chunk(_is_not_last_backfill_chunk),
+        : type(_type),
           chunk(_chunk),
+          checkpoint_region(_checkpoint_region),
           write_token(_write_token) { }
 
-    bool is_not_last_backfill_chunk;
+    type_t type;
     typename protocol_t::backfill_chunk_t chunk;
+    typename protocol_t::region_t checkpoint_region;
     fifo_enforcer_write_token_t write_token;
 };
 
 template <class protocol_t>
 void push_chunk_on_queue(fifo_enforcer_queue_t<backfill_queue_entry_t<protocol_t> > *queue,
                          typename protocol_t::backfill_chunk_t chunk, fifo_enforcer_write_token_t token) {
-    queue->push(token, backfill_queue_entry_t<protocol_t>(true, chunk, token));
+    queue->push(token, backfill_queue_entry_t<protocol_t>(backfill_queue_entry_t<protocol_t>::CHUNK,
+                                                          chunk, typename protocol_t::region_t(), token));
+}
+
+template <class protocol_t>
+void push_checkpoint_on_queue(fifo_enforcer_queue_t<backfill_queue_entry_t<protocol_t> > *queue,
+                              typename protocol_t::region_t region, fifo_enforcer_write_token_t token) {
+    queue->push(token, backfill_queue_entry_t<protocol_t>(backfill_queue_entry_t<protocol_t>::CHECKPOINT,
+                                                          typename protocol_t::backfill_chunk_t(), region, token));
 }
 
 template <class protocol_t>
 void push_finish_on_queue(fifo_enforcer_queue_t<backfill_queue_entry_t<protocol_t> > *queue, fifo_enforcer_write_token_t token) {
-    queue->push(token, backfill_queue_entry_t<protocol_t>(false, typename protocol_t::backfill_chunk_t(), token));
+    queue->push(token, backfill_queue_entry_t<protocol_t>(backfill_queue_entry_t<protocol_t>::FINISH,
+                                                          typename protocol_t::backfill_chunk_t(), typename protocol_t::region_t(), token));
 }
 
 
@@ -48,24 +81,61 @@ class chunk_callback_t : public coro_pool_callback_t<backfill_queue_entry_t<prot
 public:
     chunk_callback_t(store_view_t<protocol_t> *_svs,
                      fifo_enforcer_queue_t<backfill_queue_entry_t<protocol_t> > *_chunk_queue, mailbox_manager_t *_mbox_manager,
-                     mailbox_addr_t<void(int)> _allocation_mailbox) :
+                     mailbox_addr_t<void(int)> _allocation_mailbox,
+                     const region_map_t<protocol_t, version_range_t> &_end_point, order_source_t *_order_source) :
         svs(_svs), chunk_queue(_chunk_queue), mbox_manager(_mbox_manager),
-        allocation_mailbox(_allocation_mailbox), unacked_chunks(0),
+        allocation_mailbox(_allocation_mailbox), end_point(_end_point), order_source(_order_source), unacked_chunks(0),
         done_message_arrived(false), num_outstanding_chunks(0)
     { }
 
     void apply_backfill_chunk(fifo_enforcer_write_token_t chunk_token, const typename protocol_t::backfill_chunk_t& chunk, signal_t *interruptor) {
+        boost::shared_ptr<chunk_batch_t> batch;
+        bool is_first_in_batch = !open_batch || open_batch->chunks.size() >= BACKFILL_BATCH_SIZE;
+        if (is_first_in_batch) {
+            open_batch.reset(new chunk_batch_t);
+            svs->new_write_token(&open_batch->write_token);
+        }
+        batch = open_batch;
+        batch->chunks.push_back(chunk);
+        chunk_queue->finish_write(chunk_token);
+
+        if (!is_first_in_batch) {
+            /* Whoever started the batch will apply our chunk along with theirs. */
+            wait_interruptible(&batch->done, interruptor);
+            return;
+        }
+
+        /* Give the chunks queued up behind ours a chance to join us. */
+        coro_t::yield();
+        if (open_batch == batch) {
+            open_batch.reset();
+        }
+
+        svs->receive_backfill(batch->chunks, &batch->write_token, interruptor);
+        batch->done.pulse();
+    }
+
+    /* Records `region` as fully backfilled, so that if the backfill gets cut
+    off, the next one starts `region` from `end_point` instead of from
+    scratch. The chunks for `region` came out of `chunk_queue` before the
+    checkpoint did, so their store write tokens are ahead of ours. */
+    void apply_checkpoint(fifo_enforcer_write_token_t checkpoint_token, const typename protocol_t::region_t &region, signal_t *interruptor) {
         object_buffer_t<fifo_enforcer_sink_t::exit_write_t> write_token;
         svs->new_write_token(&write_token);
-        chunk_queue->finish_write(chunk_token);
+        chunk_queue->finish_write(checkpoint_token);
 
-        svs->receive_backfill(chunk, &write_token, interruptor);
+        svs->set_metainfo(
+            region_map_transform<protocol_t, version_range_t, binary_blob_t>(end_point.mask(region),
+                                                                             &binary_blob_t::make<version_range_t>),
+            order_source->check_in("backfillee(checkpoint)"),
+            &write_token,
+            interruptor);
     }
 
     void coro_pool_callback(backfill_queue_entry_t<protocol_t> chunk, signal_t *interruptor) {
         assert_thread();
         try {
-            if (chunk.is_not_last_backfill_chunk) {
+            if (chunk.type == backfill_queue_entry_t<protocol_t>::CHUNK) {
                 /* This is an actual backfill chunk */
 
                 /* Before letting the next thing go, increment
@@ -99,6 +169,11 @@ public:
 
                 num_outstanding_chunks--;
 
+            } else if (chunk.type == backfill_queue_entry_t<protocol_t>::CHECKPOINT) {
+                num_outstanding_chunks++;
+                apply_checkpoint(chunk.write_token, chunk.checkpoint_region, interruptor);
+                num_outstanding_chunks--;
+
             } else {
                 /* This is a fake backfill "chunk" that just indicates
                    that the backfill is over */
@@ -123,14 +198,28 @@ public:
     cond_t done_cond;
 
 private:
+    /* Chunks that have come out of `chunk_queue` but haven't been handed to
+    the store yet. They share one write token. */
+    class chunk_batch_t {
+    public:
+        std::vector<typename protocol_t::backfill_chunk_t> chunks;
+        object_buffer_t<fifo_enforcer_sink_t::exit_write_t> write_token;
+        cond_t done;
+    };
+
     store_view_t<protocol_t> *svs;
     fifo_enforcer_queue_t<backfill_queue_entry_t<protocol_t> > *chunk_queue;
     mailbox_manager_t *mbox_manager;
     mailbox_addr_t<void(int)> allocation_mailbox;
+    region_map_t<protocol_t, version_range_t> end_point;
+    order_source_t *order_source;
     int unacked_chunks;
     bool done_message_arrived;
     int num_outstanding_chunks;
 
+    /* The batch that chunks coming out of `chunk_queue` can still join. */
+    boost::shared_ptr<chunk_batch_t> open_batch;
+
     DISABLE_COPYING(chunk_callback_t);
 };
 
@@ -204,6 +293,11 @@ void backfillee(
         mailbox_t<void(backfill_chunk_t, fifo_enforcer_write_token_t)> chunk_mailbox(
             mailbox_manager, boost::bind(&push_chunk_on_queue<protocol_t>, &chunk_queue, _1, _2), mailbox_callback_mode_inline);
 
+        /* Every so often the backfiller will tell `checkpoint_mailbox` that
+        part of the region has been sent in full. */
+        mailbox_t<void(typename protocol_t::region_t, fifo_enforcer_write_token_t)> checkpoint_mailbox(
+            mailbox_manager, boost::bind(&push_checkpoint_on_queue<protocol_t>, &chunk_queue, _1, _2), mailbox_callback_mode_inline);
+
         /* The backfiller will register for allocations on the allocation
          * registration box. */
         promise_t<mailbox_addr_t<void(int)> > alloc_mailbox_promise;
@@ -217,6 +311,7 @@ void backfillee(
             start_point, start_point_associated_history,
             end_point_mailbox.get_address(),
             chunk_mailbox.get_address(),
+            checkpoint_mailbox.get_address(),
             done_mailbox.get_address(),
             alloc_registration_mbox.get_address());
 
@@ -318,9 +413,9 @@ void backfillee(
             &write_token,
             interruptor);
 
-        chunk_callback_t<protocol_t> chunk_callback(svs, &chunk_queue, mailbox_manager, allocation_mailbox);
+        chunk_callback_t<protocol_t> chunk_callback(svs, &chunk_queue, mailbox_manager, allocation_mailbox, end_point, &order_source);
 
-        coro_pool_t<backfill_queue_entry_t<protocol_t> > backfill_workers(10, &chunk_queue, &chunk_callback);
+        coro_pool_t<backfill_queue_entry_t<protocol_t> > backfill_workers(BACKFILL_BATCH_SIZE, &chunk_queue, &chunk_callback);
 
         /* Now wait for the backfill to be over */
         {
@@ -20,8 +20,7 @@ backfiller_t<protocol_t>::backfiller_t(mailbox_manager_t *mm,
                                        store_view_t<protocol_t> *_svs)
     : mailbox_manager(mm), branch_history_manager(bhm),
       svs(_svs),
-      backfill_mailbox(mailbox_manager,
-                       boost::bind(&backfiller_t::on_backfill, this, _1, _2, _3, _4, _5, _6, _7, auto_drainer_t::lock_t(&drainer))),
+      backfill_mailbox(mailbox_manager, backfill_mailbox_callback_t(this)),
       cancel_backfill_mailbox(mailbox_manager,
                               boost::bind(&backfiller_t::on_cancel_backfill, this, _1, auto_drainer_t::lock_t(&drainer))),
       request_progress_mailbox(mailbox_manager,
@@ -103,6 +102,7 @@ public:
                                         mailbox_addr_t<void(region_map_t<protocol_t, version_range_t>, branch_history_t<protocol_t>)> end_point_cont,
                                         mailbox_manager_t *mailbox_manager,
                                         mailbox_addr_t<void(typename protocol_t::backfill_chunk_t, fifo_enforcer_write_token_t)> chunk_cont,
+                                        mailbox_addr_t<void(typename protocol_t::region_t, fifo_enforcer_write_token_t)> checkpoint_cont,
                                         fifo_enforcer_source_t *fifo_src,
                                         semaphore_t *chunk_semaphore,
                                         backfiller_t<protocol_t> *backfiller)
@@ -110,6 +110,7 @@ public:
           end_point_cont_(end_point_cont),
           mailbox_manager_(mailbox_manager),
           chunk_cont_(chunk_cont),
+          checkpoint_cont_(checkpoint_cont),
           fifo_src_(fifo_src),
           chunk_semaphore_(chunk_semaphore),
           backfiller_(backfiller) { }
@@ -121,11 +122,19 @@ public:
     void send_chunk(const typename protocol_t::backfill_chunk_t &chunk, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
         do_send_chunk<protocol_t>(mailbox_manager_, chunk_cont_, chunk, fifo_src_, chunk_semaphore_, interruptor);
     }
+
+    void send_checkpoint(const typename protocol_t::region_t &region, UNUSED signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        /* Checkpoints are tiny and the backfillee doesn't count them against
+        our allocation, so they don't go through `chunk_semaphore_`. They
+        still have to be ordered after the chunks they vouch for. */
+        send(mailbox_manager_, checkpoint_cont_, region, fifo_src_->enter_write());
+    }
 private:
     const region_map_t<protocol_t, version_range_t> *start_point_;
     mailbox_addr_t<void(region_map_t<protocol_t, version_range_t>, branch_history_t<protocol_t>)> end_point_cont_;
     mailbox_manager_t *mailbox_manager_;
     mailbox_addr_t<void(typename protocol_t::backfill_chunk_t, fifo_enforcer_write_token_t)> chunk_cont_;
+    mailbox_addr_t<void(typename protocol_t::region_t, fifo_enforcer_write_token_t)> checkpoint_cont_;
     fifo_enforcer_source_t *fifo_src_;
     semaphore_t *chunk_semaphore_;
     backfiller_t<protocol_t> *backfiller_;
@@ -139,6 +148,7 @@ void backfiller_t<protocol_t>::on_backfill(backfill_session_id_t session_id,
                                            const branch_history_t<protocol_t> &start_point_associated_branch_history,
                                            mailbox_addr_t<void(region_map_t<protocol_t, version_range_t>, branch_history_t<protocol_t>)> end_point_cont,
                                            mailbox_addr_t<void(typename protocol_t::backfill_chunk_t, fifo_enforcer_write_token_t)> chunk_cont,
+                                           mailbox_addr_t<void(typename protocol_t::region_t, fifo_enforcer_write_token_t)> checkpoint_cont,
                                            mailbox_addr_t<void(fifo_enforcer_write_token_t)> done_cont,
                                            mailbox_addr_t<void(mailbox_addr_t<void(int)>)> allocation_registration_box,
                                            auto_drainer_t::lock_t keepalive) {
@@ -177,7 +187,7 @@ void backfiller_t<protocol_t>::on_backfill(backfill_session_id_t session_id,
         svs->new_read_token(&send_backfill_token);
 
         backfiller_send_backfill_callback_t<protocol_t>
-            send_backfill_cb(&start_point, end_point_cont, mailbox_manager, chunk_cont, &fifo_src, &chunk_semaphore, this);
+            send_backfill_cb(&start_point, end_point_cont, mailbox_manager, chunk_cont, checkpoint_cont, &fifo_src, &chunk_semaphore, this);
 
         /* Actually perform the backfill */
         svs->send_backfill(
@@ -39,10 +39,35 @@ private:
             const branch_history_t<protocol_t> &start_point_associated_branch_history,
             mailbox_addr_t<void(region_map_t<protocol_t, version_range_t>, branch_history_t<protocol_t>)> end_point_cont,
             mailbox_addr_t<void(typename protocol_t::backfill_chunk_t, fifo_enforcer_write_token_t)> chunk_cont,
+            mailbox_addr_t<void(typename protocol_t::region_t, fifo_enforcer_write_token_t)> checkpoint_cont,
             mailbox_addr_t<void(fifo_enforcer_write_token_t)> done_cont,
             mailbox_addr_t<void(mailbox_addr_t<void(int)>)> allocation_registration_box,
             auto_drainer_t::lock_t keepalive);
 
+    /* `boost::bind()` can't bind `on_backfill()` along with `this` and a
+    drainer lock; it only goes up to eight arguments. So `backfill_mailbox`
+    calls this instead, which carries the lock the same way. */
+    class backfill_mailbox_callback_t {
+    public:
+        explicit backfill_mailbox_callback_t(backfiller_t *_parent) : parent(_parent), keepalive(&_parent->drainer) { }
+        void operator()(
+                backfill_session_id_t session_id,
+                const region_map_t<protocol_t, version_range_t> &start_point,
+                const branch_history_t<protocol_t> &start_point_associated_branch_history,
+                mailbox_addr_t<void(region_map_t<protocol_t, version_range_t>, branch_history_t<protocol_t>)> end_point_cont,
+                mailbox_addr_t<void(typename protocol_t::backfill_chunk_t, fifo_enforcer_write_token_t)> chunk_cont,
+                mailbox_addr_t<void(typename protocol_t::region_t, fifo_enforcer_write_token_t)> checkpoint_cont,
+                mailbox_addr_t<void(fifo_enforcer_write_token_t)> done_cont,
+                mailbox_addr_t<void(mailbox_addr_t<void(int)>)> allocation_registration_box) const {
+            parent->on_backfill(session_id, start_point, start_point_associated_branch_history,
+                                end_point_cont, chunk_cont, checkpoint_cont, done_cont,
+                                allocation_registration_box, keepalive);
+        }
+    private:
+        backfiller_t *parent;
+        auto_drainer_t::lock_t keepalive;
+    };
+
     void on_cancel_backfill(backfill_session_id_t session_id, UNUSED auto_drainer_t::lock_t);
 
     void request_backfill_progress(backfill_session_id_t session_id,
@@ -27,6 +27,10 @@ the backfill will be faster but the cluster will only serve queries slowly
 during the backfill. */
 #define WRITE_QUEUE_SEMAPHORE_TRICKLE_FRACTION 0.5
 
+/* When writes pile up in the write queue, we hand up to
+`WRITE_QUEUE_MAX_BATCH_SIZE` of them to the store at once. */
+#define WRITE_QUEUE_MAX_BATCH_SIZE 64
+
 #ifndef NDEBUG
 template <class protocol_t>
 struct version_leq_metainfo_checker_callback_t : public metainfo_checker_callback_t<protocol_t> {
@@ -443,7 +447,8 @@ void listener_t<protocol_t>::perform_enqueued_write(const write_queue_entry_t &q
         write_queue_has_drained_.pulse_if_not_already_pulsed();
     }
 
-    object_buffer_t<fifo_enforcer_sink_t::exit_write_t> write_token;
+    boost::shared_ptr<write_batch_t> batch;
+    bool is_first_in_batch;
     {
         fifo_enforcer_sink_t::exit_write_t fifo_exit(&store_entrance_sink_, qe.fifo_token);
         if (qe.transition_timestamp.timestamp_before() < backfill_end_timestamp) {
@@ -451,26 +456,64 @@ void listener_t<protocol_t>::perform_enqueued_write(const write_queue_entry_t &q
         }
         wait_interruptible(&fifo_exit, interruptor);
         advance_current_timestamp_and_pulse_waiters(qe.transition_timestamp);
-        svs_->new_write_token(&write_token);
+
+        is_first_in_batch = !open_write_batch_ || open_write_batch_->writes.size() >= WRITE_QUEUE_MAX_BATCH_SIZE;
+        if (is_first_in_batch) {
+            open_write_batch_.reset(new write_batch_t);
+            svs_->new_write_token(&open_write_batch_->write_token);
+        }
+        batch = open_write_batch_;
+        batch->writes.push_back(qe.write.shard(region_intersection(qe.write.get_region(), svs_->get_region())));
+        batch->timestamps.push_back(qe.transition_timestamp);
+        batch->order_token = qe.order_token;
+    }
+
+    if (!is_first_in_batch) {
+        /* Whoever started the batch will apply our write along with theirs. */
+        wait_interruptible(&batch->done, interruptor);
+        return;
+    }
+
+    /* If more writes are waiting right behind ours, give them a chance to
+    get through `store_entrance_sink_` and join us. */
+    coro_t::yield();
+    if (open_write_batch_ == batch) {
+        open_write_batch_.reset();
     }
 
 #ifndef NDEBUG
-        version_leq_metainfo_checker_callback_t<protocol_t> metainfo_checker_callback(qe.transition_timestamp.timestamp_before());
+        version_leq_metainfo_checker_callback_t<protocol_t> metainfo_checker_callback(batch->timestamps.front().timestamp_before());
         metainfo_checker_t<protocol_t> metainfo_checker(&metainfo_checker_callback, svs_->get_region());
 #endif
 
-    typename protocol_t::write_response_t response;
-
-    svs_->write(
-        DEBUG_ONLY(metainfo_checker, )
-        region_map_t<protocol_t, binary_blob_t>(svs_->get_region(),
-            binary_blob_t(version_range_t(version_t(branch_id_, qe.transition_timestamp.timestamp_after())))),
-        qe.write.shard(region_intersection(qe.write.get_region(), svs_->get_region())),
-        &response,
-        qe.transition_timestamp,
-        qe.order_token,
-        &write_token,
-        interruptor);
+    region_map_t<protocol_t, binary_blob_t> new_metainfo(svs_->get_region(),
+        binary_blob_t(version_range_t(version_t(branch_id_, batch->timestamps.back().timestamp_after()))));
+
+    if (batch->writes.size() == 1) {
+        typename protocol_t::write_response_t response;
+        svs_->write(
+            DEBUG_ONLY(metainfo_checker, )
+            new_metainfo,
+            batch->writes.front(),
+            &response,
+            batch->timestamps.front(),
+            batch->order_token,
+            &batch->write_token,
+            interruptor);
+    } else {
+        std::vector<typename protocol_t::write_response_t> responses;
+        svs_->write_batch(
+            DEBUG_ONLY(metainfo_checker, )
+            new_metainfo,
+            batch->writes,
+            batch->timestamps,
+            &responses,
+            batch->order_token,
+            &batch->write_token,
+            interruptor);
+    }
+
+    batch->done.pulse();
 }
 
 template <class protocol_t>
@@ -518,6 +561,7 @@ void listener_t<protocol_t>::perform_writeread(const typename protocol_t::write_
 
             advance_current_timestamp_and_pulse_waiters(transition_timestamp);
 
+            open_write_batch_.reset();
             svs_->new_write_token(&write_token);
         }
 
@@ -593,6 +637,7 @@ void listener_t<protocol_t>::perform_read(const typename protocol_t::read_t &rea
 
             guarantee(current_timestamp_ == expected_timestamp);
 
+            open_write_batch_.reset();
             svs_->new_read_token(&read_token);
         }
 
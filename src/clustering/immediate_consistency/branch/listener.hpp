@@ -3,6 +3,10 @@
 #define CLUSTERING_IMMEDIATE_CONSISTENCY_BRANCH_LISTENER_HPP_
 
 #include <map>
+#include <vector>
+
+#include "errors.hpp"
+#include <boost/shared_ptr.hpp>
 
 #include "clustering/immediate_consistency/branch/metadata.hpp"
 #include "concurrency/promise.hpp"
@@ -135,6 +139,18 @@ private:
         RDB_MAKE_ME_SERIALIZABLE_4(write, order_token, transition_timestamp, fifo_token);
     };
 
+    /* Writes from the write queue that have made it through
+    `store_entrance_sink_` but haven't been handed to the store yet. They all
+    share one write token and go to the store in a single `write_batch()`. */
+    class write_batch_t {
+    public:
+        std::vector<typename protocol_t::write_t> writes;
+        std::vector<transition_timestamp_t> timestamps;
+        order_token_t order_token;
+        object_buffer_t<fifo_enforcer_sink_t::exit_write_t> write_token;
+        cond_t done;
+    };
+
     // TODO: This boost optional boost optional crap is ... crap.  This isn't Haskell, this is *real* programming, people.
     static boost::optional<boost::optional<backfiller_business_card_t<protocol_t> > > get_backfiller_from_replier_bcard(const boost::optional<boost::optional<replier_business_card_t<protocol_t> > > &replier_bcard);
 
@@ -229,6 +245,11 @@ private:
     state_timestamp_t current_timestamp_;
     fifo_enforcer_sink_t store_entrance_sink_;
 
+    /* The batch that writes coming out of `store_entrance_sink_` can still
+    join, if any. Anything else that takes a token from `svs_` must close it
+    first, so that no later write slips in ahead of it. */
+    boost::shared_ptr<write_batch_t> open_write_batch_;
+
     // Used by the replier_t which needs to be able to tell
     // backfillees how up to date it is.
     std::multimap<state_timestamp_t, cond_t *> synchronize_waiters_;
@@ -110,6 +110,7 @@ struct backfiller_business_card_t {
             branch_history_t<protocol_t>
             ) >,
         mailbox_addr_t<void(typename protocol_t::backfill_chunk_t, fifo_enforcer_write_token_t)>,
+        mailbox_addr_t<void(typename protocol_t::region_t, fifo_enforcer_write_token_t)>,
         mailbox_t<void(fifo_enforcer_write_token_t)>::address_t,
         mailbox_t<void(mailbox_addr_t<void(int)>)>::address_t
         )> backfill_mailbox_t;
@@ -8,8 +8,9 @@ things:
 * The buffer cache uses it to identify transaction modes. For this, `rwi_intent`
     and `rwi_upgrade` are illegal.
 * The buffer cache uses it to identify block acquisition modes. For this,
-    `rwi_intent` and `rwi_upgrade` are illegal, and all the `rwi_read_*` modes
-    are equivalent (I think)
+    `rwi_upgrade` is illegal (use `buf_lock_t::upgrade_to_write()` on an
+    `rwi_intent` lock instead), and all the `rwi_read_*` modes are
+    equivalent (I think)
 * `rwi_lock_t` uses it to identify how the lock is being locked or unlocked. For
     this, `rwi_read_outdated_ok` and `rwi_read_sync` are illegal.
 
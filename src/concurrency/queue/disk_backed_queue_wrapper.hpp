@@ -12,6 +12,7 @@
 #include "concurrency/queue/passive_producer.hpp"
 #include "concurrency/wait_any.hpp"
 #include "containers/disk_backed_queue.hpp"
+#include "perfmon/perfmon.hpp"
 
 /* `disk_backed_queue_t` can't be used directly as a `passive_producer_t`
 because its `pop()` method can sometimes block, and `passive_producer_t`'s
@@ -22,7 +23,11 @@ a `passive_producer_t`.
 Note that it may sometimes indicate that no data is available even when the
 queue is not empty. This happens when we cannot read data from disk fast enough
 to keep up with the consumer. In this case, we will become available again when
-we have loaded the data into memory. */
+we have loaded the data into memory.
+
+It reports how many entries it holds and how fast they're being pushed and
+consumed in `_stats_parent`, so that a consumer that can't keep up is easy to
+spot. */
 
 template<class T>
 class disk_backed_queue_wrapper_t : public passive_producer_t<T> {
@@ -38,12 +43,21 @@ public:
         io_backender(_io_backender),
         filename(_filename),
         stats_parent(_stats_parent),
-        restart_copy_coro(false)
+        restart_copy_coro(false),
+        pm_push_rate(secs_to_ticks(1)),
+        pm_drain_rate(secs_to_ticks(1)),
+        pm_membership(_stats_parent,
+                      &pm_queue_depth, "queue_depth",
+                      &pm_push_rate, "queue_push_rate",
+                      &pm_drain_rate, "queue_drain_rate",
+                      NULL)
         { }
 
     void push(const T &value) {
         mutex_t::acq_t acq(&push_mutex);
         items_in_queue++;
+        ++pm_queue_depth;
+        pm_push_rate.record();
         if (disk_queue.has()) {
             disk_queue->push(value);
 
@@ -80,6 +94,8 @@ private:
         T value = memory_queue.front();
         memory_queue.pop_front();
         items_in_queue--;
+        --pm_queue_depth;
+        pm_drain_rate.record();
         if (memory_queue.empty()) {
             available_control.set_available(false);
         }
@@ -132,6 +148,10 @@ private:
     // This is used to tell a push operation to restart the copy_from_disk_queue_to_memory_queue
     //  coroutine since the coroutine exited instead of waiting for the push operation to finish
     bool restart_copy_coro;
+
+    perfmon_counter_t pm_queue_depth;
+    perfmon_rate_monitor_t pm_push_rate, pm_drain_rate;
+    perfmon_multi_membership_t pm_membership;
 };
 
 #endif /* CONCURRENCY_QUEUE_DISK_BACKED_QUEUE_WRAPPER_HPP_ */
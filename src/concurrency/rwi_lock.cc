@@ -118,7 +118,10 @@ bool rwi_lock_t::try_lock(access_t access, bool from_queue) {
 }
 
 bool rwi_lock_t::try_lock_read(bool from_queue) {
-    if (!from_queue && queue.head() && queue.head()->op == rwi_write)
+    // Don't let a stream of new readers starve a pending upgrade, either.
+    if (!from_queue && queue.head() &&
+       (queue.head()->op == rwi_write ||
+        queue.head()->op == rwi_upgrade))
         return false;
 
     switch (state) {
@@ -203,7 +206,13 @@ bool rwi_lock_t::try_lock_upgrade(UNUSED bool from_queue) {
 }
 
 void rwi_lock_t::enqueue_request(access_t access, lock_available_callback_t *callback) {
-    queue.push_back(new lock_request_t(access, callback));
+    if (access == rwi_upgrade) {
+        // The intent holder already owns the lock in a sense; if it waited
+        // behind a queued writer, neither of them could ever proceed.
+        queue.push_front(new lock_request_t(access, callback));
+    } else {
+        queue.push_back(new lock_request_t(access, callback));
+    }
 }
 
 void rwi_lock_t::process_queue() {
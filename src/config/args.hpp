@@ -76,6 +76,10 @@
 // Size of each btree node (in bytes) on disk
 #define DEFAULT_BTREE_BLOCK_SIZE                  (4 * KILOBYTE)
 
+// The biggest block size a table file can be created with: btree nodes address
+// their contents with 16-bit offsets.
+#define MAX_BTREE_BLOCK_SIZE                      (64 * KILOBYTE)
+
 // Maximum number of data blocks
 #define MAX_DATA_EXTENTS                          (TERABYTE / (16 * KILOBYTE))
 
@@ -94,6 +98,13 @@
 // TODO: make this dynamic where possible
 #define MAX_THREADS                               128
 
+// Before an idle thread goes to sleep in the event queue, it spins for a while
+// waiting for messages from other threads. It spins for longer each time that
+// pays off and for half as long each time it doesn't, between these bounds
+// (counted in polls of its incoming message queues).
+#define MIN_EVENT_QUEUE_SPINS                     16
+#define MAX_EVENT_QUEUE_SPINS                     4096
+
 // Ticks (in milliseconds) the internal timed tasks are performed at
 #define TIMER_TICKS_IN_MS                         5
 
@@ -132,6 +143,15 @@
 #define MAX_PATCHES_SIZE_RATIO_DURABILITY         5
 #define RAISE_PATCHES_RATIO_AT_FRACTION_OF_UNSAVED_DATA_LIMIT 0.6
 
+// Patches that haven't been applied to a block on disk are written as the block's delta
+// record, and have to be replayed every time the block is loaded. Once a block has more
+// than this many of them, the next flush writes the block itself instead.
+#define MAX_DELTA_RECORD_PATCHES                  32
+
+// How many of the delta pages it read last the log serializer keeps around. The blocks of
+// one flush share a delta page, so loading several of them only reads it once.
+#define DELTA_PAGE_CACHE_PAGES                    16
+
 // If more than this many bytes of dirty data accumulate in the cache, then write
 // transactions will be throttled.
 // A value of 0 means that it will automatically be set to MAX_UNSAVED_DATA_LIMIT_FRACTION
@@ -144,6 +164,13 @@
 // We start flushing dirty pages as soon as we hit this fraction of the unsaved data limit
 #define FLUSH_AT_FRACTION_OF_UNSAVED_DATA_LIMIT   0.2
 
+// Write transactions are slowed down gradually once this fraction of the unsaved
+// data limit is dirty, so that they match the flush bandwidth before they hit the
+// limit itself. A single transaction is never held back longer than
+// WRITEBACK_MAX_THROTTLE_DELAY_MS this way.
+#define WRITEBACK_THROTTLE_AT_FRACTION_OF_UNSAVED_DATA_LIMIT 0.5
+#define WRITEBACK_MAX_THROTTLE_DELAY_MS           100
+
 // How many times the page replacement algorithm tries to find an eligible page before giving up.
 // Note that (MAX_UNSAVED_DATA_LIMIT_FRACTION ** PAGE_REPL_NUM_TRIES) is the probability that the
 // page replacement algorithm will succeed on a given try, and if that probability is less than 1/2
@@ -171,6 +198,15 @@
 // The number of concurrent queries when loading memcached operations from a file.
 #define MAX_CONCURRENT_QUEURIES_ON_IMPORT         1000
 
+// Whether the ReQL server type checks queries through a per-thread
+// `query_plan_cache_t`. Off until the `json/type_check` benchmark shows that a
+// hit costs less than the type checking it saves.
+#define RDB_USE_QUERY_PLAN_CACHE                  false
+
+// How much memory the groups of one grouped map-reduce may take up on a
+// machine (see `grouped_map_reduce_t`) before the query fails.
+#define MAX_GROUPED_MAP_REDUCE_MEMORY             (256 * MEGABYTE)
+
 // How many timestamps we store in a leaf node.  We store the
 // NUM_LEAF_NODE_EARLIER_TIMES+1 most-recent timestamps.
 #define NUM_LEAF_NODE_EARLIER_TIMES               4
@@ -214,6 +250,11 @@
 #define MIN_GC_LOW_RATIO                          0.099999
 
 
+// How fast the scrubber re-reads data extents in the background to check their blocks
+// against their checksums, in bytes per second. It uses the nice GC i/o account. 0 turns
+// it off.
+#define DEFAULT_SCRUB_BYTES_PER_SEC               (4 * MEGABYTE)
+
 // What's the maximum number of "young" extents we can have?
 #define GC_YOUNG_EXTENT_MAX_SIZE                  50
 // What's the definition of a "young" extent in microseconds?
@@ -235,6 +276,10 @@
 // doesn't return memory to the OS. If it's set too low, startup will take a longer time.
 #define LBA_READ_BUFFER_SIZE                      GIGABYTE
 
+// How many bytes `rethinkdb fsck --fast` reads from a file at once. Each fsck thread
+// holds one such buffer.
+#define FSCK_SCAN_CHUNK_SIZE                      (16 * MEGABYTE)
+
 // How many different places in each file we should be writing to at once, not counting the
 // metablock or LBA
 #define MAX_ACTIVE_DATA_EXTENTS                   64
@@ -0,0 +1,128 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "containers/crc32c.hpp"
+
+#include <string.h>
+
+#include "errors.hpp"
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+namespace {
+
+// The reflected Castagnoli polynomial.
+const uint32_t crc32c_polynomial = 0x82F63B78;
+
+// Tables for processing eight bytes at a time ("slicing-by-8"). tables[0] is
+// the usual byte-at-a-time table; tables[k][b] is the CRC of byte b followed by
+// k zero bytes.
+struct crc32c_tables_t {
+    uint32_t tables[8][256];
+    bool use_hardware;
+
+    crc32c_tables_t() {
+        for (int b = 0; b < 256; ++b) {
+            uint32_t crc = b;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (crc & 1 ? crc32c_polynomial : 0);
+            }
+            tables[0][b] = crc;
+        }
+        for (int b = 0; b < 256; ++b) {
+            for (int k = 1; k < 8; ++k) {
+                tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+            }
+        }
+
+        use_hardware = false;
+#if defined(__x86_64__)
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            use_hardware = (ecx & bit_SSE4_2) != 0;
+        }
+#endif
+    }
+};
+
+// Filled in during static initialization, before any threads are started.
+const crc32c_tables_t crc32c_tables;
+
+uint32_t crc32c_software(uint32_t crc, const uint8_t *p, size_t size) {
+    const uint32_t (*t)[256] = crc32c_tables.tables;
+    while (size > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+        ++p;
+        --size;
+    }
+    while (size >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+            ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        p += 8;
+        size -= 8;
+    }
+    while (size > 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+        ++p;
+        --size;
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hardware(uint32_t crc, const uint8_t *p, size_t size) {
+    while (size > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+        crc = __builtin_ia32_crc32qi(crc, *p);
+        ++p;
+        --size;
+    }
+    uint64_t crc64 = crc;
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+        p += 8;
+        size -= 8;
+    }
+    crc = crc64;
+    while (size > 0) {
+        crc = __builtin_ia32_crc32qi(crc, *p);
+        ++p;
+        --size;
+    }
+    return crc;
+}
+#endif
+
+}  // namespace
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t size) {
+#if defined(__x86_64__)
+    if (crc32c_tables.use_hardware) {
+        return crc32c_sse42(crc, data, size);
+    }
+#endif
+    return crc32c_slicing_by_8(crc, data, size);
+}
+
+bool crc32c_is_hardware_accelerated() {
+    return crc32c_tables.use_hardware;
+}
+
+uint32_t crc32c_slicing_by_8(uint32_t crc, const void *data, size_t size) {
+    return ~crc32c_software(~crc, static_cast<const uint8_t *>(data), size);
+}
+
+uint32_t crc32c_sse42(uint32_t crc, const void *data, size_t size) {
+    guarantee(crc32c_tables.use_hardware, "crc32c_sse42() called on a CPU without SSE 4.2");
+#if defined(__x86_64__)
+    return ~crc32c_hardware(~crc, static_cast<const uint8_t *>(data), size);
+#else
+    unreachable();
+#endif
+}
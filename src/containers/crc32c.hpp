@@ -0,0 +1,25 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef CONTAINERS_CRC32C_HPP_
+#define CONTAINERS_CRC32C_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* CRC-32C (the Castagnoli polynomial, as used by iSCSI and ext4). On x86-64
+CPUs with SSE 4.2 it uses the crc32 instruction, which checksums a 4KB block in
+a few hundred nanoseconds; elsewhere it falls back to a table-driven version.
+
+To checksum data that isn't contiguous, pass the result for the first piece as
+`crc` for the next one. Start with 0. */
+uint32_t crc32c(uint32_t crc, const void *data, size_t size);
+
+/* Whether crc32c() is using the crc32 instruction. */
+bool crc32c_is_hardware_accelerated();
+
+/* The two implementations crc32c() chooses between, so that tests can check
+both of them. crc32c_sse42() may only be called if
+crc32c_is_hardware_accelerated(). */
+uint32_t crc32c_slicing_by_8(uint32_t crc, const void *data, size_t size);
+uint32_t crc32c_sse42(uint32_t crc, const void *data, size_t size);
+
+#endif  // CONTAINERS_CRC32C_HPP_
@@ -1,129 +1,70 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
 #include "containers/disk_backed_queue.hpp"
 
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "arch/arch.hpp"
 #include "arch/io/disk.hpp"
-#include "buffer_cache/blob.hpp"
-#include "buffer_cache/buffer_cache.hpp"
-#include "serializer/config.hpp"
+#include "config/args.hpp"
+#include "utils.hpp"
 
-internal_disk_backed_queue_t::internal_disk_backed_queue_t(io_backender_t *io_backender,
-                                                           const std::string& filename,
+internal_disk_backed_queue_t::internal_disk_backed_queue_t(io_backender_t *_io_backender,
+                                                           const std::string& _filename,
                                                            perfmon_collection_t *stats_parent)
-    : queue_size(0), head_block_id(NULL_BLOCK_ID), tail_block_id(NULL_BLOCK_ID) {
-    /* We're going to register for writes, however those writes won't be able
-     * to find their way in to the btree until we're done backfilling. Thus we
-     * need to set up a serializer and cache for them to go in to. */
-    //perfmon_collection_t backfill_stats_collection("queue-" + filename, NULL, true, true);
-
-    filepath_file_opener_t file_opener(filename, io_backender);
-    standard_serializer_t::create(&file_opener,
-                                  standard_serializer_t::static_config_t());
-
-    serializer.init(new standard_serializer_t(standard_serializer_t::dynamic_config_t(),
-                                              &file_opener,
-                                              stats_parent));
-
-    /* Remove the file we just created from the filesystem, so that it will
-       get deleted as soon as the serializer is destroyed or if the process
-       crashes */
-    int res = unlink(filename.c_str());
-    guarantee_err(res == 0, "unlink() failed");
-
-    /* Create the cache. */
-    mirrored_cache_static_config_t cache_static_config;
-    cache_t::create(serializer.get(), &cache_static_config);
-
-    mirrored_cache_config_t cache_dynamic_config;
-    cache_dynamic_config.max_size = MEGABYTE;
-    cache_dynamic_config.max_dirty_size = MEGABYTE / 2;
-    cache.init(new cache_t(serializer.get(), &cache_dynamic_config, stats_parent));
+    : queue_size(0), io_backender(_io_backender), filename(_filename), next_segment_number(0),
+      segments_start(0), disk_end(0),
+      write_chunk(static_cast<char *>(malloc_aligned(DISK_BACKED_QUEUE_CHUNK_SIZE, DEVICE_BLOCK_SIZE))),
+      write_chunk_size(0),
+      read_offset(0),
+      read_chunk(static_cast<char *>(malloc_aligned(DISK_BACKED_QUEUE_CHUNK_SIZE, DEVICE_BLOCK_SIZE))),
+      read_chunk_offset(-1),
+      pm_segments_membership(stats_parent, &pm_segments, "disk_queue_segments") {
+    CT_ASSERT(DISK_BACKED_QUEUE_SEGMENT_SIZE % DISK_BACKED_QUEUE_CHUNK_SIZE == 0);
+    CT_ASSERT(DISK_BACKED_QUEUE_CHUNK_SIZE % DEVICE_BLOCK_SIZE == 0);
 }
 
-internal_disk_backed_queue_t::~internal_disk_backed_queue_t() { }
+internal_disk_backed_queue_t::~internal_disk_backed_queue_t() {
+    free(write_chunk);
+    free(read_chunk);
+}
 
 void internal_disk_backed_queue_t::push(const write_message_t& wm) {
     mutex_t::acq_t mutex_acq(&mutex);
 
-    //first we need a transaction
-    transaction_t txn(cache.get(), rwi_write, 2, repli_timestamp_t::distant_past, cache_order_source.check_in("push"));
-
-    if (head_block_id == NULL_BLOCK_ID) {
-        add_block_to_head(&txn);
-    }
-
-    scoped_ptr_t<buf_lock_t> _head(new buf_lock_t(&txn, head_block_id, rwi_write));
-    queue_block_t* head = reinterpret_cast<queue_block_t *>(_head->get_data_major_write());
-
     vector_stream_t stream;
     int res = send_write_message(&stream, &wm);
     guarantee(res == 0);
 
-    char buffer[MAX_REF_SIZE];
-    bzero(buffer, MAX_REF_SIZE);
-
-    blob_t blob(buffer, MAX_REF_SIZE);
-    blob.append_region(&txn, stream.vector().size());
-    std::string sered_data(stream.vector().begin(), stream.vector().end());
-    blob.write_from_string(sered_data, &txn, 0);
-
-    if (((head->data + head->data_size) - reinterpret_cast<char *>(head)) + blob.refsize(cache->get_block_size()) > cache->get_block_size().value()) {
-        //The data won't fit in our current head block, so it's time to make a new one
-        head = NULL;
-        _head.reset();
-        add_block_to_head(&txn);
-        _head.init(new buf_lock_t(&txn, head_block_id, rwi_write));
-        head = reinterpret_cast<queue_block_t *>(_head->get_data_major_write());
-    }
-
-    memcpy(head->data + head->data_size, buffer, blob.refsize(cache->get_block_size()));
-    head->data_size += blob.refsize(cache->get_block_size());
+    uint32_t size = stream.vector().size();
+    append(reinterpret_cast<const char *>(&size), sizeof(size));
+    append(stream.vector().data(), size);
 
     queue_size++;
 }
 
 void internal_disk_backed_queue_t::pop(std::vector<char> *buf_out) {
     mutex_t::acq_t mutex_acq(&mutex);
+    rassert(queue_size > 0);
 
-    char buffer[MAX_REF_SIZE];
-    transaction_t txn(cache.get(), rwi_write, 2, repli_timestamp_t::distant_past, cache_order_source.check_in("pop"));
-
-    scoped_ptr_t<buf_lock_t> _tail(new buf_lock_t(&txn, tail_block_id, rwi_write));
-    queue_block_t *tail = reinterpret_cast<queue_block_t *>(_tail->get_data_major_write());
-    rassert(tail->data_size != tail->live_data_offset);
-
-    /* Grab the data from the blob and delete it. */
-
-    memcpy(buffer, tail->data + tail->live_data_offset, blob::ref_size(cache->get_block_size(), tail->data + tail->live_data_offset, MAX_REF_SIZE));
-    std::vector<char> data_vec;
-
-    blob_t blob(buffer, MAX_REF_SIZE);
-    {
-        blob_acq_t acq_group;
-        buffer_group_t blob_group;
-        blob.expose_all(&txn, rwi_read, &blob_group, &acq_group);
-
-        data_vec.resize(blob_group.get_size());
-        buffer_group_t data_vec_group;
-        data_vec_group.add_buffer(data_vec.size(), data_vec.data());
-        buffer_group_copy_data(&data_vec_group, const_view(&blob_group));
-    }
-
-    /* Record how far along in the blob we are. */
-    tail->live_data_offset += blob.refsize(cache->get_block_size());
-
-    blob.clear(&txn);
+    uint32_t size;
+    consume(reinterpret_cast<char *>(&size), sizeof(size));
+    buf_out->resize(size);
+    consume(buf_out->data(), size);
 
     queue_size--;
 
-    /* If that was the last blob in this block move on to the next one. */
-    if (tail->live_data_offset == tail->data_size) {
-        _tail.reset();
-        remove_block_from_tail(&txn);
+    if (queue_size == 0) {
+        /* Everything that was pushed has been popped, so whatever is in the
+        write chunk is dead. Start the next push at the beginning of a fresh
+        chunk instead of writing it out. */
+        rassert(read_offset == disk_end + static_cast<int64_t>(write_chunk_size));
+        write_chunk_size = 0;
+        read_offset = disk_end;
     }
-
-    /* Deserialize the value and return it. */
-
-    buf_out->swap(data_vec);
 }
 
 bool internal_disk_backed_queue_t::empty() {
@@ -134,37 +75,82 @@ int64_t internal_disk_backed_queue_t::size() {
     return queue_size;
 }
 
-void internal_disk_backed_queue_t::add_block_to_head(transaction_t *txn) {
-    buf_lock_t _new_head(txn);
-    queue_block_t *new_head = reinterpret_cast<queue_block_t *>(_new_head.get_data_major_write());
-    if (head_block_id == NULL_BLOCK_ID) {
-        rassert(tail_block_id == NULL_BLOCK_ID);
-        head_block_id = tail_block_id = _new_head.get_block_id();
-    } else {
-        buf_lock_t _old_head(txn, head_block_id, rwi_write);
-        queue_block_t *old_head = reinterpret_cast<queue_block_t *>(_old_head.get_data_major_write());
-        rassert(old_head->next == NULL_BLOCK_ID);
-        old_head->next = _new_head.get_block_id();
-        head_block_id = _new_head.get_block_id();
+void internal_disk_backed_queue_t::append(const char *data, size_t size) {
+    while (size > 0) {
+        size_t n = std::min<size_t>(size, DISK_BACKED_QUEUE_CHUNK_SIZE - write_chunk_size);
+        memcpy(write_chunk + write_chunk_size, data, n);
+        write_chunk_size += n;
+        data += n;
+        size -= n;
+
+        if (write_chunk_size == DISK_BACKED_QUEUE_CHUNK_SIZE) {
+            flush_write_chunk();
+        }
     }
+}
 
-    new_head->next = NULL_BLOCK_ID;
-    new_head->data_size = 0;
-    new_head->live_data_offset = 0;
+void internal_disk_backed_queue_t::consume(char *data, size_t size) {
+    while (size > 0) {
+        size_t n;
+        if (read_offset >= disk_end) {
+            /* We've caught up with the writer, so the bytes are still in
+            memory. */
+            size_t pos = read_offset - disk_end;
+            rassert(pos + size <= write_chunk_size);
+            n = size;
+            memcpy(data, write_chunk + pos, n);
+        } else {
+            int64_t chunk_offset = read_offset - read_offset % DISK_BACKED_QUEUE_CHUNK_SIZE;
+            if (chunk_offset != read_chunk_offset) {
+                load_read_chunk(chunk_offset);
+            }
+            size_t pos = read_offset - chunk_offset;
+            n = std::min<size_t>(size, DISK_BACKED_QUEUE_CHUNK_SIZE - pos);
+            memcpy(data, read_chunk + pos, n);
+        }
+        read_offset += n;
+        data += n;
+        size -= n;
+
+        /* Give back segments that we've read all the way through. */
+        while (!segments.empty() && read_offset >= segments_start + DISK_BACKED_QUEUE_SEGMENT_SIZE) {
+            segments.pop_front();
+            segments_start += DISK_BACKED_QUEUE_SEGMENT_SIZE;
+            --pm_segments;
+        }
+    }
 }
 
-void internal_disk_backed_queue_t::remove_block_from_tail(transaction_t *txn) {
-    rassert(tail_block_id != NULL_BLOCK_ID);
-    buf_lock_t _old_tail(txn, tail_block_id, rwi_write);
-    queue_block_t *old_tail = reinterpret_cast<queue_block_t *>(_old_tail.get_data_major_write());
+void internal_disk_backed_queue_t::flush_write_chunk() {
+    rassert(write_chunk_size == DISK_BACKED_QUEUE_CHUNK_SIZE);
 
-    if (old_tail->next == NULL_BLOCK_ID) {
-        rassert(head_block_id == _old_tail.get_block_id());
-        tail_block_id = head_block_id = NULL_BLOCK_ID;
-    } else {
-        tail_block_id = old_tail->next;
+    int64_t segments_end = segments_start + static_cast<int64_t>(segments.size()) * DISK_BACKED_QUEUE_SEGMENT_SIZE;
+    if (disk_end == segments_end) {
+        std::string path = strprintf("%s.%d", filename.c_str(), next_segment_number++);
+        nondirect_file_t *segment = new nondirect_file_t(path.c_str(),
+                                                         nondirect_file_t::mode_read | nondirect_file_t::mode_write | nondirect_file_t::mode_create,
+                                                         io_backender);
+        segments.push_back(segment);
+        ++pm_segments;
+
+        /* Remove the file we just created from the filesystem, so that it will
+        get deleted as soon as we close it or if the process crashes. */
+        int res = unlink(path.c_str());
+        guarantee_err(res == 0, "unlink() failed");
+
+        segment->set_size(DISK_BACKED_QUEUE_SEGMENT_SIZE);
     }
 
-    _old_tail.mark_deleted();
+    co_write(&segments.back(), disk_end % DISK_BACKED_QUEUE_SEGMENT_SIZE, DISK_BACKED_QUEUE_CHUNK_SIZE,
+             write_chunk, DEFAULT_DISK_ACCOUNT);
+    disk_end += DISK_BACKED_QUEUE_CHUNK_SIZE;
+    write_chunk_size = 0;
 }
 
+void internal_disk_backed_queue_t::load_read_chunk(int64_t offset) {
+    rassert(offset >= segments_start && offset < disk_end);
+    size_t segment_index = (offset - segments_start) / DISK_BACKED_QUEUE_SEGMENT_SIZE;
+    co_read(&segments[segment_index], offset % DISK_BACKED_QUEUE_SEGMENT_SIZE, DISK_BACKED_QUEUE_CHUNK_SIZE,
+            read_chunk, DEFAULT_DISK_ACCOUNT);
+    read_chunk_offset = offset;
+}
@@ -2,30 +2,37 @@
 #ifndef CONTAINERS_DISK_BACKED_QUEUE_HPP_
 #define CONTAINERS_DISK_BACKED_QUEUE_HPP_
 
-#define MAX_REF_SIZE 251
-
 #include <string>
 #include <vector>
 
-#include "buffer_cache/types.hpp"
-#include "concurrency/fifo_checker.hpp"
+#include "errors.hpp"
+#include <boost/ptr_container/ptr_deque.hpp>
+
+#include "arch/types.hpp"
 #include "concurrency/mutex.hpp"
 #include "containers/archive/vector_stream.hpp"
-#include "containers/scoped.hpp"
-#include "serializer/types.hpp"
+#include "perfmon/perfmon.hpp"
 
 class io_backender_t;
-class perfmon_collection_t;
 
-//TODO there are extra copies all over the place mostly stemming from having a
-//vector<char> from the serialization code and strings from the blob code.
+/* Entries are written to disk in chunks of this size, and read back a chunk at
+a time, so every disk access is large and aligned no matter how small the
+entries are. */
+#define DISK_BACKED_QUEUE_CHUNK_SIZE (256 * KILOBYTE)
 
-struct queue_block_t {
-    block_id_t next;
-    int data_size, live_data_offset;
-    char data[0];
-};
+/* The queue lives in a series of files of this size. Once every entry in a
+file has been popped, the file is closed and its space goes back to the
+filesystem, so a long-lived queue only uses as much disk as it has backlog. */
+#define DISK_BACKED_QUEUE_SEGMENT_SIZE (16 * MEGABYTE)
+
+/* An append-only queue of serialized entries that spills to disk.
 
+Entries are stored as a length followed by the serialized bytes, packed into
+one byte stream that is split into chunks with no regard for entry
+boundaries. Pushes fill an in-memory chunk that is written out once it's full;
+pops read whole chunks back. The segment files are unlinked as soon as they are
+created, so they go away when the queue is destroyed or the process dies. Since
+nothing ever reads them after a crash, they are never `fsync()`ed. */
 class internal_disk_backed_queue_t {
 public:
     internal_disk_backed_queue_t(io_backender_t *io_backender, const std::string& filename, perfmon_collection_t *stats_parent);
@@ -42,18 +49,37 @@ public:
     int64_t size();
 
 private:
-    void add_block_to_head(transaction_t *txn);
+    void append(const char *data, size_t size);
+    void consume(char *data, size_t size);
 
-    void remove_block_from_tail(transaction_t *txn);
+    void flush_write_chunk();
+    void load_read_chunk(int64_t offset);
 
     mutex_t mutex;
     int64_t queue_size;
-    block_id_t head_block_id, tail_block_id;
-    scoped_ptr_t<standard_serializer_t> serializer;
-    scoped_ptr_t<cache_t> cache;
 
-    // Serves more as sanity-checking for the cache than this type's ordering.
-    order_source_t cache_order_source;
+    io_backender_t *io_backender;
+    std::string filename;
+    int next_segment_number;
+
+    /* Offsets are positions in the byte stream since the queue was created.
+    Bytes before `disk_end` are in `segments`, the first of which starts at
+    `segments_start`; the bytes after it are in `write_chunk`. */
+    boost::ptr_deque<nondirect_file_t> segments;
+    int64_t segments_start;
+    int64_t disk_end;
+
+    char *write_chunk;
+    size_t write_chunk_size;
+
+    /* `read_chunk` holds the chunk starting at `read_chunk_offset`, or nothing
+    if that's -1. */
+    int64_t read_offset;
+    char *read_chunk;
+    int64_t read_chunk_offset;
+
+    perfmon_counter_t pm_segments;
+    perfmon_membership_t pm_segments_membership;
 
     DISABLE_COPYING(internal_disk_backed_queue_t);
 };
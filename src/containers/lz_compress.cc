@@ -0,0 +1,196 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "containers/lz_compress.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+// Matches are at least this long; the token stores the length minus this.
+#define LZ_MIN_MATCH 4
+// The last few bytes of the input are always literals, and no match starts
+// this close to the end. These are the LZ4 block format's rules.
+#define LZ_LAST_LITERALS 5
+#define LZ_MATCH_LIMIT 12
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+size_t lz_compress_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+static uint32_t read_u32(const char *p) {
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static uint32_t lz_hash(uint32_t x) {
+    return (x * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+namespace {
+
+class lz_writer_t {
+public:
+    lz_writer_t(char *dst, size_t capacity) : dst_(dst), pos_(0), capacity_(capacity) { }
+
+    // Writes one sequence. `match_length` is 0 for the final, literals-only
+    // sequence.
+    bool sequence(const char *literals, size_t literal_length, size_t offset, size_t match_length) {
+        uint8_t literal_nibble = literal_length >= 15 ? 15 : literal_length;
+        size_t match_rest = match_length == 0 ? 0 : match_length - LZ_MIN_MATCH;
+        uint8_t match_nibble = match_rest >= 15 ? 15 : match_rest;
+        if (!put(static_cast<char>((literal_nibble << 4) | match_nibble))) {
+            return false;
+        }
+        if (literal_nibble == 15 && !put_length(literal_length - 15)) {
+            return false;
+        }
+        if (capacity_ - pos_ < literal_length) {
+            return false;
+        }
+        memcpy(dst_ + pos_, literals, literal_length);
+        pos_ += literal_length;
+
+        if (match_length == 0) {
+            return true;
+        }
+        if (!put(static_cast<char>(offset & 0xff)) || !put(static_cast<char>(offset >> 8))) {
+            return false;
+        }
+        return match_nibble < 15 || put_length(match_rest - 15);
+    }
+
+    size_t size() const { return pos_; }
+
+private:
+    bool put(char c) {
+        if (pos_ == capacity_) {
+            return false;
+        }
+        dst_[pos_++] = c;
+        return true;
+    }
+
+    bool put_length(size_t n) {
+        for (; n >= 255; n -= 255) {
+            if (!put(static_cast<char>(255))) {
+                return false;
+            }
+        }
+        return put(static_cast<char>(n));
+    }
+
+    char *dst_;
+    size_t pos_;
+    size_t capacity_;
+};
+
+}  // namespace
+
+size_t lz_compress(const char *src, size_t src_size, char *dst, size_t dst_capacity) {
+    lz_writer_t writer(dst, dst_capacity);
+    size_t anchor = 0;
+
+    if (src_size > LZ_MATCH_LIMIT) {
+        // Positions are stored plus one, so that zero means "nothing yet".
+        std::vector<uint32_t> table(1 << LZ_HASH_BITS, 0);
+        size_t match_start_limit = src_size - LZ_MATCH_LIMIT;
+        size_t match_end_limit = src_size - LZ_LAST_LITERALS;
+
+        size_t pos = 0;
+        while (pos < match_start_limit) {
+            uint32_t seq = read_u32(src + pos);
+            uint32_t *slot = &table[lz_hash(seq)];
+            size_t candidate = *slot;
+            *slot = pos + 1;
+
+            if (candidate == 0 || pos - (candidate - 1) > LZ_MAX_OFFSET || read_u32(src + candidate - 1) != seq) {
+                ++pos;
+                continue;
+            }
+            size_t ref = candidate - 1;
+
+            size_t length = LZ_MIN_MATCH;
+            while (pos + length < match_end_limit && src[ref + length] == src[pos + length]) {
+                ++length;
+            }
+
+            if (!writer.sequence(src + anchor, pos - anchor, pos - ref, length)) {
+                return 0;
+            }
+            pos += length;
+            anchor = pos;
+        }
+    }
+
+    if (!writer.sequence(src + anchor, src_size - anchor, 0, 0)) {
+        return 0;
+    }
+    return writer.size();
+}
+
+bool lz_decompress(const char *src, size_t src_size, char *dst, size_t dst_size) {
+    const uint8_t *in = reinterpret_cast<const uint8_t *>(src);
+    size_t ip = 0, op = 0;
+
+    while (ip < src_size) {
+        uint8_t token = in[ip++];
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15) {
+            uint8_t b;
+            do {
+                if (ip == src_size) {
+                    return false;
+                }
+                b = in[ip++];
+                literal_length += b;
+            } while (b == 255);
+        }
+        if (src_size - ip < literal_length || dst_size - op < literal_length) {
+            return false;
+        }
+        memcpy(dst + op, src + ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        if (ip == src_size) {
+            // The final sequence has no match.
+            break;
+        }
+
+        if (src_size - ip < 2) {
+            return false;
+        }
+        size_t offset = in[ip] | (in[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return false;
+        }
+
+        size_t match_length = token & 15;
+        if (match_length == 15) {
+            uint8_t b;
+            do {
+                if (ip == src_size) {
+                    return false;
+                }
+                b = in[ip++];
+                match_length += b;
+            } while (b == 255);
+        }
+        match_length += LZ_MIN_MATCH;
+        if (dst_size - op < match_length) {
+            return false;
+        }
+        // The match may overlap the bytes it produces, so copy bytewise.
+        for (size_t i = 0; i < match_length; ++i) {
+            dst[op + i] = dst[op - offset + i];
+        }
+        op += match_length;
+    }
+
+    return op == dst_size;
+}
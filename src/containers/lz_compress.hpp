@@ -0,0 +1,26 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef CONTAINERS_LZ_COMPRESS_HPP_
+#define CONTAINERS_LZ_COMPRESS_HPP_
+
+#include <stddef.h>
+
+/* A fast, byte-oriented LZ77 codec that writes the LZ4 block format: a series
+of sequences, each a token byte, some literals, a two-byte back-reference
+offset and a match length. It trades compression ratio for speed, so it's
+meant for data that's about to go over the network or to disk, not for
+archiving. */
+
+/* The most `lz_compress()` can produce from `size` bytes of input. */
+size_t lz_compress_bound(size_t size);
+
+/* Compresses `src` into `dst`. Returns the compressed size, or 0 if the output
+wouldn't fit in `dst_capacity` bytes; pass a smaller capacity than `src_size`
+to only get output that's actually smaller than the input. */
+size_t lz_compress(const char *src, size_t src_size, char *dst, size_t dst_capacity);
+
+/* Decompresses `src` into `dst`. Returns false if `src` is malformed or
+doesn't decompress to exactly `dst_size` bytes; `src` may come straight off
+the network, so it is never trusted. */
+bool lz_decompress(const char *src, size_t src_size, char *dst, size_t dst_size);
+
+#endif  // CONTAINERS_LZ_COMPRESS_HPP_
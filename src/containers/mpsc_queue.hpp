@@ -0,0 +1,130 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef CONTAINERS_MPSC_QUEUE_HPP_
+#define CONTAINERS_MPSC_QUEUE_HPP_
+
+#include "config/args.hpp"
+#include "containers/intrusive_list.hpp"
+#include "errors.hpp"
+
+/* `mpsc_queue_t` is an intrusive lock-free FIFO queue that any number of threads
+can push onto and one thread pops from (Dmitry Vyukov's intrusive MPSC node-based
+queue). Pushing, of a single node or of a whole batch, is one atomic exchange
+and never waits for other threads. Popping takes no atomic operations, except
+when it takes the last node off: then it has to push the stub node back, which
+is a full barrier and an atomic exchange.
+
+The queue doesn't allocate; nodes link to each other through the
+`mpsc_queue_node_t` they derive from, so a node can only be on one
+`mpsc_queue_t` at a time. */
+
+template <class node_t> class mpsc_queue_t;
+
+template <class derived_t>
+class mpsc_queue_node_t {
+public:
+    mpsc_queue_node_t() : mpsc_next_(NULL) { }
+
+private:
+    friend class mpsc_queue_t<derived_t>;
+    mpsc_queue_node_t *volatile mpsc_next_;
+
+    DISABLE_COPYING(mpsc_queue_node_t);
+};
+
+template <class node_t>
+class mpsc_queue_t {
+public:
+    mpsc_queue_t() : head_(&stub_), tail_(&stub_) { }
+    ~mpsc_queue_t() {
+        rassert(empty());
+    }
+
+    /* Can be called on any thread. */
+    void push(node_t *node) {
+        mpsc_queue_node_t<node_t> *n = node;
+        n->mpsc_next_ = NULL;
+        link(n, n);
+    }
+
+    /* Moves all of `list` onto the queue, in order, with a single atomic operation.
+    Can be called on any thread. */
+    void push_all(intrusive_list_t<node_t> *list) {
+        node_t *first = list->head();
+        if (first == NULL) {
+            return;
+        }
+        mpsc_queue_node_t<node_t> *last = NULL;
+        while (node_t *node = list->head()) {
+            list->remove(node);
+            mpsc_queue_node_t<node_t> *n = node;
+            n->mpsc_next_ = NULL;
+            if (last != NULL) {
+                last->mpsc_next_ = n;
+            }
+            last = n;
+        }
+        link(first, last);
+    }
+
+    /* Only the consumer thread may call pop() and empty().
+
+    Returns NULL if the queue is empty, but also if a push() on another thread is
+    only halfway done, in which case whatever it's pushing isn't there yet; the
+    pushing thread has to tell the consumer to try again once push() returns. */
+    node_t *pop() {
+        mpsc_queue_node_t<node_t> *tail = tail_;
+        mpsc_queue_node_t<node_t> *next = tail->mpsc_next_;
+        if (tail == &stub_) {
+            if (next == NULL) {
+                return NULL;
+            }
+            tail_ = next;
+            tail = next;
+            next = next->mpsc_next_;
+        }
+        if (next != NULL) {
+            tail_ = next;
+            return static_cast<node_t *>(tail);
+        }
+        if (tail != head_) {
+            // A push() has swapped in the new head but hasn't linked it to `tail` yet.
+            return NULL;
+        }
+        // `tail` is the last node. Put the stub behind it so that we can take it off.
+        stub_.mpsc_next_ = NULL;
+        link(&stub_, &stub_);
+        next = tail->mpsc_next_;
+        if (next != NULL) {
+            tail_ = next;
+            return static_cast<node_t *>(tail);
+        }
+        return NULL;
+    }
+
+    /* Whether nothing has been pushed that hasn't been popped. Even if this is
+    false, pop() can return NULL while a push() is halfway done. */
+    bool empty() const {
+        return tail_ == &stub_ && head_ == &stub_;
+    }
+
+private:
+    void link(mpsc_queue_node_t<node_t> *first, mpsc_queue_node_t<node_t> *last) {
+        // The nodes must be linked up before anyone can get to them from `head_`.
+        // (__sync_lock_test_and_set() is only an acquire barrier.)
+        __sync_synchronize();
+        mpsc_queue_node_t<node_t> *prev = __sync_lock_test_and_set(&head_, last);
+        prev->mpsc_next_ = first;
+    }
+
+    // Written by pushers. Keep it off the consumer's cache line.
+    mpsc_queue_node_t<node_t> *volatile head_;
+    char padding_[CACHE_LINE_SIZE - sizeof(mpsc_queue_node_t<node_t> *)];
+
+    // Only touched by the consumer (and by pushers when the queue is empty).
+    mpsc_queue_node_t<node_t> *tail_;
+    mpsc_queue_node_t<node_t> stub_;
+
+    DISABLE_COPYING(mpsc_queue_t);
+};
+
+#endif  // CONTAINERS_MPSC_QUEUE_HPP_
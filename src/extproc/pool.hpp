@@ -27,8 +27,11 @@ class pool_group_t
     friend class pool_t;
 
   public:
+    // Each per-thread pool keeps `min_workers` processes around at all times
+    // and spawns more on demand (when every existing worker is busy), up to
+    // `max_workers`.
     static const int DEFAULT_MIN_WORKERS = 2;
-    static const int DEFAULT_MAX_WORKERS = 2;
+    static const int DEFAULT_MAX_WORKERS = 8;
 
     struct config_t {
         config_t()
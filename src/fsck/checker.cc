@@ -8,10 +8,13 @@
 #include <inttypes.h>
 
 #include <algorithm>
+#include <list>
 
 #include "arch/arch.hpp"
 #include "containers/scoped.hpp"
 #include "containers/segmented_vector.hpp"
+#include "serializer/log/compressed_block.hpp"
+#include "serializer/log/delta_page.hpp"
 #include "serializer/log/log_serializer.hpp"
 #include "btree/slice.hpp"
 #include "btree/node.hpp"
@@ -19,6 +22,7 @@
 #include "btree/internal_node.hpp"
 #include "buffer_cache/mirrored/mirrored.hpp"
 #include "fsck/raw_block.hpp"
+#include "fsck/work_pool.hpp"
 #include "memcached/memcached_btree/node.hpp"
 #include "memcached/memcached_btree/value.hpp"
 #include "serializer/translator.hpp"
@@ -27,11 +31,67 @@ namespace fsck {
 
 static const char *state = NULL;
 
+// Counts the blocks we've checked so far, and (if the user asked for it) prints
+// how far along we are every few seconds. Worker threads call add()
+// concurrently.
+class progress_t {
+public:
+    progress_t() : enabled(false), phase(NULL), total(0), checked(0), last_report(0) { }
+
+    void start(bool _enabled, const char *_phase, int64_t _total) {
+        enabled = _enabled;
+        phase = _phase;
+        total = _total;
+        checked = 0;
+        last_report = get_ticks();
+    }
+
+    void add(int64_t n) {
+        int64_t now_checked = __sync_add_and_fetch(&checked, n);
+        if (!enabled) {
+            return;
+        }
+        ticks_t now = get_ticks();
+        ticks_t last = last_report;
+        if (now - last >= secs_to_ticks(FSCK_PROGRESS_INTERVAL_SECS)
+            && __sync_bool_compare_and_swap(&last_report, last, now)) {
+            fprintf(stderr, "PROGRESS %s: %" PRIi64 " of %" PRIi64 " blocks checked (%d%%)\n",
+                    phase, now_checked, total, total > 0 ? static_cast<int>(std::min<int64_t>(100, now_checked * 100 / total)) : 100);
+        }
+    }
+
+    void finish() {
+        if (enabled) {
+            fprintf(stderr, "PROGRESS %s: done, %" PRIi64 " blocks checked\n", phase, checked);
+        }
+    }
+
+private:
+    static const int FSCK_PROGRESS_INTERVAL_SECS = 5;
+
+    bool enabled;
+    const char *phase;
+    int64_t total;
+    int64_t checked;
+    ticks_t last_report;
+};
+
+static progress_t progress;
+
 // Knowledge that we contain for every block id.
 struct block_knowledge_t {
     // The offset found in the LBA.
     flagged_off64_t offset;
 
+    // The offset of the block's delta page, if the LBA says it has one.
+    flagged_off64_t delta_offset;
+
+    // The CRC-32C the LBA has for the block, or 0 if it has none.
+    uint32_t checksum;
+
+    // How many sectors the block takes up if it's compressed, or 0 if it isn't.
+    uint32_t compressed_sectors;
+
     // The serializer block sequence id we saw when we've read the block.
     // Or, NULL_BLOCK_SEQUENCE_ID, if we have not read the block.
     block_sequence_id_t block_sequence_id;
@@ -39,7 +99,7 @@ struct block_knowledge_t {
     static const block_knowledge_t unused;
 };
 
-const block_knowledge_t block_knowledge_t::unused = { flagged_off64_t::unused(), NULL_BLOCK_SEQUENCE_ID };
+const block_knowledge_t block_knowledge_t::unused = { flagged_off64_t::unused(), flagged_off64_t::unused(), 0, 0, NULL_BLOCK_SEQUENCE_ID };
 
 // A safety wrapper to make sure we've learned a value before we try
 // to use it.
@@ -179,23 +239,12 @@ public:
 struct slicecx_t {
     nondirect_file_t *file;
     file_knowledge_t *knog;
-    std::map<block_id_t, std::list<buf_patch_t *> > patch_map;
     const config_t *cfg;
 
     int global_slice_id;
     int local_slice_id;
     int mod_count;
 
-    void clear_buf_patches() {
-        for (std::map<block_id_t, std::list<buf_patch_t *> >::iterator patches = patch_map.begin(); patches != patch_map.end(); ++patches) {
-            for (std::list<buf_patch_t *>::iterator patch = patches->second.begin(); patch != patches->second.end(); ++patch) {
-                delete *patch;
-            }
-        }
-
-        patch_map.clear();
-    }
-
     block_size_t block_size() const {
         return knog->static_config->block_size();
     }
@@ -220,14 +269,72 @@ private:
     DISABLE_COPYING(slicecx_t);
 };
 
+// The patches of one block's delta record, in the order they apply in.
+class patch_list_t {
+public:
+    patch_list_t() { }
+    ~patch_list_t() {
+        for (std::list<buf_patch_t *>::iterator patch = patches.begin(); patch != patches.end(); ++patch) {
+            delete *patch;
+        }
+    }
+
+    std::list<buf_patch_t *> patches;
+
+private:
+    DISABLE_COPYING(patch_list_t);
+};
+
+enum delta_load_result_t { delta_loaded, delta_page_missing, delta_record_missing, delta_record_corrupted };
+
+// Reads the delta record of the block with serializer block id `ser_block_id`
+// (and slice block id `block_id`) from the delta page at `delta_offset`. We
+// read delta records one block at a time, as we need them, so that memory use
+// doesn't grow with the size of the database.
+delta_load_result_t load_delta_patches(nondirect_file_t *file, block_size_t block_size, off64_t delta_offset,
+                                       block_id_t ser_block_id, block_id_t block_id, patch_list_t *patches_out) {
+    block_t page;
+    if (!page.init(block_size, file, delta_offset, DELTA_PAGE_BLOCK_ID)
+        || !check_delta_page(page.buf, block_size)) {
+        return delta_page_missing;
+    }
+
+    std::string record;
+    if (!find_delta_record(page.buf, block_size, ser_block_id, &record)) {
+        return delta_record_missing;
+    }
+
+    size_t offset = 0;
+    while (offset < record.size()) {
+        buf_patch_t *patch;
+        try {
+            patch = buf_patch_t::load_patch(record.data() + offset);
+        } catch (const patch_deserialization_error_t &e) {
+            (void)e;
+            patch = NULL;
+        }
+
+        if (!patch || patch->get_block_id() != block_id) {
+            delete patch;
+            return delta_record_corrupted;
+        }
+        offset += patch->get_serialized_size();
+        patches_out->patches.push_back(patch);
+    }
+
+    // Sort the list to get patches in the right order
+    patches_out->patches.sort(dereferencing_buf_patch_compare_t());
+    return delta_loaded;
+}
+
 // A loader/destroyer of btree blocks, which performs all the
 // error-checking dirty work.
 class btree_block_t : public raw_block_t {
 public:
-    enum { no_block = raw_block_err_count, already_accessed, block_sequence_id_invalid, block_sequence_id_too_large, patch_block_sequence_id_mismatch };
+    enum { no_block = raw_block_err_count, already_accessed, block_sequence_id_invalid, block_sequence_id_too_large, patch_block_sequence_id_mismatch, checksum_mismatch };
 
     static const char *error_name(error code) {
-        static const char *codes[] = {"no block", "already accessed", "bad block sequence id", "block sequence id too large", "patch applies to future revision of the block"};
+        static const char *codes[] = {"no block", "already accessed", "bad block sequence id", "block sequence id too large", "patch applies to future revision of the block", "checksum mismatch"};
         return code >= raw_block_err_count ? codes[code - raw_block_err_count] : raw_block_t::error_name(code);
     }
 
@@ -235,15 +342,12 @@ public:
 
     // Uses and modifies knog->block_info[cx->to_ser_block_id(block_id)].
     bool init(slicecx_t *cx, block_id_t block_id) {
-        std::list<buf_patch_t *> *patches_list = NULL;
-        if (!cx->cfg->ignore_diff_log && cx->patch_map.find(block_id) != cx->patch_map.end()) {
-            patches_list = &cx->patch_map.find(block_id)->second;
-        }
-        return init(cx->file, cx->knog, cx->to_ser_block_id(block_id), patches_list);
+        return init(cx->file, cx->knog, cx->to_ser_block_id(block_id), cx->cfg->ignore_diff_log ? NULL_BLOCK_ID : block_id);
     }
 
-    // Modifies knog->block_info[ser_block_id].
-    bool init(nondirect_file_t *file, file_knowledge_t *knog, block_id_t ser_block_id, std::list<buf_patch_t *> *patches_list = NULL) {
+    // Modifies knog->block_info[ser_block_id]. Unless `patch_block_id` is
+    // NULL_BLOCK_ID, replays the patches from the block's delta record.
+    bool init(nondirect_file_t *file, file_knowledge_t *knog, block_id_t ser_block_id, block_id_t patch_block_id = NULL_BLOCK_ID) {
         block_knowledge_t info;
         {
             read_locker_t locker(knog);
@@ -262,11 +366,14 @@ public:
             return false;
         }
 
-        if (!raw_block_t::init(knog->static_config->block_size(), file, info.offset.get_value(), ser_block_id)) {
+        if (!raw_block_t::init(knog->static_config->block_size(), file, info.offset.get_value(), ser_block_id, info.compressed_sectors)) {
             return false;
         }
 
-
+        if (info.checksum != 0 && lba_block_checksum(realbuf, knog->static_config->block_size().ser_value()) != info.checksum) {
+            err = checksum_mismatch;
+            return false;
+        }
 
         block_sequence_id_t bseq_id = realbuf->block_sequence_id;
         if (bseq_id <= NULL_BLOCK_SEQUENCE_ID) {
@@ -278,9 +385,13 @@ public:
         }
 
 
-        if (patches_list) {
-            // Replay patches
-            for (std::list<buf_patch_t *>::iterator patch = patches_list->begin(); patch != patches_list->end(); ++patch) {
+        if (patch_block_id != NULL_BLOCK_ID && info.delta_offset.has_value()) {
+            // Replay patches. (If the delta record can't be loaded, we check
+            // the block without it; check_diff_log() reports the problem.)
+            patch_list_t patches_list;
+            load_delta_patches(file, knog->static_config->block_size(), info.delta_offset.get_value(),
+                               ser_block_id, patch_block_id, &patches_list);
+            for (std::list<buf_patch_t *>::iterator patch = patches_list.patches.begin(); patch != patches_list.patches.end(); ++patch) {
                 block_sequence_id_t first_matching_id = NULL_BLOCK_SEQUENCE_ID;
                 if ((*patch)->get_block_sequence_id() >= realbuf->block_sequence_id) {
                     if (first_matching_id == NULL_BLOCK_SEQUENCE_ID) {
@@ -298,8 +409,15 @@ public:
         // the main reason we have this btree_block_t abstraction.)
         {
             write_locker_t locker(knog);
+            // Another thread may have gotten to the block while we were
+            // reading it, if two nodes point at it.
+            if (locker.block_info()[ser_block_id].block_sequence_id != NULL_BLOCK_SEQUENCE_ID) {
+                err = already_accessed;
+                return false;
+            }
             locker.block_info()[ser_block_id].block_sequence_id = bseq_id;
         }
+        progress.add(1);
 
         err = none;
         return true;
@@ -501,8 +619,10 @@ bool is_valid_extent(file_knowledge_t *knog, off64_t offset) {
     return is_valid_offset(knog, offset, knog->static_config->extent_size());
 }
 
+// Blocks start at any sector of a data extent, since compressed ones take up fewer
+// sectors than a block.
 bool is_valid_btree_offset(file_knowledge_t *knog, flagged_off64_t offset) {
-    return !offset.has_value() || is_valid_offset(knog, offset.get_value(), knog->static_config->block_size().ser_value());
+    return !offset.has_value() || is_valid_offset(knog, offset.get_value(), DEVICE_BLOCK_SIZE);
 }
 
 bool is_valid_device_block(file_knowledge_t *knog, off64_t offset) {
@@ -556,7 +676,8 @@ bool check_lba_extent(nondirect_file_t *file, file_knowledge_t *knog, unsigned i
             errs->bad_block_id_count++;
         } else if (entry.block_id % LBA_SHARD_FACTOR != shard_number) {
             errs->wrong_shard_count++;
-        } else if (!is_valid_btree_offset(knog, entry.offset)) {
+        } else if (!is_valid_btree_offset(knog, entry.offset)
+                   || (entry.get_delta_offset().has_value() && !is_valid_btree_offset(knog, entry.get_delta_offset()))) {
             errs->bad_offset_count++;
         } else {
             write_locker_t locker(knog);
@@ -564,6 +685,9 @@ bool check_lba_extent(nondirect_file_t *file, file_knowledge_t *knog, unsigned i
                 locker.block_info().set_size(entry.block_id + 1, block_knowledge_t::unused);
             }
             locker.block_info()[entry.block_id].offset = entry.offset;
+            locker.block_info()[entry.block_id].delta_offset = entry.get_delta_offset();
+            locker.block_info()[entry.block_id].checksum = entry.checksum;
+            locker.block_info()[entry.block_id].compressed_sectors = entry.get_compressed_sectors();
         }
     }
 
@@ -733,79 +857,55 @@ bool check_multiplexed_config_block(nondirect_file_t *file, file_knowledge_t *kn
 }
 
 struct diff_log_errors {
-    int missing_log_block_count; // must be 0
-    int deleted_log_block_count; // must be 0
+    int missing_delta_page_count; // must be 0
+    int missing_delta_record_count; // must be 0
     int non_sequential_logs; // must be 0
     int corrupted_patch_blocks; // must be 0
 
-    diff_log_errors() : missing_log_block_count(0), deleted_log_block_count(0), non_sequential_logs(0), corrupted_patch_blocks(0) { }
+    diff_log_errors() : missing_delta_page_count(0), missing_delta_record_count(0), non_sequential_logs(0), corrupted_patch_blocks(0) { }
 };
 
-void check_and_load_diff_log(slicecx_t *cx, diff_log_errors *errs) {
-    cx->clear_buf_patches();
-
-    const unsigned int log_size = cx->knog->mc_config_block->cache.n_patch_log_blocks;
-
-    for (block_id_t block_id = MC_CONFIGBLOCK_ID + 1; block_id < MC_CONFIGBLOCK_ID + 1 + log_size; ++block_id) {
-        block_id_t ser_block_id = cx->to_ser_block_id(block_id);
+// Checks the delta record of every block that has one, one block at a time.
+void check_diff_log(slicecx_t *cx, diff_log_errors *errs) {
+    block_id_t end;
+    {
+        read_locker_t locker(cx->knog);
+        end = locker.block_info().get_size();
+    }
 
+    for (block_id_t id_iter = 0, id = cx->to_ser_block_id(0);
+         id < end;
+         id = cx->to_ser_block_id(++id_iter)) {
         block_knowledge_t info;
         {
             read_locker_t locker(cx->knog);
-            if (ser_block_id >= locker.block_info().get_size()) {
-                ++errs->missing_log_block_count;
-                continue;
-            }
-            info = locker.block_info()[ser_block_id];
+            info = locker.block_info()[id];
         }
-
-        if (info.offset.has_value()) {
-            block_t b;
-            b.init(cx->block_size(), cx->file, info.offset.get_value(), ser_block_id);
-            {
-                write_locker_t locker(cx->knog);
-                locker.block_info()[ser_block_id].block_sequence_id = b.realbuf->block_sequence_id;
-            }
-
-            const void *buf_data = b.buf;
-
-            if (*reinterpret_cast<const block_magic_t *>(buf_data) == log_block_magic) {
-                uint16_t current_offset = sizeof(log_block_magic);
-                while (current_offset + buf_patch_t::get_min_serialized_size() < cx->block_size().value()) {
-                    buf_patch_t *patch;
-                    try {
-                        patch = buf_patch_t::load_patch(reinterpret_cast<const char *>(buf_data) + current_offset);
-                    } catch (const patch_deserialization_error_t &e) {
-                        (void)e;
-                        ++errs->corrupted_patch_blocks;
-                        break;
-                    }
-
-                    if (!patch) {
-                        break;
-                    } else {
-                        current_offset += patch->get_serialized_size();
-                        cx->patch_map[patch->get_block_id()].push_back(patch);
-                    }
-                }
-            } else {
-                ++errs->missing_log_block_count;
-            }
-
-        } else {
-            ++errs->deleted_log_block_count;
+        if (!info.delta_offset.has_value()) {
+            continue;
         }
-    }
-
 
-    for (std::map<block_id_t, std::list<buf_patch_t *> >::iterator patch_list = cx->patch_map.begin(); patch_list != cx->patch_map.end(); ++patch_list) {
-        // Sort the list to get patches in the right order
-        patch_list->second.sort(dereferencing_buf_patch_compare_t());
+        patch_list_t patch_list;
+        switch (load_delta_patches(cx->file, cx->block_size(), info.delta_offset.get_value(), id, id_iter, &patch_list)) {
+        case delta_loaded:
+            break;
+        case delta_page_missing:
+            ++errs->missing_delta_page_count;
+            continue;
+        case delta_record_missing:
+            ++errs->missing_delta_record_count;
+            continue;
+        case delta_record_corrupted:
+            ++errs->corrupted_patch_blocks;
+            continue;
+        default:
+            unreachable();
+        }
 
         // Verify patches list
         block_sequence_id_t previous_block_sequence = 0;
         patch_counter_t previous_patch_counter = 0;
-        for (std::list<buf_patch_t *>::const_iterator p = patch_list->second.begin(); p != patch_list->second.end(); ++p) {
+        for (std::list<buf_patch_t *>::const_iterator p = patch_list.patches.begin(); p != patch_list.patches.end(); ++p) {
             if (previous_block_sequence == 0 || (*p)->get_block_sequence_id() != previous_block_sequence) {
                 previous_patch_counter = 0;
             }
@@ -854,11 +954,15 @@ struct subtree_errors {
         return !node_errors.empty();
     }
 
+    // Called concurrently by the threads walking the tree.
     void add_error(const node_error& error) {
+        system_mutex_t::lock_t lock(&node_errors_lock);
         node_errors.push_back(error);
     }
 
 private:
+    system_mutex_t node_errors_lock;
+
     DISABLE_COPYING(subtree_errors);
 };
 
@@ -896,7 +1000,7 @@ private:
 };
 
 bool construct_sizer_from_magic(block_size_t bs, block_magic_t magic, scoped_ptr_t< value_sizer_t<void> > *sizer) {
-    if (magic == value_sizer_t<memcached_value_t>::leaf_magic()) {
+    if (leaf::unprefixed_magic(magic) == value_sizer_t<memcached_value_t>::leaf_magic()) {
         sizer->init(new value_sizer_t<memcached_value_t>(bs));
         return true;
     } else {
@@ -942,9 +1046,9 @@ bool internal_node_begin_offset_in_range(const slicecx_t *cx, const internal_nod
         offset + sizeof(btree_internal_pair) + reinterpret_cast<const btree_internal_pair *>(reinterpret_cast<const char *>(buf) + offset)->key.size <= cx->block_size().value();
 }
 
-void check_subtree(slicecx_t *cx, block_id_t id, const btree_key_t *lo, const btree_key_t *hi, subtree_errors *errs);
+void spawn_check_subtree(work_pool_t *pool, int worker, slicecx_t *cx, block_id_t id, const btree_key_t *lo, const btree_key_t *hi, subtree_errors *errs);
 
-void check_subtree_internal_node(slicecx_t *cx, const internal_node_t *buf, const btree_key_t *lo, const btree_key_t *hi, subtree_errors *tree_errs, node_error *errs) {
+void check_subtree_internal_node(work_pool_t *pool, int worker, slicecx_t *cx, const internal_node_t *buf, const btree_key_t *lo, const btree_key_t *hi, subtree_errors *tree_errs, node_error *errs) {
     {
         std::vector<uint16_t> sorted_offsets(buf->pair_offsets, buf->pair_offsets + buf->npairs);
         std::sort(sorted_offsets.begin(), sorted_offsets.end());
@@ -976,9 +1080,9 @@ void check_subtree_internal_node(slicecx_t *cx, const internal_node_t *buf, cons
             if (errs->out_of_order) {
                 // It's not like we can restrict a subtree when our
                 // keys are out of order.
-                check_subtree(cx, pair->lnode, NULL, NULL, tree_errs);
+                spawn_check_subtree(pool, worker, cx, pair->lnode, NULL, NULL, tree_errs);
             } else {
-                check_subtree(cx, pair->lnode, prev_key, &pair->key, tree_errs);
+                spawn_check_subtree(pool, worker, cx, pair->lnode, prev_key, &pair->key, tree_errs);
             }
         } else {
             errs->last_internal_node_key_nonempty = (pair->key.size != 0);
@@ -986,9 +1090,9 @@ void check_subtree_internal_node(slicecx_t *cx, const internal_node_t *buf, cons
             errs->out_of_order |= !(prev_key == NULL || hi == NULL || internal_key_comp::compare(prev_key, hi) <= 0);
 
             if (errs->out_of_order) {
-                check_subtree(cx, pair->lnode, NULL, NULL, tree_errs);
+                spawn_check_subtree(pool, worker, cx, pair->lnode, NULL, NULL, tree_errs);
             } else {
-                check_subtree(cx, pair->lnode, prev_key, hi, tree_errs);
+                spawn_check_subtree(pool, worker, cx, pair->lnode, prev_key, hi, tree_errs);
             }
         }
 
@@ -996,8 +1100,9 @@ void check_subtree_internal_node(slicecx_t *cx, const internal_node_t *buf, cons
     }
 }
 
-void check_subtree(slicecx_t *cx, block_id_t id, const btree_key_t *lo, const btree_key_t *hi, subtree_errors *errs) {
-    /* Walk tree */
+void check_subtree(work_pool_t *pool, int worker, slicecx_t *cx, block_id_t id, const btree_key_t *lo, const btree_key_t *hi, subtree_errors *errs) {
+    /* Walk tree. Children get checked by tasks of their own, so that idle
+    threads can steal whole subtrees. */
 
     btree_block_t node;
     if (!node.init(cx, id)) {
@@ -1010,7 +1115,7 @@ void check_subtree(slicecx_t *cx, block_id_t id, const btree_key_t *lo, const bt
     node_error node_err(id);
 
     if (reinterpret_cast<internal_node_t *>(node.buf)->magic == internal_node_t::expected_magic) {
-        check_subtree_internal_node(cx, reinterpret_cast<internal_node_t *>(node.buf), lo, hi, errs, &node_err);
+        check_subtree_internal_node(pool, worker, cx, reinterpret_cast<internal_node_t *>(node.buf), lo, hi, errs, &node_err);
     } else {
 
         scoped_ptr_t< value_sizer_t<void> > sizer_ignore;
@@ -1028,6 +1133,32 @@ void check_subtree(slicecx_t *cx, block_id_t id, const btree_key_t *lo, const bt
     }
 }
 
+// Checks one subtree. The keys bounding it are copied, since the node they
+// came from is gone by the time the task runs.
+class subtree_task_t : public work_task_t {
+public:
+    subtree_task_t(slicecx_t *_cx, block_id_t _id, const btree_key_t *_lo, const btree_key_t *_hi, subtree_errors *_errs)
+        : cx(_cx), id(_id), has_lo(_lo != NULL), has_hi(_hi != NULL), errs(_errs) {
+        if (has_lo) lo.assign(_lo);
+        if (has_hi) hi.assign(_hi);
+    }
+
+    void run(work_pool_t *pool, int worker) {
+        check_subtree(pool, worker, cx, id, has_lo ? lo.btree_key() : NULL, has_hi ? hi.btree_key() : NULL, errs);
+    }
+
+private:
+    slicecx_t *cx;
+    block_id_t id;
+    bool has_lo, has_hi;
+    store_key_t lo, hi;
+    subtree_errors *errs;
+};
+
+void spawn_check_subtree(work_pool_t *pool, int worker, slicecx_t *cx, block_id_t id, const btree_key_t *lo, const btree_key_t *hi, subtree_errors *errs) {
+    pool->spawn(new subtree_task_t(cx, id, lo, hi, errs), worker);
+}
+
 static const block_magic_t Zilch = { { 0, 0, 0, 0 } };
 
 struct rogue_block_description {
@@ -1098,9 +1229,11 @@ struct slice_errors {
     }
 };
 
-//nondirect_file_t *file, file_knowledge_t *knog, int global_slice_number, slice_errors *errs, const config_t *cfg) {
-void check_slice(slicecx_t *cx, slice_errors *errs) {
-    check_and_load_diff_log(cx, &errs->diff_log_errs);
+// Checks the diff log and the btree of a slice. Only the root gets checked
+// here; the rest of the tree is checked by the tasks spawned for its children,
+// so the slice isn't done until the pool has run dry.
+void check_slice(work_pool_t *pool, int worker, slicecx_t *cx, slice_errors *errs) {
+    check_diff_log(cx, &errs->diff_log_errs);
 
     block_id_t root_block_id;
     {
@@ -1118,12 +1251,236 @@ void check_slice(slicecx_t *cx, slice_errors *errs) {
     }
 
     if (root_block_id != NULL_BLOCK_ID) {
-        check_subtree(cx, root_block_id, NULL, NULL, &errs->tree_errs);
+        spawn_check_subtree(pool, worker, cx, root_block_id, NULL, NULL, &errs->tree_errs);
     }
+}
 
-    check_slice_other_blocks(cx, &errs->other_block_errs);
+class slice_task_t : public work_task_t {
+public:
+    slice_task_t(slicecx_t *_cx, slice_errors *_errs) : cx(_cx), errs(_errs) { }
+    void run(work_pool_t *pool, int worker) {
+        check_slice(pool, worker, cx, errs);
+    }
+private:
+    slicecx_t *cx;
+    slice_errors *errs;
+};
+
+// Looks for orphan blocks. This has to wait until every tree has been walked.
+class slice_other_blocks_task_t : public work_task_t {
+public:
+    slice_other_blocks_task_t(slicecx_t *_cx, slice_errors *_errs) : cx(_cx), errs(_errs) { }
+    void run(UNUSED work_pool_t *pool, UNUSED int worker) {
+        if (errs->superblock_code == btree_block_t::none && !errs->superblock_bad_magic) {
+            check_slice_other_blocks(cx, &errs->other_block_errs);
+        }
+    }
+private:
+    slicecx_t *cx;
+    slice_errors *errs;
+};
 
-    cx->clear_buf_patches();
+// A slice to check, and where its errors go.
+struct slice_check_t {
+    scoped_ptr_t<slicecx_t> cx;
+    slice_errors *errs;
+    slice_check_t() : errs(NULL) { }
+};
+
+// The fast check. Instead of walking the btrees, it reads the data extents
+// front to back in large direct reads and checks that every block the LBA
+// points at is there, and that every delta page holds the delta records the LBA
+// says it does. It doesn't look at the contents of the blocks.
+
+struct scan_errors {
+    std::string filename;
+    int bad_block_id_count;  // must be 0
+    int bad_sequence_id_count;  // must be 0
+    int bad_delta_page_count;  // must be 0
+    int missing_delta_record_count;  // must be 0
+    int bad_checksum_count;  // must be 0
+    int total_count;
+
+    scan_errors() : bad_block_id_count(0), bad_sequence_id_count(0), bad_delta_page_count(0),
+                    missing_delta_record_count(0), bad_checksum_count(0), total_count(0) { }
+};
+
+// Something the LBA says is at `offset`: either block `block_id` itself, or
+// (if `is_delta`) the delta page holding `block_id`'s delta record.
+struct scan_entry_t {
+    off64_t offset;
+    bool is_delta;
+    block_id_t block_id;
+    uint32_t checksum;  // the LBA's checksum for the block; unused if `is_delta`
+    uint32_t compressed_sectors;  // 0 unless the block is compressed; 0 if `is_delta`
+
+    // How many bytes starting at `offset` this takes up on disk.
+    off64_t size(block_size_t block_size) const {
+        return compressed_sectors == 0 ? block_size.ser_value() : compressed_sectors * DEVICE_BLOCK_SIZE;
+    }
+
+    bool operator<(const scan_entry_t &other) const {
+        if (offset != other.offset) return offset < other.offset;
+        if (is_delta != other.is_delta) return !is_delta;
+        return block_id < other.block_id;
+    }
+};
+
+class scan_chunk_task_t : public work_task_t {
+public:
+    scan_chunk_task_t(direct_file_t *_file, file_knowledge_t *_knog, scan_errors *_errs)
+        : file(_file), knog(_knog), errs(_errs) { }
+
+    std::vector<scan_entry_t> entries;
+
+    void run(UNUSED work_pool_t *pool, UNUSED int worker) {
+        rassert(!entries.empty());
+        const block_size_t block_size = knog->static_config->block_size();
+        const off64_t start = entries.front().offset;
+        off64_t end = start;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            end = std::max(end, entries[i].offset + entries[i].size(block_size));
+        }
+        const off64_t length = end - start;
+
+        char *chunk = reinterpret_cast<char *>(malloc_aligned(length, DEVICE_BLOCK_SIZE));
+        file->read_blocking(start, length, chunk);
+        char *uncompressed = NULL;
+
+        int64_t blocks_checked = 0;
+        off64_t checked_page_offset = -1;
+        bool page_ok = false;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const scan_entry_t &e = entries[i];
+            const ls_buf_data_t *header = reinterpret_cast<const ls_buf_data_t *>(chunk + (e.offset - start));
+            if (!e.is_delta) {
+                ++blocks_checked;
+                if (header->block_id != e.block_id) {
+                    __sync_add_and_fetch(&errs->bad_block_id_count, 1);
+                } else if (header->block_sequence_id <= NULL_BLOCK_SEQUENCE_ID
+                           || header->block_sequence_id > knog->metablock->block_sequence_id) {
+                    __sync_add_and_fetch(&errs->bad_sequence_id_count, 1);
+                } else if (e.compressed_sectors == 0) {
+                    if (e.checksum != 0 && lba_block_checksum(header, block_size.ser_value()) != e.checksum) {
+                        __sync_add_and_fetch(&errs->bad_checksum_count, 1);
+                    }
+                } else {
+                    // The checksum is of the block before it got compressed, and a block
+                    // that doesn't decompress is just as damaged as one that doesn't match.
+                    if (!uncompressed) {
+                        uncompressed = reinterpret_cast<char *>(malloc(block_size.ser_value()));
+                    }
+                    if (!decompress_block(header, e.compressed_sectors, block_size, uncompressed)
+                        || (e.checksum != 0 && lba_block_checksum(uncompressed, block_size.ser_value()) != e.checksum)) {
+                        __sync_add_and_fetch(&errs->bad_checksum_count, 1);
+                    }
+                }
+            } else {
+                if (e.offset != checked_page_offset) {
+                    checked_page_offset = e.offset;
+                    page_ok = header->block_id == DELTA_PAGE_BLOCK_ID && check_delta_page(header + 1, block_size);
+                }
+                std::string record;
+                if (!page_ok) {
+                    __sync_add_and_fetch(&errs->bad_delta_page_count, 1);
+                } else if (!find_delta_record(header + 1, block_size, e.block_id, &record)) {
+                    __sync_add_and_fetch(&errs->missing_delta_record_count, 1);
+                }
+            }
+        }
+        free(uncompressed);
+        free(chunk);
+        progress.add(blocks_checked);
+    }
+
+private:
+    direct_file_t *file;
+    file_knowledge_t *knog;
+    scan_errors *errs;
+};
+
+// Splits everything the LBA points at in `knog`'s file into chunks of at most
+// FSCK_SCAN_CHUNK_SIZE bytes and spawns a task to scan each of them.
+void spawn_scan_file(work_pool_t *pool, direct_file_t *file, file_knowledge_t *knog, scan_errors *errs) {
+    const block_size_t block_size = knog->static_config->block_size();
+
+    std::vector<scan_entry_t> entries;
+    {
+        read_locker_t locker(knog);
+        for (block_id_t id = 0, end = locker.block_info().get_size(); id < end; ++id) {
+            const block_knowledge_t &info = locker.block_info()[id];
+            if (!info.offset.has_value()) {
+                continue;
+            }
+            scan_entry_t e;
+            e.block_id = id;
+            e.offset = info.offset.get_value();
+            e.is_delta = false;
+            e.checksum = info.checksum;
+            e.compressed_sectors = info.compressed_sectors;
+            entries.push_back(e);
+            if (info.delta_offset.has_value()) {
+                e.offset = info.delta_offset.get_value();
+                e.is_delta = true;
+                e.compressed_sectors = 0;
+                entries.push_back(e);
+            }
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    scan_chunk_task_t *task = NULL;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const scan_entry_t &e = entries[i];
+        if (uint64_t(e.offset + e.size(block_size)) > *knog->filesize) {
+            // check_lba_extent() makes sure this doesn't happen, unless the
+            // file size isn't a multiple of the block size.
+            ++errs->bad_block_id_count;
+            continue;
+        }
+        errs->total_count += !e.is_delta;
+
+        if (task && e.offset != task->entries.back().offset
+            && e.offset + e.size(block_size) - task->entries.front().offset > FSCK_SCAN_CHUNK_SIZE) {
+            pool->spawn(task, -1);
+            task = NULL;
+        }
+        if (!task) {
+            task = new scan_chunk_task_t(file, knog, errs);
+        }
+        task->entries.push_back(e);
+    }
+    if (task) {
+        pool->spawn(task, -1);
+    }
+}
+
+bool report_scan_errors(const scan_errors *errs) {
+    std::string s = std::string("(in file '") + errs->filename + "')";
+    state = s.c_str();
+
+    bool ok = true;
+    if (errs->bad_block_id_count > 0) {
+        printf("ERROR %s %d of %d blocks in the LBA are missing from their offset\n", state, errs->bad_block_id_count, errs->total_count);
+        ok = false;
+    }
+    if (errs->bad_sequence_id_count > 0) {
+        printf("ERROR %s %d of %d blocks have a bad block sequence id\n", state, errs->bad_sequence_id_count, errs->total_count);
+        ok = false;
+    }
+    if (errs->bad_delta_page_count > 0) {
+        printf("ERROR %s %d blocks have a delta page that is missing or corrupted\n", state, errs->bad_delta_page_count);
+        ok = false;
+    }
+    if (errs->missing_delta_record_count > 0) {
+        printf("ERROR %s %d blocks have no delta record on their delta page\n", state, errs->missing_delta_record_count);
+        ok = false;
+    }
+    if (errs->bad_checksum_count > 0) {
+        printf("ERROR %s %d of %d blocks don't match their checksums\n", state, errs->bad_checksum_count, errs->total_count);
+        ok = false;
+    }
+    return ok;
 }
 
 struct check_to_config_block_errors {
@@ -1198,36 +1555,24 @@ struct all_slices_errors_t {
     }
 };
 
-struct slice_parameter_t {
-    scoped_ptr_t<slicecx_t> cx;
-    slice_errors *errs;
-};
-
-void *do_check_slice(void *slice_param) {
-    slice_parameter_t *p = static_cast<slice_parameter_t *>(slice_param);
-    check_slice(p->cx.get(), p->errs);
-    delete p;
-    return NULL;
-}
-
-void launch_check_slice(std::vector<pthread_t> *threads, scoped_ptr_t<slicecx_t> *cx, slice_errors *errs) {
-    // add another thread.
-    threads->push_back(pthread_t());
-    slice_parameter_t *param = new slice_parameter_t;
-    param->cx.init(cx->release());
-    param->errs = errs;
-    int res = pthread_create(&threads->back(), NULL, do_check_slice, param);
-    guarantee_err(res == 0, "pthread_create not working");
-}
-
-void launch_check_after_config_block(nondirect_file_t *file, std::vector<pthread_t> *threads, file_knowledge_t *knog, all_slices_errors_t *errs, const config_t *cfg) {
+// Sets up the checks of the slices that live in `file`.
+void add_slice_checks(nondirect_file_t *file, file_knowledge_t *knog, all_slices_errors_t *errs, const config_t *cfg, scoped_array_t<slice_check_t> *checks) {
     int step = knog->config_block->n_files;
     for (int i = knog->config_block->this_serializer; i < errs->n_slices(); i += step) {
         errs->slice[i].global_slice_number = i;
         errs->slice[i].home_filename = knog->filename;
-        scoped_ptr_t<slicecx_t> cx(new slicecx_t(file, knog, i, cfg));
-        launch_check_slice(threads, &cx, &errs->slice[i]);
+        (*checks)[i].cx.init(new slicecx_t(file, knog, i, cfg));
+        (*checks)[i].errs = &errs->slice[i];
+    }
+}
+
+int64_t count_live_blocks(file_knowledge_t *knog) {
+    read_locker_t locker(knog);
+    int64_t count = 0;
+    for (block_id_t id = 0, end = locker.block_info().get_size(); id < end; ++id) {
+        count += locker.block_info()[id].offset.has_value();
     }
+    return count;
 }
 
 void report_pre_config_block_errors(const check_to_config_block_errors& errs) {
@@ -1400,12 +1745,12 @@ bool report_other_block_errors(const other_block_errors *errs) {
 bool report_diff_log_errors(const diff_log_errors *errs) {
     bool ok = true;
 
-    if (errs->deleted_log_block_count > 0) {
-        printf("ERROR %s %d diff log blocks have been deleted\n", state, errs->deleted_log_block_count);
+    if (errs->missing_delta_page_count > 0) {
+        printf("ERROR %s %d blocks have a delta page that is missing or corrupted\n", state, errs->missing_delta_page_count);
         ok = false;
     }
-    if (errs->missing_log_block_count > 0) {
-        printf("ERROR %s %d diff log blocks are missing (maybe n_log_blocks in the config_block is too large?)\n", state, errs->missing_log_block_count);
+    if (errs->missing_delta_record_count > 0) {
+        printf("ERROR %s %d blocks have no delta record on their delta page\n", state, errs->missing_delta_record_count);
         ok = false;
     }
     if (errs->non_sequential_logs > 0) {
@@ -1413,7 +1758,7 @@ bool report_diff_log_errors(const diff_log_errors *errs) {
         ok = false;
     }
     if (errs->corrupted_patch_blocks > 0) {
-        printf("ERROR %s %d blocks of the diff log contain at least one corrupted patch\n", state, errs->corrupted_patch_blocks);
+        printf("ERROR %s %d delta records contain at least one corrupted patch\n", state, errs->corrupted_patch_blocks);
         ok = false;
     }
 
@@ -1462,24 +1807,6 @@ std::string extract_slices_flags(const multiplexer_config_block_t& c) {
     return strprintf(" -s %d", c.n_proxies);
 }
 
-std::string extract_cache_flags(nondirect_file_t *file, const multiplexer_config_block_t& c, const mc_config_block_t& mcc) {
-    // TODO: This is evil code replication, just because we need the block size...
-    block_t header;
-    if (!header.init(DEVICE_BLOCK_SIZE, file, 0)) {
-        return " --diff-log-size intentionally-invalid";
-    }
-    static_header_t *buf = reinterpret_cast<static_header_t *>(header.realbuf);
-    log_serializer_on_disk_static_config_t *static_cfg = reinterpret_cast<log_serializer_on_disk_static_config_t *>(buf + 1);
-    block_size_t block_size = static_cfg->block_size();
-
-
-    // Convert total number of log blocks to MB
-    int64_t diff_log_size = int64_t(mcc.cache.n_patch_log_blocks) * int64_t(c.n_proxies) * int64_t(block_size.ser_value());
-    int64_t diff_log_size_mb = ceil_divide(diff_log_size, MEGABYTE);
-
-    return strprintf(" --diff-log-size %" PRId64, diff_log_size_mb);
-}
-
 bool check_files(const config_t *cfg) {
     scoped_ptr_t<io_backender_t> backender;
     make_io_backender(cfg->io_backend, &backender);
@@ -1528,31 +1855,76 @@ bool check_files(const config_t *cfg) {
         std::string flags("FLAGS: ");
         flags.append(extract_static_config_flags(knog.files[0].get(), knog.file_knog[0].get()));
         flags.append(extract_slices_flags(*knog.file_knog[0]->config_block));
-        flags.append(extract_cache_flags(knog.files[0].get(), *knog.file_knog[0]->config_block, *knog.file_knog[0]->mc_config_block));
         printf("%s\n", flags.c_str());
         return true;
     }
 
     print_interfile_summary(*knog.file_knog[0]->config_block, *knog.file_knog[0]->mc_config_block);
 
-    // A thread for every slice.
+    work_pool_t pool(cfg->n_threads > 0 ? cfg->n_threads : get_cpu_count());
+
+    std::vector<file_knowledge_t *> all_knogs;
+    for (int i = 0; i < num_files; ++i) {
+        all_knogs.push_back(knog.file_knog[i].get());
+    }
+    if (knog.metadata_file.has()) {
+        all_knogs.push_back(knog.metadata_file_knog.get());
+    }
+
+    int64_t live_blocks = 0;
+    for (size_t i = 0; i < all_knogs.size(); ++i) {
+        live_blocks += count_live_blocks(all_knogs[i]);
+    }
+
+    if (cfg->fast_check) {
+        // Read every file front to back, with the reads spread over the pool.
+        scoped_array_t<scoped_ptr_t<direct_file_t> > direct_files(all_knogs.size());
+        scoped_array_t<scan_errors> scan_errs(all_knogs.size());
+        progress.start(cfg->print_progress, "scan", live_blocks);
+        for (size_t i = 0; i < all_knogs.size(); ++i) {
+            direct_files[i].init(new direct_file_t(all_knogs[i]->filename.c_str(), direct_file_t::mode_read, backender.get()));
+            scan_errs[i].filename = all_knogs[i]->filename;
+            spawn_scan_file(&pool, direct_files[i].get(), all_knogs[i], &scan_errs[i]);
+        }
+        pool.run();
+        progress.finish();
+
+        bool ok = true;
+        for (size_t i = 0; i < all_knogs.size(); ++i) {
+            ok &= report_scan_errors(&scan_errs[i]);
+        }
+        return ok;
+    }
+
     int n_slices = knog.file_knog[0]->config_block->n_proxies;
-    std::vector<pthread_t> threads;
     all_slices_errors_t slices_errs(n_slices, knog.metadata_file.has());
+    scoped_array_t<slice_check_t> checks(n_slices + (knog.metadata_file.has() ? 1 : 0));
     for (int i = 0; i < num_files; ++i) {
-        launch_check_after_config_block(knog.files[i].get(), &threads, knog.file_knog[i].get(), &slices_errs, cfg);
+        add_slice_checks(knog.files[i].get(), knog.file_knog[i].get(), &slices_errs, cfg, &checks);
     }
 
-    // ... and one for the metadata slice
+    // ... and the metadata slice
     if (knog.metadata_file.has()) {
-        scoped_ptr_t<slicecx_t> cx(new slicecx_t(knog.metadata_file.get(), knog.metadata_file_knog.get(), 0, cfg));
-        launch_check_slice(&threads, &cx, slices_errs.metadata_slice.get());
+        checks[n_slices].cx.init(new slicecx_t(knog.metadata_file.get(), knog.metadata_file_knog.get(), 0, cfg));
+        checks[n_slices].errs = slices_errs.metadata_slice.get();
     }
 
-    // Wait for all threads to finish.
-    for (unsigned i = 0; i < threads.size(); ++i) {
-        guarantee_err(!pthread_join(threads[i], NULL), "pthread_join failing");
+    // Walk all the trees at once, then look for the blocks none of them reached.
+    progress.start(cfg->print_progress, "btree check", live_blocks);
+    // (A slice has no context if its file is missing from the command line.)
+    for (int i = 0; i < checks.size(); ++i) {
+        if (checks[i].cx.has()) {
+            pool.spawn(new slice_task_t(checks[i].cx.get(), checks[i].errs), -1);
+        }
+    }
+    pool.run();
+    for (int i = 0; i < checks.size(); ++i) {
+        if (checks[i].cx.has()) {
+            pool.spawn(new slice_other_blocks_task_t(checks[i].cx.get(), checks[i].errs), -1);
+        }
     }
+    pool.run();
+    progress.finish();
 
     return report_post_config_block_errors(slices_errs);
 }
@@ -45,6 +45,12 @@ namespace fsck {
     in use.  (supremacy check)
 
   - that the patches in the diff storage are sequentially numbered
+
+  With `fast_check`, we don't walk the btrees. We check the static
+  header, metablocks, LBA and config blocks as usual, then read each
+  file sequentially and check that every block the LBA points at
+  carries the right block id and a plausible block sequence id, and
+  that every delta page holds the delta records pointing at it.
 */
 
 struct config_t {
@@ -52,12 +58,17 @@ struct config_t {
     std::string metadata_filename;
     std::string log_file_name;
     bool ignore_diff_log;
+    bool fast_check;
+
+    // The number of threads to check with; 0 means one per CPU.
+    int n_threads;
+    bool print_progress;
 
     bool print_command_line;
     bool print_file_version;
     io_backend_t io_backend;
 
-    config_t() : ignore_diff_log(false), print_command_line(false), print_file_version(false), io_backend(aio_default) {}
+    config_t() : ignore_diff_log(false), fast_check(false), n_threads(0), print_progress(false), print_command_line(false), print_file_version(false), io_backend(aio_default) {}
 };
 
 bool check_files(const config_t *config);
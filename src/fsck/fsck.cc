@@ -22,11 +22,18 @@ NORETURN void usage() {
                 "                            the database exists.\n"
                 "      --metadata-file       Path to the file where the database metadata exists\n"
                 "      --ignore-diff-log     Do not apply patches from the diff log while\n"
-                "                            checking the database.\n");
+                "                            checking the database.\n"
+                "      --fast                Only check the metablocks, the LBA and that the\n"
+                "                            blocks the LBA points at are there, reading each\n"
+                "                            file sequentially. Does not check the btrees.\n"
+                "  -j  --threads             Number of threads to check with. Defaults to the\n"
+                "                            number of CPUs.\n");
     help->pagef("\n"
                 "Output options:\n"
                 "  -l  --log-file            File to log to.  If not provided, messages will be\n"
-                "                            printed to stderr.\n");
+                "                            printed to stderr.\n"
+                "      --progress            Print how far along the check is to stderr every\n"
+                "                            few seconds.\n");
 #ifndef NDEBUG
     help->pagef("  -c  --command-line        Print the command line arguments that were used\n"
                 "                            to start this server.\n");
@@ -37,7 +44,9 @@ NORETURN void usage() {
 }
 
 enum { ignore_diff_log = 256,  // Start these values above the ASCII range.
-       metadata_file
+       metadata_file,
+       fast_check,
+       print_progress
 };
 
 void parse_cmd_args(int argc, char **argv, config_t *config) {
@@ -56,6 +65,9 @@ void parse_cmd_args(int argc, char **argv, config_t *config) {
                 {"file", required_argument, 0, 'f'},
                 {"metadata-file", required_argument, 0, metadata_file},
                 {"ignore-diff-log", no_argument, 0, ignore_diff_log},
+                {"fast", no_argument, 0, fast_check},
+                {"threads", required_argument, 0, 'j'},
+                {"progress", no_argument, 0, print_progress},
                 {"log-file", required_argument, 0, 'l'},
                 {"help", no_argument, &do_help, 1},
                 {"command-line", no_argument, &command_line, 'c'},
@@ -64,7 +76,7 @@ void parse_cmd_args(int argc, char **argv, config_t *config) {
             };
 
         int option_index = 0;
-        int c = getopt_long(argc, argv, "f:l:hcv", long_options, &option_index);
+        int c = getopt_long(argc, argv, "f:l:j:hcv", long_options, &option_index);
 
         if (do_help) {
             c = 'h';
@@ -94,6 +106,19 @@ void parse_cmd_args(int argc, char **argv, config_t *config) {
         case ignore_diff_log:
             config->ignore_diff_log = true;
             break;
+        case fast_check:
+            config->fast_check = true;
+            break;
+        case 'j': {
+            int64_t n_threads;
+            if (!strtoi64_strict(optarg, 10, &n_threads) || n_threads <= 0 || n_threads > MAX_THREADS) {
+                fail_due_to_user_error("Number of threads must be between 1 and %d.", MAX_THREADS);
+            }
+            config->n_threads = n_threads;
+        } break;
+        case print_progress:
+            config->print_progress = true;
+            break;
         case 'l':
             config->log_file_name = optarg;
             break;
@@ -2,11 +2,12 @@
 #include "fsck/raw_block.hpp"
 
 #include "arch/arch.hpp"
+#include "serializer/log/compressed_block.hpp"
 
 namespace fsck {
 
 const char *raw_block_t::error_name(error code) {
-    static const char *codes[raw_block_err_count] = {"none", "block id mismatch", "bad offset"};
+    static const char *codes[raw_block_err_count] = {"none", "block id mismatch", "bad offset", "bad compressed data"};
     return codes[code];
 }
 
@@ -25,9 +26,24 @@ bool raw_block_t::init(int64_t size, nondirect_file_t *file, off64_t offset) {
     return true;
 }
 
-bool raw_block_t::init(block_size_t size, nondirect_file_t *file, off64_t offset, block_id_t ser_block_id) {
-    if (!init(size.ser_value(), file, offset)) {
-        return false;
+bool raw_block_t::init(block_size_t size, nondirect_file_t *file, off64_t offset, block_id_t ser_block_id, uint32_t compressed_sectors) {
+    if (compressed_sectors == 0) {
+        if (!init(size.ser_value(), file, offset)) {
+            return false;
+        }
+    } else {
+        if (!init(compressed_sectors * DEVICE_BLOCK_SIZE, file, offset)) {
+            return false;
+        }
+        ls_buf_data_t *image = realbuf;
+        realbuf = reinterpret_cast<ls_buf_data_t *>(malloc_aligned(size.ser_value(), DEVICE_BLOCK_SIZE));
+        buf = (realbuf + 1);
+        const bool ok = decompress_block(image, compressed_sectors, size, realbuf);
+        free(image);
+        if (!ok) {
+            err = bad_compressed_data;
+            return false;
+        }
     }
 
     if (realbuf->block_id != ser_block_id) {
@@ -9,7 +9,7 @@ namespace fsck {
 
 class raw_block_t {
 public:
-    enum { none = 0, block_id_mismatch, bad_offset, raw_block_err_count };
+    enum { none = 0, block_id_mismatch, bad_offset, bad_compressed_data, raw_block_err_count };
     typedef uint8_t error;
 
     static const char *error_name(error code);
@@ -23,7 +23,9 @@ protected:
     raw_block_t();
     ~raw_block_t();
     bool init(int64_t size, nondirect_file_t *file, off64_t offset) __attribute__ ((warn_unused_result));
-    bool init(block_size_t size, nondirect_file_t *file, off64_t offset, block_id_t ser_block_id);
+    // Reads a data block, decompressing it if the LBA says that it takes up
+    // `compressed_sectors` sectors.
+    bool init(block_size_t size, nondirect_file_t *file, off64_t offset, block_id_t ser_block_id, uint32_t compressed_sectors = 0);
 
     ls_buf_data_t *realbuf;
 private:
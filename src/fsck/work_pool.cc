@@ -0,0 +1,121 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "fsck/work_pool.hpp"
+
+namespace fsck {
+
+work_pool_t::work_pool_t(int n_workers)
+    : workers(n_workers), next_worker(0), outstanding(0), spawn_count(0) {
+    guarantee(n_workers > 0);
+    for (int i = 0; i < n_workers; ++i) {
+        workers[i].init(new worker_t);
+    }
+}
+
+work_pool_t::~work_pool_t() {
+    rassert(outstanding == 0);
+}
+
+void work_pool_t::spawn(work_task_t *task, int worker) {
+    if (worker == -1) {
+        worker = next_worker;
+        next_worker = (next_worker + 1) % workers.size();
+    }
+    rassert(worker >= 0 && worker < workers.size());
+
+    // Count the task before anybody can see it, so that `outstanding` can't
+    // drop to zero while it's sitting in a deque.
+    {
+        system_mutex_t::lock_t lock(&idle_lock);
+        ++outstanding;
+    }
+    {
+        system_mutex_t::lock_t lock(&workers[worker]->lock);
+        workers[worker]->tasks.push_back(task);
+    }
+    // Only bump `spawn_count` once the task can be taken. A worker that saw the
+    // old count either finds the task or sees the new count before it sleeps,
+    // and one that's already asleep gets woken.
+    {
+        system_mutex_t::lock_t lock(&idle_lock);
+        ++spawn_count;
+        idle_cond.broadcast();
+    }
+}
+
+void work_pool_t::run() {
+    std::vector<pthread_t> threads(workers.size());
+    scoped_array_t<thread_arg_t> args(workers.size());
+    for (int i = 0; i < workers.size(); ++i) {
+        args[i].pool = this;
+        args[i].worker = i;
+        int res = pthread_create(&threads[i], NULL, &work_pool_t::worker_main, &args[i]);
+        guarantee_err(res == 0, "pthread_create not working");
+    }
+    for (int i = 0; i < workers.size(); ++i) {
+        guarantee_err(!pthread_join(threads[i], NULL), "pthread_join failing");
+    }
+    rassert(outstanding == 0);
+}
+
+void *work_pool_t::worker_main(void *arg) {
+    thread_arg_t *a = static_cast<thread_arg_t *>(arg);
+    a->pool->work(a->worker);
+    return NULL;
+}
+
+void work_pool_t::work(int worker) {
+    for (;;) {
+        int64_t seen_spawn_count;
+        {
+            system_mutex_t::lock_t lock(&idle_lock);
+            seen_spawn_count = spawn_count;
+        }
+
+        work_task_t *task = take_task(worker);
+        if (task) {
+            task->run(this, worker);
+            delete task;
+
+            system_mutex_t::lock_t lock(&idle_lock);
+            --outstanding;
+            if (outstanding == 0) {
+                idle_cond.broadcast();
+            }
+            continue;
+        }
+
+        // Nothing to do. Sleep until somebody spawns a task or everything is done.
+        system_mutex_t::lock_t lock(&idle_lock);
+        if (outstanding == 0) {
+            return;
+        }
+        if (spawn_count == seen_spawn_count) {
+            idle_cond.wait(&idle_lock);
+        }
+    }
+}
+
+work_task_t *work_pool_t::take_task(int worker) {
+    {
+        system_mutex_t::lock_t lock(&workers[worker]->lock);
+        if (!workers[worker]->tasks.empty()) {
+            work_task_t *task = workers[worker]->tasks.back();
+            workers[worker]->tasks.pop_back();
+            return task;
+        }
+    }
+
+    for (int i = 1; i < workers.size(); ++i) {
+        worker_t *victim = workers[(worker + i) % workers.size()].get();
+        system_mutex_t::lock_t lock(&victim->lock);
+        if (!victim->tasks.empty()) {
+            work_task_t *task = victim->tasks.front();
+            victim->tasks.pop_front();
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+}  // namespace fsck
@@ -0,0 +1,81 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef FSCK_WORK_POOL_HPP_
+#define FSCK_WORK_POOL_HPP_
+
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+
+#include "arch/io/concurrency.hpp"
+#include "containers/scoped.hpp"
+#include "utils.hpp"
+
+namespace fsck {
+
+class work_pool_t;
+
+/* A unit of work for a `work_pool_t`. Tasks may spawn more tasks; the pool
+deletes each task after running it. */
+class work_task_t {
+public:
+    virtual ~work_task_t() { }
+    // `worker` is the index of the worker thread running the task, to be passed
+    // back to `work_pool_t::spawn()`.
+    virtual void run(work_pool_t *pool, int worker) = 0;
+};
+
+/* A fixed set of pthreads working through a set of tasks that grows as they
+run. Every worker has its own deque: it pushes the tasks it spawns onto the back
+and takes its next task from the back, so a worker walking a tree goes depth
+first and the number of queued tasks stays proportional to the depth of the
+tree. A worker whose deque is empty steals from the front of somebody else's,
+which is where the biggest pieces of work (the ones nearest the root) are. */
+class work_pool_t {
+public:
+    explicit work_pool_t(int n_workers);
+    ~work_pool_t();
+
+    int num_workers() const { return workers.size(); }
+
+    /* Queues `task` on `worker`'s deque. Before `run()` is called, pass -1 to
+    spread tasks over all the workers. */
+    void spawn(work_task_t *task, int worker);
+
+    /* Starts the workers and returns once every task (including the ones spawned
+    while running) has been run. The pool can be refilled and run again. */
+    void run();
+
+private:
+    struct worker_t {
+        system_mutex_t lock;
+        std::deque<work_task_t *> tasks;
+    };
+
+    struct thread_arg_t {
+        work_pool_t *pool;
+        int worker;
+    };
+
+    static void *worker_main(void *arg);
+    void work(int worker);
+    work_task_t *take_task(int worker);
+
+    scoped_array_t<scoped_ptr_t<worker_t> > workers;
+    int next_worker;
+
+    // Protects `outstanding` and `spawn_count`.
+    system_mutex_t idle_lock;
+    system_cond_t idle_cond;
+    // Tasks that have been spawned but haven't finished running.
+    int64_t outstanding;
+    // Bumped on every spawn, so a worker about to go to sleep can tell that a
+    // task showed up after it last looked.
+    int64_t spawn_count;
+
+    DISABLE_COPYING(work_pool_t);
+};
+
+}  // namespace fsck
+
+#endif  // FSCK_WORK_POOL_HPP_
@@ -37,6 +37,11 @@ public:
         cb_->on_keyvalue(atom, interruptor);
     }
 
+    void on_range_done(const key_range_t &range, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        rassert(kr_.is_superset(range));
+        cb_->on_range_done(range, interruptor);
+    }
+
     backfill_callback_t *cb_;
     key_range_t kr_;
 };
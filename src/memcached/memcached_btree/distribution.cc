@@ -1,12 +1,14 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
 #include "memcached/memcached_btree/distribution.hpp"
 #include "btree/get_distribution.hpp"
+#include "memcached/memcached_btree/node.hpp"
 
 distribution_result_t memcached_distribution_get(btree_slice_t *slice, int max_depth, const store_key_t &left_key, 
         exptime_t, transaction_t *txn, superblock_t *superblock) {
     int64_t key_count_out;
     std::vector<store_key_t> key_splits;
-    get_btree_key_distribution(slice, txn, superblock, max_depth, &key_count_out, &key_splits);
+    value_sizer_t<memcached_value_t> sizer(slice->cache()->get_block_size());
+    get_btree_key_distribution(&sizer, slice, txn, superblock, max_depth, &key_count_out, &key_splits);
 
     distribution_result_t res;
 
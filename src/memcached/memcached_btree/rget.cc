@@ -90,8 +90,9 @@ public:
 rget_result_t memcached_rget_slice(btree_slice_t *slice, const key_range_t &range,
         int maximum, exptime_t effective_time, transaction_t *txn, superblock_t *superblock) {
 
+    value_sizer_t<memcached_value_t> sizer(slice->cache()->get_block_size());
     rget_depth_first_traversal_callback_t callback(txn, maximum, effective_time);
-    btree_depth_first_traversal(slice, txn, superblock, range, &callback);
+    btree_depth_first_traversal(&sizer, slice, txn, superblock, range, &callback);
     if (callback.cumulative_size >= rget_max_chunk_size) {
         callback.result.truncated = true;
     } else {
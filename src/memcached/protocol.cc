@@ -5,6 +5,7 @@
 #include <boost/variant.hpp>
 #include <boost/bind.hpp>
 
+#include "btree/backfill.hpp"
 #include "btree/operations.hpp"
 #include "btree/parallel_traversal.hpp"
 #include "btree/slice.hpp"
@@ -575,8 +576,8 @@ void store_t::protocol_write(const write_t &write,
 class memcached_backfill_callback_t : public backfill_callback_t {
     typedef backfill_chunk_t chunk_t;
 public:
-    explicit memcached_backfill_callback_t(chunk_fun_callback_t<memcached_protocol_t> *chunk_fun_cb)
-        : chunk_fun_cb_(chunk_fun_cb) { }
+    memcached_backfill_callback_t(chunk_fun_callback_t<memcached_protocol_t> *chunk_fun_cb, const region_t &region)
+        : chunk_fun_cb_(chunk_fun_cb), region_(region) { }
 
     void on_delete_range(const key_range_t &range, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
         chunk_fun_cb_->send_chunk(chunk_t::delete_range(region_t(range)), interruptor);
@@ -589,6 +590,10 @@ public:
     void on_keyvalue(const backfill_atom_t& atom, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
         chunk_fun_cb_->send_chunk(chunk_t::set_key(atom), interruptor);
     }
+
+    void on_range_done(const key_range_t &range, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        chunk_fun_cb_->send_checkpoint(region_intersection(region_, region_t(range)), interruptor);
+    }
     ~memcached_backfill_callback_t() { }
 
 protected:
@@ -598,19 +603,22 @@ protected:
 
 private:
     chunk_fun_callback_t<memcached_protocol_t> *chunk_fun_cb_;
+    /* The part of the start point this callback is backfilling. */
+    region_t region_;
 
     DISABLE_COPYING(memcached_backfill_callback_t);
 };
 
 static void call_memcached_backfill(int i, btree_slice_t *btree, const std::vector<std::pair<region_t, state_timestamp_t> > &regions,
-        memcached_backfill_callback_t *callback, transaction_t *txn, superblock_t *superblock, memcached_protocol_t::backfill_progress_t *progress,
+        chunk_fun_callback_t<memcached_protocol_t> *chunk_fun_cb, transaction_t *txn, superblock_t *superblock, memcached_protocol_t::backfill_progress_t *progress,
         signal_t *interruptor) {
     parallel_traversal_progress_t *p = new parallel_traversal_progress_t;
     scoped_ptr_t<traversal_progress_t> p_owner(p);
     progress->add_constituent(&p_owner);
     repli_timestamp_t timestamp = regions[i].second.to_repli_timestamp();
+    memcached_backfill_callback_t callback(chunk_fun_cb, regions[i].first);
     try {
-        memcached_backfill(btree, regions[i].first.inner, timestamp, callback, txn, superblock, p, interruptor);
+        memcached_backfill(btree, regions[i].first.inner, timestamp, &callback, txn, superblock, p, interruptor);
     } catch (interrupted_exc_t) {
         /* do nothing; `protocol_send_backfill()` will notice and deal with it.
         */
@@ -626,24 +634,34 @@ void store_t::protocol_send_backfill(const region_map_t<memcached_protocol_t, st
                                      backfill_progress_t *progress,
                                      signal_t *interruptor)
                                      THROWS_ONLY(interrupted_exc_t) {
-    std::vector<std::pair<region_t, state_timestamp_t> > regions(start_point.begin(), start_point.end());
-
-    if (regions.size() > 0) {
-        memcached_backfill_callback_t callback(chunk_fun_cb);
-
-        // pmapping by regions.size() is now the arguably wrong thing to do,
-        // because adjacent regions often have the same value. On the other hand
-        // it's harmless, because caching is basically perfect.
-        refcount_superblock_t refcount_wrapper(superblock, regions.size());
-        pmap(regions.size(), boost::bind(&call_memcached_backfill, _1,
-                                         btree, regions, &callback, txn, &refcount_wrapper, progress, interruptor));
-
-        /* if interruptor was pulsed in `call_memcached_backfill()`, it returned
-        normally anyway. So now we have to check manually. */
-        if (interruptor->is_pulsed()) {
-            throw interrupted_exc_t();
+    if (start_point.begin() == start_point.end()) {
+        return;
+    }
+
+    /* Each region is cut up further along the keys in the root, so that the
+    pieces are traversed concurrently and report their progress separately. */
+    std::vector<std::pair<region_t, state_timestamp_t> > regions;
+    const int parts_per_region = std::max<int>(1, BACKFILL_MAX_SUBRANGES / std::distance(start_point.begin(), start_point.end()));
+    for (region_map_t<memcached_protocol_t, state_timestamp_t>::const_iterator it = start_point.begin(); it != start_point.end(); ++it) {
+        std::vector<key_range_t> parts;
+        split_backfill_range(txn, superblock, it->first.inner, parts_per_region, &parts);
+        for (size_t i = 0; i < parts.size(); ++i) {
+            regions.push_back(std::make_pair(region_t(it->first.beg, it->first.end, parts[i]), it->second));
         }
     }
+
+    // pmapping by regions.size() is now the arguably wrong thing to do,
+    // because adjacent regions often have the same value. On the other hand
+    // it's harmless, because caching is basically perfect.
+    refcount_superblock_t refcount_wrapper(superblock, regions.size());
+    pmap(regions.size(), boost::bind(&call_memcached_backfill, _1,
+                                     btree, regions, chunk_fun_cb, txn, &refcount_wrapper, progress, interruptor));
+
+    /* if interruptor was pulsed in `call_memcached_backfill()`, it returned
+    normally anyway. So now we have to check manually. */
+    if (interruptor->is_pulsed()) {
+        throw interrupted_exc_t();
+    }
 }
 
 namespace {
@@ -695,6 +713,14 @@ void store_t::protocol_receive_backfill(btree_slice_t *btree,
     boost::apply_visitor(receive_backfill_visitor_t(btree, txn, superblock, interruptor), chunk.val);
 }
 
+bool store_t::protocol_bulk_load_backfill(UNUSED btree_slice_t *btree,
+                                          UNUSED transaction_t *txn,
+                                          UNUSED superblock_t *superblock,
+                                          UNUSED const std::vector<backfill_chunk_t> &chunks) {
+    // Memcached backfills are applied one key at a time.
+    return false;
+}
+
 namespace {
 
 // TODO: Maybe hash_range_key_tester_t is redundant with this, since
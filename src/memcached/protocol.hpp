@@ -198,6 +198,11 @@ public:
                                        signal_t *interruptor,
                                        const backfill_chunk_t &chunk);
 
+        bool protocol_bulk_load_backfill(btree_slice_t *btree,
+                                         transaction_t *txn,
+                                         superblock_t *superblock,
+                                         const std::vector<backfill_chunk_t> &chunks);
+
         void protocol_reset_data(const region_t& subregion,
                                  btree_slice_t *btree,
                                  transaction_t *txn,
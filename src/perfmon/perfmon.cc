@@ -20,6 +20,10 @@ static const char * stat_mean = "mean";
 static const char * stat_std_dev = "std_dev";
 static const char * no_value = "-";
 
+/* Percentiles reported by perfmon_histogram_t, and their names. */
+static const double histogram_percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+static const char * histogram_percentile_names[] = { "p50", "p90", "p99", "p999" };
+
 
 bool global_full_perfmon = false;
 
@@ -282,11 +286,162 @@ perfmon_result_t *perfmon_rate_monitor_t::output_stat(const double &stat) {
     return new perfmon_result_t(strprintf("%.8f", stat / ticks_to_secs(length)));
 }
 
+/* perfmon_histogram_t */
+
+namespace perfmon_histogram {
+
+stats_t::stats_t() : count(0) {
+    for (int i = 0; i < PERFMON_HISTOGRAM_NUM_BUCKETS; ++i) {
+        buckets[i] = 0;
+    }
+}
+
+void stats_t::record(ticks_t value) {
+    ++count;
+    ++buckets[bucket_for(value)];
+}
+
+void stats_t::aggregate(const stats_t &other) {
+    count += other.count;
+    for (int i = 0; i < PERFMON_HISTOGRAM_NUM_BUCKETS; ++i) {
+        buckets[i] += other.buckets[i];
+    }
+}
+
+ticks_t stats_t::percentile(double fraction) const {
+    rassert(count > 0);
+    uint64_t rank = ceil(fraction * count);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < PERFMON_HISTOGRAM_NUM_BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return bucket_midpoint(i);
+        }
+    }
+    unreachable();
+}
+
+int stats_t::bucket_for(ticks_t value) {
+    const ticks_t sub_buckets = 1 << PERFMON_HISTOGRAM_SUB_BUCKET_BITS;
+    if (value < sub_buckets) {
+        // Small values get a bucket each.
+        return value;
+    }
+    value = std::min<ticks_t>(value, (1ULL << PERFMON_HISTOGRAM_MAX_BITS) - 1);
+    int exponent = 63 - __builtin_clzll(value);
+    int shift = exponent - PERFMON_HISTOGRAM_SUB_BUCKET_BITS;
+    // The leading bit picks the power of two, the next few bits the bucket
+    // within it.
+    return ((shift + 1) << PERFMON_HISTOGRAM_SUB_BUCKET_BITS) + ((value >> shift) & (sub_buckets - 1));
+}
+
+ticks_t stats_t::bucket_midpoint(int bucket) {
+    const int sub_buckets = 1 << PERFMON_HISTOGRAM_SUB_BUCKET_BITS;
+    if (bucket < sub_buckets) {
+        return bucket;
+    }
+    int shift = (bucket >> PERFMON_HISTOGRAM_SUB_BUCKET_BITS) - 1;
+    ticks_t low = static_cast<ticks_t>(sub_buckets + (bucket & (sub_buckets - 1))) << shift;
+    return low + ((1ULL << shift) >> 1);
+}
+
+}   /* namespace perfmon_histogram */
+
+perfmon_histogram_t::perfmon_histogram_t(ticks_t _length)
+    : perfmon_perthread_t<stats_t>(), thread_data(new thread_info_t[MAX_THREADS]), length(_length)
+{
+    for (int i = 0; i < MAX_THREADS; i++) {
+        thread_data[i].current_interval = get_ticks() / length;
+    }
+}
+
+perfmon_histogram_t::~perfmon_histogram_t() {
+    for (int i = 0; i < MAX_THREADS; i++) {
+        delete thread_data[i].current_stats;
+        delete thread_data[i].last_stats;
+    }
+    delete[] thread_data;
+}
+
+void perfmon_histogram_t::update(ticks_t now) {
+    int interval = now / length;
+    rassert(get_thread_id() >= 0);
+    thread_info_t *thread = &thread_data[get_thread_id()];
+
+    if (thread->current_interval == interval) {
+        /* We're up to date; nothing to do */
+    } else if (thread->current_interval + 1 == interval) {
+        /* We're one step behind; reuse the old buckets for the new interval */
+        std::swap(thread->current_stats, thread->last_stats);
+        if (thread->current_stats != NULL) {
+            *thread->current_stats = stats_t();
+        }
+        thread->current_interval++;
+    } else {
+        /* We're more than one step behind */
+        if (thread->current_stats != NULL) {
+            *thread->current_stats = stats_t();
+        }
+        if (thread->last_stats != NULL) {
+            *thread->last_stats = stats_t();
+        }
+        thread->current_interval = interval;
+    }
+}
+
+void perfmon_histogram_t::record(ticks_t duration) {
+    update(get_ticks());
+    rassert(get_thread_id() >= 0);
+    thread_info_t *thread = &thread_data[get_thread_id()];
+    if (thread->current_stats == NULL) {
+        thread->current_stats = new stats_t;
+    }
+    thread->current_stats->record(duration);
+}
+
+void perfmon_histogram_t::get_thread_stat(stats_t *stat) {
+    update(get_ticks());
+    /* As with perfmon_sampler_t, report the last complete interval. */
+    rassert(get_thread_id() >= 0);
+    const stats_t *last = thread_data[get_thread_id()].last_stats;
+    if (last != NULL) {
+        *stat = *last;
+    }
+}
+
+perfmon_histogram_t::stats_t perfmon_histogram_t::combine_stats(stats_t *stats) {
+    stats_t aggregated;
+    for (int i = 0; i < get_num_threads(); i++) {
+        aggregated.aggregate(stats[i]);
+    }
+    return aggregated;
+}
+
+perfmon_result_t *perfmon_histogram_t::output_stat(const stats_t &aggregated) {
+    perfmon_result_t *stat;
+    perfmon_result_t::alloc_map_result(&stat);
+
+    stat->insert(stat_count, new perfmon_result_t(strprintf("%" PRIu64, aggregated.count)));
+    for (size_t i = 0; i < sizeof(histogram_percentiles) / sizeof(histogram_percentiles[0]); ++i) {
+        if (aggregated.count > 0) {
+            double secs = ticks_to_secs(aggregated.percentile(histogram_percentiles[i]));
+            stat->insert(histogram_percentile_names[i], new perfmon_result_t(strprintf("%.8f", secs)));
+        } else {
+            stat->insert(histogram_percentile_names[i], new perfmon_result_t(no_value));
+        }
+    }
+    return stat;
+}
+
 perfmon_duration_sampler_t::perfmon_duration_sampler_t(ticks_t length, bool _ignore_global_full_perfmon)
-    : stat(), active(), total(), recent(length, true),
+    : stat(), active(), total(), recent(length, true), recent_latency(length),
       active_membership(&stat, &active, "active_count"),
       total_membership(&stat, &total, "total"),
       recent_membership(&stat, &recent, "recent_duration"),
+      recent_latency_membership(&stat, &recent_latency, "recent_latency"),
       ignore_global_full_perfmon(_ignore_global_full_perfmon)
 { }
 
@@ -303,7 +458,9 @@ void perfmon_duration_sampler_t::begin(ticks_t *v) {
 void perfmon_duration_sampler_t::end(ticks_t *v) {
     --active;
     if (*v != 0) {
-        recent.record(ticks_to_secs(get_ticks() - *v));
+        ticks_t duration = get_ticks() - *v;
+        recent.record(ticks_to_secs(duration));
+        recent_latency.record(duration);
     }
 }
 
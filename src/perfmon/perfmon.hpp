@@ -211,11 +211,69 @@ public:
     void record(double value = 1.0);
 };
 
+/* perfmon_histogram_t is a perfmon_t that records the distribution of some
+ * durations, so that it can report percentiles rather than just an average. It
+ * buckets values the way an HDR histogram does: each power of two is split into
+ * 2^PERFMON_HISTOGRAM_SUB_BUCKET_BITS equal buckets, so a value is known to
+ * within an eighth of itself whatever its scale. Each thread records into its
+ * own buckets, which are only allocated once that thread records something,
+ * and the threads' buckets are added up when stats are collected. Like
+ * perfmon_sampler_t, it reports on the last complete interval of `length`
+ * ticks.
+ */
+#define PERFMON_HISTOGRAM_SUB_BUCKET_BITS 3
+// Values of 2^PERFMON_HISTOGRAM_MAX_BITS ticks or more go in the last bucket.
+#define PERFMON_HISTOGRAM_MAX_BITS 40
+#define PERFMON_HISTOGRAM_NUM_BUCKETS ((PERFMON_HISTOGRAM_MAX_BITS - PERFMON_HISTOGRAM_SUB_BUCKET_BITS + 1) << PERFMON_HISTOGRAM_SUB_BUCKET_BITS)
+
+namespace perfmon_histogram {
+
+struct stats_t {
+    stats_t();
+    void record(ticks_t value);
+    void aggregate(const stats_t &other);
+
+    /* Returns a value that at least `fraction` of the recorded values are no
+    greater than, give or take the width of its bucket. */
+    ticks_t percentile(double fraction) const;
+
+    static int bucket_for(ticks_t value);
+    static ticks_t bucket_midpoint(int bucket);
+
+    uint64_t count;
+    uint64_t buckets[PERFMON_HISTOGRAM_NUM_BUCKETS];
+};
+
+}   /* namespace perfmon_histogram */
+
+class perfmon_histogram_t : public perfmon_perthread_t<perfmon_histogram::stats_t> {
+    typedef perfmon_histogram::stats_t stats_t;
+    struct thread_info_t {
+        thread_info_t() : current_stats(NULL), last_stats(NULL), current_interval(0) { }
+        stats_t *current_stats, *last_stats;
+        int current_interval;
+    };
+
+    thread_info_t *thread_data;
+
+    void get_thread_stat(stats_t *);
+    stats_t combine_stats(stats_t *);
+    perfmon_result_t *output_stat(const stats_t&);
+
+    void update(ticks_t now);
+
+    ticks_t length;
+public:
+    explicit perfmon_histogram_t(ticks_t _length);
+    virtual ~perfmon_histogram_t();
+    void record(ticks_t duration);
+};
+
 /* perfmon_duration_sampler_t is a perfmon_t that monitors events that have a
  * starting and ending time. When something starts, call begin(); when
  * something ends, call end() with the same value as begin. It will produce
- * stats for the number of active events, the average length of an event, and
- * so on. If `global_full_perfmon` is false, it won't report any timing-related
+ * stats for the number of active events, the average length of an event, its
+ * percentiles (see perfmon_histogram_t), and so on. If `global_full_perfmon` is false, it won't report any timing-related
  * stats because `get_ticks()` is rather slow.
  *
  * Frequently we're in the case where we'd like to have a single slow perfmon
@@ -230,9 +288,11 @@ private:
     perfmon_counter_t active;
     perfmon_counter_t total;
     perfmon_sampler_t recent;
+    perfmon_histogram_t recent_latency;
     perfmon_membership_t active_membership;
     perfmon_membership_t total_membership;
     perfmon_membership_t recent_membership;
+    perfmon_membership_t recent_latency_membership;
 
     bool ignore_global_full_perfmon;
 public:
@@ -120,9 +120,16 @@ public:
     MUST_USE region_map_t mask(typename protocol_t::region_t region) const {
         internal_vec_t masked_pairs;
         for (size_t i = 0; i < regions_and_values.size(); ++i) {
-            typename protocol_t::region_t ixn = region_intersection(regions_and_values[i].first, region);
-            if (!region_is_empty(ixn)) {
-                masked_pairs.push_back(internal_pair_t(ixn, regions_and_values[i].second));
+            const internal_pair_t &pair = regions_and_values[i];
+            // Most pairs are either entirely inside `region` or entirely
+            // outside it, and neither case needs an intersection.
+            if (!region_overlaps(pair.first, region)) {
+                continue;
+            }
+            if (region_is_superset(region, pair.first)) {
+                masked_pairs.push_back(pair);
+            } else {
+                masked_pairs.push_back(internal_pair_t(region_intersection(pair.first, region), pair.second));
             }
         }
         return region_map_t(masked_pairs.begin(), masked_pairs.end());
@@ -136,19 +143,65 @@ public:
             overlay_regions.push_back((*i).first);
         }
 
-        internal_vec_t updated_pairs;
-        for (const_iterator i = begin(); i != end(); ++i) {
-            typename protocol_t::region_t old = (*i).first;
-            std::vector<typename protocol_t::region_t> old_subregions = region_subtract_many(old, overlay_regions);
+        // Pairs that don't touch the update stay where they are; only the ones
+        // that do are taken out and replaced by what's left of them.
+        internal_vec_t fragments;
+        std::vector<typename protocol_t::region_t> overlapping_regions;
+        size_t kept = 0;
+        for (size_t i = 0; i < regions_and_values.size(); ++i) {
+            const internal_pair_t &pair = regions_and_values[i];
+
+            overlapping_regions.clear();
+            for (size_t j = 0; j < overlay_regions.size(); ++j) {
+                if (region_overlaps(pair.first, overlay_regions[j])) {
+                    overlapping_regions.push_back(overlay_regions[j]);
+                }
+            }
+            if (overlapping_regions.empty()) {
+                if (kept != i) {
+                    regions_and_values[kept] = pair;
+                }
+                ++kept;
+                continue;
+            }
+
+            std::vector<typename protocol_t::region_t> old_subregions = region_subtract_many(pair.first, overlapping_regions);
 
-            // Insert the unchanged parts of the old region into updated_pairs with the old value
+            // Insert the unchanged parts of the old region into fragments with the old value
             for (typename std::vector<typename protocol_t::region_t>::const_iterator j = old_subregions.begin(); j != old_subregions.end(); ++j) {
-                updated_pairs.push_back(internal_pair_t(*j, (*i).second));
+                fragments.push_back(internal_pair_t(*j, pair.second));
+            }
+        }
+        regions_and_values.erase(regions_and_values.begin() + kept, regions_and_values.end());
+        regions_and_values.insert(regions_and_values.end(), fragments.begin(), fragments.end());
+        regions_and_values.insert(regions_and_values.end(), new_values.begin(), new_values.end());
+    }
+
+    /* Merges pairs that have equal values wherever their regions join into a
+    single region. `update()` leaves the map split along every boundary it has
+    ever been updated on, so a map that keeps getting the same value over
+    different regions (like a store's metainfo while a backfill checkpoints it)
+    should call this to stay small. Requires `value_t` to have `operator==`. */
+    void coalesce() {
+        std::vector<typename protocol_t::region_t> candidates(2);
+        for (size_t i = 0; i < regions_and_values.size(); ++i) {
+            size_t j = i + 1;
+            while (j < regions_and_values.size()) {
+                if (regions_and_values[j].second == regions_and_values[i].second) {
+                    candidates[0] = regions_and_values[i].first;
+                    candidates[1] = regions_and_values[j].first;
+                    typename protocol_t::region_t joined;
+                    if (region_join(candidates, &joined) == REGION_JOIN_OK) {
+                        regions_and_values[i].first = joined;
+                        regions_and_values.erase(regions_and_values.begin() + j);
+                        // The bigger region may join pairs we've already passed.
+                        j = i + 1;
+                        continue;
+                    }
+                }
+                ++j;
             }
         }
-        std::copy(new_values.begin(), new_values.end(), std::back_inserter(updated_pairs));
-
-        regions_and_values = updated_pairs;
     }
 
     void set(const typename protocol_t::region_t &r, const value_t &v) {
@@ -277,6 +330,11 @@ class chunk_fun_callback_t {
 public:
     virtual void send_chunk(const typename protocol_t::backfill_chunk_t &, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) = 0;
 
+    /* Tells the receiver that every chunk touching `region` has already been
+    passed to `send_chunk()`, so it can record that part of the backfill as
+    finished. A backfill that gets cut off then only has to redo the rest. */
+    virtual void send_checkpoint(const typename protocol_t::region_t &region, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) = 0;
+
 protected:
     chunk_fun_callback_t() { }
     virtual ~chunk_fun_callback_t() { }
@@ -366,6 +424,25 @@ public:
             signal_t *interruptor)
             THROWS_ONLY(interrupted_exc_t) = 0;
 
+    /* Performs several writes, in order, with one write token. The effect is
+    the same as that of calling `write()` for each of them in turn, except
+    that the metainfo only gets updated once, to `new_metainfo`, and that
+    the store may apply them all in a single transaction. `metainfo_expecter`
+    is checked against the metainfo from before the first write.
+    [Precondition] writes.size() == timestamps.size()
+    [Precondition] The preconditions of `write()` for every write
+    [May block] */
+    virtual void write_batch(
+            DEBUG_ONLY(const metainfo_checker_t<protocol_t>& metainfo_expecter, )
+            const metainfo_t& new_metainfo,
+            const std::vector<typename protocol_t::write_t> &writes,
+            const std::vector<transition_timestamp_t> &timestamps,
+            std::vector<typename protocol_t::write_response_t> *responses,
+            order_token_t order_token,
+            object_buffer_t<fifo_enforcer_sink_t::exit_write_t> *token,
+            signal_t *interruptor)
+            THROWS_ONLY(interrupted_exc_t) = 0;
+
     /* Expresses the changes that have happened since `start_point` as a
     series of `backfill_chunk_t` objects.
     [Precondition] start_point.get_domain() <= view->get_region()
@@ -382,13 +459,14 @@ public:
             THROWS_ONLY(interrupted_exc_t) = 0;
 
 
-    /* Applies a backfill data chunk sent by `send_backfill()`. If
-    `interrupted_exc_t` is thrown, the state of the database is undefined
-    except that doing a second backfill must put it into a valid state.
+    /* Applies backfill data chunks sent by `send_backfill()`, in order and
+    under the one token. If `interrupted_exc_t` is thrown, the state of the
+    database is undefined except that doing a second backfill must put it into
+    a valid state.
     [May block]
     */
     virtual void receive_backfill(
-            const typename protocol_t::backfill_chunk_t &chunk,
+            const std::vector<typename protocol_t::backfill_chunk_t> &chunks,
             object_buffer_t<fifo_enforcer_sink_t::exit_write_t> *token,
             signal_t *interruptor)
             THROWS_ONLY(interrupted_exc_t) = 0;
@@ -522,6 +600,23 @@ public:
         store_view->write(DEBUG_ONLY(metainfo_checker, ) new_metainfo, write, response, timestamp, order_token, token, interruptor);
     }
 
+    void write_batch(
+            DEBUG_ONLY(const metainfo_checker_t<protocol_t>& metainfo_checker, )
+            const metainfo_t& new_metainfo,
+            const std::vector<typename protocol_t::write_t> &writes,
+            const std::vector<transition_timestamp_t> &timestamps,
+            std::vector<typename protocol_t::write_response_t> *responses,
+            order_token_t order_token,
+            object_buffer_t<fifo_enforcer_sink_t::exit_write_t> *token,
+            signal_t *interruptor)
+            THROWS_ONLY(interrupted_exc_t) {
+        home_thread_mixin_t::assert_thread();
+        rassert(region_is_superset(get_region(), metainfo_checker.get_domain()));
+        rassert(region_is_superset(get_region(), new_metainfo.get_domain()));
+
+        store_view->write_batch(DEBUG_ONLY(metainfo_checker, ) new_metainfo, writes, timestamps, responses, order_token, token, interruptor);
+    }
+
     // TODO: Make this take protocol_t::progress_t again (or maybe a
     // progress_receiver_t type that you define).
     bool send_backfill(
@@ -538,12 +633,12 @@ public:
     }
 
     void receive_backfill(
-            const typename protocol_t::backfill_chunk_t &chunk,
+            const std::vector<typename protocol_t::backfill_chunk_t> &chunks,
             object_buffer_t<fifo_enforcer_sink_t::exit_write_t> *token,
             signal_t *interruptor)
             THROWS_ONLY(interrupted_exc_t) {
         home_thread_mixin_t::assert_thread();
-        store_view->receive_backfill(chunk, token, interruptor);
+        store_view->receive_backfill(chunks, token, interruptor);
     }
 
     void reset_data(
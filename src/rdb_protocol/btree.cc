@@ -1,4 +1,5 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -7,6 +8,7 @@
 #include <boost/variant.hpp>
 
 #include "btree/backfill.hpp"
+#include "btree/bulk_load.hpp"
 #include "btree/depth_first_traversal.hpp"
 #include "btree/erase_range.hpp"
 #include "btree/get_distribution.hpp"
@@ -79,7 +81,9 @@ block_magic_t value_sizer_t<rdb_value_t>::leaf_magic() {
 }
 
 block_magic_t value_sizer_t<rdb_value_t>::btree_leaf_magic() const {
-    return leaf_magic();
+    // Documents' keys tend to share long prefixes, so new leaves are
+    // prefix-compressed.
+    return leaf::prefixed_magic(leaf_magic());
 }
 
 block_size_t value_sizer_t<rdb_value_t>::block_size() const { return block_size_; }
@@ -124,10 +128,9 @@ void kv_location_delete(keyvalue_location_t<rdb_value_t> *kv_location, const sto
     apply_keyvalue_change(txn, kv_location, key.btree_key(), timestamp, false, &null_cb, &slice->root_eviction_priority);
 }
 
-void kv_location_set(keyvalue_location_t<rdb_value_t> *kv_location, const store_key_t &key,
-                     boost::shared_ptr<scoped_cJSON_t> data,
-                     btree_slice_t *slice, repli_timestamp_t timestamp, transaction_t *txn) {
-
+// Puts `data` in a new value's blob.
+static void make_rdb_value(boost::shared_ptr<scoped_cJSON_t> data, transaction_t *txn,
+                           scoped_malloc_t<rdb_value_t> *value_out) {
     scoped_malloc_t<rdb_value_t> new_value(MAX_RDB_VALUE_SIZE);
     bzero(new_value.get(), MAX_RDB_VALUE_SIZE);
 
@@ -145,6 +148,15 @@ void kv_location_set(keyvalue_location_t<rdb_value_t> *kv_location, const store_
     std::string sered_data(stream.vector().begin(), stream.vector().end());
     blob.write_from_string(sered_data, txn, 0);
 
+    value_out->swap(new_value);
+}
+
+void kv_location_set(keyvalue_location_t<rdb_value_t> *kv_location, const store_key_t &key,
+                     boost::shared_ptr<scoped_cJSON_t> data,
+                     btree_slice_t *slice, repli_timestamp_t timestamp, transaction_t *txn) {
+    scoped_malloc_t<rdb_value_t> new_value;
+    make_rdb_value(data, txn, &new_value);
+
     // Actually update the leaf, if needed.
     kv_location->value.reinterpret_swap(new_value);
     null_key_modification_callback_t<rdb_value_t> null_cb;
@@ -211,6 +223,37 @@ void rdb_set(const store_key_t &key, boost::shared_ptr<scoped_cJSON_t> data, boo
     response->result = (had_value ? DUPLICATE : STORED);
 }
 
+static bool backfill_atom_less(const rdb_protocol_details::backfill_atom_t *x, const rdb_protocol_details::backfill_atom_t *y) {
+    return x->key < y->key;
+}
+
+bool rdb_bulk_load(std::vector<const rdb_protocol_details::backfill_atom_t *> atoms, btree_slice_t *slice,
+                   transaction_t *txn, superblock_t *superblock) {
+    if (atoms.empty()) {
+        return false;
+    }
+    std::sort(atoms.begin(), atoms.end(), &backfill_atom_less);
+    for (size_t i = 1; i < atoms.size(); ++i) {
+        if (!(atoms[i - 1]->key < atoms[i]->key)) {
+            return false;
+        }
+    }
+
+    value_sizer_t<rdb_value_t> sizer(slice->cache()->get_block_size());
+    btree_bulk_loader_t loader(&sizer, txn, superblock, repli_timestamp_t::distant_past);
+    if (!loader.accepts(atoms[0]->key.btree_key())) {
+        return false;
+    }
+
+    for (size_t i = 0; i < atoms.size(); ++i) {
+        scoped_malloc_t<rdb_value_t> value;
+        make_rdb_value(atoms[i]->value, txn, &value);
+        loader.add(atoms[i]->key.btree_key(), value.get(), atoms[i]->recency);
+    }
+    loader.finish();
+    return true;
+}
+
 class agnostic_rdb_backfill_callback_t : public agnostic_backfill_callback_t {
 public:
     agnostic_rdb_backfill_callback_t(rdb_backfill_callback_t *cb, const key_range_t &kr) : cb_(cb), kr_(kr) { }
@@ -236,6 +279,11 @@ public:
         cb_->on_keyvalue(atom, interruptor);
     }
 
+    void on_range_done(const key_range_t &range, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        rassert(kr_.is_superset(range));
+        cb_->on_range_done(range, interruptor);
+    }
+
     rdb_backfill_callback_t *cb_;
     key_range_t kr_;
 };
@@ -308,14 +356,18 @@ public:
                                               boost::optional<rdb_protocol_details::terminal_t> _terminal,
                                               const key_range_t &range,
                                               rget_read_response_t *_response)
-        : bad_init(false), transaction(txn), response(_response), cumulative_size(0),
-          env(_env), transform(_transform), terminal(_terminal)
+        : bad_init(false), transaction(txn), response(_response), cumulative_size(0), rows_scanned(0),
+          env(_env), transform(_transform), terminal(_terminal),
+          batching(query_language::transform_wants_batching(_transform))
     {
         try {
             response->last_considered_key = range.left;
 
             if (terminal) {
                 boost::apply_visitor(query_language::terminal_initializer_visitor_t(&response->result, env, terminal->scopes, terminal->backtrace), terminal->variant);
+                if (const Builtin_GroupedMapReduce *gmr = boost::get<Builtin_GroupedMapReduce>(&terminal->variant)) {
+                    grouped_map_reduce.init(new query_language::grouped_map_reduce_t(*gmr, env, terminal->scopes, terminal->backtrace));
+                }
             }
         } catch (const query_language::runtime_exc_t &e) {
             /* Evaluation threw so we're not going to be accepting any more requests. */
@@ -326,6 +378,7 @@ public:
 
     bool handle_pair(const btree_key_t* key, const void *value) {
         if (bad_init) return false;
+        ++rows_scanned;
         try {
             store_key_t store_key(key);
             if (response->last_considered_key < store_key) {
@@ -334,6 +387,17 @@ public:
 
             const rdb_value_t *rdb_value = reinterpret_cast<const rdb_value_t *>(value);
 
+            if (batching) {
+                /* Rows are buffered up and transformed together once we have
+                enough of them (or the traversal ends, see `finish()`). */
+                pending.push_back(std::make_pair(pending_keys.size(), get_data(rdb_value, transaction)));
+                pending_keys.push_back(store_key);
+                if (pending.size() < query_language::TRANSFORM_BATCH_SIZE) {
+                    return true;
+                }
+                return flush_pending();
+            }
+
             json_list_t data;
             data.push_back(get_data(rdb_value, transaction));
 
@@ -353,60 +417,127 @@ public:
                 data.splice(data.begin(), tmp);
             }
 
-            if (!terminal) {
-                typedef rget_read_response_t::stream_t stream_t;
-                stream_t *stream = boost::get<stream_t>(&response->result);
-                guarantee(stream);
-                for (json_list_t::iterator it =  data.begin();
-                                           it != data.end();
-                                           ++it) {
-                    stream->push_back(std::make_pair(key, *it));
-                    cumulative_size += estimate_rget_response_size(*it);
-                }
-
-                return cumulative_size < rget_max_chunk_size;
-            } else {
-                for (json_list_t::iterator jt  = data.begin();
-                                           jt != data.end();
-                                           ++jt) {
-                    boost::apply_visitor(query_language::terminal_visitor_t(*jt, env, terminal->scopes, terminal->backtrace, &response->result), terminal->variant);
-                }
-                return true;
+            for (json_list_t::iterator it =  data.begin();
+                                       it != data.end();
+                                       ++it) {
+                emit(store_key, *it);
             }
+            return terminal || cumulative_size < rget_max_chunk_size;
         } catch (const query_language::runtime_exc_t &e) {
             /* Evaluation threw so we're not going to be accepting any more requests. */
             response->result = e;
             return false;
         }
     }
+
+    /* Must be called after the traversal to process any rows still buffered
+    for batched evaluation. */
+    void finish() {
+        if (bad_init || pending.empty()) return;
+        try {
+            flush_pending();
+        } catch (const query_language::runtime_exc_t &e) {
+            response->result = e;
+        }
+    }
+
+private:
+    bool flush_pending() {
+        typedef rdb_protocol_details::transform_t::iterator tit_t;
+        for (tit_t it  = transform.begin();
+                   it != transform.end();
+                   ++it) {
+            boost::apply_visitor(query_language::transform_batch_visitor_t(&pending, env, it->scopes, it->backtrace), it->variant);
+        }
+
+        for (query_language::tagged_json_vec_t::iterator it =  pending.begin();
+                                                         it != pending.end();
+                                                         ++it) {
+            emit(pending_keys[it->first], it->second);
+        }
+        pending.clear();
+        pending_keys.clear();
+
+        return terminal || cumulative_size < rget_max_chunk_size;
+    }
+
+    void emit(const store_key_t &key, const boost::shared_ptr<scoped_cJSON_t> &json) {
+        if (!terminal) {
+            typedef rget_read_response_t::stream_t stream_t;
+            stream_t *stream = boost::get<stream_t>(&response->result);
+            guarantee(stream);
+            stream->push_back(std::make_pair(key, json));
+            cumulative_size += estimate_rget_response_size(json);
+        } else if (grouped_map_reduce.has()) {
+            grouped_map_reduce->add_row(json, boost::get<rget_read_response_t::groups_t>(&response->result));
+        } else {
+            boost::apply_visitor(query_language::terminal_visitor_t(json, env, terminal->scopes, terminal->backtrace, &response->result), terminal->variant);
+        }
+    }
+
+public:
     bool bad_init;
     transaction_t *transaction;
     rget_read_response_t *response;
     size_t cumulative_size;
+    int64_t rows_scanned;
     query_language::runtime_environment_t *env;
     rdb_protocol_details::transform_t transform;
     boost::optional<rdb_protocol_details::terminal_t> terminal;
+
+private:
+    bool batching;
+    scoped_ptr_t<query_language::grouped_map_reduce_t> grouped_map_reduce;
+    query_language::tagged_json_vec_t pending;
+    std::vector<store_key_t> pending_keys;
 };
 
 void rdb_rget_slice(btree_slice_t *slice, const key_range_t &range,
                     transaction_t *txn, superblock_t *superblock,
                     query_language::runtime_environment_t *env, const rdb_protocol_details::transform_t &transform,
-                    boost::optional<rdb_protocol_details::terminal_t> terminal, rget_read_response_t *response) {
+                    boost::optional<rdb_protocol_details::terminal_t> terminal, rget_read_response_t *response,
+                    rget_read_stats_t *stats_out) {
+    ticks_t start_time = 0;
+    int64_t blocks_before = 0, disk_blocks_before = 0;
+    if (stats_out) {
+        start_time = get_ticks();
+        blocks_before = txn->get_num_blocks_acquired();
+        disk_blocks_before = txn->get_num_blocks_read_from_disk();
+    }
+
+    value_sizer_t<rdb_value_t> sizer(slice->cache()->get_block_size());
     rdb_rget_depth_first_traversal_callback_t callback(txn, env, transform, terminal, range, response);
-    btree_depth_first_traversal(slice, txn, superblock, range, &callback);
+    btree_depth_first_traversal(&sizer, slice, txn, superblock, range, &callback);
+    callback.finish();
 
     if (callback.cumulative_size >= rget_max_chunk_size) {
         response->truncated = true;
     } else {
         response->truncated = false;
     }
+
+    if (stats_out) {
+        stats_out->duration = get_ticks() - start_time;
+        stats_out->rows_scanned = callback.rows_scanned;
+        int64_t disk_blocks = txn->get_num_blocks_read_from_disk() - disk_blocks_before;
+        stats_out->blocks_from_disk = disk_blocks;
+        stats_out->blocks_from_cache = txn->get_num_blocks_acquired() - blocks_before - disk_blocks;
+
+        write_message_t msg;
+        msg << response->result;
+        vector_stream_t stream;
+        int res = send_write_message(&stream, &msg);
+        guarantee(res == 0);
+        stats_out->bytes = stream.vector().size();
+    }
 }
 
 void rdb_distribution_get(btree_slice_t *slice, int max_depth, const store_key_t &left_key,
                           transaction_t *txn, superblock_t *superblock, distribution_read_response_t *response) {
     int64_t key_count_out;
     std::vector<store_key_t> key_splits;
-    get_btree_key_distribution(slice, txn, superblock, max_depth, &key_count_out, &key_splits);
+    value_sizer_t<rdb_value_t> sizer(slice->cache()->get_block_size());
+    get_btree_key_distribution(&sizer, slice, txn, superblock, max_depth, &key_count_out, &key_splits);
 
     int64_t keys_per_bucket;
     if (key_splits.size() == 0) {
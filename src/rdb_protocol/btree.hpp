@@ -22,6 +22,7 @@ typedef rdb_protocol_t::point_read_response_t point_read_response_t;
 
 typedef rdb_protocol_t::rget_read_t rget_read_t;
 typedef rdb_protocol_t::rget_read_response_t rget_read_response_t;
+typedef rdb_protocol_t::rget_read_stats_t rget_read_stats_t;
 
 typedef rdb_protocol_t::distribution_read_t distribution_read_t;
 typedef rdb_protocol_t::distribution_read_response_t distribution_read_response_t;
@@ -76,6 +77,9 @@ private:
     DISABLE_COPYING(value_sizer_t<rdb_value_t>);
 };
 
+/* Reads and deserializes the document that `value` refers to. */
+boost::shared_ptr<scoped_cJSON_t> get_data(const rdb_value_t *value, transaction_t *txn);
+
 void rdb_get(const store_key_t &key, btree_slice_t *slice, transaction_t *txn, superblock_t *superblock, point_read_response_t *response);
 
 void rdb_modify(const std::string &primary_key, const store_key_t &key, const point_modify_ns::op_t op,
@@ -94,6 +98,7 @@ public:
     virtual void on_delete_range(const key_range_t &range, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) = 0;
     virtual void on_deletion(const btree_key_t *key, repli_timestamp_t recency, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) = 0;
     virtual void on_keyvalue(const rdb_protocol_details::backfill_atom_t& atom, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) = 0;
+    virtual void on_range_done(const key_range_t &range, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) = 0;
 protected:
     virtual ~rdb_backfill_callback_t() { }
 };
@@ -106,6 +111,12 @@ void rdb_backfill(btree_slice_t *slice, const key_range_t& key_range,
         THROWS_ONLY(interrupted_exc_t);
 
 
+/* Appends the atoms to the tree with a `btree_bulk_loader_t`, if their keys are
+distinct and above every key in it.  Returns false, having changed nothing, if
+they aren't. */
+bool rdb_bulk_load(std::vector<const rdb_protocol_details::backfill_atom_t *> atoms, btree_slice_t *slice,
+                   transaction_t *txn, superblock_t *superblock);
+
 void rdb_delete(const store_key_t &key, btree_slice_t *slice, repli_timestamp_t timestamp, transaction_t *txn, superblock_t *superblock, point_delete_response_t *response);
 
 void rdb_erase_range(btree_slice_t *slice, key_tester_t *tester,
@@ -120,10 +131,13 @@ struct rget_response_t {
     bool truncated;
 };
 
+/* If `stats_out` isn't NULL, also records how long the read took and how much
+work it was. */
 void rdb_rget_slice(btree_slice_t *slice, const key_range_t &range,
                     transaction_t *txn, superblock_t *superblock,
                     query_language::runtime_environment_t *env, const rdb_protocol_details::transform_t &transform,
-                    boost::optional<rdb_protocol_details::terminal_t> terminal, rget_read_response_t *response);
+                    boost::optional<rdb_protocol_details::terminal_t> terminal, rget_read_response_t *response,
+                    rget_read_stats_t *stats_out);
 
 void rdb_distribution_get(btree_slice_t *slice, int max_depth, const store_key_t &left_key,
                           transaction_t *txn, superblock_t *superblock, distribution_read_response_t *response);
@@ -3,11 +3,13 @@
 #define RDB_PROTOCOL_ENVIRONMENT_HPP_
 
 #include <map>
+#include <string>
 
 #include "clustering/administration/database_metadata.hpp"
 #include "clustering/administration/metadata.hpp"
 #include "concurrency/one_per_thread.hpp"
 #include "rdb_protocol/js.hpp"
+#include "rdb_protocol/profile.hpp"
 #include "rdb_protocol/protocol.hpp"
 #include "rdb_protocol/stream.hpp"
 
@@ -27,7 +29,9 @@ public:
         directory_read_manager_t<cluster_directory_metadata_t> *_directory_read_manager,
         boost::shared_ptr<js::runner_t> _js_runner,
         signal_t *_interruptor,
-        uuid_t _this_machine)
+        uuid_t _this_machine,
+        io_backender_t *_io_backender,
+        const std::string &_temp_dir)
         : pool(_pool_group->get()),
           ns_repo(_ns_repo),
           namespaces_semilattice_metadata(_namespaces_semilattice_metadata),
@@ -36,7 +40,10 @@ public:
           directory_read_manager(_directory_read_manager),
           js_runner(_js_runner),
           interruptor(_interruptor),
-          this_machine(_this_machine) {
+          this_machine(_this_machine),
+          io_backender(_io_backender),
+          temp_dir(_temp_dir),
+          profile(NULL) {
         guarantee(js_runner);
     }
 
@@ -60,7 +67,9 @@ public:
           directory_read_manager(NULL),
           js_runner(_js_runner),
           interruptor(_interruptor),
-          this_machine(_this_machine) {
+          this_machine(_this_machine),
+          io_backender(NULL),
+          profile(NULL) {
         guarantee(js_runner);
     }
 
@@ -99,6 +108,15 @@ public:
     signal_t *interruptor;
     uuid_t this_machine;
 
+    // For spilling large sorts to disk; NULL where there is no disk to use.
+    io_backender_t *io_backender;
+    // The directory the spill files go in.
+    std::string temp_dir;
+
+    // Where to record the query's execution profile; NULL unless the client
+    // asked for one.
+    profile_t *profile;
+
 private:
     DISABLE_COPYING(runtime_environment_t);
 };
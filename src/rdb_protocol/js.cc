@@ -328,6 +328,46 @@ id_t runner_t::compile(
 }
 
 // ----- call() -----
+// Calls `func` with the given receiver and arguments, and converts the result
+// to JSON. Shared by call_task_t and call_batch_task_t.
+static json_result_t call_function(v8::Handle<v8::Function> func,
+                                   const boost::optional<boost::shared_ptr<scoped_cJSON_t> > &obj,
+                                   const std::vector<boost::shared_ptr<scoped_cJSON_t> > &args) {
+    json_result_t result("");
+    std::string *errmsg = boost::get<std::string>(&result);
+
+    v8::TryCatch try_catch;
+    v8::HandleScope scope;
+
+    // Construct receiver object.
+    v8::Handle<v8::Object> recv = obj ? fromJSON(*obj.get()->get())->ToObject()
+                                      : v8::Object::New();
+    guarantee(!recv.IsEmpty());
+
+    // Construct arguments.
+    size_t nargs = args.size();
+
+    scoped_array_t<v8::Handle<v8::Value> > handles(nargs);
+    for (size_t i = 0; i < nargs; ++i) {
+        handles[i] = fromJSON(*args[i]->get());
+        guarantee(!handles[i].IsEmpty());
+    }
+
+    // Call function with environment as its receiver.
+    v8::Handle<v8::Value> value = func->Call(recv, nargs, handles.data());
+    if (value.IsEmpty()) {
+        *errmsg = "calling function failed";
+        append_caught_error(errmsg, try_catch);
+    } else {
+        // JSONify result.
+        boost::shared_ptr<scoped_cJSON_t> json = toJSON(value, errmsg);
+        if (json) {
+            result = json;
+        }
+    }
+    return result;
+}
+
 struct call_task_t : auto_task_t<call_task_t> {
     call_task_t() {}
     call_task_t(id_t id,
@@ -346,50 +386,12 @@ struct call_task_t : auto_task_t<call_task_t> {
     std::vector<boost::shared_ptr<scoped_cJSON_t> > args_;
     RDB_MAKE_ME_SERIALIZABLE_3(func_id_, obj_, args_);
 
-    v8::Handle<v8::Value> eval(v8::Handle<v8::Function> func, std::string *errmsg) {
-        v8::TryCatch try_catch;
-        v8::HandleScope scope;
-
-        // Construct receiver object.
-        v8::Handle<v8::Object> obj = obj_ ? fromJSON(*obj_.get()->get())->ToObject()
-                                          : v8::Object::New();
-        guarantee(!obj.IsEmpty());
-
-        // Construct arguments.
-        size_t nargs = args_.size();
-
-        scoped_array_t<v8::Handle<v8::Value> > handles(nargs);
-        for (size_t i = 0; i < nargs; ++i) {
-            handles[i] = fromJSON(*args_[i]->get());
-            guarantee(!handles[i].IsEmpty());
-        }
-
-        // Call function with environment as its receiver.
-        v8::Handle<v8::Value> result = func->Call(obj, nargs, handles.data());
-        if (result.IsEmpty()) {
-            *errmsg = "calling function failed";
-            append_caught_error(errmsg, try_catch);
-        }
-        return scope.Close(result);
-    }
-
     void run(env_t *env) {
-        // TODO(rntz): This is very similar to compile_task_t::run(). Refactor?
-        json_result_t result("");
-        std::string *errmsg = boost::get<std::string>(&result);
-
         v8::HandleScope handle_scope;
         v8::Handle<v8::Function> func = v8::Handle<v8::Function>::Cast(env->findValue(func_id_));
         guarantee(!func.IsEmpty());
 
-        v8::Handle<v8::Value> value = eval(func, errmsg);
-        if (!value.IsEmpty()) {
-            // JSONify result.
-            boost::shared_ptr<scoped_cJSON_t> json = toJSON(value, errmsg);
-            if (json) {
-                result = json;
-            }
-        }
+        json_result_t result = call_function(func, obj_, args_);
 
         write_message_t msg;
         msg << result;
@@ -418,4 +420,89 @@ boost::shared_ptr<scoped_cJSON_t> runner_t::call(
     return boost::apply_visitor(v, result);
 }
 
+// ----- call_batch() -----
+const size_t runner_t::MAX_CALL_BATCH_SIZE;
+
+struct call_batch_task_t : auto_task_t<call_batch_task_t> {
+    typedef boost::optional<boost::shared_ptr<scoped_cJSON_t> > receiver_t;
+
+    call_batch_task_t() {}
+    call_batch_task_t(id_t id,
+                      const std::vector<boost::shared_ptr<scoped_cJSON_t> > &objs,
+                      const std::vector<std::vector<boost::shared_ptr<scoped_cJSON_t> > > &args,
+                      size_t begin, size_t end)
+        : func_id_(id), objs_(end - begin), args_(args.begin() + begin, args.begin() + end)
+    {
+        for (size_t i = begin; i < end; ++i) {
+            if (NULL != objs[i].get()) {
+                guarantee(objs[i]->type() == cJSON_Object);
+                objs_[i - begin] = objs[i];
+            }
+        }
+    }
+
+    id_t func_id_;
+    std::vector<receiver_t> objs_;
+    std::vector<std::vector<boost::shared_ptr<scoped_cJSON_t> > > args_;
+    RDB_MAKE_ME_SERIALIZABLE_3(func_id_, objs_, args_);
+
+    void run(env_t *env) {
+        v8::HandleScope handle_scope;
+        v8::Handle<v8::Function> func = v8::Handle<v8::Function>::Cast(env->findValue(func_id_));
+        guarantee(!func.IsEmpty());
+
+        // We stop at the first error; the caller would throw away the
+        // remaining results anyway.
+        std::vector<json_result_t> results;
+        results.reserve(args_.size());
+        for (size_t i = 0; i < args_.size(); ++i) {
+            results.push_back(call_function(func, objs_[i], args_[i]));
+            if (boost::get<std::string>(&results.back())) {
+                break;
+            }
+        }
+
+        write_message_t msg;
+        msg << results;
+        int sendres = send_write_message(env->control(), &msg);
+        guarantee(0 == sendres);
+    }
+};
+
+bool runner_t::call_batch(
+    id_t func_id,
+    const std::vector<boost::shared_ptr<scoped_cJSON_t> > &objects,
+    const std::vector<std::vector<boost::shared_ptr<scoped_cJSON_t> > > &args,
+    std::vector<boost::shared_ptr<scoped_cJSON_t> > *results_out,
+    std::string *errmsg,
+    const req_config_t *config)
+{
+    guarantee(objects.size() == args.size());
+    results_out->reserve(results_out->size() + args.size());
+
+    for (size_t begin = 0; begin < args.size(); begin += MAX_CALL_BATCH_SIZE) {
+        size_t end = std::min(args.size(), begin + MAX_CALL_BATCH_SIZE);
+        std::vector<json_result_t> results;
+
+        {
+            run_task_t run(this, config, call_batch_task_t(func_id, objects, args, begin, end));
+            int res = deserialize(&run, &results);
+            guarantee(ARCHIVE_SUCCESS == res);
+        }
+        guarantee(!results.empty() && results.size() <= end - begin);
+
+        json_visitor_t v(errmsg);
+        for (size_t i = 0; i < results.size(); ++i) {
+            boost::shared_ptr<scoped_cJSON_t> json = boost::apply_visitor(v, results[i]);
+            if (!json) {
+                return false;
+            }
+            results_out->push_back(json);
+        }
+        guarantee(results.size() == end - begin);
+    }
+
+    return true;
+}
+
 } // namespace js
@@ -118,6 +118,23 @@ class runner_t : private extproc::job_handle_t {
         std::string *errmsg,
         const req_config_t *config = NULL);
 
+    // Calls a previously compiled function once for each entry in `objects`
+    // and `args` (which must have the same length), shipping the calls to the
+    // worker in batches of at most MAX_CALL_BATCH_SIZE per round trip. Results
+    // are appended to `results_out` in order. Evaluation stops at the first
+    // error, in which case `errmsg` is set and false is returned; results for
+    // the calls preceding the failing one are still appended.
+    static const size_t MAX_CALL_BATCH_SIZE = 256;
+
+    MUST_USE bool call_batch(
+        id_t func_id,
+        // Receivers, with the same meaning as `object` in `call()`.
+        const std::vector<boost::shared_ptr<scoped_cJSON_t> > &objects,
+        const std::vector<std::vector<boost::shared_ptr<scoped_cJSON_t> > > &args,
+        std::vector<boost::shared_ptr<scoped_cJSON_t> > *results_out,
+        std::string *errmsg,
+        const req_config_t *config = NULL);
+
     // TODO (rntz): a way to send streams over to javascript.
     // TODO (rntz): a way to get streams back from javascript.
 
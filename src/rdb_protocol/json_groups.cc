@@ -0,0 +1,169 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "rdb_protocol/json_groups.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "containers/archive/stl_types.hpp"
+
+namespace query_language {
+
+static const size_t MIN_SLOTS = 16;
+
+static size_t hash_combine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+size_t hash_json(const cJSON *json) {
+    size_t hash = json->type;
+    switch (json->type) {
+    case cJSON_False:
+    case cJSON_True:
+    case cJSON_NULL:
+        break;
+    case cJSON_Number: {
+        // -0.0 and 0.0 compare equal but have different bits.
+        double d = json->valuedouble == 0 ? 0 : json->valuedouble;
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        hash = hash_combine(hash, static_cast<size_t>(bits ^ (bits >> 32)));
+    } break;
+    case cJSON_String:
+        // FNV-1a
+        for (const char *c = json->valuestring; *c; ++c) {
+            hash = (hash ^ static_cast<unsigned char>(*c)) * 16777619;
+        }
+        break;
+    case cJSON_Array:
+        for (const cJSON *child = json->child; child; child = child->next) {
+            hash = hash_combine(hash, hash_json(child));
+        }
+        break;
+    case cJSON_Object:
+        // Objects can't be compared, so this is as good as anything.
+        break;
+    default:
+        unreachable();
+    }
+    return hash;
+}
+
+size_t json_memory_size(const cJSON *json) {
+    size_t size = sizeof(cJSON);
+    if (json->string) {
+        size += strlen(json->string) + 1;
+    }
+    if (json->type == cJSON_String) {
+        size += strlen(json->valuestring) + 1;
+    }
+    for (const cJSON *child = json->child; child; child = child->next) {
+        size += json_memory_size(child);
+    }
+    return size;
+}
+
+json_groups_t::json_groups_t() { }
+
+boost::shared_ptr<scoped_cJSON_t> *json_groups_t::find(const boost::shared_ptr<scoped_cJSON_t> &key, const backtrace_t &backtrace) {
+    if (slots.empty()) {
+        return NULL;
+    }
+    size_t hash = hash_json(key->get());
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask; slots[i] != 0; i = (i + 1) & mask) {
+        size_t group = slots[i] - 1;
+        if (hashes[group] == hash && cJSON_cmp(groups[group].first->get(), key->get(), backtrace) == 0) {
+            return &groups[group].second;
+        }
+    }
+    return NULL;
+}
+
+boost::shared_ptr<scoped_cJSON_t> *json_groups_t::insert(const boost::shared_ptr<scoped_cJSON_t> &key,
+                                                         const boost::shared_ptr<scoped_cJSON_t> &value) {
+    groups.push_back(std::make_pair(key, value));
+    hashes.push_back(hash_json(key->get()));
+    if (2 * groups.size() > slots.size()) {
+        rebuild_index(std::max(MIN_SLOTS, 2 * slots.size()));
+    } else {
+        add_to_index(groups.size() - 1);
+    }
+    return &groups.back().second;
+}
+
+class group_index_less_t {
+public:
+    group_index_less_t(const std::vector<json_groups_t::group_t> *_groups, const backtrace_t &bt)
+        : groups(_groups), backtrace(bt) { }
+    bool operator()(size_t x, size_t y) const {
+        return cJSON_cmp((*groups)[x].first->get(), (*groups)[y].first->get(), backtrace) < 0;
+    }
+private:
+    const std::vector<json_groups_t::group_t> *groups;
+    backtrace_t backtrace;
+};
+
+void json_groups_t::sort(const backtrace_t &backtrace) {
+    std::vector<size_t> order(groups.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), group_index_less_t(&groups, backtrace));
+
+    std::vector<group_t> sorted_groups(groups.size());
+    std::vector<size_t> sorted_hashes(hashes.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        sorted_groups[i].first.swap(groups[order[i]].first);
+        sorted_groups[i].second.swap(groups[order[i]].second);
+        sorted_hashes[i] = hashes[order[i]];
+    }
+    groups.swap(sorted_groups);
+    hashes.swap(sorted_hashes);
+    rebuild_index(slots.size());
+}
+
+void json_groups_t::add_to_index(size_t group) {
+    size_t mask = slots.size() - 1;
+    size_t i = hashes[group] & mask;
+    while (slots[i] != 0) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = group + 1;
+}
+
+void json_groups_t::rebuild_index(size_t num_slots) {
+    slots.assign(num_slots, 0);
+    for (size_t i = 0; i < groups.size(); ++i) {
+        add_to_index(i);
+    }
+}
+
+write_message_t &operator<<(write_message_t &msg, const json_groups_t &groups) {
+    uint64_t sz = groups.size();
+    msg << sz;
+    for (json_groups_t::const_iterator it = groups.begin(); it != groups.end(); ++it) {
+        msg << *it;
+    }
+    return msg;
+}
+
+archive_result_t deserialize(read_stream_t *s, json_groups_t *groups) {
+    *groups = json_groups_t();
+
+    uint64_t sz;
+    archive_result_t res = deserialize(s, &sz);
+    if (res) { return res; }
+
+    for (uint64_t i = 0; i < sz; ++i) {
+        json_groups_t::group_t group;
+        res = deserialize(s, &group);
+        if (res) { return res; }
+        // The keys were unique on the sending side.
+        groups->insert(group.first, group.second);
+    }
+
+    return ARCHIVE_SUCCESS;
+}
+
+}  // namespace query_language
@@ -0,0 +1,75 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_JSON_GROUPS_HPP_
+#define RDB_PROTOCOL_JSON_GROUPS_HPP_
+
+#include <utility>
+#include <vector>
+
+#include "errors.hpp"
+#include <boost/shared_ptr.hpp>
+
+#include "containers/archive/archive.hpp"
+#include "rdb_protocol/backtrace.hpp"
+#include "rdb_protocol/rdb_protocol_json.hpp"
+
+namespace query_language {
+
+/* Hashes a JSON value such that values which `cJSON_cmp()` considers equal
+get the same hash. */
+size_t hash_json(const cJSON *json);
+
+/* Estimates how much memory `json` takes up: its nodes and their strings. */
+size_t json_memory_size(const cJSON *json);
+
+/* The groups of a grouped map-reduce: a hash table from group keys to their
+reductions so far. Keys are compared with `cJSON_cmp()`, but only when their
+hashes match, so grouping a row costs one hash of its key instead of a tree
+walk with a comparison at every level. The groups are kept in one vector in
+insertion order; the table itself is just an array of indexes into it.
+
+Serialized the same way as the `std::map` we used to use. */
+class json_groups_t {
+public:
+    typedef std::pair<boost::shared_ptr<scoped_cJSON_t>, boost::shared_ptr<scoped_cJSON_t> > group_t;
+    typedef std::vector<group_t>::iterator iterator;
+    typedef std::vector<group_t>::const_iterator const_iterator;
+
+    json_groups_t();
+
+    /* Returns the reduction of the group with key `key`, or NULL if there is
+    no such group. The pointer is invalidated by `insert()` and `sort()`. */
+    boost::shared_ptr<scoped_cJSON_t> *find(const boost::shared_ptr<scoped_cJSON_t> &key, const backtrace_t &backtrace);
+
+    /* Adds a group; there must not be a group with key `key` yet. Returns a
+    pointer to its reduction, like `find()`. */
+    boost::shared_ptr<scoped_cJSON_t> *insert(const boost::shared_ptr<scoped_cJSON_t> &key,
+                                              const boost::shared_ptr<scoped_cJSON_t> &value);
+
+    /* Orders the groups by key, for presenting them to the user. */
+    void sort(const backtrace_t &backtrace);
+
+    size_t size() const { return groups.size(); }
+    bool empty() const { return groups.empty(); }
+    iterator begin() { return groups.begin(); }
+    iterator end() { return groups.end(); }
+    const_iterator begin() const { return groups.begin(); }
+    const_iterator end() const { return groups.end(); }
+
+private:
+    void add_to_index(size_t group);
+    void rebuild_index(size_t num_slots);
+
+    std::vector<group_t> groups;
+    // `hashes[i]` is the hash of the key of `groups[i]`.
+    std::vector<size_t> hashes;
+    // Open addressing with linear probing; a slot holds an index into
+    // `groups` plus one, or zero if it's free. Never more than half full.
+    std::vector<size_t> slots;
+};
+
+write_message_t &operator<<(write_message_t &msg, const json_groups_t &groups);
+MUST_USE archive_result_t deserialize(read_stream_t *s, json_groups_t *groups);
+
+}  // namespace query_language
+
+#endif  // RDB_PROTOCOL_JSON_GROUPS_HPP_
@@ -6,6 +6,8 @@
 
 #include "concurrency/cross_thread_watchable.hpp"
 #include "concurrency/watchable.hpp"
+#include "config/args.hpp"
+#include "rdb_protocol/profile.hpp"
 #include "rdb_protocol/stream_cache.hpp"
 #include "rpc/semilattice/view/field.hpp"
 
@@ -45,14 +47,27 @@ Response query_server_t::handle(Query *q, context_t *query_context) {
     Response res;
     res.set_token(q->token());
 
-    query_language::type_checking_environment_t type_environment;
-
     query_language::backtrace_t root_backtrace;
     bool is_deterministic;
 
+    scoped_ptr_t<query_language::profile_t> profile_storage;
+    query_language::profile_t *profile = NULL;
+    if (q->profile()) {
+        profile_storage.init(new query_language::profile_t);
+        profile = profile_storage.get();
+    }
+
     try {
-        query_language::check_query_type(
-            q, &type_environment, &is_deterministic, root_backtrace);
+        {
+            query_language::profile_span_t span(profile, "check_query_type");
+            if (RDB_USE_QUERY_PLAN_CACHE) {
+                plan_caches.get()->check_query_type(q, &is_deterministic, root_backtrace);
+            } else {
+                query_language::type_checking_environment_t type_environment;
+                query_language::check_query_type(
+                    q, &type_environment, &is_deterministic, root_backtrace);
+            }
+        }
         boost::shared_ptr<js::runner_t> js_runner = boost::make_shared<js::runner_t>();
         int thread = get_thread_id();
         query_language::runtime_environment_t runtime_environment(
@@ -61,7 +76,9 @@ Response query_server_t::handle(Query *q, context_t *query_context) {
             ctx->cross_thread_database_watchables[thread]->get_watchable(),
             ctx->semilattice_metadata,
             ctx->directory_read_manager,
-            js_runner, interruptor, ctx->machine_id);
+            js_runner, interruptor, ctx->machine_id, ctx->io_backender, ctx->temp_dir);
+        runtime_environment.profile = profile;
+        query_language::profile_span_t span(profile, "execute");
         //[execute_query] will set the status code unless it throws
         execute_query(q, &runtime_environment, &res, scopes_t(),
                       root_backtrace, stream_cache);
@@ -83,5 +100,9 @@ Response query_server_t::handle(Query *q, context_t *query_context) {
         res.set_error_message("Query interrupted.  Did you shut down the server?");
     }
 
+    if (profile) {
+        profile->write_to(res.mutable_profile());
+    }
+
     return res;
 }
@@ -14,6 +14,7 @@
 #include "extproc/pool.hpp"
 #include "protob/protob.hpp"
 #include "protocol_api.hpp"
+#include "rdb_protocol/plan_cache.hpp"
 #include "rdb_protocol/protocol.hpp"
 #include "rdb_protocol/query_language.hpp"
 
@@ -36,6 +37,7 @@ private:
     rdb_protocol_t::context_t *ctx;
     uuid_t parser_id;
     one_per_thread_t<int> thread_counters;
+    one_per_thread_t<query_language::query_plan_cache_t> plan_caches;
 };
 
 Response on_unparsable_query(Query *q, std::string msg);
@@ -0,0 +1,232 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "rdb_protocol/plan_cache.hpp"
+
+#include "perfmon/perfmon.hpp"
+#include "rdb_protocol/query_language.hpp"
+
+namespace query_language {
+
+// `microseconds_saved` is the type checking that hits avoided, and
+// `microseconds_spent` is what the cache itself cost, on hits and misses.
+static perfmon_counter_t pm_plan_cache_hits, pm_plan_cache_misses, pm_plan_cache_evictions, pm_plan_cache_us_saved, pm_plan_cache_us_spent;
+static perfmon_multi_membership_t pm_plan_cache_membership(&get_global_perfmon_collection(),
+    &pm_plan_cache_hits, "query_plan_cache_hits",
+    &pm_plan_cache_misses, "query_plan_cache_misses",
+    &pm_plan_cache_evictions, "query_plan_cache_evictions",
+    &pm_plan_cache_us_saved, "query_plan_cache_microseconds_saved",
+    &pm_plan_cache_us_spent, "query_plan_cache_microseconds_spent",
+    NULLPTR);
+
+static bool is_literal_term(const Term &t) {
+    switch (t.type()) {
+    case Term::NUMBER:
+    case Term::STRING:
+    case Term::JSON:
+    case Term::BOOL:
+        return true;
+    case Term::JSON_NULL:
+    case Term::VAR:
+    case Term::LET:
+    case Term::CALL:
+    case Term::IF:
+    case Term::ERROR:
+    case Term::ARRAY:
+    case Term::OBJECT:
+    case Term::GETBYKEY:
+    case Term::TABLE:
+    case Term::JAVASCRIPT:
+    case Term::IMPLICIT_VAR:
+        return false;
+    default:
+        unreachable();
+    }
+}
+
+void collect_literal_terms(google::protobuf::Message *msg, std::vector<Term *> *literals_out) {
+    if (msg->GetDescriptor() == Term::descriptor()) {
+        Term *t = static_cast<Term *>(msg);
+        if (is_literal_term(*t)) {
+            literals_out->push_back(t);
+            return;
+        }
+    }
+
+    const google::protobuf::Reflection *reflection = msg->GetReflection();
+    std::vector<const google::protobuf::FieldDescriptor *> fields;
+    reflection->ListFields(*msg, &fields);
+    for (size_t i = 0; i < fields.size(); ++i) {
+        const google::protobuf::FieldDescriptor *field = fields[i];
+        if (field->cpp_type() != google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+            continue;
+        }
+        if (field->is_repeated()) {
+            int n = reflection->FieldSize(*msg, field);
+            for (int j = 0; j < n; ++j) {
+                collect_literal_terms(reflection->MutableRepeatedMessage(msg, field, j), literals_out);
+            }
+        } else {
+            collect_literal_terms(reflection->MutableMessage(msg, field), literals_out);
+        }
+    }
+}
+
+/* Copies the value of literal term `src` into `dest`, leaving the rest of
+`dest` (in particular its type annotations) alone. */
+static void copy_literal_value(const Term &src, Term *dest) {
+    guarantee(src.type() == dest->type());
+    switch (src.type()) {
+    case Term::NUMBER: dest->set_number(src.number()); break;
+    case Term::STRING: dest->set_valuestring(src.valuestring()); break;
+    case Term::JSON: dest->set_jsonstring(src.jsonstring()); break;
+    case Term::BOOL: dest->set_valuebool(src.valuebool()); break;
+    case Term::JSON_NULL:
+    case Term::VAR:
+    case Term::LET:
+    case Term::CALL:
+    case Term::IF:
+    case Term::ERROR:
+    case Term::ARRAY:
+    case Term::OBJECT:
+    case Term::GETBYKEY:
+    case Term::TABLE:
+    case Term::JAVASCRIPT:
+    case Term::IMPLICIT_VAR:
+    default: unreachable();
+    }
+}
+
+/* Blanks out the value of a literal term, keeping track of which fields are
+set so that queries with and without a literal field still differ. */
+static void clear_literal_value(Term *t) {
+    switch (t->type()) {
+    case Term::NUMBER: if (t->has_number()) t->set_number(0); break;
+    case Term::STRING: if (t->has_valuestring()) t->set_valuestring(""); break;
+    case Term::JSON: if (t->has_jsonstring()) t->set_jsonstring(""); break;
+    case Term::BOOL: if (t->has_valuebool()) t->set_valuebool(false); break;
+    case Term::JSON_NULL:
+    case Term::VAR:
+    case Term::LET:
+    case Term::CALL:
+    case Term::IF:
+    case Term::ERROR:
+    case Term::ARRAY:
+    case Term::OBJECT:
+    case Term::GETBYKEY:
+    case Term::TABLE:
+    case Term::JAVASCRIPT:
+    case Term::IMPLICIT_VAR:
+    default: unreachable();
+    }
+}
+
+/* Computes the shape of `q`: its serialization with the token and all
+literal values blanked out. `q` is left as it was. */
+static void compute_shape(Query *q, const std::vector<Term *> &literals, std::string *shape_out) {
+    std::vector<Term> saved(literals.size());
+    for (size_t i = 0; i < literals.size(); ++i) {
+        saved[i].CopyFrom(*literals[i]);
+        clear_literal_value(literals[i]);
+    }
+    int64_t token = q->token();
+    q->set_token(0);
+
+    guarantee(q->SerializeToString(shape_out));
+
+    q->set_token(token);
+    for (size_t i = 0; i < literals.size(); ++i) {
+        literals[i]->CopyFrom(saved[i]);
+    }
+}
+
+query_plan_cache_t::query_plan_cache_t(size_t _max_plans)
+    : max_plans(_max_plans), use_counter(0) {
+    guarantee(max_plans > 0);
+}
+
+query_plan_cache_t::~query_plan_cache_t() {
+    for (plan_map_t::iterator it = plans.begin(); it != plans.end(); ++it) {
+        delete it->second;
+    }
+}
+
+void query_plan_cache_t::check_query_type(Query *q, bool *is_det_out, const backtrace_t &backtrace) {
+    /* Other kinds of queries are cheap to check and not worth caching. */
+    if (!Query::QueryType_IsValid(q->type()) ||
+        (q->type() != Query::READ && q->type() != Query::WRITE)) {
+        type_checking_environment_t type_environment;
+        query_language::check_query_type(q, &type_environment, is_det_out, backtrace);
+        return;
+    }
+
+    ticks_t start = get_ticks();
+
+    std::vector<Term *> literals;
+    collect_literal_terms(q, &literals);
+    std::string shape;
+    compute_shape(q, literals, &shape);
+
+    ticks_t shaped = get_ticks();
+    stats_.shape_ticks += shaped - start;
+
+    plan_map_t::iterator it = plans.find(shape);
+    if (it != plans.end()) {
+        plan_t *plan = it->second;
+        plan->last_use = ++use_counter;
+
+        Query annotated(plan->query);
+        std::vector<Term *> slots;
+        collect_literal_terms(&annotated, &slots);
+        guarantee(slots.size() == literals.size());
+        for (size_t i = 0; i < slots.size(); ++i) {
+            copy_literal_value(*literals[i], slots[i]);
+        }
+        annotated.set_token(q->token());
+        q->Swap(&annotated);
+        *is_det_out = plan->is_deterministic;
+
+        ticks_t end = get_ticks();
+        stats_.rebind_ticks += end - shaped;
+        stats_.check_ticks_saved += plan->check_ticks;
+        ++stats_.hits;
+
+        ++pm_plan_cache_hits;
+        pm_plan_cache_us_saved += plan->check_ticks / 1000;
+        pm_plan_cache_us_spent += (end - start) / 1000;
+        return;
+    }
+
+    ++stats_.misses;
+    ++pm_plan_cache_misses;
+    pm_plan_cache_us_spent += (shaped - start) / 1000;
+
+    /* Throws if the query is ill-typed, in which case we don't cache it. */
+    type_checking_environment_t type_environment;
+    query_language::check_query_type(q, &type_environment, is_det_out, backtrace);
+    ticks_t check_ticks = get_ticks() - shaped;
+    stats_.check_ticks += check_ticks;
+
+    if (plans.size() >= max_plans) {
+        evict_lru();
+    }
+    plan_t *plan = new plan_t;
+    plan->query.CopyFrom(*q);
+    plan->is_deterministic = *is_det_out;
+    plan->check_ticks = check_ticks;
+    plan->last_use = ++use_counter;
+    plans.insert(std::make_pair(shape, plan));
+}
+
+void query_plan_cache_t::evict_lru() {
+    plan_map_t::iterator lru = plans.end();
+    for (plan_map_t::iterator it = plans.begin(); it != plans.end(); ++it) {
+        if (lru == plans.end() || it->second->last_use < lru->second->last_use) {
+            lru = it;
+        }
+    }
+    guarantee(lru != plans.end());
+    delete lru->second;
+    plans.erase(lru);
+    ++pm_plan_cache_evictions;
+}
+
+} // namespace query_language
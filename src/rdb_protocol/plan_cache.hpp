@@ -0,0 +1,93 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_PLAN_CACHE_HPP_
+#define RDB_PROTOCOL_PLAN_CACHE_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "utils.hpp"
+
+#include "rdb_protocol/backtrace.hpp"
+#include "rdb_protocol/query_language.pb.h"
+
+namespace query_language {
+
+/* Type checking a query annotates its terms with their inferred types (see
+`check_query_type()`). The annotations only depend on the structure of the
+query, not on the values of its literals (numbers, strings, booleans and
+JSON strings), and applications tend to send the same few query shapes over
+and over with different literals. `query_plan_cache_t` remembers type-checked
+queries by shape: when a query comes in whose shape we have seen before, we
+take the cached, annotated query and plug the new literals into its literal
+slots instead of type checking again.
+
+This only saves the type checking. What gets cached is the annotated
+protobuf, not a lowered, executable plan: `execute_query()` still walks the
+term tree of every query. A hit isn't free either: computing the shape means
+collecting the literals and serializing the query, and a hit then copies the
+cached query and the new literals into it. Whether that beats type checking
+depends on the query, which is why both sides are measured: `stats()` and the
+perfmon counters report the time spent on lookups next to the type checking
+time that hits saved, and the `json/type_check` benchmark compares the two.
+Until it shows a net win, the query server doesn't use the cache (see
+`RDB_USE_QUERY_PLAN_CACHE`).
+
+There is one cache per thread (see `query_server_t`), so no locking is
+needed. */
+class query_plan_cache_t {
+public:
+    static const size_t DEFAULT_MAX_PLANS = 256;
+
+    explicit query_plan_cache_t(size_t _max_plans = DEFAULT_MAX_PLANS);
+    ~query_plan_cache_t();
+
+    /* Has the same effect on `q` as `query_language::check_query_type()`, and
+    throws the same exceptions. */
+    void check_query_type(Query *q, bool *is_det_out, const backtrace_t &backtrace);
+
+    size_t size() const { return plans.size(); }
+
+    struct stats_t {
+        stats_t() : hits(0), misses(0), shape_ticks(0), rebind_ticks(0), check_ticks(0), check_ticks_saved(0) { }
+        uint64_t hits, misses;
+        // Computing the shapes of all queries, hits and misses alike.
+        ticks_t shape_ticks;
+        // Copying the cached queries and plugging in the new literals on hits.
+        ticks_t rebind_ticks;
+        // Type checking the misses.
+        ticks_t check_ticks;
+        // What type checking the hits took when they were first seen.
+        ticks_t check_ticks_saved;
+    };
+    const stats_t &stats() const { return stats_; }
+
+private:
+    struct plan_t {
+        Query query;
+        bool is_deterministic;
+        // How long it took to type check the query, used to estimate the
+        // time we save on every hit.
+        ticks_t check_ticks;
+        uint64_t last_use;
+    };
+    typedef std::map<std::string, plan_t *> plan_map_t;
+
+    void evict_lru();
+
+    size_t max_plans;
+    plan_map_t plans;
+    uint64_t use_counter;
+    stats_t stats_;
+
+    DISABLE_COPYING(query_plan_cache_t);
+};
+
+/* Appends the literal terms of `msg` (which is typically a `Query`) to
+`literals_out`, in a deterministic order that only depends on the shape of
+`msg`. Exposed for testing. */
+void collect_literal_terms(google::protobuf::Message *msg, std::vector<Term *> *literals_out);
+
+} // namespace query_language
+
+#endif  // RDB_PROTOCOL_PLAN_CACHE_HPP_
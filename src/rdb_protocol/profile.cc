@@ -0,0 +1,63 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "rdb_protocol/profile.hpp"
+
+#include "rdb_protocol/query_language.pb.h"
+
+namespace query_language {
+
+void profile_t::span_t::add_counter(const std::string &counter_name, int64_t value) {
+    for (size_t i = 0; i < counters.size(); ++i) {
+        if (counters[i].first == counter_name) {
+            counters[i].second += value;
+            return;
+        }
+    }
+    counters.push_back(std::make_pair(counter_name, value));
+}
+
+profile_t::span_t *profile_t::span_t::child(const std::string &child_name) {
+    for (size_t i = 0; i < children.size(); ++i) {
+        if (children[i].name == child_name) {
+            return &children[i];
+        }
+    }
+    children.push_back(new span_t(child_name));
+    return &children.back();
+}
+
+profile_t::profile_t() : root("query"), start_time(get_ticks()) {
+    open_spans.push_back(&root);
+}
+
+profile_t::span_t *profile_t::begin_span(const std::string &name) {
+    span_t *span = current_span()->child(name);
+    open_spans.push_back(span);
+    return span;
+}
+
+void profile_t::end_span(span_t *span, ticks_t duration) {
+    guarantee(open_spans.size() > 1 && open_spans.back() == span);
+    span->duration += duration;
+    span->add_counter("calls", 1);
+    open_spans.pop_back();
+}
+
+static void write_span(const profile_t::span_t &span, Response_Profile *out) {
+    out->set_name(span.name);
+    out->set_duration(ticks_to_secs(span.duration));
+    for (size_t i = 0; i < span.counters.size(); ++i) {
+        Response_Profile_Counter *counter = out->add_counter();
+        counter->set_name(span.counters[i].first);
+        counter->set_value(span.counters[i].second);
+    }
+    for (size_t i = 0; i < span.children.size(); ++i) {
+        write_span(span.children[i], out->add_child());
+    }
+}
+
+void profile_t::write_to(Response_Profile *out) {
+    root.duration = get_ticks() - start_time;
+    write_span(root, out);
+}
+
+}  // namespace query_language
@@ -0,0 +1,109 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_PROFILE_HPP_
+#define RDB_PROTOCOL_PROFILE_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "errors.hpp"
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include "utils.hpp"
+
+class Response_Profile;
+
+namespace query_language {
+
+/* The execution profile of a query that asked for one (`Query.profile`). It's
+a tree of spans: each span is one step of executing the query, with how long
+it took, some counters, and the spans of the steps it was made up of. A query
+runs in a single coroutine, so spans nest the same way as the scopes of the
+`profile_span_t`s that record them.
+
+Steps that happen over and over (a javascript call per row, a read per batch)
+would make for a huge tree, so a span with the same name as one of its
+siblings is merged into it: the durations and counters add up, and the "calls"
+counter says how many there were. */
+class profile_t {
+public:
+    class span_t {
+    public:
+        explicit span_t(const std::string &_name) : name(_name), duration(0) { }
+
+        /* Adds `value` to the counter called `counter_name`. */
+        void add_counter(const std::string &counter_name, int64_t value);
+
+        /* Returns the child called `child_name`, creating it if there isn't
+        one yet. */
+        span_t *child(const std::string &child_name);
+
+        std::string name;
+        ticks_t duration;
+        std::vector<std::pair<std::string, int64_t> > counters;
+        boost::ptr_vector<span_t> children;
+
+    private:
+        DISABLE_COPYING(span_t);
+    };
+
+    profile_t();
+
+    /* The innermost span that's still open. */
+    span_t *current_span() { return open_spans.back(); }
+
+    span_t *begin_span(const std::string &name);
+    void end_span(span_t *span, ticks_t duration);
+
+    /* The root span lasts from when the profile was created until this is
+    called. */
+    void write_to(Response_Profile *out);
+
+private:
+    span_t root;
+    ticks_t start_time;
+    std::vector<span_t *> open_spans;
+
+    DISABLE_COPYING(profile_t);
+};
+
+/* Records a span for as long as it is in scope. If `profile` is NULL, which
+it is for every query that didn't ask to be profiled, it does nothing. */
+class profile_span_t {
+public:
+    profile_span_t(profile_t *_profile, const char *name)
+        : profile(_profile), span(NULL), start_time(0) {
+        if (profile) {
+            span = profile->begin_span(name);
+            start_time = get_ticks();
+        }
+    }
+
+    ~profile_span_t() {
+        if (profile) {
+            profile->end_span(span, get_ticks() - start_time);
+        }
+    }
+
+    /* NULL if we're not profiling. */
+    profile_t::span_t *get() { return span; }
+
+    void add_counter(const char *name, int64_t value) {
+        if (span) {
+            span->add_counter(name, value);
+        }
+    }
+
+private:
+    profile_t *profile;
+    profile_t::span_t *span;
+    ticks_t start_time;
+
+    DISABLE_COPYING(profile_span_t);
+};
+
+}  // namespace query_language
+
+#endif  // RDB_PROTOCOL_PROFILE_HPP_
@@ -4,6 +4,7 @@
 #include <boost/function.hpp>
 #include <boost/make_shared.hpp>
 
+#include "btree/backfill.hpp"
 #include "btree/erase_range.hpp"
 #include "btree/parallel_traversal.hpp"
 #include "btree/slice.hpp"
@@ -17,6 +18,7 @@
 #include "rdb_protocol/btree.hpp"
 #include "rdb_protocol/protocol.hpp"
 #include "rdb_protocol/query_language.hpp"
+#include "rdb_protocol/transform_visitors.hpp"
 #include "rpc/semilattice/view/field.hpp"
 #include "rpc/semilattice/watchable.hpp"
 #include "serializer/config.hpp"
@@ -36,6 +38,7 @@ typedef rdb_protocol_t::point_read_response_t point_read_response_t;
 
 typedef rdb_protocol_t::rget_read_t rget_read_t;
 typedef rdb_protocol_t::rget_read_response_t rget_read_response_t;
+typedef rdb_protocol_t::rget_read_stats_t rget_read_stats_t;
 
 typedef rdb_protocol_t::distribution_read_t distribution_read_t;
 typedef rdb_protocol_t::distribution_read_response_t distribution_read_response_t;
@@ -78,21 +81,26 @@ rdb_protocol_t::context_t::context_t()
     cross_thread_namespace_watchables(get_num_threads()),
     cross_thread_database_watchables(get_num_threads()),
     directory_read_manager(NULL),
-    signals(get_num_threads())
+    signals(get_num_threads()),
+    io_backender(NULL)
 { }
 
 rdb_protocol_t::context_t::context_t(extproc::pool_group_t *_pool_group,
           namespace_repo_t<rdb_protocol_t> *_ns_repo,
           boost::shared_ptr<semilattice_readwrite_view_t<cluster_semilattice_metadata_t> > _semilattice_metadata,
           directory_read_manager_t<cluster_directory_metadata_t> *_directory_read_manager,
-          machine_id_t _machine_id)
+          machine_id_t _machine_id,
+          io_backender_t *_io_backender,
+          const std::string &_temp_dir)
     : pool_group(_pool_group), ns_repo(_ns_repo),
       cross_thread_namespace_watchables(get_num_threads()),
       cross_thread_database_watchables(get_num_threads()),
       semilattice_metadata(_semilattice_metadata),
       directory_read_manager(_directory_read_manager),
       signals(get_num_threads()),
-      machine_id(_machine_id)
+      machine_id(_machine_id),
+      io_backender(_io_backender),
+      temp_dir(_temp_dir)
 {
     for (int thread = 0; thread < get_num_threads(); ++thread) {
         cross_thread_namespace_watchables[thread].init(new cross_thread_watchable_variable_t<cow_ptr_t<namespaces_semilattice_metadata_t<rdb_protocol_t> > >(
@@ -291,23 +299,13 @@ public:
                 //GroupedMapreduce
                 rg_response.result = groups_t();
                 groups_t *res_groups = boost::get<groups_t>(&rg_response.result);
+                query_language::grouped_map_reduce_t grouped_map_reduce(*gmr, &env, rg.terminal->scopes, rg.terminal->backtrace);
                 for (size_t i = 0; i < count; ++i) {
                     const rget_read_response_t *_rr = boost::get<rget_read_response_t>(&responses[i].response);
                     guarantee(_rr);
 
                     const groups_t *groups = boost::get<groups_t>(&(_rr->result));
-
-                    for (groups_t::const_iterator j = groups->begin(); j != groups->end(); ++j) {
-                        Term base = gmr->reduction().base(),
-                             body = gmr->reduction().body();
-
-                        scopes_t scopes_copy = rg.terminal->scopes;
-                        query_language::new_val_scope_t inner_scope(&scopes_copy.scope);
-                        scopes_copy.scope.put_in_scope(gmr->reduction().var1(),
-                            res_groups->insert(std::make_pair(j->first, eval_term_as_json(&base, &env, rg.terminal->scopes, rg.terminal->backtrace.with("reduction").with("base")))).first->second);
-                        scopes_copy.scope.put_in_scope(gmr->reduction().var2(), j->second);
-                        (*res_groups)[j->first] = eval_term_as_json(&body, &env, scopes_copy, rg.terminal->backtrace.with("reduction").with("body"));
-                    }
+                    grouped_map_reduce.merge(*groups, res_groups);
                 }
             } else if (const Reduction *r = boost::get<Reduction>(&rg.terminal->variant)) {
                 //Normal Mapreduce
@@ -360,6 +358,14 @@ public:
         } catch (const runtime_exc_t &e) {
             rg_response.result = e;
         }
+
+        if (rg.profile) {
+            for (size_t i = 0; i < count; ++i) {
+                const rget_read_response_t *_rr = boost::get<rget_read_response_t>(&responses[i].response);
+                guarantee(_rr);
+                rg_response.shard_stats.insert(rg_response.shard_stats.end(), _rr->shard_stats.begin(), _rr->shard_stats.end());
+            }
+        }
     }
 
     void operator()(const distribution_read_t &dg) {
@@ -527,7 +533,14 @@ struct read_visitor_t : public boost::static_visitor<void> {
     void operator()(const rget_read_t &rget) {
         response->response = rget_read_response_t();
         rget_read_response_t &res = boost::get<rget_read_response_t>(response->response);
-        rdb_rget_slice(btree, rget.region.inner, txn, superblock, &env, rget.transform, rget.terminal, &res);
+        if (rget.profile) {
+            rget_read_stats_t stats;
+            stats.region = rget.region;
+            rdb_rget_slice(btree, rget.region.inner, txn, superblock, &env, rget.transform, rget.terminal, &res, &stats);
+            res.shard_stats.push_back(stats);
+        } else {
+            rdb_rget_slice(btree, rget.region.inner, txn, superblock, &env, rget.transform, rget.terminal, &res, NULL);
+        }
     }
 
     void operator()(const distribution_read_t &dg) {
@@ -712,8 +725,8 @@ struct rdb_backfill_callback_impl_t : public rdb_backfill_callback_t {
 public:
     typedef backfill_chunk_t chunk_t;
 
-    explicit rdb_backfill_callback_impl_t(chunk_fun_callback_t<rdb_protocol_t> *_chunk_fun_cb)
-        : chunk_fun_cb(_chunk_fun_cb) { }
+    rdb_backfill_callback_impl_t(chunk_fun_callback_t<rdb_protocol_t> *_chunk_fun_cb, const region_t &_region)
+        : chunk_fun_cb(_chunk_fun_cb), region(_region) { }
     ~rdb_backfill_callback_impl_t() { }
 
     void on_delete_range(const key_range_t &range, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
@@ -728,6 +741,10 @@ public:
         chunk_fun_cb->send_chunk(chunk_t::set_key(atom), interruptor);
     }
 
+    void on_range_done(const key_range_t &range, signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        chunk_fun_cb->send_checkpoint(region_intersection(region, region_t(range)), interruptor);
+    }
+
 protected:
     store_key_t to_store_key(const btree_key_t *key) {
         return store_key_t(key->size, key->contents);
@@ -735,19 +752,22 @@ protected:
 
 private:
     chunk_fun_callback_t<rdb_protocol_t> *chunk_fun_cb;
+    /* The part of the start point this callback is backfilling. */
+    region_t region;
 
     DISABLE_COPYING(rdb_backfill_callback_impl_t);
 };
 
 static void call_rdb_backfill(int i, btree_slice_t *btree, const std::vector<std::pair<region_t, state_timestamp_t> > &regions,
-        rdb_backfill_callback_t *callback, transaction_t *txn, superblock_t *superblock, backfill_progress_t *progress,
+        chunk_fun_callback_t<rdb_protocol_t> *chunk_fun_cb, transaction_t *txn, superblock_t *superblock, backfill_progress_t *progress,
         signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
     parallel_traversal_progress_t *p = new parallel_traversal_progress_t;
     scoped_ptr_t<traversal_progress_t> p_owned(p);
     progress->add_constituent(&p_owned);
     repli_timestamp_t timestamp = regions[i].second.to_repli_timestamp();
+    rdb_backfill_callback_impl_t callback(chunk_fun_cb, regions[i].first);
     try {
-        rdb_backfill(btree, regions[i].first.inner, timestamp, callback, txn, superblock, p, interruptor);
+        rdb_backfill(btree, regions[i].first.inner, timestamp, &callback, txn, superblock, p, interruptor);
     } catch (interrupted_exc_t) {
         /* do nothing; `protocol_send_backfill()` will notice that interruptor
         has been pulsed */
@@ -762,11 +782,25 @@ void store_t::protocol_send_backfill(const region_map_t<rdb_protocol_t, state_ti
                                      backfill_progress_t *progress,
                                      signal_t *interruptor)
                                      THROWS_ONLY(interrupted_exc_t) {
-    rdb_backfill_callback_impl_t callback(chunk_fun_cb);
-    std::vector<std::pair<region_t, state_timestamp_t> > regions(start_point.begin(), start_point.end());
+    if (start_point.begin() == start_point.end()) {
+        return;
+    }
+
+    /* Each region is cut up further along the keys in the root, so that the
+    pieces are traversed concurrently and report their progress separately. */
+    std::vector<std::pair<region_t, state_timestamp_t> > regions;
+    const int parts_per_region = std::max<int>(1, BACKFILL_MAX_SUBRANGES / std::distance(start_point.begin(), start_point.end()));
+    for (region_map_t<rdb_protocol_t, state_timestamp_t>::const_iterator it = start_point.begin(); it != start_point.end(); ++it) {
+        std::vector<key_range_t> parts;
+        split_backfill_range(txn, superblock, it->first.inner, parts_per_region, &parts);
+        for (size_t i = 0; i < parts.size(); ++i) {
+            regions.push_back(std::make_pair(region_t(it->first.beg, it->first.end, parts[i]), it->second));
+        }
+    }
+
     refcount_superblock_t refcount_wrapper(superblock, regions.size());
     pmap(regions.size(), boost::bind(&call_rdb_backfill, _1,
-        btree, regions, &callback, txn, &refcount_wrapper, progress, interruptor));
+        btree, regions, chunk_fun_cb, txn, &refcount_wrapper, progress, interruptor));
 
     /* If interruptor was pulsed, `call_rdb_backfill()` exited silently, so we
     have to check directly. */
@@ -833,6 +867,21 @@ void store_t::protocol_receive_backfill(btree_slice_t *btree,
     boost::apply_visitor(receive_backfill_visitor_t(btree, txn, superblock, interruptor), chunk.val);
 }
 
+bool store_t::protocol_bulk_load_backfill(btree_slice_t *btree,
+                                          transaction_t *txn,
+                                          superblock_t *superblock,
+                                          const std::vector<backfill_chunk_t> &chunks) {
+    std::vector<const rdb_backfill_atom_t *> atoms;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        const backfill_chunk_t::key_value_pair_t *kv = boost::get<backfill_chunk_t::key_value_pair_t>(&chunks[i].val);
+        if (kv == NULL) {
+            return false;
+        }
+        atoms.push_back(&kv->backfill_atom);
+    }
+    return rdb_bulk_load(atoms, btree, txn, superblock);
+}
+
 void store_t::protocol_reset_data(const region_t& subregion,
                                   btree_slice_t *btree,
                                   transaction_t *txn,
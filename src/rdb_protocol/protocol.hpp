@@ -29,6 +29,7 @@
 #include "hash_region.hpp"
 #include "protocol_api.hpp"
 #include "rdb_protocol/exceptions.hpp"
+#include "rdb_protocol/json_groups.hpp"
 #include "rdb_protocol/query_language.pb.h"
 #include "rdb_protocol/rdb_protocol_json.hpp"
 #include "rdb_protocol/serializable_environment.hpp"
@@ -134,6 +135,7 @@ struct terminal_t {
 } // namespace rdb_protocol_details
 
 class cluster_semilattice_metadata_t;
+class io_backender_t;
 
 struct rdb_protocol_t {
     static const std::string protocol_name;
@@ -148,7 +150,9 @@ struct rdb_protocol_t {
                   namespace_repo_t<rdb_protocol_t> *_ns_repo,
                   boost::shared_ptr<semilattice_readwrite_view_t<cluster_semilattice_metadata_t> > _semilattice_metadata,
                   directory_read_manager_t<cluster_directory_metadata_t> *_directory_read_manager,
-                  machine_id_t _machine_id);
+                  machine_id_t _machine_id,
+                  io_backender_t *_io_backender,
+                  const std::string &_temp_dir);
         ~context_t();
 
         extproc::pool_group_t *pool_group;
@@ -163,6 +167,10 @@ struct rdb_protocol_t {
         cond_t interruptor; //TODO figure out where we're going to want to interrupt this from and put this there instead
         scoped_array_t<scoped_ptr_t<cross_thread_signal_t> > signals;
         machine_id_t machine_id;
+        // Used for temporary files, e.g. by large sorts. May be NULL.
+        io_backender_t *io_backender;
+        // The directory the temporary files go in.
+        std::string temp_dir;
     };
 
     struct point_read_response_t {
@@ -175,9 +183,25 @@ struct rdb_protocol_t {
         RDB_MAKE_ME_SERIALIZABLE_1(data);
     };
 
+    /* What one shard did to answer a profiled `rget_read_t`. */
+    struct rget_read_stats_t {
+        rget_read_stats_t()
+            : duration(0), rows_scanned(0), blocks_from_cache(0), blocks_from_disk(0), bytes(0) { }
+
+        region_t region;
+        ticks_t duration;
+        int64_t rows_scanned;
+        int64_t blocks_from_cache;
+        int64_t blocks_from_disk;
+        // The serialized size of the shard's result.
+        int64_t bytes;
+
+        RDB_MAKE_ME_SERIALIZABLE_6(region, duration, rows_scanned, blocks_from_cache, blocks_from_disk, bytes);
+    };
+
     struct rget_read_response_t {
         typedef std::vector<std::pair<store_key_t, boost::shared_ptr<scoped_cJSON_t> > > stream_t; //Present if there was no terminal
-        typedef std::map<boost::shared_ptr<scoped_cJSON_t>, boost::shared_ptr<scoped_cJSON_t>, shared_scoped_less_t> groups_t; //Present if the terminal was a groupedmapreduce
+        typedef query_language::json_groups_t groups_t; //Present if the terminal was a groupedmapreduce
         typedef boost::shared_ptr<scoped_cJSON_t> atom_t; //Present if the terminal was a reduction
 
         struct length_t {
@@ -198,6 +222,8 @@ struct rdb_protocol_t {
         int errors;
         bool truncated;
         store_key_t last_considered_key;
+        // One entry per shard, if the read was profiled.
+        std::vector<rget_read_stats_t> shard_stats;
 
         rget_read_response_t() { }
         rget_read_response_t(const key_range_t &_key_range, const result_t _result, int _errors, bool _truncated, const store_key_t &_last_considered_key)
@@ -205,7 +231,7 @@ struct rdb_protocol_t {
               last_considered_key(_last_considered_key)
         { }
 
-        RDB_MAKE_ME_SERIALIZABLE_5(result, errors, key_range, truncated, last_considered_key);
+        RDB_MAKE_ME_SERIALIZABLE_6(result, errors, key_range, truncated, last_considered_key, shard_stats);
     };
 
     struct distribution_read_response_t {
@@ -246,25 +272,25 @@ struct rdb_protocol_t {
 
     class rget_read_t {
     public:
-        rget_read_t() { }
+        rget_read_t() : profile(false) { }
         explicit rget_read_t(const region_t &_region)
-            : region(_region) { }
+            : region(_region), profile(false) { }
 
         rget_read_t(const region_t &_region,
                     const rdb_protocol_details::transform_t &_transform)
-            : region(_region), transform(_transform)
+            : region(_region), transform(_transform), profile(false)
         { }
 
         rget_read_t(const region_t &_region,
                     const boost::optional<rdb_protocol_details::terminal_t> &_terminal)
-            : region(_region), terminal(_terminal)
+            : region(_region), terminal(_terminal), profile(false)
         { }
 
         rget_read_t(const region_t &_region,
                     const rdb_protocol_details::transform_t &_transform,
                     const boost::optional<rdb_protocol_details::terminal_t> &_terminal)
             : region(_region), transform(_transform),
-              terminal(_terminal)
+              terminal(_terminal), profile(false)
         { }
 
         region_t region;
@@ -272,7 +298,10 @@ struct rdb_protocol_t {
         rdb_protocol_details::transform_t transform;
         boost::optional<rdb_protocol_details::terminal_t> terminal;
 
-        RDB_MAKE_ME_SERIALIZABLE_3(region, transform, terminal);
+        // If true, every shard fills in `shard_stats` in its response.
+        bool profile;
+
+        RDB_MAKE_ME_SERIALIZABLE_4(region, transform, terminal, profile);
     };
 
     class distribution_read_t {
@@ -508,6 +537,11 @@ struct rdb_protocol_t {
                                        signal_t *interruptor,
                                        const backfill_chunk_t &chunk);
 
+        bool protocol_bulk_load_backfill(btree_slice_t *btree,
+                                         transaction_t *txn,
+                                         superblock_t *superblock,
+                                         const std::vector<backfill_chunk_t> &chunks);
+
         void protocol_reset_data(const region_t& subregion,
                                  btree_slice_t *btree,
                                  transaction_t *txn,
@@ -12,6 +12,7 @@
 #include "http/json.hpp"
 #include "rdb_protocol/internal_extensions.pb.h"
 #include "rdb_protocol/js.hpp"
+#include "rdb_protocol/profile.hpp"
 #include "rpc/directory/read_manager.hpp"
 #include "rdb_protocol/proto_utils.hpp"
 
@@ -1134,12 +1135,20 @@ void execute_query(Query *q, runtime_environment_t *env, Response *res, const sc
         execute_write_query(q->mutable_write_query(), env, res, scopes, backtrace);
     } break; //status set in [execute_write_query]
     case Query::CONTINUE: {
-        if (!stream_cache->serve(q->token(), res, env->interruptor)) {
+        if (!stream_cache->serve(q->token(), res, env->interruptor, env->profile)) {
+            std::string reason;
+            if (stream_cache->was_evicted(q->token(), &reason)) {
+                throw runtime_exc_t(strprintf("Cursor for key %lld was closed by the server because %s.", (long long int)q->token(), reason.c_str()), backtrace);
+            }
             throw runtime_exc_t(strprintf("Could not serve key %lld from stream cache.", (long long int)q->token()), backtrace);
         }
     } break; //status set in [serve]
     case Query::STOP: {
-        if (!stream_cache->contains(q->token())) {
+        std::string reason;
+        if (stream_cache->was_evicted(q->token(), &reason)) {
+            // The server beat the client to it; nothing left to do.
+            res->set_status_code(Response::SUCCESS_EMPTY);
+        } else if (!stream_cache->contains(q->token())) {
             throw broken_client_exc_t(strprintf("No key %lld in stream cache.", (long long int)q->token()));
         } else {
             res->set_status_code(Response::SUCCESS_EMPTY);
@@ -1173,7 +1182,7 @@ void execute_read_query(ReadQuery *r, runtime_environment_t *env, Response *res,
         } else {
             stream_cache->insert(r, key, stream);
         }
-        bool b = stream_cache->serve(key, res, env->interruptor);
+        bool b = stream_cache->serve(key, res, env->interruptor, env->profile);
         guarantee_debug_throw_release(b, backtrace);
         break; //status code set in [serve]
     }
@@ -1214,6 +1223,7 @@ void throwing_insert(namespace_repo_t<rdb_protocol_t>::access_t ns_access, const
     try {
         rdb_protocol_t::write_t write(rdb_protocol_t::point_write_t(store_key_t(cJSON_print_primary(data->GetObjectItem(pk.c_str()), backtrace)), data, overwrite));
         rdb_protocol_t::write_response_t response;
+        profile_span_t span(env->profile, "point_write");
         ns_access.get_namespace_if()->write(write, &response, order_token_t::ignore, env->interruptor);
 
         if (generated_key && boost::get<rdb_protocol_t::point_write_response_t>(response.response).result == DUPLICATE) {
@@ -1251,6 +1261,7 @@ rdb_protocol_t::point_read_response_t read_by_key(namespace_repo_t<rdb_protocol_
                                             cJSON *key, bool use_outdated, const backtrace_t &backtrace) {
     rdb_protocol_t::read_t read(rdb_protocol_t::point_read_t(store_key_t(cJSON_print_primary(key, backtrace))));
     rdb_protocol_t::read_response_t res;
+    profile_span_t span(env->profile, "point_read");
     if (use_outdated) {
         ns_access.get_namespace_if()->read_outdated(read, &res, env->interruptor);
     } else {
@@ -1266,6 +1277,7 @@ int point_delete(namespace_repo_t<rdb_protocol_t>::access_t ns_access, cJSON *id
     try {
         rdb_protocol_t::write_t write(rdb_protocol_t::point_delete_t(store_key_t(cJSON_print_primary(id, backtrace))));
         rdb_protocol_t::write_response_t response;
+        profile_span_t span(env->profile, "point_delete");
         ns_access.get_namespace_if()->write(write, &response, order_token_t::ignore, env->interruptor);
         return (boost::get<rdb_protocol_t::point_delete_response_t>(response.response).result == DELETED);
     } catch (cannot_perform_query_exc_t e) {
@@ -1388,6 +1400,7 @@ point_modify_ns::result_t point_modify(namespace_repo_t<rdb_protocol_t>::access_
         } else { //deterministic modifications can be dispatched as point_modifies
             rdb_protocol_t::write_t write(rdb_protocol_t::point_modify_t(pk, store_key_t(cJSON_print_primary(id, backtrace)), op, scopes, backtrace, m));
             rdb_protocol_t::write_response_t response;
+            profile_span_t span(env->profile, "point_modify");
             ns_access.get_namespace_if()->write(write, &response, order_token_t::ignore, env->interruptor);
             rdb_protocol_t::point_modify_response_t mod_res = boost::get<rdb_protocol_t::point_modify_response_t>(response.response);
             if (mod_res.result == point_modify_ns::ERROR) throw mod_res.exc;
@@ -1685,6 +1698,46 @@ boost::shared_ptr<scoped_cJSON_t> eval_term_as_json_and_check_either(Term *t, ru
 }
 
 
+/* Returns the id of the compiled function for the javascript term `t`,
+compiling it (and tagging `t` with the id) if necessary. All values in scope
+are passed as arguments; their values are written to `argvals_out`. */
+static js::id_t get_js_function(Term *t, js::runner_t *js, const scopes_t &scopes,
+                                std::vector<boost::shared_ptr<scoped_cJSON_t> > *argvals_out,
+                                const backtrace_t &backtrace) {
+    // Check whether the function has been compiled already.
+    bool compiled = t->HasExtension(extension::js_id);
+
+    std::vector<std::string> argnames; // only used if (!compiled)
+    scopes.scope.dump(compiled ? NULL : &argnames, argvals_out);
+
+    if (compiled) {
+        return t->GetExtension(extension::js_id);
+    }
+
+    // Not compiled yet. Compile it and add the extension.
+    std::string errmsg;
+    js::id_t id = js->compile(argnames, t->javascript(), &errmsg);
+    if (js::INVALID_ID == id) {
+        throw runtime_exc_t("failed to compile javascript: " + errmsg, backtrace);
+    }
+    t->SetExtension(extension::js_id, (int32_t) id);
+    return id;
+}
+
+/* Figures out whether to bind "this" to the implicit object. */
+static boost::shared_ptr<scoped_cJSON_t> get_js_receiver(const scopes_t &scopes) {
+    boost::shared_ptr<scoped_cJSON_t> object;
+    if (scopes.implicit_attribute_value.has_value()) {
+        object = scopes.implicit_attribute_value.get_value();
+        if (object->type() != cJSON_Object) {
+            // If it's not a JSON object, we have to ignore it ("this"
+            // can't be bound to a non-object).
+            object.reset();
+        }
+    }
+    return object;
+}
+
 boost::shared_ptr<scoped_cJSON_t> eval_term_as_json(Term *t, runtime_environment_t *env, const scopes_t &scopes, const backtrace_t &backtrace) THROWS_ONLY(interrupted_exc_t, runtime_exc_t, broken_client_exc_t) {
     switch (t->type()) {
     case Term::IMPLICIT_VAR:
@@ -1799,17 +1852,10 @@ boost::shared_ptr<scoped_cJSON_t> eval_term_as_json(Term *t, runtime_environment
         crash("Term::TABLE must be evaluated with eval_stream or eval_view");
 
     case Term::JAVASCRIPT: {
-        // TODO(rntz): optimize map/reduce/filter queries whose
-        // mappings/reductions/predicates are just javascript terms by
-        // streaming arguments to them and streaming results back. Should
-        // wait to do this until it's established it's a bottleneck, but
-        // it's a reasonably good bet that it is. Putting this comment here
-        // not because the changes will need to be made here but because
-        // it's the most logical place to put it.
-
         // TODO (rntz): implicitly bound argument should become receiver
         // ("this") object on javascript side.
 
+        profile_span_t span(env->profile, "javascript");
         boost::shared_ptr<js::runner_t> js = env->get_js_runner();
         std::string errmsg;
         boost::shared_ptr<scoped_cJSON_t> result;
@@ -1817,40 +1863,13 @@ boost::shared_ptr<scoped_cJSON_t> eval_term_as_json(Term *t, runtime_environment
         // TODO(rntz): set up a js::runner_t::req_config_t with an
         // appropriately-chosen timeout.
 
-        // Check whether the function has been compiled already.
-        bool compiled = t->HasExtension(extension::js_id);
-
         // We give all values in scope as arguments.
         // TODO(rntz): this is wasteful double-copying.
-        std::vector<std::string> argnames; // only used if (!compiled)
         std::vector<boost::shared_ptr<scoped_cJSON_t> > argvals;
-        scopes.scope.dump(compiled ? NULL : &argnames, &argvals);
-
-        js::id_t id;
-        if (compiled) {
-            id = t->GetExtension(extension::js_id);
-        } else {
-            // Not compiled yet. Compile it and add the extension.
-            id = js->compile(argnames, t->javascript(), &errmsg);
-            if (js::INVALID_ID == id) {
-                throw runtime_exc_t("failed to compile javascript: " + errmsg, backtrace);
-            }
-            t->SetExtension(extension::js_id, (int32_t) id);
-        }
-
-        // Figure out whether to bind "this" to the implicit object.
-        boost::shared_ptr<scoped_cJSON_t> object;
-        if (scopes.implicit_attribute_value.has_value()) {
-            object = scopes.implicit_attribute_value.get_value();
-            if (object->type() != cJSON_Object) {
-                // If it's not a JSON object, we have to ignore it ("this"
-                // can't be bound to a non-object).
-                object.reset();
-            }
-        }
+        js::id_t id = get_js_function(t, js.get(), scopes, &argvals, backtrace);
 
         // Evaluate the source.
-        result = js->call(id, object, argvals, &errmsg);
+        result = js->call(id, get_js_receiver(scopes), argvals, &errmsg);
         if (!result) {
             throw runtime_exc_t("failed to evaluate javascript: " + errmsg, backtrace);
         }
@@ -2375,8 +2394,9 @@ boost::shared_ptr<scoped_cJSON_t> eval_call_as_json(Term::Call *c, runtime_envir
                 try {
                     rdb_protocol_t::rget_read_response_t::result_t result = stream->apply_terminal(c->builtin().grouped_map_reduce(), env, scopes, backtrace);
                     rdb_protocol_t::rget_read_response_t::groups_t *groups = boost::get<rdb_protocol_t::rget_read_response_t::groups_t>(&result);
+                    groups->sort(backtrace);
                     boost::shared_ptr<scoped_cJSON_t> res(new scoped_cJSON_t(cJSON_CreateArray()));
-                    std::map<boost::shared_ptr<scoped_cJSON_t>, boost::shared_ptr<scoped_cJSON_t>, shared_scoped_less_t>::iterator it;
+                    rdb_protocol_t::rget_read_response_t::groups_t::iterator it;
                     for (it = groups->begin(); it != groups->end(); ++it) {
                         scoped_cJSON_t obj(cJSON_CreateObject());
                         obj.AddItemToObject("group", it->first->release());
@@ -2455,6 +2475,7 @@ bool predicate_t::operator()(boost::shared_ptr<scoped_cJSON_t> json) {
     }
 }
 
+/* Sorted streams outlive the query, so this holds its own copy of the ordering. */
 class ordering_t {
 public:
     ordering_t(const google::protobuf::RepeatedPtrField<Builtin::OrderBy> &_order, const backtrace_t &bt)
@@ -2494,10 +2515,35 @@ public:
     }
 
 private:
-    const google::protobuf::RepeatedPtrField<Builtin::OrderBy> &order;
+    google::protobuf::RepeatedPtrField<Builtin::OrderBy> order;
     backtrace_t backtrace;
 };
 
+static bool is_order_by(const Term &t) {
+    return t.type() == Term::CALL && t.call().builtin().type() == Builtin::ORDERBY;
+}
+
+/* Sorts `stream` by the ordering of the ORDERBY call `c`. If `limit` is
+nonzero only the first `limit` rows of the result will be read, which lets the
+sort keep just those in memory. */
+static boost::shared_ptr<json_stream_t> sort_stream(Term::Call *c, boost::shared_ptr<json_stream_t> stream, size_t limit,
+                                                   runtime_environment_t *env, const backtrace_t &backtrace) {
+    ordering_t o(c->builtin().order_by(), backtrace.with("order_by"));
+    return boost::make_shared<sort_stream_t>(stream, o, limit, env->io_backender, env->temp_dir);
+}
+
+static boost::shared_ptr<json_stream_t> eval_order_by_as_stream(Term::Call *c, size_t limit, runtime_environment_t *env,
+                                                                const scopes_t &scopes, const backtrace_t &backtrace) {
+    boost::shared_ptr<json_stream_t> stream = eval_term_as_stream(c->mutable_args(0), env, scopes, backtrace.with("arg:0"));
+    return sort_stream(c, stream, limit, env, backtrace);
+}
+
+static view_t eval_order_by_as_view(Term::Call *c, size_t limit, runtime_environment_t *env,
+                                    const scopes_t &scopes, const backtrace_t &backtrace) {
+    view_t view = eval_term_as_view(c->mutable_args(0), env, scopes, backtrace.with("arg:0"));
+    return view_t(view.access, view.primary_key, sort_stream(c, view.stream, limit, env, backtrace));
+}
+
 /* Renaming map here because otherwise it conflicts with std::map. */
 boost::shared_ptr<scoped_cJSON_t> map_rdb(std::string arg, Term *term, runtime_environment_t *env, const scopes_t &scopes, const backtrace_t &backtrace, boost::shared_ptr<scoped_cJSON_t> val) {
     scopes_t scopes_copy = scopes;
@@ -2515,6 +2561,46 @@ boost::shared_ptr<scoped_cJSON_t> eval_mapping(Mapping m, runtime_environment_t
     return map_rdb(m.arg(), m.mutable_body(), env, scopes, backtrace, val);
 }
 
+void map_rdb_batch(const std::string &arg, Term *term, runtime_environment_t *env, const scopes_t &scopes, const backtrace_t &backtrace,
+                   const std::vector<boost::shared_ptr<scoped_cJSON_t> > &vals, std::vector<boost::shared_ptr<scoped_cJSON_t> > *out) {
+    out->reserve(out->size() + vals.size());
+
+    if (term->type() != Term::JAVASCRIPT || vals.size() < 2) {
+        for (size_t i = 0; i < vals.size(); ++i) {
+            out->push_back(map_rdb(arg, term, env, scopes, backtrace, vals[i]));
+        }
+        return;
+    }
+
+    /* The term is a bare javascript function, so rather than doing one round
+    trip to the worker per value we gather up the receivers and arguments for
+    every value and ship them over together. */
+    boost::shared_ptr<js::runner_t> js = env->get_js_runner();
+    std::vector<boost::shared_ptr<scoped_cJSON_t> > objects;
+    std::vector<std::vector<boost::shared_ptr<scoped_cJSON_t> > > args(vals.size());
+    objects.reserve(vals.size());
+
+    js::id_t id = js::INVALID_ID;
+    for (size_t i = 0; i < vals.size(); ++i) {
+        scopes_t scopes_copy = scopes;
+
+        variable_val_scope_t::new_scope_t scope_maker(&scopes_copy.scope, arg, vals[i]);
+        implicit_value_setter_t impliciter(&scopes_copy.implicit_attribute_value, vals[i]);
+
+        if (i == 0) {
+            id = get_js_function(term, js.get(), scopes_copy, &args[i], backtrace);
+        } else {
+            scopes_copy.scope.dump(NULL, &args[i]);
+        }
+        objects.push_back(get_js_receiver(scopes_copy));
+    }
+
+    std::string errmsg;
+    if (!js->call_batch(id, objects, args, out, &errmsg)) {
+        throw runtime_exc_t("failed to evaluate javascript: " + errmsg, backtrace);
+    }
+}
+
 boost::shared_ptr<json_stream_t> concatmap(std::string arg, Term *term, runtime_environment_t *env, const scopes_t &scopes, const backtrace_t &backtrace, boost::shared_ptr<scoped_cJSON_t> val) {
     scopes_t scopes_copy = scopes;
     variable_val_scope_t::new_scope_t scope_maker(&scopes_copy.scope, arg, val);
@@ -2575,14 +2661,8 @@ boost::shared_ptr<json_stream_t> eval_call_as_stream(Term::Call *c, runtime_envi
                 return stream->add_transformation(c->builtin().concat_map(), env, scopes, backtrace.with("mapping"));
             }
             break;
-        case Builtin::ORDERBY: {
-            ordering_t o(c->builtin().order_by(), backtrace.with("order_by"));
-            boost::shared_ptr<json_stream_t> stream = eval_term_as_stream(c->mutable_args(0), env, scopes, backtrace.with("arg:0"));
-
-            boost::shared_ptr<in_memory_stream_t> sorted_stream(new in_memory_stream_t(stream));
-            sorted_stream->sort(o);
-            return sorted_stream;
-        }
+        case Builtin::ORDERBY:
+            return eval_order_by_as_stream(c, 0, env, scopes, backtrace);
             break;
         case Builtin::DISTINCT:
             {
@@ -2595,8 +2675,6 @@ boost::shared_ptr<json_stream_t> eval_call_as_stream(Term::Call *c, runtime_envi
             break;
         case Builtin::SLICE:
             {
-                boost::shared_ptr<json_stream_t> stream = eval_term_as_stream(c->mutable_args(0), env, scopes, backtrace.with("arg:0"));
-
                 int start, stop;
                 bool stop_unbounded = false;
 
@@ -2632,6 +2710,14 @@ boost::shared_ptr<json_stream_t> eval_call_as_stream(Term::Call *c, runtime_envi
                     throw runtime_exc_t("Slice stop cannot be before slice start", backtrace.with("arg:2"));
                 }
 
+                // Only the first `stop` rows of a sort will be looked at.
+                boost::shared_ptr<json_stream_t> stream;
+                if (!stop_unbounded && stop > 0 && is_order_by(c->args(0))) {
+                    stream = eval_order_by_as_stream(c->mutable_args(0)->mutable_call(), stop, env, scopes, backtrace.with("arg:0"));
+                } else {
+                    stream = eval_term_as_stream(c->mutable_args(0), env, scopes, backtrace.with("arg:0"));
+                }
+
                 return boost::shared_ptr<json_stream_t>(new slice_stream_t(stream, start, stop_unbounded, stop));
             }
         case Builtin::UNION:
@@ -2776,19 +2862,10 @@ view_t eval_call_as_view(Term::Call *c, runtime_environment_t *env, const scopes
             }
             break;
         case Builtin::ORDERBY:
-            {
-                ordering_t o(c->builtin().order_by(), backtrace.with("order_by"));
-                view_t view = eval_term_as_view(c->mutable_args(0), env, scopes, backtrace.with("arg:0"));
-
-                boost::shared_ptr<in_memory_stream_t> sorted_stream(new in_memory_stream_t(view.stream));
-                sorted_stream->sort(o);
-                return view_t(view.access, view.primary_key, sorted_stream);
-            }
+            return eval_order_by_as_view(c, 0, env, scopes, backtrace);
             break;
         case Builtin::SLICE:
             {
-                view_t view = eval_term_as_view(c->mutable_args(0), env, scopes, backtrace.with("arg:0"));
-
                 int start, stop;
                 bool stop_unbounded = false;
 
@@ -2824,6 +2901,11 @@ view_t eval_call_as_view(Term::Call *c, runtime_environment_t *env, const scopes
                     throw runtime_exc_t("Slice stop cannot be before slice start", backtrace.with("arg:2"));
                 }
 
+                // Only the first `stop` rows of a sort will be looked at.
+                view_t view = !stop_unbounded && stop > 0 && is_order_by(c->args(0))
+                    ? eval_order_by_as_view(c->mutable_args(0)->mutable_call(), stop, env, scopes, backtrace.with("arg:0"))
+                    : eval_term_as_view(c->mutable_args(0), env, scopes, backtrace.with("arg:0"));
+
                 return view_t(view.access, view.primary_key, boost::shared_ptr<json_stream_t>(new slice_stream_t(view.stream, start, stop_unbounded, stop)));
             }
             break;
@@ -2883,7 +2965,7 @@ view_t eval_term_as_view(Term *t, runtime_environment_t *env, const scopes_t &sc
 view_t eval_table_as_view(Term::Table *t, runtime_environment_t *env, const backtrace_t &backtrace) THROWS_ONLY(interrupted_exc_t, runtime_exc_t, broken_client_exc_t) {
     namespace_repo_t<rdb_protocol_t>::access_t ns_access = eval_table_ref(t->mutable_table_ref(), env, backtrace);
     std::string pk = get_primary_key(t->mutable_table_ref(), env, backtrace);
-    boost::shared_ptr<json_stream_t> stream(new batched_rget_stream_t(ns_access, env->interruptor, key_range_t::universe(), 100, backtrace, t->table_ref().use_outdated()));
+    boost::shared_ptr<json_stream_t> stream(new batched_rget_stream_t(ns_access, env->interruptor, key_range_t::universe(), 100, backtrace, t->table_ref().use_outdated(), env->profile));
     return view_t(ns_access, pk, stream);
 }
 
@@ -105,6 +105,11 @@ boost::shared_ptr<scoped_cJSON_t> eval_mapping(Mapping m, runtime_environment_t
 
 boost::shared_ptr<scoped_cJSON_t> map_rdb(std::string arg, Term *term, runtime_environment_t *env, const scopes_t &scopes, const backtrace_t &backtrace, boost::shared_ptr<scoped_cJSON_t> val);
 
+/* Like `map_rdb()`, but for many values at once. If `term` is a javascript
+term the values are sent to the JS worker in batches instead of one by one. */
+void map_rdb_batch(const std::string &arg, Term *term, runtime_environment_t *env, const scopes_t &scopes, const backtrace_t &backtrace,
+                   const std::vector<boost::shared_ptr<scoped_cJSON_t> > &vals, std::vector<boost::shared_ptr<scoped_cJSON_t> > *out);
+
 boost::shared_ptr<json_stream_t> concatmap(std::string arg, Term *term, runtime_environment_t *env, const scopes_t &scopes, const backtrace_t &backtrace, boost::shared_ptr<scoped_cJSON_t> val);
 
 } //namespace query_language
@@ -1,6 +1,16 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
 #include "rdb_protocol/stream.hpp"
+
+#include "errors.hpp"
+#include <boost/bind.hpp>
+
+#include "arch/runtime/migratable_task.hpp"
+#include "concurrency/wait_any.hpp"
+#include "containers/disk_backed_queue.hpp"
+#include "containers/uuid.hpp"
+#include "memcached/protocol_json_adapter.hpp"
 #include "rdb_protocol/environment.hpp"
+#include "rdb_protocol/profile.hpp"
 #include "rdb_protocol/transform_visitors.hpp"
 
 namespace query_language {
@@ -15,6 +25,12 @@ result_t json_stream_t::apply_terminal(const rdb_protocol_details::terminal_vari
     result_t res;
     boost::apply_visitor(terminal_initializer_visitor_t(&res, env, scopes, backtrace), t);
     boost::shared_ptr<scoped_cJSON_t> json;
+    if (const Builtin_GroupedMapReduce *gmr = boost::get<Builtin_GroupedMapReduce>(&t)) {
+        grouped_map_reduce_t grouped_map_reduce(*gmr, env, scopes, backtrace);
+        rdb_protocol_t::rget_read_response_t::groups_t *groups = boost::get<rdb_protocol_t::rget_read_response_t::groups_t>(&res);
+        while ((json = next())) grouped_map_reduce.add_row(json, groups);
+        return res;
+    }
     while ((json = next())) boost::apply_visitor(terminal_visitor_t(json, env, scopes, backtrace, &res), t);
     return res;
 }
@@ -41,6 +57,231 @@ boost::shared_ptr<scoped_cJSON_t> in_memory_stream_t::next() {
     }
 }
 
+/* A rough estimate of the memory a cJSON tree takes up, used to decide when a
+sort run is full. */
+static size_t estimate_json_size(cJSON *json) {
+    size_t size = sizeof(cJSON);
+    if (json->string) {
+        size += strlen(json->string) + 1;
+    }
+    if (json->valuestring) {
+        size += strlen(json->valuestring) + 1;
+    }
+    for (cJSON *child = json->child; child; child = child->next) {
+        size += estimate_json_size(child);
+    }
+    return size;
+}
+
+sort_stream_t::sort_stream_t(boost::shared_ptr<json_stream_t> _source, const less_t &_less,
+                             size_t _limit, io_backender_t *_io_backender,
+                             const std::string &_spill_dir, size_t _memory_budget)
+    : source(_source), less(_less), limit(_limit), io_backender(_io_backender),
+      spill_dir(_spill_dir), memory_budget(_memory_budget), started(false), rows_read(0), rows_produced(0),
+      buffer_bytes(0), buffer_pos(0) {
+    guarantee(source);
+}
+
+sort_stream_t::~sort_stream_t() {
+    for (size_t i = 0; i < runs.size(); ++i) {
+        delete runs[i];
+    }
+}
+
+boost::shared_ptr<scoped_cJSON_t> sort_stream_t::next() {
+    if (!started) {
+        started = true;
+        read_source();
+        source.reset();
+        for (size_t run = 0; run <= runs.size(); ++run) {
+            push_head(run);
+        }
+    }
+
+    if ((limit != 0 && rows_produced >= limit) || heads.empty()) {
+        return boost::shared_ptr<scoped_cJSON_t>();
+    }
+
+    std::pop_heap(heads.begin(), heads.end(), boost::bind(&sort_stream_t::head_greater, this, _1, _2));
+    head_t head = heads.back();
+    heads.pop_back();
+    push_head(head.run);
+    ++rows_produced;
+    return head.row;
+}
+
+bool sort_stream_t::head_greater(const head_t &x, const head_t &y) const {
+    if (less(y.row, x.row)) {
+        return true;
+    } else if (less(x.row, y.row)) {
+        return false;
+    } else {
+        return x.run > y.run;
+    }
+}
+
+bool sort_stream_t::limited_row_less(const limited_row_t &x, const limited_row_t &y) const {
+    if (less(x.row, y.row)) {
+        return true;
+    } else if (less(y.row, x.row)) {
+        return false;
+    } else {
+        return x.arrival < y.arrival;
+    }
+}
+
+void sort_stream_t::read_source() {
+    while (boost::shared_ptr<scoped_cJSON_t> row = source->next()) {
+        if (++rows_read == 1) {
+            // We want to do this so that we trigger exceptions consistently.
+            less(row, row);
+        }
+        add_row(row);
+        if (io_backender && buffer_bytes > memory_budget) {
+            spill_buffer();
+        }
+    }
+    sort_buffer();
+}
+
+void sort_stream_t::add_row(const boost::shared_ptr<scoped_cJSON_t> &row) {
+    if (limit == 0) {
+        buffer.push_back(row);
+        buffer_bytes += estimate_json_size(row->get());
+    } else if (limited_rows.size() < limit) {
+        limited_rows.push_back(limited_row_t(row, rows_read));
+        std::push_heap(limited_rows.begin(), limited_rows.end(), boost::bind(&sort_stream_t::limited_row_less, this, _1, _2));
+        buffer_bytes += estimate_json_size(row->get());
+    } else if (less(row, limited_rows.front().row)) {
+        // `row` displaces the greatest of the best `limit` rows so far. A row
+        // equal to that one came in after it, so it doesn't.
+        std::pop_heap(limited_rows.begin(), limited_rows.end(), boost::bind(&sort_stream_t::limited_row_less, this, _1, _2));
+        buffer_bytes -= estimate_json_size(limited_rows.back().row->get());
+        limited_rows.back() = limited_row_t(row, rows_read);
+        std::push_heap(limited_rows.begin(), limited_rows.end(), boost::bind(&sort_stream_t::limited_row_less, this, _1, _2));
+        buffer_bytes += estimate_json_size(row->get());
+    }
+}
+
+/* Stable-sorts the slice [begin, end) of a sort run, or if `middle` isn't
+`begin`, merges the sorted slices [begin, middle) and [middle, end). */
+class sort_slice_task_t : public migratable_task_t {
+public:
+    typedef std::vector<boost::shared_ptr<scoped_cJSON_t> >::iterator iterator_t;
+
+    sort_slice_task_t(iterator_t _begin, iterator_t _middle, iterator_t _end, const sort_stream_t::less_t &_less)
+        : begin(_begin), middle(_middle), end(_end), less(_less) { }
+
+    void run() {
+        try {
+            if (middle == begin) {
+                std::stable_sort(begin, end, less);
+            } else {
+                std::inplace_merge(begin, middle, end, less);
+            }
+        } catch (const runtime_exc_t &e) {
+            exc.init(new runtime_exc_t(e));
+        }
+    }
+
+    iterator_t begin, middle, end;
+    sort_stream_t::less_t less;
+    scoped_ptr_t<runtime_exc_t> exc;
+};
+
+/* Runs `tasks` on whichever threads are free and deletes them, then rethrows
+the first exception any of them caught. */
+static void run_sort_tasks(const std::vector<sort_slice_task_t *> &tasks) {
+    run_migratable_tasks(std::vector<migratable_task_t *>(tasks.begin(), tasks.end()));
+    scoped_ptr_t<runtime_exc_t> exc;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        if (!exc.has() && tasks[i]->exc.has()) {
+            exc.init(tasks[i]->exc.release());
+        }
+        delete tasks[i];
+    }
+    if (exc.has()) {
+        throw *exc.get();
+    }
+}
+
+void sort_stream_t::sort_buffer() {
+    if (limit != 0) {
+        std::sort_heap(limited_rows.begin(), limited_rows.end(), boost::bind(&sort_stream_t::limited_row_less, this, _1, _2));
+        rassert(buffer.empty());
+        buffer.reserve(limited_rows.size());
+        for (size_t i = 0; i < limited_rows.size(); ++i) {
+            buffer.push_back(limited_rows[i].row);
+        }
+        limited_rows.clear();
+        return;
+    }
+
+    const size_t slices = std::min<size_t>(get_num_threads(), buffer.size() / MIN_ROWS_PER_SORT_TASK);
+    if (slices > 1) {
+        // Sort a slice per thread, then merge pairs of neighbouring slices until
+        // there's only one left. `bounds` holds where each slice starts, and the end.
+        std::vector<size_t> bounds;
+        for (size_t i = 0; i <= slices; ++i) {
+            bounds.push_back(buffer.size() * i / slices);
+        }
+        std::vector<sort_slice_task_t *> tasks;
+        for (size_t i = 0; i < slices; ++i) {
+            tasks.push_back(new sort_slice_task_t(buffer.begin() + bounds[i], buffer.begin() + bounds[i],
+                                                  buffer.begin() + bounds[i + 1], less));
+        }
+        run_sort_tasks(tasks);
+
+        while (bounds.size() > 2) {
+            std::vector<size_t> merged_bounds;
+            tasks.clear();
+            for (size_t i = 0; i + 1 < bounds.size(); i += 2) {
+                merged_bounds.push_back(bounds[i]);
+                if (i + 2 < bounds.size()) {
+                    tasks.push_back(new sort_slice_task_t(buffer.begin() + bounds[i], buffer.begin() + bounds[i + 1],
+                                                          buffer.begin() + bounds[i + 2], less));
+                }
+            }
+            merged_bounds.push_back(buffer.size());
+            run_sort_tasks(tasks);
+            bounds.swap(merged_bounds);
+        }
+    } else {
+        std::stable_sort(buffer.begin(), buffer.end(), less);
+    }
+}
+
+void sort_stream_t::spill_buffer() {
+    sort_buffer();
+    run_stats.push_back(new perfmon_collection_t);
+    run_stats_memberships.push_back(new perfmon_membership_t(&spill_stats, &run_stats.back(),
+                                                             strprintf("run-%zu", runs.size())));
+    run_t *run = new run_t(io_backender, spill_dir + "/sort-spill-" + uuid_to_str(generate_uuid()), &run_stats.back());
+    runs.push_back(run);
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        run->push(buffer[i]);
+    }
+    buffer.clear();
+    buffer_bytes = 0;
+}
+
+void sort_stream_t::push_head(size_t run) {
+    boost::shared_ptr<scoped_cJSON_t> row;
+    if (run < runs.size()) {
+        if (runs[run]->empty()) {
+            return;
+        }
+        runs[run]->pop(&row);
+    } else {
+        if (buffer_pos == buffer.size()) {
+            return;
+        }
+        row.swap(buffer[buffer_pos++]);
+    }
+    heads.push_back(head_t(row, run));
+    std::push_heap(heads.begin(), heads.end(), boost::bind(&sort_stream_t::head_greater, this, _1, _2));
+}
+
 transform_stream_t::transform_stream_t(boost::shared_ptr<json_stream_t> _stream,
                                        runtime_environment_t *_env,
                                        const rdb_protocol_details::transform_t &tr) :
@@ -49,6 +290,10 @@ transform_stream_t::transform_stream_t(boost::shared_ptr<json_stream_t> _stream,
     transform(tr) { }
 
 boost::shared_ptr<scoped_cJSON_t> transform_stream_t::next() {
+    if (transform_wants_batching(transform)) {
+        return next_batched();
+    }
+
     while (data.empty()) {
         boost::shared_ptr<scoped_cJSON_t> input = stream->next();
         if (!input) {
@@ -83,6 +328,37 @@ boost::shared_ptr<scoped_cJSON_t> transform_stream_t::next() {
     return res;
 }
 
+boost::shared_ptr<scoped_cJSON_t> transform_stream_t::next_batched() {
+    while (data.empty()) {
+        tagged_json_vec_t rows;
+        while (rows.size() < TRANSFORM_BATCH_SIZE) {
+            boost::shared_ptr<scoped_cJSON_t> input = stream->next();
+            if (!input) {
+                break;
+            }
+            rows.push_back(std::make_pair(rows.size(), input));
+        }
+        if (rows.empty()) {
+            return boost::shared_ptr<scoped_cJSON_t>();
+        }
+
+        typedef rdb_protocol_details::transform_t::iterator tit_t;
+        for (tit_t it  = transform.begin();
+                   it != transform.end();
+                   ++it) {
+            boost::apply_visitor(transform_batch_visitor_t(&rows, env, it->scopes, it->backtrace), it->variant);
+        }
+
+        for (tagged_json_vec_t::iterator it = rows.begin(); it != rows.end(); ++it) {
+            data.push_back(it->second);
+        }
+    }
+
+    boost::shared_ptr<scoped_cJSON_t> res = data.front();
+    data.pop_front();
+    return res;
+}
+
 boost::shared_ptr<json_stream_t> transform_stream_t::add_transformation(const rdb_protocol_details::transform_variant_t &t, UNUSED runtime_environment_t *env2, const scopes_t &scopes, const backtrace_t &backtrace) {
     transform.push_back(rdb_protocol_details::transform_atom_t(t, scopes, backtrace));
     return shared_from_this();
@@ -91,23 +367,60 @@ boost::shared_ptr<json_stream_t> transform_stream_t::add_transformation(const rd
 batched_rget_stream_t::batched_rget_stream_t(const namespace_repo_t<rdb_protocol_t>::access_t &_ns_access,
                       signal_t *_interruptor, key_range_t _range,
                       int _batch_size, const backtrace_t &_table_scan_backtrace,
-                      bool _use_outdated)
+                      bool _use_outdated, profile_t *_profile)
     : ns_access(_ns_access), interruptor(_interruptor),
       range(_range), batch_size(_batch_size), index(0),
       finished(false), started(false), use_outdated(_use_outdated),
-      table_scan_backtrace(_table_scan_backtrace)
+      table_scan_backtrace(_table_scan_backtrace), profile(_profile)
 { }
 
+/* Adds what every shard that took part in a profiled read did to a child of
+`span`, and the totals to `span` itself. */
+static void record_shard_stats(const std::vector<rdb_protocol_t::rget_read_stats_t> &shard_stats,
+                               profile_span_t *span) {
+    if (!span->get()) {
+        return;
+    }
+    for (std::vector<rdb_protocol_t::rget_read_stats_t>::const_iterator it = shard_stats.begin();
+         it != shard_stats.end(); ++it) {
+        rdb_protocol_t::region_t region = it->region;
+        profile_t::span_t *shard = span->get()->child("shard " + render_region_as_string(&region));
+        shard->duration += it->duration;
+        shard->add_counter("calls", 1);
+        shard->add_counter("rows_scanned", it->rows_scanned);
+        shard->add_counter("blocks_from_cache", it->blocks_from_cache);
+        shard->add_counter("blocks_from_disk", it->blocks_from_disk);
+        shard->add_counter("bytes", it->bytes);
+
+        span->add_counter("rows_scanned", it->rows_scanned);
+        span->add_counter("blocks_from_cache", it->blocks_from_cache);
+        span->add_counter("blocks_from_disk", it->blocks_from_disk);
+        span->add_counter("bytes", it->bytes);
+    }
+}
+
 boost::shared_ptr<scoped_cJSON_t> batched_rget_stream_t::next() {
     started = true;
-    if (data.empty()) {
-        if (finished) {
+    while (data.empty()) {
+        if (prefetch.has()) {
+            finish_prefetch();
+        } else if (finished) {
             return boost::shared_ptr<scoped_cJSON_t>();
+        } else {
+            profile_span_t span(profile, "read");
+            std::vector<rdb_protocol_t::rget_read_stats_t> shard_stats;
+            read_more(&data, interruptor, profile ? &shard_stats : NULL);
+            record_shard_stats(shard_stats, &span);
+            if (data.empty()) {
+                finished = true;
+                return boost::shared_ptr<scoped_cJSON_t>();
+            }
         }
-        read_more();
-        if (data.empty()) {
-            finished = true;
-            return boost::shared_ptr<scoped_cJSON_t>();
+
+        /* Get the shards started on the next batch while this one is being
+        consumed. */
+        if (!data.empty() && !finished && !prefetch.has()) {
+            start_prefetch();
         }
     }
     boost::shared_ptr<scoped_cJSON_t> ret = data.front();
@@ -116,18 +429,63 @@ boost::shared_ptr<scoped_cJSON_t> batched_rget_stream_t::next() {
     return ret;
 }
 
+void batched_rget_stream_t::start_prefetch() {
+    guarantee(!prefetch.has());
+    prefetch.init(new prefetch_t);
+    prefetch->profiled = profile != NULL;
+    /* `do_prefetch()` sends off the read before it first blocks, so by the
+    time we return the shards already have the request. */
+    coro_t::spawn_now_dangerously(boost::bind(&batched_rget_stream_t::do_prefetch, this, prefetch.get(), auto_drainer_t::lock_t(&drainer)));
+}
+
+void batched_rget_stream_t::do_prefetch(prefetch_t *pf, auto_drainer_t::lock_t keepalive) {
+    try {
+        read_more(&pf->data, keepalive.get_drain_signal(), pf->profiled ? &pf->shard_stats : NULL);
+    } catch (const runtime_exc_t &e) {
+        pf->error = e;
+    } catch (const interrupted_exc_t &) {
+        pf->interrupted = true;
+    }
+    pf->done.pulse();
+}
+
+void batched_rget_stream_t::finish_prefetch() {
+    guarantee(prefetch.has());
+    /* The span only covers how long we had to wait for the prefetch; the
+    shards' own timings say how long the read actually took. */
+    profile_span_t span(profile, "prefetched_read");
+    wait_interruptible(&prefetch->done, interruptor);
+    record_shard_stats(prefetch->shard_stats, &span);
+
+    scoped_ptr_t<prefetch_t> pf;
+    pf.swap(prefetch);
+    if (pf->error) {
+        throw *pf->error;
+    }
+    /* We only get interrupted by `drainer`, which means we're being
+    destroyed and nobody should be calling `next()`. */
+    guarantee(!pf->interrupted);
+
+    data.splice(data.end(), pf->data);
+    if (data.empty()) {
+        finished = true;
+    }
+}
+
 boost::shared_ptr<json_stream_t> batched_rget_stream_t::add_transformation(const rdb_protocol_details::transform_variant_t &t, UNUSED runtime_environment_t *env2, const scopes_t &scopes, const backtrace_t &per_op_backtrace) {
     guarantee(!started);
     transform.push_back(rdb_protocol_details::transform_atom_t(t, scopes, per_op_backtrace));
     return shared_from_this();
 }
 
-result_t batched_rget_stream_t::apply_terminal(const rdb_protocol_details::terminal_variant_t &t, UNUSED runtime_environment_t *env2, const scopes_t &scopes, const backtrace_t &per_op_backtrace) {
+result_t batched_rget_stream_t::apply_terminal(const rdb_protocol_details::terminal_variant_t &t, runtime_environment_t *env2, const scopes_t &scopes, const backtrace_t &per_op_backtrace) {
     rdb_protocol_t::region_t region(range);
     rdb_protocol_t::rget_read_t rget_read(region);
     rget_read.transform = transform;
     rget_read.terminal = rdb_protocol_details::terminal_t(t, scopes, per_op_backtrace);
+    rget_read.profile = env2->profile != NULL;
     rdb_protocol_t::read_t read(rget_read);
+    profile_span_t span(env2->profile, "read_with_terminal");
     try {
         rdb_protocol_t::read_response_t res;
         if (use_outdated) {
@@ -138,6 +496,8 @@ result_t batched_rget_stream_t::apply_terminal(const rdb_protocol_details::termi
         rdb_protocol_t::rget_read_response_t *p_res = boost::get<rdb_protocol_t::rget_read_response_t>(&res.response);
         guarantee(p_res);
 
+        record_shard_stats(p_res->shard_stats, &span);
+
         /* Re throw an exception if we got one. */
         if (runtime_exc_t *e = boost::get<runtime_exc_t>(&p_res->result)) {
             throw *e;
@@ -149,20 +509,26 @@ result_t batched_rget_stream_t::apply_terminal(const rdb_protocol_details::termi
     }
 }
 
-void batched_rget_stream_t::read_more() {
+void batched_rget_stream_t::read_more(json_list_t *out, signal_t *read_interruptor,
+                                      std::vector<rdb_protocol_t::rget_read_stats_t> *shard_stats_out) {
     rdb_protocol_t::rget_read_t rget_read(rdb_protocol_t::region_t(range), transform);
+    rget_read.profile = shard_stats_out != NULL;
     rdb_protocol_t::read_t read(rget_read);
     try {
         guarantee(ns_access.get_namespace_if());
         rdb_protocol_t::read_response_t res;
         if (use_outdated) {
-            ns_access.get_namespace_if()->read_outdated(read, &res, interruptor);
+            ns_access.get_namespace_if()->read_outdated(read, &res, read_interruptor);
         } else {
-            ns_access.get_namespace_if()->read(read, &res, order_token_t::ignore, interruptor);
+            ns_access.get_namespace_if()->read(read, &res, order_token_t::ignore, read_interruptor);
         }
         rdb_protocol_t::rget_read_response_t *p_res = boost::get<rdb_protocol_t::rget_read_response_t>(&res.response);
         guarantee(p_res);
 
+        if (shard_stats_out) {
+            shard_stats_out->swap(p_res->shard_stats);
+        }
+
         /* Re throw an exception if we got one. */
         if (runtime_exc_t *e = boost::get<runtime_exc_t>(&p_res->result)) {
             throw *e;
@@ -175,7 +541,7 @@ void batched_rget_stream_t::read_more() {
 
         for (stream_t::iterator i = stream->begin(); i != stream->end(); ++i) {
             guarantee(i->second);
-            data.push_back(i->second);
+            out->push_back(i->second);
         }
 
         range.left = p_res->last_considered_key;
@@ -13,17 +13,27 @@
 #include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/optional.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/variant/get.hpp>
 
 #include "clustering/administration/namespace_interface_repository.hpp"
+#include "concurrency/auto_drainer.hpp"
+#include "concurrency/cond_var.hpp"
+#include "containers/scoped.hpp"
+#include "perfmon/core.hpp"
 #include "rdb_protocol/exceptions.hpp"
 #include "rdb_protocol/protocol.hpp"
 #include "rdb_protocol/stream_cache.hpp"
 #include "rdb_protocol/proto_utils.hpp"
 
 
+class io_backender_t;
+template <class T> class disk_backed_queue_t;
+
 namespace query_language {
 
+class profile_t;
 class runtime_environment_t;
 
 typedef std::list<boost::shared_ptr<scoped_cJSON_t> > json_list_t;
@@ -40,6 +50,11 @@ public:
 
     virtual void reset_interruptor(UNUSED signal_t *new_interruptor) { }
 
+    /* Like the interruptor, the profile belongs to the query that's currently
+    reading from the stream (which may be a CONTINUE), so it gets reset every
+    time. Streams that wrap other streams pass it on. */
+    virtual void reset_profile(UNUSED profile_t *new_profile) { }
+
 private:
     DISABLE_COPYING(json_stream_t);
 };
@@ -67,6 +82,116 @@ private:
     json_list_t data;
 };
 
+/* Produces the rows of `source` sorted by `less`. Nothing happens until the
+first call to `next()`, which reads all of `source` into sorted runs of at most
+`memory_budget` (estimated) bytes each. Every run but the last one is spilled
+to a temporary disk-backed queue in `spill_dir`, and the runs are merged lazily
+as rows are pulled from the stream, so only the head of each run has to be in
+memory.
+
+If `limit` is nonzero only the first `limit` rows are produced; we then keep
+just the best `limit` rows of each run in a heap instead of sorting everything
+(orderby followed by limit). Without an `io_backender` nothing is spilled and
+the budget is ignored.
+
+The sort is stable either way: rows that `less` considers equal come out in the
+order `source` produced them.
+
+Big runs without a limit get sorted by several threads at once (see
+migratable_task.hpp), so `less` must be safe to call on any thread and must not
+throw anything but `runtime_exc_t`. */
+class sort_stream_t : public json_stream_t {
+public:
+    typedef boost::function<bool(const boost::shared_ptr<scoped_cJSON_t> &, const boost::shared_ptr<scoped_cJSON_t> &)> less_t;  // NOLINT
+
+    static const size_t DEFAULT_MEMORY_BUDGET = 32 * MEGABYTE;
+
+    // Runs are only split up for other threads to sort into slices of at least
+    // this many rows.
+    static const size_t MIN_ROWS_PER_SORT_TASK = 8192;
+
+    sort_stream_t(boost::shared_ptr<json_stream_t> _source, const less_t &_less,
+                  size_t _limit, io_backender_t *_io_backender, const std::string &_spill_dir,
+                  size_t _memory_budget = DEFAULT_MEMORY_BUDGET);
+    ~sort_stream_t();
+
+    boost::shared_ptr<scoped_cJSON_t> next();
+
+    /* Use default implementation of `add_transformation()` and `apply_terminal()` */
+
+    virtual void reset_interruptor(signal_t *new_interruptor) {
+        if (source) {
+            source->reset_interruptor(new_interruptor);
+        }
+    }
+
+    virtual void reset_profile(profile_t *new_profile) {
+        if (source) {
+            source->reset_profile(new_profile);
+        }
+    }
+
+    size_t num_spilled_runs() const { return runs.size(); }
+
+private:
+    typedef disk_backed_queue_t<boost::shared_ptr<scoped_cJSON_t> > run_t;
+
+    // The next row of a run; the in-memory run has index `runs.size()`.
+    struct head_t {
+        head_t(const boost::shared_ptr<scoped_cJSON_t> &_row, size_t _run) : row(_row), run(_run) { }
+        boost::shared_ptr<scoped_cJSON_t> row;
+        size_t run;
+    };
+    // Orders heads so that the `std` heap functions keep the smallest row (and
+    // among equal rows the one from the earliest run) at the front.
+    bool head_greater(const head_t &x, const head_t &y) const;
+
+    // A row kept while reading `source` with a limit, and where it came in.
+    struct limited_row_t {
+        limited_row_t(const boost::shared_ptr<scoped_cJSON_t> &_row, size_t _arrival) : row(_row), arrival(_arrival) { }
+        boost::shared_ptr<scoped_cJSON_t> row;
+        size_t arrival;
+    };
+    // Breaks ties between equal rows by arrival, so that the heap sort of the
+    // best `limit` rows is stable (and the latest of equal rows goes first).
+    bool limited_row_less(const limited_row_t &x, const limited_row_t &y) const;
+
+    void read_source();
+    void add_row(const boost::shared_ptr<scoped_cJSON_t> &row);
+    void sort_buffer();
+    void spill_buffer();
+    void push_head(size_t run);
+
+    boost::shared_ptr<json_stream_t> source;
+    less_t less;
+    size_t limit;
+    io_backender_t *io_backender;
+    std::string spill_dir;
+    size_t memory_budget;
+
+    bool started;
+    size_t rows_read, rows_produced;
+
+    // The rows of the current run. Once sorted it is the in-memory run,
+    // consumed from `buffer_pos` on.
+    std::vector<boost::shared_ptr<scoped_cJSON_t> > buffer;
+    size_t buffer_bytes, buffer_pos;
+
+    // While reading `source` with a limit, the rows of the current run are kept
+    // here instead, as a heap with the greatest row at the front.
+    std::vector<limited_row_t> limited_rows;
+
+    std::vector<run_t *> runs;
+    std::vector<head_t> heads;
+
+    // The spill queues want somewhere to put their stats; nobody looks at
+    // them. Each run gets a collection of its own, since the queues all use
+    // the same stat names.
+    perfmon_collection_t spill_stats;
+    boost::ptr_vector<perfmon_collection_t> run_stats;
+    boost::ptr_vector<perfmon_membership_t> run_stats_memberships;
+};
+
 class transform_stream_t : public json_stream_t {
 public:
     transform_stream_t(boost::shared_ptr<json_stream_t> stream, runtime_environment_t *env, const rdb_protocol_details::transform_t &tr);
@@ -74,7 +199,15 @@ public:
     boost::shared_ptr<scoped_cJSON_t> next();
     boost::shared_ptr<json_stream_t> add_transformation(const rdb_protocol_details::transform_variant_t &, runtime_environment_t *env, const scopes_t &scopes, const backtrace_t &backtrace);
 
+    virtual void reset_profile(profile_t *new_profile) {
+        stream->reset_profile(new_profile);
+    }
+
 private:
+    /* Pulls many rows from `stream` at a time and transforms them together;
+    used when the transformation involves javascript. */
+    boost::shared_ptr<scoped_cJSON_t> next_batched();
+
     boost::shared_ptr<json_stream_t> stream;
     runtime_environment_t *env;
     rdb_protocol_details::transform_t transform;
@@ -86,7 +219,7 @@ public:
     batched_rget_stream_t(const namespace_repo_t<rdb_protocol_t>::access_t &_ns_access, 
                           signal_t *_interruptor, key_range_t _range, 
                           int _batch_size, const backtrace_t &_table_scan_backtrace,
-                          bool _use_outdated);
+                          bool _use_outdated, profile_t *_profile);
 
     boost::shared_ptr<scoped_cJSON_t> next();
 
@@ -97,8 +230,38 @@ public:
         interruptor = new_interruptor;
     };
 
+    virtual void reset_profile(profile_t *new_profile) {
+        profile = new_profile;
+    }
+
 private:
-    void read_more();
+    /* Reads the next batch of rows into `out`, advancing `range`. If
+    `shard_stats_out` isn't NULL, the read is profiled and the shards' stats
+    end up there. */
+    void read_more(json_list_t *out, signal_t *read_interruptor,
+                   std::vector<rdb_protocol_t::rget_read_stats_t> *shard_stats_out);
+
+    /* While the rows of one batch are being consumed we already have the read
+    for the next batch in flight, so that the shards can work on it in the
+    meantime (in particular while the client is busy with the previous chunk
+    of a cursor). The prefetch runs in its own coroutine; it is interrupted by
+    `drainer` when the stream is destroyed, since the interruptor of whatever
+    request started it may be long gone. */
+    struct prefetch_t {
+        prefetch_t() : interrupted(false), profiled(false) { }
+        cond_t done;
+        json_list_t data;
+        boost::optional<runtime_exc_t> error;
+        bool interrupted;
+        // The prefetch may finish after the query that started it is gone,
+        // so rather than recording into a profile it keeps the shards' stats
+        // for whoever picks up the result.
+        bool profiled;
+        std::vector<rdb_protocol_t::rget_read_stats_t> shard_stats;
+    };
+    void start_prefetch();
+    void do_prefetch(prefetch_t *prefetch, auto_drainer_t::lock_t keepalive);
+    void finish_prefetch();
 
     rdb_protocol_details::transform_t transform;
     namespace_repo_t<rdb_protocol_t>::access_t ns_access;
@@ -112,6 +275,13 @@ private:
     bool use_outdated;
 
     backtrace_t table_scan_backtrace;
+
+    profile_t *profile;
+
+    scoped_ptr_t<prefetch_t> prefetch;
+
+    /* Must be destroyed before everything the prefetch coroutine touches. */
+    auto_drainer_t drainer;
 };
 
 class union_stream_t : public json_stream_t {
@@ -126,6 +296,12 @@ public:
 
     /* TODO: Maybe we can optimize `apply_terminal()`. */
 
+    virtual void reset_profile(profile_t *new_profile) {
+        for (stream_list_t::iterator it = streams.begin(); it != streams.end(); ++it) {
+            (*it)->reset_profile(new_profile);
+        }
+    }
+
 private:
     stream_list_t streams;
     stream_list_t::iterator hd;
@@ -148,6 +324,10 @@ public:
         return boost::shared_ptr<scoped_cJSON_t>();
     }
 
+    virtual void reset_profile(profile_t *new_profile) {
+        stream->reset_profile(new_profile);
+    }
+
 private:
     boost::shared_ptr<json_stream_t> stream;
     std::set<boost::shared_ptr<scoped_cJSON_t>, C> seen;
@@ -176,6 +356,10 @@ public:
         return boost::shared_ptr<scoped_cJSON_t>();
     }
 
+    virtual void reset_profile(profile_t *new_profile) {
+        stream->reset_profile(new_profile);
+    }
+
 private:
     boost::shared_ptr<json_stream_t> stream;
     int start;
@@ -195,6 +379,10 @@ public:
         return stream->next();
     }
 
+    virtual void reset_profile(profile_t *new_profile) {
+        stream->reset_profile(new_profile);
+    }
+
 private:
     boost::shared_ptr<json_stream_t> stream;
     int offset;
@@ -229,6 +417,10 @@ public:
         return boost::shared_ptr<scoped_cJSON_t>();
     }
 
+    virtual void reset_profile(profile_t *new_profile) {
+        stream->reset_profile(new_profile);
+    }
+
 private:
     boost::shared_ptr<json_stream_t> stream;
     key_range_t range;
@@ -1,41 +1,84 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <limits>
+
 #include "rdb_protocol/exceptions.hpp"
+#include "rdb_protocol/profile.hpp"
 #include "rdb_protocol/stream.hpp"
 #include "rdb_protocol/stream_cache.hpp"
 
+stream_cache_t::stream_cache_t(size_t _max_streams, size_t _max_bytes)
+    : max_streams(_max_streams), max_bytes(_max_bytes),
+      total_bytes(0), use_counter(0) {
+    guarantee(max_streams > 0);
+}
+
 bool stream_cache_t::contains(int64_t key) {
     return streams.find(key) != streams.end();
 }
 
 void stream_cache_t::insert(ReadQuery *r, int64_t key,
                             boost::shared_ptr<query_language::json_stream_t> val) {
-    maybe_evict();
-    std::pair<std::map<int64_t, entry_t>::iterator, bool> res = streams.insert(std::pair<int64_t, entry_t>(key, entry_t(time(0), val, r)));
+    evicted.erase(key);
+    std::pair<stream_map_t::iterator, bool> res = streams.insert(std::pair<int64_t, entry_t>(key, entry_t(time(0), val, r)));
     guarantee(res.second);
+    res.first->second.last_use = ++use_counter;
+    maybe_evict(key);
 }
 
 void stream_cache_t::erase(int64_t key) {
-    size_t num_erased = streams.erase(key);
-    guarantee(num_erased == 1);
+    stream_map_t::iterator it = streams.find(key);
+    guarantee(it != streams.end());
+    set_bytes(&it->second, 0);
+    streams.erase(it);
+}
+
+/* Adds what went into one chunk of a cursor to a profiled query's span;
+`serialize_ticks` is the time spent turning rows into JSON text. */
+static void record_chunk(query_language::profile_span_t *span, int rows, size_t bytes, ticks_t serialize_ticks) {
+    if (!span->get()) {
+        return;
+    }
+    span->add_counter("rows", rows);
+    span->add_counter("bytes", bytes);
+    span->get()->child("serialize_json")->duration += serialize_ticks;
 }
 
-bool stream_cache_t::serve(int64_t key, Response *res, signal_t *interruptor) {
-    std::map<int64_t, entry_t>::iterator it = streams.find(key);
+bool stream_cache_t::serve(int64_t key, Response *res, signal_t *interruptor, query_language::profile_t *profile) {
+    maybe_evict(key);
+    stream_map_t::iterator it = streams.find(key);
     if (it == streams.end()) return false;
     entry_t *entry = &it->second;
     entry->last_activity = time(0);
+    entry->last_use = ++use_counter;
     try {
         int chunk_size = 0;
+        size_t chunk_bytes = 0;
         // This is a hack.  Some streams have an interruptor that is invalid by
         // the time we reach here, so we just reset it to a good one.
         entry->stream->reset_interruptor(interruptor);
+        entry->stream->reset_profile(profile);
+        query_language::profile_span_t span(profile, "serve");
+        ticks_t serialize_ticks = 0;
         while (boost::shared_ptr<scoped_cJSON_t> json = entry->stream->next()) {
+            ticks_t serialize_start = profile ? get_ticks() : 0;
             res->add_response(json->PrintUnformatted());
-            if (entry->max_chunk_size && ++chunk_size >= entry->max_chunk_size) {
+            if (profile) {
+                serialize_ticks += get_ticks() - serialize_start;
+            }
+            chunk_bytes += res->response(res->response_size() - 1).size();
+            ++chunk_size;
+            bool chunk_full = entry->max_chunk_size
+                ? chunk_size >= entry->max_chunk_size
+                : chunk_bytes >= entry->max_chunk_bytes;
+            if (chunk_full) {
+                record_chunk(&span, chunk_size, chunk_bytes, serialize_ticks);
+                set_bytes(entry, chunk_bytes);
+                maybe_evict(key);
                 res->set_status_code(Response::SUCCESS_PARTIAL);
                 return true;
             }
         }
+        record_chunk(&span, chunk_size, chunk_bytes, serialize_ticks);
     } catch (const std::exception &e) {
         erase(key);
         throw;
@@ -45,18 +88,63 @@ bool stream_cache_t::serve(int64_t key, Response *res, signal_t *interruptor) {
     return true;
 }
 
-void stream_cache_t::maybe_evict() {
+bool stream_cache_t::was_evicted(int64_t key, std::string *reason_out) {
+    std::map<int64_t, std::string>::iterator it = evicted.find(key);
+    if (it == evicted.end()) return false;
+    *reason_out = it->second;
+    return true;
+}
+
+void stream_cache_t::maybe_evict(int64_t keep) {
     time_t cur_time = time(0);
-    std::map<int64_t, entry_t>::iterator it_old, it = streams.begin();
+    stream_map_t::iterator it_old, it = streams.begin();
     while (it != streams.end()) {
         it_old = it++;
         entry_t *entry = &it_old->second;
-        if (entry->max_age && cur_time - entry->last_activity > entry->max_age) {
-            streams.erase(it_old);
+        if (it_old->first != keep && entry->max_age && cur_time - entry->last_activity > entry->max_age) {
+            evict(it_old, strprintf("it was idle for more than %ld seconds", static_cast<long>(entry->max_age)));  // NOLINT(runtime/int)
+        }
+    }
+
+    // Close least recently used cursors until we're back within our limits.
+    while (streams.size() > max_streams || total_bytes > max_bytes) {
+        stream_map_t::iterator lru = streams.end();
+        for (it = streams.begin(); it != streams.end(); ++it) {
+            if (it->first != keep && (lru == streams.end() || it->second.last_use < lru->second.last_use)) {
+                lru = it;
+            }
         }
+        if (lru == streams.end()) {
+            // Only `keep` is left; we always let the active cursor through.
+            break;
+        }
+        evict(lru, streams.size() > max_streams
+              ? strprintf("too many cursors were open on this connection (the limit is %zu)", max_streams)
+              : strprintf("open cursors on this connection used too much memory (the limit is %zu bytes)", max_bytes));
     }
 }
 
+void stream_cache_t::evict(stream_map_t::iterator it, const std::string &reason) {
+    int64_t key = it->first;
+    set_bytes(&it->second, 0);
+    streams.erase(it);
+
+    if (evicted.insert(std::make_pair(key, reason)).second) {
+        eviction_order.push_back(key);
+    }
+    while (eviction_order.size() > MAX_REMEMBERED_EVICTIONS) {
+        evicted.erase(eviction_order.front());
+        eviction_order.pop_front();
+    }
+}
+
+void stream_cache_t::set_bytes(entry_t *entry, size_t bytes) {
+    guarantee(total_bytes >= entry->bytes);
+    total_bytes -= entry->bytes;
+    entry->bytes = bytes;
+    total_bytes += bytes;
+}
+
 /*******************************************************************************
                                     ENTRY_T
 *******************************************************************************/
@@ -67,13 +155,16 @@ bool valid_age(int64_t age) { return 0 <= age; }
 stream_cache_t::entry_t::entry_t(time_t _last_activity,
                                  boost::shared_ptr<query_language::json_stream_t> _stream,
                                  ReadQuery *r)
-    : last_activity(_last_activity), stream(_stream),
-      max_chunk_size(DEFAULT_MAX_CHUNK_SIZE), max_age(DEFAULT_MAX_AGE) {
+    : last_activity(_last_activity), last_use(0), stream(_stream),
+      max_chunk_size(DEFAULT_MAX_CHUNK_SIZE), max_chunk_bytes(DEFAULT_MAX_CHUNK_BYTES),
+      max_age(DEFAULT_MAX_AGE), bytes(0) {
     if (r) {
         if (r->has_max_chunk_size() && valid_chunk_size(r->max_chunk_size())) {
             max_chunk_size = r->max_chunk_size();
+            // An explicit 0 asks for the whole stream in one response.
+            max_chunk_bytes = max_chunk_size ? 0 : std::numeric_limits<size_t>::max();
         }
-        if (r->has_max_age() && valid_age(max_age)) {
+        if (r->has_max_age() && valid_age(r->max_age())) {
             max_age = r->max_age();
         }
     }
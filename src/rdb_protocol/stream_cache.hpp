@@ -4,7 +4,9 @@
 
 #include <time.h>
 
+#include <deque>
 #include <map>
+#include <string>
 
 #include "utils.hpp"
 #include <boost/shared_ptr.hpp>
@@ -14,30 +16,72 @@
 
 namespace query_language {
 class json_stream_t;
+class profile_t;
 }
 
+/* Holds the open cursors of one client connection. The cache is bounded both
+in the number of cursors and in the (estimated) memory they pin; when it
+grows past either limit the least recently used cursors are closed. Cursors
+that have been idle for longer than their max age are closed as well. A client
+that tries to continue a cursor we closed gets an error saying why. */
 class stream_cache_t {
 public:
+    static const size_t DEFAULT_MAX_STREAMS = 64;
+    static const size_t DEFAULT_MAX_BYTES = 64 * MEGABYTE;
+
+    stream_cache_t(size_t _max_streams = DEFAULT_MAX_STREAMS,
+                   size_t _max_bytes = DEFAULT_MAX_BYTES);
+
     // TODO: Uses of contains can all just try insert or erase and look at return codes.
     bool contains(int64_t key);
     void insert(ReadQuery *r, int64_t key, boost::shared_ptr<query_language::json_stream_t> val);
     void erase(int64_t key);
-    bool serve(int64_t key, Response *res, signal_t *interruptor);
-private:
-    void maybe_evict();
+    /* Sends the next chunk of the cursor; `profile` is that of the query
+    asking for it, or NULL. */
+    bool serve(int64_t key, Response *res, signal_t *interruptor, query_language::profile_t *profile);
+
+    /* Returns true if `key` is not in the cache because we evicted it, and
+    sets `*reason_out` to a human-readable explanation. */
+    bool was_evicted(int64_t key, std::string *reason_out);
+
+    size_t num_streams() const { return streams.size(); }
+    size_t estimated_bytes() const { return total_bytes; }
 
+private:
     struct entry_t {
-        static const int DEFAULT_MAX_CHUNK_SIZE = 1000; // 0 = unbounded
-        static const time_t DEFAULT_MAX_AGE = 0; // 0 = never evict
+        static const int DEFAULT_MAX_CHUNK_SIZE = 0; // 0 = no row limit; chunks are capped by bytes
+        static const size_t DEFAULT_MAX_CHUNK_BYTES = MEGABYTE;
+        static const time_t DEFAULT_MAX_AGE = 600; // 0 = never evict
         entry_t(time_t _last_activity,
                 boost::shared_ptr<query_language::json_stream_t> _stream,
                 ReadQuery *r);
         time_t last_activity;
+        uint64_t last_use; // for LRU ordering, since `time()` is coarse
         boost::shared_ptr<query_language::json_stream_t> stream;
         int max_chunk_size; //Size of 0 = unlimited
+        size_t max_chunk_bytes; //Only used if `max_chunk_size` is 0
         time_t max_age;
+        // Our estimate of the memory held by the cursor, namely the size of
+        // the last chunk it produced. The streams buffer roughly a chunk's
+        // worth of rows internally.
+        size_t bytes;
     };
-    std::map<int64_t, entry_t> streams;
+    typedef std::map<int64_t, entry_t> stream_map_t;
+
+    void maybe_evict(int64_t keep);
+    void evict(stream_map_t::iterator it, const std::string &reason);
+    void set_bytes(entry_t *entry, size_t bytes);
+
+    stream_map_t streams;
+    size_t max_streams, max_bytes;
+    size_t total_bytes;
+    uint64_t use_counter;
+
+    // Tokens of recently evicted cursors, so that we can give the client a
+    // useful error. Bounded; the oldest are forgotten first.
+    static const size_t MAX_REMEMBERED_EVICTIONS = 1024;
+    std::map<int64_t, std::string> evicted;
+    std::deque<int64_t> eviction_order;
 };
 
 #endif  // RDB_PROTOCOL_STREAM_CACHE_HPP_
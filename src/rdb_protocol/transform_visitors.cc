@@ -1,5 +1,8 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
 #include "rdb_protocol/transform_visitors.hpp"
+
+#include "config/args.hpp"
+#include "rdb_protocol/json_groups.hpp"
 #include "rdb_protocol/query_language.hpp"
 
 
@@ -62,6 +65,91 @@ void transform_visitor_t::operator()(Builtin_Range range) const {
     }
 }
 
+class wants_batching_visitor_t : public boost::static_visitor<bool> {
+public:
+    bool operator()(const Builtin_Filter &filter) const {
+        return filter.predicate().body().type() == Term::JAVASCRIPT;
+    }
+    bool operator()(const Mapping &mapping) const {
+        return mapping.body().type() == Term::JAVASCRIPT;
+    }
+    bool operator()(const Builtin_ConcatMap &) const { return false; }
+    bool operator()(const Builtin_Range &) const { return false; }
+};
+
+bool transform_wants_batching(const rdb_protocol_details::transform_t &transform) {
+    for (rdb_protocol_details::transform_t::const_iterator it  = transform.begin();
+                                                           it != transform.end();
+                                                           ++it) {
+        if (boost::apply_visitor(wants_batching_visitor_t(), it->variant)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+transform_batch_visitor_t::transform_batch_visitor_t(tagged_json_vec_t *_rows, query_language::runtime_environment_t *_env, const scopes_t &_scopes, const backtrace_t &_backtrace)
+    : rows(_rows), env(_env), scopes(_scopes), backtrace(_backtrace)
+{ }
+
+void transform_batch_visitor_t::operator()(const Builtin_Filter &filter) const {
+    std::vector<boost::shared_ptr<scoped_cJSON_t> > vals, bools;
+    vals.reserve(rows->size());
+    for (tagged_json_vec_t::iterator it = rows->begin(); it != rows->end(); ++it) {
+        vals.push_back(it->second);
+    }
+
+    Term body = filter.predicate().body();
+    query_language::map_rdb_batch(filter.predicate().arg(), &body, env, scopes, backtrace, vals, &bools);
+    guarantee(bools.size() == rows->size());
+
+    tagged_json_vec_t tmp;
+    for (size_t i = 0; i < bools.size(); ++i) {
+        if (bools[i]->type() == cJSON_True) {
+            tmp.push_back((*rows)[i]);
+        } else if (bools[i]->type() != cJSON_False) {
+            throw runtime_exc_t("Predicate failed to evaluate to a bool", backtrace);
+        }
+    }
+    rows->swap(tmp);
+}
+
+void transform_batch_visitor_t::operator()(const Mapping &mapping) const {
+    std::vector<boost::shared_ptr<scoped_cJSON_t> > vals, mapped;
+    vals.reserve(rows->size());
+    for (tagged_json_vec_t::iterator it = rows->begin(); it != rows->end(); ++it) {
+        vals.push_back(it->second);
+    }
+
+    Term body = mapping.body();
+    query_language::map_rdb_batch(mapping.arg(), &body, env, scopes, backtrace, vals, &mapped);
+    guarantee(mapped.size() == rows->size());
+
+    for (size_t i = 0; i < mapped.size(); ++i) {
+        (*rows)[i].second = mapped[i];
+    }
+}
+
+void transform_batch_visitor_t::operator()(const Builtin_ConcatMap &concatmap) const {
+    apply_row_by_row(concatmap);
+}
+
+void transform_batch_visitor_t::operator()(const Builtin_Range &range) const {
+    apply_row_by_row(range);
+}
+
+void transform_batch_visitor_t::apply_row_by_row(const rdb_protocol_details::transform_variant_t &t) const {
+    tagged_json_vec_t tmp;
+    for (tagged_json_vec_t::iterator it = rows->begin(); it != rows->end(); ++it) {
+        json_list_t out;
+        boost::apply_visitor(transform_visitor_t(it->second, &out, env, scopes, backtrace), t);
+        for (json_list_t::iterator jt = out.begin(); jt != out.end(); ++jt) {
+            tmp.push_back(std::make_pair(it->first, *jt));
+        }
+    }
+    rows->swap(tmp);
+}
+
 terminal_initializer_visitor_t::terminal_initializer_visitor_t(rget_read_response_t::result_t *_out,
                                                                query_language::runtime_environment_t *_env,
                                                                const scopes_t &_scopes,
@@ -88,6 +176,59 @@ void terminal_initializer_visitor_t::operator()(const WriteQuery_ForEach &) cons
     *out = i;
 }
 
+grouped_map_reduce_t::grouped_map_reduce_t(const Builtin_GroupedMapReduce &_gmr,
+                                           query_language::runtime_environment_t *_env,
+                                           const scopes_t &_scopes,
+                                           const backtrace_t &_backtrace)
+    : gmr(_gmr), env(_env), scopes(_scopes), backtrace(_backtrace), groups_memory(0)
+{ }
+
+void grouped_map_reduce_t::add_row(const boost::shared_ptr<scoped_cJSON_t> &json, rget_read_response_t::groups_t *groups) {
+    boost::shared_ptr<scoped_cJSON_t> grouping =
+        query_language::map_rdb(gmr.group_mapping().arg(), gmr.mutable_group_mapping()->mutable_body(),
+                                env, scopes, backtrace.with("group_mapping"), json);
+    boost::shared_ptr<scoped_cJSON_t> mapped_value =
+        query_language::map_rdb(gmr.value_mapping().arg(), gmr.mutable_value_mapping()->mutable_body(),
+                                env, scopes, backtrace.with("value_mapping"), json);
+    reduce(grouping, mapped_value, groups);
+}
+
+void grouped_map_reduce_t::merge(const rget_read_response_t::groups_t &other, rget_read_response_t::groups_t *groups) {
+    for (rget_read_response_t::groups_t::const_iterator it = other.begin(); it != other.end(); ++it) {
+        reduce(it->first, it->second, groups);
+    }
+}
+
+void grouped_map_reduce_t::reduce(const boost::shared_ptr<scoped_cJSON_t> &key, const boost::shared_ptr<scoped_cJSON_t> &value,
+                                  rget_read_response_t::groups_t *groups) {
+    Reduction *reduction = gmr.mutable_reduction();
+
+    boost::shared_ptr<scoped_cJSON_t> *acc = groups->find(key, backtrace.with("group_mapping"));
+    size_t old_acc_memory;
+    if (!acc) {
+        acc = groups->insert(key, eval_term_as_json(reduction->mutable_base(), env, scopes, backtrace.with("reduction").with("base")));
+        groups_memory += sizeof(rget_read_response_t::groups_t::group_t) + json_memory_size(key->get());
+        // The base is replaced right below, so it isn't counted.
+        old_acc_memory = 0;
+    } else {
+        old_acc_memory = json_memory_size((*acc)->get());
+    }
+
+    scopes_t scopes_copy = scopes;
+    new_val_scope_t inner_scope(&scopes_copy.scope);
+    scopes_copy.scope.put_in_scope(reduction->var1(), *acc);
+    scopes_copy.scope.put_in_scope(reduction->var2(), value);
+    *acc = eval_term_as_json(reduction->mutable_body(), env, scopes_copy, backtrace.with("reduction").with("body"));
+
+    groups_memory = groups_memory - old_acc_memory + json_memory_size((*acc)->get());
+    if (groups_memory > MAX_GROUPED_MAP_REDUCE_MEMORY) {
+        throw runtime_exc_t(strprintf("Grouped map-reduce has %zu groups, which take up more than %lld MB. "
+                                      "Group by something with fewer distinct values.",
+                                      groups->size(), MAX_GROUPED_MAP_REDUCE_MEMORY / MEGABYTE),
+                            backtrace.with("group_mapping"));
+    }
+}
+
 terminal_visitor_t::terminal_visitor_t(boost::shared_ptr<scoped_cJSON_t> _json,
                    query_language::runtime_environment_t *_env,
                    const scopes_t &_scopes,
@@ -101,31 +242,8 @@ void terminal_visitor_t::operator()(const Builtin_GroupedMapReduce &gmr) const {
     rget_read_response_t::groups_t *res_groups = boost::get<rget_read_response_t::groups_t>(out);
     guarantee(res_groups);
 
-    //Grab the grouping
-    boost::shared_ptr<scoped_cJSON_t> grouping;
-    {
-        Term body = gmr.group_mapping().body();
-        grouping = query_language::map_rdb(gmr.group_mapping().arg(), &body, env, scopes, backtrace.with("group_mapping"), json);
-    }
-
-    //Apply the mapping
-    boost::shared_ptr<scoped_cJSON_t> mapped_value;
-    {
-        Term body = gmr.value_mapping().body();
-        mapped_value = query_language::map_rdb(gmr.value_mapping().arg(), &body, env, scopes, backtrace.with("value_mapping"), json);
-    }
-
-    //Finally reduce it in
-    {
-        Term base = gmr.reduction().base(),
-             body = gmr.reduction().body();
-
-        scopes_t scopes_copy = scopes;
-        new_val_scope_t inner_scope(&scopes_copy.scope);
-        scopes_copy.scope.put_in_scope(gmr.reduction().var1(), res_groups->insert(std::make_pair(grouping, eval_term_as_json(&base, env, scopes, backtrace.with("reduction").with("base")))).first->second);
-        scopes_copy.scope.put_in_scope(gmr.reduction().var2(), mapped_value);
-        (*res_groups)[grouping] = eval_term_as_json(&body, env, scopes_copy, backtrace.with("reduction").with("body"));
-    }
+    // Callers that see many rows should use a `grouped_map_reduce_t` directly.
+    grouped_map_reduce_t(gmr, env, scopes, backtrace).add_row(json, res_groups);
 }
 
 void terminal_visitor_t::operator()(const Reduction &r) const {
@@ -3,6 +3,8 @@
 #define RDB_PROTOCOL_TRANSFORM_VISITORS_HPP_
 
 #include <list>
+#include <utility>
+#include <vector>
 
 #include "errors.hpp"
 #include <boost/shared_ptr.hpp>
@@ -41,6 +43,44 @@ private:
     backtrace_t backtrace;
 };
 
+/* A row flowing through a batched transformation, tagged with the index of
+the input row it was derived from (so that callers can recover e.g. its key). */
+typedef std::pair<size_t, boost::shared_ptr<scoped_cJSON_t> > tagged_json_t;
+typedef std::vector<tagged_json_t> tagged_json_vec_t;
+
+/* The number of rows we try to accumulate before applying a transformation
+that benefits from batching. */
+const size_t TRANSFORM_BATCH_SIZE = 256;
+
+/* Returns true if `transform` contains a filter or mapping whose body is a
+javascript term, in which case it is much cheaper to apply it to many rows at
+once with `transform_batch_visitor_t`. */
+bool transform_wants_batching(const rdb_protocol_details::transform_t &transform);
+
+/* A visitor for applying a transformation to a batch of rows. Filters and
+mappings are evaluated with `map_rdb_batch()`; everything else falls back to
+`transform_visitor_t` row by row. */
+class transform_batch_visitor_t : public boost::static_visitor<void> {
+public:
+    transform_batch_visitor_t(tagged_json_vec_t *_rows, query_language::runtime_environment_t *_env, const scopes_t &_scopes, const backtrace_t &_backtrace);
+
+    void operator()(const Builtin_Filter &filter) const;
+
+    void operator()(const Mapping &mapping) const;
+
+    void operator()(const Builtin_ConcatMap &concatmap) const;
+
+    void operator()(const Builtin_Range &range) const;
+
+private:
+    void apply_row_by_row(const rdb_protocol_details::transform_variant_t &t) const;
+
+    tagged_json_vec_t *rows;
+    query_language::runtime_environment_t *env;
+    scopes_t scopes;
+    backtrace_t backtrace;
+};
+
 /* A visitor for setting the result type based on a terminal. */
 class terminal_initializer_visitor_t : public boost::static_visitor<void> {
 public:
@@ -63,6 +103,45 @@ private:
     backtrace_t backtrace;
 };
 
+/* Runs a grouped map-reduce over many rows (or merges the groups of several
+shards). The group mapping, value mapping and reduction terms are copied once
+here rather than for every row, so javascript in them is compiled only once,
+and the reduction base is only evaluated when a new group shows up.
+
+It also keeps track of how much memory the keys and reductions of the groups
+it has built take up, and throws `runtime_exc_t` when that goes over
+`MAX_GROUPED_MAP_REDUCE_MEMORY`, so a grouping with too many groups fails the
+query instead of running the machine out of memory. For this to work, the
+groups passed to `add_row()` and `merge()` must start out empty and only be
+changed through the same `grouped_map_reduce_t`. */
+class grouped_map_reduce_t {
+public:
+    grouped_map_reduce_t(const Builtin_GroupedMapReduce &_gmr,
+                         query_language::runtime_environment_t *_env,
+                         const scopes_t &_scopes,
+                         const backtrace_t &_backtrace);
+
+    /* Maps `json` and reduces it into its group. */
+    void add_row(const boost::shared_ptr<scoped_cJSON_t> &json, rget_read_response_t::groups_t *groups);
+
+    /* Reduces every group of `other` into `groups`. */
+    void merge(const rget_read_response_t::groups_t &other, rget_read_response_t::groups_t *groups);
+
+private:
+    void reduce(const boost::shared_ptr<scoped_cJSON_t> &key, const boost::shared_ptr<scoped_cJSON_t> &value,
+                rget_read_response_t::groups_t *groups);
+
+    Builtin_GroupedMapReduce gmr;
+    query_language::runtime_environment_t *env;
+    scopes_t scopes;
+    backtrace_t backtrace;
+
+    // Our estimate of how much memory the groups take up.
+    size_t groups_memory;
+
+    DISABLE_COPYING(grouped_map_reduce_t);
+};
+
 /* A visitor for applying a terminal to a bit of json. */
 class terminal_visitor_t : public boost::static_visitor<void> {
 public:
@@ -11,6 +11,7 @@
 #include "concurrency/pmap.hpp"
 #include "concurrency/semaphore.hpp"
 #include "containers/archive/vector_stream.hpp"
+#include "containers/lz_compress.hpp"
 #include "containers/object_buffer.hpp"
 #include "containers/uuid.hpp"
 #include "logger.hpp"
@@ -19,6 +20,26 @@
 #define CLUSTER_PROTO_HEADER "RethinkDB " RETHINKDB_VERSION " cluster\n"
 const char *const cluster_proto_header = CLUSTER_PROTO_HEADER;
 
+/* Optional features of the cluster protocol. Each side sends the ones it
+supports right after its address, and a connection uses the ones that both
+sides support. */
+enum cluster_capability_t {
+    CLUSTER_CAPABILITY_COMPRESSION = 1 << 0
+};
+static const uint32_t our_cluster_capabilities = CLUSTER_CAPABILITY_COMPRESSION;
+
+/* Messages smaller than this are never worth compressing. */
+#define CLUSTER_COMPRESSION_THRESHOLD 512
+
+/* On a connection with `compress_messages` set, each message starts with one
+of these. A raw message is then a `std::string`; a compressed message is the
+uncompressed size as a `uint64_t` followed by a `std::string` of compressed
+data. */
+enum cluster_message_format_t {
+    CLUSTER_MESSAGE_RAW = 0,
+    CLUSTER_MESSAGE_COMPRESSED = 1
+};
+
 void debug_print(append_only_printf_buffer_t *buf, const peer_address_t &address) {
     buf->appendf("peer_address{ips=[");
     const std::set<ip_address_t> *ips = address.all_ips();
@@ -61,7 +82,7 @@ connectivity_cluster_t::run_t::run_t(connectivity_cluster_t *p,
     `connection_map` on each thread and notifying any listeners that we're now
     connected to ourself. The destructor will remove us from the
     `connection_map` and again notify any listeners. */
-    connection_to_ourself(this, parent->me, NULL, routing_table[parent->me]),
+    connection_to_ourself(this, parent->me, NULL, routing_table[parent->me], false),
 
     listener(new tcp_listener_t(cluster_listener_socket.get(),
                                 boost::bind(&connectivity_cluster_t::run_t::on_new_connection,
@@ -87,15 +108,28 @@ void connectivity_cluster_t::run_t::join(peer_address_t address) THROWS_NOTHING
         auto_drainer_t::lock_t(&drainer)));
 }
 
-connectivity_cluster_t::run_t::connection_entry_t::connection_entry_t(run_t *p, peer_id_t id, tcp_conn_stream_t *c, peer_address_t a) THROWS_NOTHING :
+connectivity_cluster_t::run_t::connection_entry_t::connection_entry_t(run_t *p, peer_id_t id, tcp_conn_stream_t *c, peer_address_t a, bool compress) THROWS_NOTHING :
     conn(c), address(a), session_id(generate_uuid()),
+    compress_messages(compress),
     pm_collection(),
     pm_bytes_sent(secs_to_ticks(1), true),
+    pm_compression_negotiated(),
+    pm_compression_ratio(secs_to_ticks(1), false),
+    pm_compress(secs_to_ticks(1)),
+    pm_decompress(secs_to_ticks(1)),
     pm_collection_membership(&p->parent->connectivity_collection, &pm_collection, uuid_to_str(id.get_uuid())),
     pm_bytes_sent_membership(&pm_collection, &pm_bytes_sent, "bytes_sent"),
+    pm_compression_membership(&pm_collection,
+                              &pm_compression_negotiated, "compression_negotiated",
+                              &pm_compression_ratio, "compression_ratio",
+                              &pm_compress, "compress",
+                              &pm_decompress, "decompress",
+                              NULL),
     parent(p), peer(id),
     entries(new one_per_thread_t<entry_installation_t>(this)) {
-
+    if (compress_messages) {
+        ++pm_compression_negotiated;
+    }
 }
 
 connectivity_cluster_t::run_t::connection_entry_t::~connection_entry_t() THROWS_NOTHING {
@@ -262,6 +296,51 @@ static bool deserialize_and_check(tcp_conn_stream_t *c, T *p, const char *peer)
     }
 }
 
+// Reads one message off the connection, decompressing it if necessary.
+// Returns true if handle() should return.
+static bool receive_message(tcp_conn_stream_t *c, bool compress_messages, perfmon_duration_sampler_t *pm_decompress,
+                            const char *peer, std::vector<char> *message_out) {
+    int8_t format = CLUSTER_MESSAGE_RAW;
+    if (compress_messages && deserialize_and_check(c, &format, peer))
+        return true;
+    uint64_t size = 0;
+    if (format == CLUSTER_MESSAGE_COMPRESSED && deserialize_and_check(c, &size, peer))
+        return true;
+
+    /* For now, we use `std::string` for messages on the wire: it's just a
+    length and a byte vector. This is obviously slow and we should change it
+    when we care about performance. */
+    std::string message;
+    if (deserialize_and_check(c, &message, peer))
+        return true;
+
+    switch (format) {
+      case CLUSTER_MESSAGE_RAW:
+        message_out->assign(message.begin(), message.end());
+        return false;
+
+      case CLUSTER_MESSAGE_COMPRESSED: {
+        // Each compressed byte expands to at most 255 bytes, so anything
+        // claiming more than that is corrupt; don't allocate for it.
+        if (size == 0 || size / 255 > message.size()) {
+            logERR("received compressed message with impossible size from %s, closing connection", peer);
+            return true;
+        }
+        message_out->resize(size);
+        block_pm_duration timer(pm_decompress);
+        if (!lz_decompress(message.data(), message.size(), &(*message_out)[0], size)) {
+            logERR("could not decompress message received from %s, closing connection", peer);
+            return true;
+        }
+        return false;
+      }
+
+      default:
+        logERR("received message in unknown format from %s, closing connection", peer);
+        return true;
+    }
+}
+
 // We log error conditions as follows:
 // - silent: network error; conflict between parallel connections
 // - warning: invalid header
@@ -300,6 +379,7 @@ void connectivity_cluster_t::run_t::handle(
         msg.append(cluster_proto_header, header_size);
         msg << parent->me;
         msg << routing_table[parent->me];
+        msg << our_cluster_capabilities;
         if (send_write_message(conn, &msg))
             return;             // network error.
     }
@@ -322,12 +402,15 @@ void connectivity_cluster_t::run_t::handle(
         }
     }
 
-    // Receive id, address.
+    // Receive id, address, capabilities.
     peer_id_t other_id;
     peer_address_t other_address;
+    uint32_t other_capabilities;
     if (deserialize_and_check(conn, &other_id, peername) ||
-        deserialize_and_check(conn, &other_address, peername))
+        deserialize_and_check(conn, &other_address, peername) ||
+        deserialize_and_check(conn, &other_capabilities, peername))
         return;
+    uint32_t shared_capabilities = our_cluster_capabilities & other_capabilities;
 
     /* Sanity checks */
     if (other_id == parent->me) {
@@ -523,21 +606,18 @@ void connectivity_cluster_t::run_t::handle(
         /* `connection_entry_t` is the public interface of this coroutine. Its
         constructor registers it in the `connectivity_cluster_t`'s connection
         map and notifies any connect listeners. */
-        connection_entry_t conn_structure(this, other_id, conn, other_address);
+        connection_entry_t conn_structure(this, other_id, conn, other_address,
+                                          (shared_capabilities & CLUSTER_CAPABILITY_COMPRESSION) != 0);
 
         /* Main message-handling loop: read messages off the connection until
         it's closed, which may be due to network events, or the other end
         shutting down, or us shutting down. */
         try {
             while (true) {
-                /* For now, we use `std::string` for messages on the wire: it's
-                just a length and a byte vector. This is obviously slow and we
-                should change it when we care about performance. */
-                std::string message;
-                if (deserialize_and_check(conn, &message, peername))
+                std::vector<char> vec;
+                if (receive_message(conn, conn_structure.compress_messages, &conn_structure.pm_decompress, peername, &vec))
                     break;
 
-                std::vector<char> vec(message.begin(), message.end());
                 vector_read_stream_t stream(&vec);
                 message_handler->on_message(other_id, &stream); // might raise fake_archive_exc_t
             }
@@ -662,10 +742,27 @@ void connectivity_cluster_t::send_message(peer_id_t dest, send_message_write_cal
         // We could be on any thread here! Oh no!
         vector_read_stream_t buffer2(&buffer.vector());
         current_run->message_handler->on_message(me, &buffer2);
+        // Nothing is framed or compressed on the way to ourself; the handler
+        // gets exactly the serialized message.
         conn_structure->pm_bytes_sent.record(buffer.vector().size());
 
     } else {
         guarantee(dest != me);
+
+        /* Compress on the sender's thread rather than the connection's, so
+        the work is spread out. Only keep the result if it's smaller. */
+        std::string compressed;
+        if (conn_structure->compress_messages && buffer.vector().size() >= CLUSTER_COMPRESSION_THRESHOLD) {
+            block_pm_duration timer(&conn_structure->pm_compress);
+            compressed.resize(buffer.vector().size() - 1);
+            size_t compressed_size = lz_compress(buffer.vector().data(), buffer.vector().size(),
+                                                 &compressed[0], compressed.size());
+            compressed.resize(compressed_size);
+            timer.end();
+            conn_structure->pm_compression_ratio.record(static_cast<double>(compressed_size == 0 ? buffer.vector().size() : compressed_size)
+                                                        / buffer.vector().size());
+        }
+
         on_thread_t threader(conn_structure->conn->home_thread());
 
         /* Acquire the send-mutex so we don't collide with other things trying
@@ -674,11 +771,23 @@ void connectivity_cluster_t::send_message(peer_id_t dest, send_message_write_cal
 
         {
             write_message_t msg;
-            std::string buffer_str(buffer.vector().begin(), buffer.vector().end());
-            msg << buffer_str;
+            if (!compressed.empty()) {
+                msg << static_cast<int8_t>(CLUSTER_MESSAGE_COMPRESSED);
+                msg << static_cast<uint64_t>(buffer.vector().size());
+                msg << compressed;
+            } else {
+                if (conn_structure->compress_messages) {
+                    msg << static_cast<int8_t>(CLUSTER_MESSAGE_RAW);
+                }
+                std::string buffer_str(buffer.vector().begin(), buffer.vector().end());
+                msg << buffer_str;
+            }
             int res = send_write_message(conn_structure->conn, &msg);
-            conn_structure->pm_bytes_sent.record(buffer.vector().size());
-            if (res) {
+            if (res == 0) {
+                // What went over the wire: the framing, and the compressed
+                // message if we compressed it.
+                conn_structure->pm_bytes_sent.record(msg.size());
+            } else {
                 /* Close the other half of the connection to make sure that
                    `connectivity_cluster_t::run_t::handle()` notices that something is
                    up */
@@ -116,7 +116,7 @@ public:
         public:
             /* The constructor registers us in every thread's `connection_map`;
             the destructor deregisters us. Both also notify all subscribers. */
-            connection_entry_t(run_t *, peer_id_t, tcp_conn_stream_t *, peer_address_t) THROWS_NOTHING;
+            connection_entry_t(run_t *, peer_id_t, tcp_conn_stream_t *, peer_address_t, bool compress_messages) THROWS_NOTHING;
             ~connection_entry_t() THROWS_NOTHING;
 
             /* NULL for our "connection" to ourself */
@@ -132,9 +132,19 @@ public:
 
             uuid_t session_id;
 
+            /* True if both ends support compressed messages. Then every
+            message carries a format byte, and messages of at least
+            `CLUSTER_COMPRESSION_THRESHOLD` bytes are compressed if that makes
+            them smaller. */
+            bool compress_messages;
+
             perfmon_collection_t pm_collection;
             perfmon_sampler_t pm_bytes_sent;
+            perfmon_counter_t pm_compression_negotiated;
+            perfmon_sampler_t pm_compression_ratio;
+            perfmon_duration_sampler_t pm_compress, pm_decompress;
             perfmon_membership_t pm_collection_membership, pm_bytes_sent_membership;
+            perfmon_multi_membership_t pm_compression_membership;
 
         private:
             /* We only hold this information so we can deregister ourself */
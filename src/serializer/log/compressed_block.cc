@@ -0,0 +1,51 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "serializer/log/compressed_block.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "containers/lz_compress.hpp"
+#include "utils.hpp"
+
+uint32_t compress_block(const void *ser_block, block_size_t block_size, void *image_out) {
+    const uint32_t block_sectors = block_size.ser_value() / DEVICE_BLOCK_SIZE;
+    const uint32_t max_sectors = std::min<uint32_t>(block_sectors - 1, MAX_COMPRESSED_BLOCK_SECTORS);
+    if (max_sectors == 0) {
+        return 0;
+    }
+
+    const ls_buf_data_t *block = reinterpret_cast<const ls_buf_data_t *>(ser_block);
+    ls_compressed_block_header_t *header = reinterpret_cast<ls_compressed_block_header_t *>(image_out);
+    char *data_out = reinterpret_cast<char *>(header + 1);
+
+    // Passing a capacity that's smaller than the block makes lz_compress() give
+    // up as soon as it's clear that we wouldn't save a sector.
+    const size_t capacity = max_sectors * DEVICE_BLOCK_SIZE - sizeof(ls_compressed_block_header_t);
+    const size_t compressed_size = lz_compress(reinterpret_cast<const char *>(block + 1), block_size.value(),
+                                               data_out, capacity);
+    if (compressed_size == 0) {
+        return 0;
+    }
+
+    header->buf_data = *block;
+    header->compressed_size = compressed_size;
+
+    const size_t used = sizeof(ls_compressed_block_header_t) + compressed_size;
+    const uint32_t sectors = ceil_divide(used, DEVICE_BLOCK_SIZE);
+    bzero(reinterpret_cast<char *>(image_out) + used, sectors * DEVICE_BLOCK_SIZE - used);
+    return sectors;
+}
+
+bool decompress_block(const void *image, uint32_t sectors, block_size_t block_size, void *ser_block_out) {
+    const ls_compressed_block_header_t *header = reinterpret_cast<const ls_compressed_block_header_t *>(image);
+    rassert(sectors > 0);
+    if (header->compressed_size > sectors * DEVICE_BLOCK_SIZE - sizeof(ls_compressed_block_header_t)) {
+        return false;
+    }
+
+    ls_buf_data_t *block = reinterpret_cast<ls_buf_data_t *>(ser_block_out);
+    *block = header->buf_data;
+    return lz_decompress(reinterpret_cast<const char *>(header + 1), header->compressed_size,
+                         reinterpret_cast<char *>(block + 1), block_size.value());
+}
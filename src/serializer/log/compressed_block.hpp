@@ -0,0 +1,44 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef SERIALIZER_LOG_COMPRESSED_BLOCK_HPP_
+#define SERIALIZER_LOG_COMPRESSED_BLOCK_HPP_
+
+#include <stdint.h>
+
+#include "config/args.hpp"
+#include "serializer/types.hpp"
+
+/* When the dynamic config asks for it, the data block manager compresses
+blocks before writing them. A compressed block takes up as many
+DEVICE_BLOCK_SIZE sectors as it needs, instead of a whole block_size slot, so
+this only saves space when blocks are bigger than a sector.
+
+On disk, a compressed block starts with the block's ls_buf_data_t, so the
+block id and block sequence id are where they always are, followed by the size
+of the compressed data and the block's data compressed with lz_compress(). The
+rest of the last sector is zeroes. Nothing on disk says that a block is
+compressed: its LBA entry records how many sectors it takes up, or 0 if it's
+an ordinary block. */
+
+struct ls_compressed_block_header_t {
+    ls_buf_data_t buf_data;
+    uint32_t compressed_size;
+} __attribute__((__packed__));
+
+/* The LBA keeps the number of sectors in the low bits of an offset that is
+aligned to DEVICE_BLOCK_SIZE, so a compressed block can't take up more than
+this. */
+#define MAX_COMPRESSED_BLOCK_SECTORS (DEVICE_BLOCK_SIZE - 1)
+
+/* Compresses the block at `ser_block` (ls_buf_data_t and all) into
+`image_out`, which must be aligned to DEVICE_BLOCK_SIZE and have room for a
+whole block. Returns how many sectors the compressed block takes up, or 0 if
+compressing it doesn't save at least a sector, in which case the block should
+be written as it is. */
+uint32_t compress_block(const void *ser_block, block_size_t block_size, void *image_out);
+
+/* Decompresses the `sectors` sectors long compressed block at `image` into the
+block_size.ser_value() bytes at `ser_block_out`. Returns false if the
+compressed data is malformed; it comes off the disk, so it isn't trusted. */
+bool decompress_block(const void *image, uint32_t sectors, block_size_t block_size, void *ser_block_out);
+
+#endif  // SERIALIZER_LOG_COMPRESSED_BLOCK_HPP_
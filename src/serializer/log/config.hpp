@@ -19,6 +19,8 @@ struct log_serializer_dynamic_config_t {
         file_zone_size = DEFAULT_FILE_ZONE_SIZE;
         read_ahead = true;
         io_batch_factor = DEFAULT_IO_BATCH_FACTOR;
+        scrub_bytes_per_sec = DEFAULT_SCRUB_BYTES_PER_SEC;
+        compress_blocks = false;
     }
 
     /* When the proportion of garbage blocks hits gc_high_ratio, then the serializer will collect
@@ -44,7 +46,16 @@ struct log_serializer_dynamic_config_t {
     /* Enable reading more data than requested to let the cache warmup more quickly esp. on rotational drives */
     bool read_ahead;
 
-    RDB_MAKE_ME_SERIALIZABLE_7(gc_low_ratio, gc_high_ratio, num_active_data_extents, file_size, file_zone_size, io_batch_factor, read_ahead);
+    /* How many bytes per second the scrubber reads to check blocks against their checksums.
+    0 turns the scrubber off. */
+    int64_t scrub_bytes_per_sec;
+
+    /* Compress blocks before writing them. Blocks that were written compressed can be read
+    either way. This only saves space if the block size is bigger than DEVICE_BLOCK_SIZE,
+    because compressed blocks still take up whole sectors (see compressed_block.hpp). */
+    bool compress_blocks;
+
+    RDB_MAKE_ME_SERIALIZABLE_9(gc_low_ratio, gc_high_ratio, num_active_data_extents, file_size, file_zone_size, io_batch_factor, read_ahead, scrub_bytes_per_sec, compress_blocks);
 };
 
 /* This is equivalent to log_serializer_static_config_t below, but is an on-disk
@@ -55,9 +66,14 @@ struct log_serializer_on_disk_static_config_t {
 
     // Some helpers
     uint64_t blocks_per_extent() const { return extent_size_ / block_size_; }
-    int block_index(off64_t offset) const { return (offset % extent_size_) / block_size_; }
     int extent_index(off64_t offset) const { return offset / extent_size_; }
 
+    // Compressed blocks take up a whole number of DEVICE_BLOCK_SIZE sectors rather than a
+    // block_size slot, so the data block manager keeps track of extents sector by sector.
+    uint64_t sectors_per_extent() const { return extent_size_ / DEVICE_BLOCK_SIZE; }
+    uint64_t sectors_per_block() const { return block_size_ / DEVICE_BLOCK_SIZE; }
+    int sector_index(off64_t offset) const { return (offset % extent_size_) / DEVICE_BLOCK_SIZE; }
+
     // Minimize calls to these.
     block_size_t block_size() const { return block_size_t::unsafe_make(block_size_); }
     uint64_t extent_size() const { return extent_size_; }
@@ -73,5 +89,12 @@ struct log_serializer_static_config_t : public log_serializer_on_disk_static_con
     RDB_MAKE_ME_SERIALIZABLE_2(block_size_, extent_size_);
 };
 
+/* How the serializers for a kind of file get set up, as given on the command
+line. `static_config` only matters when a file is created. */
+struct log_serializer_config_t {
+    log_serializer_static_config_t static_config;
+    log_serializer_dynamic_config_t dynamic_config;
+};
+
 #endif /* SERIALIZER_LOG_CONFIG_HPP_ */
 
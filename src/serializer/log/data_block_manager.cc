@@ -5,8 +5,11 @@
 #include <boost/bind.hpp>
 
 #include "arch/arch.hpp"
+#include "arch/timing.hpp"
 #include "concurrency/mutex.hpp"
 #include "perfmon/perfmon.hpp"
+#include "serializer/log/compressed_block.hpp"
+#include "serializer/log/delta_page.hpp"
 #include "serializer/log/log_serializer.hpp"
 
 /* TODO: Right now we perform garbage collection via the do_write() interface on the
@@ -50,9 +53,9 @@ void data_block_manager_t::start_reconstruct() {
 // gc_entry in the entries table.  (This is used when we start up, when
 // everything is presumed to be garbage, until we mark it as
 // non-garbage.)
-void data_block_manager_t::mark_live(off64_t offset) {
+void data_block_manager_t::mark_live(off64_t offset, uint32_t compressed_sectors) {
     int extent_id = static_config->extent_index(offset);
-    int block_id = static_config->block_index(offset);
+    int sector = static_config->sector_index(offset);
 
     if (entries.get(extent_id) == NULL) {
         rassert(gc_state.step() == gc_reconstruct);  // This is called at startup.
@@ -63,8 +66,10 @@ void data_block_manager_t::mark_live(off64_t offset) {
     }
 
     /* mark the block as alive */
-    entries.get(extent_id)->i_array.set(block_id, 1);
-    entries.get(extent_id)->update_g_array(block_id);
+    gc_entry *entry = entries.get(extent_id);
+    entry->set_block_sectors(sector, sectors_on_disk(compressed_sectors));
+    entry->i_array.set(sector, 1);
+    entry->update_g_array(sector);
 }
 
 void data_block_manager_t::end_reconstruct() {
@@ -101,7 +106,7 @@ void data_block_manager_t::start_existing(file_t *file, metablock_mixin_t *last_
             active_extents[i]->state = gc_entry::state_active;
             reconstructed_extents.remove(active_extents[i]);
 
-            blocks_in_active_extent[i] = last_metablock->blocks_in_active_extent[i];
+            sectors_in_active_extent[i] = last_metablock->blocks_in_active_extent[i] * static_config->sectors_per_block();
         } else {
             active_extents[i] = NULL;
         }
@@ -117,11 +122,13 @@ void data_block_manager_t::start_existing(file_t *file, metablock_mixin_t *last_
 
         entry->our_pq_entry = gc_pq.push(entry);
 
-        gc_stats.old_total_blocks += static_config->blocks_per_extent();
+        gc_stats.old_total_blocks += static_config->sectors_per_extent();
         gc_stats.old_garbage_blocks += entry->g_array.count();
     }
 
     state = state_ready;
+
+    start_scrubber();
 }
 
 class dbm_read_ahead_fsm_t : public iocallback_t {
@@ -133,10 +140,11 @@ public:
     off64_t read_ahead_size;
     off64_t read_ahead_offset;
     off64_t off_in;
+    uint32_t compressed_sectors;
     void *buf_out;
 
-    dbm_read_ahead_fsm_t(data_block_manager_t *p, off64_t _off_in, void *_buf_out, file_account_t *io_account, iocallback_t *cb)
-        : parent(p), callback(cb), read_ahead_buf(NULL), off_in(_off_in), buf_out(_buf_out)
+    dbm_read_ahead_fsm_t(data_block_manager_t *p, off64_t _off_in, uint32_t _compressed_sectors, void *_buf_out, file_account_t *io_account, iocallback_t *cb)
+        : parent(p), callback(cb), read_ahead_buf(NULL), off_in(_off_in), compressed_sectors(_compressed_sectors), buf_out(_buf_out)
     {
         extent = floor_aligned(off_in, parent->static_config->extent_size());
 
@@ -144,6 +152,10 @@ public:
         read_ahead_size = std::min<int64_t>(parent->static_config->extent_size(), MAX_READ_AHEAD_BLOCKS * int64_t(parent->static_config->block_size().ser_value()));
         // We divide the extent into chunks of size read_ahead_size, then select the one which contains off_in
         read_ahead_offset = extent + (off_in - extent) / read_ahead_size * read_ahead_size;
+        // Blocks start at any sector, so the one we're reading can run past the end of its chunk.
+        const off64_t block_end = off_in + parent->sectors_on_disk(compressed_sectors) * DEVICE_BLOCK_SIZE;
+        read_ahead_size = std::max<int64_t>(read_ahead_size, block_end - read_ahead_offset);
+        read_ahead_size = std::min<int64_t>(read_ahead_size, extent + parent->static_config->extent_size() - read_ahead_offset);
         read_ahead_buf = malloc_aligned(read_ahead_size, DEVICE_BLOCK_SIZE);
         parent->dbfile->read_async(read_ahead_offset, read_ahead_size, read_ahead_buf, io_account, this);
     }
@@ -151,20 +163,20 @@ public:
     void on_io_complete() {
         rassert(off_in >= read_ahead_offset);
         rassert(off_in < read_ahead_offset + read_ahead_size);
-        rassert(divides(parent->static_config->block_size().ser_value(), off_in - read_ahead_offset));
+        rassert(divides(DEVICE_BLOCK_SIZE, off_in - read_ahead_offset));
 
-        // Walk over the read ahead buffer and copy stuff...
-        for (int64_t current_block = 0; current_block * parent->static_config->block_size().ser_value() < read_ahead_size; ++current_block) {
+        // Walk over the read ahead buffer sector by sector, since blocks can start at any of them...
+        for (int64_t current_sector = 0; current_sector * DEVICE_BLOCK_SIZE < read_ahead_size; ++current_sector) {
 
-            const char *current_buf = reinterpret_cast<char *>(read_ahead_buf) + (current_block * parent->static_config->block_size().ser_value());
+            const char *current_buf = reinterpret_cast<char *>(read_ahead_buf) + (current_sector * DEVICE_BLOCK_SIZE);
 
-            const off64_t current_offset = read_ahead_offset + (current_block * parent->static_config->block_size().ser_value());
+            const off64_t current_offset = read_ahead_offset + (current_sector * DEVICE_BLOCK_SIZE);
 
             // Copy either into buf_out or create a new buffer for read ahead
             if (current_offset == off_in) {
                 ls_buf_data_t *data = reinterpret_cast<ls_buf_data_t *>(buf_out);
                 --data;
-                memcpy(data, current_buf, parent->static_config->block_size().ser_value());
+                parent->uncompress_block(current_buf, compressed_sectors, data);
             } else {
                 const block_id_t block_id = reinterpret_cast<const ls_buf_data_t *>(current_buf)->block_id;
 
@@ -173,18 +185,35 @@ public:
                 // Do this by checking the LBA
                 const flagged_off64_t flagged_lba_offset = parent->serializer->lba_index->get_block_offset(block_id);
                 block_is_live = block_is_live && flagged_lba_offset.has_value() && current_offset == flagged_lba_offset.get_value();
+                // A block with a delta record isn't up to date without it, so it has
+                // to go through a regular read.
+                block_is_live = block_is_live && !parent->serializer->lba_index->get_block_delta_offset(block_id).has_value();
 
                 if (!block_is_live) {
                     continue;
                 }
 
-                const repli_timestamp_t recency_timestamp = parent->serializer->lba_index->get_block_recency(block_id);
+                // We may not have read all of it.
+                const uint32_t block_compressed_sectors = parent->serializer->lba_index->get_block_compressed_sectors(block_id);
+                if ((current_sector + parent->sectors_on_disk(block_compressed_sectors)) * DEVICE_BLOCK_SIZE > read_ahead_size) {
+                    continue;
+                }
 
                 ls_buf_data_t *data = reinterpret_cast<ls_buf_data_t *>(parent->serializer->malloc());
                 --data;
-                memcpy(data, current_buf, parent->static_config->block_size().ser_value());
+                parent->uncompress_block(current_buf, block_compressed_sectors, data);
+
+                // Leave a corrupt block for the regular read to trip over.
+                const uint32_t checksum = parent->serializer->lba_index->get_block_checksum(block_id);
+                if (checksum != 0 && lba_block_checksum(data, parent->static_config->block_size().ser_value()) != checksum) {
+                    parent->serializer->free(data + 1);
+                    continue;
+                }
+
+                const repli_timestamp_t recency_timestamp = parent->serializer->lba_index->get_block_recency(block_id);
+
                 ++data;
-                intrusive_ptr_t<ls_block_token_pointee_t> ls_token(new ls_block_token_pointee_t(parent->serializer, current_offset));
+                intrusive_ptr_t<ls_block_token_pointee_t> ls_token(new ls_block_token_pointee_t(parent->serializer, current_offset, checksum, block_compressed_sectors));
                 intrusive_ptr_t<standard_block_token_t> token = to_standard_block_token(block_id, ls_token);
                 if (!parent->serializer->offer_buf_to_read_ahead_callbacks(block_id, data, token, recency_timestamp)) {
                     // If there is no interest anymore, delete the buffer again
@@ -201,6 +230,31 @@ public:
     }
 };
 
+// Reads a compressed block without reading ahead.
+class dbm_compressed_read_fsm_t : public iocallback_t {
+public:
+    dbm_compressed_read_fsm_t(data_block_manager_t *_parent, off64_t off_in, uint32_t _compressed_sectors, void *_buf_out,
+                              file_account_t *io_account, iocallback_t *_callback)
+        : parent(_parent), callback(_callback), compressed_sectors(_compressed_sectors), buf_out(_buf_out) {
+        image = malloc_aligned(compressed_sectors * DEVICE_BLOCK_SIZE, DEVICE_BLOCK_SIZE);
+        parent->dbfile->read_async(off_in, compressed_sectors * DEVICE_BLOCK_SIZE, image, io_account, this);
+    }
+
+    void on_io_complete() {
+        parent->uncompress_block(image, compressed_sectors, reinterpret_cast<ls_buf_data_t *>(buf_out) - 1);
+        free(image);
+        callback->on_io_complete();
+        delete this;
+    }
+
+private:
+    data_block_manager_t *parent;
+    iocallback_t *callback;
+    uint32_t compressed_sectors;
+    void *buf_out;
+    void *image;
+};
+
 bool data_block_manager_t::should_perform_read_ahead(off64_t offset) {
     unsigned int extent_id = static_config->extent_index(offset);
 
@@ -212,12 +266,14 @@ bool data_block_manager_t::should_perform_read_ahead(off64_t offset) {
     return !entry->was_written && serializer->should_perform_read_ahead();
 }
 
-void data_block_manager_t::read(off64_t off_in, void *buf_out, file_account_t *io_account, iocallback_t *cb) {
+void data_block_manager_t::read(off64_t off_in, uint32_t compressed_sectors, void *buf_out, file_account_t *io_account, iocallback_t *cb) {
     rassert(state == state_ready);
 
     if (should_perform_read_ahead(off_in)) {
         // We still need an fsm for read ahead as additional work has to be done on io complete...
-        new dbm_read_ahead_fsm_t(this, off_in, buf_out, io_account, cb);
+        new dbm_read_ahead_fsm_t(this, off_in, compressed_sectors, buf_out, io_account, cb);
+    } else if (compressed_sectors != 0) {
+        new dbm_compressed_read_fsm_t(this, off_in, compressed_sectors, buf_out, io_account, cb);
     } else {
         ls_buf_data_t *data = reinterpret_cast<ls_buf_data_t *>(buf_out);
         data--;
@@ -225,6 +281,59 @@ void data_block_manager_t::read(off64_t off_in, void *buf_out, file_account_t *i
     }
 }
 
+void data_block_manager_t::uncompress_block(const void *ser_block, uint32_t compressed_sectors, void *ser_block_out) {
+    if (compressed_sectors == 0) {
+        memcpy(ser_block_out, ser_block, static_config->block_size().ser_value());
+        return;
+    }
+
+    block_pm_duration timer(&stats->pm_serializer_block_decompressions);
+    if (!decompress_block(ser_block, compressed_sectors, static_config->block_size(), ser_block_out)) {
+        bzero(ser_block_out, static_config->block_size().ser_value());
+    }
+}
+
+bool data_block_manager_t::check_block(const char *block, off64_t offset) {
+    const ls_buf_data_t *header = reinterpret_cast<const ls_buf_data_t *>(block);
+    if (header->block_id == DELTA_PAGE_BLOCK_ID) {
+        return check_delta_page(header + 1, static_config->block_size());
+    }
+
+    // The LBA points here, so unless the header is damaged it's pointing here under the
+    // block id in the header.
+    const flagged_off64_t lba_offset = serializer->lba_index->get_block_offset(header->block_id);
+    if (!lba_offset.has_value() || lba_offset.get_value() != offset) {
+        return false;
+    }
+    const uint32_t checksum = serializer->lba_index->get_block_checksum(header->block_id);
+    if (checksum == 0) {
+        return true;
+    }
+    const uint32_t compressed_sectors = serializer->lba_index->get_block_compressed_sectors(header->block_id);
+    if (compressed_sectors == 0) {
+        return lba_block_checksum(block, static_config->block_size().ser_value()) == checksum;
+    }
+
+    // The checksum is that of the block before it got compressed.
+    char *uncompressed = static_cast<char *>(malloc(static_config->block_size().ser_value()));
+    uncompress_block(block, compressed_sectors, uncompressed);
+    const bool ok = lba_block_checksum(uncompressed, static_config->block_size().ser_value()) == checksum;
+    free(uncompressed);
+    return ok;
+}
+
+// Frees a compressed block once it's been written.
+struct dbm_compressed_write_callback_t : public iocallback_t {
+    dbm_compressed_write_callback_t(void *_image, iocallback_t *_cb) : image(_image), cb(_cb) { }
+    void on_io_complete() {
+        free(image);
+        cb->on_io_complete();
+        delete this;
+    }
+    void *image;
+    iocallback_t *cb;
+};
+
 /*
  Instead of wrapping this into a coroutine, we are still using a callback as we
  want to be able to spawn a lot of writes in parallel. Having to spawn a coroutine
@@ -234,23 +343,68 @@ void data_block_manager_t::read(off64_t off_in, void *buf_out, file_account_t *i
  */
 off64_t data_block_manager_t::write(const void *buf_in, block_id_t block_id, bool assign_new_block_sequence_id,
                                     file_account_t *io_account, iocallback_t *cb,
-                                    bool token_referenced) {
+                                    bool token_referenced, uint32_t *checksum_out,
+                                    uint32_t *compressed_sectors_out) {
     // Either we're ready to write, or we're shutting down and just
     // finished reading blocks for gc and called do_write.
     rassert(state == state_ready
            || (state == state_shutting_down && gc_state.step() == gc_write));
 
-    off64_t offset = gimme_a_new_offset(token_referenced);
-
-    ++stats->pm_serializer_data_blocks_written;
-
     ls_buf_data_t *data = const_cast<ls_buf_data_t *>(reinterpret_cast<const ls_buf_data_t *>(buf_in) - 1);
     data->block_id = block_id;
     if (assign_new_block_sequence_id) {
         data->block_sequence_id = ++serializer->latest_block_sequence_id;
     }
 
-    dbfile->write_async(offset, static_config->block_size().ser_value(), data, io_account, cb);
+    if (checksum_out) {
+        *checksum_out = lba_block_checksum(data, static_config->block_size().ser_value());
+    }
+
+    // Delta pages don't get compressed: they have no LBA entry of their own to say how
+    // many sectors they take up.
+    void *image = NULL;
+    uint32_t compressed_sectors = 0;
+    if (dynamic_config->compress_blocks && block_id != DELTA_PAGE_BLOCK_ID && static_config->sectors_per_block() > 1) {
+        image = malloc_aligned(static_config->block_size().ser_value(), DEVICE_BLOCK_SIZE);
+        {
+            block_pm_duration compression_timer(&stats->pm_serializer_block_compressions);
+            compressed_sectors = compress_block(data, static_config->block_size(), image);
+        }
+        stats->pm_serializer_compression_ratio.record(double(sectors_on_disk(compressed_sectors)) / static_config->sectors_per_block());
+        if (compressed_sectors == 0) {
+            free(image);
+            image = NULL;
+        }
+    }
+    if (compressed_sectors_out) {
+        *compressed_sectors_out = compressed_sectors;
+    }
+
+    off64_t offset = gimme_a_new_offset(token_referenced, sectors_on_disk(compressed_sectors));
+
+    ++stats->pm_serializer_data_blocks_written;
+
+    if (image) {
+        dbfile->write_async(offset, compressed_sectors * DEVICE_BLOCK_SIZE, image, io_account,
+                            new dbm_compressed_write_callback_t(image, cb));
+    } else {
+        dbfile->write_async(offset, static_config->block_size().ser_value(), data, io_account, cb);
+    }
+
+    return offset;
+}
+
+off64_t data_block_manager_t::copy_block(const void *ser_block, uint32_t compressed_sectors,
+                                         file_account_t *io_account, iocallback_t *cb) {
+    rassert(state == state_ready
+           || (state == state_shutting_down && gc_state.step() == gc_write));
+
+    const unsigned int sectors = sectors_on_disk(compressed_sectors);
+    off64_t offset = gimme_a_new_offset(true, sectors);
+
+    ++stats->pm_serializer_data_blocks_written;
+
+    dbfile->write_async(offset, sectors * DEVICE_BLOCK_SIZE, ser_block, io_account, cb);
 
     return offset;
 }
@@ -261,8 +415,8 @@ void data_block_manager_t::check_and_handle_empty_extent(unsigned int extent_id)
         return; // The extent has already been deleted
     }
 
-    rassert(entry->g_array.size() == static_config->blocks_per_extent());
-    if (entry->g_array.count() == static_config->blocks_per_extent() && entry->state != gc_entry::state_active) {
+    rassert(entry->g_array.size() == static_config->sectors_per_extent());
+    if (entry->g_array.count() == static_config->sectors_per_extent() && entry->state != gc_entry::state_active) {
         /* Every block in the extent is now garbage. */
         switch (entry->state) {
             case gc_entry::state_reconstructing:
@@ -279,8 +433,8 @@ void data_block_manager_t::check_and_handle_empty_extent(unsigned int extent_id)
             /* Remove from the priority queue */
             case gc_entry::state_old:
                 gc_pq.remove(entry->our_pq_entry);
-                gc_stats.old_total_blocks -= static_config->blocks_per_extent();
-                gc_stats.old_garbage_blocks -= static_config->blocks_per_extent();
+                gc_stats.old_total_blocks -= static_config->sectors_per_extent();
+                gc_stats.old_garbage_blocks -= static_config->sectors_per_extent();
                 break;
 
             /* Notify the GC that the extent got released during GC */
@@ -320,15 +474,15 @@ file_account_t *data_block_manager_t::choose_gc_io_account() {
 
 void data_block_manager_t::mark_garbage(off64_t offset, extent_transaction_t *txn) {
     unsigned int extent_id = static_config->extent_index(offset);
-    unsigned int block_id = static_config->block_index(offset);
+    unsigned int sector = static_config->sector_index(offset);
 
     gc_entry *entry = entries.get(extent_id);
-    rassert(entry->i_array[block_id] == 1, "with block_id = %u", block_id);
-    rassert(entry->g_array[block_id] == 0, "with block_id = %u", block_id);
+    rassert(entry->i_array[sector] == 1, "with sector = %u", sector);
+    rassert(entry->g_array[sector] == 0, "with sector = %u", sector);
 
     // Now we set the i_array entry to zero.  We make an extra reference to the extent which gets
     // held until we commit the transaction.
-    entry->i_array.set(block_id, 0);
+    entry->i_array.set(sector, 0);
 
     {
         extent_reference_t local_extent_ref;
@@ -336,13 +490,13 @@ void data_block_manager_t::mark_garbage(off64_t offset, extent_transaction_t *tx
         txn->push_extent(&local_extent_ref);
     }
 
-    entry->update_g_array(block_id);
+    entry->update_g_array(sector);
 
-    rassert(entry->g_array.size() == static_config->blocks_per_extent());
+    rassert(entry->g_array.size() == static_config->sectors_per_extent());
 
-    // Add to old garbage count if we have toggled the g_array bit (works because of the g_array[block_id] == 0 assertion above)
-    if (entry->state == gc_entry::state_old && entry->g_array[block_id]) {
-        ++gc_stats.old_garbage_blocks;
+    // Add to old garbage count if we have toggled the g_array bit (works because of the g_array[sector] == 0 assertion above)
+    if (entry->state == gc_entry::state_old && entry->g_array[sector]) {
+        gc_stats.old_garbage_blocks += entry->block_sectors(sector);
     }
 
     check_and_handle_empty_extent(extent_id);
@@ -350,30 +504,31 @@ void data_block_manager_t::mark_garbage(off64_t offset, extent_transaction_t *tx
 
 void data_block_manager_t::mark_token_live(off64_t offset) {
     unsigned int extent_id = static_config->extent_index(offset);
-    unsigned int block_id = static_config->block_index(offset);
+    unsigned int sector = static_config->sector_index(offset);
 
     gc_entry *entry = entries.get(extent_id);
     rassert(entry != NULL);
-    entry->t_array.set(block_id, 1);
-    entry->update_g_array(block_id);
+    rassert(entry->block_sectors(sector) != 0);
+    entry->t_array.set(sector, 1);
+    entry->update_g_array(sector);
 }
 
 void data_block_manager_t::mark_token_garbage(off64_t offset) {
     unsigned int extent_id = static_config->extent_index(offset);
-    unsigned int block_id = static_config->block_index(offset);
+    unsigned int sector = static_config->sector_index(offset);
 
     gc_entry *entry = entries.get(extent_id);
     rassert(entry != NULL);
-    rassert(entry->t_array[block_id] == 1);
-    rassert(entry->g_array[block_id] == 0);
-    entry->t_array.set(block_id, 0);
-    entry->update_g_array(block_id);
+    rassert(entry->t_array[sector] == 1);
+    rassert(entry->g_array[sector] == 0);
+    entry->t_array.set(sector, 0);
+    entry->update_g_array(sector);
 
-    rassert(entry->g_array.size() == static_config->blocks_per_extent());
+    rassert(entry->g_array.size() == static_config->sectors_per_extent());
 
-    // Add to old garbage count if we have toggled the g_array bit (works because of the g_array[block_id] == 0 assertion above)
-    if (entry->state == gc_entry::state_old && entry->g_array[block_id]) {
-        ++gc_stats.old_garbage_blocks;
+    // Add to old garbage count if we have toggled the g_array bit (works because of the g_array[sector] == 0 assertion above)
+    if (entry->state == gc_entry::state_old && entry->g_array[sector]) {
+        gc_stats.old_garbage_blocks += entry->block_sectors(sector);
     }
 
     check_and_handle_empty_extent(extent_id);
@@ -415,13 +570,13 @@ void data_block_manager_t::gc_writer_t::write_gcs(gc_write_t* writes, int num_wr
                 block_write_conds.push_back(new block_write_cond_t());
                 // ... and save block tokens for the old offset.
                 rassert(parent->gc_state.current_entry != NULL, "i = %d", i);
-                block_tokens.push_back(parent->serializer->generate_block_token(writes[i].old_offset));
+                block_tokens.push_back(parent->serializer->generate_block_token(writes[i].old_offset, 0, writes[i].compressed_sectors));
 
                 const ls_buf_data_t *data = static_cast<const ls_buf_data_t *>(writes[i].buf) - 1;
 
-                // the first "false" argument indicates that we do not with to assign a new block sequence id
-                // We pass true because we know there is a token for this block: we just constructed one!
-                writes[i].new_offset = parent->write(writes[i].buf, data->block_id, false, parent->choose_gc_io_account(), block_write_conds.back(), true);
+                // The block gets written exactly as we read it, so it keeps its block sequence id
+                // (and stays compressed if it was).
+                writes[i].new_offset = parent->copy_block(data, writes[i].compressed_sectors, parent->choose_gc_io_account(), block_write_conds.back());
             }
         }
 
@@ -436,6 +591,7 @@ void data_block_manager_t::gc_writer_t::write_gcs(gc_write_t* writes, int num_wr
         guarantee(parent->gc_state.current_entry != NULL);
 
         std::vector<index_write_op_t> index_write_ops;
+        std::vector<log_serializer_t::delta_page_move_t> delta_page_moves;
 
         // Step 3: Figure out index ops.  It's important that we do this
         // now, right before the index_write, so that the updates to the
@@ -444,12 +600,25 @@ void data_block_manager_t::gc_writer_t::write_gcs(gc_write_t* writes, int num_wr
             ASSERT_NO_CORO_WAITING;
 
             for (int i = 0; i < num_writes; ++i) {
-                unsigned int block_id = parent->static_config->block_index(writes[i].old_offset);
+                unsigned int sector = parent->static_config->sector_index(writes[i].old_offset);
 
-                if (parent->gc_state.current_entry->i_array[block_id]) {
+                if (parent->gc_state.current_entry->i_array[sector]) {
                     const ls_buf_data_t *data = static_cast<const ls_buf_data_t *>(writes[i].buf) - 1;
-                    intrusive_ptr_t<ls_block_token_pointee_t> token = parent->serializer->generate_block_token(writes[i].new_offset);
-                    index_write_ops.push_back(index_write_op_t(data->block_id, to_standard_block_token(data->block_id, token)));
+                    // The copy is byte for byte, so it keeps the LBA's checksum. (We
+                    // don't recompute it: that would bless a block that got corrupted.)
+                    const uint32_t checksum = data->block_id == DELTA_PAGE_BLOCK_ID ? 0
+                        : parent->serializer->lba_index->get_block_checksum(data->block_id);
+                    intrusive_ptr_t<ls_block_token_pointee_t> token = parent->serializer->generate_block_token(writes[i].new_offset, checksum, writes[i].compressed_sectors);
+                    if (data->block_id == DELTA_PAGE_BLOCK_ID) {
+                        // Delta pages aren't in the index under their own block id; the
+                        // serializer re-points the blocks whose records are on them.
+                        log_serializer_t::delta_page_move_t move;
+                        move.old_offset = writes[i].old_offset;
+                        move.new_token = token;
+                        delta_page_moves.push_back(move);
+                    } else {
+                        index_write_ops.push_back(index_write_op_t(data->block_id, to_standard_block_token(data->block_id, token)));
+                    }
                 }
 
                 // (If we don't have an i_array entry, the block is referenced
@@ -478,11 +647,13 @@ void data_block_manager_t::gc_writer_t::write_gcs(gc_write_t* writes, int num_wr
 
         // Step 4B: Commit the transaction to the serializer, emptying
         // out all the i_array bits.
-        parent->serializer->index_write(index_write_ops, parent->choose_gc_io_account());
+        parent->serializer->index_write_internal(index_write_ops, std::vector<intrusive_ptr_t<ls_block_token_pointee_t> >(),
+                                                 delta_page_moves, parent->choose_gc_io_account());
 
         ASSERT_NO_CORO_WAITING;
 
         index_write_ops.clear();  // cleanup index_write_ops under the watchful eyes of ASSERT_NO_CORO_WAITING
+        delta_page_moves.clear();
     }
 
     {
@@ -524,7 +695,7 @@ void data_block_manager_t::run_gc() {
                 rassert(gc_state.current_entry->state == gc_entry::state_old);
                 gc_state.current_entry->state = gc_entry::state_in_gc;
                 gc_stats.old_garbage_blocks -= gc_state.current_entry->g_array.count();
-                gc_stats.old_total_blocks -= static_config->blocks_per_extent();
+                gc_stats.old_total_blocks -= static_config->sectors_per_extent();
 
                 /* read all the live data into buffers */
 
@@ -544,14 +715,16 @@ void data_block_manager_t::run_gc() {
                 gc_state.gc_blocks = static_cast<char *>(malloc_aligned(extent_manager->extent_size,
                         DEVICE_BLOCK_SIZE));
                 gc_state.set_step(gc_read);
-                for (unsigned int i = 0, bpe = static_config->blocks_per_extent(); i < bpe; i++) {
-                    if (!gc_state.current_entry->g_array[i]) {
+                for (unsigned int i = 0, spe = static_config->sectors_per_extent(); i < spe; i++) {
+                    // Read the live blocks, which start at the sectors that aren't garbage
+                    // and have a block starting at them.
+                    if (!gc_state.current_entry->g_array[i] && gc_state.current_entry->block_sectors(i) != 0) {
                         // Increment the refcount before read_async, because read_async can call
                         // its callback immediately, causing the decrement of the refcount.
                         gc_state.refcount++;
-                        dbfile->read_async(gc_state.current_entry->extent_ref.offset() + (i * static_config->block_size().ser_value()),
-                                           static_config->block_size().ser_value(),
-                                           gc_state.gc_blocks + (i * static_config->block_size().ser_value()),
+                        dbfile->read_async(gc_state.current_entry->extent_ref.offset() + (i * DEVICE_BLOCK_SIZE),
+                                           gc_state.current_entry->block_sectors(i) * DEVICE_BLOCK_SIZE,
+                                           gc_state.gc_blocks + (i * DEVICE_BLOCK_SIZE),
                                            choose_gc_io_account(),
                                            &(gc_state.gc_read_callback));
                     }
@@ -579,35 +752,34 @@ void data_block_manager_t::run_gc() {
                 }
 
                 /* an array to put our writes in */
-#ifndef NDEBUG
-                int num_writes = static_config->blocks_per_extent() - gc_state.current_entry->g_array.count();
-#endif
-
                 gc_writes.clear();
-                for (unsigned int i = 0; i < static_config->blocks_per_extent(); i++) {
+                for (unsigned int i = 0; i < static_config->sectors_per_extent(); i++) {
 
                     /* We re-check the bit array here in case a write came in for one of the
                     blocks we are GCing. We wouldn't want to overwrite the new valid data with
                     out-of-date data. */
-                    if (gc_state.current_entry->g_array[i]) continue;
+                    if (gc_state.current_entry->g_array[i] || gc_state.current_entry->block_sectors(i) == 0) continue;
 
-                    char *block = gc_state.gc_blocks + i * static_config->block_size().ser_value();
-                    const off64_t block_offset = gc_state.current_entry->extent_ref.offset() + (i * static_config->block_size().ser_value());
+                    char *block = gc_state.gc_blocks + i * DEVICE_BLOCK_SIZE;
+                    const off64_t block_offset = gc_state.current_entry->extent_ref.offset() + (i * DEVICE_BLOCK_SIZE);
+                    const unsigned int sectors = gc_state.current_entry->block_sectors(i);
+                    const uint32_t compressed_sectors = sectors == static_config->sectors_per_block() ? 0 : sectors;
                     block_id_t id;
                     // The block is either referenced by an index or by a token (or both)
                     if (gc_state.current_entry->i_array[i]) {
                         id = (reinterpret_cast<ls_buf_data_t *>(block))->block_id;
                         rassert(id != NULL_BLOCK_ID);
+                        if (!check_block(block, block_offset)) {
+                            serializer->report_corrupt_block(id, block_offset);
+                        }
                     } else {
                         id = NULL_BLOCK_ID;
                     }
                     void *data = block + sizeof(ls_buf_data_t);
 
-                    gc_writes.push_back(gc_write_t(id, data, block_offset));
+                    gc_writes.push_back(gc_write_t(id, data, compressed_sectors, block_offset));
                 }
 
-                rassert(gc_writes.size() == (size_t)num_writes);
-
                 gc_state.set_step(gc_write);
 
                 /* schedule the write */
@@ -655,7 +827,8 @@ void data_block_manager_t::prepare_metablock(metablock_mixin_t *metablock) {
     for (int i = 0; i < MAX_ACTIVE_DATA_EXTENTS; i++) {
         if (active_extents[i]) {
             metablock->active_extents[i] = active_extents[i]->extent_ref.offset();
-            metablock->blocks_in_active_extent[i] = blocks_in_active_extent[i];
+            // Round up, so that whatever we write next doesn't overlap what's there.
+            metablock->blocks_in_active_extent[i] = ceil_divide(sectors_in_active_extent[i], static_config->sectors_per_block());
         } else {
             metablock->active_extents[i] = NULL_OFFSET;
             metablock->blocks_in_active_extent[i] = 0;
@@ -709,42 +882,52 @@ void data_block_manager_t::actually_shutdown() {
     }
 }
 
-off64_t data_block_manager_t::gimme_a_new_offset(bool token_referenced) {
+off64_t data_block_manager_t::gimme_a_new_offset(bool token_referenced, unsigned int sectors) {
     rassert(token_referenced);
+    rassert(sectors > 0 && sectors <= static_config->sectors_per_block());
+
+    /* Give up on the extent if the block doesn't fit at its end. (Then the rest of it is
+    garbage.) */
+
+    if (active_extents[next_active_extent]
+        && sectors_in_active_extent[next_active_extent] + sectors > static_config->sectors_per_extent()) {
+        deactivate_extent(next_active_extent);
+    }
+
     /* Start a new extent if necessary */
 
     if (!active_extents[next_active_extent]) {
         active_extents[next_active_extent] = new gc_entry(this);
         active_extents[next_active_extent]->state = gc_entry::state_active;
-        blocks_in_active_extent[next_active_extent] = 0;
+        sectors_in_active_extent[next_active_extent] = 0;
 
         ++stats->pm_serializer_data_extents_allocated;
     }
 
     /* Put the block into the chosen extent */
 
-    rassert(active_extents[next_active_extent]->state == gc_entry::state_active);
-    rassert(active_extents[next_active_extent]->g_array.count() > 0);
-    rassert(blocks_in_active_extent[next_active_extent] < static_config->blocks_per_extent());
+    gc_entry *entry = active_extents[next_active_extent];
+    const unsigned int sector = sectors_in_active_extent[next_active_extent];
+
+    rassert(entry->state == gc_entry::state_active);
+    rassert(sector + sectors <= static_config->sectors_per_extent());
 
-    off64_t offset = active_extents[next_active_extent]->extent_ref.offset() + blocks_in_active_extent[next_active_extent] * static_config->block_size().ser_value();
-    active_extents[next_active_extent]->was_written = true;
+    off64_t offset = entry->extent_ref.offset() + sector * DEVICE_BLOCK_SIZE;
+    entry->was_written = true;
 
-    rassert(active_extents[next_active_extent]->g_array[blocks_in_active_extent[next_active_extent]]);
-    active_extents[next_active_extent]->t_array.set(blocks_in_active_extent[next_active_extent], token_referenced);
-    rassert(!active_extents[next_active_extent]->i_array[blocks_in_active_extent[next_active_extent]]);
-    active_extents[next_active_extent]->update_g_array(blocks_in_active_extent[next_active_extent]);
+    rassert(entry->g_array[sector]);
+    entry->set_block_sectors(sector, sectors);
+    entry->t_array.set(sector, token_referenced);
+    rassert(!entry->i_array[sector]);
+    entry->update_g_array(sector);
 
-    blocks_in_active_extent[next_active_extent]++;
+    sectors_in_active_extent[next_active_extent] += sectors;
 
     /* Deactivate the extent if necessary */
 
-    if (blocks_in_active_extent[next_active_extent] == static_config->blocks_per_extent()) {
-        rassert(active_extents[next_active_extent]->g_array.count() < static_config->blocks_per_extent(), "g_array.count() == %zu, blocks_per_extent=%lu", active_extents[next_active_extent]->g_array.count(), static_config->blocks_per_extent());
-        active_extents[next_active_extent]->state = gc_entry::state_young;
-        young_extent_queue.push_back(active_extents[next_active_extent]);
-        mark_unyoung_entries();
-        active_extents[next_active_extent] = NULL;
+    if (sectors_in_active_extent[next_active_extent] == static_config->sectors_per_extent()) {
+        rassert(entry->g_array.count() < static_config->sectors_per_extent(), "g_array.count() == %zu, sectors_per_extent=%lu", entry->g_array.count(), static_config->sectors_per_extent());
+        deactivate_extent(next_active_extent);
     }
 
     /* Move along to the next extent. This logic is kind of weird because it needs to handle the
@@ -762,6 +945,20 @@ off64_t data_block_manager_t::gimme_a_new_offset(bool token_referenced) {
     return offset;
 }
 
+void data_block_manager_t::deactivate_extent(unsigned int i) {
+    gc_entry *entry = active_extents[i];
+    rassert(entry->state == gc_entry::state_active);
+    active_extents[i] = NULL;
+
+    entry->state = gc_entry::state_young;
+    young_extent_queue.push_back(entry);
+    mark_unyoung_entries();
+
+    // If we're giving up on the extent because a block didn't fit, everything on it may
+    // already be garbage.
+    check_and_handle_empty_extent(static_config->extent_index(entry->extent_ref.offset()));
+}
+
 // Looks at young_extent_queue and pops things off the queue that are
 // no longer deemed young, putting them on the priority queue.
 void data_block_manager_t::mark_unyoung_entries() {
@@ -788,19 +985,22 @@ void data_block_manager_t::remove_last_unyoung_entry() {
 
     entry->our_pq_entry = gc_pq.push(entry);
 
-    gc_stats.old_total_blocks += static_config->blocks_per_extent();
+    gc_stats.old_total_blocks += static_config->sectors_per_extent();
     gc_stats.old_garbage_blocks += entry->g_array.count();
 }
 
 
 gc_entry::gc_entry(data_block_manager_t *_parent)
     : parent(_parent),
-      g_array(parent->static_config->blocks_per_extent()),
-      t_array(parent->static_config->blocks_per_extent()),
-      i_array(parent->static_config->blocks_per_extent()),
+      g_array(parent->static_config->sectors_per_extent()),
+      t_array(parent->static_config->sectors_per_extent()),
+      i_array(parent->static_config->sectors_per_extent()),
       timestamp(current_microtime()),
       was_written(false)
 {
+    if (parent->static_config->sectors_per_block() > 1) {
+        sectors.resize(parent->static_config->sectors_per_extent(), 0);
+    }
     parent->extent_manager->gen_extent(&extent_ref);
     offset = extent_ref.offset();
     rassert(parent->entries.get(extent_ref.offset() / parent->extent_manager->extent_size) == NULL);
@@ -812,12 +1012,15 @@ gc_entry::gc_entry(data_block_manager_t *_parent)
 
 gc_entry::gc_entry(data_block_manager_t *_parent, off64_t _offset)
     : parent(_parent),
-      g_array(parent->static_config->blocks_per_extent()),
-      t_array(parent->static_config->blocks_per_extent()),
-      i_array(parent->static_config->blocks_per_extent()),
+      g_array(parent->static_config->sectors_per_extent()),
+      t_array(parent->static_config->sectors_per_extent()),
+      i_array(parent->static_config->sectors_per_extent()),
       timestamp(current_microtime()),
       was_written(false)
 {
+    if (parent->static_config->sectors_per_block() > 1) {
+        sectors.resize(parent->static_config->sectors_per_extent(), 0);
+    }
     parent->extent_manager->reserve_extent(_offset, &extent_ref);
     offset = extent_ref.offset();
     rassert(parent->entries.get(extent_ref.offset() / parent->extent_manager->extent_size) == NULL);
@@ -834,6 +1037,17 @@ gc_entry::~gc_entry() {
     --parent->stats->pm_serializer_data_extents;
 }
 
+void gc_entry::set_block_sectors(unsigned int sector, unsigned int n) {
+    rassert(n > 0 && sector + n <= g_array.size());
+    if (sectors.empty()) {
+        rassert(n == 1);
+    } else {
+        // Each sector only gets written once, so a block's size never changes.
+        rassert(sectors[sector] == 0 || sectors[sector] == n);
+        sectors[sector] = n;
+    }
+}
+
 void gc_entry::destroy() {
     parent->extent_manager->release_extent(&extent_ref);
     delete this;
@@ -886,7 +1100,7 @@ double data_block_manager_t::garbage_ratio() const {
     } else {
         double old_garbage = gc_stats.old_garbage_blocks.get();
         double old_total = gc_stats.old_total_blocks.get();
-        return old_garbage / (old_total + extent_manager->held_extents() * static_config->blocks_per_extent());
+        return old_garbage / (old_total + extent_manager->held_extents() * static_config->sectors_per_extent());
     }
 }
 
@@ -909,6 +1123,83 @@ void data_block_manager_t::enable_gc() {
     gc_state.should_be_stopped = false;
 }
 
+void data_block_manager_t::start_scrubber() {
+    rassert(!scrub_drainer.has());
+    if (dynamic_config->scrub_bytes_per_sec > 0) {
+        scrub_drainer.init(new auto_drainer_t);
+        coro_t::spawn_sometime(boost::bind(&data_block_manager_t::scrub, this, auto_drainer_t::lock_t(scrub_drainer.get())));
+    }
+}
+
+void data_block_manager_t::stop_scrubber() {
+    scrub_drainer.reset();
+}
+
+void data_block_manager_t::scrub(auto_drainer_t::lock_t keepalive) {
+    // Pace ourselves so that we read no more than scrub_bytes_per_sec.
+    const int64_t nap_ms = extent_manager->extent_size * 1000 / dynamic_config->scrub_bytes_per_sec;
+    char *buf = static_cast<char *>(malloc_aligned(extent_manager->extent_size, DEVICE_BLOCK_SIZE));
+    unsigned int extent_id = 0;
+    try {
+        for (;;) {
+            nap(nap_ms, keepalive.get_drain_signal());
+            if (gc_entry *entry = next_extent_to_scrub(&extent_id)) {
+                scrub_extent(entry, buf);
+                ++extent_id;
+            }
+        }
+    } catch (const interrupted_exc_t &) {
+        // We're shutting down.
+    }
+    free(buf);
+}
+
+gc_entry *data_block_manager_t::next_extent_to_scrub(unsigned int *extent_id) {
+    const unsigned int end_extent_id = ceil_divide(dbfile->get_size(), extent_manager->extent_size);
+    for (unsigned int i = 0; i < end_extent_id; ++i) {
+        const unsigned int id = (*extent_id + i) % end_extent_id;
+        gc_entry *entry = entries.get(id);
+        // Active extents are still being written to, and the GC is already reading the
+        // one it's collecting.
+        if (entry && (entry->state == gc_entry::state_young || entry->state == gc_entry::state_old)) {
+            *extent_id = id;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void data_block_manager_t::scrub_extent(gc_entry *entry, char *buf) {
+    const unsigned int extent_id = static_config->extent_index(entry->extent_ref.offset());
+
+    // Hold a reference so that the extent can't be freed and reused while we read it.
+    extent_reference_t extent_ref;
+    extent_manager->copy_extent_reference(&entry->extent_ref, &extent_ref);
+    const off64_t extent_offset = extent_ref.offset();
+
+    struct : public cond_t, public iocallback_t {
+        void on_io_complete() { pulse(); }
+    } read_done;
+    dbfile->read_async(extent_offset, extent_manager->extent_size, buf, gc_io_account_nice.get(), &read_done);
+    read_done.wait();
+
+    // Blocks may have become garbage (or the GC may have emptied the whole extent) while
+    // we were reading, but none can have become live: nothing gets written to an extent
+    // that isn't active. So whatever the LBA points at now is what we read.
+    entry = entries.get(extent_id);
+    if (entry) {
+        for (unsigned int i = 0, spe = static_config->sectors_per_extent(); i < spe; ++i) {
+            if (entry->i_array[i] && !check_block(buf + i * DEVICE_BLOCK_SIZE, extent_offset + i * DEVICE_BLOCK_SIZE)) {
+                serializer->report_corrupt_block(reinterpret_cast<const ls_buf_data_t *>(buf + i * DEVICE_BLOCK_SIZE)->block_id,
+                                                 extent_offset + i * DEVICE_BLOCK_SIZE);
+            }
+        }
+        ++stats->pm_serializer_extents_scrubbed;
+    }
+
+    extent_manager->release_extent_copy(&extent_ref);
+}
+
 
 void data_block_manager_t::gc_stat_t::operator++() {
     val++;
@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "arch/types.hpp"
+#include "concurrency/auto_drainer.hpp"
 #include "containers/bitset.hpp"
 #include "containers/priority_queue.hpp"
 #include "containers/two_level_array.hpp"
@@ -28,6 +29,11 @@ struct gc_entry_less {
 // Identifies an extent, the time we started writing to the
 // extent, whether it's the extent we're currently writing to, and
 // describes blocks are garbage.
+//
+// Blocks start at any DEVICE_BLOCK_SIZE sector of the extent and take up
+// one or more sectors (fewer than block_size if they're compressed), so
+// the bit arrays have a bit per sector. t_array and i_array only use the
+// bits for the sectors that blocks start at.
 class gc_entry :
     public intrusive_list_node_t<gc_entry>
 {
@@ -35,13 +41,23 @@ public:
     data_block_manager_t *parent;
 
     extent_reference_t extent_ref;
-    bitset_t g_array; /* !< bit array for whether or not each block is garbage */
+    bitset_t g_array; /* !< bit array for whether or not each sector is garbage */
     bitset_t t_array; /* !< bit array for whether or not each block is referenced by some token */
     bitset_t i_array; /* !< bit array for whether or not each block is referenced by the current lba (*i*ndex) */
-    // g_array is redundant. g_array[i] = !(t_array[i] || i_array[i])
-    void update_g_array(unsigned int block_id) {
-        g_array.set(block_id, !(t_array[block_id] || i_array[block_id]));
+    // g_array is redundant. For each sector of the block starting at sector i,
+    // g_array is !(t_array[i] || i_array[i]), and it's set for the sectors no block takes up.
+    void update_g_array(unsigned int sector) {
+        const bool garbage = !(t_array[sector] || i_array[sector]);
+        for (unsigned int i = sector, end = sector + block_sectors(sector); i < end; ++i) {
+            g_array.set(i, garbage);
+        }
+    }
+
+    /* How many sectors the block that starts at `sector` takes up. */
+    unsigned int block_sectors(unsigned int sector) const {
+        return sectors.empty() ? 1 : sectors[sector];
     }
+    void set_block_sectors(unsigned int sector, unsigned int n);
     microtime_t timestamp; /* !< when we started writing to the extent */
     priority_queue_t<gc_entry*, gc_entry_less>::entry_t *our_pq_entry; /* !< The PQ entry pointing to us */
     bool was_written; /* true iff the extent has been written to after starting up the serializer */
@@ -79,21 +95,27 @@ private:
     // array.
     off64_t offset;
 
+    // For each sector, how many sectors the block that starts there takes up, or 0 if no
+    // block does. (This stays empty if blocks are a single sector, since then they all are.)
+    std::vector<uint16_t> sectors;
+
     DISABLE_COPYING(gc_entry);
 };
 
 class data_block_manager_t {
     friend class gc_entry;
     friend class dbm_read_ahead_fsm_t;
+    friend class dbm_compressed_read_fsm_t;
 
 private:
     struct gc_write_t {
         block_id_t block_id;
         const void *buf;
+        uint32_t compressed_sectors;
         off64_t old_offset;
         off64_t new_offset;
-        gc_write_t(block_id_t i, const void *b, off64_t _old_offset)
-            : block_id(i), buf(b), old_offset(_old_offset), new_offset(0) { }
+        gc_write_t(block_id_t i, const void *b, uint32_t _compressed_sectors, off64_t _old_offset)
+            : block_id(i), buf(b), compressed_sectors(_compressed_sectors), old_offset(_old_offset), new_offset(0) { }
     };
 
     struct gc_writer_t {
@@ -113,6 +135,8 @@ public:
 
     struct metablock_mixin_t {
         off64_t active_extents[MAX_ACTIVE_DATA_EXTENTS];
+        // We keep track of sectors, but this is in blocks (rounded up) so that the format
+        // didn't have to change.
         uint64_t blocks_in_active_extent[MAX_ACTIVE_DATA_EXTENTS];
     };
 
@@ -122,12 +146,19 @@ public:
     static void prepare_initial_metablock(metablock_mixin_t *mb);
     void start_existing(file_t *dbfile, metablock_mixin_t *last_metablock);
 
-    void read(off64_t off_in, void *buf_out, file_account_t *io_account, iocallback_t *cb);
+    /* Reads the block at `off_in`, decompressing it if it's stored compressed, in which case
+    `compressed_sectors` is how many sectors it takes up. */
+    void read(off64_t off_in, uint32_t compressed_sectors, void *buf_out, file_account_t *io_account, iocallback_t *cb);
 
-    /* Returns the offset to which the block will be written */
+    /* Returns the offset to which the block will be written. If `checksum_out` isn't NULL,
+    it gets the CRC-32C of the block, header included (before it's compressed). If
+    dynamic_config->compress_blocks is set, the block gets compressed if that saves space;
+    `compressed_sectors_out` gets how many sectors it takes up then, or 0 if it didn't get
+    compressed. */
     off64_t write(const void *buf_in, block_id_t block_id, bool assign_new_block_sequence_id,
                   file_account_t *io_account, iocallback_t *cb,
-                  bool token_referenced);
+                  bool token_referenced, uint32_t *checksum_out = NULL,
+                  uint32_t *compressed_sectors_out = NULL);
 
     /* exposed gc api */
     /* mark a buffer as garbage */
@@ -139,7 +170,7 @@ public:
 
     /* r{start,stop}_reconstruct functions for safety */
     void start_reconstruct();
-    void mark_live(off64_t);  // Takes a real off64_t.
+    void mark_live(off64_t offset, uint32_t compressed_sectors);  // Takes a real off64_t.
     void end_reconstruct();
 
     /* We must make sure that blocks which have tokens pointing to them don't
@@ -154,6 +185,12 @@ public:
     /* take step in gcing */
     void run_gc();
 
+    /* The scrubber is a coroutine that keeps reading the data extents that aren't being
+    written to, at dynamic_config->scrub_bytes_per_sec, and reports the blocks that don't
+    match the checksums in the LBA. stop_scrubber() blocks until it's done. */
+    void start_scrubber();
+    void stop_scrubber();
+
     void prepare_metablock(metablock_mixin_t *metablock);
     bool do_we_want_to_start_gcing() const;
 
@@ -187,7 +224,22 @@ private:
 
     file_account_t *choose_gc_io_account();
 
-    off64_t gimme_a_new_offset(bool token_referenced);
+    off64_t gimme_a_new_offset(bool token_referenced, unsigned int sectors);
+
+    // Moves the active extent in slot `i` to the young extent queue.
+    void deactivate_extent(unsigned int i);
+
+    // How many sectors a block takes up on disk.
+    unsigned int sectors_on_disk(uint32_t compressed_sectors) const {
+        return compressed_sectors == 0 ? static_config->sectors_per_block() : compressed_sectors;
+    }
+
+    /* Writes a block that the GC read off disk as it is, compressed or not. */
+    off64_t copy_block(const void *ser_block, uint32_t compressed_sectors, file_account_t *io_account, iocallback_t *cb);
+
+    /* Turns a block as it is on disk into the block_size bytes at `ser_block_out`. A block that
+    doesn't decompress comes out as zeroes, which won't match its checksum. */
+    void uncompress_block(const void *ser_block, uint32_t compressed_sectors, void *ser_block_out);
 
     /* Checks whether the extent is empty and if it is, notifies the extent manager and cleans up */
     void check_and_handle_empty_extent(unsigned int extent_id);
@@ -205,6 +257,15 @@ private:
 
     bool should_perform_read_ahead(off64_t offset);
 
+    /* Checks a block that the LBA points at, as read from `offset`, against the checksum
+    in the LBA (or, for a delta page, its own). */
+    bool check_block(const char *block, off64_t offset);
+
+    void scrub(auto_drainer_t::lock_t keepalive);
+    // Finds the next extent to scrub, starting at `*extent_id`. Returns NULL if there isn't any.
+    gc_entry *next_extent_to_scrub(unsigned int *extent_id);
+    void scrub_extent(gc_entry *entry, char *buf);
+
     /* internal garbage collection structures */
     struct gc_read_callback_t : public iocallback_t {
         data_block_manager_t *parent;
@@ -251,7 +312,7 @@ private:
     is determined by dynamic_config->num_active_data_extents. */
     unsigned int next_active_extent;   // Cycles through the active extents
     gc_entry *active_extents[MAX_ACTIVE_DATA_EXTENTS];
-    unsigned blocks_in_active_extent[MAX_ACTIVE_DATA_EXTENTS];
+    unsigned sectors_in_active_extent[MAX_ACTIVE_DATA_EXTENTS];
 
     /* Contains every extent in the gc_entry::state_young state */
     intrusive_list_t< gc_entry > young_extent_queue;
@@ -335,6 +396,7 @@ private:
     gc_state_t gc_state;
 
 
+    // (These count DEVICE_BLOCK_SIZE sectors, not blocks.)
     struct gc_stats_t {
         gc_stat_t old_total_blocks;
         gc_stat_t old_garbage_blocks;
@@ -343,6 +405,8 @@ private:
 
     gc_stats_t gc_stats;
 
+    scoped_ptr_t<auto_drainer_t> scrub_drainer;
+
     DISABLE_COPYING(data_block_manager_t);
 };
 
@@ -0,0 +1,92 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "serializer/log/delta_page.hpp"
+
+#include <string.h>
+
+#include "containers/crc32c.hpp"
+
+delta_page_writer_t::delta_page_writer_t(void *_page, block_size_t block_size)
+    : page(reinterpret_cast<char *>(_page)), page_size(block_size.value()),
+      offset(sizeof(ls_delta_page_header_t)) {
+    bzero(page, page_size);
+    memcpy(reinterpret_cast<ls_delta_page_header_t *>(page)->magic, delta_page_magic, DELTA_PAGE_MAGIC_SIZE);
+}
+
+bool delta_page_writer_t::add(block_id_t block_id, const std::string &record) {
+    rassert(!record.empty());
+    if (offset + sizeof(ls_delta_record_header_t) + record.size() > page_size) {
+        return false;
+    }
+
+    ls_delta_record_header_t *header = reinterpret_cast<ls_delta_record_header_t *>(page + offset);
+    header->block_id = block_id;
+    header->length = record.size();
+    memcpy(page + offset + sizeof(ls_delta_record_header_t), record.data(), record.size());
+
+    // The checksum covers the records in order, so it can be extended a record at a time.
+    ls_delta_page_header_t *page_header = reinterpret_cast<ls_delta_page_header_t *>(page);
+    const size_t record_end = offset + sizeof(ls_delta_record_header_t) + record.size();
+    page_header->checksum = crc32c(page_header->checksum, page + offset, record_end - offset);
+    offset = record_end;
+    return true;
+}
+
+size_t delta_page_writer_t::max_record_size(block_size_t block_size) {
+    return block_size.value() - sizeof(ls_delta_page_header_t) - sizeof(ls_delta_record_header_t);
+}
+
+/* Calls `cb(header, data)` for each record on the page, and then checks the
+page's checksum. Returns false if the page is malformed. */
+template <class callable_t>
+static bool walk_delta_page(const void *page, block_size_t block_size, callable_t *cb) {
+    const char *p = reinterpret_cast<const char *>(page);
+    const size_t page_size = block_size.value();
+    const ls_delta_page_header_t *page_header = reinterpret_cast<const ls_delta_page_header_t *>(p);
+    if (memcmp(page_header->magic, delta_page_magic, DELTA_PAGE_MAGIC_SIZE) != 0) {
+        return false;
+    }
+
+    size_t offset = sizeof(ls_delta_page_header_t);
+    while (offset + sizeof(ls_delta_record_header_t) <= page_size) {
+        const ls_delta_record_header_t *header = reinterpret_cast<const ls_delta_record_header_t *>(p + offset);
+        if (header->length == 0) {
+            break;
+        }
+        offset += sizeof(ls_delta_record_header_t);
+        if (header->length > page_size - offset) {
+            return false;
+        }
+        (*cb)(header, p + offset);
+        offset += header->length;
+    }
+    const size_t records_start = sizeof(ls_delta_page_header_t);
+    return crc32c(0, p + records_start, offset - records_start) == page_header->checksum;
+}
+
+struct delta_record_finder_t {
+    delta_record_finder_t(block_id_t _block_id, std::string *_record_out)
+        : block_id(_block_id), record_out(_record_out), found(false) { }
+    void operator()(const ls_delta_record_header_t *header, const char *data) {
+        if (header->block_id == block_id) {
+            record_out->assign(data, header->length);
+            found = true;
+        }
+    }
+    block_id_t block_id;
+    std::string *record_out;
+    bool found;
+};
+
+bool find_delta_record(const void *page, block_size_t block_size, block_id_t block_id, std::string *record_out) {
+    delta_record_finder_t finder(block_id, record_out);
+    return walk_delta_page(page, block_size, &finder) && finder.found;
+}
+
+struct delta_record_ignorer_t {
+    void operator()(const ls_delta_record_header_t *, const char *) { }
+};
+
+bool check_delta_page(const void *page, block_size_t block_size) {
+    delta_record_ignorer_t ignorer;
+    return walk_delta_page(page, block_size, &ignorer);
+}
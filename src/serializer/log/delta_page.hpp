@@ -0,0 +1,70 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef SERIALIZER_LOG_DELTA_PAGE_HPP_
+#define SERIALIZER_LOG_DELTA_PAGE_HPP_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "serializer/types.hpp"
+
+/* Delta records are kept in "delta pages": ordinary data blocks, written
+through the data block manager with DELTA_PAGE_BLOCK_ID as their block id, that
+hold the delta records of all the blocks of one index_write() one after the
+other. The LBA entry of each of those blocks points at the page. A page stays
+live (and gets moved by the GC like any other block) for as long as some block
+still points at it.
+
+Delta pages have no LBA entry of their own to keep a checksum in, so the page
+header carries the CRC-32C of the records instead. */
+
+#define DELTA_PAGE_BLOCK_ID (block_id_t(-2))
+
+#define DELTA_PAGE_MAGIC_SIZE 8
+static const char delta_page_magic[DELTA_PAGE_MAGIC_SIZE] = {'d', 'e', 'l', 't', 'a', 'p', 'g', 'e'};
+
+struct ls_delta_page_header_t {
+    char magic[DELTA_PAGE_MAGIC_SIZE];
+    // The CRC-32C of everything from the end of this header to the end of the
+    // last record.
+    uint32_t checksum;
+} __attribute__((__packed__));
+
+// Records follow the page header back to back. A record with length 0 (or the
+// end of the page) ends the page.
+struct ls_delta_record_header_t {
+    block_id_t block_id;
+    uint32_t length;
+} __attribute__((__packed__));
+
+/* Fills a delta page with records. */
+class delta_page_writer_t {
+public:
+    delta_page_writer_t(void *page, block_size_t block_size);
+
+    /* Returns false (and adds nothing) if the record doesn't fit on the page. */
+    MUST_USE bool add(block_id_t block_id, const std::string &record);
+
+    bool empty() const { return offset == sizeof(ls_delta_page_header_t); }
+
+    /* The largest record that fits on an empty page. */
+    static size_t max_record_size(block_size_t block_size);
+
+private:
+    char *page;
+    size_t page_size;
+    size_t offset;
+
+    DISABLE_COPYING(delta_page_writer_t);
+};
+
+/* Looks for `block_id`'s delta record on the page. Returns false if the page
+doesn't have one for it, or isn't a well-formed delta page (which includes a
+checksum mismatch). */
+bool find_delta_record(const void *page, block_size_t block_size, block_id_t block_id, std::string *record_out);
+
+/* Checks that `page` is a well-formed delta page whose records match its
+checksum. */
+bool check_delta_page(const void *page, block_size_t block_size);
+
+#endif  // SERIALIZER_LOG_DELTA_PAGE_HPP_
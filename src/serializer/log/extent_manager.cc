@@ -318,6 +318,12 @@ void extent_manager_t::copy_extent_reference(extent_reference_t *extent_ref, ext
     zone_for_offset(offset)->make_extent_reference(offset, extent_ref_out);
 }
 
+void extent_manager_t::release_extent_copy(extent_reference_t *extent_ref) {
+    assert_thread();
+    // Unlike release_extent(), this doesn't touch the stats: the copy was never counted.
+    zone_for_offset(extent_ref->offset())->release_extent(extent_ref);
+}
+
 void extent_manager_t::release_extent_into_transaction(extent_reference_t *extent_ref, extent_transaction_t *txn) {
     release_extent_preliminaries();
     rassert(current_transaction);
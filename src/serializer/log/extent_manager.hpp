@@ -136,6 +136,9 @@ public:
     most recent metablock points to. */
 
     void copy_extent_reference(extent_reference_t *extent_ref, extent_reference_t *extent_ref_out);
+    /* Drops a reference made by copy_extent_reference() outside of any transaction. The extent
+    is freed if it was the last one. */
+    void release_extent_copy(extent_reference_t *extent_ref);
 
     void begin_transaction(extent_transaction_t *out);
     void gen_extent(extent_reference_t *extent_ref_out);
@@ -61,7 +61,7 @@ void lba_disk_extent_t::read_step_2(read_info_t *info, in_memory_index_t *index)
     for (int i = 0; i < info->count; i++) {
         lba_entry_t *e = &extent->entries[i];
         if (!lba_entry_t::is_padding(e)) {
-            index->set_block_info(e->block_id, e->recency, e->offset);
+            index->set_block_info(e->block_id, e->recency, e->offset, e->get_delta_offset(), e->checksum, e->get_compressed_sectors());
         }
     }
 
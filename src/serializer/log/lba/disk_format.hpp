@@ -6,6 +6,7 @@
 
 #include "serializer/serializer.hpp"
 #include "config/args.hpp"
+#include "containers/crc32c.hpp"
 
 
 
@@ -77,28 +78,58 @@ struct lba_metablock_mixin_t {
 
 static const block_id_t PADDING_BLOCK_ID = NULL_BLOCK_ID;
 
+// The checksum that goes in an lba_entry_t for a block (header and data) of
+// `size` bytes. It's the block's CRC-32C, except that a CRC of 0 is stored as
+// 1, because 0 means the checksum isn't known.
+inline uint32_t lba_block_checksum(const void *block, size_t size) {
+    const uint32_t crc = crc32c(0, block, size);
+    return crc == 0 ? 1 : crc;
+}
+
 struct lba_entry_t {
     block_id_t block_id;
 
-    // TODO: Remove the need for these fields.  Remove the requirement
-    // that lba_entry_t be a divisor of DEVICE_BLOCK_SIZE.
-    uint32_t zero1;
-    uint64_t zero2;
+    // The CRC-32C of the block's header and data before any compression (see
+    // lba_block_checksum()), so a compressed block is checked after it's
+    // uncompressed. 0 if it isn't known: this field used to be padding that was
+    // always written as 0, so blocks written before checksums existed aren't checked.
+    uint32_t checksum;
+
+    // The offset of the delta page that holds the block's delta record,
+    // or 0 if it has none. (Offset 0 is the static header, so no delta
+    // page can be there, and LBAs from before delta records read as 0.)
+    // Delta pages are aligned to DEVICE_BLOCK_SIZE, which leaves the low
+    // bits free for the number of sectors the block takes up at `offset`
+    // if it's stored compressed, or 0 if it isn't (see compressed_block.hpp).
+    uint64_t delta_offset_and_sectors;
 
     repli_timestamp_t recency;
     // An offset into the file, with is_delete set appropriately.
     flagged_off64_t offset;
 
-    static inline lba_entry_t make(block_id_t block_id, repli_timestamp_t recency, flagged_off64_t offset) {
+    static inline lba_entry_t make(block_id_t block_id, repli_timestamp_t recency, flagged_off64_t offset,
+                                   flagged_off64_t delta_offset = flagged_off64_t::unused(),
+                                   uint32_t checksum = 0, uint32_t compressed_sectors = 0) {
         lba_entry_t entry;
         entry.block_id = block_id;
-        entry.zero1 = 0;
-        entry.zero2 = 0;
+        entry.checksum = checksum;
+        rassert(!delta_offset.has_value() || (delta_offset.get_value() != 0 && divides(DEVICE_BLOCK_SIZE, delta_offset.get_value())));
+        rassert(compressed_sectors < DEVICE_BLOCK_SIZE);
+        entry.delta_offset_and_sectors = (delta_offset.has_value() ? delta_offset.get_value() : 0) | compressed_sectors;
         entry.recency = recency;
         entry.offset = offset;
         return entry;
     }
 
+    flagged_off64_t get_delta_offset() const {
+        const off64_t delta_offset = delta_offset_and_sectors & ~uint64_t(DEVICE_BLOCK_SIZE - 1);
+        return delta_offset == 0 ? flagged_off64_t::unused() : flagged_off64_t::make(delta_offset);
+    }
+
+    uint32_t get_compressed_sectors() const {
+        return delta_offset_and_sectors & (DEVICE_BLOCK_SIZE - 1);
+    }
+
     static inline bool is_padding(const lba_entry_t* entry) {
         return entry->block_id == PADDING_BLOCK_ID  && entry->offset.is_padding();
     }
@@ -17,23 +17,30 @@ block_id_t in_memory_index_t::end_block_id() {
 
 in_memory_index_t::info_t in_memory_index_t::get_block_info(block_id_t id) {
     if (id >= blocks.get_size()) {
-        info_t ret = { flagged_off64_t::unused(), repli_timestamp_t::invalid };
+        info_t ret = { flagged_off64_t::unused(), repli_timestamp_t::invalid, flagged_off64_t::unused(), 0, 0 };
         return ret;
     } else {
-        info_t ret = { blocks[id], timestamps[id] };
+        info_t ret = { blocks[id], timestamps[id], deltas[id], checksums[id], compressed_sectors[id] };
         return ret;
     }
 }
 
 void in_memory_index_t::set_block_info(block_id_t id, repli_timestamp_t recency,
-                                       flagged_off64_t offset) {
+                                       flagged_off64_t offset, flagged_off64_t delta_offset, uint32_t checksum,
+                                       uint32_t _compressed_sectors) {
     if (id >= blocks.get_size()) {
         blocks.set_size(id + 1, flagged_off64_t::unused());
         timestamps.set_size(id + 1, repli_timestamp_t::invalid);
+        deltas.set_size(id + 1, flagged_off64_t::unused());
+        checksums.set_size(id + 1, 0);
+        compressed_sectors.set_size(id + 1, 0);
     }
 
     blocks[id] = offset;
     timestamps[id] = recency;
+    deltas[id] = delta_offset;
+    checksums[id] = checksum;
+    compressed_sectors[id] = _compressed_sectors;
 }
 
 #ifndef NDEBUG
@@ -11,10 +11,13 @@
 
 class in_memory_index_t
 {
-    // blocks.get_size() == timestamps.get_size().  We use parallel
-    // arrays to avoid wasting memory from alignment.
+    // blocks.get_size() == timestamps.get_size() == deltas.get_size() == checksums.get_size()
+    // == compressed_sectors.get_size(). We use parallel arrays to avoid wasting memory from alignment.
     segmented_vector_t<flagged_off64_t, MAX_BLOCK_ID> blocks;
     segmented_vector_t<repli_timestamp_t, MAX_BLOCK_ID> timestamps;
+    segmented_vector_t<flagged_off64_t, MAX_BLOCK_ID> deltas;
+    segmented_vector_t<uint32_t, MAX_BLOCK_ID> checksums;
+    segmented_vector_t<uint16_t, MAX_BLOCK_ID> compressed_sectors;
 
 public:
     in_memory_index_t();
@@ -25,11 +28,15 @@ public:
     struct info_t {
         flagged_off64_t offset;
         repli_timestamp_t recency;
+        flagged_off64_t delta_offset;
+        uint32_t checksum;
+        uint32_t compressed_sectors;
     };
 
     info_t get_block_info(block_id_t id);
     void set_block_info(block_id_t id, repli_timestamp_t recency,
-                        flagged_off64_t offset);
+                        flagged_off64_t offset, flagged_off64_t delta_offset, uint32_t checksum,
+                        uint32_t compressed_sectors);
 
     bool is_offset_indexed(off64_t offset);
     block_id_t get_block_id(off64_t offset);
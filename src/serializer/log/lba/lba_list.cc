@@ -104,17 +104,35 @@ repli_timestamp_t lba_list_t::get_block_recency(block_id_t block) {
     return in_memory_index.get_block_info(block).recency;
 }
 
-void lba_list_t::set_block_info(block_id_t block, repli_timestamp_t recency, flagged_off64_t offset, file_account_t *io_account, extent_transaction_t *txn) {
+flagged_off64_t lba_list_t::get_block_delta_offset(block_id_t block) {
     rassert(state == state_ready);
 
-    in_memory_index.set_block_info(block, recency, offset);
+    return in_memory_index.get_block_info(block).delta_offset;
+}
+
+uint32_t lba_list_t::get_block_checksum(block_id_t block) {
+    rassert(state == state_ready);
+
+    return in_memory_index.get_block_info(block).checksum;
+}
+
+uint32_t lba_list_t::get_block_compressed_sectors(block_id_t block) {
+    rassert(state == state_ready);
+
+    return in_memory_index.get_block_info(block).compressed_sectors;
+}
+
+void lba_list_t::set_block_info(block_id_t block, repli_timestamp_t recency, flagged_off64_t offset, flagged_off64_t delta_offset, uint32_t checksum, uint32_t compressed_sectors, file_account_t *io_account, extent_transaction_t *txn) {
+    rassert(state == state_ready);
+
+    in_memory_index.set_block_info(block, recency, offset, delta_offset, checksum, compressed_sectors);
 
     /* Strangely enough, this works even with the GC. Here's the reasoning: If the GC is
     waiting for the disk structure lock, then sync() will never be called again on the
     current disk_structure, so it's meaningless but harmless to call add_entry(). However,
     since our changes are also being put into the in_memory_index, they will be
     incorporated into the new disk_structure that the GC creates, so they won't get lost. */
-    disk_structures[block % LBA_SHARD_FACTOR]->add_entry(block, recency, offset, io_account, txn);
+    disk_structures[block % LBA_SHARD_FACTOR]->add_entry(block, recency, offset, delta_offset, checksum, compressed_sectors, io_account, txn);
 }
 
 class lba_syncer_t :
@@ -199,9 +217,9 @@ public:
              id < end_id;
              id += LBA_SHARD_FACTOR) {
             block_id_t block_id = id;
-            flagged_off64_t off = owner->get_block_offset(block_id);
-            if (off.has_value()) {
-                owner->disk_structures[i]->add_entry(block_id, owner->get_block_recency(block_id), off, io_account, txn);
+            in_memory_index_t::info_t info = owner->in_memory_index.get_block_info(block_id);
+            if (info.offset.has_value()) {
+                owner->disk_structures[i]->add_entry(block_id, info.recency, info.offset, info.delta_offset, info.checksum, info.compressed_sectors, io_account, txn);
             }
         }
 
@@ -37,6 +37,12 @@ public:
 public:
     flagged_off64_t get_block_offset(block_id_t block);
     repli_timestamp_t get_block_recency(block_id_t block);
+    // The offset of the delta page holding the block's delta record, if it has one.
+    flagged_off64_t get_block_delta_offset(block_id_t block);
+    // The CRC-32C of the block at its current offset, or 0 if it isn't known.
+    uint32_t get_block_checksum(block_id_t block);
+    // How many sectors the block takes up if it's stored compressed, or 0 if it isn't.
+    uint32_t get_block_compressed_sectors(block_id_t block);
 
     /* Returns a block ID such that all blocks that exist are guaranteed to have IDs less than
     that block ID. */
@@ -50,7 +56,8 @@ public:
 
 public:
     void set_block_info(block_id_t block, repli_timestamp_t recency,
-                        flagged_off64_t offset, file_account_t *io_account,
+                        flagged_off64_t offset, flagged_off64_t delta_offset, uint32_t checksum,
+                        uint32_t compressed_sectors, file_account_t *io_account,
                         extent_transaction_t *txn);
 
     struct sync_callback_t {
@@ -2,16 +2,21 @@
 #include "serializer/log/log_serializer.hpp"
 
 #include <fcntl.h>
+#include <inttypes.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include "errors.hpp"
 #include <boost/bind.hpp>
 
 #include "arch/arch.hpp"
 #include "buffer_cache/types.hpp"
+#include "logger.hpp"
 #include "perfmon/perfmon.hpp"
+#include "serializer/log/delta_page.hpp"
 
 filepath_file_opener_t::filepath_file_opener_t(const std::string &filepath, io_backender_t *backender)
     : filepath_(filepath), backender_(backender) {
@@ -82,6 +87,14 @@ log_serializer_stats_t::log_serializer_stats_t(perfmon_collection_t *parent)
       pm_serializer_old_garbage_blocks(),
       pm_serializer_old_total_blocks(),
       pm_serializer_lba_gcs(),
+      pm_serializer_extents_scrubbed(),
+      pm_serializer_corrupt_blocks(),
+      pm_serializer_block_compressions(secs_to_ticks(1)),
+      pm_serializer_block_decompressions(secs_to_ticks(1)),
+      pm_serializer_compression_ratio(secs_to_ticks(1), false),
+      pm_serializer_delta_reads(),
+      pm_serializer_delta_page_reads(),
+      pm_serializer_delta_pages_moved(),
       parent_collection_membership(parent, &serializer_collection, "serializer"),
       stats_membership(&serializer_collection,
           &pm_serializer_block_reads, "serializer_block_reads",
@@ -100,6 +113,14 @@ log_serializer_stats_t::log_serializer_stats_t(perfmon_collection_t *parent)
           &pm_serializer_old_garbage_blocks, "serializer_old_garbage_blocks",
           &pm_serializer_old_total_blocks, "serializer_old_total_blocks",
           &pm_serializer_lba_gcs, "serializer_lba_gcs",
+          &pm_serializer_extents_scrubbed, "serializer_extents_scrubbed",
+          &pm_serializer_corrupt_blocks, "serializer_corrupt_blocks",
+          &pm_serializer_block_compressions, "serializer_block_compressions",
+          &pm_serializer_block_decompressions, "serializer_block_decompressions",
+          &pm_serializer_compression_ratio, "serializer_compression_ratio",
+          &pm_serializer_delta_reads, "serializer_delta_reads",
+          &pm_serializer_delta_page_reads, "serializer_delta_page_reads",
+          &pm_serializer_delta_pages_moved, "serializer_delta_pages_moved",
           NULLPTR)
 { }
 
@@ -234,7 +255,11 @@ struct ls_start_existing_fsm_t :
             for (block_id_t id = 0; id < ser->lba_index->end_block_id(); id++) {
                 flagged_off64_t offset = ser->lba_index->get_block_offset(id);
                 if (offset.has_value()) {
-                    ser->data_block_manager->mark_live(offset.get_value());
+                    ser->data_block_manager->mark_live(offset.get_value(), ser->lba_index->get_block_compressed_sectors(id));
+                }
+                flagged_off64_t delta_offset = ser->lba_index->get_block_delta_offset(id);
+                if (delta_offset.has_value()) {
+                    ser->add_delta_page_ref(delta_offset.get_value(), id);
                 }
             }
             ser->data_block_manager->end_reconstruct();
@@ -336,6 +361,10 @@ log_serializer_t::~log_serializer_t() {
     rassert(state == state_unstarted || state == state_shut_down);
     rassert(last_write == NULL);
     rassert(active_write_count == 0);
+
+    for (std::list<recent_delta_page_t>::iterator it = recent_delta_pages.begin(); it != recent_delta_pages.end(); ++it) {
+        free(it->page);
+    }
 }
 
 void ls_check_existing(const char *filename, io_backender_t *backender, log_serializer_t::check_callback_t *cb) {
@@ -402,17 +431,32 @@ void log_serializer_t::block_read(const intrusive_ptr_t<ls_block_token_pointee_t
     struct my_cb_t : public iocallback_t {
         void on_io_complete() {
             stats->pm_serializer_block_reads.end(&pm_time);
+            if (tok->checksum_ != 0) {
+                // There's no way to hand a read error back up through the
+                // cache, and going on with a corrupt block would be worse.
+                const ls_buf_data_t *data = reinterpret_cast<const ls_buf_data_t *>(buf) - 1;
+                const uint32_t actual = lba_block_checksum(data, block_size.ser_value());
+                guarantee(actual == tok->checksum_,
+                          "Block %u at offset %" PRIi64 " of the database file doesn't match its checksum "
+                          "(expected %08x, got %08x). The file is corrupt.",
+                          data->block_id, offset, tok->checksum_, actual);
+            }
             if (cb) cb->on_io_complete();
             delete this;
         }
-        my_cb_t(iocallback_t *_cb, const intrusive_ptr_t<ls_block_token_pointee_t>& _tok, log_serializer_stats_t *_stats) : cb(_cb), tok(_tok), stats(_stats) {}
+        my_cb_t(iocallback_t *_cb, const intrusive_ptr_t<ls_block_token_pointee_t>& _tok, log_serializer_stats_t *_stats,
+                void *_buf, block_size_t _block_size)
+            : cb(_cb), tok(_tok), stats(_stats), buf(_buf), block_size(_block_size), offset(-1) {}
         iocallback_t *cb;
         intrusive_ptr_t<ls_block_token_pointee_t> tok; // needed to keep it alive for appropriate period of time
         ticks_t pm_time;
         log_serializer_stats_t *stats;
+        void *buf;
+        block_size_t block_size;
+        off64_t offset;
     };
 
-    my_cb_t *readcb = new my_cb_t(cb, token, stats.get());
+    my_cb_t *readcb = new my_cb_t(cb, token, stats.get(), buf, get_block_size());
 
     stats->pm_serializer_block_reads.begin(&readcb->pm_time);
 
@@ -428,7 +472,8 @@ void log_serializer_t::block_read(const intrusive_ptr_t<ls_block_token_pointee_t
     rassert(token_offsets_it != token_offsets.end());
 
     const off64_t offset = token_offsets_it->second;
-    data_block_manager->read(offset, buf, io_account, readcb);
+    readcb->offset = offset;
+    data_block_manager->read(offset, ls_token->compressed_sectors_, buf, io_account, readcb);
 }
 
 // God this is such a hack.
@@ -447,8 +492,101 @@ intrusive_ptr_t<ls_block_token_pointee_t> get_ls_block_token(const intrusive_ptr
 #endif  // SEMANTIC_SERIALIZER_CHECK
 
 
+struct delta_page_write_cond_t : public cond_t, public iocallback_t {
+    void on_io_complete() { pulse(); }
+};
+
+void log_serializer_t::write_delta_pages(const std::vector<index_write_op_t>& write_ops, file_account_t *io_account,
+                                         std::vector<intrusive_ptr_t<ls_block_token_pointee_t> > *delta_tokens_out) {
+    assert_thread();
+
+    // Pack the records into as few pages as we can, in op order.
+    std::vector<void *> pages;
+    std::vector<size_t> page_of_op(write_ops.size());
+    scoped_ptr_t<delta_page_writer_t> writer;
+    for (size_t i = 0; i < write_ops.size(); ++i) {
+        const index_write_op_t& op = write_ops[i];
+        if (!op.delta || op.delta->empty()) {
+            continue;
+        }
+        guarantee(op.delta->size() <= delta_page_writer_t::max_record_size(get_block_size()),
+                  "Delta record for block %u doesn't fit in a block", op.block_id);
+        if (!writer.has() || !writer->add(op.block_id, op.delta.get())) {
+            pages.push_back(malloc());
+            writer.reset();
+            writer.init(new delta_page_writer_t(pages.back(), get_block_size()));
+            DEBUG_VAR bool added = writer->add(op.block_id, op.delta.get());
+            rassert(added);
+        }
+        page_of_op[i] = pages.size() - 1;
+    }
+
+    if (pages.empty()) {
+        return;
+    }
+
+    std::vector<delta_page_write_cond_t *> conds;
+    std::vector<intrusive_ptr_t<ls_block_token_pointee_t> > page_tokens;
+    for (size_t p = 0; p < pages.size(); ++p) {
+        conds.push_back(new delta_page_write_cond_t);
+        page_tokens.push_back(block_write(pages[p], DELTA_PAGE_BLOCK_ID, io_account, conds.back()));
+    }
+    for (size_t p = 0; p < pages.size(); ++p) {
+        conds[p]->wait();
+        delete conds[p];
+        free(pages[p]);
+    }
+
+    delta_tokens_out->resize(write_ops.size());
+    for (size_t i = 0; i < write_ops.size(); ++i) {
+        if (write_ops[i].delta && !write_ops[i].delta->empty()) {
+            (*delta_tokens_out)[i] = page_tokens[page_of_op[i]];
+        }
+    }
+}
+
+void log_serializer_t::add_delta_page_ref(off64_t offset, block_id_t block_id) {
+    std::set<block_id_t> *blocks = &delta_page_blocks[offset];
+    if (blocks->empty()) {
+        data_block_manager->mark_live(offset, 0);
+    }
+    blocks->insert(block_id);
+}
+
+void log_serializer_t::remove_delta_page_ref(off64_t offset, block_id_t block_id, extent_transaction_t *txn) {
+    std::map<off64_t, std::set<block_id_t> >::iterator it = delta_page_blocks.find(offset);
+    rassert(it != delta_page_blocks.end());
+    it->second.erase(block_id);
+    if (it->second.empty()) {
+        delta_page_blocks.erase(it);
+        forget_recent_delta_page(offset);
+        data_block_manager->mark_garbage(offset, txn);
+    }
+}
+
+void log_serializer_t::forget_recent_delta_page(off64_t offset) {
+    for (std::list<recent_delta_page_t>::iterator it = recent_delta_pages.begin(); it != recent_delta_pages.end(); ++it) {
+        if (it->offset == offset) {
+            free(it->page);
+            recent_delta_pages.erase(it);
+            return;
+        }
+    }
+}
+
 void log_serializer_t::index_write(const std::vector<index_write_op_t>& write_ops, file_account_t *io_account) {
     assert_thread();
+    std::vector<intrusive_ptr_t<ls_block_token_pointee_t> > delta_tokens;
+    write_delta_pages(write_ops, io_account, &delta_tokens);
+    index_write_internal(write_ops, delta_tokens, std::vector<delta_page_move_t>(), io_account);
+}
+
+void log_serializer_t::index_write_internal(const std::vector<index_write_op_t>& write_ops,
+                                            const std::vector<intrusive_ptr_t<ls_block_token_pointee_t> >& delta_tokens,
+                                            const std::vector<delta_page_move_t>& delta_page_moves,
+                                            file_account_t *io_account) {
+    assert_thread();
+    rassert(delta_tokens.empty() || delta_tokens.size() == write_ops.size());
     ticks_t pm_time;
     stats->pm_serializer_index_writes.begin(&pm_time);
     stats->pm_serializer_index_writes_size.record(write_ops.size());
@@ -462,11 +600,12 @@ void log_serializer_t::index_write(const std::vector<index_write_op_t>& write_op
         // atomic.
         ASSERT_NO_CORO_WAITING;
 
-        for (std::vector<index_write_op_t>::const_iterator write_op_it = write_ops.begin();
-             write_op_it != write_ops.end();
-             ++write_op_it) {
-            const index_write_op_t& op = *write_op_it;
+        for (size_t i = 0; i < write_ops.size(); ++i) {
+            const index_write_op_t& op = write_ops[i];
             flagged_off64_t offset = lba_index->get_block_offset(op.block_id);
+            flagged_off64_t delta_offset = lba_index->get_block_delta_offset(op.block_id);
+            uint32_t checksum = lba_index->get_block_checksum(op.block_id);
+            uint32_t compressed_sectors = lba_index->get_block_compressed_sectors(op.block_id);
 
             if (op.token) {
                 // Update the offset pointed to, and mark garbage/liveness as necessary.
@@ -484,18 +623,62 @@ void log_serializer_t::index_write(const std::vector<index_write_op_t>& write_op
                     std::map<ls_block_token_pointee_t *, off64_t>::const_iterator to_it = token_offsets.find(ls_token);
                     rassert(to_it != token_offsets.end());
                     offset = flagged_off64_t::make(to_it->second);
+                    checksum = ls_token->checksum_;
+                    compressed_sectors = ls_token->compressed_sectors_;
 
                     /* mark the life */
-                    data_block_manager->mark_live(offset.get_value());
+                    data_block_manager->mark_live(offset.get_value(), compressed_sectors);
                 } else {
                     offset = flagged_off64_t::unused();
+                    checksum = 0;
+                    compressed_sectors = 0;
+                }
+            }
+
+            // A deleted block takes its delta record with it.
+            if (op.delta || !offset.has_value()) {
+                if (delta_offset.has_value()) {
+                    remove_delta_page_ref(delta_offset.get_value(), op.block_id, &context.extent_txn);
+                    delta_offset = flagged_off64_t::unused();
+                }
+                if (op.delta && !op.delta->empty()) {
+                    rassert(offset.has_value(), "Delta record for block %u, which has no data", op.block_id);
+                    std::map<ls_block_token_pointee_t *, off64_t>::const_iterator to_it = token_offsets.find(delta_tokens[i].get());
+                    rassert(to_it != token_offsets.end());
+                    delta_offset = flagged_off64_t::make(to_it->second);
+                    add_delta_page_ref(delta_offset.get_value(), op.block_id);
                 }
             }
 
             repli_timestamp_t recency = op.recency ? op.recency.get()
                 : lba_index->get_block_recency(op.block_id);
 
-            lba_index->set_block_info(op.block_id, recency, offset, io_account, &context.extent_txn);
+            lba_index->set_block_info(op.block_id, recency, offset, delta_offset, checksum, compressed_sectors,
+                                      io_account, &context.extent_txn);
+        }
+
+        for (size_t i = 0; i < delta_page_moves.size(); ++i) {
+            std::map<off64_t, std::set<block_id_t> >::iterator it = delta_page_blocks.find(delta_page_moves[i].old_offset);
+            if (it == delta_page_blocks.end()) {
+                // Every block on the page got a newer delta record while the GC was copying it.
+                continue;
+            }
+            std::map<ls_block_token_pointee_t *, off64_t>::const_iterator to_it = token_offsets.find(delta_page_moves[i].new_token.get());
+            rassert(to_it != token_offsets.end());
+            const off64_t new_offset = to_it->second;
+
+            for (std::set<block_id_t>::const_iterator jt = it->second.begin(); jt != it->second.end(); ++jt) {
+                lba_index->set_block_info(*jt, lba_index->get_block_recency(*jt), lba_index->get_block_offset(*jt),
+                                          flagged_off64_t::make(new_offset), lba_index->get_block_checksum(*jt),
+                                          lba_index->get_block_compressed_sectors(*jt), io_account, &context.extent_txn);
+            }
+
+            data_block_manager->mark_live(new_offset, 0);
+            delta_page_blocks[new_offset].swap(it->second);
+            delta_page_blocks.erase(it);
+            forget_recent_delta_page(delta_page_moves[i].old_offset);
+            data_block_manager->mark_garbage(delta_page_moves[i].old_offset, &context.extent_txn);
+            ++stats->pm_serializer_delta_pages_moved;
         }
     }
 
@@ -583,9 +766,10 @@ void log_serializer_t::index_write_finish(index_write_context_t *context, file_a
     }
 }
 
-intrusive_ptr_t<ls_block_token_pointee_t> log_serializer_t::generate_block_token(off64_t offset) {
+intrusive_ptr_t<ls_block_token_pointee_t> log_serializer_t::generate_block_token(off64_t offset, uint32_t checksum,
+                                                                                 uint32_t compressed_sectors) {
     assert_thread();
-    return intrusive_ptr_t<ls_block_token_pointee_t>(new ls_block_token_pointee_t(this, offset));
+    return intrusive_ptr_t<ls_block_token_pointee_t>(new ls_block_token_pointee_t(this, offset, checksum, compressed_sectors));
 }
 
 intrusive_ptr_t<ls_block_token_pointee_t>
@@ -594,9 +778,10 @@ log_serializer_t::block_write(const void *buf, block_id_t block_id, file_account
     // TODO: Implement a duration sampler perfmon for this
     ++stats->pm_serializer_block_writes;
 
-    const off64_t offset = data_block_manager->write(buf, block_id, true, io_account, cb, true);
+    uint32_t checksum, compressed_sectors;
+    const off64_t offset = data_block_manager->write(buf, block_id, true, io_account, cb, true, &checksum, &compressed_sectors);
 
-    return generate_block_token(offset);
+    return generate_block_token(offset, checksum, compressed_sectors);
 }
 
 intrusive_ptr_t<ls_block_token_pointee_t>
@@ -743,12 +928,65 @@ intrusive_ptr_t<ls_block_token_pointee_t> log_serializer_t::index_read(block_id_
 
     flagged_off64_t offset = lba_index->get_block_offset(block_id);
     if (offset.has_value()) {
-        return intrusive_ptr_t<ls_block_token_pointee_t>(new ls_block_token_pointee_t(this, offset.get_value()));
+        return generate_block_token(offset.get_value(), lba_index->get_block_checksum(block_id),
+                                    lba_index->get_block_compressed_sectors(block_id));
     } else {
         return intrusive_ptr_t<ls_block_token_pointee_t>();
     }
 }
 
+bool log_serializer_t::delta_read(block_id_t block_id, std::string *delta_out, file_account_t *io_account) {
+    assert_thread();
+    rassert(state == state_ready);
+
+    if (block_id >= lba_index->end_block_id()) {
+        return false;
+    }
+
+    flagged_off64_t delta_offset = lba_index->get_block_delta_offset(block_id);
+    if (!delta_offset.has_value()) {
+        return false;
+    }
+
+    ++stats->pm_serializer_delta_reads;
+    const off64_t offset = delta_offset.get_value();
+    for (std::list<recent_delta_page_t>::iterator it = recent_delta_pages.begin(); it != recent_delta_pages.end(); ++it) {
+        if (it->offset == offset) {
+            recent_delta_pages.splice(recent_delta_pages.begin(), recent_delta_pages, it);
+            const bool found = find_delta_record(it->page, get_block_size(), block_id, delta_out);
+            guarantee(found, "Block %u's delta page has no delta record for it", block_id);
+            return true;
+        }
+    }
+
+    // Delta pages carry their own checksum, which find_delta_record() checks.
+    ++stats->pm_serializer_delta_page_reads;
+    void *page = malloc();
+    block_read(generate_block_token(offset), page, io_account);
+    const bool found = find_delta_record(page, get_block_size(), block_id, delta_out);
+    guarantee(found, "Block %u's delta page has no delta record for it", block_id);
+
+    // Somebody else may have read the page while we did, or it may have become
+    // garbage (and its offset free to be reused) in the meantime.
+    bool keep = delta_page_blocks.find(offset) != delta_page_blocks.end();
+    for (std::list<recent_delta_page_t>::iterator it = recent_delta_pages.begin(); keep && it != recent_delta_pages.end(); ++it) {
+        keep = it->offset != offset;
+    }
+    if (keep) {
+        recent_delta_page_t recent;
+        recent.offset = offset;
+        recent.page = page;
+        recent_delta_pages.push_front(recent);
+        if (recent_delta_pages.size() > DELTA_PAGE_CACHE_PAGES) {
+            free(recent_delta_pages.back().page);
+            recent_delta_pages.pop_back();
+        }
+    } else {
+        free(page);
+    }
+    return true;
+}
+
 bool log_serializer_t::get_delete_bit(block_id_t id) {
     assert_thread();
     rassert(state == state_ready);
@@ -770,6 +1008,9 @@ bool log_serializer_t::shutdown(cond_t *cb) {
     rassert(state == state_ready);
     shutdown_callback = cb;
 
+    // The scrubber reads the LBA and holds extent references, so stop it before anything else.
+    data_block_manager->stop_scrubber();
+
     shutdown_state = shutdown_begin;
     shutdown_in_one_shot = true;
 
@@ -923,13 +1164,37 @@ bool log_serializer_t::offer_buf_to_read_ahead_callbacks(block_id_t block_id, vo
     return false;
 }
 
+void log_serializer_t::register_corruption_cb(serializer_corruption_callback_t *cb) {
+    assert_thread();
+
+    corruption_callbacks.push_back(cb);
+}
+
+void log_serializer_t::unregister_corruption_cb(serializer_corruption_callback_t *cb) {
+    assert_thread();
+
+    std::vector<serializer_corruption_callback_t *>::iterator it = std::find(corruption_callbacks.begin(), corruption_callbacks.end(), cb);
+    rassert(it != corruption_callbacks.end());
+    corruption_callbacks.erase(it);
+}
+
+void log_serializer_t::report_corrupt_block(block_id_t block_id, off64_t offset) {
+    assert_thread();
+    ++stats->pm_serializer_corrupt_blocks;
+    logERR("Block %u at offset %" PRIi64 " of the database file doesn't match its checksum.\n", block_id, offset);
+    for (size_t i = 0; i < corruption_callbacks.size(); ++i) {
+        corruption_callbacks[i]->on_corrupt_block(block_id, offset);
+    }
+}
+
 bool log_serializer_t::should_perform_read_ahead() {
     assert_thread();
     return dynamic_config.read_ahead && !read_ahead_callbacks.empty();
 }
 
-ls_block_token_pointee_t::ls_block_token_pointee_t(log_serializer_t *serializer, off64_t initial_offset)
-    : serializer_(serializer), ref_count_(0) {
+ls_block_token_pointee_t::ls_block_token_pointee_t(log_serializer_t *serializer, off64_t initial_offset, uint32_t checksum,
+                                                   uint32_t compressed_sectors)
+    : serializer_(serializer), ref_count_(0), checksum_(checksum), compressed_sectors_(compressed_sectors) {
     serializer_->assert_thread();
     serializer_->register_block_token(this, initial_offset);
 }
@@ -2,7 +2,9 @@
 #ifndef SERIALIZER_LOG_LOG_SERIALIZER_HPP_
 #define SERIALIZER_LOG_LOG_SERIALIZER_HPP_
 
+#include <list>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -64,6 +66,15 @@ private:
 };
 
 
+// Told about blocks whose contents don't match the checksum in the LBA, when
+// the GC or the scrubber comes across them. Called on the serializer's thread.
+class serializer_corruption_callback_t {
+public:
+    virtual void on_corrupt_block(block_id_t block_id, off64_t offset) = 0;
+protected:
+    virtual ~serializer_corruption_callback_t() { }
+};
+
 // Used internally
 struct ls_start_existing_fsm_t;
 
@@ -116,11 +127,17 @@ public:
 
     void register_read_ahead_cb(serializer_read_ahead_callback_t *cb);
     void unregister_read_ahead_cb(serializer_read_ahead_callback_t *cb);
+
+    // Not part of the serializer_t API: only the log serializer has checksums.
+    void register_corruption_cb(serializer_corruption_callback_t *cb);
+    void unregister_corruption_cb(serializer_corruption_callback_t *cb);
+
     block_id_t max_block_id();
     repli_timestamp_t get_recency(block_id_t id);
 
     bool get_delete_bit(block_id_t id);
     intrusive_ptr_t<ls_block_token_pointee_t> index_read(block_id_t block_id);
+    bool delta_read(block_id_t block_id, std::string *delta_out, file_account_t *io_account);
 
     void block_read(const intrusive_ptr_t<ls_block_token_pointee_t>& token, void *buf, file_account_t *io_account, iocallback_t *cb);
 
@@ -142,9 +159,13 @@ private:
     bool tokens_exist_for_offset(off64_t off);
     void unregister_block_token(ls_block_token_pointee_t *token);
     void remap_block_to_new_offset(off64_t current_offset, off64_t new_offset);
-    intrusive_ptr_t<ls_block_token_pointee_t> generate_block_token(off64_t offset);
+    // Pass the block's checksum if it's known, so that reads through the token check it, and
+    // the number of sectors it takes up if it's compressed.
+    intrusive_ptr_t<ls_block_token_pointee_t> generate_block_token(off64_t offset, uint32_t checksum = 0,
+                                                                   uint32_t compressed_sectors = 0);
 
     bool offer_buf_to_read_ahead_callbacks(block_id_t block_id, void *buf, const intrusive_ptr_t<standard_block_token_t>& token, repli_timestamp_t recency_timestamp);
+    void report_corrupt_block(block_id_t block_id, off64_t offset);
     bool should_perform_read_ahead();
 
     struct index_write_context_t {
@@ -155,6 +176,27 @@ private:
     private:
         DISABLE_COPYING(index_write_context_t);
     };
+    /* The GC moves a delta page by copying it to `new_token` and having
+    index_write_internal() point every block whose delta record is on it at the
+    copy. */
+    struct delta_page_move_t {
+        off64_t old_offset;
+        intrusive_ptr_t<ls_block_token_pointee_t> new_token;
+    };
+
+    /* Writes the delta records of `write_ops` into delta pages. Fills
+    `delta_tokens_out` with the token of the page each op's record went to. */
+    void write_delta_pages(const std::vector<index_write_op_t>& write_ops, file_account_t *io_account,
+                           std::vector<intrusive_ptr_t<ls_block_token_pointee_t> > *delta_tokens_out);
+    void index_write_internal(const std::vector<index_write_op_t>& write_ops,
+                              const std::vector<intrusive_ptr_t<ls_block_token_pointee_t> >& delta_tokens,
+                              const std::vector<delta_page_move_t>& delta_page_moves,
+                              file_account_t *io_account);
+    void add_delta_page_ref(off64_t offset, block_id_t block_id);
+    void remove_delta_page_ref(off64_t offset, block_id_t block_id, extent_transaction_t *txn);
+    // Called when the delta page at `offset` becomes garbage.
+    void forget_recent_delta_page(off64_t offset);
+
     /* Starts a new transaction, updates perfmons etc. */
     void index_write_prepare(index_write_context_t *context, file_account_t *io_account);
     /* Finishes a write transaction */
@@ -191,6 +233,17 @@ private:
 
     std::map<ls_block_token_pointee_t *, off64_t> token_offsets;
     std::multimap<off64_t, ls_block_token_pointee_t *> offset_tokens;
+    // The blocks whose delta records are on each delta page. A delta page is
+    // live in the data block manager exactly when it has an entry here.
+    std::map<off64_t, std::set<block_id_t> > delta_page_blocks;
+    // The last DELTA_PAGE_CACHE_PAGES live delta pages delta_read() read, the
+    // most recently used first. A page at a given offset never changes while
+    // it's live.
+    struct recent_delta_page_t {
+        off64_t offset;
+        void *page;
+    };
+    std::list<recent_delta_page_t> recent_delta_pages;
     scoped_ptr_t<log_serializer_stats_t> stats;
     perfmon_collection_t disk_stats_collection;
     perfmon_membership_t disk_stats_membership;
@@ -202,6 +255,7 @@ private:
 #endif
 
     std::vector<serializer_read_ahead_callback_t *> read_ahead_callbacks;
+    std::vector<serializer_corruption_callback_t *> corruption_callbacks;
 
     const dynamic_config_t dynamic_config;
     static_config_t static_config;
@@ -33,6 +33,23 @@ struct log_serializer_stats_t {
     /* used in serializer/log/lba/lba_list.cc */
     perfmon_counter_t pm_serializer_lba_gcs;
 
+    /* used by the scrubber in serializer/log/data_block_manager.cc */
+    perfmon_counter_t pm_serializer_extents_scrubbed;
+    // Blocks that the GC or the scrubber found not to match their checksums
+    perfmon_counter_t pm_serializer_corrupt_blocks;
+
+    /* used for block compression in serializer/log/data_block_manager.cc */
+    perfmon_duration_sampler_t pm_serializer_block_compressions;
+    perfmon_duration_sampler_t pm_serializer_block_decompressions;
+    // The fraction of the block size that each block we try to compress takes up on disk
+    perfmon_sampler_t pm_serializer_compression_ratio;
+
+    /* used for delta records in serializer/log/log_serializer.cc */
+    perfmon_counter_t pm_serializer_delta_reads;
+    // Delta reads whose delta page wasn't one of the ones we read recently
+    perfmon_counter_t pm_serializer_delta_page_reads;
+    perfmon_counter_t pm_serializer_delta_pages_moved;
+
     perfmon_membership_t parent_collection_membership;
     perfmon_multi_membership_t stats_membership;
 };
@@ -22,6 +22,7 @@ the log serializer. */
 
 struct scs_block_info_t;
 struct scs_persisted_block_info_t;
+class serializer_corruption_callback_t;
 
 template<class inner_serializer_t>
 class semantic_checking_serializer_t :
@@ -68,6 +69,8 @@ public:
 
     block_sequence_id_t get_block_sequence_id(block_id_t block_id, const void* buf) const;
 
+    bool delta_read(block_id_t block_id, std::string *delta_out, file_account_t *io_account);
+
     void index_write(const std::vector<index_write_op_t>& write_ops, file_account_t *io_account);
 
     intrusive_ptr_t< scs_block_token_t<inner_serializer_t> > block_write(const void *buf, block_id_t block_id, file_account_t *io_account, iocallback_t *cb);
@@ -85,6 +88,9 @@ public:
     void register_read_ahead_cb(UNUSED serializer_read_ahead_callback_t *cb);
     void unregister_read_ahead_cb(UNUSED serializer_read_ahead_callback_t *cb);
 
+    void register_corruption_cb(serializer_corruption_callback_t *cb);
+    void unregister_corruption_cb(serializer_corruption_callback_t *cb);
+
 public:
     typedef typename inner_serializer_t::gc_disable_callback_t gc_disable_callback_t;
     bool disable_gc(gc_disable_callback_t *cb);
@@ -203,6 +203,15 @@ get_block_sequence_id(block_id_t block_id, const void* buf) const {
     return inner_serializer.get_block_sequence_id(block_id, buf);
 }
 
+template<class inner_serializer_t>
+bool semantic_checking_serializer_t<inner_serializer_t>::
+delta_read(block_id_t block_id, std::string *delta_out, file_account_t *io_account) {
+    bool found = inner_serializer.delta_read(block_id, delta_out, io_account);
+    guarantee(!found || blocks.get(block_id).state != scs_block_info_t::state_deleted,
+              "Deleted block %u still has a delta record.", block_id);
+    return found;
+}
+
 template<class inner_serializer_t>
 void semantic_checking_serializer_t<inner_serializer_t>::
 index_write(const std::vector<index_write_op_t>& write_ops, file_account_t *io_account) {
@@ -298,6 +307,14 @@ template<class inner_serializer_t>
 void semantic_checking_serializer_t<inner_serializer_t>::
 unregister_read_ahead_cb(UNUSED serializer_read_ahead_callback_t *cb) { }
 
+template<class inner_serializer_t>
+void semantic_checking_serializer_t<inner_serializer_t>::
+register_corruption_cb(serializer_corruption_callback_t *cb) { inner_serializer.register_corruption_cb(cb); }
+
+template<class inner_serializer_t>
+void semantic_checking_serializer_t<inner_serializer_t>::
+unregister_corruption_cb(serializer_corruption_callback_t *cb) { inner_serializer.unregister_corruption_cb(cb); }
+
 template<class inner_serializer_t>
 bool semantic_checking_serializer_t<inner_serializer_t>::
 disable_gc(gc_disable_callback_t *cb) { return inner_serializer.disable_gc(cb); }
@@ -50,6 +50,15 @@ serializer_write_t serializer_write_t::make_delete(block_id_t block_id) {
     return w;
 }
 
+serializer_write_t serializer_write_t::make_delta(block_id_t block_id, repli_timestamp_t recency, const std::string *record) {
+    serializer_write_t w;
+    w.block_id = block_id;
+    w.action_type = DELTA;
+    w.action.delta.record = record;
+    w.action.delta.recency = recency;
+    return w;
+}
+
 struct write_cond_t : public cond_t, public iocallback_t {
     explicit write_cond_t(iocallback_t *cb) : callback(cb) { }
     void on_io_complete() {
@@ -69,14 +78,22 @@ void perform_write(const serializer_write_t *write, serializer_t *ser, file_acco
             write->action.update.launch_callback->on_write_launched(op->token.get());
         }
         op->recency = write->action.update.recency;
+        // The new version of the block supersedes its delta record.
+        op->delta = std::string();
     } break;
     case serializer_write_t::DELETE: {
         op->token = intrusive_ptr_t<standard_block_token_t>();
         op->recency = repli_timestamp_t::invalid;
+        op->delta = std::string();
     } break;
     case serializer_write_t::TOUCH: {
         op->recency = write->action.touch.recency;
     } break;
+    case serializer_write_t::DELTA: {
+        rassert(!write->action.delta.record->empty());
+        op->recency = write->action.delta.recency;
+        op->delta = *write->action.delta.record;
+    } break;
     default:
         unreachable();
     }
@@ -2,6 +2,7 @@
 #ifndef SERIALIZER_SERIALIZER_HPP_
 #define SERIALIZER_SERIALIZER_HPP_
 
+#include <string>
 #include <vector>
 
 #include "utils.hpp"
@@ -17,11 +18,15 @@ struct index_write_op_t {
     // Buf to write. None if not to be modified. Initialized but a null ptr if to be removed from lba.
     boost::optional<intrusive_ptr_t<standard_block_token_t> > token;
     boost::optional<repli_timestamp_t> recency; // Recency, if it should be modified.
+    // Delta record to keep for the block. None if not to be modified. Initialized but empty if
+    // the block's delta record is to be dropped.
+    boost::optional<std::string> delta;
 
     explicit index_write_op_t(block_id_t _block_id,
                               boost::optional<intrusive_ptr_t<standard_block_token_t> > _token = boost::none,
-                              boost::optional<repli_timestamp_t> _recency = boost::none)
-        : block_id(_block_id), token(_token), recency(_recency) { }
+                              boost::optional<repli_timestamp_t> _recency = boost::none,
+                              boost::optional<std::string> _delta = boost::none)
+        : block_id(_block_id), token(_token), recency(_recency), delta(_delta) { }
 };
 
 /* serializer_t is an abstract interface that describes how each serializer should
@@ -68,7 +73,10 @@ public:
     /* The index stores three pieces of information for each ID:
      * 1. A pointer to a data block on disk (which may be NULL)
      * 2. A repli_timestamp_t, called the "recency"
-     * 3. A boolean, called the "delete bit" */
+     * 3. A boolean, called the "delete bit"
+     * 4. An opaque string, called the "delta record", which is written in the log next to
+     *    other blocks' delta records instead of by rewriting the block. The buffer cache
+     *    keeps the patches it hasn't applied to the block on disk yet there. */
 
     /* max_block_id() and get_delete_bit() are used by the buffer cache to reconstruct
     the free list of unused block IDs. */
@@ -88,6 +96,9 @@ public:
     /* Reads the block's actual data */
     virtual intrusive_ptr_t<standard_block_token_t> index_read(block_id_t block_id) = 0;
 
+    /* Reads the block's delta record. Returns false if the block doesn't have one. */
+    virtual bool delta_read(block_id_t block_id, std::string *delta_out, file_account_t *io_account) = 0;
+
     /* index_write() applies all given index operations in an atomic way */
     virtual void index_write(const std::vector<index_write_op_t>& write_ops, file_account_t *io_account) = 0;
 
@@ -117,7 +128,7 @@ struct serializer_write_launched_callback_t {
 struct serializer_write_t {
     block_id_t block_id;
 
-    enum { UPDATE, DELETE, TOUCH } action_type;
+    enum { UPDATE, DELETE, TOUCH, DELTA } action_type;
     union {
         struct {
             const void *buf;
@@ -128,6 +139,10 @@ struct serializer_write_t {
         struct {
             repli_timestamp_t recency;
         } touch;
+        struct {
+            const std::string *record;
+            repli_timestamp_t recency;
+        } delta;
     } action;
 
     static serializer_write_t make_touch(block_id_t block_id, repli_timestamp_t recency);
@@ -135,6 +150,9 @@ struct serializer_write_t {
                                           iocallback_t *io_callback = NULL,
                                           serializer_write_launched_callback_t *launch_callback = NULL);
     static serializer_write_t make_delete(block_id_t block_id);
+    // Replaces the block's delta record with `*record`, which must stay valid until
+    // do_writes() returns. The block's data is left alone.
+    static serializer_write_t make_delta(block_id_t block_id, repli_timestamp_t recency, const std::string *record);
 };
 
 /* A bad wrapper for doing block writes and index writes.
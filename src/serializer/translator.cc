@@ -242,6 +242,10 @@ intrusive_ptr_t<standard_block_token_t> translator_serializer_t::index_read(bloc
     return inner->index_read(translate_block_id(block_id));
 }
 
+bool translator_serializer_t::delta_read(block_id_t block_id, std::string *delta_out, file_account_t *io_account) {
+    return inner->delta_read(translate_block_id(block_id), delta_out, io_account);
+}
+
 block_sequence_id_t translator_serializer_t::get_block_sequence_id(block_id_t block_id, const void* buf) const {
     return inner->get_block_sequence_id(translate_block_id(block_id), buf);
 }
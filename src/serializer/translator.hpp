@@ -144,6 +144,7 @@ public:
     void block_read(const intrusive_ptr_t<standard_block_token_t>& token, void *buf, file_account_t *io_account, iocallback_t *cb);
     void block_read(const intrusive_ptr_t<standard_block_token_t>& token, void *buf, file_account_t *io_account);
     intrusive_ptr_t<standard_block_token_t> index_read(block_id_t block_id);
+    bool delta_read(block_id_t block_id, std::string *delta_out, file_account_t *io_account);
 
 public:
     bool offer_read_ahead_buf(block_id_t block_id, void *buf, const intrusive_ptr_t<standard_block_token_t>& token, repli_timestamp_t recency_timestamp);
@@ -58,15 +58,27 @@ template <class serializer_type> struct serializer_traits_t;
 class log_serializer_t;
 
 class ls_block_token_pointee_t {
+public:
+    // How many sectors the block takes up if it's stored compressed, or 0 if it isn't.
+    uint32_t compressed_sectors() const { return compressed_sectors_; }
+
+private:
     friend class log_serializer_t;
     friend class dbm_read_ahead_fsm_t;  // For read-ahead tokens.
 
     friend void adjust_ref(ls_block_token_pointee_t *p, int adjustment);
 
-    ls_block_token_pointee_t(log_serializer_t *serializer, off64_t initial_offset);
+    ls_block_token_pointee_t(log_serializer_t *serializer, off64_t initial_offset, uint32_t checksum,
+                             uint32_t compressed_sectors);
 
     log_serializer_t *serializer_;
     int64_t ref_count_;
+    // The CRC-32C the block's contents must have, or 0 if we don't know it. The
+    // GC copies blocks verbatim, so this stays right when the token is remapped.
+    uint32_t checksum_;
+    // How many sectors the block takes up if it's stored compressed, or 0 if it
+    // isn't. The checksum is that of the block after decompressing it.
+    uint32_t compressed_sectors_;
 
     void do_destroy();
 
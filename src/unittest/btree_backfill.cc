@@ -0,0 +1,72 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <set>
+
+#include "btree/backfill.hpp"
+#include "btree/operations.hpp"
+#include "unittest/bulk_load_test_tree.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+// Checks that a backfill only reports a range as done once every key in it
+// has been sent.
+class checking_backfill_callback_t : public agnostic_backfill_callback_t {
+public:
+    explicit checking_backfill_callback_t(int num_keys) : num_keys_(num_keys), num_reports(0) { }
+
+    void on_delete_range(UNUSED const key_range_t &range, UNUSED signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) { }
+
+    void on_deletion(UNUSED const btree_key_t *key, UNUSED repli_timestamp_t recency, UNUSED signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) { }
+
+    void on_pair(UNUSED transaction_t *txn, UNUSED repli_timestamp_t recency, const btree_key_t *key, UNUSED const void *value, UNUSED signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        sent.insert(store_key_t(key));
+    }
+
+    void on_range_done(const key_range_t &range, UNUSED signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        EXPECT_TRUE(range.is_superset(done));
+        done = range;
+        ++num_reports;
+        for (int i = 0; i < num_keys_; ++i) {
+            store_key_t key(bulk_load_key(i));
+            if (range.contains_key(key)) {
+                EXPECT_TRUE(sent.count(key) == 1) << bulk_load_key(i);
+            }
+        }
+    }
+
+    int num_keys_;
+    std::set<store_key_t> sent;
+    key_range_t done;
+    int num_reports;
+};
+
+/* `Checkpoints` backfills a bulk loaded tree and checks that every range it
+reports as done has had all of its keys sent, and that there are reports
+before the end. */
+void run_backfill_checkpoints_test() {
+    bulk_load_test_tree_t tree;
+
+    const int num_keys = 50000;
+    tree.load(0, num_keys);
+
+    scoped_ptr_t<transaction_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    get_btree_superblock_and_txn_for_backfilling(tree.btree.get(), tree.order_source.check_in("btree backfill unittest"), &superblock, &txn);
+
+    checking_backfill_callback_t callback(num_keys);
+    cond_t non_interruptor;
+    do_agnostic_btree_backfill(tree.sizer.get(), tree.btree.get(), key_range_t::universe(), repli_timestamp_t::distant_past,
+                               &callback, txn.get(), superblock.get(), NULL, &non_interruptor);
+
+    EXPECT_EQ(static_cast<size_t>(num_keys), callback.sent.size());
+    EXPECT_TRUE(callback.done == key_range_t::universe());
+    // The tree has enough leaves for the backfill to report progress
+    // before it gets to the end.
+    EXPECT_LT(1, callback.num_reports);
+}
+
+TEST(BtreeBackfill, Checkpoints) {
+    mock::run_in_thread_pool(&run_backfill_checkpoints_test);
+}
+
+}   /* namespace unittest */
@@ -0,0 +1,67 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "unittest/gtest.hpp"
+
+#include <algorithm>
+
+#include "btree/node.hpp"
+#include "btree/operations.hpp"
+#include "unittest/bulk_load_test_tree.hpp"
+
+namespace unittest {
+
+void run_bulk_load_test() {
+    bulk_load_test_tree_t tree;
+
+    // Enough keys for a tree three levels deep.
+    const int num_keys = 50000;
+    tree.load(0, num_keys);
+    tree.check(num_keys);
+
+    {
+        scoped_ptr_t<transaction_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        get_btree_superblock_and_txn_for_reading(tree.btree.get(), rwi_read, tree.order_source.check_in("bulk load unittest"),
+                                                 CACHE_SNAPSHOTTED_NO, &superblock, &txn);
+        buf_lock_t root_buf(txn.get(), superblock->get_root_block_id(), rwi_read);
+        EXPECT_TRUE(node::is_internal(reinterpret_cast<const node_t *>(root_buf.get_data_read())));
+    }
+}
+
+TEST(BtreeBulkLoad, BuildAndLookup) {
+    mock::run_in_thread_pool(&run_bulk_load_test);
+}
+
+void run_bulk_load_right_edge_test() {
+    // However many keys there are, the last nodes of each level get
+    // rebalanced against the ones before them.
+    const int num_keys[] = { 1, 2, 90, 91, 180, 181, 1000, 7777, 20001 };
+    for (size_t i = 0; i < sizeof(num_keys) / sizeof(num_keys[0]); ++i) {
+        SCOPED_TRACE(num_keys[i]);
+        bulk_load_test_tree_t tree;
+        tree.load(0, num_keys[i]);
+        tree.check(num_keys[i]);
+    }
+}
+
+TEST(BtreeBulkLoad, RightEdge) {
+    mock::run_in_thread_pool(&run_bulk_load_right_edge_test);
+}
+
+void run_bulk_load_append_test() {
+    bulk_load_test_tree_t tree;
+
+    // Batches the size of a backfill's, each appended to the right edge the
+    // last one left.
+    const int num_keys = 20000;
+    tree.load(0, 1);
+    for (int beg = 1; beg < num_keys; beg += 64) {
+        tree.load(beg, std::min(beg + 64, num_keys));
+    }
+    tree.check(num_keys);
+}
+
+TEST(BtreeBulkLoad, Append) {
+    mock::run_in_thread_pool(&run_bulk_load_append_test);
+}
+
+}   /* namespace unittest */
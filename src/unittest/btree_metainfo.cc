@@ -181,4 +181,79 @@ TEST(BtreeMetainfo, MetainfoTest) {
     mock::run_in_thread_pool(&run_metainfo_test);
 }
 
+typedef std::vector<std::pair<std::vector<char>, std::vector<char> > > metainfo_pairs_t;
+
+metainfo_pairs_t read_metainfo(btree_slice_t *btree, order_source_t *order_source) {
+    scoped_ptr_t<transaction_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    get_btree_superblock_and_txn_for_reading(btree, rwi_read, order_source->check_in("read_metainfo").with_read_mode(),
+                                             CACHE_SNAPSHOTTED_NO, &superblock, &txn);
+    metainfo_pairs_t pairs;
+    get_superblock_metainfo(txn.get(), superblock->get(), &pairs);
+    return pairs;
+}
+
+void run_metainfo_on_release_test() {
+    mock::temp_file_t temp_file("/tmp/rdb_unittest.XXXXXX");
+
+    scoped_ptr_t<io_backender_t> io_backender;
+    make_io_backender(aio_default, &io_backender);
+
+    filepath_file_opener_t file_opener(temp_file.name(), io_backender.get());
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    mirrored_cache_static_config_t cache_static_config;
+    cache_t::create(&serializer, &cache_static_config);
+
+    mirrored_cache_config_t cache_dynamic_config;
+    cache_t cache(&serializer, &cache_dynamic_config, &get_global_perfmon_collection());
+
+    btree_slice_t::create(&cache);
+
+    btree_slice_t btree(&cache, &get_global_perfmon_collection());
+
+    order_source_t order_source;
+
+    metainfo_pairs_t old_pairs;
+    old_pairs.push_back(std::make_pair(string_to_vector("a"), string_to_vector("old")));
+    {
+        scoped_ptr_t<transaction_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        get_btree_superblock_and_txn(&btree, rwi_write, 1, repli_timestamp_t::invalid,
+                                     order_source.check_in("run_metainfo_on_release_test"), &superblock, &txn);
+        set_superblock_metainfo(txn.get(), superblock->get(), old_pairs);
+    }
+
+    metainfo_pairs_t new_pairs;
+    new_pairs.push_back(std::make_pair(string_to_vector("a"), string_to_vector("new")));
+    new_pairs.push_back(std::make_pair(string_to_vector("b"), string_to_vector(std::string(5000, 'b'))));
+    {
+        scoped_ptr_t<transaction_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        get_btree_superblock_and_txn(&btree, rwi_intent, 1, repli_timestamp_t::invalid,
+                                     order_source.check_in("run_metainfo_on_release_test"), &superblock, &txn);
+        superblock->set_metainfo_on_release(txn.get(), new_pairs);
+
+        // The writer only has the superblock with rwi_intent, so a reader can
+        // still get at it, and it sees the old metainfo.
+        EXPECT_TRUE(old_pairs == read_metainfo(&btree, &order_source));
+
+        superblock->release();
+        EXPECT_FALSE(superblock->get()->is_acquired());
+    }
+
+    EXPECT_TRUE(new_pairs == read_metainfo(&btree, &order_source));
+}
+
+TEST(BtreeMetainfo, MetainfoOnRelease) {
+    mock::run_in_thread_pool(&run_metainfo_on_release_test);
+}
+
 }   /* namespace unittest */
@@ -0,0 +1,136 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "unittest/bulk_load_test_tree.hpp"
+
+#include "arch/io/disk.hpp"
+#include "btree/bulk_load.hpp"
+#include "btree/internal_node.hpp"
+#include "btree/operations.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+std::string bulk_load_key(int i) {
+    return strprintf("key%08d", i);
+}
+
+std::string bulk_load_value(int i) {
+    return std::string(i % 50, 'a' + i % 26);
+}
+
+bool bulk_load_lookup(value_sizer_t<void> *sizer, transaction_t *txn, block_id_t root, const std::string &key, std::string *value_out) {
+    store_key_t store_key(key);
+    block_id_t node_id = root;
+    for (;;) {
+        buf_lock_t buf(txn, node_id, rwi_read);
+        const node_t *node = reinterpret_cast<const node_t *>(buf.get_data_read());
+        if (node::is_internal(node)) {
+            node_id = internal_node::lookup(reinterpret_cast<const internal_node_t *>(node), store_key.btree_key());
+        } else {
+            uint8_t value[256];
+            if (!leaf::lookup(sizer, reinterpret_cast<const leaf_node_t *>(node), store_key.btree_key(), value)) {
+                return false;
+            }
+            *value_out = std::string(reinterpret_cast<const char *>(value + 1), value[0]);
+            return true;
+        }
+    }
+}
+
+bulk_load_test_tree_t::bulk_load_test_tree_t() : temp_file("/tmp/rdb_unittest.XXXXXX") {
+    make_io_backender(aio_default, &io_backender);
+
+    file_opener.init(new filepath_file_opener_t(temp_file.name(), io_backender.get()));
+    standard_serializer_t::create(file_opener.get(), standard_serializer_t::static_config_t());
+    serializer.init(new standard_serializer_t(standard_serializer_t::dynamic_config_t(),
+                                              file_opener.get(),
+                                              &get_global_perfmon_collection()));
+
+    mirrored_cache_static_config_t cache_static_config;
+    cache_t::create(serializer.get(), &cache_static_config);
+    cache.init(new cache_t(serializer.get(), &cache_dynamic_config, &get_global_perfmon_collection()));
+
+    btree_slice_t::create(cache.get());
+    btree.init(new btree_slice_t(cache.get(), &get_global_perfmon_collection()));
+
+    sizer.init(new bulk_load_value_sizer_t(cache->get_block_size()));
+}
+
+bulk_load_test_tree_t::~bulk_load_test_tree_t() { }
+
+void bulk_load_test_tree_t::load(int beg, int end) {
+    scoped_ptr_t<transaction_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    get_btree_superblock_and_txn(btree.get(), rwi_write, 1, repli_timestamp_t::distant_past,
+                                 order_source.check_in("bulk load unittest"), &superblock, &txn);
+
+    btree_bulk_loader_t loader(sizer.get(), txn.get(), superblock.get(), repli_timestamp_t::distant_past);
+    for (int i = beg; i < end; ++i) {
+        store_key_t key(bulk_load_key(i));
+        ASSERT_TRUE(loader.accepts(key.btree_key())) << bulk_load_key(i);
+        std::string value = bulk_load_value(i);
+        uint8_t buf[256];
+        buf[0] = value.size();
+        memcpy(buf + 1, value.data(), value.size());
+        loader.add(key.btree_key(), buf);
+    }
+    if (beg > 0) {
+        // Nothing can go below what's already there.
+        EXPECT_FALSE(loader.accepts(store_key_t(bulk_load_key(beg - 1)).btree_key()));
+    }
+    loader.finish();
+    EXPECT_EQ(end - beg, loader.population());
+}
+
+void bulk_load_test_tree_t::check(int num_keys) {
+    scoped_ptr_t<transaction_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    get_btree_superblock_and_txn_for_reading(btree.get(), rwi_read, order_source.check_in("bulk load unittest"),
+                                             CACHE_SNAPSHOTTED_NO, &superblock, &txn);
+
+    block_id_t root = superblock->get_root_block_id();
+    ASSERT_NE(NULL_BLOCK_ID, root);
+    {
+        buf_lock_t stat_block(txn.get(), superblock->get_stat_block_id(), rwi_read);
+        EXPECT_EQ(num_keys, reinterpret_cast<const btree_statblock_t *>(stat_block.get_data_read())->population);
+    }
+
+    int next_key = 0;
+    check_subtree(txn.get(), root, true, &next_key);
+    EXPECT_EQ(num_keys, next_key);
+
+    for (int i = 0; i < num_keys; i += 7) {
+        std::string value;
+        ASSERT_TRUE(bulk_load_lookup(sizer.get(), txn.get(), root, bulk_load_key(i), &value)) << bulk_load_key(i);
+        EXPECT_EQ(bulk_load_value(i), value);
+    }
+    std::string value;
+    EXPECT_TRUE(bulk_load_lookup(sizer.get(), txn.get(), root, bulk_load_key(num_keys - 1), &value));
+    EXPECT_FALSE(bulk_load_lookup(sizer.get(), txn.get(), root, bulk_load_key(num_keys), &value));
+    EXPECT_FALSE(bulk_load_lookup(sizer.get(), txn.get(), root, "key", &value));
+}
+
+void bulk_load_test_tree_t::check_subtree(transaction_t *txn, block_id_t node_id, bool is_root, int *next_key) {
+    buf_lock_t buf(txn, node_id, rwi_read);
+    const node_t *node = reinterpret_cast<const node_t *>(buf.get_data_read());
+    if (node::is_internal(node)) {
+        const internal_node_t *internal = reinterpret_cast<const internal_node_t *>(node);
+        if (!is_root) {
+            EXPECT_FALSE(internal_node::is_underfull(cache->get_block_size(), internal)) << "internal node " << node_id;
+        }
+        EXPECT_LE(2, internal->npairs) << "internal node " << node_id;
+        for (int i = 0; i < internal->npairs; ++i) {
+            check_subtree(txn, internal_node::get_pair_by_index(internal, i)->lnode, false, next_key);
+        }
+    } else {
+        const leaf_node_t *leaf = reinterpret_cast<const leaf_node_t *>(node);
+        if (!is_root) {
+            EXPECT_FALSE(leaf::is_underfull(sizer.get(), leaf)) << "leaf " << node_id;
+        }
+        for (leaf::live_iter_t it = leaf::iter_for_whole_leaf(sizer.get(), leaf); it.get_key(leaf) != NULL; it.step(leaf)) {
+            EXPECT_EQ(store_key_t(bulk_load_key(*next_key)), store_key_t(it.get_key(leaf)));
+            ++*next_key;
+        }
+    }
+}
+
+}  // namespace unittest
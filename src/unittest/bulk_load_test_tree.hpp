@@ -0,0 +1,96 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#ifndef UNITTEST_BULK_LOAD_TEST_TREE_HPP_
+#define UNITTEST_BULK_LOAD_TEST_TREE_HPP_
+
+#include <string>
+
+#include "btree/node.hpp"
+#include "btree/slice.hpp"
+#include "buffer_cache/buffer_cache.hpp"
+#include "containers/scoped.hpp"
+#include "mock/unittest_utils.hpp"
+#include "serializer/config.hpp"
+
+class filepath_file_opener_t;
+class io_backender_t;
+
+namespace unittest {
+
+// A value is a length byte followed by that many bytes.
+class bulk_load_value_sizer_t : public value_sizer_t<void> {
+public:
+    explicit bulk_load_value_sizer_t(block_size_t bs) : block_size_(bs) { }
+
+    int size(const void *value) const {
+        return 1 + *reinterpret_cast<const uint8_t *>(value);
+    }
+
+    bool fits(const void *value, int length_available) const {
+        return length_available > 0 && size(value) <= length_available;
+    }
+
+    bool deep_fsck(UNUSED block_getter_t *getter, const void *value, int length_available, std::string *msg_out) const {
+        if (!fits(value, length_available)) {
+            *msg_out = strprintf("value does not fit within %d", length_available);
+            return false;
+        }
+        return true;
+    }
+
+    int max_possible_size() const {
+        return 256;
+    }
+
+    block_magic_t btree_leaf_magic() const {
+        block_magic_t magic = { { 'b', 'l', 'L', 'F' } };
+        return magic;
+    }
+
+    block_size_t block_size() const { return block_size_; }
+
+private:
+    block_size_t block_size_;
+
+    DISABLE_COPYING(bulk_load_value_sizer_t);
+};
+
+std::string bulk_load_key(int i);
+std::string bulk_load_value(int i);
+
+// Looks `key` up the way a read descends the tree.
+bool bulk_load_lookup(value_sizer_t<void> *sizer, transaction_t *txn, block_id_t root, const std::string &key, std::string *value_out);
+
+// A btree in a fresh file, which the bulk loader and backfill tests fill
+// with keys made by `bulk_load_key()`.
+class bulk_load_test_tree_t {
+public:
+    bulk_load_test_tree_t();
+    ~bulk_load_test_tree_t();
+
+    // Bulk loads the keys numbered `beg` to `end`, in one transaction.
+    void load(int beg, int end);
+
+    // Checks that the tree holds the first `num_keys` keys with the right
+    // values and population, and that no node but the root is underfull or
+    // an internal node with a single child.
+    void check(int num_keys);
+
+    mock::temp_file_t temp_file;
+    scoped_ptr_t<io_backender_t> io_backender;
+    scoped_ptr_t<filepath_file_opener_t> file_opener;
+    scoped_ptr_t<standard_serializer_t> serializer;
+    mirrored_cache_config_t cache_dynamic_config;
+    scoped_ptr_t<cache_t> cache;
+    scoped_ptr_t<btree_slice_t> btree;
+    scoped_ptr_t<bulk_load_value_sizer_t> sizer;
+    order_source_t order_source;
+
+private:
+    void check_subtree(transaction_t *txn, block_id_t node_id, bool is_root, int *next_key);
+
+    DISABLE_COPYING(bulk_load_test_tree_t);
+};
+
+}  // namespace unittest
+
+#endif  // UNITTEST_BULK_LOAD_TEST_TREE_HPP_
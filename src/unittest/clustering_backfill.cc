@@ -164,4 +164,186 @@ TEST(ClusteringBackfill, BackfillTest) {
     mock::run_in_thread_pool(&run_backfill_test);
 }
 
+namespace {
+
+/* Passes everything through to `inner`, but remembers which keys it received
+chunks for, and pulses `interruptor` after the `interrupt_after`th call to
+`set_metainfo()`. */
+class checkpoint_interrupting_store_t : public store_subview_t<dummy_protocol_t> {
+public:
+    checkpoint_interrupting_store_t(store_view_t<dummy_protocol_t> *inner, int _interrupt_after, cond_t *_interruptor)
+        : store_subview_t<dummy_protocol_t>(inner, inner->get_region()),
+          interrupt_after(_interrupt_after), interruptor_to_pulse(_interruptor), num_set_metainfos(0) { }
+
+    void set_metainfo(const metainfo_t &new_metainfo,
+                      order_token_t order_token,
+                      object_buffer_t<fifo_enforcer_sink_t::exit_write_t> *token,
+                      signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        store_subview_t<dummy_protocol_t>::set_metainfo(new_metainfo, order_token, token, interruptor);
+        if (++num_set_metainfos == interrupt_after) {
+            interruptor_to_pulse->pulse_if_not_already_pulsed();
+        }
+    }
+
+    void receive_backfill(const std::vector<dummy_protocol_t::backfill_chunk_t> &chunks,
+                          object_buffer_t<fifo_enforcer_sink_t::exit_write_t> *token,
+                          signal_t *interruptor) THROWS_ONLY(interrupted_exc_t) {
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            received_keys.insert(chunks[i].key);
+        }
+        store_subview_t<dummy_protocol_t>::receive_backfill(chunks, token, interruptor);
+    }
+
+    std::set<std::string> received_keys;
+
+private:
+    int interrupt_after;
+    cond_t *interruptor_to_pulse;
+    int num_set_metainfos;
+};
+
+region_map_t<dummy_protocol_t, version_range_t> get_version_map(store_view_t<dummy_protocol_t> *store, order_source_t *order_source) {
+    object_buffer_t<fifo_enforcer_sink_t::exit_read_t> token;
+    store->new_read_token(&token);
+    cond_t non_interruptor;
+    region_map_t<dummy_protocol_t, binary_blob_t> metainfo;
+    store->do_get_metainfo(order_source->check_in("get_version_map").with_read_mode(), &token, &non_interruptor, &metainfo);
+    return region_map_transform<dummy_protocol_t, binary_blob_t, version_range_t>(metainfo, &binary_blob_t::get<version_range_t>);
+}
+
+}   /* anonymous namespace */
+
+/* `ResumeFromCheckpoint` cuts a backfill off right after the backfillee has
+recorded its first checkpoint, and checks that the next backfill picks up from
+there: the checkpointed part of the region is already at the backfiller's
+version, and nothing in it gets sent again. */
+void run_resume_from_checkpoint_test() {
+    order_source_t order_source;
+
+    dummy_protocol_t::region_t region('a', 'z');
+    dummy_protocol_t::store_t backfiller_store;
+    dummy_protocol_t::store_t backfillee_store;
+
+    mock::in_memory_branch_history_manager_t<mock::dummy_protocol_t> branch_history_manager;
+    branch_id_t branch_id = generate_uuid();
+    {
+        branch_birth_certificate_t<dummy_protocol_t> branch;
+        branch.region = region;
+        branch.initial_timestamp = state_timestamp_t::zero();
+        branch.origin = region_map_t<dummy_protocol_t, version_range_t>(
+            region, version_range_t(version_t(nil_uuid(), state_timestamp_t::zero())));
+        cond_t non_interruptor;
+        branch_history_manager.create_branch(branch_id, branch, &non_interruptor);
+    }
+
+    // The backfillee's metainfo comes in two parts, so the backfiller sends
+    // two checkpoints.
+    state_timestamp_t timestamp = state_timestamp_t::zero();
+    binary_blob_t initial_version(version_range_t(version_t(branch_id, timestamp)));
+    std::vector<std::pair<dummy_protocol_t::region_t, binary_blob_t> > halves;
+    halves.push_back(std::make_pair(dummy_protocol_t::region_t('a', 'm'), initial_version));
+    halves.push_back(std::make_pair(dummy_protocol_t::region_t('n', 'z'), initial_version));
+    {
+        cond_t non_interruptor;
+        object_buffer_t<fifo_enforcer_sink_t::exit_write_t> token;
+        backfiller_store.new_write_token(&token);
+        backfiller_store.set_metainfo(region_map_t<dummy_protocol_t, binary_blob_t>(region, initial_version),
+                                      order_source.check_in("set_metainfo(backfiller)"), &token, &non_interruptor);
+        backfillee_store.new_write_token(&token);
+        backfillee_store.set_metainfo(region_map_t<dummy_protocol_t, binary_blob_t>(halves.begin(), halves.end()),
+                                      order_source.check_in("set_metainfo(backfillee)"), &token, &non_interruptor);
+    }
+
+    // Write every key, so that both halves have something to send.
+    for (char c = 'a'; c <= 'z'; c++) {
+        dummy_protocol_t::write_t w;
+        dummy_protocol_t::write_response_t response;
+        w.values[std::string(1, c)] = strprintf("%c", c);
+
+        transition_timestamp_t ts = transition_timestamp_t::starting_from(timestamp);
+        timestamp = ts.timestamp_after();
+
+        cond_t non_interruptor;
+        object_buffer_t<fifo_enforcer_sink_t::exit_write_t> token;
+        backfiller_store.new_write_token(&token);
+#ifndef NDEBUG
+        mock::equality_metainfo_checker_callback_t<dummy_protocol_t>
+            metainfo_checker_callback(binary_blob_t(version_range_t(version_t(branch_id, ts.timestamp_before()))));
+        metainfo_checker_t<dummy_protocol_t> metainfo_checker(&metainfo_checker_callback, region);
+#endif
+        backfiller_store.write(
+            DEBUG_ONLY(metainfo_checker, )
+            region_map_t<dummy_protocol_t, binary_blob_t>(region, binary_blob_t(version_range_t(version_t(branch_id, timestamp)))),
+            w, &response, ts,
+            order_source.check_in("backfiller_store.write"),
+            &token,
+            &non_interruptor);
+    }
+    const version_range_t end_version(version_t(branch_id, timestamp));
+
+    mock::simple_mailbox_cluster_t cluster;
+    backfiller_t<dummy_protocol_t> backfiller(cluster.get_mailbox_manager(), &branch_history_manager, &backfiller_store);
+    watchable_variable_t<boost::optional<backfiller_business_card_t<dummy_protocol_t> > > pseudo_directory(
+        boost::optional<backfiller_business_card_t<dummy_protocol_t> >(backfiller.get_business_card()));
+
+    /* The first `set_metainfo()` marks the whole region as being backfilled;
+    the second is the first checkpoint. */
+    std::set<std::string> checkpointed_keys;
+    {
+        cond_t interruptor;
+        checkpoint_interrupting_store_t store(&backfillee_store, 2, &interruptor);
+        try {
+            backfillee<dummy_protocol_t>(
+                cluster.get_mailbox_manager(),
+                &branch_history_manager,
+                &store,
+                store.get_region(),
+                pseudo_directory.get_watchable()->subview(&wrap_in_optional),
+                generate_uuid(),
+                &interruptor);
+        } catch (interrupted_exc_t) {
+        }
+        ASSERT_TRUE(interruptor.is_pulsed());
+
+        region_map_t<dummy_protocol_t, version_range_t> versions = get_version_map(&backfillee_store, &order_source);
+        for (region_map_t<dummy_protocol_t, version_range_t>::const_iterator it = versions.begin(); it != versions.end(); ++it) {
+            if (it->second == end_version) {
+                checkpointed_keys.insert(it->first.keys.begin(), it->first.keys.end());
+            }
+        }
+        ASSERT_FALSE(checkpointed_keys.empty());
+    }
+
+    {
+        cond_t interruptor;
+        checkpoint_interrupting_store_t store(&backfillee_store, -1, &interruptor);
+        backfillee<dummy_protocol_t>(
+            cluster.get_mailbox_manager(),
+            &branch_history_manager,
+            &store,
+            store.get_region(),
+            pseudo_directory.get_watchable()->subview(&wrap_in_optional),
+            generate_uuid(),
+            &interruptor);
+
+        // Whatever wasn't checkpointed starts over from the old version.
+        for (char c = 'a'; c <= 'z'; c++) {
+            std::string key(1, c);
+            EXPECT_NE(checkpointed_keys.count(key), store.received_keys.count(key)) << key;
+        }
+    }
+
+    for (char c = 'a'; c <= 'z'; c++) {
+        std::string key(1, c);
+        EXPECT_EQ(backfiller_store.values[key], backfillee_store.values[key]);
+    }
+    region_map_t<dummy_protocol_t, version_range_t> versions = get_version_map(&backfillee_store, &order_source);
+    for (region_map_t<dummy_protocol_t, version_range_t>::const_iterator it = versions.begin(); it != versions.end(); ++it) {
+        EXPECT_TRUE(it->second == end_version);
+    }
+}
+TEST(ClusteringBackfill, ResumeFromCheckpoint) {
+    mock::run_in_thread_pool(&run_resume_from_checkpoint_test);
+}
+
 }   /* namespace unittest */
@@ -0,0 +1,75 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "serializer/log/compressed_block.hpp"
+#include "unittest/gtest.hpp"
+#include "utils.hpp"
+
+namespace unittest {
+
+static const block_size_t block_size = block_size_t::unsafe_make(4 * DEVICE_BLOCK_SIZE);
+
+static ls_buf_data_t *make_block(std::vector<char> *storage, const std::string &contents) {
+    storage->assign(block_size.ser_value(), 0);
+    ls_buf_data_t *block = reinterpret_cast<ls_buf_data_t *>(&(*storage)[0]);
+    block->block_id = 17;
+    block->block_sequence_id = 123;
+    memcpy(block + 1, contents.data(), std::min<size_t>(contents.size(), block_size.value()));
+    return block;
+}
+
+TEST(CompressedBlockTest, RoundTrip) {
+    std::string json;
+    while (json.size() < block_size.value()) {
+        json += strprintf("{\"id\": %zu, \"name\": \"user%zu\"}, ", json.size(), json.size());
+    }
+    std::vector<char> storage;
+    ls_buf_data_t *block = make_block(&storage, json);
+
+    std::vector<char> image(block_size.ser_value());
+    const uint32_t sectors = compress_block(block, block_size, &image[0]);
+    ASSERT_LT(0u, sectors);
+    ASSERT_GT(block_size.ser_value() / DEVICE_BLOCK_SIZE, sectors);
+
+    // The block id is where it is on an uncompressed block.
+    EXPECT_EQ(17u, reinterpret_cast<ls_buf_data_t *>(&image[0])->block_id);
+
+    std::vector<char> out(block_size.ser_value());
+    ASSERT_TRUE(decompress_block(&image[0], sectors, block_size, &out[0]));
+    EXPECT_EQ(0, memcmp(&out[0], block, block_size.ser_value()));
+}
+
+TEST(CompressedBlockTest, IncompressibleBlocks) {
+    std::string noise;
+    for (size_t i = 0; i < block_size.value(); ++i) {
+        noise += static_cast<char>(randint(256));
+    }
+    std::vector<char> storage;
+    std::vector<char> image(block_size.ser_value());
+    EXPECT_EQ(0u, compress_block(make_block(&storage, noise), block_size, &image[0]));
+
+    // A block that's a single sector can't get any smaller.
+    const block_size_t small_size = block_size_t::unsafe_make(DEVICE_BLOCK_SIZE);
+    std::vector<char> small(small_size.ser_value(), 0);
+    EXPECT_EQ(0u, compress_block(&small[0], small_size, &image[0]));
+}
+
+TEST(CompressedBlockTest, DetectsCorruption) {
+    std::vector<char> storage;
+    ls_buf_data_t *block = make_block(&storage, std::string(1000, 'x'));
+    std::vector<char> image(block_size.ser_value());
+    const uint32_t sectors = compress_block(block, block_size, &image[0]);
+    ASSERT_EQ(1u, sectors);
+
+    std::vector<char> out(block_size.ser_value());
+    ls_compressed_block_header_t *header = reinterpret_cast<ls_compressed_block_header_t *>(&image[0]);
+    header->compressed_size = DEVICE_BLOCK_SIZE;
+    EXPECT_FALSE(decompress_block(&image[0], sectors, block_size, &out[0]));
+    header->compressed_size = 3;
+    EXPECT_FALSE(decompress_block(&image[0], sectors, block_size, &out[0]));
+}
+
+}  // namespace unittest
@@ -0,0 +1,100 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <string.h>
+
+#include <string>
+
+#include "containers/crc32c.hpp"
+#include "serializer/log/lba/disk_format.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+// The bit-at-a-time definition, to check the fast versions against.
+static uint32_t reference_crc32c(const std::string &s) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < s.size(); ++i) {
+        crc ^= static_cast<uint8_t>(s[i]);
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (crc & 1 ? 0x82F63B78 : 0);
+        }
+    }
+    return ~crc;
+}
+
+typedef uint32_t (*crc32c_fn_t)(uint32_t crc, const void *data, size_t size);
+
+static void check_known_values(crc32c_fn_t fn) {
+    EXPECT_EQ(0u, fn(0, "", 0));
+    EXPECT_EQ(0xE3069283u, fn(0, "123456789", 9));
+
+    // From RFC 3720, appendix B.4.
+    char zeros[32];
+    memset(zeros, 0, sizeof(zeros));
+    EXPECT_EQ(0x8A9136AAu, fn(0, zeros, sizeof(zeros)));
+    char ones[32];
+    memset(ones, 0xFF, sizeof(ones));
+    EXPECT_EQ(0x62A8AB43u, fn(0, ones, sizeof(ones)));
+}
+
+static void check_matches_reference(crc32c_fn_t fn) {
+    std::string s;
+    for (int i = 0; i < 300; ++i) {
+        s.push_back(static_cast<char>(i * 37 + 11));
+    }
+    // Every length and alignment, to exercise the unaligned head and tail.
+    for (size_t start = 0; start < 16; ++start) {
+        for (size_t len = 0; start + len <= s.size(); len += 7) {
+            std::string piece = s.substr(start, len);
+            EXPECT_EQ(reference_crc32c(piece), fn(0, s.data() + start, len));
+        }
+    }
+}
+
+static void check_extends(crc32c_fn_t fn) {
+    std::string s = "The quick brown fox jumps over the lazy dog";
+    for (size_t split = 0; split <= s.size(); ++split) {
+        uint32_t crc = fn(0, s.data(), split);
+        crc = fn(crc, s.data() + split, s.size() - split);
+        EXPECT_EQ(fn(0, s.data(), s.size()), crc);
+    }
+}
+
+TEST(Crc32cTest, KnownValues) {
+    check_known_values(crc32c);
+}
+
+TEST(Crc32cTest, MatchesReference) {
+    check_matches_reference(crc32c);
+}
+
+TEST(Crc32cTest, Extends) {
+    check_extends(crc32c);
+}
+
+TEST(Crc32cTest, SlicingBy8) {
+    check_known_values(crc32c_slicing_by_8);
+    check_matches_reference(crc32c_slicing_by_8);
+    check_extends(crc32c_slicing_by_8);
+}
+
+TEST(Crc32cTest, Sse42) {
+    if (!crc32c_is_hardware_accelerated()) {
+        // Nothing to test on this CPU; crc32c() is the slicing-by-8 version.
+        return;
+    }
+    check_known_values(crc32c_sse42);
+    check_matches_reference(crc32c_sse42);
+    check_extends(crc32c_sse42);
+}
+
+TEST(Crc32cTest, LbaChecksumIsNeverZero) {
+    // These four bytes happen to have a CRC of 0, which in an LBA entry would
+    // mean that the block's checksum isn't known.
+    const char zero_crc[4] = { '\xAB', '\x9B', '\xE0', '\x9B' };
+    ASSERT_EQ(0u, crc32c(0, zero_crc, sizeof(zero_crc)));
+    EXPECT_NE(0u, lba_block_checksum(zero_crc, sizeof(zero_crc)));
+
+    EXPECT_EQ(crc32c(0, "123456789", 9), lba_block_checksum("123456789", 9));
+}
+
+}  // namespace unittest
@@ -0,0 +1,70 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <vector>
+
+#include "serializer/log/delta_page.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+static const block_size_t page_size = block_size_t::unsafe_make(4096);
+
+TEST(DeltaPageTest, FindsRecords) {
+    std::vector<char> page(page_size.value());
+    delta_page_writer_t writer(&page[0], page_size);
+    EXPECT_TRUE(writer.empty());
+    ASSERT_TRUE(writer.add(3, "three"));
+    ASSERT_TRUE(writer.add(17, std::string(100, 'x')));
+    EXPECT_FALSE(writer.empty());
+
+    EXPECT_TRUE(check_delta_page(&page[0], page_size));
+
+    std::string record;
+    ASSERT_TRUE(find_delta_record(&page[0], page_size, 3, &record));
+    EXPECT_EQ("three", record);
+    ASSERT_TRUE(find_delta_record(&page[0], page_size, 17, &record));
+    EXPECT_EQ(std::string(100, 'x'), record);
+    EXPECT_FALSE(find_delta_record(&page[0], page_size, 4, &record));
+}
+
+TEST(DeltaPageTest, FillsUp) {
+    std::vector<char> page(page_size.value());
+    delta_page_writer_t writer(&page[0], page_size);
+    const std::string biggest(delta_page_writer_t::max_record_size(page_size), 'y');
+    ASSERT_TRUE(writer.add(1, biggest));
+    EXPECT_FALSE(writer.add(2, "z"));
+
+    std::string record;
+    ASSERT_TRUE(find_delta_record(&page[0], page_size, 1, &record));
+    EXPECT_EQ(biggest, record);
+    EXPECT_FALSE(find_delta_record(&page[0], page_size, 2, &record));
+}
+
+TEST(DeltaPageTest, RejectsGarbage) {
+    std::vector<char> page(page_size.value(), 0);
+    std::string record;
+    EXPECT_FALSE(check_delta_page(&page[0], page_size));
+    EXPECT_FALSE(find_delta_record(&page[0], page_size, 0, &record));
+
+    // A record running past the end of the page.
+    delta_page_writer_t writer(&page[0], page_size);
+    ASSERT_TRUE(writer.add(5, "five"));
+    reinterpret_cast<ls_delta_record_header_t *>(&page[0] + sizeof(ls_delta_page_header_t))->length = page_size.value();
+    EXPECT_FALSE(check_delta_page(&page[0], page_size));
+    EXPECT_FALSE(find_delta_record(&page[0], page_size, 5, &record));
+}
+
+TEST(DeltaPageTest, DetectsCorruption) {
+    std::vector<char> page(page_size.value());
+    delta_page_writer_t writer(&page[0], page_size);
+    ASSERT_TRUE(writer.add(6, "six"));
+    ASSERT_TRUE(writer.add(7, "seven"));
+    EXPECT_TRUE(check_delta_page(&page[0], page_size));
+
+    // Flip a bit in the last record's data.
+    page[sizeof(ls_delta_page_header_t) + 2 * sizeof(ls_delta_record_header_t) + 3 + 1] ^= 0x10;
+    std::string record;
+    EXPECT_FALSE(check_delta_page(&page[0], page_size));
+    EXPECT_FALSE(find_delta_record(&page[0], page_size, 6, &record));
+}
+
+}  // namespace unittest
@@ -1,5 +1,7 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <algorithm>
 #include <queue>
+#include <string>
 
 #include "arch/io/disk.hpp"
 #include "arch/timing.hpp"
@@ -8,6 +10,7 @@
 #include "containers/archive/stl_types.hpp"
 #include "containers/disk_backed_queue.hpp"
 #include "mock/unittest_utils.hpp"
+#include "perfmon/collect.hpp"
 #include "unittest/gtest.hpp"
 
 namespace unittest {
@@ -67,6 +70,109 @@ TEST(DiskBackedQueue, BigVals) {
     mock::run_in_thread_pool(&run_big_values_test, 2);
 }
 
+static std::string interleaved_test_value(int i) {
+    // Sizes that don't divide the chunk size, so entries straddle chunk and
+    // segment boundaries in every possible way.
+    std::string val = strprintf("%d:", i);
+    val.resize(100 * KILOBYTE + (i * 7919) % (300 * KILOBYTE), 'a' + i % 26);
+    return val;
+}
+
+static int64_t get_segments_stat() {
+    scoped_ptr_t<perfmon_result_t> stats(perfmon_get_stats());
+    perfmon_result_t::iterator collection = stats->get_map()->find("disk_backed_queue_test");
+    guarantee(collection != stats->end());
+    perfmon_result_t::iterator stat = collection->second->get_map()->find("disk_queue_segments");
+    guarantee(stat != collection->second->end());
+    return strtoll(stat->second->get_string()->c_str(), NULL, 10);
+}
+
+/* Pushes three entries for every two it pops, so that the reader follows the
+writer through several segments, and checks that segments are given back once
+they've been read through. */
+void run_interleaved_test() {
+    scoped_ptr_t<io_backender_t> io_backender;
+    make_io_backender(aio_default, &io_backender);
+    perfmon_collection_t collection;
+    perfmon_membership_t membership(&get_global_perfmon_collection(), &collection, "disk_backed_queue_test");
+
+    disk_backed_queue_t<std::string> queue(io_backender.get(), DBQ_TEST_DIRECTORY, &collection);
+    std::queue<std::string> ref_queue;
+
+    int64_t bytes_pushed = 0;
+    int pushed = 0;
+    int64_t max_segments = 0;
+    while (bytes_pushed < 6 * DISK_BACKED_QUEUE_SEGMENT_SIZE) {
+        for (int j = 0; j < 3; ++j, ++pushed) {
+            std::string val = interleaved_test_value(pushed);
+            bytes_pushed += val.size();
+            queue.push(val);
+            ref_queue.push(val);
+        }
+        for (int j = 0; j < 2; ++j) {
+            std::string x;
+            queue.pop(&x);
+            ASSERT_EQ(ref_queue.front(), x);
+            ref_queue.pop();
+        }
+        ASSERT_EQ(static_cast<int64_t>(ref_queue.size()), queue.size());
+        max_segments = std::max(max_segments, get_segments_stat());
+    }
+    // At most a third of what was pushed, about two segments' worth, was ever
+    // queued at once, so no more than four segments should have been open at
+    // a time. Without giving segments back there would have been six.
+    EXPECT_LE(max_segments, 4);
+
+    while (!ref_queue.empty()) {
+        ASSERT_FALSE(queue.empty());
+        std::string x;
+        queue.pop(&x);
+        ASSERT_EQ(ref_queue.front(), x);
+        ref_queue.pop();
+    }
+    EXPECT_TRUE(queue.empty());
+    EXPECT_LE(get_segments_stat(), 1);
+}
+
+TEST(DiskBackedQueue, InterleavedAcrossSegments) {
+    mock::run_in_thread_pool(&run_interleaved_test, 2);
+}
+
+/* Drains the queue with the writer part of the way into a chunk, both before
+and after anything has gone to disk, and checks that what gets pushed next
+comes back out intact. */
+void run_reset_after_drain_test() {
+    scoped_ptr_t<io_backender_t> io_backender;
+    make_io_backender(aio_default, &io_backender);
+
+    disk_backed_queue_t<std::string> queue(io_backender.get(), DBQ_TEST_DIRECTORY, &get_global_perfmon_collection());
+    int next = 0;
+    // A few entries that stay in memory, then enough to spill a few chunks,
+    // then a few more.
+    const int rounds[] = { 3, 20, 1, 7 };
+    for (size_t r = 0; r < sizeof(rounds) / sizeof(rounds[0]); ++r) {
+        std::queue<std::string> ref_queue;
+        for (int i = 0; i < rounds[r]; ++i, ++next) {
+            std::string val = interleaved_test_value(next);
+            queue.push(val);
+            ref_queue.push(val);
+        }
+        EXPECT_EQ(rounds[r], queue.size());
+        while (!ref_queue.empty()) {
+            std::string x;
+            queue.pop(&x);
+            ASSERT_EQ(ref_queue.front(), x);
+            ref_queue.pop();
+        }
+        EXPECT_TRUE(queue.empty());
+        EXPECT_EQ(0, queue.size());
+    }
+}
+
+TEST(DiskBackedQueue, ResetAfterDrain) {
+    mock::run_in_thread_pool(&run_reset_after_drain_test, 2);
+}
+
 static void randomly_delay(int, signal_t *) {
     nap(randint(100));
 }
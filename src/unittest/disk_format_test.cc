@@ -68,6 +68,14 @@ TEST(DiskFormatTest, LbaEntryT) {
     deleteblock = flagged_off64_t::make(1);
     ent = lba_entry_t::make(1, repli_timestamp_t::invalid, deleteblock);
     ASSERT_FALSE(lba_entry_t::is_padding(&ent));
+
+    // The compressed sector count shares a word with the delta page offset.
+    ent = lba_entry_t::make(1, repli_timestamp_t::invalid, real, flagged_off64_t::make(3 * DEVICE_BLOCK_SIZE), 0, 5);
+    EXPECT_EQ(3 * DEVICE_BLOCK_SIZE, ent.get_delta_offset().get_value());
+    EXPECT_EQ(5u, ent.get_compressed_sectors());
+    ent = lba_entry_t::make(1, repli_timestamp_t::invalid, real, flagged_off64_t::unused(), 0, 5);
+    EXPECT_FALSE(ent.get_delta_offset().has_value());
+    EXPECT_EQ(5u, ent.get_compressed_sectors());
 }
 
 TEST(DiskFormatTest, LbaExtentT) {
@@ -0,0 +1,64 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "fsck/work_pool.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+// Visits a complete tree with the given fanout and depth, one task per node.
+class tree_task_t : public fsck::work_task_t {
+public:
+    tree_task_t(int _fanout, int _depth, int64_t *_visited) : fanout(_fanout), depth(_depth), visited(_visited) { }
+
+    void run(fsck::work_pool_t *pool, int worker) {
+        __sync_add_and_fetch(visited, 1);
+        if (depth > 0) {
+            for (int i = 0; i < fanout; ++i) {
+                pool->spawn(new tree_task_t(fanout, depth - 1, visited), worker);
+            }
+        }
+    }
+
+private:
+    int fanout;
+    int depth;
+    int64_t *visited;
+};
+
+static int64_t tree_size(int fanout, int depth) {
+    int64_t size = 1, level = 1;
+    for (int i = 0; i < depth; ++i) {
+        level *= fanout;
+        size += level;
+    }
+    return size;
+}
+
+TEST(FsckWorkPoolTest, RunsSpawnedTasks) {
+    for (int n_workers = 1; n_workers <= 8; n_workers *= 2) {
+        fsck::work_pool_t pool(n_workers);
+        int64_t visited = 0;
+        pool.spawn(new tree_task_t(4, 6, &visited), -1);
+        pool.run();
+        EXPECT_EQ(tree_size(4, 6), visited);
+    }
+}
+
+TEST(FsckWorkPoolTest, RunsAgain) {
+    fsck::work_pool_t pool(4);
+    int64_t visited = 0;
+    for (int i = 0; i < 10; ++i) {
+        pool.spawn(new tree_task_t(3, 3, &visited), -1);
+    }
+    pool.run();
+    EXPECT_EQ(10 * tree_size(3, 3), visited);
+
+    // An empty run returns right away.
+    pool.run();
+
+    visited = 0;
+    pool.spawn(new tree_task_t(2, 10, &visited), -1);
+    pool.run();
+    EXPECT_EQ(tree_size(2, 10), visited);
+}
+
+}  // namespace unittest
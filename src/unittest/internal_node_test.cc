@@ -61,6 +61,44 @@ TEST(InternalNodeTest, Offsets) {
     EXPECT_EQ(5, sizeof(btree_internal_pair));
 }
 
+static int compare_from(const std::string &x, const std::string &y, int known_common, int *common_out) {
+    store_key_t x_key(x);
+    store_key_t y_key(y);
+    return compare_keys_from(x_key.btree_key(), y_key.btree_key(), known_common, common_out);
+}
+
+TEST(InternalNodeTest, CompareKeysFrom) {
+    const std::string prefix = "0123456789abcdef0123456789abcdef/";
+    int common;
+    EXPECT_GT(0, compare_from(prefix + "apple", prefix + "banana", 0, &common));
+    EXPECT_EQ(static_cast<int>(prefix.size()), common);
+    EXPECT_LT(0, compare_from(prefix + "banana", prefix + "apple", prefix.size(), &common));
+    EXPECT_EQ(static_cast<int>(prefix.size()), common);
+    EXPECT_EQ(0, compare_from(prefix + "apple", prefix + "apple", 8, &common));
+    EXPECT_EQ(static_cast<int>(prefix.size() + 5), common);
+    EXPECT_GT(0, compare_from(prefix, prefix + "a", 3, &common));
+    EXPECT_EQ(static_cast<int>(prefix.size()), common);
+    // Bytes compare unsigned.
+    EXPECT_GT(0, compare_from("abcdefgh\x01", "abcdefgh\xff", 0, &common));
+    EXPECT_EQ(8, common);
+}
+
+static std::string shortened_separator(const std::string &left, const std::string &right) {
+    store_key_t left_key(left);
+    store_key_t right_key(right);
+    shorten_separator(left_key.btree_key(), right_key.btree_key());
+    return key_to_unescaped_str(left_key);
+}
+
+TEST(InternalNodeTest, ShortenSeparator) {
+    EXPECT_EQ("uuid-1234/b", shortened_separator("uuid-1234/alpha", "uuid-1234/beta"));
+    // Nothing shorter than `left` fits below `right`.
+    EXPECT_EQ("uuid-1234/a", shortened_separator("uuid-1234/a", "uuid-1234/b"));
+    EXPECT_EQ("abc", shortened_separator("abc", "abcd"));
+    EXPECT_EQ("abcdef", shortened_separator("abcdef", "abd"));
+    EXPECT_EQ("b", shortened_separator("azzz", "bcd"));
+}
+
 
 }  // namespace unittest
 
@@ -0,0 +1,83 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <vector>
+
+#include "containers/archive/vector_stream.hpp"
+#include "rdb_protocol/json_groups.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+static boost::shared_ptr<scoped_cJSON_t> make_number(double d) {
+    return boost::shared_ptr<scoped_cJSON_t>(new scoped_cJSON_t(cJSON_CreateNumber(d)));
+}
+
+static boost::shared_ptr<scoped_cJSON_t> make_string(const char *s) {
+    return boost::shared_ptr<scoped_cJSON_t>(new scoped_cJSON_t(cJSON_CreateString(s)));
+}
+
+TEST(JsonGroupsTest, HashMatchesComparison) {
+    EXPECT_EQ(query_language::hash_json(make_number(0)->get()), query_language::hash_json(make_number(-0.0)->get()));
+    EXPECT_EQ(query_language::hash_json(make_string("abc")->get()), query_language::hash_json(make_string("abc")->get()));
+    EXPECT_NE(query_language::hash_json(make_string("abc")->get()), query_language::hash_json(make_string("abd")->get()));
+}
+
+TEST(JsonGroupsTest, MemorySize) {
+    EXPECT_EQ(sizeof(cJSON), query_language::json_memory_size(make_number(1)->get()));
+    EXPECT_EQ(sizeof(cJSON) + 4, query_language::json_memory_size(make_string("abc")->get()));
+
+    scoped_cJSON_t object(cJSON_CreateObject());
+    cJSON_AddItemToObject(object.get(), "ab", cJSON_CreateString("c"));
+    cJSON_AddItemToObject(object.get(), "d", cJSON_CreateNumber(1));
+    EXPECT_EQ(3 * sizeof(cJSON) + 3 + 2 + 2, query_language::json_memory_size(object.get()));
+}
+
+TEST(JsonGroupsTest, FindInsertSort) {
+    query_language::backtrace_t backtrace;
+    query_language::json_groups_t groups;
+
+    // Enough groups to make the table grow a few times.
+    for (int i = 99; i >= 0; --i) {
+        EXPECT_TRUE(groups.find(make_number(i), backtrace) == NULL);
+        groups.insert(make_number(i), make_number(i * 2));
+    }
+    EXPECT_EQ(100u, groups.size());
+
+    boost::shared_ptr<scoped_cJSON_t> *value = groups.find(make_number(42), backtrace);
+    ASSERT_TRUE(value != NULL);
+    EXPECT_EQ(84, (*value)->get()->valueint);
+    EXPECT_TRUE(groups.find(make_string("42"), backtrace) == NULL);
+
+    groups.sort(backtrace);
+    int expected = 0;
+    for (query_language::json_groups_t::iterator it = groups.begin(); it != groups.end(); ++it) {
+        EXPECT_EQ(expected, it->first->get()->valueint);
+        ++expected;
+    }
+    value = groups.find(make_number(42), backtrace);
+    ASSERT_TRUE(value != NULL);
+    EXPECT_EQ(84, (*value)->get()->valueint);
+}
+
+TEST(JsonGroupsTest, Serialization) {
+    query_language::backtrace_t backtrace;
+    query_language::json_groups_t groups;
+    groups.insert(make_string("a"), make_number(1));
+    groups.insert(make_string("b"), make_number(2));
+
+    write_message_t msg;
+    msg << groups;
+    vector_stream_t stream;
+    ASSERT_EQ(0, send_write_message(&stream, &msg));
+
+    std::vector<char> data = stream.vector();
+    vector_read_stream_t read_stream(&data);
+    query_language::json_groups_t copy;
+    ASSERT_EQ(ARCHIVE_SUCCESS, deserialize(&read_stream, &copy));
+
+    EXPECT_EQ(2u, copy.size());
+    boost::shared_ptr<scoped_cJSON_t> *value = copy.find(make_string("b"), backtrace);
+    ASSERT_TRUE(value != NULL);
+    EXPECT_EQ(2, (*value)->get()->valueint);
+}
+
+}  // namespace unittest
@@ -59,3 +59,35 @@ void run_timeout_test(js::runner_t *runner) {
 }
 
 TEST(JSProc, Timeout) { main_jsproc_test(run_timeout_test); }
+
+void run_call_batch_test(js::runner_t *runner) {
+    std::vector<std::string> argnames(1, "x");
+    std::string errmsg;
+    id_t id = runner->compile(argnames, "return x * 2;", &errmsg);
+    ASSERT_NE(js::INVALID_ID, id);
+
+    // More calls than fit in a single batch, to exercise the chunking.
+    const size_t n = js::runner_t::MAX_CALL_BATCH_SIZE * 2 + 3;
+    std::vector<boost::shared_ptr<scoped_cJSON_t> > objects(n);
+    std::vector<std::vector<boost::shared_ptr<scoped_cJSON_t> > > args(n);
+    for (size_t i = 0; i < n; ++i) {
+        args[i].push_back(boost::shared_ptr<scoped_cJSON_t>(new scoped_cJSON_t(cJSON_CreateNumber(i))));
+    }
+
+    std::vector<boost::shared_ptr<scoped_cJSON_t> > results;
+    ASSERT_TRUE(runner->call_batch(id, objects, args, &results, &errmsg));
+    ASSERT_EQ(n, results.size());
+    for (size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(cJSON_Number, results[i]->type());
+        ASSERT_EQ(static_cast<int>(i * 2), results[i]->get()->valueint);
+    }
+
+    // Evaluation stops at the first error.
+    id_t bad_id = runner->compile(argnames, "if (x == 5) { throw 'five'; } return x;", &errmsg);
+    ASSERT_NE(js::INVALID_ID, bad_id);
+    results.clear();
+    ASSERT_FALSE(runner->call_batch(bad_id, objects, args, &results, &errmsg));
+    ASSERT_EQ(5u, results.size());
+}
+
+TEST(JSProc, CallBatch) { main_jsproc_test(run_call_batch_test); }
@@ -13,7 +13,8 @@ struct short_value_t;
 template <>
 class value_sizer_t<short_value_t> : public value_sizer_t<void> {
 public:
-    explicit value_sizer_t<short_value_t>(block_size_t bs) : block_size_(bs) { }
+    // `prefixed` picks the prefix-compressed layout for new leaves.
+    explicit value_sizer_t<short_value_t>(block_size_t bs, bool prefixed = false) : block_size_(bs), prefixed_(prefixed) { }
 
     int size(const void *value) const {
         int x = *reinterpret_cast<const uint8_t *>(value);
@@ -38,13 +39,14 @@ public:
 
     block_magic_t btree_leaf_magic() const {
         block_magic_t magic = { { 's', 'h', 'L', 'F' } };
-        return magic;
+        return prefixed_ ? leaf::prefixed_magic(magic) : magic;
     }
 
     block_size_t block_size() const { return block_size_; }
 
 private:
     block_size_t block_size_;
+    bool prefixed_;
 
     DISABLE_COPYING(value_sizer_t<short_value_t>);
 };
@@ -77,8 +79,9 @@ private:
 
 class LeafNodeTracker {
 public:
-    LeafNodeTracker() : bs_(block_size_t::unsafe_make(4096)), sizer_(bs_), node_(bs_.value()),
-                        tstamp_counter_(0) {
+    explicit LeafNodeTracker(bool prefixed = false)
+        : bs_(block_size_t::unsafe_make(4096)), sizer_(bs_, prefixed), node_(bs_.value()),
+          tstamp_counter_(0) {
         leaf::init(&sizer_, node_.get());
         Print();
     }
@@ -295,6 +298,20 @@ public:
             printf("\n");
         }
         ASSERT_TRUE(receptor.map() == kv_);
+
+        // Lookups and iteration see the same keys.
+        leaf::live_iter_t it = leaf::iter_for_whole_leaf(&sizer_, node());
+        for (std::map<store_key_t, std::string>::iterator p = kv_.begin(); p != kv_.end(); ++p) {
+            short_value_buffer_t v(std::string(""));
+            ASSERT_TRUE(leaf::lookup(&sizer_, node(), p->first.btree_key(), v.data()));
+            ASSERT_EQ(p->second, v.as_str());
+
+            const btree_key_t *k = it.get_key(node());
+            ASSERT_TRUE(k != NULL);
+            ASSERT_EQ(key_to_unescaped_str(p->first), key_to_unescaped_str(store_key_t(k)));
+            it.step(node());
+        }
+        ASSERT_TRUE(it.get_key(node()) == NULL);
     }
 
 public:
@@ -623,4 +640,159 @@ TEST(LeafNodeTest, Fullness) {
     ASSERT_TRUE(node.IsFull(store_key_t(strprintf("a%d", i)), strprintf("A%d", i)));
 }
 
+// Keys like a table's: a long shared prefix and a short distinct part.
+static store_key_t uuid_key(const char *table, int i) {
+    return store_key_t(strprintf("%s-b4b5-4a3e-9d2e-c2b9a7a1f3e0/%d", table, i));
+}
+
+TEST(LeafNodeTest, PrefixedRandomOutOfOrder) {
+    for (int try_num = 0; try_num < 10; ++try_num) {
+        LeafNodeTracker tracker(true);
+
+        rng_t rng;
+
+        // Some keys share the whole prefix, some part of it and some
+        // nothing.
+        const int num_keys = 20;
+        store_key_t key_pool[num_keys];
+        for (int i = 0; i < num_keys; ++i) {
+            std::string k = strprintf("6f1a2c3d-b4b5-4a3e-9d2e-c2b9a7a1f3e0/%d", rng.randint(1000));
+            k.resize(rng.randint(k.size() + 1));
+            int length = rng.randint(100);
+            for (int j = 0; j < length; ++j) {
+                k.push_back('a' + rng.randint(3));
+            }
+            key_pool[i] = store_key_t(k);
+        }
+
+        const int num_ops = 10000;
+        for (int i = 0; i < num_ops; ++i) {
+            const store_key_t &key = key_pool[rng.randint(num_keys)];
+            repli_timestamp_t tstamp;
+            tstamp.longtime = rng.randint(num_ops);
+
+            if (rng.randint(2) == 1) {
+                std::string value(rng.randint(160), 'a' + rng.randint(26));
+                tracker.Insert(key, value, tstamp);
+            } else {
+                if (tracker.ShouldHave(key)) {
+                    tracker.Remove(key);
+                }
+            }
+        }
+    }
+}
+
+TEST(LeafNodeTest, PrefixedFullness) {
+    LeafNodeTracker plain;
+    LeafNodeTracker prefixed(true);
+
+    int plain_count = 0;
+    while (plain.Insert(uuid_key("6f1a2c3d", plain_count), "V")) {
+        ++plain_count;
+    }
+    int prefixed_count = 0;
+    while (prefixed.Insert(uuid_key("6f1a2c3d", prefixed_count), "V")) {
+        ++prefixed_count;
+    }
+
+    // A key costs 41 bytes in a plain leaf and about 6 in a
+    // prefix-compressed one.
+    EXPECT_LT(2 * plain_count, prefixed_count);
+}
+
+TEST(LeafNodeTest, PrefixedSplitting) {
+    LeafNodeTracker left(true);
+    for (int i = 0; left.Insert(uuid_key("6f1a2c3d", i), strprintf("A%d", i)); ++i) { }
+
+    LeafNodeTracker right(true);
+    left.Split(&right);
+    left.Verify();
+    right.Verify();
+
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_TRUE(right.Insert(uuid_key("6f1a2c3d", 100000 + i), "B"));
+    }
+}
+
+TEST(LeafNodeTest, PrefixedSplittingRecomputesPrefix) {
+    // With an odd first key, the left node's prefix is of no use to the
+    // table's keys, and they're stored in full.
+    LeafNodeTracker left(true);
+    ASSERT_TRUE(left.Insert(store_key_t("0"), "A"));
+    int count = 0;
+    while (left.Insert(uuid_key("6f1a2c3d", count), "B")) {
+        ++count;
+    }
+
+    LeafNodeTracker right(true);
+    left.Split(&right);
+    left.Verify();
+    right.Verify();
+
+    // The right node only got table keys, so its prefix is theirs now
+    // and it has room for many more than the left node held.
+    int more = 0;
+    while (right.Insert(uuid_key("6f1a2c3d", 100000 + more), "B")) {
+        ++more;
+    }
+    EXPECT_LT(2 * count, more);
+}
+
+TEST(LeafNodeTest, PrefixedMergingAcrossPrefixes) {
+    LeafNodeTracker left(true);
+    LeafNodeTracker right(true);
+
+    for (int i = 0; i < 40; ++i) {
+        left.Insert(uuid_key("0a1a2c3d", i), strprintf("A%d", i));
+        right.Insert(uuid_key("6f1a2c3d", i), strprintf("B%d", i));
+        if (i % 5 == 0) {
+            left.Remove(uuid_key("0a1a2c3d", i / 5));
+            right.Remove(uuid_key("6f1a2c3d", i / 5));
+        }
+    }
+
+    ASSERT_TRUE(leaf::is_mergable(&right.sizer_, right.node(), left.node()));
+    right.Merge(&left);
+}
+
+TEST(LeafNodeTest, MergingAcrossLayouts) {
+    LeafNodeTracker left;
+    LeafNodeTracker right(true);
+
+    for (int i = 0; i < 20; ++i) {
+        left.Insert(uuid_key("0a1a2c3d", i), strprintf("A%d", i));
+        right.Insert(uuid_key("6f1a2c3d", i), strprintf("B%d", i));
+    }
+
+    ASSERT_TRUE(leaf::is_mergable(&right.sizer_, right.node(), left.node()));
+    right.Merge(&left);
+}
+
+TEST(LeafNodeTest, PrefixedLevelingAcrossPrefixes) {
+    LeafNodeTracker left(true);
+    LeafNodeTracker right(true);
+
+    for (int i = 0; left.Insert(uuid_key("0a1a2c3d", i), strprintf("A%d", i)); ++i) { }
+    right.Insert(uuid_key("6f1a2c3d", 0), "B0");
+
+    // Every key the right node gets is stored there in full, so it
+    // fills up long before it has half of the left node's keys.
+    bool could_level;
+    right.Level(1, &left, &could_level);
+    ASSERT_TRUE(could_level);
+}
+
+TEST(LeafNodeTest, PrefixedLevelingRightToLeft) {
+    LeafNodeTracker left(true);
+    LeafNodeTracker right(true);
+
+    for (int i = 0; right.Insert(uuid_key("6f1a2c3d", i), strprintf("B%d", i)); ++i) { }
+    left.Insert(uuid_key("0a1a2c3d", 0), "A0");
+
+    bool could_level;
+    left.Level(-1, &right, &could_level);
+    ASSERT_TRUE(could_level);
+}
+
 }  // namespace unittest
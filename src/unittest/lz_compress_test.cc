@@ -0,0 +1,86 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <string>
+#include <vector>
+
+#include "containers/lz_compress.hpp"
+#include "unittest/gtest.hpp"
+#include "utils.hpp"
+
+namespace unittest {
+
+static void expect_round_trip(const std::string &data) {
+    std::vector<char> compressed(lz_compress_bound(data.size()));
+    size_t compressed_size = lz_compress(data.data(), data.size(), compressed.data(), compressed.size());
+    ASSERT_LT(0u, compressed_size);
+
+    std::vector<char> decompressed(data.size() + 1);
+    ASSERT_TRUE(lz_decompress(compressed.data(), compressed_size, decompressed.data(), data.size()));
+    EXPECT_EQ(data, std::string(decompressed.data(), data.size()));
+
+    // The size has to match exactly.
+    EXPECT_FALSE(lz_decompress(compressed.data(), compressed_size, decompressed.data(), data.size() + 1));
+}
+
+TEST(LzCompressTest, RoundTrip) {
+    expect_round_trip("");
+    expect_round_trip("a");
+    expect_round_trip("abcdefghijklm");
+    expect_round_trip(std::string(100000, 'x'));
+
+    std::string json;
+    for (int i = 0; i < 300; ++i) {
+        json += strprintf("{\"id\": %d, \"name\": \"user%d\", \"email\": \"user%d@example.com\"}, ", i, i, i);
+    }
+    expect_round_trip(json);
+
+    std::string noise;
+    for (int i = 0; i < 10000; ++i) {
+        noise += static_cast<char>(randint(256));
+    }
+    expect_round_trip(noise);
+}
+
+TEST(LzCompressTest, CompressesRepetitiveData) {
+    std::string json;
+    for (int i = 0; i < 300; ++i) {
+        json += strprintf("{\"id\": %d, \"name\": \"user%d\", \"email\": \"user%d@example.com\"}, ", i, i, i);
+    }
+
+    // Asking for less room than the input is how callers insist on a gain.
+    std::vector<char> compressed(json.size() - 1);
+    size_t compressed_size = lz_compress(json.data(), json.size(), compressed.data(), compressed.size());
+    EXPECT_LT(0u, compressed_size);
+    EXPECT_LT(compressed_size, json.size() / 2);
+
+    std::string noise;
+    for (int i = 0; i < 10000; ++i) {
+        noise += static_cast<char>(randint(256));
+    }
+    compressed.resize(noise.size() - 1);
+    EXPECT_EQ(0u, lz_compress(noise.data(), noise.size(), compressed.data(), compressed.size()));
+}
+
+TEST(LzCompressTest, RejectsCorruptInput) {
+    std::string data(1000, 'x');
+    std::vector<char> compressed(lz_compress_bound(data.size()));
+    size_t compressed_size = lz_compress(data.data(), data.size(), compressed.data(), compressed.size());
+    std::vector<char> decompressed(data.size());
+
+    // Cut off partway through.
+    EXPECT_FALSE(lz_decompress(compressed.data(), compressed_size / 2, decompressed.data(), data.size()));
+
+    // A back-reference to before the start of the output.
+    const char bad_offset[] = { 0x10, 'x', 0x05, 0x00, 0x00 };
+    EXPECT_FALSE(lz_decompress(bad_offset, sizeof(bad_offset), decompressed.data(), 5));
+
+    // Random garbage must fail cleanly, never write out of bounds.
+    for (int i = 0; i < 1000; ++i) {
+        std::vector<char> garbage(1 + randint(64));
+        for (size_t j = 0; j < garbage.size(); ++j) {
+            garbage[j] = static_cast<char>(randint(256));
+        }
+        lz_decompress(garbage.data(), garbage.size(), decompressed.data(), decompressed.size());
+    }
+}
+
+}  // namespace unittest
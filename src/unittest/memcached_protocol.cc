@@ -139,5 +139,86 @@ TEST(MemcachedProtocol, GetSet) {
     run_in_thread_pool_with_namespace_interface(&run_get_set_test);
 }
 
+/* `WriteBatch` applies several sets with one `write_batch()` call and checks
+that they all took effect, in order. */
+void run_write_batch_test() {
+    mock::temp_file_t temp_file("/tmp/rdb_unittest.XXXXXX");
+
+    scoped_ptr_t<io_backender_t> io_backender;
+    make_io_backender(aio_default, &io_backender);
+
+    filepath_file_opener_t file_opener(temp_file.name(), io_backender.get());
+    standard_serializer_t::create(&file_opener,
+                                  standard_serializer_t::static_config_t());
+    standard_serializer_t serializer(standard_serializer_t::dynamic_config_t(),
+                                     &file_opener,
+                                     &get_global_perfmon_collection());
+
+    memcached_protocol_t::store_t store(&serializer, std::string(temp_file.name()) + "_store", GIGABYTE, true, &get_global_perfmon_collection(), NULL);
+
+    std::vector<memcached_protocol_t::write_t> writes;
+    std::vector<transition_timestamp_t> timestamps;
+    state_timestamp_t timestamp = state_timestamp_t::zero();
+    for (int i = 0; i < 100; ++i) {
+        sarc_mutation_t set;
+        // Every key gets set twice; the second value has to win.
+        set.key = store_key_t(strprintf("key%d", i % 50));
+        set.data = data_buffer_t::create(1);
+        set.data->buf()[0] = i < 50 ? 'A' : 'B';
+        set.flags = 0;
+        set.exptime = 0;
+        set.add_policy = add_policy_yes;
+        set.replace_policy = replace_policy_yes;
+        writes.push_back(memcached_protocol_t::write_t(set, time(NULL), 12345));
+        timestamps.push_back(transition_timestamp_t::starting_from(timestamp));
+        timestamp = timestamps.back().timestamp_after();
+    }
+
+    cond_t interruptor;
+    order_source_t order_source;
+
+    {
+#ifndef NDEBUG
+        trivial_metainfo_checker_callback_t<memcached_protocol_t> metainfo_checker_callback;
+        metainfo_checker_t<memcached_protocol_t> metainfo_checker(&metainfo_checker_callback, store.get_region());
+#endif
+        object_buffer_t<fifo_enforcer_sink_t::exit_write_t> write_token;
+        store.new_write_token(&write_token);
+        std::vector<memcached_protocol_t::write_response_t> responses;
+        store.write_batch(DEBUG_ONLY(metainfo_checker, )
+                          region_map_t<memcached_protocol_t, binary_blob_t>(store.get_region(), binary_blob_t(timestamp)),
+                          writes, timestamps, &responses,
+                          order_source.check_in("unittest::run_write_batch_test(A)"),
+                          &write_token, &interruptor);
+        ASSERT_EQ(writes.size(), responses.size());
+    }
+
+    for (int i = 0; i < 50; ++i) {
+#ifndef NDEBUG
+        trivial_metainfo_checker_callback_t<memcached_protocol_t> metainfo_checker_callback;
+        metainfo_checker_t<memcached_protocol_t> metainfo_checker(&metainfo_checker_callback, store.get_region());
+#endif
+        get_query_t get;
+        get.key = store_key_t(strprintf("key%d", i));
+        memcached_protocol_t::read_t read(get, time(NULL));
+        memcached_protocol_t::read_response_t result;
+        object_buffer_t<fifo_enforcer_sink_t::exit_read_t> read_token;
+        store.new_read_token(&read_token);
+        store.read(DEBUG_ONLY(metainfo_checker, ) read, &result,
+                   order_source.check_in("unittest::run_write_batch_test(B)").with_read_mode(),
+                   &read_token, &interruptor);
+
+        if (get_result_t *maybe_get_result = boost::get<get_result_t>(&result.result)) {
+            ASSERT_TRUE(maybe_get_result->value.get() != NULL);
+            EXPECT_EQ('B', maybe_get_result->value->buf()[0]);
+        } else {
+            ADD_FAILURE() << "got wrong type of result back";
+        }
+    }
+}
+TEST(MemcachedProtocol, WriteBatch) {
+    mock::run_in_thread_pool(&run_write_batch_test);
+}
+
 }   /* namespace unittest */
 
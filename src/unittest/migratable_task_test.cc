@@ -0,0 +1,53 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <vector>
+
+#include "arch/runtime/migratable_task.hpp"
+#include "arch/runtime/runtime.hpp"
+#include "mock/unittest_utils.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+class counting_task_t : public migratable_task_t {
+public:
+    counting_task_t() : runs(0), sum(0) { }
+
+    void run() {
+        // Something for the CPU to do, so that the other threads have a chance to
+        // steal.
+        for (int i = 0; i < 100000; ++i) {
+            sum += i % 7;
+        }
+        __sync_add_and_fetch(&runs, 1);
+    }
+
+    volatile int runs;
+    volatile int64_t sum;
+};
+
+static void run_all_tasks_test() {
+    const int home_thread = get_thread_id();
+    for (int round = 0; round < 10; ++round) {
+        std::vector<counting_task_t> tasks(50);
+        std::vector<migratable_task_t *> task_ptrs;
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            task_ptrs.push_back(&tasks[i]);
+        }
+        run_migratable_tasks(task_ptrs);
+
+        // We're back on the thread we started on, and every task has run once.
+        EXPECT_EQ(home_thread, get_thread_id());
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            EXPECT_EQ(1, tasks[i].runs);
+        }
+    }
+
+    // Nothing to do returns right away.
+    run_migratable_tasks(std::vector<migratable_task_t *>());
+}
+
+TEST(MigratableTaskTest, RunsAllTasks) {
+    mock::run_in_thread_pool(&run_all_tasks_test, 4);
+}
+
+}  // namespace unittest
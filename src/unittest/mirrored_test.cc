@@ -1,10 +1,18 @@
 // Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <string.h>
+
+#include <vector>
+
+#include "arch/timing.hpp"
 #include "buffer_cache/buffer_cache.hpp"
 #include "errors.hpp"
 #include "mock/unittest_utils.hpp"
+#include "perfmon/collect.hpp"
+#include "serializer/config.hpp"
 #include "serializer/log/log_serializer.hpp" // for ls_buf_data_t
 #include "serializer/translator.hpp"
 #include "unittest/gtest.hpp"
+#include "unittest/mock_file.hpp"
 #include "unittest/server_test_helper.hpp"
 
 namespace unittest {
@@ -14,8 +22,38 @@ protected:
     void run_tests(cache_t *cache) {
         // for now this test doesn't work as it should, so turn it off
         trace_call(test_read_ahead_checks_free_list, cache);
+        trace_call(test_intent_then_upgrade, cache);
     }
 private:
+    void test_intent_then_upgrade(cache_t *cache) {
+        // t1:acqi(A), t2:acq(A) doesn't block, t2:release(A), t1:upgrade+change(A),
+        // t3:acqi(A) blocks, t1:release(A), t3 unblocks, t3 sees the change
+        order_source_t order_source;
+        transaction_t t0(cache, rwi_write, 0, repli_timestamp_t::distant_past,
+                         order_source.check_in("test_intent_then_upgrade(t0)"));
+        block_id_t block_A, block_B;
+        create_two_blocks(&t0, &block_A, &block_B);
+
+        transaction_t t1(cache, rwi_write, 0, repli_timestamp_t::distant_past,
+                         order_source.check_in("test_intent_then_upgrade(t1)"));
+        transaction_t t2(cache, rwi_read, 0, repli_timestamp_t::invalid,
+                         order_source.check_in("test_intent_then_upgrade(t2)").with_read_mode());
+        transaction_t t3(cache, rwi_write, 0, repli_timestamp_t::distant_past,
+                         order_source.check_in("test_intent_then_upgrade(t3)"));
+
+        buf_lock_t buf1(&t1, block_A, rwi_intent);
+        buf_lock_t buf2, buf3;
+        EXPECT_FALSE(acq_check_if_blocks_until_buf_released(&buf2, &t2, &buf1, rwi_read, false));
+        EXPECT_EQ(init_value, get_value(&buf2));
+        buf2.release();
+
+        buf1.upgrade_to_write();
+        change_value(&buf1, changed_value);
+
+        EXPECT_TRUE(acq_check_if_blocks_until_buf_released(&buf3, &t3, &buf1, rwi_intent, true));
+        EXPECT_EQ(changed_value, get_value(&buf3));
+    }
+
     void test_read_ahead_checks_free_list(cache_t *cache) {
         order_source_t order_source;
         // Scenario:
@@ -62,5 +100,107 @@ TEST(MirroredTest, all_tests) {
     mirrored_tester_t().run();
 }
 
+static int64_t get_serializer_stat(const char *collection_name, const char *stat_name) {
+    scoped_ptr_t<perfmon_result_t> stats(perfmon_get_stats());
+    perfmon_result_t::iterator collection = stats->get_map()->find(collection_name);
+    guarantee(collection != stats->end());
+    perfmon_result_t::iterator serializer = collection->second->get_map()->find("serializer");
+    guarantee(serializer != collection->second->end());
+    perfmon_result_t::iterator stat = serializer->second->get_map()->find(stat_name);
+    guarantee(stat != serializer->second->end());
+    return strtoll(stat->second->get_string()->c_str(), NULL, 10);
+}
+
+static const int delta_test_blocks = 8;
+static const int delta_test_filler_blocks = 64;
+static const uint32_t delta_test_value = 0xdeadbeef;
+
+static void set_up_delta_test_cache(mirrored_cache_config_t *config) {
+    config->max_size = GIGABYTE;
+    // Every write transaction starts a flush, and a 4-byte change to a block
+    // is small enough to go to disk as a patch.
+    config->flush_timer_ms = 0;
+}
+
+/* Patches a few blocks so that the cache writes delta records for them, has
+the GC move the delta page, and then loads the blocks into a fresh cache. */
+static void run_delta_records_survive_gc_and_eviction() {
+    perfmon_collection_t collection;
+    perfmon_membership_t membership(&get_global_perfmon_collection(), &collection, "delta_record_test");
+
+    mock_file_opener_t file_opener;
+    standard_serializer_t::create(&file_opener, standard_serializer_t::static_config_t());
+    standard_serializer_t log_serializer(standard_serializer_t::dynamic_config_t(), &file_opener, &collection);
+    std::vector<standard_serializer_t *> serializers;
+    serializers.push_back(&log_serializer);
+    serializer_multiplexer_t::create(serializers, 1);
+    serializer_multiplexer_t multiplexer(serializers);
+    serializer_t *serializer = multiplexer.proxies[0];
+
+    mirrored_cache_static_config_t cache_static_config;
+    cache_t::create(serializer, &cache_static_config);
+    mirrored_cache_config_t cache_config;
+    set_up_delta_test_cache(&cache_config);
+    order_source_t order_source;
+
+    // The blocks and some filler blocks get written as a whole.
+    std::vector<block_id_t> blocks, filler_blocks;
+    {
+        cache_t cache(serializer, &cache_config, &collection);
+        transaction_t txn(&cache, rwi_write, 0, repli_timestamp_t::distant_past, order_source.check_in("delta test (create)"));
+        for (int i = 0; i < delta_test_blocks + delta_test_filler_blocks; ++i) {
+            buf_lock_t buf(&txn);
+            memset(buf.get_data_major_write(), 0, serializer->get_block_size().value());
+            (i < delta_test_blocks ? blocks : filler_blocks).push_back(buf.get_block_id());
+        }
+    }
+
+    // The change to the blocks goes into delta records, which all end up on
+    // the same delta page.
+    {
+        cache_t cache(serializer, &cache_config, &collection);
+        transaction_t txn(&cache, rwi_write, 0, repli_timestamp_t::distant_past, order_source.check_in("delta test (patch)"));
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            buf_lock_t buf(&txn, blocks[i], rwi_write);
+            buf.set_data(const_cast<void *>(buf.get_data_read()), &delta_test_value, sizeof(delta_test_value));
+        }
+    }
+
+    // Overwriting the filler blocks makes garbage of the extent the delta page
+    // is in, until the GC moves it.
+    {
+        cache_t cache(serializer, &cache_config, &collection);
+        for (int round = 1; get_serializer_stat("delta_record_test", "serializer_delta_pages_moved") == 0; ++round) {
+            ASSERT_LT(round, 1000) << "the GC never moved the delta page";
+            transaction_t txn(&cache, rwi_write, 0, repli_timestamp_t::distant_past, order_source.check_in("delta test (filler)"));
+            for (size_t i = 0; i < filler_blocks.size(); ++i) {
+                buf_lock_t buf(&txn, filler_blocks[i], rwi_write);
+                memset(buf.get_data_major_write(), round, serializer->get_block_size().value());
+            }
+            // Give the flush and the GC a chance to run.
+            nap(1);
+        }
+    }
+
+    // A fresh cache has to load the blocks from disk, with their delta records,
+    // which only takes reading the delta page once.
+    const int64_t delta_reads = get_serializer_stat("delta_record_test", "serializer_delta_reads");
+    const int64_t delta_page_reads = get_serializer_stat("delta_record_test", "serializer_delta_page_reads");
+    {
+        cache_t cache(serializer, &cache_config, &collection);
+        transaction_t txn(&cache, rwi_read, 0, repli_timestamp_t::invalid, order_source.check_in("delta test (load)").with_read_mode());
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            buf_lock_t buf(&txn, blocks[i], rwi_read);
+            EXPECT_EQ(0, memcmp(buf.get_data_read(), &delta_test_value, sizeof(delta_test_value))) << "block " << blocks[i];
+        }
+    }
+    EXPECT_EQ(delta_reads + delta_test_blocks, get_serializer_stat("delta_record_test", "serializer_delta_reads"));
+    EXPECT_EQ(delta_page_reads + 1, get_serializer_stat("delta_record_test", "serializer_delta_page_reads"));
+}
+
+TEST(MirroredTest, DeltaRecordsSurviveGCAndEviction) {
+    mock::run_in_thread_pool(&run_delta_records_survive_gc_and_eviction);
+}
+
 }  // namespace unittest
 
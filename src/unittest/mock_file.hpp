@@ -58,6 +58,9 @@ public:
     MUST_USE bool open_semantic_checking_file(int *fd_out);
 #endif
 
+    // The file's contents, so that tests can look at (or damage) what got written.
+    std::vector<char> *file_contents() { return &file_; }
+
 private:
     bool file_exists_;
     std::vector<char> file_;
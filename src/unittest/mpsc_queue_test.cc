@@ -0,0 +1,116 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <pthread.h>
+
+#include <vector>
+
+#include "containers/mpsc_queue.hpp"
+#include "containers/scoped.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+struct queued_int_t :
+    public intrusive_list_node_t<queued_int_t>,
+    public mpsc_queue_node_t<queued_int_t> {
+    queued_int_t() : producer(0), value(0) { }
+    int producer;
+    int value;
+};
+
+TEST(MpscQueueTest, Fifo) {
+    scoped_array_t<queued_int_t> nodes(10);
+    mpsc_queue_t<queued_int_t> queue;
+    EXPECT_TRUE(queue.empty());
+    EXPECT_TRUE(queue.pop() == NULL);
+
+    intrusive_list_t<queued_int_t> batch;
+    for (int i = 0; i < 10; ++i) {
+        nodes[i].value = i;
+        if (i < 3) {
+            queue.push(&nodes[i]);
+        } else {
+            batch.push_back(&nodes[i]);
+        }
+    }
+    queue.push_all(&batch);
+    EXPECT_TRUE(batch.empty());
+    EXPECT_FALSE(queue.empty());
+
+    for (int i = 0; i < 10; ++i) {
+        queued_int_t *node = queue.pop();
+        ASSERT_TRUE(node != NULL);
+        EXPECT_EQ(i, node->value);
+        if (i == 4) {
+            // Pushing onto the queue while it's partly popped keeps the order.
+            queue.push(&nodes[0]);
+        }
+    }
+    EXPECT_EQ(&nodes[0], queue.pop());
+    EXPECT_TRUE(queue.pop() == NULL);
+    EXPECT_TRUE(queue.empty());
+}
+
+static const int NUM_PRODUCERS = 4;
+static const int VALUES_PER_PRODUCER = 200000;
+static const int BATCH_SIZE = 16;
+
+struct producer_t {
+    mpsc_queue_t<queued_int_t> *queue;
+    scoped_array_t<queued_int_t> nodes;
+};
+
+static void *produce(void *arg) {
+    producer_t *producer = static_cast<producer_t *>(arg);
+    intrusive_list_t<queued_int_t> batch;
+    for (int i = 0; i < VALUES_PER_PRODUCER; ++i) {
+        // Push some values by themselves and some in batches, like the message hub does.
+        if (i % (2 * BATCH_SIZE) < BATCH_SIZE) {
+            producer->queue->push(&producer->nodes[i]);
+        } else {
+            batch.push_back(&producer->nodes[i]);
+            if (batch.size() == static_cast<unsigned int>(BATCH_SIZE)) {
+                producer->queue->push_all(&batch);
+            }
+        }
+    }
+    producer->queue->push_all(&batch);
+    return NULL;
+}
+
+TEST(MpscQueueTest, ManyProducers) {
+    mpsc_queue_t<queued_int_t> queue;
+    scoped_array_t<producer_t> producers(NUM_PRODUCERS);
+    std::vector<pthread_t> threads(NUM_PRODUCERS);
+    for (int p = 0; p < NUM_PRODUCERS; ++p) {
+        producers[p].queue = &queue;
+        producers[p].nodes.init(VALUES_PER_PRODUCER);
+        for (int i = 0; i < VALUES_PER_PRODUCER; ++i) {
+            producers[p].nodes[i].producer = p;
+            producers[p].nodes[i].value = i;
+        }
+    }
+
+    for (int p = 0; p < NUM_PRODUCERS; ++p) {
+        ASSERT_EQ(0, pthread_create(&threads[p], NULL, &produce, &producers[p]));
+    }
+
+    // Every producer's values come out in the order it pushed them.
+    std::vector<int> next_value(NUM_PRODUCERS, 0);
+    for (int received = 0; received < NUM_PRODUCERS * VALUES_PER_PRODUCER; ) {
+        queued_int_t *node = queue.pop();
+        if (node == NULL) {
+            continue;
+        }
+        ASSERT_EQ(next_value[node->producer], node->value);
+        ++next_value[node->producer];
+        ++received;
+    }
+
+    for (int p = 0; p < NUM_PRODUCERS; ++p) {
+        ASSERT_EQ(0, pthread_join(threads[p], NULL));
+    }
+    EXPECT_TRUE(queue.pop() == NULL);
+    EXPECT_TRUE(queue.empty());
+}
+
+}  // namespace unittest
@@ -47,4 +47,45 @@ TEST(PerfmonTest, StddevComputation) {
     }
 }
 
+TEST(PerfmonTest, HistogramBuckets) {
+    typedef perfmon_histogram::stats_t t;
+
+    // Buckets never go backwards, and every value is within an eighth of the
+    // middle of its bucket.
+    int last_bucket = 0;
+    for (ticks_t value = 0; value < (1ULL << 36); value = value * 1.01 + 1) {
+        int bucket = t::bucket_for(value);
+        ASSERT_LE(last_bucket, bucket);
+        ASSERT_GT(PERFMON_HISTOGRAM_NUM_BUCKETS, bucket);
+        last_bucket = bucket;
+
+        double midpoint = t::bucket_midpoint(bucket);
+        EXPECT_NEAR(value, midpoint, value / 8.0 + 1);
+    }
+
+    EXPECT_EQ(PERFMON_HISTOGRAM_NUM_BUCKETS - 1, t::bucket_for(1ULL << 50));
+}
+
+TEST(PerfmonTest, HistogramPercentiles) {
+    typedef perfmon_histogram::stats_t t;
+
+    t a, b;
+    for (int i = 1; i <= 1000; ++i) {
+        // Split the values between two "threads".
+        (i % 2 == 0 ? a : b).record(i * 1000);
+    }
+    a.aggregate(b);
+    EXPECT_EQ(1000u, a.count);
+
+    EXPECT_NEAR(500000, a.percentile(0.5), 500000 / 8);
+    EXPECT_NEAR(990000, a.percentile(0.99), 990000 / 8);
+    EXPECT_NEAR(1000000, a.percentile(1.0), 1000000 / 8);
+    EXPECT_LE(a.percentile(0.5), a.percentile(0.9));
+    EXPECT_LE(a.percentile(0.9), a.percentile(0.999));
+
+    t single;
+    single.record(12345);
+    EXPECT_EQ(single.percentile(0.001), single.percentile(0.999));
+}
+
 }  // namespace unittest
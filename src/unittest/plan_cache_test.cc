@@ -0,0 +1,93 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <string>
+#include <vector>
+
+#include "mock/unittest_utils.hpp"
+#include "rdb_protocol/internal_extensions.pb.h"
+#include "rdb_protocol/plan_cache.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+// Builds the query `[number, string]`.
+static void make_query(int64_t token, double number, const std::string &str, Query *q) {
+    q->set_type(Query::READ);
+    q->set_token(token);
+    Term *t = q->mutable_read_query()->mutable_term();
+    t->set_type(Term::ARRAY);
+    Term *n = t->add_array();
+    n->set_type(Term::NUMBER);
+    n->set_number(number);
+    Term *s = t->add_array();
+    s->set_type(Term::STRING);
+    s->set_valuestring(str);
+}
+
+static void run_rebinds_literals_test() {
+    query_language::query_plan_cache_t cache;
+    query_language::backtrace_t backtrace;
+
+    Query q1;
+    make_query(1, 3, "foo", &q1);
+    bool is_det;
+    cache.check_query_type(&q1, &is_det, backtrace);
+    EXPECT_TRUE(is_det);
+    EXPECT_EQ(1u, cache.size());
+
+    Query q2;
+    make_query(2, 4, "bar", &q2);
+    cache.check_query_type(&q2, &is_det, backtrace);
+    EXPECT_TRUE(is_det);
+    EXPECT_EQ(1u, cache.size());
+
+    // The second query was served from the cache: it has its own literals and
+    // token, and the type annotations of the first one.
+    EXPECT_EQ(2, q2.token());
+    const Term &t = q2.read_query().term();
+    EXPECT_TRUE(t.HasExtension(query_language::extension::inferred_type));
+    ASSERT_EQ(2, t.array_size());
+    EXPECT_EQ(4, t.array(0).number());
+    EXPECT_EQ("bar", t.array(1).valuestring());
+    EXPECT_TRUE(t.array(1).HasExtension(query_language::extension::inferred_type));
+
+    std::vector<Term *> literals;
+    query_language::collect_literal_terms(&q2, &literals);
+    EXPECT_EQ(2u, literals.size());
+
+    // A different shape gets its own plan.
+    Query q3;
+    make_query(3, 5, "baz", &q3);
+    q3.mutable_read_query()->mutable_term()->mutable_array(1)->set_type(Term::JSON_NULL);
+    q3.mutable_read_query()->mutable_term()->mutable_array(1)->clear_valuestring();
+    cache.check_query_type(&q3, &is_det, backtrace);
+    EXPECT_EQ(2u, cache.size());
+
+    EXPECT_EQ(1u, cache.stats().hits);
+    EXPECT_EQ(2u, cache.stats().misses);
+}
+
+TEST(PlanCacheTest, RebindsLiterals) {
+    mock::run_in_thread_pool(&run_rebinds_literals_test);
+}
+
+static void run_evicts_lru_test() {
+    query_language::query_plan_cache_t cache(1);
+    query_language::backtrace_t backtrace;
+    bool is_det;
+
+    Query q1;
+    make_query(1, 3, "foo", &q1);
+    cache.check_query_type(&q1, &is_det, backtrace);
+
+    Query q2;
+    make_query(2, 3, "foo", &q2);
+    q2.mutable_read_query()->mutable_term()->add_array()->set_type(Term::JSON_NULL);
+    cache.check_query_type(&q2, &is_det, backtrace);
+    EXPECT_EQ(1u, cache.size());
+}
+
+TEST(PlanCacheTest, EvictsLeastRecentlyUsed) {
+    mock::run_in_thread_pool(&run_evicts_lru_test);
+}
+
+}  // namespace unittest
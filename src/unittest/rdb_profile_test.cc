@@ -0,0 +1,64 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "rdb_protocol/profile.hpp"
+#include "rdb_protocol/query_language.pb.h"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+static int64_t counter_value(const Response_Profile &span, const std::string &name) {
+    for (int i = 0; i < span.counter_size(); ++i) {
+        if (span.counter(i).name() == name) {
+            return span.counter(i).value();
+        }
+    }
+    return -1;
+}
+
+TEST(RdbProfileTest, SpansNest) {
+    query_language::profile_t profile;
+    {
+        query_language::profile_span_t execute(&profile, "execute");
+        {
+            query_language::profile_span_t read(&profile, "point_read");
+            read.add_counter("rows", 1);
+        }
+        query_language::profile_span_t js(&profile, "javascript");
+    }
+
+    Response res;
+    profile.write_to(res.mutable_profile());
+    const Response_Profile &root = res.profile();
+    EXPECT_EQ("query", root.name());
+    ASSERT_EQ(1, root.child_size());
+
+    const Response_Profile &execute = root.child(0);
+    EXPECT_EQ("execute", execute.name());
+    EXPECT_LE(execute.duration(), root.duration());
+    ASSERT_EQ(2, execute.child_size());
+    EXPECT_EQ("point_read", execute.child(0).name());
+    EXPECT_EQ(1, counter_value(execute.child(0), "rows"));
+    EXPECT_EQ("javascript", execute.child(1).name());
+    EXPECT_EQ(0, execute.child(1).child_size());
+}
+
+TEST(RdbProfileTest, RepeatedSpansMerge) {
+    query_language::profile_t profile;
+    for (int i = 0; i < 1000; ++i) {
+        query_language::profile_span_t js(&profile, "javascript");
+        js.add_counter("rows", 2);
+    }
+
+    Response res;
+    profile.write_to(res.mutable_profile());
+    ASSERT_EQ(1, res.profile().child_size());
+    EXPECT_EQ(1000, counter_value(res.profile().child(0), "calls"));
+    EXPECT_EQ(2000, counter_value(res.profile().child(0), "rows"));
+}
+
+TEST(RdbProfileTest, NullProfileRecordsNothing) {
+    query_language::profile_span_t span(NULL, "execute");
+    EXPECT_TRUE(span.get() == NULL);
+    span.add_counter("rows", 1);
+}
+
+}  // namespace unittest
@@ -111,5 +111,126 @@ void run_get_set_test(namespace_interface_t<rdb_protocol_t> *nsi, order_source_t
 //    run_in_thread_pool_with_namespace_interface(&run_get_set_test);
 //}
 
+namespace {
+
+class collecting_backfill_callback_t : public send_backfill_callback_t<rdb_protocol_t> {
+public:
+    collecting_backfill_callback_t() : num_checkpoints(0) { }
+
+    void send_chunk(const rdb_protocol_t::backfill_chunk_t &chunk, UNUSED signal_t *interruptor) THROWS_NOTHING {
+        // Only the values are checked; a deleted key just mustn't show up.
+        if (const rdb_protocol_t::backfill_chunk_t::key_value_pair_t *kv = boost::get<rdb_protocol_t::backfill_chunk_t::key_value_pair_t>(&chunk.val)) {
+            EXPECT_EQ(0u, values.count(kv->backfill_atom.key));
+            values[kv->backfill_atom.key] = kv->backfill_atom.value->get()->valueint;
+        }
+    }
+
+    void send_checkpoint(UNUSED const rdb_protocol_t::region_t &region, UNUSED signal_t *interruptor) THROWS_NOTHING {
+        ++num_checkpoints;
+    }
+
+    std::map<store_key_t, int> values;
+    int num_checkpoints;
+
+private:
+    bool should_backfill_impl(UNUSED const rdb_protocol_t::store_t::metainfo_t &metainfo) {
+        return true;
+    }
+};
+
+rdb_protocol_t::backfill_chunk_t set_chunk(int key, int value) {
+    repli_timestamp_t recency;
+    recency.longtime = value;
+    return rdb_protocol_t::backfill_chunk_t::set_key(rdb_protocol_details::backfill_atom_t(
+        store_key_t(strprintf("key%05d", key)),
+        boost::shared_ptr<scoped_cJSON_t>(new scoped_cJSON_t(cJSON_CreateNumber(value))),
+        recency));
+}
+
+void receive_batch(rdb_protocol_t::store_t *store, const std::vector<rdb_protocol_t::backfill_chunk_t> &chunks) {
+    object_buffer_t<fifo_enforcer_sink_t::exit_write_t> write_token;
+    store->new_write_token(&write_token);
+    cond_t interruptor;
+    store->receive_backfill(chunks, &write_token, &interruptor);
+}
+
+}   /* anonymous namespace */
+
+/* `BackfillBatches` applies a backfill in batches, the way the backfillee
+does, and backfills the result back out again.  The first batches are sorted
+and go after everything in the tree, so they take the bulk loading path; the
+last one is shuffled and mixes in deletions, so it takes the one-key-at-a-time
+path.  The store is big enough that the sender cuts it into several key
+sub-ranges, each with its own progress. */
+void run_backfill_batches_test() {
+    mock::temp_file_t temp_file("/tmp/rdb_unittest.XXXXXX");
+
+    scoped_ptr_t<io_backender_t> io_backender;
+    make_io_backender(aio_default, &io_backender);
+
+    filepath_file_opener_t file_opener(temp_file.name(), io_backender.get());
+    standard_serializer_t::create(&file_opener,
+                                  standard_serializer_t::static_config_t());
+    standard_serializer_t serializer(standard_serializer_t::dynamic_config_t(),
+                                     &file_opener,
+                                     &get_global_perfmon_collection());
+
+    rdb_protocol_t::context_t ctx;
+    rdb_protocol_t::store_t store(&serializer, std::string(temp_file.name()) + "_store", GIGABYTE, true, &get_global_perfmon_collection(), &ctx);
+
+    const int num_keys = 2000;
+    const int batch_size = 64;
+    std::map<store_key_t, int> expected;
+
+    for (int start = 0; start < num_keys; start += batch_size) {
+        std::vector<rdb_protocol_t::backfill_chunk_t> chunks;
+        for (int i = start; i < std::min(start + batch_size, num_keys); ++i) {
+            chunks.push_back(set_chunk(i, i + 1));
+            expected[store_key_t(strprintf("key%05d", i))] = i + 1;
+        }
+        receive_batch(&store, chunks);
+    }
+
+    std::vector<rdb_protocol_t::backfill_chunk_t> chunks;
+    for (int i = 0; i < num_keys; i += 7) {
+        repli_timestamp_t recency;
+        recency.longtime = num_keys + i + 1;
+        chunks.push_back(rdb_protocol_t::backfill_chunk_t::delete_key(store_key_t(strprintf("key%05d", i)), recency));
+        expected.erase(store_key_t(strprintf("key%05d", i)));
+    }
+    for (int i = 3; i < num_keys; i += 5) {
+        if (i % 7 != 0) {
+            chunks.push_back(set_chunk(i, 2 * num_keys + i + 1));
+            expected[store_key_t(strprintf("key%05d", i))] = 2 * num_keys + i + 1;
+        }
+    }
+    std::random_shuffle(chunks.begin(), chunks.end());
+    receive_batch(&store, chunks);
+
+    collecting_backfill_callback_t callback;
+    traversal_progress_combiner_t progress;
+    {
+        object_buffer_t<fifo_enforcer_sink_t::exit_read_t> read_token;
+        store.new_read_token(&read_token);
+        cond_t interruptor;
+        ASSERT_TRUE(store.send_backfill(region_map_t<rdb_protocol_t, state_timestamp_t>(store.get_region(), state_timestamp_t::zero()),
+                                        &callback, &progress, &read_token, &interruptor));
+    }
+
+    EXPECT_TRUE(expected == callback.values);
+
+    std::vector<progress_completion_fraction_t> parts = progress.guess_constituent_completions();
+    EXPECT_LT(1u, parts.size());
+    EXPECT_LE(static_cast<int>(parts.size()), callback.num_checkpoints);
+    for (size_t i = 0; i < parts.size(); ++i) {
+        ASSERT_FALSE(parts[i].invalid());
+        EXPECT_LT(0, parts[i].estimate_of_released_nodes);
+    }
+}
+
+TEST(RDBProtocol, BackfillBatches) {
+    mock::run_in_thread_pool(&run_backfill_batches_test);
+}
+
 }   /* namespace unittest */
 
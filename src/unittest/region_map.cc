@@ -44,4 +44,38 @@ TEST(RegionMap, Mask) {
         }
     }
 }
+
+TEST(RegionMap, Update) {
+    region_map_t<dummy_protocol_t, int> rmap(dummy_protocol_t::region_t('a', 'z'), 0);
+    rmap.set(dummy_protocol_t::region_t('a', 'm'), 1);
+    rmap.set(dummy_protocol_t::region_t('g', 'r'), 2);
+
+    EXPECT_TRUE(rmap.get_domain() == dummy_protocol_t::region_t('a', 'z'));
+
+    for (char c = 'a'; c <= 'z'; ++c) {
+        region_map_t<dummy_protocol_t, int> point = rmap.mask(dummy_protocol_t::region_t(c, c));
+        ASSERT_EQ(1u, point.size());
+        int expected = c < 'g' ? 1 : c <= 'r' ? 2 : 0;
+        EXPECT_EQ(expected, point.begin()->second);
+    }
+}
+
+TEST(RegionMap, Coalesce) {
+    region_map_t<dummy_protocol_t, int> rmap(dummy_protocol_t::region_t('a', 'z'), 0);
+    rmap.set(dummy_protocol_t::region_t('a', 'm'), 1);
+    rmap.set(dummy_protocol_t::region_t('n', 'r'), 1);
+    rmap.set(dummy_protocol_t::region_t('s', 'z'), 2);
+    EXPECT_EQ(3u, rmap.size());
+
+    region_map_t<dummy_protocol_t, int> before = rmap;
+    rmap.coalesce();
+    EXPECT_EQ(2u, rmap.size());
+    EXPECT_TRUE(rmap == before);
+
+    rmap.set(dummy_protocol_t::region_t('s', 'z'), 1);
+    rmap.coalesce();
+    ASSERT_EQ(1u, rmap.size());
+    EXPECT_TRUE(rmap.begin()->first == dummy_protocol_t::region_t('a', 'z'));
+    EXPECT_EQ(1, rmap.begin()->second);
+}
 } //namespace unittest
@@ -0,0 +1,68 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include "unittest/gtest.hpp"
+
+#include "containers/binary_blob.hpp"
+#include "memcached/protocol.hpp"
+#include "protocol_api.hpp"
+#include "utils.hpp"
+
+namespace unittest {
+
+/* Times `region_map_t` the way a store's metainfo gets used during a
+backfill: the backfill checkpoints one key range after another with the new
+version, and every write masks the metainfo to its own region to check it. */
+
+typedef memcached_protocol_t::region_t region_t;
+typedef region_map_t<memcached_protocol_t, binary_blob_t> metainfo_t;
+
+static const int NUM_CHECKPOINTS = 1000;
+
+static region_t checkpoint_region(int i) {
+    store_key_t left(strprintf("key%08d", i));
+    if (i == NUM_CHECKPOINTS - 1) {
+        return region_t(key_range_t(key_range_t::closed, left, key_range_t::none, store_key_t()));
+    }
+    store_key_t right(strprintf("key%08d", i + 1));
+    return region_t(key_range_t(key_range_t::closed, left, key_range_t::open, right));
+}
+
+static double run_checkpoints(bool coalesce, metainfo_t *metainfo_out) {
+    metainfo_t metainfo(region_t::universe(), binary_blob_t(0));
+    ticks_t start = get_ticks();
+    for (int i = 0; i < NUM_CHECKPOINTS; ++i) {
+        metainfo.update(metainfo_t(checkpoint_region(i), binary_blob_t(1)));
+        if (coalesce) {
+            metainfo.coalesce();
+        }
+        metainfo_t masked = metainfo.mask(checkpoint_region(i / 2));
+        EXPECT_EQ(1u, masked.size());
+    }
+    *metainfo_out = metainfo;
+    return ticks_to_secs(get_ticks() - start);
+}
+
+TEST(RegionMapBenchmark, BackfillCheckpoints) {
+    metainfo_t fragmented, coalesced;
+    double fragmented_secs = run_checkpoints(false, &fragmented);
+    double coalesced_secs = run_checkpoints(true, &coalesced);
+
+    printf("%d checkpoints: %.3fs leaving %zu pairs, %.3fs coalesced leaving %zu pairs\n",
+           NUM_CHECKPOINTS, fragmented_secs, fragmented.size(), coalesced_secs, coalesced.size());
+
+    // Everything from the first checkpoint on has the new version; only the
+    // keys before it still have the old one.
+    EXPECT_EQ(2u, coalesced.size());
+    EXPECT_TRUE(fragmented == coalesced);
+
+    // Masking a fragmented map has to look at every pair, but it shouldn't
+    // have to intersect the ones it skips or wholly contains.
+    ticks_t start = get_ticks();
+    for (int i = 0; i < NUM_CHECKPOINTS; ++i) {
+        metainfo_t masked = fragmented.mask(checkpoint_region(i));
+        EXPECT_EQ(1u, masked.size());
+    }
+    printf("%d masks of a %zu-pair map: %.3fs\n",
+           NUM_CHECKPOINTS, fragmented.size(), ticks_to_secs(get_ticks() - start));
+}
+
+}  // namespace unittest
@@ -1,4 +1,13 @@
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include "arch/runtime/starter.hpp"
+#include "arch/timing.hpp"
+#include "concurrency/cond_var.hpp"
+#include "perfmon/collect.hpp"
 #include "serializer/config.hpp"
 #include "unittest/mock_file.hpp"
 #include "unittest/gtest.hpp"
@@ -20,5 +29,226 @@ TEST(SerializerTest, CreateConstructDestroy) {
     run_in_thread_pool(run_CreateConstructDestroy, 4);
 }
 
+static const int compressed_test_blocks = 64;
+
+static void fill_compressible_block(void *buf, block_size_t block_size, block_id_t block_id, int version) {
+    std::string text;
+    while (text.size() < block_size.value()) {
+        text += strprintf("{\"block\": %u, \"version\": %d}, ", block_id, version);
+    }
+    memcpy(buf, text.data(), block_size.value());
+}
+
+static int64_t get_serializer_stat(const char *collection_name, const char *stat_name) {
+    scoped_ptr_t<perfmon_result_t> stats(perfmon_get_stats());
+    perfmon_result_t::iterator collection = stats->get_map()->find(collection_name);
+    guarantee(collection != stats->end());
+    perfmon_result_t::iterator serializer = collection->second->get_map()->find("serializer");
+    guarantee(serializer != collection->second->end());
+    perfmon_result_t::iterator stat = serializer->second->get_map()->find(stat_name);
+    guarantee(stat != serializer->second->end());
+    return strtoll(stat->second->get_string()->c_str(), NULL, 10);
+}
+
+/* Checks that every block has the contents it was last written with, and is
+stored compressed. */
+static void check_compressed_blocks(standard_serializer_t *ser, const std::vector<int> &versions) {
+    void *buf = ser->malloc();
+    void *expected = ser->malloc();
+    for (block_id_t i = 0; i < versions.size(); ++i) {
+        intrusive_ptr_t<standard_block_token_t> token = ser->index_read(i);
+        ASSERT_TRUE(token);
+        EXPECT_GT(token->compressed_sectors(), 0u);
+        ser->block_read(token, buf, DEFAULT_DISK_ACCOUNT);
+        fill_compressible_block(expected, ser->get_block_size(), i, versions[i]);
+        EXPECT_EQ(0, memcmp(buf, expected, ser->get_block_size().value())) << "block " << i;
+    }
+    ser->free(expected);
+    ser->free(buf);
+}
+
+/* Writes compressible blocks with compression on, overwrites half of them until
+the GC has moved some of the others, and then reads them all back, before and
+after reopening the file. */
+void run_CompressedBlocksSurviveGCAndRestart() {
+    perfmon_collection_t collection;
+    perfmon_membership_t membership(&get_global_perfmon_collection(), &collection, "compressed_serializer_test");
+
+    mock_file_opener_t file_opener;
+    standard_serializer_t::static_config_t static_config;
+    static_config.block_size_ = 4 * DEVICE_BLOCK_SIZE;
+    standard_serializer_t::create(&file_opener, static_config);
+    standard_serializer_t::dynamic_config_t dynamic_config;
+    dynamic_config.compress_blocks = true;
+
+    std::vector<int> versions(compressed_test_blocks, 0);
+    {
+        standard_serializer_t ser(dynamic_config, &file_opener, &collection);
+        const block_size_t block_size = ser.get_block_size();
+        std::vector<void *> bufs;
+        for (block_id_t i = 0; i < compressed_test_blocks; ++i) {
+            bufs.push_back(ser.malloc());
+        }
+
+        std::vector<serializer_write_t> writes;
+        for (block_id_t i = 0; i < compressed_test_blocks; ++i) {
+            fill_compressible_block(bufs[i], block_size, i, 0);
+            writes.push_back(serializer_write_t::make_update(i, repli_timestamp_t::distant_past, bufs[i]));
+        }
+        do_writes(&ser, writes, DEFAULT_DISK_ACCOUNT);
+
+        // Only the even blocks get overwritten, so the GC has to move the odd
+        // ones out of the extents it collects.
+        for (int round = 1; get_serializer_stat("compressed_serializer_test", "serializer_data_extents_gced") == 0; ++round) {
+            ASSERT_LT(round, 1000) << "the GC never ran";
+            writes.clear();
+            for (block_id_t i = 0; i < compressed_test_blocks; i += 2) {
+                versions[i] = round;
+                fill_compressible_block(bufs[i], block_size, i, round);
+                writes.push_back(serializer_write_t::make_update(i, repli_timestamp_t::distant_past, bufs[i]));
+            }
+            do_writes(&ser, writes, DEFAULT_DISK_ACCOUNT);
+            // Give the GC a chance to run.
+            nap(1);
+        }
+
+        for (size_t i = 0; i < bufs.size(); ++i) {
+            ser.free(bufs[i]);
+        }
+
+        check_compressed_blocks(&ser, versions);
+    }
+
+    standard_serializer_t ser(dynamic_config, &file_opener, &collection);
+    check_compressed_blocks(&ser, versions);
+}
+
+TEST(SerializerTest, CompressedBlocksSurviveGCAndRestart) {
+    run_in_thread_pool(run_CompressedBlocksSurviveGCAndRestart, 1);
+}
+
+// Enough blocks to fill a few extents, so that the ones written first aren't in
+// the active extent, which the scrubber leaves alone.
+static const int checksum_test_blocks = 3 * DEFAULT_EXTENT_SIZE / DEFAULT_BTREE_BLOCK_SIZE;
+
+static std::string checksum_test_tag(block_id_t block_id) {
+    return strprintf("<checksum test block %u>", block_id);
+}
+
+static void fill_tagged_block(void *buf, block_size_t block_size, block_id_t block_id) {
+    std::string text = checksum_test_tag(block_id);
+    while (text.size() < block_size.value()) {
+        text += strprintf("%u ", block_id);
+    }
+    memcpy(buf, text.data(), block_size.value());
+}
+
+/* Creates a serializer file with `checksum_test_blocks` blocks in it, and then
+flips a bit in block `corrupt_id`. Each block was written once, so the file
+has exactly one copy of it. */
+static void write_and_corrupt_blocks(mock_file_opener_t *file_opener, block_id_t corrupt_id) {
+    standard_serializer_t::create(file_opener, standard_serializer_t::static_config_t());
+    {
+        perfmon_collection_t collection;
+        standard_serializer_t ser(standard_serializer_t::dynamic_config_t(), file_opener, &collection);
+        std::vector<void *> bufs;
+        std::vector<serializer_write_t> writes;
+        for (block_id_t i = 0; i < checksum_test_blocks; ++i) {
+            bufs.push_back(ser.malloc());
+            fill_tagged_block(bufs[i], ser.get_block_size(), i);
+            writes.push_back(serializer_write_t::make_update(i, repli_timestamp_t::distant_past, bufs[i]));
+        }
+        do_writes(&ser, writes, DEFAULT_DISK_ACCOUNT);
+        for (size_t i = 0; i < bufs.size(); ++i) {
+            ser.free(bufs[i]);
+        }
+    }
+
+    std::vector<char> *contents = file_opener->file_contents();
+    const std::string tag = checksum_test_tag(corrupt_id);
+    std::vector<char>::iterator it = std::search(contents->begin(), contents->end(), tag.begin(), tag.end());
+    guarantee(it != contents->end());
+    guarantee(std::search(it + 1, contents->end(), tag.begin(), tag.end()) == contents->end());
+    *(it + tag.size()) ^= 0x10;
+}
+
+static const block_id_t checksum_test_corrupt_id = 17;
+
+/* Reads every block but the corrupt one, which should all check out, and then
+the corrupt one, which should crash. */
+void run_ReadsVerifyChecksums() {
+    mock_file_opener_t file_opener;
+    write_and_corrupt_blocks(&file_opener, checksum_test_corrupt_id);
+
+    perfmon_collection_t collection;
+    standard_serializer_t ser(standard_serializer_t::dynamic_config_t(), &file_opener, &collection);
+    void *buf = ser.malloc();
+    void *expected = ser.malloc();
+    for (block_id_t i = 0; i < checksum_test_blocks; ++i) {
+        if (i == checksum_test_corrupt_id) {
+            continue;
+        }
+        ser.block_read(ser.index_read(i), buf, DEFAULT_DISK_ACCOUNT);
+        fill_tagged_block(expected, ser.get_block_size(), i);
+        guarantee(memcmp(buf, expected, ser.get_block_size().value()) == 0);
+    }
+    ser.block_read(ser.index_read(checksum_test_corrupt_id), buf, DEFAULT_DISK_ACCOUNT);
+    ser.free(expected);
+    ser.free(buf);
+}
+
+TEST(SerializerTest, ReadsVerifyChecksums) {
+    EXPECT_DEATH(run_in_thread_pool(run_ReadsVerifyChecksums, 1), "doesn't match its checksum");
+}
+
+class recording_corruption_callback_t : public serializer_corruption_callback_t {
+public:
+    void on_corrupt_block(block_id_t block_id, UNUSED off64_t offset) {
+        block_ids.push_back(block_id);
+        reported.pulse_if_not_already_pulsed();
+    }
+
+    std::vector<block_id_t> block_ids;
+    cond_t reported;
+};
+
+/* Reopens a file with a flipped bit in one block and checks that the scrubber
+finds that block, and only that block. */
+void run_ScrubberReportsFlippedBit() {
+    mock_file_opener_t file_opener;
+    write_and_corrupt_blocks(&file_opener, checksum_test_corrupt_id);
+
+    perfmon_collection_t collection;
+    perfmon_membership_t membership(&get_global_perfmon_collection(), &collection, "scrubber_serializer_test");
+    standard_serializer_t::dynamic_config_t dynamic_config;
+    dynamic_config.scrub_bytes_per_sec = 64 * MEGABYTE;
+    standard_serializer_t ser(dynamic_config, &file_opener, &collection);
+    recording_corruption_callback_t callback;
+    ser.register_corruption_cb(&callback);
+
+    for (int i = 0; !callback.reported.is_pulsed(); ++i) {
+        ASSERT_LT(i, 1000) << "the scrubber never found the corrupt block";
+        nap(10);
+    }
+    // Give it a full pass over the file after the first report, to see that
+    // nothing else gets reported.
+    const int64_t scrubbed = get_serializer_stat("scrubber_serializer_test", "serializer_extents_scrubbed");
+    const int64_t file_extents = ceil_divide(file_opener.file_contents()->size(), DEFAULT_EXTENT_SIZE);
+    while (get_serializer_stat("scrubber_serializer_test", "serializer_extents_scrubbed") < scrubbed + file_extents) {
+        nap(10);
+    }
+    ser.unregister_corruption_cb(&callback);
+
+    ASSERT_FALSE(callback.block_ids.empty());
+    for (size_t i = 0; i < callback.block_ids.size(); ++i) {
+        EXPECT_EQ(checksum_test_corrupt_id, callback.block_ids[i]);
+    }
+    EXPECT_EQ(static_cast<int64_t>(callback.block_ids.size()),
+              get_serializer_stat("scrubber_serializer_test", "serializer_corrupt_blocks"));
+}
+
+TEST(SerializerTest, ScrubberReportsFlippedBit) {
+    run_in_thread_pool(run_ScrubberReportsFlippedBit, 1);
+}
 
 }  // namespace unittest
@@ -63,8 +63,6 @@ void server_test_helper_t::run_serializer_tests() {
     cache_cfg.max_size = GIGABYTE;
     cache_t cache(this->serializer, &cache_cfg, &get_global_perfmon_collection());
 
-    nap(200);   // to let patch_disk_storage do writeback.sync();
-
     run_tests(&cache);
 }
 
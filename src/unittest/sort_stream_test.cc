@@ -0,0 +1,147 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "errors.hpp"
+#include <boost/make_shared.hpp>
+
+#include "arch/io/disk.hpp"
+#include "mock/unittest_utils.hpp"
+#include "rdb_protocol/stream.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+static bool number_less(const boost::shared_ptr<scoped_cJSON_t> &x, const boost::shared_ptr<scoped_cJSON_t> &y) {
+    return x->get()->valuedouble < y->get()->valuedouble;
+}
+
+// The numbers 0 to n - 1, shuffled.
+static boost::shared_ptr<query_language::json_stream_t> make_shuffled_stream(int n) {
+    scoped_cJSON_t array(cJSON_CreateArray());
+    for (int i = 0; i < n; ++i) {
+        array.AddItemToArray(cJSON_CreateNumber((i * 7919) % n));
+    }
+    return boost::make_shared<query_language::in_memory_stream_t>(json_array_iterator_t(array.get()));
+}
+
+static void check_sorted(query_language::sort_stream_t *stream, int expected_count) {
+    for (int i = 0; i < expected_count; ++i) {
+        boost::shared_ptr<scoped_cJSON_t> row = stream->next();
+        ASSERT_TRUE(row);
+        EXPECT_EQ(i, row->get()->valueint);
+    }
+    EXPECT_FALSE(stream->next());
+}
+
+static void run_in_memory_test() {
+    query_language::sort_stream_t stream(make_shuffled_stream(1000), &number_less, 0, NULL, "");
+    check_sorted(&stream, 1000);
+    EXPECT_EQ(0u, stream.num_spilled_runs());
+}
+
+TEST(SortStreamTest, InMemory) {
+    mock::run_in_thread_pool(&run_in_memory_test);
+}
+
+static void run_top_k_test() {
+    query_language::sort_stream_t stream(make_shuffled_stream(1000), &number_less, 10, NULL, "");
+    check_sorted(&stream, 10);
+}
+
+TEST(SortStreamTest, TopK) {
+    mock::run_in_thread_pool(&run_top_k_test);
+}
+
+static void run_parallel_test() {
+    // Big enough for the run to get split up between the threads.
+    const int n = 4 * query_language::sort_stream_t::MIN_ROWS_PER_SORT_TASK + 17;
+    query_language::sort_stream_t stream(make_shuffled_stream(n), &number_less, 0, NULL, "");
+    check_sorted(&stream, n);
+}
+
+TEST(SortStreamTest, Parallel) {
+    mock::run_in_thread_pool(&run_parallel_test, 4);
+}
+
+static void run_spill_test() {
+    scoped_ptr_t<io_backender_t> io_backender;
+    make_io_backender(aio_default, &io_backender);
+    char spill_dir[] = "/tmp/rdb_unittest.XXXXXX";
+    guarantee_err(mkdtemp(spill_dir) != NULL, "Couldn't create a temporary directory");
+
+    {
+        // A tiny budget, so that we get several runs on disk.
+        query_language::sort_stream_t stream(make_shuffled_stream(1000), &number_less, 0, io_backender.get(), spill_dir, 10 * KILOBYTE);
+        check_sorted(&stream, 1000);
+        EXPECT_LT(1u, stream.num_spilled_runs());
+    }
+
+    // The runs don't leave anything behind.
+    EXPECT_EQ(0, rmdir(spill_dir));
+}
+
+TEST(SortStreamTest, Spill) {
+    mock::run_in_thread_pool(&run_spill_test, 2);
+}
+
+static bool key_less(const boost::shared_ptr<scoped_cJSON_t> &x, const boost::shared_ptr<scoped_cJSON_t> &y) {
+    return cJSON_GetObjectItem(x->get(), "key")->valueint < cJSON_GetObjectItem(y->get(), "key")->valueint;
+}
+
+static int tied_key(int position) {
+    return (position * 7919) % 10;
+}
+
+// `n` rows with only a few different keys, and each row's position.
+static boost::shared_ptr<query_language::json_stream_t> make_tied_stream(int n) {
+    scoped_cJSON_t array(cJSON_CreateArray());
+    for (int i = 0; i < n; ++i) {
+        cJSON *row = cJSON_CreateObject();
+        cJSON_AddItemToObject(row, "key", cJSON_CreateNumber(tied_key(i)));
+        cJSON_AddItemToObject(row, "position", cJSON_CreateNumber(i));
+        array.AddItemToArray(row);
+    }
+    return boost::make_shared<query_language::in_memory_stream_t>(json_array_iterator_t(array.get()));
+}
+
+static std::vector<int> read_positions(query_language::sort_stream_t *stream) {
+    std::vector<int> positions;
+    while (boost::shared_ptr<scoped_cJSON_t> row = stream->next()) {
+        positions.push_back(cJSON_GetObjectItem(row->get(), "position")->valueint);
+    }
+    return positions;
+}
+
+static void run_ties_test() {
+    // Big enough for the run without a limit to get split up between the threads.
+    const int n = 4 * query_language::sort_stream_t::MIN_ROWS_PER_SORT_TASK + 17;
+    query_language::sort_stream_t unlimited(make_tied_stream(n), &key_less, 0, NULL, "");
+    std::vector<int> expected = read_positions(&unlimited);
+    ASSERT_EQ(static_cast<size_t>(n), expected.size());
+
+    // Equal rows come out in the order they went in...
+    for (int i = 1; i < n; ++i) {
+        if (tied_key(expected[i - 1]) == tied_key(expected[i])) {
+            EXPECT_LT(expected[i - 1], expected[i]);
+        }
+    }
+
+    // ...and the same way with a limit.
+    const size_t limits[] = { 1, 100, n / 3, n };
+    for (size_t l = 0; l < sizeof(limits) / sizeof(limits[0]); ++l) {
+        query_language::sort_stream_t limited(make_tied_stream(n), &key_less, limits[l], NULL, "");
+        std::vector<int> positions = read_positions(&limited);
+        ASSERT_EQ(limits[l], positions.size());
+        EXPECT_TRUE(std::equal(positions.begin(), positions.end(), expected.begin())) << "limit " << limits[l];
+    }
+}
+
+TEST(SortStreamTest, TiesKeepTheirOrder) {
+    mock::run_in_thread_pool(&run_ties_test, 4);
+}
+
+}  // namespace unittest
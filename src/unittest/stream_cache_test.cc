@@ -0,0 +1,136 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <string>
+
+#include "errors.hpp"
+#include <boost/make_shared.hpp>
+
+#include "concurrency/cond_var.hpp"
+#include "mock/unittest_utils.hpp"
+#include "rdb_protocol/profile.hpp"
+#include "rdb_protocol/stream.hpp"
+#include "rdb_protocol/stream_cache.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+static boost::shared_ptr<query_language::json_stream_t> make_stream(int n) {
+    scoped_cJSON_t array(cJSON_CreateArray());
+    for (int i = 0; i < n; ++i) {
+        array.AddItemToArray(cJSON_CreateNumber(i));
+    }
+    return boost::make_shared<query_language::in_memory_stream_t>(json_array_iterator_t(array.get()));
+}
+
+static void run_row_chunks_test() {
+    stream_cache_t cache;
+    ReadQuery rq;
+    rq.set_max_chunk_size(2);
+    cache.insert(&rq, 1, make_stream(3));
+
+    cond_t interruptor;
+    Response res;
+    ASSERT_TRUE(cache.serve(1, &res, &interruptor, NULL));
+    EXPECT_EQ(Response::SUCCESS_PARTIAL, res.status_code());
+    EXPECT_EQ(2, res.response_size());
+
+    Response res2;
+    ASSERT_TRUE(cache.serve(1, &res2, &interruptor, NULL));
+    EXPECT_EQ(Response::SUCCESS_STREAM, res2.status_code());
+    EXPECT_EQ(1, res2.response_size());
+    EXPECT_FALSE(cache.contains(1));
+    EXPECT_EQ(0u, cache.estimated_bytes());
+}
+
+TEST(StreamCacheTest, RowChunks) {
+    mock::run_in_thread_pool(&run_row_chunks_test);
+}
+
+static void run_profiled_serve_test() {
+    stream_cache_t cache;
+    ReadQuery rq;
+    rq.set_max_chunk_size(2);
+    cache.insert(&rq, 1, make_stream(3));
+
+    cond_t interruptor;
+    query_language::profile_t profile;
+    Response res;
+    ASSERT_TRUE(cache.serve(1, &res, &interruptor, &profile));
+    profile.write_to(res.mutable_profile());
+
+    ASSERT_EQ(1, res.profile().child_size());
+    const Response_Profile &serve = res.profile().child(0);
+    EXPECT_EQ("serve", serve.name());
+    bool found_rows = false;
+    for (int i = 0; i < serve.counter_size(); ++i) {
+        if (serve.counter(i).name() == "rows") {
+            EXPECT_EQ(2, serve.counter(i).value());
+            found_rows = true;
+        }
+    }
+    EXPECT_TRUE(found_rows);
+    ASSERT_EQ(1, serve.child_size());
+    EXPECT_EQ("serialize_json", serve.child(0).name());
+}
+
+TEST(StreamCacheTest, ProfiledServe) {
+    mock::run_in_thread_pool(&run_profiled_serve_test);
+}
+
+static void run_evicts_lru_test() {
+    stream_cache_t cache(2);
+    ReadQuery rq;
+    rq.set_max_chunk_size(1);
+    cond_t interruptor;
+
+    cache.insert(&rq, 1, make_stream(10));
+    cache.insert(&rq, 2, make_stream(10));
+
+    // Touch 1 so that 2 becomes the least recently used.
+    Response res;
+    ASSERT_TRUE(cache.serve(1, &res, &interruptor, NULL));
+
+    cache.insert(&rq, 3, make_stream(10));
+    EXPECT_EQ(2u, cache.num_streams());
+    EXPECT_TRUE(cache.contains(1));
+    EXPECT_FALSE(cache.contains(2));
+    EXPECT_TRUE(cache.contains(3));
+
+    std::string reason;
+    EXPECT_TRUE(cache.was_evicted(2, &reason));
+    EXPECT_FALSE(reason.empty());
+    EXPECT_FALSE(cache.was_evicted(1, &reason));
+
+    Response res2;
+    EXPECT_FALSE(cache.serve(2, &res2, &interruptor, NULL));
+}
+
+TEST(StreamCacheTest, EvictsLeastRecentlyUsed) {
+    mock::run_in_thread_pool(&run_evicts_lru_test);
+}
+
+static void run_memory_budget_test() {
+    // Big enough for one partially consumed cursor, but not for two.
+    stream_cache_t cache(stream_cache_t::DEFAULT_MAX_STREAMS, 5);
+    ReadQuery rq;
+    rq.set_max_chunk_size(3);
+    cond_t interruptor;
+
+    cache.insert(&rq, 1, make_stream(10));
+    cache.insert(&rq, 2, make_stream(10));
+
+    Response res;
+    ASSERT_TRUE(cache.serve(1, &res, &interruptor, NULL));
+    Response res2;
+    ASSERT_TRUE(cache.serve(2, &res2, &interruptor, NULL));
+
+    EXPECT_FALSE(cache.contains(1));
+    EXPECT_TRUE(cache.contains(2));
+    std::string reason;
+    EXPECT_TRUE(cache.was_evicted(1, &reason));
+}
+
+TEST(StreamCacheTest, MemoryBudget) {
+    mock::run_in_thread_pool(&run_memory_budget_test);
+}
+
+}  // namespace unittest
@@ -0,0 +1,195 @@
+// Copyright 2010-2012 RethinkDB, all rights reserved.
+#include <boost/bind.hpp>
+
+#include "arch/runtime/coroutines.hpp"
+#include "buffer_cache/buffer_cache.hpp"
+#include "buffer_cache/mirrored/write_throttle.hpp"
+#include "concurrency/cond_var.hpp"
+#include "perfmon/perfmon.hpp"
+#include "serializer/translator.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/server_test_helper.hpp"
+
+namespace unittest {
+
+static const ticks_t ms = 1000000;
+
+TEST(WriteThrottleTest, NoDelayWithoutPressure) {
+    write_throttle_t throttle(1000, 0.5, 100 * ms);
+    throttle.on_flush_finished(100, 1000 * ms);
+
+    // Below the throttle point, everybody starts right away.
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(ms, throttle.admit(500, 10, ms));
+    }
+}
+
+TEST(WriteThrottleTest, NoDelayWithoutBandwidthEstimate) {
+    write_throttle_t throttle(1000, 0.5, 100 * ms);
+    EXPECT_EQ(ms, throttle.admit(999, 10, ms));
+    EXPECT_EQ(ms, throttle.admit(999, 10, ms));
+}
+
+TEST(WriteThrottleTest, DelayGrowsWithPressure) {
+    ticks_t previous_delay = 0;
+    for (unsigned int dirty = 600; dirty < 1000; dirty += 100) {
+        write_throttle_t throttle(1000, 0.5, 100 * ms);
+        throttle.on_flush_finished(1000, 1000 * ms);
+        ticks_t first = throttle.admit(dirty, 10, ms);
+        ticks_t second = throttle.admit(dirty, 10, ms);
+        EXPECT_EQ(ms, first);
+        EXPECT_GT(second - first, previous_delay);
+        previous_delay = second - first;
+    }
+}
+
+TEST(WriteThrottleTest, MatchesFlushBandwidthHalfwayToLimit) {
+    // 1000 blocks/sec, and we're halfway between the throttle point and the
+    // limit, so a transaction dirtying 10 blocks should take up 10ms.
+    write_throttle_t throttle(1000, 0.5, 100 * ms);
+    throttle.on_flush_finished(1000, 1000 * ms);
+    ticks_t first = throttle.admit(750, 10, ms);
+    ticks_t second = throttle.admit(750, 10, ms);
+    ticks_t third = throttle.admit(750, 10, ms);
+    EXPECT_NEAR(10 * ms, second - first, ms / 100);
+    EXPECT_NEAR(10 * ms, third - second, ms / 100);
+}
+
+TEST(WriteThrottleTest, DelayIsCapped) {
+    write_throttle_t throttle(1000, 0.5, 100 * ms);
+    throttle.on_flush_finished(1, 1000 * ms);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_LE(throttle.admit(1000, 100, ms), 101 * ms);
+    }
+}
+
+TEST(WriteThrottleTest, RecoversAfterPressure) {
+    write_throttle_t throttle(1000, 0.5, 100 * ms);
+    throttle.on_flush_finished(1000, 1000 * ms);
+
+    // At the hard limit, the next transaction has to wait the longest.
+    EXPECT_EQ(ms, throttle.admit(1000, 10, ms));
+    EXPECT_EQ(101 * ms, throttle.admit(1000, 10, ms));
+
+    // Once the flush has caught up, nobody waits any more.
+    for (int i = 0; i < 10; ++i) {
+        ticks_t now = (200 + i) * ms;
+        EXPECT_EQ(now, throttle.admit(100, 10, now));
+    }
+}
+
+TEST(WriteThrottleTest, FlushesEarlyWhenDirtyingFast) {
+    write_throttle_t throttle(1000, 0.5, 100 * ms);
+    EXPECT_FALSE(throttle.should_flush_early(100));
+
+    // Flushes clean 1000 blocks/sec, so flushing 100 blocks takes 100ms.
+    throttle.on_flush_finished(1000, 1000 * ms);
+
+    // Dirtying 1000 blocks/sec, we'd reach the throttle point in 400ms: no hurry.
+    for (int i = 1; i <= 200; ++i) {
+        throttle.on_blocks_dirtied(1, i * ms);
+    }
+    EXPECT_NEAR(1000, throttle.get_dirty_rate(), 20);
+    EXPECT_FALSE(throttle.should_flush_early(100));
+
+    // At 10000 blocks/sec, we'd be there in 40ms.
+    for (int i = 1; i <= 10000; ++i) {
+        throttle.on_blocks_dirtied(1, 200 * ms + i * ms / 10);
+    }
+    EXPECT_GT(throttle.get_dirty_rate(), 5000);
+    EXPECT_TRUE(throttle.should_flush_early(100));
+
+    // Past the throttle point we always want a flush.
+    EXPECT_TRUE(throttle.should_flush_early(600));
+}
+
+/* Runs write transactions through a real cache, with full perfmon off, after
+the cache has been at its dirty block limit once. */
+class write_throttle_tester_t : public server_test_helper_t {
+protected:
+    static const int max_dirty_blocks = 100;
+
+    void run_serializer_tests() {
+        bool old_full_perfmon = global_full_perfmon;
+        global_full_perfmon = false;
+
+        mirrored_cache_static_config_t cache_static_cfg;
+        cache_t::create(serializer, &cache_static_cfg);
+        mirrored_cache_config_t cache_cfg;
+        cache_cfg.max_size = GIGABYTE;
+        cache_cfg.max_dirty_size = max_dirty_blocks * serializer->get_block_size().ser_value();
+        cache_cfg.flush_dirty_size = 0;
+        cache_cfg.flush_timer_ms = 1000000;
+        // So that every write transaction waits for its flush, and we know
+        // the flush bandwidth before the cache fills up.
+        cache_cfg.wait_for_flush = true;
+        cache_t cache(serializer, &cache_cfg, &get_global_perfmon_collection());
+
+        run_tests(&cache);
+
+        global_full_perfmon = old_full_perfmon;
+    }
+
+    void run_tests(cache_t *cache) {
+        order_source_t order_source;
+
+        // Gets the throttle an estimate of the flush bandwidth.
+        {
+            transaction_t txn(cache, rwi_write, 0, repli_timestamp_t::distant_past,
+                              order_source.check_in("write_throttle_tester_t(warmup)"));
+            dirty_new_blocks(&txn, 10);
+        }
+
+        // Fills the cache up to the hard limit and starts a transaction while
+        // it's there, which makes the transaction after it wait the longest.
+        // That one has to run in its own coroutine, because it waits for the
+        // flush that can't start until `fill_txn` is done.
+        {
+            scoped_ptr_t<transaction_t> fill_txn(new transaction_t(cache, rwi_write, 0, repli_timestamp_t::distant_past,
+                                                                   order_source.check_in("write_throttle_tester_t(fill)")));
+            dirty_new_blocks(fill_txn.get(), max_dirty_blocks);
+            cond_t at_limit_done;
+            coro_t::spawn_now_dangerously(boost::bind(&write_throttle_tester_t::begin_at_limit,
+                                                      cache, order_source.check_in("write_throttle_tester_t(at limit)"),
+                                                      &at_limit_done));
+            fill_txn.reset();
+            at_limit_done.wait();
+        }
+
+        // The flush is done, so at most the first of these should have to
+        // wait, and not for longer than `WRITEBACK_MAX_THROTTLE_DELAY_MS`.
+        ticks_t waited = 0;
+        for (int i = 0; i < 5; ++i) {
+            ticks_t start = get_ticks();
+            transaction_t txn(cache, rwi_write, 0, repli_timestamp_t::distant_past,
+                              order_source.check_in("write_throttle_tester_t(after)"));
+            waited += get_ticks() - start;
+            dirty_new_blocks(&txn, 1);
+        }
+        EXPECT_LT(ticks_to_secs(waited), 2 * WRITEBACK_MAX_THROTTLE_DELAY_MS / 1000.0);
+    }
+
+private:
+    static void begin_at_limit(cache_t *cache, order_token_t token, cond_t *done) {
+        {
+            transaction_t txn(cache, rwi_write, 0, repli_timestamp_t::distant_past, token);
+            // So that committing it starts a flush if there isn't one coming
+            // already; otherwise it would wait for one forever.
+            dirty_new_blocks(&txn, 1);
+        }
+        done->pulse();
+    }
+
+    static void dirty_new_blocks(transaction_t *txn, int n) {
+        for (int i = 0; i < n; ++i) {
+            buf_lock_t buf(txn);
+            change_value(&buf, init_value);
+        }
+    }
+};
+
+TEST(WriteThrottleTest, CacheRecoversAfterPressure) {
+    write_throttle_tester_t().run();
+}
+
+}  // namespace unittest